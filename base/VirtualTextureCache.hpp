@@ -0,0 +1,245 @@
+/*
+* Virtual texture feedback resolve and page cache
+*
+* CPU side of feedback driven virtual texturing, free of Vulkan so it can be used and tested without a device
+*
+* Copyright (C) 2026 by the colefet/Vulkan contributors
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <algorithm>
+
+namespace vks
+{
+	/** @brief Mip level and page coordinates of a virtual texture page packed into 32 bits (8 bit mip, 12 bit y, 12 bit x) */
+	struct VirtualPageId
+	{
+		static const uint32_t invalid = 0xFFFFFFFF;
+
+		static uint32_t pack(uint32_t mipLevel, uint32_t x, uint32_t y)
+		{
+			return (mipLevel << 24) | (y << 12) | x;
+		}
+		static uint32_t mipLevel(uint32_t id) { return id >> 24; }
+		static uint32_t y(uint32_t id) { return (id >> 12) & 0xFFF; }
+		static uint32_t x(uint32_t id) { return id & 0xFFF; }
+		/** @brief Page of the next coarser mip level covering the same texels */
+		static uint32_t parent(uint32_t id)
+		{
+			return pack(mipLevel(id) + 1, x(id) / 2, y(id) / 2);
+		}
+	};
+
+	/**
+	* Turns the page ids written by the feedback pass into a list of page requests
+	*
+	* Every page referenced by the feedback is requested together with its coarser parents up to the mip tail, so a
+	* coarse fallback is always streamed in before the finer pages. Requests are ordered coarse to fine and by the
+	* number of feedback samples referencing them.
+	*/
+	class FeedbackResolver
+	{
+	public:
+		struct Request {
+			uint32_t page;
+			// Feedback samples referencing this page or one of its finer children
+			uint32_t count;
+		};
+
+		/**
+		* Set the page layout of the virtual texture
+		*
+		* @param width Width of the virtual texture's first mip level
+		* @param height Height of the virtual texture's first mip level
+		* @param pageWidth Width of a page in texels
+		* @param pageHeight Height of a page in texels
+		* @param pagedLevels Number of mip levels stored as pages, coarser levels are in the always resident mip tail
+		*/
+		void setLayout(uint32_t width, uint32_t height, uint32_t pageWidth, uint32_t pageHeight, uint32_t pagedLevels)
+		{
+			pagesX.resize(pagedLevels);
+			pagesY.resize(pagedLevels);
+			for (uint32_t level = 0; level < pagedLevels; level++) {
+				pagesX[level] = (std::max(width >> level, 1u) + pageWidth - 1) / pageWidth;
+				pagesY[level] = (std::max(height >> level, 1u) + pageHeight - 1) / pageHeight;
+			}
+		}
+
+		uint32_t getPagedLevels() const { return static_cast<uint32_t>(pagesX.size()); }
+		uint32_t getPagesX(uint32_t level) const { return pagesX[level]; }
+		uint32_t getPagesY(uint32_t level) const { return pagesY[level]; }
+
+		/** @brief False for the invalid id and for pages outside of the paged levels */
+		bool isValid(uint32_t page) const
+		{
+			if (page == VirtualPageId::invalid) {
+				return false;
+			}
+			const uint32_t level = VirtualPageId::mipLevel(page);
+			return (level < pagesX.size()) && (VirtualPageId::x(page) < pagesX[level]) && (VirtualPageId::y(page) < pagesY[level]);
+		}
+
+		/**
+		* Resolve feedback into page requests
+		*
+		* @param feedback Page ids written by the feedback pass, VirtualPageId::invalid for samples without a request
+		* @param count Number of entries in feedback
+		*
+		* @return Requested pages, coarse to fine
+		*/
+		const std::vector<Request> &resolve(const uint32_t *feedback, size_t count)
+		{
+			counts.clear();
+			for (size_t i = 0; i < count; i++) {
+				if (isValid(feedback[i])) {
+					counts[feedback[i]]++;
+				}
+			}
+			// Parents inherit the samples of their children
+			for (uint32_t level = 0; level + 1 < pagesX.size(); level++) {
+				for (auto &entry : counts) {
+					if (VirtualPageId::mipLevel(entry.first) == level) {
+						parents.push_back(entry);
+					}
+				}
+				for (auto &entry : parents) {
+					counts[VirtualPageId::parent(entry.first)] += entry.second;
+				}
+				parents.clear();
+			}
+
+			requests.clear();
+			for (auto &entry : counts) {
+				requests.push_back({ entry.first, entry.second });
+			}
+			std::sort(requests.begin(), requests.end(), [](const Request &a, const Request &b) {
+				const uint32_t levelA = VirtualPageId::mipLevel(a.page);
+				const uint32_t levelB = VirtualPageId::mipLevel(b.page);
+				if (levelA != levelB) {
+					return levelA > levelB;
+				}
+				if (a.count != b.count) {
+					return a.count > b.count;
+				}
+				return a.page < b.page;
+			});
+			return requests;
+		}
+
+	private:
+		std::vector<uint32_t> pagesX;
+		std::vector<uint32_t> pagesY;
+		std::unordered_map<uint32_t, uint32_t> counts;
+		std::vector<std::pair<uint32_t, uint32_t>> parents;
+		std::vector<Request> requests;
+	};
+
+	/**
+	* Least recently used assignment of virtual pages to the slots of a fixed size page pool
+	*
+	* Pages used in the current frame are never evicted, so a pool that's too small for the working set stops accepting
+	* new pages instead of thrashing.
+	*/
+	class PageCache
+	{
+	public:
+		/** @brief Set the number of pool slots, drops all pages */
+		void resize(uint32_t capacity)
+		{
+			this->capacity = capacity;
+			clear();
+		}
+
+		/** @brief Drop all pages and return them so their memory bindings can be removed */
+		std::vector<uint32_t> clear()
+		{
+			std::vector<uint32_t> pages;
+			for (auto &entry : lru) {
+				pages.push_back(entry.page);
+			}
+			lru.clear();
+			entries.clear();
+			freeSlots.clear();
+			for (uint32_t i = capacity; i > 0; i--) {
+				freeSlots.push_back(i - 1);
+			}
+			return pages;
+		}
+
+		uint32_t getCapacity() const { return capacity; }
+		uint32_t getSize() const { return static_cast<uint32_t>(entries.size()); }
+
+		/** @brief Pool slot of a resident page */
+		bool find(uint32_t page, uint32_t &slot) const
+		{
+			auto it = entries.find(page);
+			if (it == entries.end()) {
+				return false;
+			}
+			slot = it->second->slot;
+			return true;
+		}
+
+		/** @brief Mark a resident page as used in the given frame, returns false if the page is not resident */
+		bool touch(uint32_t page, uint64_t frame)
+		{
+			auto it = entries.find(page);
+			if (it == entries.end()) {
+				return false;
+			}
+			it->second->lastUsed = frame;
+			lru.splice(lru.begin(), lru, it->second);
+			return true;
+		}
+
+		/**
+		* Assign a pool slot to a page, evicting the least recently used page if the pool is full
+		*
+		* @param page Page to add, must not be resident
+		* @param frame Current frame, pages used in it are not evicted
+		* @param slot Assigned pool slot
+		* @param evicted Page that was evicted from the slot or VirtualPageId::invalid
+		*
+		* @return False if all pages are in use in the current frame
+		*/
+		bool insert(uint32_t page, uint64_t frame, uint32_t &slot, uint32_t &evicted)
+		{
+			evicted = VirtualPageId::invalid;
+			if (!freeSlots.empty()) {
+				slot = freeSlots.back();
+				freeSlots.pop_back();
+			}
+			else {
+				if (lru.empty() || (lru.back().lastUsed >= frame)) {
+					return false;
+				}
+				evicted = lru.back().page;
+				slot = lru.back().slot;
+				entries.erase(evicted);
+				lru.pop_back();
+			}
+			lru.push_front({ page, slot, frame });
+			entries[page] = lru.begin();
+			return true;
+		}
+
+	private:
+		struct Entry {
+			uint32_t page;
+			uint32_t slot;
+			uint64_t lastUsed;
+		};
+		uint32_t capacity = 0;
+		// Most recently used first
+		std::list<Entry> lru;
+		std::unordered_map<uint32_t, std::list<Entry>::iterator> entries;
+		std::vector<uint32_t> freeSlots;
+	};
+}
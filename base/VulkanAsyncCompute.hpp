@@ -0,0 +1,376 @@
+/*
+* Vulkan async compute scheduler
+*
+* Submits graphics and compute jobs with the semaphore waits and signals required by their declared dependencies
+*
+* Copyright (C) 2026 by the colefet/Vulkan contributors
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <array>
+#include <string>
+#include <cstring>
+#include <iostream>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanDevice.hpp"
+
+namespace vks
+{
+	/**
+	* @brief Submits the command buffers of graphics and compute jobs and synchronizes them according to their dependencies
+	* @note Submissions are counted per job, a dependency with distance k makes the n-th submission of a job wait for the (n - k)-th submission of the other job
+	* @note Uses one timeline semaphore per job (VK_KHR_timeline_semaphore), the n-th submission of a job signals the value n + 1
+	* @note Falls back to binary semaphores (a ring of distance + 1 semaphores per dependency) and fences if timeline semaphores aren't supported
+	* @note With the binary fallback jobs have to be submitted in lockstep: a job must be submitted after the submissions it waits for,
+	* and a job that others depend on may only run distance + 1 submissions ahead of each dependent job, as every submission signals
+	* the dependent's next semaphore of the ring (asserted in submit). The timeline path has no such restriction.
+	*/
+	class AsyncComputeScheduler
+	{
+	public:
+		enum QueueType { GRAPHICS = 0, COMPUTE = 1 };
+
+		/** @brief Number of submissions of a job that may be pending with the binary fallback before submit blocks */
+		static const uint32_t MAX_PENDING_SUBMISSIONS = 3;
+
+		/** @brief Use binary semaphores even if timeline semaphores are supported (--binary-semaphores), e.g. to compare the output of both paths */
+		bool forceBinarySemaphores = false;
+		/** @brief Print every submission with the submissions it waits for (--log-submissions) */
+		bool logSubmissions = false;
+
+		vks::VulkanDevice *device = nullptr;
+
+		/** @brief Read the scheduler options from the command line */
+		void parseCommandLine(const std::vector<const char*> &args)
+		{
+			for (auto arg : args) {
+				if (std::string(arg) == "--binary-semaphores") {
+					forceBinarySemaphores = true;
+				}
+				if (std::string(arg) == "--log-submissions") {
+					logSubmissions = true;
+				}
+			}
+		}
+
+		/**
+		* Add the instance extensions needed to query timeline semaphore support, call from the example's constructor before the instance is created
+		*
+		* @param enabledInstanceExtensions Instance extensions to enable, VK_KHR_get_physical_device_properties2 is added if not yet present
+		*/
+		static void requestInstanceExtensions(std::vector<const char*> &enabledInstanceExtensions)
+		{
+			for (auto extension : enabledInstanceExtensions) {
+				if (strcmp(extension, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) == 0) {
+					return;
+				}
+			}
+			enabledInstanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+		}
+
+		/**
+		* Request timeline semaphores for logical device creation if the physical device supports them, call from getEnabledFeatures
+		*
+		* @param physicalDevice Physical device the logical device is created for
+		* @param enabledDeviceExtensions Device extensions to enable, VK_KHR_timeline_semaphore is added if supported
+		* @param pNextChain Device creation pNext chain, the timeline semaphore feature structure is prepended
+		*
+		* @note Requires VK_KHR_get_physical_device_properties2 to be enabled on the instance (see requestInstanceExtensions)
+		*
+		* @return True if timeline semaphores will be used
+		*/
+		bool requestTimelineSemaphores(VkPhysicalDevice physicalDevice, std::vector<const char*> &enabledDeviceExtensions, void *&pNextChain)
+		{
+			timelineSemaphores = false;
+			if (forceBinarySemaphores) {
+				return false;
+			}
+			uint32_t extensionCount = 0;
+			vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+			std::vector<VkExtensionProperties> extensions(extensionCount);
+			vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensions.data());
+			for (auto &extension : extensions) {
+				if (strcmp(extension.extensionName, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME) == 0) {
+					timelineSemaphores = true;
+				}
+			}
+			if (timelineSemaphores) {
+				// The feature is mandatory for devices exposing the extension
+				enabledDeviceExtensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+				timelineSemaphoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+				timelineSemaphoreFeatures.timelineSemaphore = VK_TRUE;
+				timelineSemaphoreFeatures.pNext = pNextChain;
+				pNextChain = &timelineSemaphoreFeatures;
+			}
+			return timelineSemaphores;
+		}
+
+		/** @brief Returns true if jobs are synchronized with timeline semaphores, false for the binary semaphore fallback */
+		bool usesTimelineSemaphores()
+		{
+			return timelineSemaphores;
+		}
+
+		/**
+		* Declare a job, must be called before prepare
+		*
+		* @param name Name used for logging
+		* @param queueType Queue the job's command buffers are submitted to
+		*
+		* @return Index of the job
+		*/
+		uint32_t addJob(const std::string &name, QueueType queueType)
+		{
+			assert(device == nullptr);
+			Job job;
+			job.name = name;
+			job.queueType = queueType;
+			jobs.push_back(job);
+			return static_cast<uint32_t>(jobs.size() - 1);
+		}
+
+		/**
+		* Declare that a job has to wait for another job, must be called before prepare
+		*
+		* @param job Index of the waiting job
+		* @param dependency Index of the job that is waited for
+		* @param waitStage Pipeline stages of the waiting job that depend on the other job
+		* @param distance Number of submissions the other job is behind, e.g. 1 = the other job's previous submission
+		*/
+		void addDependency(uint32_t job, uint32_t dependency, VkPipelineStageFlags waitStage, uint32_t distance = 0)
+		{
+			assert((device == nullptr) && (job < jobs.size()) && (dependency < jobs.size()));
+			Dependency jobDependency;
+			jobDependency.job = dependency;
+			jobDependency.waitStage = waitStage;
+			jobDependency.distance = distance;
+			jobs[job].dependencies.push_back(jobDependency);
+		}
+
+		/**
+		* Create the synchronization primitives for all declared jobs and dependencies
+		*
+		* @param device Pointer to the Vulkan device
+		* @param graphicsQueue Queue for graphics jobs
+		* @param computeQueue Queue for compute jobs (may be the same as the graphics queue)
+		*/
+		void prepare(vks::VulkanDevice *device, VkQueue graphicsQueue, VkQueue computeQueue)
+		{
+			this->device = device;
+			queues = { graphicsQueue, computeQueue };
+
+			if (timelineSemaphores) {
+				vkWaitSemaphoresKHR = reinterpret_cast<PFN_vkWaitSemaphoresKHR>(vkGetDeviceProcAddr(device->logicalDevice, "vkWaitSemaphoresKHR"));
+				assert(vkWaitSemaphoresKHR);
+			}
+
+			for (auto &job : jobs) {
+				if (timelineSemaphores) {
+					VkSemaphoreTypeCreateInfoKHR semaphoreTypeCreateInfo = {};
+					semaphoreTypeCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+					semaphoreTypeCreateInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+					semaphoreTypeCreateInfo.initialValue = 0;
+					VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
+					semaphoreCreateInfo.pNext = &semaphoreTypeCreateInfo;
+					VK_CHECK_RESULT(vkCreateSemaphore(device->logicalDevice, &semaphoreCreateInfo, nullptr, &job.timeline));
+				} else {
+					// Signal operations of the ring's semaphores are distance + 1 submissions apart, so each one has been waited for before it's signaled again
+					for (auto &dependency : job.dependencies) {
+						dependency.semaphores.resize(dependency.distance + 1);
+						for (auto &semaphore : dependency.semaphores) {
+							VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
+							VK_CHECK_RESULT(vkCreateSemaphore(device->logicalDevice, &semaphoreCreateInfo, nullptr, &semaphore));
+						}
+					}
+					for (auto &fence : job.fences) {
+						VkFenceCreateInfo fenceCreateInfo = vks::initializers::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
+						VK_CHECK_RESULT(vkCreateFence(device->logicalDevice, &fenceCreateInfo, nullptr, &fence));
+					}
+				}
+			}
+
+			if (logSubmissions) {
+				std::cout << "Async compute scheduler using " << (timelineSemaphores ? "timeline" : "binary") << " semaphores" << std::endl;
+			}
+		}
+
+		/**
+		* Submit the next command buffer of a job
+		*
+		* @param jobIndex Index of the job
+		* @param commandBuffer Command buffer to submit
+		* @param waitSemaphores Additional (binary) semaphores to wait on, e.g. swap chain image acquisition
+		* @param waitStages Pipeline stages for the additional wait semaphores
+		* @param signalSemaphores Additional (binary) semaphores to signal, e.g. for presentation
+		*/
+		void submit(uint32_t jobIndex, VkCommandBuffer commandBuffer, const std::vector<VkSemaphore> &waitSemaphores = {}, const std::vector<VkPipelineStageFlags> &waitStages = {}, const std::vector<VkSemaphore> &signalSemaphores = {})
+		{
+			assert((device != nullptr) && (waitSemaphores.size() == waitStages.size()));
+			Job &job = jobs[jobIndex];
+			const uint64_t submission = job.submissionCount;
+
+			std::vector<VkSemaphore> waits(waitSemaphores);
+			std::vector<VkPipelineStageFlags> stages(waitStages);
+			std::vector<VkSemaphore> signals(signalSemaphores);
+			// Values for binary semaphores are ignored
+			std::vector<uint64_t> waitValues(waits.size(), 0);
+			std::vector<uint64_t> signalValues(signals.size(), 0);
+
+			if (logSubmissions) {
+				std::cout << "Submit " << job.name << " #" << submission << " (" << ((job.queueType == GRAPHICS) ? "graphics" : "compute") << " queue)";
+			}
+
+			for (auto &dependency : job.dependencies) {
+				// The first submissions have nothing to wait for
+				if (submission < dependency.distance) {
+					continue;
+				}
+				const uint64_t dependencySubmission = submission - dependency.distance;
+				Job &other = jobs[dependency.job];
+				if (timelineSemaphores) {
+					waits.push_back(other.timeline);
+					waitValues.push_back(dependencySubmission + 1);
+				} else {
+					// A binary semaphore can only be waited on after its signal operation has been submitted
+					assert(other.submissionCount > dependencySubmission);
+					waits.push_back(dependency.semaphores[dependencySubmission % dependency.semaphores.size()]);
+					waitValues.push_back(0);
+					dependency.waitCount++;
+				}
+				stages.push_back(dependency.waitStage);
+				if (logSubmissions) {
+					std::cout << ", waits for " << other.name << " #" << dependencySubmission;
+				}
+			}
+
+			if (timelineSemaphores) {
+				signals.push_back(job.timeline);
+				signalValues.push_back(submission + 1);
+			} else {
+				for (auto &other : jobs) {
+					for (auto &dependency : other.dependencies) {
+						if (&jobs[dependency.job] == &job) {
+							// The semaphore signaled distance + 1 submissions ago has to be waited for first, a binary semaphore can't be signaled twice
+							assert(submission - dependency.waitCount < dependency.semaphores.size());
+							signals.push_back(dependency.semaphores[submission % dependency.semaphores.size()]);
+							signalValues.push_back(0);
+						}
+					}
+				}
+			}
+
+			if (logSubmissions) {
+				std::cout << std::endl;
+			}
+
+			VkTimelineSemaphoreSubmitInfoKHR timelineSubmitInfo = {};
+			timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+			timelineSubmitInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+			timelineSubmitInfo.pWaitSemaphoreValues = waitValues.data();
+			timelineSubmitInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+			timelineSubmitInfo.pSignalSemaphoreValues = signalValues.data();
+
+			VkSubmitInfo submitInfo = vks::initializers::submitInfo();
+			submitInfo.pNext = timelineSemaphores ? &timelineSubmitInfo : nullptr;
+			submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waits.size());
+			submitInfo.pWaitSemaphores = waits.data();
+			submitInfo.pWaitDstStageMask = stages.data();
+			submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signals.size());
+			submitInfo.pSignalSemaphores = signals.data();
+			submitInfo.commandBufferCount = 1;
+			submitInfo.pCommandBuffers = &commandBuffer;
+
+			VkFence fence = VK_NULL_HANDLE;
+			if (!timelineSemaphores) {
+				fence = job.fences[submission % MAX_PENDING_SUBMISSIONS];
+				VK_CHECK_RESULT(vkWaitForFences(device->logicalDevice, 1, &fence, VK_TRUE, UINT64_MAX));
+				VK_CHECK_RESULT(vkResetFences(device->logicalDevice, 1, &fence));
+			}
+			VK_CHECK_RESULT(vkQueueSubmit(queues[job.queueType], 1, &submitInfo, fence));
+			job.submissionCount++;
+		}
+
+		/** @brief Wait on the host until the latest submission of a job has finished executing */
+		void wait(uint32_t jobIndex)
+		{
+			Job &job = jobs[jobIndex];
+			if (job.submissionCount == 0) {
+				return;
+			}
+			if (timelineSemaphores) {
+				VkSemaphoreWaitInfoKHR waitInfo = {};
+				waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+				waitInfo.semaphoreCount = 1;
+				waitInfo.pSemaphores = &job.timeline;
+				waitInfo.pValues = &job.submissionCount;
+				VK_CHECK_RESULT(vkWaitSemaphoresKHR(device->logicalDevice, &waitInfo, UINT64_MAX));
+			} else {
+				VK_CHECK_RESULT(vkWaitForFences(device->logicalDevice, 1, &job.fences[(job.submissionCount - 1) % MAX_PENDING_SUBMISSIONS], VK_TRUE, UINT64_MAX));
+			}
+		}
+
+		/** @brief Returns the number of submissions of a job so far */
+		uint64_t getSubmissionCount(uint32_t jobIndex)
+		{
+			return jobs[jobIndex].submissionCount;
+		}
+
+		/** @brief Release all Vulkan resources, the device must be idle */
+		void destroy()
+		{
+			if (!device) {
+				return;
+			}
+			for (auto &job : jobs) {
+				if (job.timeline != VK_NULL_HANDLE) {
+					vkDestroySemaphore(device->logicalDevice, job.timeline, nullptr);
+				}
+				for (auto &dependency : job.dependencies) {
+					for (auto &semaphore : dependency.semaphores) {
+						vkDestroySemaphore(device->logicalDevice, semaphore, nullptr);
+					}
+				}
+				for (auto &fence : job.fences) {
+					if (fence != VK_NULL_HANDLE) {
+						vkDestroyFence(device->logicalDevice, fence, nullptr);
+					}
+				}
+			}
+			jobs.clear();
+			device = nullptr;
+		}
+
+	private:
+		struct Dependency {
+			uint32_t job;
+			VkPipelineStageFlags waitStage;
+			uint32_t distance;
+			// Binary fallback only
+			std::vector<VkSemaphore> semaphores;
+			uint64_t waitCount = 0;
+		};
+
+		struct Job {
+			std::string name;
+			QueueType queueType;
+			std::vector<Dependency> dependencies;
+			uint64_t submissionCount = 0;
+			// Timeline path only
+			VkSemaphore timeline = VK_NULL_HANDLE;
+			// Binary fallback only
+			std::array<VkFence, MAX_PENDING_SUBMISSIONS> fences = {};
+		};
+
+		std::vector<Job> jobs;
+		std::array<VkQueue, 2> queues;
+		bool timelineSemaphores = false;
+		VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineSemaphoreFeatures = {};
+		PFN_vkWaitSemaphoresKHR vkWaitSemaphoresKHR = nullptr;
+	};
+}
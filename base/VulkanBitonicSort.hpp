@@ -0,0 +1,335 @@
+/*
+* Vulkan compute shader bitonic sort
+*
+* Sorts 32 bit key/value pairs in place in a storage buffer
+*
+* Copyright (C) 2026 by the colefet/Vulkan contributors
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanBuffer.hpp"
+#include "VulkanDevice.hpp"
+
+namespace vks
+{
+	/**
+	* @brief Sorts key/value pairs (uvec2) in ascending key order in place in a storage buffer
+	* @note The sort network always covers the full (power of two) capacity of the buffer, unused slots have to be padded with PADDING_KEY
+	* @note Pairs are compared by key, then by value, so the result is deterministic and equal to sortReference
+	*/
+	class BitonicSort
+	{
+	public:
+		/** @brief Number of pairs sorted in shared memory by a single work group (must match bitonicsort.comp) */
+		static const uint32_t TILE_SIZE = 512;
+		/** @brief Key for padding unused slots, sorts behind all other keys */
+		static const uint32_t PADDING_KEY = 0xFFFFFFFF;
+
+		struct KeyValue {
+			uint32_t key;
+			uint32_t value;
+		};
+
+		vks::VulkanDevice *device = nullptr;
+
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+
+		/** @brief Number of pairs covered by the sort network of the currently bound buffer */
+		uint32_t capacity = 0;
+
+		/** @brief Returns the number of pairs a buffer has to provide for sorting count pairs */
+		static uint32_t getCapacity(uint32_t count)
+		{
+			uint32_t capacity = TILE_SIZE;
+			while (capacity < count) {
+				capacity <<= 1;
+			}
+			return capacity;
+		}
+
+		/**
+		* Group count of a stage for sorting count pairs with recordSortIndirect, i.e. what the producer of the indirect commands has to write
+		* Stage 0 sorts the tiles, stage s > 0 merges sequences of TILE_SIZE << s pairs and is skipped (0 groups) if they're larger than the sorted range
+		*/
+		static uint32_t getIndirectGroupCount(uint32_t count, uint32_t stage)
+		{
+			const uint32_t size = getCapacity(count);
+			return ((TILE_SIZE << stage) <= size) ? size / TILE_SIZE : 0;
+		}
+
+		/** @brief Number of indirect dispatch commands (stages) recordSortIndirect reads for the capacity of the bound buffer */
+		uint32_t getIndirectCommandCount()
+		{
+			uint32_t count = 1;
+			for (uint32_t k = TILE_SIZE * 2; k <= capacity; k <<= 1) {
+				count++;
+			}
+			return count;
+		}
+
+		/** @brief CPU reference implementation, produces the same order as the GPU sort */
+		static void sortReference(std::vector<KeyValue> &pairs)
+		{
+			std::sort(pairs.begin(), pairs.end(), [](const KeyValue &a, const KeyValue &b) {
+				return (a.key < b.key) || ((a.key == b.key) && (a.value < b.value));
+			});
+		}
+
+		/**
+		* Create the compute pipeline used by the sort
+		*
+		* @param device Pointer to the Vulkan device
+		* @param pipelineCache Pipeline cache used for pipeline creation
+		* @param shaderStage Shader stage of bitonicsort.comp (the module is owned by the caller)
+		*/
+		void prepare(vks::VulkanDevice *device, VkPipelineCache pipelineCache, VkPipelineShaderStageCreateInfo shaderStage)
+		{
+			this->device = device;
+
+			std::vector<VkDescriptorPoolSize> poolSizes = {
+				vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1)
+			};
+			VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 1);
+			VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolInfo, nullptr, &descriptorPool));
+
+			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+				// Binding 0 : Key/value pairs
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+			};
+			VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorLayout, nullptr, &descriptorSetLayout));
+
+			VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, &descriptorSet));
+
+			// Push constants select the sort stage for each dispatch
+			VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(PushConstants), 0);
+			VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+			pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+			pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+			VK_CHECK_RESULT(vkCreatePipelineLayout(device->logicalDevice, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout));
+
+			VkComputePipelineCreateInfo pipelineCreateInfo = vks::initializers::computePipelineCreateInfo(pipelineLayout, 0);
+			pipelineCreateInfo.stage = shaderStage;
+			VK_CHECK_RESULT(vkCreateComputePipelines(device->logicalDevice, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipeline));
+		}
+
+		/**
+		* Set the buffer to be sorted
+		*
+		* @param descriptor Descriptor of the buffer range containing the key/value pairs
+		* @param capacity Number of pairs in the buffer range, must be a power of two and at least TILE_SIZE (see getCapacity)
+		*/
+		void setBuffer(VkDescriptorBufferInfo *descriptor, uint32_t capacity)
+		{
+			assert(capacity >= TILE_SIZE && (capacity & (capacity - 1)) == 0);
+			this->capacity = capacity;
+			VkWriteDescriptorSet writeDescriptorSet = vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, descriptor);
+			vkUpdateDescriptorSets(device->logicalDevice, 1, &writeDescriptorSet, 0, nullptr);
+		}
+
+		/**
+		* Record the sort into a command buffer
+		*
+		* @note The caller has to make prior writes to the buffer visible to compute shader reads and writes, and the sort's writes visible to later consumers
+		*/
+		void recordSort(VkCommandBuffer commandBuffer)
+		{
+			recordStages(commandBuffer, VK_NULL_HANDLE, 0, 0);
+		}
+
+		/**
+		* Record a sort of the first pairs of the buffer, with the number of pairs only known on the GPU
+		*
+		* @param commandBuffer Command buffer to record to
+		* @param buffer Buffer containing getIndirectCommandCount() VkDispatchIndirectCommand entries, one per stage (see getIndirectGroupCount)
+		* @param offset Offset of the first command in the buffer
+		* @param stride Distance between the commands in bytes
+		*
+		* @note Only the first getCapacity(count) pairs are sorted, they have to be padded like for recordSort
+		* @note All stages for the capacity of the buffer are recorded, the skipped ones dispatch no groups
+		* @note The caller also has to make prior writes to the indirect commands visible to indirect command reads
+		*/
+		void recordSortIndirect(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize stride = sizeof(VkDispatchIndirectCommand))
+		{
+			assert(buffer != VK_NULL_HANDLE);
+			recordStages(commandBuffer, buffer, offset, stride);
+		}
+
+		/**
+		* Sort random pairs on the GPU, check the result against sortReference and report the throughput
+		*
+		* @param queue Queue to submit to (must support compute and be of the device's default command pool family)
+		* @param count Number of pairs to sort
+		*
+		* @return True if the GPU result matches the CPU reference
+		*
+		* @note Rebinds the sort buffer, call setBuffer again afterwards
+		*/
+		bool benchmark(VkQueue queue, uint32_t count)
+		{
+			const uint32_t bufferCapacity = getCapacity(count);
+			const VkDeviceSize bufferSize = bufferCapacity * sizeof(KeyValue);
+
+			std::default_random_engine rndEngine(0);
+			std::uniform_int_distribution<uint32_t> rndDist(0, PADDING_KEY - 1);
+			std::vector<KeyValue> pairs(bufferCapacity);
+			for (uint32_t i = 0; i < bufferCapacity; i++) {
+				pairs[i].key = (i < count) ? rndDist(rndEngine) : PADDING_KEY;
+				pairs[i].value = i;
+			}
+
+			vks::Buffer stagingBuffer, sortBuffer;
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&stagingBuffer,
+				bufferSize,
+				pairs.data()));
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				&sortBuffer,
+				bufferSize));
+			setBuffer(&sortBuffer.descriptor, bufferCapacity);
+
+			VkQueryPool queryPool;
+			VkQueryPoolCreateInfo queryPoolInfo = {};
+			queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			queryPoolInfo.queryCount = 2;
+			VK_CHECK_RESULT(vkCreateQueryPool(device->logicalDevice, &queryPoolInfo, nullptr, &queryPool));
+
+			VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			vkCmdResetQueryPool(commandBuffer, queryPool, 0, 2);
+			VkBufferCopy copyRegion = { 0, 0, bufferSize };
+			vkCmdCopyBuffer(commandBuffer, stagingBuffer.buffer, sortBuffer.buffer, 1, &copyRegion);
+			VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+			memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+			recordSort(commandBuffer);
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+			memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			vkCmdCopyBuffer(commandBuffer, sortBuffer.buffer, stagingBuffer.buffer, 1, &copyRegion);
+			memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			device->flushCommandBuffer(commandBuffer, queue);
+
+			uint64_t timestamps[2] = { 0, 0 };
+			VK_CHECK_RESULT(vkGetQueryPoolResults(device->logicalDevice, queryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+			double gpuTime = (double)(timestamps[1] - timestamps[0]) * device->properties.limits.timestampPeriod / 1000000.0;
+
+			std::vector<KeyValue> gpuResult(bufferCapacity);
+			VK_CHECK_RESULT(stagingBuffer.map());
+			memcpy(gpuResult.data(), stagingBuffer.mapped, bufferSize);
+			stagingBuffer.unmap();
+
+			auto tStart = std::chrono::high_resolution_clock::now();
+			sortReference(pairs);
+			double cpuTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+
+			bool valid = true;
+			for (uint32_t i = 0; i < bufferCapacity; i++) {
+				if ((gpuResult[i].key != pairs[i].key) || (gpuResult[i].value != pairs[i].value)) {
+					valid = false;
+					break;
+				}
+			}
+
+			std::cout << std::fixed << std::setprecision(3);
+			std::cout << "Bitonic sort of " << count << " pairs (capacity " << bufferCapacity << "): " << gpuTime << " ms GPU (" << ((double)count / gpuTime / 1000.0) << " Mpairs/s), " << cpuTime << " ms CPU reference, " << (valid ? "valid" : "INVALID") << std::endl;
+
+			vkDestroyQueryPool(device->logicalDevice, queryPool, nullptr);
+			sortBuffer.destroy();
+			stagingBuffer.destroy();
+			capacity = 0;
+
+			return valid;
+		}
+
+		/** @brief Release all Vulkan resources */
+		void destroy()
+		{
+			if (device) {
+				vkDestroyPipeline(device->logicalDevice, pipeline, nullptr);
+				vkDestroyPipelineLayout(device->logicalDevice, pipelineLayout, nullptr);
+				vkDestroyDescriptorSetLayout(device->logicalDevice, descriptorSetLayout, nullptr);
+				vkDestroyDescriptorPool(device->logicalDevice, descriptorPool, nullptr);
+				device = nullptr;
+			}
+		}
+
+	private:
+		enum Mode { MODE_LOCAL_SORT = 0, MODE_GLOBAL_STEP = 1, MODE_LOCAL_MERGE = 2 };
+
+		struct PushConstants {
+			uint32_t mode;
+			uint32_t k;
+			uint32_t j;
+			uint32_t padding;
+		};
+
+		// Dispatches cover the whole capacity, or are read from one indirect command per stage if an indirect buffer is passed
+		void recordStages(VkCommandBuffer commandBuffer, VkBuffer indirectBuffer, VkDeviceSize offset, VkDeviceSize stride)
+		{
+			assert(capacity > 0);
+			const uint32_t groupCount = capacity / TILE_SIZE;
+
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+
+			auto dispatch = [&](Mode mode, uint32_t k, uint32_t j, uint32_t stage) {
+				PushConstants pushConstants = { (uint32_t)mode, k, j, 0 };
+				vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+				if (indirectBuffer != VK_NULL_HANDLE) {
+					vkCmdDispatchIndirect(commandBuffer, indirectBuffer, offset + stage * stride);
+				} else {
+					vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+				}
+			};
+
+			// Sort each tile in shared memory
+			dispatch(MODE_LOCAL_SORT, TILE_SIZE, TILE_SIZE / 2, 0);
+
+			// Merge tiles, steps with a compare distance smaller than a tile are done in shared memory
+			uint32_t stage = 1;
+			for (uint32_t k = TILE_SIZE * 2; k <= capacity; k <<= 1, stage++) {
+				for (uint32_t j = k >> 1; j >= TILE_SIZE; j >>= 1) {
+					barrier(commandBuffer);
+					dispatch(MODE_GLOBAL_STEP, k, j, stage);
+				}
+				barrier(commandBuffer);
+				dispatch(MODE_LOCAL_MERGE, k, TILE_SIZE / 2, stage);
+			}
+		}
+
+		void barrier(VkCommandBuffer commandBuffer)
+		{
+			VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+			memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		}
+	};
+}
@@ -0,0 +1,795 @@
+/*
+* Compiled binary fonts and text layout into persistently mapped glyph instance buffers
+*
+* Copyright (C) 2026 by the colefet/Vulkan contributors
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif !defined(__ANDROID__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(__ANDROID__)
+#include <android/asset_manager.h>
+#endif
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanDevice.hpp"
+#include "VulkanBuffer.hpp"
+
+namespace vks
+{
+	/**
+	* Font metrics compiled from an AngelCode .fnt file into a binary file that is memory mapped at load
+	*
+	* The file is a header followed by the glyphs sorted by id and the kerning pairs sorted by (first, second),
+	* so nothing needs to be parsed at load time and all lookups go directly into the mapped file
+	*/
+	class Font
+	{
+	public:
+		struct FileHeader {
+			char magic[4];
+			uint32_t version;
+			uint32_t lineHeight;
+			uint32_t base;
+			uint32_t scaleW;
+			uint32_t scaleH;
+			uint32_t glyphCount;
+			uint32_t kerningCount;
+		};
+
+		struct Glyph {
+			uint32_t id;
+			uint16_t x, y;
+			uint16_t width, height;
+			int16_t xoffset, yoffset;
+			int16_t xadvance;
+			uint16_t page;
+		};
+
+		struct KerningPair {
+			// (first << 16) | second
+			uint32_t pair;
+			int32_t amount;
+		};
+
+		/** @brief Array layer of this font's atlas in the texture array it is rendered with */
+		uint32_t layer = 0;
+
+		Font() {}
+		Font(const Font&) = delete;
+		Font& operator=(const Font&) = delete;
+		~Font()
+		{
+			unload();
+		}
+
+		/**
+		* Compile the contents of an AngelCode text .fnt file into the binary font format
+		* See http://www.angelcode.com/products/bmfont/doc/file_format.html for details on the source format
+		*/
+		static std::vector<uint8_t> compile(const std::string &fnt)
+		{
+			FileHeader header = {};
+			memcpy(header.magic, "VKFN", 4);
+			header.version = 1;
+			std::vector<Glyph> glyphs;
+			std::vector<KerningPair> kerningPairs;
+
+			std::istringstream stream(fnt);
+			std::string line;
+			std::unordered_map<std::string, int32_t> values;
+			while (std::getline(stream, line)) {
+				std::istringstream lineStream(line);
+				std::string tag;
+				lineStream >> tag;
+				if ((tag != "common") && (tag != "char") && (tag != "kerning")) {
+					continue;
+				}
+				values.clear();
+				std::string pair;
+				while (lineStream >> pair) {
+					size_t pos = pair.find('=');
+					if ((pos != std::string::npos) && (pos + 1 < pair.size())) {
+						values[pair.substr(0, pos)] = std::stoi(pair.substr(pos + 1));
+					}
+				}
+				auto value = [&values](const char *key) { auto it = values.find(key); return (it != values.end()) ? it->second : 0; };
+				if (tag == "common") {
+					header.lineHeight = value("lineHeight");
+					header.base = value("base");
+					header.scaleW = value("scaleW");
+					header.scaleH = value("scaleH");
+				}
+				if (tag == "char") {
+					Glyph glyph;
+					glyph.id = value("id");
+					glyph.x = value("x");
+					glyph.y = value("y");
+					glyph.width = value("width");
+					glyph.height = value("height");
+					glyph.xoffset = value("xoffset");
+					glyph.yoffset = value("yoffset");
+					glyph.xadvance = value("xadvance");
+					glyph.page = value("page");
+					glyphs.push_back(glyph);
+				}
+				if (tag == "kerning") {
+					KerningPair kerningPair;
+					kerningPair.pair = ((uint32_t)value("first") << 16) | ((uint32_t)value("second") & 0xFFFF);
+					kerningPair.amount = value("amount");
+					kerningPairs.push_back(kerningPair);
+				}
+			}
+
+			std::sort(glyphs.begin(), glyphs.end(), [](const Glyph &a, const Glyph &b) { return a.id < b.id; });
+			std::sort(kerningPairs.begin(), kerningPairs.end(), [](const KerningPair &a, const KerningPair &b) { return a.pair < b.pair; });
+			header.glyphCount = static_cast<uint32_t>(glyphs.size());
+			header.kerningCount = static_cast<uint32_t>(kerningPairs.size());
+
+			std::vector<uint8_t> data(sizeof(FileHeader) + glyphs.size() * sizeof(Glyph) + kerningPairs.size() * sizeof(KerningPair));
+			uint8_t *dst = data.data();
+			memcpy(dst, &header, sizeof(FileHeader));
+			dst += sizeof(FileHeader);
+			if (!glyphs.empty()) {
+				memcpy(dst, glyphs.data(), glyphs.size() * sizeof(Glyph));
+				dst += glyphs.size() * sizeof(Glyph);
+			}
+			if (!kerningPairs.empty()) {
+				memcpy(dst, kerningPairs.data(), kerningPairs.size() * sizeof(KerningPair));
+			}
+			return data;
+		}
+
+		/** @brief Compile an AngelCode text .fnt file and write the result to a binary font file */
+		static bool compileFile(const std::string &fntFilename, const std::string &filename)
+		{
+			std::ifstream input(fntFilename, std::ios::in | std::ios::binary);
+			if (!input.is_open()) {
+				return false;
+			}
+			std::stringstream fnt;
+			fnt << input.rdbuf();
+			std::vector<uint8_t> data = compile(fnt.str());
+			std::ofstream output(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+			if (!output.is_open()) {
+				return false;
+			}
+			output.write((const char*)data.data(), data.size());
+			return output.good();
+		}
+
+#if defined(__ANDROID__)
+		/** @brief Load a binary font stored uncompressed in the apk, the asset buffer is used directly */
+		bool loadFromFile(const std::string &filename, AAssetManager *assetManager)
+		{
+			unload();
+			asset = AAssetManager_open(assetManager, filename.c_str(), AASSET_MODE_BUFFER);
+			if (!asset) {
+				return false;
+			}
+			data = (const uint8_t*)AAsset_getBuffer(asset);
+			size = AAsset_getLength(asset);
+			return setup();
+		}
+#else
+		/** @brief Memory map a binary font file */
+		bool loadFromFile(const std::string &filename)
+		{
+			unload();
+#if defined(_WIN32)
+			file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (file == INVALID_HANDLE_VALUE) {
+				return false;
+			}
+			LARGE_INTEGER fileSize;
+			GetFileSizeEx(file, &fileSize);
+			size = (size_t)fileSize.QuadPart;
+			mapping = (size > 0) ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+			if (mapping == NULL) {
+				unload();
+				return false;
+			}
+			data = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+			int fd = open(filename.c_str(), O_RDONLY);
+			if (fd < 0) {
+				return false;
+			}
+			struct stat fileStat;
+			fstat(fd, &fileStat);
+			size = (size_t)fileStat.st_size;
+			void *mapped = (size > 0) ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+			close(fd);
+			data = (mapped != MAP_FAILED) ? (const uint8_t*)mapped : nullptr;
+			mappedFile = (data != nullptr);
+#endif
+			if (!data) {
+				unload();
+				return false;
+			}
+			return setup();
+		}
+#endif
+
+		/** @brief Use a compiled font kept in memory (e.g. if the binary font could not be written) */
+		bool loadFromMemory(std::vector<uint8_t> &&fontData)
+		{
+			unload();
+			memory = std::move(fontData);
+			data = memory.data();
+			size = memory.size();
+			return setup();
+		}
+
+		void unload()
+		{
+#if defined(__ANDROID__)
+			if (asset) {
+				AAsset_close(asset);
+				asset = nullptr;
+			}
+#elif defined(_WIN32)
+			if (data && memory.empty()) {
+				UnmapViewOfFile(data);
+			}
+			if (mapping != NULL) {
+				CloseHandle(mapping);
+				mapping = NULL;
+			}
+			if (file != INVALID_HANDLE_VALUE) {
+				CloseHandle(file);
+				file = INVALID_HANDLE_VALUE;
+			}
+#else
+			if (mappedFile) {
+				munmap((void*)data, size);
+				mappedFile = false;
+			}
+#endif
+			memory.clear();
+			data = nullptr;
+			size = 0;
+			header = nullptr;
+		}
+
+		const FileHeader& getHeader() const
+		{
+			assert(header);
+			return *header;
+		}
+
+		/** @brief Returns the glyph for a character or nullptr if the font doesn't contain it */
+		const Glyph* getGlyph(uint32_t id) const
+		{
+			if (id < 256) {
+				return (glyphIndices[id] >= 0) ? &glyphs[glyphIndices[id]] : nullptr;
+			}
+			const Glyph *end = glyphs + header->glyphCount;
+			const Glyph *glyph = std::lower_bound(glyphs, end, id, [](const Glyph &g, uint32_t id) { return g.id < id; });
+			return ((glyph != end) && (glyph->id == id)) ? glyph : nullptr;
+		}
+
+		/** @brief Returns the horizontal adjustment between two characters */
+		int32_t getKerning(uint32_t first, uint32_t second) const
+		{
+			if ((first - 32 < 96) && (second - 32 < 96)) {
+				return asciiKerning[(first - 32) * 96 + (second - 32)];
+			}
+			return findKerning(first, second);
+		}
+
+	private:
+		const uint8_t *data = nullptr;
+		size_t size = 0;
+		// Owns the font data if it has not been mapped from a file
+		std::vector<uint8_t> memory;
+#if defined(__ANDROID__)
+		AAsset *asset = nullptr;
+#elif defined(_WIN32)
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = NULL;
+#else
+		bool mappedFile = false;
+#endif
+		const FileHeader *header = nullptr;
+		const Glyph *glyphs = nullptr;
+		const KerningPair *kerningPairs = nullptr;
+		// Glyph indices for the first 256 character ids (-1 if not present)
+		int32_t glyphIndices[256];
+		// Kerning between printable ASCII characters, which is looked up for nearly every glyph during layout
+		std::vector<int16_t> asciiKerning;
+
+		int32_t findKerning(uint32_t first, uint32_t second) const
+		{
+			const uint32_t pair = (first << 16) | (second & 0xFFFF);
+			const KerningPair *end = kerningPairs + header->kerningCount;
+			const KerningPair *kerningPair = std::lower_bound(kerningPairs, end, pair, [](const KerningPair &k, uint32_t pair) { return k.pair < pair; });
+			return ((kerningPair != end) && (kerningPair->pair == pair)) ? kerningPair->amount : 0;
+		}
+
+		// Validates the font data and sets up the lookup tables
+		bool setup()
+		{
+			if (!data || (size < sizeof(FileHeader))) {
+				return false;
+			}
+			const FileHeader *fileHeader = (const FileHeader*)data;
+			if ((memcmp(fileHeader->magic, "VKFN", 4) != 0) || (fileHeader->version != 1) || (fileHeader->base == 0)) {
+				return false;
+			}
+			if (size != sizeof(FileHeader) + fileHeader->glyphCount * sizeof(Glyph) + fileHeader->kerningCount * sizeof(KerningPair)) {
+				return false;
+			}
+			header = fileHeader;
+			glyphs = (const Glyph*)(data + sizeof(FileHeader));
+			kerningPairs = (const KerningPair*)(data + sizeof(FileHeader) + header->glyphCount * sizeof(Glyph));
+
+			std::fill(std::begin(glyphIndices), std::end(glyphIndices), -1);
+			for (uint32_t i = 0; i < header->glyphCount; i++) {
+				if (glyphs[i].id < 256) {
+					glyphIndices[glyphs[i].id] = i;
+				}
+			}
+			asciiKerning.assign(96 * 96, 0);
+			for (uint32_t i = 0; i < header->kerningCount; i++) {
+				uint32_t first = kerningPairs[i].pair >> 16;
+				uint32_t second = kerningPairs[i].pair & 0xFFFF;
+				if ((first - 32 < 96) && (second - 32 < 96)) {
+					asciiKerning[(first - 32) * 96 + (second - 32)] = (int16_t)kerningPairs[i].amount;
+				}
+			}
+			return true;
+		}
+	};
+
+	/**
+	* Glyph instances of independently updated text blocks in a single persistently mapped buffer
+	*
+	* Each block keeps its range (with some slack to grow in place) for as long as it exists, so changing a block's text
+	* only lays out and writes that block. Blocks that outgrow their range are moved to the end of the buffer, the range
+	* left behind is cleared to empty glyphs and reclaimed by compaction once more than half of the buffer is unused.
+	* All blocks are drawn with a single instanced draw, the instance count is read from an indirect buffer
+	*/
+	class TextBuffer
+	{
+	public:
+		/** @brief Per-instance glyph data, the quad's corners are derived from the vertex index */
+		struct GlyphInstance {
+			// Glyph rectangle (x0, y0, x1, y1) in layout units, y pointing down
+			glm::vec4 rect;
+			// Atlas texture coordinates (s0, t0, s1, t1), normalized
+			uint16_t uv[4];
+			// Texture array layer of the font's atlas
+			uint32_t layer;
+			// RGBA8
+			uint32_t color;
+		};
+
+		enum Align { alignLeft, alignCenter, alignRight };
+
+		struct Style {
+			glm::vec2 origin = glm::vec2(0.0f);
+			// Height of the font's base line in layout units
+			float size = 1.0f;
+			// Lines wider than this are wrapped at word boundaries (0 = no wrapping)
+			float wrapWidth = 0.0f;
+			Align align = alignLeft;
+			// Center the block's lines vertically on the origin
+			bool centerVertically = false;
+			glm::vec4 color = glm::vec4(1.0f);
+		};
+
+		struct Statistics {
+			uint32_t blocks = 0;
+			uint32_t glyphs = 0;
+			// Glyphs laid out and written by the last update
+			uint32_t writtenGlyphs = 0;
+			uint32_t relocatedBlocks = 0;
+			double updateTime = 0.0;
+		} stats;
+
+		void create(vks::VulkanDevice *device, uint32_t initialCapacity = 16384)
+		{
+			this->device = device;
+			createInstanceBuffer(std::max(initialCapacity, 64u));
+
+			// Glyph quad indices for the corners (x0,y0), (x1,y0), (x0,y1), (x1,y1)
+			std::vector<uint16_t> indices = { 0, 1, 2, 2, 1, 3 };
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&indexBuffer,
+				indices.size() * sizeof(uint16_t),
+				indices.data()));
+
+			VkDrawIndexedIndirectCommand indirectCmd{};
+			indirectCmd.indexCount = static_cast<uint32_t>(indices.size());
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&indirectBuffer,
+				sizeof(VkDrawIndexedIndirectCommand),
+				&indirectCmd));
+			VK_CHECK_RESULT(indirectBuffer.map());
+		}
+
+		void destroy()
+		{
+			instanceBuffer.destroy();
+			indexBuffer.destroy();
+			indirectBuffer.destroy();
+			blocks.clear();
+			freeBlocks.clear();
+		}
+
+		/** @brief Vertex input binding for the glyph instances */
+		static VkVertexInputBindingDescription vertexInputBinding(uint32_t binding)
+		{
+			return vks::initializers::vertexInputBindingDescription(binding, sizeof(GlyphInstance), VK_VERTEX_INPUT_RATE_INSTANCE);
+		}
+
+		/** @brief Vertex attributes for the glyph instances (locations 0 to 3) */
+		static std::vector<VkVertexInputAttributeDescription> vertexInputAttributes(uint32_t binding)
+		{
+			return {
+				vks::initializers::vertexInputAttributeDescription(binding, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(GlyphInstance, rect)),	// Location 0: Rectangle
+				vks::initializers::vertexInputAttributeDescription(binding, 1, VK_FORMAT_R16G16B16A16_UNORM, offsetof(GlyphInstance, uv)),		// Location 1: UV rectangle
+				vks::initializers::vertexInputAttributeDescription(binding, 2, VK_FORMAT_R32_UINT, offsetof(GlyphInstance, layer)),				// Location 2: Atlas layer
+				vks::initializers::vertexInputAttributeDescription(binding, 3, VK_FORMAT_R8G8B8A8_UNORM, offsetof(GlyphInstance, color)),		// Location 3: Color
+			};
+		}
+
+		/** @brief Add an empty text block, returns its handle */
+		uint32_t addBlock()
+		{
+			uint32_t index;
+			if (!freeBlocks.empty()) {
+				index = freeBlocks.back();
+				freeBlocks.pop_back();
+				blocks[index] = Block();
+			} else {
+				index = static_cast<uint32_t>(blocks.size());
+				blocks.push_back(Block());
+			}
+			blocks[index].alive = true;
+			return index;
+		}
+
+		void removeBlock(uint32_t block)
+		{
+			assert(blocks[block].alive);
+			releaseRange(blocks[block]);
+			blocks[block] = Block();
+			freeBlocks.push_back(block);
+		}
+
+		/** @brief Set the text of a block, it's laid out on the next update if anything changed */
+		void setText(uint32_t block, const Font *font, const std::string &text, const Style &style)
+		{
+			Block &b = blocks[block];
+			assert(b.alive && font);
+			if ((b.font == font) && (b.text == text) && sameStyle(b.style, style)) {
+				return;
+			}
+			b.font = font;
+			b.text = text;
+			b.style = style;
+			b.dirty = true;
+		}
+
+		/**
+		* Lay out and write all changed blocks
+		*
+		* @note The buffer must not be in use by the GPU
+		*
+		* @return True if the instance buffer has been recreated and command buffers need to be rebuilt
+		*/
+		bool update()
+		{
+			auto tStart = std::chrono::high_resolution_clock::now();
+			stats.writtenGlyphs = 0;
+			stats.relocatedBlocks = 0;
+			bufferRecreated = false;
+
+			for (auto &block : blocks) {
+				if (!block.alive || !block.dirty) {
+					continue;
+				}
+				layout(block);
+				const uint32_t count = static_cast<uint32_t>(block.glyphs.size());
+				GlyphInstance *mapped = (GlyphInstance*)instanceBuffer.mapped;
+				if (count <= block.capacity) {
+					// Fits into the current range, glyphs no longer used are cleared
+					if (block.count > count) {
+						memset(mapped + block.first + count, 0, (block.count - count) * sizeof(GlyphInstance));
+					}
+				} else {
+					releaseRange(block);
+					allocateRange(block, count + count / 4);
+					mapped = (GlyphInstance*)instanceBuffer.mapped;
+					stats.relocatedBlocks++;
+				}
+				if (count > 0) {
+					memcpy(mapped + block.first, block.glyphs.data(), count * sizeof(GlyphInstance));
+				}
+				block.count = count;
+				block.dirty = false;
+				stats.writtenGlyphs += count;
+			}
+
+			if ((end > 4096) && (unused > end / 2)) {
+				compact();
+			}
+
+			VkDrawIndexedIndirectCommand *indirectCmd = (VkDrawIndexedIndirectCommand*)indirectBuffer.mapped;
+			indirectCmd->instanceCount = end;
+
+			stats.blocks = 0;
+			stats.glyphs = 0;
+			for (auto &block : blocks) {
+				if (block.alive) {
+					stats.blocks++;
+					stats.glyphs += block.count;
+				}
+			}
+			stats.updateTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+			return bufferRecreated;
+		}
+
+		/** @brief Draw all blocks with the currently bound pipeline */
+		void draw(VkCommandBuffer commandBuffer)
+		{
+			VkDeviceSize offsets[1] = { 0 };
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &instanceBuffer.buffer, offsets);
+			vkCmdBindIndexBuffer(commandBuffer, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+			vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffer.buffer, 0, 1, sizeof(VkDrawIndexedIndirectCommand));
+		}
+
+	private:
+		struct Block {
+			const Font *font = nullptr;
+			std::string text;
+			Style style;
+			uint32_t first = 0;
+			uint32_t capacity = 0;
+			uint32_t count = 0;
+			bool alive = false;
+			bool dirty = false;
+			// CPU copy of the laid out glyphs, used to move the block without reading back mapped memory
+			std::vector<GlyphInstance> glyphs;
+		};
+
+		vks::VulkanDevice *device = nullptr;
+		vks::Buffer instanceBuffer;
+		vks::Buffer indexBuffer;
+		vks::Buffer indirectBuffer;
+		std::vector<Block> blocks;
+		std::vector<uint32_t> freeBlocks;
+		uint32_t capacity = 0;
+		// End of the last allocated range, all instances up to here are drawn
+		uint32_t end = 0;
+		// Instances below end that don't belong to any block
+		uint32_t unused = 0;
+		bool bufferRecreated = false;
+
+		static bool sameStyle(const Style &a, const Style &b)
+		{
+			return (a.origin == b.origin) && (a.size == b.size) && (a.wrapWidth == b.wrapWidth) && (a.align == b.align) && (a.centerVertically == b.centerVertically) && (a.color == b.color);
+		}
+
+		void createInstanceBuffer(uint32_t newCapacity)
+		{
+			if (instanceBuffer.buffer != VK_NULL_HANDLE) {
+				instanceBuffer.destroy();
+			}
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&instanceBuffer,
+				newCapacity * sizeof(GlyphInstance)));
+			VK_CHECK_RESULT(instanceBuffer.map());
+			capacity = newCapacity;
+			bufferRecreated = true;
+		}
+
+		// Clears a block's range and adds it to the unused instances
+		void releaseRange(Block &block)
+		{
+			if (block.capacity == 0) {
+				return;
+			}
+			memset((GlyphInstance*)instanceBuffer.mapped + block.first, 0, block.capacity * sizeof(GlyphInstance));
+			if (block.first + block.capacity == end) {
+				end = block.first;
+			} else {
+				unused += block.capacity;
+			}
+			block.first = 0;
+			block.capacity = 0;
+		}
+
+		// Allocates a range at the end of the buffer, compacting or growing it if required
+		void allocateRange(Block &block, uint32_t count)
+		{
+			if (end + count > capacity) {
+				compact();
+			}
+			if (end + count > capacity) {
+				uint32_t newCapacity = capacity;
+				while (end + count > newCapacity) {
+					newCapacity *= 2;
+				}
+				createInstanceBuffer(newCapacity);
+				rewrite();
+			}
+			block.first = end;
+			block.capacity = count;
+			end += count;
+		}
+
+		// Packs all blocks with a range to the start of the buffer
+		void compact()
+		{
+			end = 0;
+			for (auto &block : blocks) {
+				if (block.alive && (block.capacity > 0)) {
+					block.first = end;
+					end += block.capacity;
+				}
+			}
+			unused = 0;
+			rewrite();
+		}
+
+		// Writes all blocks and their unused slack to the instance buffer
+		void rewrite()
+		{
+			GlyphInstance *mapped = (GlyphInstance*)instanceBuffer.mapped;
+			memset(mapped, 0, end * sizeof(GlyphInstance));
+			for (auto &block : blocks) {
+				if (block.alive && (block.capacity > 0) && (block.count > 0)) {
+					// Blocks that still have to be laid out keep their previous glyphs until they are written
+					const uint32_t count = std::min(block.count, block.capacity);
+					memcpy(mapped + block.first, block.glyphs.data(), std::min(count, (uint32_t)block.glyphs.size()) * sizeof(GlyphInstance));
+				}
+			}
+		}
+
+		// Moves the glyphs of a finished line for alignment
+		void alignLine(Block &block, size_t first, size_t last, float lineWidth)
+		{
+			float offset = block.style.origin.x;
+			if (block.style.align == alignCenter) {
+				offset -= lineWidth / 2.0f;
+			}
+			if (block.style.align == alignRight) {
+				offset -= lineWidth;
+			}
+			for (size_t i = first; i < last; i++) {
+				block.glyphs[i].rect.x += offset;
+				block.glyphs[i].rect.z += offset;
+			}
+		}
+
+		// Lays out the block's text with kerning and word wrapping, lines grow downwards
+		void layout(Block &block)
+		{
+			const Font &font = *block.font;
+			const Font::FileHeader &header = font.getHeader();
+			const Style &style = block.style;
+			const float scale = style.size / (float)header.base;
+			const float lineHeight = (float)header.lineHeight * scale;
+			const glm::vec2 uvScale = glm::vec2(65535.0f / (float)header.scaleW, 65535.0f / (float)header.scaleH);
+			const glm::vec4 c = glm::clamp(style.color, glm::vec4(0.0f), glm::vec4(1.0f)) * 255.0f + 0.5f;
+			const uint32_t color = (uint32_t)c.r | ((uint32_t)c.g << 8) | ((uint32_t)c.b << 16) | ((uint32_t)c.a << 24);
+
+			std::vector<GlyphInstance> &glyphs = block.glyphs;
+			glyphs.clear();
+			glyphs.reserve(block.text.size());
+
+			float penX = 0.0f;
+			float penY = 0.0f;
+			float lineWidth = 0.0f;
+			size_t lineFirst = 0;
+			// Start of the last word on the current line, where the line can be wrapped
+			size_t wordFirst = 0;
+			float wordX = 0.0f;
+			float lineWidthBeforeWord = 0.0f;
+			bool lineHasBreak = false;
+			uint32_t prev = 0;
+
+			for (auto character : block.text) {
+				const uint32_t id = (uint8_t)character;
+				if (id == '\n') {
+					alignLine(block, lineFirst, glyphs.size(), lineWidth);
+					lineFirst = glyphs.size();
+					penX = 0.0f;
+					penY += lineHeight;
+					lineWidth = 0.0f;
+					lineHasBreak = false;
+					prev = 0;
+					continue;
+				}
+				const Font::Glyph *glyph = font.getGlyph(id);
+				if (!glyph) {
+					continue;
+				}
+				const float kerning = (prev != 0) ? (float)font.getKerning(prev, id) * scale : 0.0f;
+				prev = id;
+				if (id == ' ') {
+					penX += kerning + (float)glyph->xadvance * scale;
+					wordFirst = glyphs.size();
+					wordX = penX;
+					lineWidthBeforeWord = lineWidth;
+					lineHasBreak = true;
+					continue;
+				}
+				float x0 = penX + kerning + (float)glyph->xoffset * scale;
+				float x1 = x0 + (float)glyph->width * scale;
+				if ((style.wrapWidth > 0.0f) && (x1 > style.wrapWidth) && lineHasBreak && (wordFirst > lineFirst)) {
+					// Move the current word to a new line
+					alignLine(block, lineFirst, wordFirst, lineWidthBeforeWord);
+					for (size_t i = wordFirst; i < glyphs.size(); i++) {
+						glyphs[i].rect.x -= wordX;
+						glyphs[i].rect.z -= wordX;
+						glyphs[i].rect.y += lineHeight;
+						glyphs[i].rect.w += lineHeight;
+					}
+					lineFirst = wordFirst;
+					lineWidth = (glyphs.size() > wordFirst) ? glyphs.back().rect.z : 0.0f;
+					penX -= wordX;
+					penY += lineHeight;
+					x0 -= wordX;
+					x1 -= wordX;
+					lineHasBreak = false;
+				}
+				if ((glyph->width > 0) && (glyph->height > 0)) {
+					GlyphInstance instance;
+					const float y0 = penY + (float)glyph->yoffset * scale;
+					instance.rect = glm::vec4(x0, y0, x1, y0 + (float)glyph->height * scale);
+					instance.uv[0] = (uint16_t)std::min((float)glyph->x * uvScale.x + 0.5f, 65535.0f);
+					instance.uv[1] = (uint16_t)std::min((float)glyph->y * uvScale.y + 0.5f, 65535.0f);
+					instance.uv[2] = (uint16_t)std::min((float)(glyph->x + glyph->width) * uvScale.x + 0.5f, 65535.0f);
+					instance.uv[3] = (uint16_t)std::min((float)(glyph->y + glyph->height) * uvScale.y + 0.5f, 65535.0f);
+					instance.layer = font.layer;
+					instance.color = color;
+					glyphs.push_back(instance);
+					lineWidth = std::max(lineWidth, x1);
+				}
+				penX += kerning + (float)glyph->xadvance * scale;
+			}
+			alignLine(block, lineFirst, glyphs.size(), lineWidth);
+
+			float offsetY = style.origin.y;
+			if (style.centerVertically) {
+				offsetY -= (penY + lineHeight) / 2.0f;
+			}
+			for (auto &glyph : glyphs) {
+				glyph.rect.y += offsetY;
+				glyph.rect.w += offsetY;
+			}
+		}
+	};
+}
@@ -0,0 +1,611 @@
+/*
+* Asynchronous screenshot and frame sequence capture
+*
+* Presented images are copied into a ring of host visible readback buffers and read back a few frames later,
+* swizzling and encoding (PPM, PNG, QOI) is done on a worker thread so the render loop never waits for it
+*
+* Copyright (C) 2026 by the colefet/Vulkan contributors
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__SSSE3__) || defined(__AVX__) || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)))
+#define VKS_CAPTURE_SSSE3
+#include <tmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define VKS_CAPTURE_NEON
+#include <arm_neon.h>
+#endif
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanBuffer.hpp"
+#include "VulkanDevice.hpp"
+
+namespace vks
+{
+	class FrameCapture
+	{
+	public:
+		enum class Format { PPM, PNG, QOI };
+
+		/** @brief Parse a file format name ("ppm", "png" or "qoi") */
+		static bool parseFormat(const std::string &name, Format &format)
+		{
+			if (name == "ppm") { format = Format::PPM; return true; }
+			if (name == "png") { format = Format::PNG; return true; }
+			if (name == "qoi") { format = Format::QOI; return true; }
+			return false;
+		}
+
+		/** @brief File extension for a format (without dot) */
+		static const char* getExtension(Format format)
+		{
+			switch (format) {
+			case Format::PNG: return "png";
+			case Format::QOI: return "qoi";
+			default: return "ppm";
+			}
+		}
+
+		/** @brief Continuous capture settings, captures the given number of consecutive frames as an image sequence */
+		struct {
+			uint32_t frameCount = 0;
+			Format format = Format::PNG;
+			std::string prefix = "capture";
+		} sequence;
+
+		/** @brief Number of readback buffers, a frame is read back at most this many frames after it was captured */
+		uint32_t ringSize = 4;
+
+		/** @brief Number of images written to disk */
+		std::atomic<uint32_t> savedCount{ 0 };
+
+		/**
+		* Create the resources for capturing
+		*
+		* @param device Pointer to the Vulkan device
+		* @param colorFormat Format of the images to be captured (swapchain color format)
+		* @param queueFamilyIndex Queue family the captures are submitted to (must be the present queue)
+		*/
+		void prepare(vks::VulkanDevice *device, VkFormat colorFormat, uint32_t queueFamilyIndex)
+		{
+			this->device = device;
+			this->colorFormat = colorFormat;
+
+			// Only 8 bit per channel color formats are converted
+			const std::vector<VkFormat> supportedFormats = {
+				VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_R8G8B8A8_SRGB, VK_FORMAT_R8G8B8A8_SNORM,
+				VK_FORMAT_B8G8R8A8_UNORM, VK_FORMAT_B8G8R8A8_SRGB, VK_FORMAT_B8G8R8A8_SNORM
+			};
+			supported = std::find(supportedFormats.begin(), supportedFormats.end(), colorFormat) != supportedFormats.end();
+
+			VkCommandPoolCreateInfo cmdPoolInfo = vks::initializers::commandPoolCreateInfo();
+			cmdPoolInfo.queueFamilyIndex = queueFamilyIndex;
+			cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+			VK_CHECK_RESULT(vkCreateCommandPool(device->logicalDevice, &cmdPoolInfo, nullptr, &commandPool));
+
+			// Reading from cached memory is a lot faster, fall back to coherent memory if not available
+			VkBool32 cachedFound = VK_FALSE;
+			device->getMemoryType(0xFFFFFFFF, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, &cachedFound);
+			memoryPropertyFlags = cachedFound ? (VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT) : (VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+			slots.clear();
+			for (uint32_t i = 0; i < ringSize; i++) {
+				std::unique_ptr<Slot> slot(new Slot());
+				VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+				VK_CHECK_RESULT(vkAllocateCommandBuffers(device->logicalDevice, &cmdBufAllocateInfo, &slot->commandBuffer));
+				VkFenceCreateInfo fenceCreateInfo = vks::initializers::fenceCreateInfo(0);
+				VK_CHECK_RESULT(vkCreateFence(device->logicalDevice, &fenceCreateInfo, nullptr, &slot->fence));
+				VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
+				VK_CHECK_RESULT(vkCreateSemaphore(device->logicalDevice, &semaphoreCreateInfo, nullptr, &slot->semaphore));
+				slots.push_back(std::move(slot));
+			}
+
+			destroying = false;
+			worker = std::thread(&FrameCapture::workerLoop, this);
+		}
+
+		/** @brief Wait for all outstanding captures to be written and release all resources */
+		void destroy()
+		{
+			if (!device) {
+				return;
+			}
+			for (auto &slot : slots) {
+				if (slot->state == SLOT_GPU) {
+					vkWaitForFences(device->logicalDevice, 1, &slot->fence, VK_TRUE, UINT64_MAX);
+				}
+			}
+			poll();
+			{
+				std::lock_guard<std::mutex> lock(queueMutex);
+				destroying = true;
+			}
+			condition.notify_all();
+			if (worker.joinable()) {
+				worker.join();
+			}
+			for (auto &slot : slots) {
+				slot->buffer.destroy();
+				vkDestroyFence(device->logicalDevice, slot->fence, nullptr);
+				vkDestroySemaphore(device->logicalDevice, slot->semaphore, nullptr);
+			}
+			slots.clear();
+			vkDestroyCommandPool(device->logicalDevice, commandPool, nullptr);
+			device = nullptr;
+		}
+
+		/** @brief Capture the next presented frame to the given file, the format is taken from the file extension */
+		void requestScreenshot(const std::string &filename)
+		{
+			screenshotFilename = filename;
+		}
+
+		/** @brief Returns true if there is anything left to capture or write */
+		bool busy()
+		{
+			if (!screenshotFilename.empty() || (sequenceIndex < sequence.frameCount)) {
+				return true;
+			}
+			for (auto &slot : slots) {
+				if (slot->state != SLOT_FREE) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		/**
+		* Record and submit the copy of a presentable image if a capture has been requested for this frame
+		*
+		* @param queue Queue to submit the copy to (same queue the image is presented on)
+		* @param image Swapchain image about to be presented
+		* @param width Width of the image
+		* @param height Height of the image
+		* @param waitSemaphore Semaphore signalled when rendering to the image has finished
+		*
+		* @return Semaphore the presentation has to wait on (waitSemaphore if nothing was captured)
+		*/
+		VkSemaphore captureFrame(VkQueue queue, VkImage image, uint32_t width, uint32_t height, VkSemaphore waitSemaphore)
+		{
+			poll();
+
+			std::string filename;
+			Format format;
+			if (!screenshotFilename.empty()) {
+				filename = screenshotFilename;
+				std::string extension = filename.substr(filename.find_last_of('.') + 1);
+				if (!parseFormat(extension, format)) {
+					format = Format::PPM;
+				}
+				screenshotFilename.clear();
+			} else if (sequenceIndex < sequence.frameCount) {
+				char name[32];
+				snprintf(name, sizeof(name), "_%05u.", sequenceIndex);
+				filename = sequence.prefix + name + getExtension(sequence.format);
+				format = sequence.format;
+				sequenceIndex++;
+			} else {
+				return waitSemaphore;
+			}
+
+			if (!supported) {
+				std::cerr << "Frame capture is not supported for the current color format" << std::endl;
+				return waitSemaphore;
+			}
+
+			Slot &slot = *slots[nextSlot];
+			nextSlot = (nextSlot + 1) % static_cast<uint32_t>(slots.size());
+
+			// All readback buffers are in use, so the writer can't keep up (or the ring is too small)
+			// Wait for the oldest capture instead of dropping frames, as sequences are used for comparisons
+			if (slot.state == SLOT_GPU) {
+				vkWaitForFences(device->logicalDevice, 1, &slot.fence, VK_TRUE, UINT64_MAX);
+				poll();
+			}
+			if (slot.state != SLOT_FREE) {
+				std::unique_lock<std::mutex> lock(queueMutex);
+				condition.wait(lock, [&slot] { return slot.state == SLOT_FREE; });
+			}
+
+			const VkDeviceSize size = (VkDeviceSize)width * height * 4;
+			if (slot.buffer.size < size) {
+				slot.buffer.destroy();
+				VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, memoryPropertyFlags, &slot.buffer, size));
+				VK_CHECK_RESULT(slot.buffer.map());
+			}
+			slot.width = width;
+			slot.height = height;
+			slot.filename = filename;
+			slot.format = format;
+
+			VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+			VK_CHECK_RESULT(vkBeginCommandBuffer(slot.commandBuffer, &cmdBufInfo));
+
+			vks::tools::insertImageMemoryBarrier(
+				slot.commandBuffer,
+				image,
+				VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+				VK_ACCESS_TRANSFER_READ_BIT,
+				VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
+
+			// Tightly packed copy, channel order and conversion to RGB are done by the worker
+			VkBufferImageCopy copyRegion = {};
+			copyRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+			copyRegion.imageExtent = { width, height, 1 };
+			vkCmdCopyImageToBuffer(slot.commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer.buffer, 1, &copyRegion);
+
+			vks::tools::insertImageMemoryBarrier(
+				slot.commandBuffer,
+				image,
+				VK_ACCESS_TRANSFER_READ_BIT,
+				VK_ACCESS_MEMORY_READ_BIT,
+				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+				VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+				VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
+
+			// Make the transfer visible to host reads once the fence has been signalled
+			VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+			memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+			vkCmdPipelineBarrier(slot.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+			VK_CHECK_RESULT(vkEndCommandBuffer(slot.commandBuffer));
+
+			VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+			VkSubmitInfo submitInfo = vks::initializers::submitInfo();
+			submitInfo.waitSemaphoreCount = (waitSemaphore != VK_NULL_HANDLE) ? 1 : 0;
+			submitInfo.pWaitSemaphores = &waitSemaphore;
+			submitInfo.pWaitDstStageMask = &waitStageMask;
+			submitInfo.commandBufferCount = 1;
+			submitInfo.pCommandBuffers = &slot.commandBuffer;
+			submitInfo.signalSemaphoreCount = 1;
+			submitInfo.pSignalSemaphores = &slot.semaphore;
+			VK_CHECK_RESULT(vkResetFences(device->logicalDevice, 1, &slot.fence));
+			VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, slot.fence));
+			slot.state = SLOT_GPU;
+
+			return slot.semaphore;
+		}
+
+		/** @brief Hand finished readbacks to the worker thread, never blocks */
+		void poll()
+		{
+			for (uint32_t i = 0; i < slots.size(); i++) {
+				Slot &slot = *slots[i];
+				if ((slot.state == SLOT_GPU) && (vkGetFenceStatus(device->logicalDevice, slot.fence) == VK_SUCCESS)) {
+					slot.state = SLOT_ENCODING;
+					{
+						std::lock_guard<std::mutex> lock(queueMutex);
+						encodeQueue.push_back(i);
+					}
+					condition.notify_all();
+				}
+			}
+		}
+
+		/**
+		* Convert a row of 32 bit pixels to 24 bit RGB
+		*
+		* @param src Source pixels (RGBA or BGRA)
+		* @param dst Destination for width * 3 bytes
+		* @param width Number of pixels
+		* @param bgr Swap red and blue channels
+		*/
+		static void convertRow(const uint8_t *src, uint8_t *dst, uint32_t width, bool bgr)
+		{
+			uint32_t x = 0;
+#if defined(VKS_CAPTURE_SSSE3)
+			// Four pixels per shuffle, the 16 byte store writes 4 bytes past the 12 valid ones, which are overwritten by the next iteration
+			const __m128i mask = bgr ? _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1) : _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+			for (; x + 6 <= width; x += 4) {
+				__m128i pixels = _mm_loadu_si128((const __m128i*)(src + x * 4));
+				_mm_storeu_si128((__m128i*)(dst + x * 3), _mm_shuffle_epi8(pixels, mask));
+			}
+#elif defined(VKS_CAPTURE_NEON)
+			// Eight pixels per iteration, deinterleaving load and interleaving store
+			for (; x + 8 <= width; x += 8) {
+				uint8x8x4_t pixels = vld4_u8(src + x * 4);
+				uint8x8x3_t rgb;
+				rgb.val[0] = bgr ? pixels.val[2] : pixels.val[0];
+				rgb.val[1] = pixels.val[1];
+				rgb.val[2] = bgr ? pixels.val[0] : pixels.val[2];
+				vst3_u8(dst + x * 3, rgb);
+			}
+#endif
+			for (; x < width; x++) {
+				dst[x * 3 + 0] = src[x * 4 + (bgr ? 2 : 0)];
+				dst[x * 3 + 1] = src[x * 4 + 1];
+				dst[x * 3 + 2] = src[x * 4 + (bgr ? 0 : 2)];
+			}
+		}
+
+		/** @brief Encode tightly packed 24 bit RGB pixels */
+		static void encode(Format format, const uint8_t *rgb, uint32_t width, uint32_t height, std::vector<uint8_t> &out)
+		{
+			out.clear();
+			switch (format) {
+			case Format::PNG: encodePNG(rgb, width, height, out); break;
+			case Format::QOI: encodeQOI(rgb, width, height, out); break;
+			default: encodePPM(rgb, width, height, out); break;
+			}
+		}
+
+	private:
+		enum SlotState : uint32_t { SLOT_FREE = 0, SLOT_GPU = 1, SLOT_ENCODING = 2 };
+
+		struct Slot {
+			vks::Buffer buffer;
+			VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+			VkFence fence = VK_NULL_HANDLE;
+			// Signalled after the copy, presentation waits on it
+			VkSemaphore semaphore = VK_NULL_HANDLE;
+			std::atomic<uint32_t> state{ SLOT_FREE };
+			uint32_t width = 0;
+			uint32_t height = 0;
+			std::string filename;
+			Format format = Format::PPM;
+		};
+
+		vks::VulkanDevice *device = nullptr;
+		VkFormat colorFormat = VK_FORMAT_UNDEFINED;
+		bool supported = false;
+		VkMemoryPropertyFlags memoryPropertyFlags = 0;
+		VkCommandPool commandPool = VK_NULL_HANDLE;
+		std::vector<std::unique_ptr<Slot>> slots;
+		uint32_t nextSlot = 0;
+		std::string screenshotFilename;
+		uint32_t sequenceIndex = 0;
+
+		std::thread worker;
+		std::mutex queueMutex;
+		std::condition_variable condition;
+		std::deque<uint32_t> encodeQueue;
+		bool destroying = false;
+
+		bool isBGR()
+		{
+			return (colorFormat == VK_FORMAT_B8G8R8A8_UNORM) || (colorFormat == VK_FORMAT_B8G8R8A8_SRGB) || (colorFormat == VK_FORMAT_B8G8R8A8_SNORM);
+		}
+
+		void workerLoop()
+		{
+			std::vector<uint8_t> rgb;
+			std::vector<uint8_t> encoded;
+			while (true) {
+				uint32_t index;
+				{
+					std::unique_lock<std::mutex> lock(queueMutex);
+					condition.wait(lock, [this] { return !encodeQueue.empty() || destroying; });
+					if (encodeQueue.empty()) {
+						break;
+					}
+					index = encodeQueue.front();
+					encodeQueue.pop_front();
+				}
+
+				Slot &slot = *slots[index];
+				if ((memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0) {
+					slot.buffer.invalidate();
+				}
+				const bool bgr = isBGR();
+				rgb.resize((size_t)slot.width * slot.height * 3);
+				const uint8_t *src = (const uint8_t*)slot.buffer.mapped;
+				for (uint32_t y = 0; y < slot.height; y++) {
+					convertRow(src + (size_t)y * slot.width * 4, rgb.data() + (size_t)y * slot.width * 3, slot.width, bgr);
+				}
+				const uint32_t width = slot.width;
+				const uint32_t height = slot.height;
+				const std::string filename = slot.filename;
+				const Format format = slot.format;
+
+				// The readback buffer is no longer needed
+				{
+					std::lock_guard<std::mutex> lock(queueMutex);
+					slot.state = SLOT_FREE;
+				}
+				condition.notify_all();
+
+				encode(format, rgb.data(), width, height, encoded);
+				FILE *file = fopen(filename.c_str(), "wb");
+				if (file) {
+					fwrite(encoded.data(), 1, encoded.size(), file);
+					fclose(file);
+					savedCount++;
+				} else {
+					std::cerr << "Could not write capture to \"" << filename << "\"" << std::endl;
+				}
+			}
+		}
+
+		static void writeU32BE(std::vector<uint8_t> &out, uint32_t value)
+		{
+			out.push_back((uint8_t)(value >> 24));
+			out.push_back((uint8_t)(value >> 16));
+			out.push_back((uint8_t)(value >> 8));
+			out.push_back((uint8_t)value);
+		}
+
+		static void encodePPM(const uint8_t *rgb, uint32_t width, uint32_t height, std::vector<uint8_t> &out)
+		{
+			std::string header = "P6\n" + std::to_string(width) + "\n" + std::to_string(height) + "\n255\n";
+			out.reserve(header.size() + (size_t)width * height * 3);
+			out.insert(out.end(), header.begin(), header.end());
+			out.insert(out.end(), rgb, rgb + (size_t)width * height * 3);
+		}
+
+		static uint32_t crc32(const uint8_t *data, size_t size, uint32_t crc = 0)
+		{
+			static uint32_t table[256];
+			static bool tableReady = false;
+			if (!tableReady) {
+				for (uint32_t i = 0; i < 256; i++) {
+					uint32_t c = i;
+					for (uint32_t k = 0; k < 8; k++) {
+						c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+					}
+					table[i] = c;
+				}
+				tableReady = true;
+			}
+			crc = ~crc;
+			for (size_t i = 0; i < size; i++) {
+				crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+			}
+			return ~crc;
+		}
+
+		static void writePNGChunk(std::vector<uint8_t> &out, const char *type, const uint8_t *data, size_t size)
+		{
+			writeU32BE(out, (uint32_t)size);
+			size_t typeOffset = out.size();
+			out.insert(out.end(), type, type + 4);
+			if (size > 0) {
+				out.insert(out.end(), data, data + size);
+			}
+			writeU32BE(out, crc32(out.data() + typeOffset, size + 4));
+		}
+
+		// Writes the image data with stored (uncompressed) deflate blocks, so no compression library is required
+		// Files are larger than compressed PNGs, but encoding is cheap enough for continuous capture
+		static void encodePNG(const uint8_t *rgb, uint32_t width, uint32_t height, std::vector<uint8_t> &out)
+		{
+			static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+			out.insert(out.end(), signature, signature + 8);
+
+			std::vector<uint8_t> ihdr;
+			writeU32BE(ihdr, width);
+			writeU32BE(ihdr, height);
+			ihdr.push_back(8);	// Bit depth
+			ihdr.push_back(2);	// Color type RGB
+			ihdr.push_back(0);	// Compression
+			ihdr.push_back(0);	// Filter
+			ihdr.push_back(0);	// Interlace
+			writePNGChunk(out, "IHDR", ihdr.data(), ihdr.size());
+
+			// Filtered scanlines (filter type none)
+			const size_t rowSize = (size_t)width * 3;
+			std::vector<uint8_t> raw((rowSize + 1) * height);
+			for (uint32_t y = 0; y < height; y++) {
+				raw[y * (rowSize + 1)] = 0;
+				memcpy(&raw[y * (rowSize + 1) + 1], rgb + y * rowSize, rowSize);
+			}
+
+			// zlib stream
+			std::vector<uint8_t> zlib;
+			zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+			zlib.push_back(0x78);
+			zlib.push_back(0x01);
+			uint32_t adlerA = 1, adlerB = 0;
+			size_t offset = 0;
+			do {
+				const size_t blockSize = std::min(raw.size() - offset, (size_t)65535);
+				const bool lastBlock = (offset + blockSize == raw.size());
+				zlib.push_back(lastBlock ? 1 : 0);
+				zlib.push_back((uint8_t)(blockSize & 0xFF));
+				zlib.push_back((uint8_t)(blockSize >> 8));
+				zlib.push_back((uint8_t)(~blockSize & 0xFF));
+				zlib.push_back((uint8_t)((~blockSize >> 8) & 0xFF));
+				zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + blockSize);
+				// Adler-32, modulo is deferred as long as the sums can't overflow
+				for (size_t i = 0; i < blockSize; ) {
+					const size_t end = std::min(blockSize, i + 5552);
+					for (; i < end; i++) {
+						adlerA += raw[offset + i];
+						adlerB += adlerA;
+					}
+					adlerA %= 65521;
+					adlerB %= 65521;
+				}
+				offset += blockSize;
+			} while (offset < raw.size());
+			writeU32BE(zlib, (adlerB << 16) | adlerA);
+
+			writePNGChunk(out, "IDAT", zlib.data(), zlib.size());
+			writePNGChunk(out, "IEND", nullptr, 0);
+		}
+
+		// Quite OK Image format (https://qoiformat.org)
+		static void encodeQOI(const uint8_t *rgb, uint32_t width, uint32_t height, std::vector<uint8_t> &out)
+		{
+			out.reserve(14 + (size_t)width * height * 4 + 8);
+			out.push_back('q'); out.push_back('o'); out.push_back('i'); out.push_back('f');
+			writeU32BE(out, width);
+			writeU32BE(out, height);
+			out.push_back(3);	// Channels
+			out.push_back(0);	// sRGB with linear alpha
+
+			uint8_t index[64][3] = {};
+			uint8_t prev[3] = { 0, 0, 0 };
+			uint32_t run = 0;
+			const size_t pixelCount = (size_t)width * height;
+			for (size_t i = 0; i < pixelCount; i++) {
+				const uint8_t *px = rgb + i * 3;
+				if ((px[0] == prev[0]) && (px[1] == prev[1]) && (px[2] == prev[2])) {
+					run++;
+					if ((run == 62) || (i == pixelCount - 1)) {
+						out.push_back((uint8_t)(0xC0 | (run - 1)));
+						run = 0;
+					}
+					continue;
+				}
+				if (run > 0) {
+					out.push_back((uint8_t)(0xC0 | (run - 1)));
+					run = 0;
+				}
+				// Alpha is always 255
+				const uint32_t hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + 255 * 11) % 64;
+				if ((index[hash][0] == px[0]) && (index[hash][1] == px[1]) && (index[hash][2] == px[2])) {
+					out.push_back((uint8_t)hash);
+				} else {
+					index[hash][0] = px[0];
+					index[hash][1] = px[1];
+					index[hash][2] = px[2];
+					const int8_t vr = (int8_t)(px[0] - prev[0]);
+					const int8_t vg = (int8_t)(px[1] - prev[1]);
+					const int8_t vb = (int8_t)(px[2] - prev[2]);
+					const int8_t vgr = vr - vg;
+					const int8_t vgb = vb - vg;
+					if ((vr > -3) && (vr < 2) && (vg > -3) && (vg < 2) && (vb > -3) && (vb < 2)) {
+						out.push_back((uint8_t)(0x40 | ((vr + 2) << 4) | ((vg + 2) << 2) | (vb + 2)));
+					} else if ((vgr > -9) && (vgr < 8) && (vg > -33) && (vg < 32) && (vgb > -9) && (vgb < 8)) {
+						out.push_back((uint8_t)(0x80 | (vg + 32)));
+						out.push_back((uint8_t)(((vgr + 8) << 4) | (vgb + 8)));
+					} else {
+						out.push_back(0xFE);
+						out.push_back(px[0]);
+						out.push_back(px[1]);
+						out.push_back(px[2]);
+					}
+				}
+				prev[0] = px[0];
+				prev[1] = px[1];
+				prev[2] = px[2];
+			}
+			static const uint8_t padding[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+			out.insert(out.end(), padding, padding + 8);
+		}
+	};
+}
@@ -0,0 +1,695 @@
+/*
+* Vulkan GPU driven culling
+*
+* Frustum and optional hierarchical depth occlusion culling, LOD selection and instance compaction for indirect draws in a compute shader
+*
+* Copyright (C) 2026 by the colefet/Vulkan contributors
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <array>
+#include <string>
+#include <cstring>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <glm/glm.hpp>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanDevice.hpp"
+#include "VulkanBuffer.hpp"
+#include "VulkanTexture.hpp"
+#include "VulkanHiZ.hpp"
+#include "frustum.hpp"
+
+namespace vks
+{
+	/**
+	* @brief Culls instances and builds the indirect draw commands for them on the GPU
+	*
+	* Every instance has a bounding sphere and a mesh, every mesh has a list of LODs (index ranges) selected by the
+	* distance to the camera, and every LOD of every mesh is one indirect draw. Three dispatches of gpuculling.comp are
+	* recorded per frame, none of them depends on the number of instances on the host side:
+	* - Cull: one invocation per instance tests the sphere against the frustum (and the HiZ pyramid set with setHiZ), picks the LOD and reserves a slot in its draw
+	* - Build: a single work group scans the per draw instance counts and writes the indirect commands
+	* - Scatter: the per instance data (e.g. the vertex attributes of an instanced draw) of the visible instances is copied
+	*   into culledInstanceBuffer, grouped by draw, so the existing instanced vertex shaders can be used unchanged
+	*
+	* @note With VK_KHR_draw_indirect_count only the draws with visible instances are written and their number is read from
+	* drawCountBuffer, without it every draw keeps its fixed slot and draws with no visible instances get an instanceCount of zero
+	* @note Without the drawIndirectFirstInstance feature every draw gets a fixed range of culledInstanceBuffer large enough for
+	* all instances of its mesh, the commands use a firstInstance of zero and cmdDraw binds the range of each draw separately
+	*/
+	class GpuCulling
+	{
+	public:
+		/** @brief Work group size of all passes (must match gpuculling.comp) */
+		static const uint32_t GROUP_SIZE = 256;
+
+		/** @brief World space bounding sphere of an instance */
+		struct InstanceBounds {
+			glm::vec3 center;
+			float radius;
+		};
+
+		/** @brief Range of LODs of a mesh in the LOD table */
+		struct Mesh {
+			uint32_t firstLod;
+			uint32_t lodCount;
+		};
+
+		/** @brief Index range of a LOD, used up to the given distance from the camera (the last LOD of a mesh is used beyond) */
+		struct Lod {
+			uint32_t firstIndex;
+			uint32_t indexCount;
+			int32_t vertexOffset;
+			float distance;
+		};
+
+		/** @brief Result of the last culling pass that finished */
+		struct Statistics {
+			// Number of indirect draws issued
+			uint32_t drawCount;
+			// Number of instances that passed the culling
+			uint32_t visibleCount;
+		};
+
+		/** @brief Parameters of the culling passes, updated with updateView */
+		struct UniformData {
+			// Transform applied to all bounding spheres, must not scale
+			glm::mat4 model = glm::mat4(1.0f);
+			glm::vec4 frustumPlanes[6];
+			glm::vec4 cameraPos;
+			// Matrix the depth buffer of the HiZ pyramid was rendered with
+			glm::mat4 hizViewProjection = glm::mat4(1.0f);
+			// xy = depth buffer size, z = pyramid levels, w = occlusion culling enabled
+			glm::ivec4 hizParams = glm::ivec4(0);
+			uint32_t instanceCount = 0;
+			uint32_t drawCount = 0;
+			// Size of an instance's data in 32 bit words
+			uint32_t instanceStride = 0;
+			uint32_t compactDraws = 0;
+			// Scales the distance used for LOD selection
+			float lodScale = 1.0f;
+			// Keep the first instances uploaded by setInstances and write a firstInstance of zero (no drawIndirectFirstInstance)
+			uint32_t fixedFirstInstance = 0;
+		} uniformData;
+
+		/** @brief Use instanceCount compaction even if VK_KHR_draw_indirect_count is supported (--no-draw-indirect-count) */
+		bool forceInstanceCountCompaction = false;
+
+		vks::VulkanDevice *device = nullptr;
+
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+
+		vks::Buffer uniformBuffer;
+		vks::Buffer boundsBuffer;
+		vks::Buffer meshIndexBuffer;
+		vks::Buffer meshBuffer;
+		vks::Buffer lodBuffer;
+		/** @brief Data of the visible instances grouped by draw, bind as instance vertex buffer (or storage buffer) for the draws */
+		vks::Buffer culledInstanceBuffer;
+		/** @brief Draw and slot within the draw for every instance */
+		vks::Buffer visibilityBuffer;
+		/** @brief Visible instances per draw, cleared before every cull pass */
+		vks::Buffer drawInstanceCountBuffer;
+		/** @brief First instance of every draw in culledInstanceBuffer */
+		vks::Buffer drawFirstInstanceBuffer;
+		/** @brief One VkDrawIndexedIndirectCommand per draw */
+		vks::Buffer indirectCommandBuffer;
+		/** @brief Number of draws and visible instances, used as count buffer for the indirect draw and read for the statistics */
+		vks::Buffer drawCountBuffer;
+		/** @brief Bound instead of the HiZ pyramid while no pyramid is set */
+		vks::Texture2D hizPlaceholder{};
+
+		/** @brief Read the culling options from the command line */
+		void parseCommandLine(const std::vector<const char*> &args)
+		{
+			for (auto arg : args) {
+				if (std::string(arg) == "--no-draw-indirect-count") {
+					forceInstanceCountCompaction = true;
+				}
+			}
+		}
+
+		/**
+		* Request VK_KHR_draw_indirect_count for logical device creation if the physical device supports it, call from getEnabledFeatures
+		*
+		* @param physicalDevice Physical device the logical device is created for
+		* @param enabledDeviceExtensions Device extensions to enable, VK_KHR_draw_indirect_count is added if supported
+		*
+		* @return True if the draw count will be read from drawCountBuffer
+		*/
+		bool requestDrawIndirectCount(VkPhysicalDevice physicalDevice, std::vector<const char*> &enabledDeviceExtensions)
+		{
+			drawIndirectCount = false;
+			if (forceInstanceCountCompaction) {
+				return false;
+			}
+			uint32_t extensionCount = 0;
+			vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+			std::vector<VkExtensionProperties> extensions(extensionCount);
+			vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensions.data());
+			for (auto &extension : extensions) {
+				if (strcmp(extension.extensionName, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) == 0) {
+					drawIndirectCount = true;
+				}
+			}
+			if (drawIndirectCount) {
+				enabledDeviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+			}
+			return drawIndirectCount;
+		}
+
+		/** @brief Enable the device features used by the indirect draws if supported, call from getEnabledFeatures */
+		static void enableFeatures(const VkPhysicalDeviceFeatures &deviceFeatures, VkPhysicalDeviceFeatures &enabledFeatures)
+		{
+			if (deviceFeatures.drawIndirectFirstInstance) {
+				enabledFeatures.drawIndirectFirstInstance = VK_TRUE;
+			}
+			if (deviceFeatures.multiDrawIndirect) {
+				enabledFeatures.multiDrawIndirect = VK_TRUE;
+			}
+		}
+
+		/** @brief Returns true if the number of draws is read from drawCountBuffer, false for the instanceCount fallback */
+		bool usesDrawIndirectCount()
+		{
+			return drawIndirectCount;
+		}
+
+		/** @brief Returns the number of work groups of the per instance passes */
+		static uint32_t getGroupCount(uint32_t instanceCount)
+		{
+			return (instanceCount + GROUP_SIZE - 1) / GROUP_SIZE;
+		}
+
+		/**
+		* CPU reference of the cull pass
+		*
+		* @param uniformData Culling parameters (frustum, camera and model transform)
+		* @param bounds Bounding sphere of every instance
+		* @param meshIndices Mesh of every instance
+		* @param meshes Mesh table
+		* @param lods LOD table
+		* @param pyramid Host copy of the HiZ pyramid for the occlusion test (optional, only used if enabled in uniformData.hizParams)
+		*
+		* @return Number of visible instances per draw (LOD)
+		*/
+		static std::vector<uint32_t> cullReference(const UniformData &uniformData, const std::vector<InstanceBounds> &bounds, const std::vector<uint32_t> &meshIndices, const std::vector<Mesh> &meshes, const std::vector<Lod> &lods, const vks::HiZ::Pyramid *pyramid = nullptr)
+		{
+			std::vector<uint32_t> counts(lods.size(), 0);
+			vks::Frustum frustum;
+			for (uint32_t i = 0; i < 6; i++) {
+				frustum.planes[i] = uniformData.frustumPlanes[i];
+			}
+			for (size_t i = 0; i < bounds.size(); i++) {
+				glm::vec3 center = glm::vec3(uniformData.model * glm::vec4(bounds[i].center, 1.0f));
+				if (!frustum.checkSphere(center, bounds[i].radius)) {
+					continue;
+				}
+				if (pyramid && (uniformData.hizParams.w != 0) && vks::HiZ::sphereOccluded(*pyramid, uniformData.hizViewProjection, center, bounds[i].radius)) {
+					continue;
+				}
+				counts[selectLod(uniformData, meshes[meshIndices[i]], lods, center)]++;
+			}
+			return counts;
+		}
+
+		/**
+		* Create the compute pipeline and the uniform buffer
+		*
+		* @param device Pointer to the Vulkan device
+		* @param pipelineCache Pipeline cache used for pipeline creation
+		* @param shaderStage Shader stage of gpuculling.comp (the module is owned by the caller)
+		*/
+		void prepare(vks::VulkanDevice *device, VkPipelineCache pipelineCache, VkPipelineShaderStageCreateInfo shaderStage)
+		{
+			this->device = device;
+
+			// Without a first instance in the commands each draw is issued separately with its own instance buffer offset, so the draw count isn't used
+			uniformData.fixedFirstInstance = device->enabledFeatures.drawIndirectFirstInstance ? 0 : 1;
+			if (uniformData.fixedFirstInstance) {
+				drawIndirectCount = false;
+			}
+			if (drawIndirectCount) {
+				vkCmdDrawIndexedIndirectCountKHR = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(vkGetDeviceProcAddr(device->logicalDevice, "vkCmdDrawIndexedIndirectCountKHR"));
+				drawIndirectCount = (vkCmdDrawIndexedIndirectCountKHR != nullptr);
+			}
+			uniformData.compactDraws = drawIndirectCount ? 1 : 0;
+
+			std::vector<VkDescriptorPoolSize> poolSizes = {
+				vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1),
+				vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 11),
+				vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1)
+			};
+			VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 1);
+			VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolInfo, nullptr, &descriptorPool));
+
+			// Binding 0 : Culling parameters, bindings 1 - 11 : storage buffers, binding 12 : HiZ pyramid (see gpuculling.comp)
+			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0)
+			};
+			for (uint32_t i = 1; i <= 11; i++) {
+				setLayoutBindings.push_back(vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, i));
+			}
+			setLayoutBindings.push_back(vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 12));
+			VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorLayout, nullptr, &descriptorSetLayout));
+
+			VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, &descriptorSet));
+
+			// Push constant selects the pass
+			VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(uint32_t), 0);
+			VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+			pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+			pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+			VK_CHECK_RESULT(vkCreatePipelineLayout(device->logicalDevice, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout));
+
+			VkComputePipelineCreateInfo pipelineCreateInfo = vks::initializers::computePipelineCreateInfo(pipelineLayout, 0);
+			pipelineCreateInfo.stage = shaderStage;
+			VK_CHECK_RESULT(vkCreateComputePipelines(device->logicalDevice, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipeline));
+
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&uniformBuffer,
+				sizeof(UniformData)));
+			VK_CHECK_RESULT(uniformBuffer.map());
+		}
+
+		/**
+		* Upload the instances and the mesh tables and (re)create the buffers written by the culling passes
+		*
+		* @param queue Queue used for the uploads
+		* @param bounds Bounding sphere of every instance
+		* @param meshIndices Mesh of every instance
+		* @param meshes Mesh table, each mesh references a range of LODs
+		* @param lods LOD table, each LOD is one indirect draw
+		* @param instanceData Descriptor of the per instance data copied for the visible instances (needs VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)
+		* @param instanceStride Size of an instance's data in bytes, must be a multiple of four
+		*
+		* @note Must not be called while a recorded culling pass is pending, command buffers referencing the buffers have to be rebuilt
+		*/
+		void setInstances(VkQueue queue, const std::vector<InstanceBounds> &bounds, const std::vector<uint32_t> &meshIndices, const std::vector<Mesh> &meshes, const std::vector<Lod> &lods, VkDescriptorBufferInfo *instanceData, uint32_t instanceStride)
+		{
+			assert(!bounds.empty() && (bounds.size() == meshIndices.size()) && !lods.empty());
+			assert((instanceStride % 4) == 0);
+
+			this->bounds = bounds;
+			this->meshIndices = meshIndices;
+			this->meshes = meshes;
+			this->lods = lods;
+
+			const uint32_t instanceCount = static_cast<uint32_t>(bounds.size());
+			const uint32_t drawCount = static_cast<uint32_t>(lods.size());
+			uniformData.instanceCount = instanceCount;
+			uniformData.drawCount = drawCount;
+			uniformData.instanceStride = instanceStride / 4;
+
+			// Fixed range of every draw in culledInstanceBuffer for the fallback without drawIndirectFirstInstance
+			std::vector<uint32_t> drawSlots(drawCount, 0);
+			if (uniformData.fixedFirstInstance) {
+				std::vector<uint32_t> meshInstanceCounts(meshes.size(), 0);
+				for (auto meshIndex : meshIndices) {
+					meshInstanceCounts[meshIndex]++;
+				}
+				for (size_t i = 0; i < meshes.size(); i++) {
+					for (uint32_t j = 0; j < meshes[i].lodCount; j++) {
+						drawSlots[meshes[i].firstLod + j] += meshInstanceCounts[i];
+					}
+				}
+			}
+			drawFirstInstances.assign(drawCount, 0);
+			uint32_t culledInstanceCount = instanceCount;
+			if (uniformData.fixedFirstInstance) {
+				culledInstanceCount = 0;
+				for (uint32_t i = 0; i < drawCount; i++) {
+					drawFirstInstances[i] = culledInstanceCount;
+					culledInstanceCount += drawSlots[i];
+				}
+			}
+
+			destroyBuffers();
+			createDeviceLocalBuffer(queue, &boundsBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, bounds.size() * sizeof(InstanceBounds), bounds.data());
+			createDeviceLocalBuffer(queue, &meshIndexBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, meshIndices.size() * sizeof(uint32_t), meshIndices.data());
+			createDeviceLocalBuffer(queue, &meshBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, meshes.size() * sizeof(Mesh), meshes.data());
+			createDeviceLocalBuffer(queue, &lodBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, lods.size() * sizeof(Lod), lods.data());
+
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &culledInstanceBuffer, (VkDeviceSize)culledInstanceCount * instanceStride));
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &visibilityBuffer, (VkDeviceSize)instanceCount * 2 * sizeof(uint32_t)));
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &drawInstanceCountBuffer, drawCount * sizeof(uint32_t)));
+			// Written by the build pass, or read only with the fixed ranges uploaded here
+			createDeviceLocalBuffer(queue, &drawFirstInstanceBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, drawFirstInstances.size() * sizeof(uint32_t), drawFirstInstances.data());
+			// Initialized on the host so the draws of the instanceCount fallback are valid before the first build pass
+			std::vector<VkDrawIndexedIndirectCommand> commands(drawCount);
+			for (uint32_t i = 0; i < drawCount; i++) {
+				commands[i] = { lods[i].indexCount, 0, lods[i].firstIndex, lods[i].vertexOffset, 0 };
+			}
+			createDeviceLocalBuffer(queue, &indirectCommandBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, commands.size() * sizeof(VkDrawIndexedIndirectCommand), commands.data());
+			// Host visible, so the statistics don't need a copy (written once per frame, small enough for host memory)
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&drawCountBuffer,
+				sizeof(Statistics)));
+			VK_CHECK_RESULT(drawCountBuffer.map());
+			memset(drawCountBuffer.mapped, 0, sizeof(Statistics));
+
+			if (hizPlaceholder.image == VK_NULL_HANDLE) {
+				glm::vec2 texel(0.0f);
+				hizPlaceholder.fromBuffer(&texel, sizeof(texel), VK_FORMAT_R32G32_SFLOAT, 1, 1, device, queue, VK_FILTER_NEAREST);
+			}
+
+			std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+				vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffer.descriptor),
+				vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &boundsBuffer.descriptor),
+				vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &meshIndexBuffer.descriptor),
+				vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &meshBuffer.descriptor),
+				vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, &lodBuffer.descriptor),
+				vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5, instanceData),
+				vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6, &culledInstanceBuffer.descriptor),
+				vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 7, &visibilityBuffer.descriptor),
+				vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 8, &drawInstanceCountBuffer.descriptor),
+				vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 9, &drawFirstInstanceBuffer.descriptor),
+				vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 10, &indirectCommandBuffer.descriptor),
+				vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 11, &drawCountBuffer.descriptor),
+			};
+			vkUpdateDescriptorSets(device->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+
+			setHiZ(hiz);
+		}
+
+		/**
+		* Set the HiZ pyramid instances are additionally tested against for occlusion (see shaders/base/hiz.h), call after setInstances
+		*
+		* @param hiz Pyramid built from the depth buffer of a previous frame, nullptr disables occlusion culling
+		*
+		* @note Call again after the pyramid was recreated (vks::HiZ::setDepthImage), command buffers recording the culling have to be rebuilt
+		* @note The caller records the pyramid build before the culling and makes its writes visible to compute shader reads
+		*/
+		void setHiZ(vks::HiZ *hiz)
+		{
+			this->hiz = hiz;
+			if (hiz) {
+				uniformData.hizParams = glm::ivec4(hiz->depthWidth, hiz->depthHeight, hiz->levelCount, 1);
+			} else {
+				uniformData.hizParams = glm::ivec4(0);
+			}
+			if (hizPlaceholder.image != VK_NULL_HANDLE) {
+				VkWriteDescriptorSet writeDescriptorSet = vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 12, hiz ? &hiz->descriptor : &hizPlaceholder.descriptor);
+				vkUpdateDescriptorSets(device->logicalDevice, 1, &writeDescriptorSet, 0, nullptr);
+			}
+			if (uniformBuffer.mapped) {
+				memcpy(uniformBuffer.mapped, &uniformData, sizeof(UniformData));
+			}
+		}
+
+		/** @brief Returns true if instances are tested against a HiZ pyramid */
+		bool usesHiZ()
+		{
+			return hiz != nullptr;
+		}
+
+		/**
+		* Update the matrix the depth buffer of the HiZ pyramid was rendered with, used by the next culling pass
+		*
+		* @param viewProjection Projection * view matrix of the frame the pyramid was built from (e.g. the previous frame)
+		*/
+		void updateHiZView(const glm::mat4 &viewProjection)
+		{
+			uniformData.hizViewProjection = viewProjection;
+			if (uniformBuffer.mapped) {
+				memcpy(uniformBuffer.mapped, &uniformData, sizeof(UniformData));
+			}
+		}
+
+		/**
+		* Update the frustum and the camera position used by the next culling pass
+		*
+		* @param viewProjection Projection * view matrix of the camera the instances are drawn with
+		* @param cameraPos World space camera position for the LOD selection
+		* @param model Transform applied to all bounding spheres (e.g. an animation shared by all instances), must not scale
+		*/
+		void updateView(const glm::mat4 &viewProjection, const glm::vec3 &cameraPos, const glm::mat4 &model = glm::mat4(1.0f))
+		{
+			vks::Frustum frustum;
+			frustum.update(viewProjection);
+			for (uint32_t i = 0; i < 6; i++) {
+				uniformData.frustumPlanes[i] = frustum.planes[i];
+			}
+			uniformData.cameraPos = glm::vec4(cameraPos, 1.0f);
+			uniformData.model = model;
+			if (uniformBuffer.mapped) {
+				memcpy(uniformBuffer.mapped, &uniformData, sizeof(UniformData));
+			}
+		}
+
+		/**
+		* Record the culling passes, must be recorded outside of a render pass
+		*
+		* @param commandBuffer Command buffer to record to
+		*
+		* @note The caller has to make prior writes to the instance data visible to compute shader reads, the results are made visible to the indirect draws and vertex input
+		*/
+		void recordCulling(VkCommandBuffer commandBuffer)
+		{
+			assert(uniformData.instanceCount > 0);
+			const uint32_t groupCount = getGroupCount(uniformData.instanceCount);
+
+			vkCmdFillBuffer(commandBuffer, drawInstanceCountBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+			VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+			memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+			dispatch(commandBuffer, MODE_CULL, groupCount);
+			barrier(commandBuffer);
+			dispatch(commandBuffer, MODE_BUILD, 1);
+			barrier(commandBuffer);
+			dispatch(commandBuffer, MODE_SCATTER, groupCount);
+
+			memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+			vkCmdPipelineBarrier(
+				commandBuffer,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+				0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		}
+
+		/**
+		* Draw the visible instances with the commands written by the last culling pass
+		*
+		* @param commandBuffer Command buffer to record to
+		* @param instanceBinding Vertex input binding of the instance data, rebound per draw if drawIndirectFirstInstance is not enabled
+		*
+		* @note The caller binds the pipeline, the index buffer and the vertex buffers (culledInstanceBuffer for the instance data)
+		*/
+		void cmdDraw(VkCommandBuffer commandBuffer, uint32_t instanceBinding)
+		{
+			const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+			if (uniformData.fixedFirstInstance) {
+				for (uint32_t i = 0; i < uniformData.drawCount; i++) {
+					VkDeviceSize offset = (VkDeviceSize)drawFirstInstances[i] * uniformData.instanceStride * 4;
+					vkCmdBindVertexBuffers(commandBuffer, instanceBinding, 1, &culledInstanceBuffer.buffer, &offset);
+					vkCmdDrawIndexedIndirect(commandBuffer, indirectCommandBuffer.buffer, i * stride, 1, stride);
+				}
+			} else if (drawIndirectCount) {
+				vkCmdDrawIndexedIndirectCountKHR(commandBuffer, indirectCommandBuffer.buffer, 0, drawCountBuffer.buffer, 0, uniformData.drawCount, stride);
+			} else if (device->enabledFeatures.multiDrawIndirect && (uniformData.drawCount <= device->properties.limits.maxDrawIndirectCount)) {
+				vkCmdDrawIndexedIndirect(commandBuffer, indirectCommandBuffer.buffer, 0, uniformData.drawCount, stride);
+			} else {
+				for (uint32_t i = 0; i < uniformData.drawCount; i++) {
+					vkCmdDrawIndexedIndirect(commandBuffer, indirectCommandBuffer.buffer, i * stride, 1, stride);
+				}
+			}
+		}
+
+		/** @brief Returns the statistics of the last culling pass that finished */
+		Statistics getStatistics()
+		{
+			Statistics statistics = { 0, 0 };
+			if (drawCountBuffer.mapped) {
+				memcpy(&statistics, drawCountBuffer.mapped, sizeof(Statistics));
+			}
+			return statistics;
+		}
+
+		/**
+		* Time the culling passes for the current instances and view and check the visible instances against cullReference
+		*
+		* @note The reference only does the frustum test, with a HiZ pyramid set the GPU may only report fewer visible instances per draw
+		*
+		* @param queue Queue to submit to (must support compute and be of the device's default command pool family)
+		*
+		* @return True if the GPU result matches the CPU reference
+		*/
+		bool benchmark(VkQueue queue)
+		{
+			VkQueryPool queryPool;
+			VkQueryPoolCreateInfo queryPoolInfo = {};
+			queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			queryPoolInfo.queryCount = 2;
+			VK_CHECK_RESULT(vkCreateQueryPool(device->logicalDevice, &queryPoolInfo, nullptr, &queryPool));
+
+			vks::Buffer readbackBuffer;
+			const VkDeviceSize countsSize = uniformData.drawCount * sizeof(uint32_t);
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &readbackBuffer, countsSize));
+
+			VkCommandBuffer cmdBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			vkCmdResetQueryPool(cmdBuffer, queryPool, 0, 2);
+			vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+			// Only the command recording is timed on the host, it doesn't depend on the number of instances
+			auto tStart = std::chrono::high_resolution_clock::now();
+			recordCulling(cmdBuffer);
+			double recordTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+			vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+			VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+			memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			VkBufferCopy copyRegion = { 0, 0, countsSize };
+			vkCmdCopyBuffer(cmdBuffer, drawInstanceCountBuffer.buffer, readbackBuffer.buffer, 1, &copyRegion);
+			memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+			vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			device->flushCommandBuffer(cmdBuffer, queue);
+
+			uint64_t timestamps[2] = { 0, 0 };
+			VK_CHECK_RESULT(vkGetQueryPoolResults(device->logicalDevice, queryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+			double gpuTime = (double)(timestamps[1] - timestamps[0]) * device->properties.limits.timestampPeriod / 1000000.0;
+
+			std::vector<uint32_t> gpuCounts(uniformData.drawCount);
+			VK_CHECK_RESULT(readbackBuffer.map());
+			memcpy(gpuCounts.data(), readbackBuffer.mapped, countsSize);
+			readbackBuffer.unmap();
+
+			tStart = std::chrono::high_resolution_clock::now();
+			std::vector<uint32_t> cpuCounts = cullReference(uniformData, bounds, meshIndices, meshes, lods);
+			double cpuTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+
+			// Spheres touching a frustum plane may be classified differently due to floating point precision
+			uint32_t visible = 0;
+			uint32_t occluded = 0;
+			uint32_t mismatches = 0;
+			for (uint32_t i = 0; i < uniformData.drawCount; i++) {
+				visible += gpuCounts[i];
+				if (gpuCounts[i] > cpuCounts[i]) {
+					mismatches += gpuCounts[i] - cpuCounts[i];
+				} else if (hiz) {
+					occluded += cpuCounts[i] - gpuCounts[i];
+				} else {
+					mismatches += cpuCounts[i] - gpuCounts[i];
+				}
+			}
+
+			std::cout << std::fixed << std::setprecision(3);
+			std::cout << "GPU culling of " << uniformData.instanceCount << " instances (" << uniformData.drawCount << " draws, " << (drawIndirectCount ? "draw indirect count" : "instanceCount compaction") << "): ";
+			std::cout << visible << " visible, ";
+			if (hiz) {
+				std::cout << occluded << " occluded, ";
+			}
+			std::cout << gpuTime << " ms GPU, " << recordTime << " ms recording, " << cpuTime << " ms CPU reference, ";
+			std::cout << (mismatches == 0 ? "valid" : std::to_string(mismatches) + " instances differ from the reference") << std::endl;
+
+			readbackBuffer.destroy();
+			vkDestroyQueryPool(device->logicalDevice, queryPool, nullptr);
+
+			return mismatches == 0;
+		}
+
+		/** @brief Release all Vulkan resources */
+		void destroy()
+		{
+			if (device) {
+				destroyBuffers();
+				uniformBuffer.destroy();
+				if (hizPlaceholder.image != VK_NULL_HANDLE) {
+					hizPlaceholder.destroy();
+					hizPlaceholder = vks::Texture2D{};
+				}
+				vkDestroyPipeline(device->logicalDevice, pipeline, nullptr);
+				vkDestroyPipelineLayout(device->logicalDevice, pipelineLayout, nullptr);
+				vkDestroyDescriptorSetLayout(device->logicalDevice, descriptorSetLayout, nullptr);
+				vkDestroyDescriptorPool(device->logicalDevice, descriptorPool, nullptr);
+				device = nullptr;
+			}
+		}
+
+	private:
+		enum Mode { MODE_CULL = 0, MODE_BUILD = 1, MODE_SCATTER = 2 };
+
+		bool drawIndirectCount = false;
+		vks::HiZ *hiz = nullptr;
+		PFN_vkCmdDrawIndexedIndirectCountKHR vkCmdDrawIndexedIndirectCountKHR = nullptr;
+
+		// First instance of every draw for the fallback without drawIndirectFirstInstance
+		std::vector<uint32_t> drawFirstInstances;
+
+		// Host copies for the CPU reference
+		std::vector<InstanceBounds> bounds;
+		std::vector<uint32_t> meshIndices;
+		std::vector<Mesh> meshes;
+		std::vector<Lod> lods;
+
+		static uint32_t selectLod(const UniformData &uniformData, const Mesh &mesh, const std::vector<Lod> &lods, const glm::vec3 &center)
+		{
+			const float dist = glm::length(center - glm::vec3(uniformData.cameraPos)) * uniformData.lodScale;
+			for (uint32_t i = 0; i + 1 < mesh.lodCount; i++) {
+				if (dist < lods[mesh.firstLod + i].distance) {
+					return mesh.firstLod + i;
+				}
+			}
+			return mesh.firstLod + mesh.lodCount - 1;
+		}
+
+		void createDeviceLocalBuffer(VkQueue queue, vks::Buffer *buffer, VkBufferUsageFlags usage, VkDeviceSize size, const void *data)
+		{
+			vks::Buffer stagingBuffer;
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, size, (void*)data));
+			VK_CHECK_RESULT(device->createBuffer(usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, size));
+			device->copyBuffer(&stagingBuffer, buffer, queue);
+			stagingBuffer.destroy();
+		}
+
+		void destroyBuffers()
+		{
+			std::array<vks::Buffer*, 10> buffers = { &boundsBuffer, &meshIndexBuffer, &meshBuffer, &lodBuffer, &culledInstanceBuffer, &visibilityBuffer, &drawInstanceCountBuffer, &drawFirstInstanceBuffer, &indirectCommandBuffer, &drawCountBuffer };
+			for (auto buffer : buffers) {
+				if (buffer->buffer != VK_NULL_HANDLE) {
+					buffer->destroy();
+					*buffer = vks::Buffer();
+				}
+			}
+		}
+
+		void dispatch(VkCommandBuffer commandBuffer, Mode mode, uint32_t groupCount)
+		{
+			uint32_t pushConstant = (uint32_t)mode;
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &pushConstant);
+			vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+		}
+
+		void barrier(VkCommandBuffer commandBuffer)
+		{
+			VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+			memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		}
+	};
+}
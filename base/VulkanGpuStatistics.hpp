@@ -0,0 +1,341 @@
+/*
+* Per pass pipeline statistics and timestamps collected without waiting on the GPU
+*
+* Copyright (C) 2026 by the colefet/Vulkan contributors
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <ostream>
+#include <iomanip>
+#include <algorithm>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanDevice.hpp"
+
+namespace vks
+{
+	/**
+	* Collects vertex, primitive, fragment and compute invocation counters and GPU times for named passes
+	*
+	* Each slot (usually one per prebuilt command buffer) has its own query pools. Passes are marked with
+	* cmdBeginPass/cmdEndPass while recording, after a slot's command buffer has been submitted its results
+	* are polled with VK_QUERY_RESULT_WITH_AVAILABILITY_BIT on later frames and never waited for. Results that
+	* are still missing when the slot is submitted again are dropped.
+	*
+	* Passes must not overlap as only one pipeline statistics query can be active at a time, and a pass that
+	* begins inside a render pass must end in the same subpass
+	*/
+	class GpuStatistics
+	{
+	public:
+		enum Counter {
+			VertexInvocations = 0,
+			Primitives,
+			FragmentInvocations,
+			ComputeInvocations,
+			CounterCount
+		};
+
+		struct Pass {
+			std::string name;
+			// Moving averages
+			double gpuTime = 0.0;
+			double counters[CounterCount] = {};
+			// Sums over all collected frames (for the benchmark results)
+			double totalGpuTime = 0.0;
+			double totalCounters[CounterCount] = {};
+			uint64_t samples = 0;
+		};
+
+		/** @brief Set by the --stats command line argument, all functions are no-ops if disabled */
+		bool enabled = false;
+		/** @brief Maximum number of passes per slot */
+		uint32_t maxPasses = 16;
+		/** @brief Weight of the current frame in the moving averages */
+		double smoothing = 0.1;
+
+		std::vector<Pass> passes;
+
+		/** @brief Frames whose results weren't available before their slot was submitted again */
+		uint32_t droppedFrames = 0;
+
+		/** @brief Names of the counters (in the order of the Counter enum) */
+		static const char* counterName(uint32_t counter)
+		{
+			static const char* names[CounterCount] = { "vertex invocations", "primitives", "fragment invocations", "compute invocations" };
+			return names[counter];
+		}
+
+		/**
+		* Create the query pools
+		*
+		* @param device Device to create the query pools on
+		* @param slotCount Number of slots to create (usually the number of draw command buffers)
+		* @param pipelineStatistics Set to true if the pipelineStatisticsQuery feature has been enabled, otherwise only timestamps are collected
+		* @param timestampPeriod Nanoseconds per timestamp tick (VkPhysicalDeviceLimits::timestampPeriod)
+		*/
+		void prepare(vks::VulkanDevice *device, uint32_t slotCount, bool pipelineStatistics, float timestampPeriod)
+		{
+			if (!enabled) {
+				return;
+			}
+			this->device = device;
+			this->pipelineStatistics = pipelineStatistics;
+			this->timestampPeriod = timestampPeriod;
+			for (uint32_t i = 0; i < slotCount; i++) {
+				createSlot(device->queueFamilyIndices.graphics);
+			}
+		}
+
+		/**
+		* Create an additional slot, e.g. for a command buffer that is submitted to another queue
+		*
+		* @param queueFamilyIndex Queue family the slot's command buffer is submitted to (for the valid timestamp bits)
+		*
+		* @return Index of the new slot
+		*/
+		uint32_t createSlot(uint32_t queueFamilyIndex)
+		{
+			if (!enabled) {
+				return 0;
+			}
+			Slot slot;
+			uint32_t queueFamilyCount;
+			vkGetPhysicalDeviceQueueFamilyProperties(device->physicalDevice, &queueFamilyCount, nullptr);
+			std::vector<VkQueueFamilyProperties> queueFamilyProperties(queueFamilyCount);
+			vkGetPhysicalDeviceQueueFamilyProperties(device->physicalDevice, &queueFamilyCount, queueFamilyProperties.data());
+			const uint32_t validBits = queueFamilyProperties[queueFamilyIndex].timestampValidBits;
+			slot.timestampMask = (validBits >= 64) ? ~0ULL : ((1ULL << validBits) - 1);
+
+			VkQueryPoolCreateInfo queryPoolInfo = {};
+			queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			if (validBits > 0) {
+				queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+				queryPoolInfo.queryCount = maxPasses * 2;
+				VK_CHECK_RESULT(vkCreateQueryPool(device->logicalDevice, &queryPoolInfo, nullptr, &slot.timestamps));
+			}
+			if (pipelineStatistics) {
+				queryPoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+				// Results are returned in the order of the bits, which matches the Counter enum
+				// Graphics counters can't be queried on queues without graphics support
+				if (queueFamilyProperties[queueFamilyIndex].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+					queryPoolInfo.pipelineStatistics =
+						VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+						VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+						VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+					slot.counters = { VertexInvocations, Primitives, FragmentInvocations };
+				}
+				queryPoolInfo.pipelineStatistics |= VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+				slot.counters.push_back(ComputeInvocations);
+				queryPoolInfo.queryCount = maxPasses;
+				VK_CHECK_RESULT(vkCreateQueryPool(device->logicalDevice, &queryPoolInfo, nullptr, &slot.statistics));
+			}
+			slots.push_back(slot);
+			return static_cast<uint32_t>(slots.size() - 1);
+		}
+
+		void destroy()
+		{
+			for (auto &slot : slots) {
+				if (slot.timestamps != VK_NULL_HANDLE) {
+					vkDestroyQueryPool(device->logicalDevice, slot.timestamps, nullptr);
+				}
+				if (slot.statistics != VK_NULL_HANDLE) {
+					vkDestroyQueryPool(device->logicalDevice, slot.statistics, nullptr);
+				}
+			}
+			slots.clear();
+		}
+
+		/** @brief Reset the queries of a slot, must be recorded at the start of the command buffer outside of a render pass */
+		void cmdReset(VkCommandBuffer commandBuffer, uint32_t slotIndex)
+		{
+			if (!enabled || (slotIndex >= slots.size())) {
+				return;
+			}
+			Slot &slot = slots[slotIndex];
+			// The recorded passes change, so results of an earlier recording that aren't available yet are lost
+			if (slot.pending && !readResults(slot)) {
+				droppedFrames++;
+			}
+			slot.pending = false;
+			slot.passes.clear();
+			if (slot.timestamps != VK_NULL_HANDLE) {
+				vkCmdResetQueryPool(commandBuffer, slot.timestamps, 0, maxPasses * 2);
+			}
+			if (slot.statistics != VK_NULL_HANDLE) {
+				vkCmdResetQueryPool(commandBuffer, slot.statistics, 0, maxPasses);
+			}
+		}
+
+		/** @brief Begin a named pass, passes with the same name in different slots are accumulated together */
+		void cmdBeginPass(VkCommandBuffer commandBuffer, uint32_t slotIndex, const std::string &name)
+		{
+			if (!enabled || (slotIndex >= slots.size())) {
+				return;
+			}
+			Slot &slot = slots[slotIndex];
+			assert(slot.passes.size() < maxPasses);
+			const uint32_t query = static_cast<uint32_t>(slot.passes.size());
+			slot.passes.push_back(getPass(name));
+			if (slot.timestamps != VK_NULL_HANDLE) {
+				vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, slot.timestamps, query * 2);
+			}
+			if (slot.statistics != VK_NULL_HANDLE) {
+				vkCmdBeginQuery(commandBuffer, slot.statistics, query, 0);
+			}
+		}
+
+		void cmdEndPass(VkCommandBuffer commandBuffer, uint32_t slotIndex)
+		{
+			if (!enabled || (slotIndex >= slots.size())) {
+				return;
+			}
+			Slot &slot = slots[slotIndex];
+			const uint32_t query = static_cast<uint32_t>(slot.passes.size() - 1);
+			if (slot.statistics != VK_NULL_HANDLE) {
+				vkCmdEndQuery(commandBuffer, slot.statistics, query);
+			}
+			if (slot.timestamps != VK_NULL_HANDLE) {
+				vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, slot.timestamps, query * 2 + 1);
+			}
+		}
+
+		/** @brief Notify that the command buffer of a slot has been submitted */
+		void submitted(uint32_t slotIndex)
+		{
+			if (!enabled || (slotIndex >= slots.size())) {
+				return;
+			}
+			Slot &slot = slots[slotIndex];
+			if (slot.passes.empty()) {
+				return;
+			}
+			// The new submission resets the queries before the previous results could be read
+			if (slot.pending) {
+				droppedFrames++;
+			}
+			slot.pending = true;
+		}
+
+		/** @brief Read the results of all submitted slots that are available by now, never waits */
+		void collect()
+		{
+			if (!enabled) {
+				return;
+			}
+			for (auto &slot : slots) {
+				if (slot.pending) {
+					slot.pending = !readResults(slot);
+				}
+			}
+		}
+
+		/** @brief Write the per pass averages over all collected frames as CSV */
+		void writeResults(std::ostream &stream)
+		{
+			stream << "pass,frames,gpu (ms)";
+			for (uint32_t c = 0; c < CounterCount; c++) {
+				stream << "," << counterName(c);
+			}
+			stream << std::endl;
+			for (auto &pass : passes) {
+				const double samples = (double)std::max(pass.samples, (uint64_t)1);
+				stream << pass.name << "," << pass.samples << "," << pass.totalGpuTime / samples;
+				for (uint32_t c = 0; c < CounterCount; c++) {
+					stream << "," << (uint64_t)(pass.totalCounters[c] / samples);
+				}
+				stream << std::endl;
+			}
+		}
+
+	private:
+		struct Slot {
+			VkQueryPool timestamps = VK_NULL_HANDLE;
+			VkQueryPool statistics = VK_NULL_HANDLE;
+			uint64_t timestampMask = 0;
+			// Counters returned by the statistics pool (in result order)
+			std::vector<uint32_t> counters;
+			// Pass index for each query of the current recording
+			std::vector<uint32_t> passes;
+			bool pending = false;
+		};
+
+		vks::VulkanDevice *device = nullptr;
+		bool pipelineStatistics = false;
+		float timestampPeriod = 1.0f;
+		std::vector<Slot> slots;
+		// Timestamp/availability pairs and counter/availability tuples
+		std::vector<uint64_t> timestampResults;
+		std::vector<uint64_t> statisticsResults;
+
+		uint32_t getPass(const std::string &name)
+		{
+			for (uint32_t i = 0; i < passes.size(); i++) {
+				if (passes[i].name == name) {
+					return i;
+				}
+			}
+			Pass pass;
+			pass.name = name;
+			passes.push_back(pass);
+			return static_cast<uint32_t>(passes.size() - 1);
+		}
+
+		/** @brief Returns false if not all of the slot's results are available yet */
+		bool readResults(Slot &slot)
+		{
+			const uint32_t count = static_cast<uint32_t>(slot.passes.size());
+			const VkQueryResultFlags flags = VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT;
+			if (slot.timestamps != VK_NULL_HANDLE) {
+				timestampResults.resize(count * 2 * 2);
+				vkGetQueryPoolResults(device->logicalDevice, slot.timestamps, 0, count * 2, timestampResults.size() * sizeof(uint64_t), timestampResults.data(), sizeof(uint64_t) * 2, flags);
+				for (uint32_t i = 0; i < count * 2; i++) {
+					if (timestampResults[i * 2 + 1] == 0) {
+						return false;
+					}
+				}
+			}
+			if (slot.statistics != VK_NULL_HANDLE) {
+				const uint32_t stride = static_cast<uint32_t>(slot.counters.size()) + 1;
+				statisticsResults.resize(count * stride);
+				vkGetQueryPoolResults(device->logicalDevice, slot.statistics, 0, count, statisticsResults.size() * sizeof(uint64_t), statisticsResults.data(), sizeof(uint64_t) * stride, flags);
+				for (uint32_t i = 0; i < count; i++) {
+					if (statisticsResults[i * stride + stride - 1] == 0) {
+						return false;
+					}
+				}
+			}
+
+			for (uint32_t i = 0; i < count; i++) {
+				Pass &pass = passes[slot.passes[i]];
+				pass.samples++;
+				if (slot.timestamps != VK_NULL_HANDLE) {
+					const uint64_t begin = timestampResults[i * 4] & slot.timestampMask;
+					const uint64_t end = timestampResults[i * 4 + 2] & slot.timestampMask;
+					// Handle a wrap of the timestamp counter between the two writes
+					const uint64_t ticks = (end - begin) & slot.timestampMask;
+					const double ms = (double)ticks * (double)timestampPeriod / 1000000.0;
+					pass.gpuTime = (pass.samples == 1) ? ms : pass.gpuTime * (1.0 - smoothing) + ms * smoothing;
+					pass.totalGpuTime += ms;
+				}
+				if (slot.statistics != VK_NULL_HANDLE) {
+					const size_t stride = slot.counters.size() + 1;
+					for (size_t r = 0; r < slot.counters.size(); r++) {
+						const uint32_t c = slot.counters[r];
+						const double value = (double)statisticsResults[i * stride + r];
+						pass.counters[c] = (pass.samples == 1) ? value : pass.counters[c] * (1.0 - smoothing) + value * smoothing;
+						pass.totalCounters[c] += value;
+					}
+				}
+			}
+			return true;
+		}
+	};
+}
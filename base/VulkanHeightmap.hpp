@@ -6,26 +6,57 @@
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
-#include <glm/glm.hpp>
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <glm/glm.hpp>
 
 #include "vulkan/vulkan.h"
 #include "VulkanDevice.hpp"
 #include "VulkanBuffer.hpp"
+#include "frustum.hpp"
 #include <ktx.h>
 #include <ktxvulkan.h>
 
-namespace vks 
+namespace vks
 {
 	class HeightMap
 	{
 	private:
-		uint16_t *heightdata;
-		uint32_t dim;
-		uint32_t scale;
+		std::vector<uint16_t> heightdata;
+		uint32_t dim = 0;
+		uint32_t scale = 1;
 
 		vks::VulkanDevice *device = nullptr;
 		VkQueue copyQueue = VK_NULL_HANDLE;
+
+		// Raw height sample, coordinates are clamped to the height map
+		uint16_t sample(int32_t x, int32_t y) const
+		{
+			x = std::max(0, std::min(x, (int32_t)dim - 1));
+			y = std::max(0, std::min(y, (int32_t)dim - 1));
+			return heightdata[x + y * dim];
+		}
+
+		// Upload data to a device local buffer through a staging buffer
+		void createDeviceLocalBuffer(VkBufferUsageFlags usage, vks::Buffer *buffer, VkDeviceSize size, void *data)
+		{
+			vks::Buffer staging;
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging, size, data));
+			VK_CHECK_RESULT(device->createBuffer(usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, size));
+			VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			VkBufferCopy copyRegion = {};
+			copyRegion.size = size;
+			vkCmdCopyBuffer(copyCmd, staging.buffer, buffer->buffer, 1, &copyRegion);
+			device->flushCommandBuffer(copyCmd, copyQueue, true);
+			staging.destroy();
+		}
+
 	public:
 		enum Topology { topologyTriangles, topologyQuads };
 
@@ -45,6 +76,53 @@ namespace vks
 		size_t indexBufferSize = 0;
 		uint32_t indexCount = 0;
 
+		/** @brief Compact vertex used by the chunked terrain, the position on the grid is derived from the vertex index in the shader */
+		struct ChunkVertex {
+			// Raw height (R16_UNORM)
+			uint16_t height;
+			// x and z components of the normal (R8G8_SNORM), y is reconstructed as the normal always points up
+			int8_t normal[2];
+		};
+
+		/** @brief Chunk layout passed to the vertex shader as push constants */
+		struct ChunkPushConstants {
+			glm::vec2 origin;
+			float spacing;
+			float heightScale;
+			float skirtDepth;
+			uint32_t chunkSize;
+			uint32_t chunksPerRow;
+			float uvScale;
+		};
+
+		/** @brief Chunked terrain with a geomipmapped level of detail chain per chunk */
+		struct Chunks {
+			// Number of quads along a chunk side (power of two)
+			uint32_t size = 0;
+			uint32_t lodCount = 0;
+			uint32_t chunksPerRow = 0;
+			// Vertices per chunk: (size + 1)^2 grid vertices followed by 4 * (size + 1) skirt vertices
+			uint32_t vertexCount = 0;
+			ChunkPushConstants pushConstants;
+			// Per chunk bounding sphere and geometric error of each level of detail (in world units)
+			std::vector<glm::vec4> boundingSpheres;
+			std::vector<float> lodErrors;
+			// Index ranges of the levels of detail in the shared index buffer
+			std::vector<uint32_t> lodFirstIndex;
+			std::vector<uint32_t> lodIndexCount;
+			vks::Buffer vertexBuffer;
+			// Shared by all chunks, chunks only differ in their vertex offset
+			vks::Buffer indexBuffer;
+			// One indirect draw per chunk, rewritten each frame by updateChunks
+			vks::Buffer indirectBuffer;
+			// Selected level of detail per chunk (UINT32_MAX if culled)
+			std::vector<uint32_t> selectedLods;
+			uint32_t visibleCount = 0;
+			uint64_t triangleCount = 0;
+			// Time spent generating chunk geometry on the CPU (in ms)
+			float generationTime = 0.0f;
+		} chunks;
+
 		HeightMap(vks::VulkanDevice *device, VkQueue copyQueue)
 		{
 			this->device = device;
@@ -55,39 +133,44 @@ namespace vks
 		{
 			vertexBuffer.destroy();
 			indexBuffer.destroy();
-			delete[] heightdata;
+			chunks.vertexBuffer.destroy();
+			chunks.indexBuffer.destroy();
+			chunks.indirectBuffer.destroy();
+		}
+
+		uint32_t getDim() const
+		{
+			return dim;
 		}
 
-		float getHeight(uint32_t x, uint32_t y)
+		const std::vector<uint16_t>& getHeightData() const
 		{
-			glm::ivec2 rpos = glm::ivec2(x, y) * glm::ivec2(scale);
-			rpos.x = std::max(0, std::min(rpos.x, (int)dim - 1));
-			rpos.y = std::max(0, std::min(rpos.y, (int)dim - 1));
-			rpos /= glm::ivec2(scale);
-			return *(heightdata + (rpos.x + rpos.y * dim) * scale) / 65535.0f * heightScale;
+			return heightdata;
 		}
 
+		float getHeight(uint32_t x, uint32_t y) const
+		{
+			return sample(x * scale, y * scale) / 65535.0f * heightScale;
+		}
+
+		/** @brief Load the height samples of a single channel 16 bit KTX file */
 #if defined(__ANDROID__)
-		void loadFromFile(const std::string filename, uint32_t patchsize, glm::vec3 scale, Topology topology, AAssetManager* assetManager)
+		void loadHeightData(const std::string filename, AAssetManager* assetManager)
 #else
-		void loadFromFile(const std::string filename, uint32_t patchsize, glm::vec3 scale, Topology topology)
+		void loadHeightData(const std::string filename)
 #endif
 		{
-			assert(device);
-			assert(copyQueue != VK_NULL_HANDLE);
-
 			ktxResult result;
 			ktxTexture* ktxTexture;
 #if defined(__ANDROID__)
-			AAsset* asset = AAssetManager_open(androidApp->activity->assetManager, filename.c_str(), AASSET_MODE_STREAMING);
+			AAsset* asset = AAssetManager_open(assetManager, filename.c_str(), AASSET_MODE_STREAMING);
 			assert(asset);
 			size_t size = AAsset_getLength(asset);
 			assert(size > 0);
-			void *textureData = malloc(size);
-			AAsset_read(asset, textureData, size);
+			std::vector<ktx_uint8_t> textureData(size);
+			AAsset_read(asset, textureData.data(), size);
 			AAsset_close(asset);
-			result = ktxTexture_CreateFromMemory(textureData, size, KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, target);
-			free(textureData);
+			result = ktxTexture_CreateFromMemory(textureData.data(), size, KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &ktxTexture);
 #else
 			result = ktxTexture_CreateFromNamedFile(filename.c_str(), KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &ktxTexture);
 #endif
@@ -95,38 +178,87 @@ namespace vks
 			ktx_size_t ktxSize = ktxTexture_GetImageSize(ktxTexture, 0);
 			ktx_uint8_t* ktxImage = ktxTexture_GetData(ktxTexture);
 			dim = ktxTexture->baseWidth;
-			heightdata = new uint16_t[dim * dim];
-			memcpy(heightdata, ktxImage, ktxSize);
-			this->scale = dim / patchsize;
+			heightdata.resize(dim * dim);
+			memcpy(heightdata.data(), ktxImage, std::min(ktxSize, (ktx_size_t)(heightdata.size() * sizeof(uint16_t))));
 			ktxTexture_Destroy(ktxTexture);
+		}
+
+		/** @brief Use existing height samples (e.g. generated or resampled ones) */
+		void setHeightData(std::vector<uint16_t> &&data, uint32_t dim)
+		{
+			assert(data.size() == (size_t)dim * dim);
+			heightdata = std::move(data);
+			this->dim = dim;
+		}
+
+		/** @brief Bilinearly resample the height data to a new dimension */
+		void resample(uint32_t newDim)
+		{
+			std::vector<uint16_t> resampled((size_t)newDim * newDim);
+			const float ratio = (float)(dim - 1) / (float)(newDim - 1);
+			for (uint32_t y = 0; y < newDim; y++) {
+				const float fy = y * ratio;
+				const int32_t y0 = (int32_t)fy;
+				const float ty = fy - y0;
+				for (uint32_t x = 0; x < newDim; x++) {
+					const float fx = x * ratio;
+					const int32_t x0 = (int32_t)fx;
+					const float tx = fx - x0;
+					const float h0 = sample(x0, y0) * (1.0f - tx) + sample(x0 + 1, y0) * tx;
+					const float h1 = sample(x0, y0 + 1) * (1.0f - tx) + sample(x0 + 1, y0 + 1) * tx;
+					resampled[x + (size_t)y * newDim] = (uint16_t)(h0 * (1.0f - ty) + h1 * ty + 0.5f);
+				}
+			}
+			setHeightData(std::move(resampled), newDim);
+		}
+
+#if defined(__ANDROID__)
+		void loadFromFile(const std::string filename, uint32_t patchsize, glm::vec3 scale, Topology topology, AAssetManager* assetManager)
+#else
+		void loadFromFile(const std::string filename, uint32_t patchsize, glm::vec3 scale, Topology topology)
+#endif
+		{
+			assert(device);
+			assert(copyQueue != VK_NULL_HANDLE);
+
+#if defined(__ANDROID__)
+			loadHeightData(filename, assetManager);
+#else
+			loadHeightData(filename);
+#endif
+			this->scale = dim / patchsize;
 
 			// Generate vertices
-			Vertex * vertices = new Vertex[patchsize * patchsize * 4];
+			std::vector<Vertex> vertices(patchsize * patchsize);
 
 			const float wx = 2.0f;
 			const float wy = 2.0f;
 
-			for (uint32_t x = 0; x < patchsize; x++)
+			for (uint32_t y = 0; y < patchsize; y++)
 			{
-				for (uint32_t y = 0; y < patchsize; y++)
+				for (uint32_t x = 0; x < patchsize; x++)
 				{
-					uint32_t index = (x + y * patchsize);
-					vertices[index].pos[0] = (x * wx + wx / 2.0f - (float)patchsize * wx / 2.0f) * scale.x;
-					vertices[index].pos[1] = -getHeight(x, y);
-					vertices[index].pos[2] = (y * wy + wy / 2.0f - (float)patchsize * wy / 2.0f) * scale.z;
-					vertices[index].uv = glm::vec2((float)x / patchsize, (float)y / patchsize) * uvScale;
+					Vertex &vertex = vertices[x + y * patchsize];
+					vertex.pos[0] = (x * wx + wx / 2.0f - (float)patchsize * wx / 2.0f) * scale.x;
+					vertex.pos[1] = -getHeight(x, y);
+					vertex.pos[2] = (y * wy + wy / 2.0f - (float)patchsize * wy / 2.0f) * scale.z;
+					vertex.uv = glm::vec2((float)x / patchsize, (float)y / patchsize) * uvScale;
 				}
 			}
 
+			// Normals from central differences of the already generated heights (one sided at the borders)
 			for (uint32_t y = 0; y < patchsize; y++)
 			{
 				for (uint32_t x = 0; x < patchsize; x++)
 				{
-					float dx = getHeight(x < patchsize - 1 ? x + 1 : x, y) - getHeight(x > 0 ? x - 1 : x, y);
+					const uint32_t x0 = x > 0 ? x - 1 : x;
+					const uint32_t x1 = x < patchsize - 1 ? x + 1 : x;
+					const uint32_t y0 = y > 0 ? y - 1 : y;
+					const uint32_t y1 = y < patchsize - 1 ? y + 1 : y;
+					float dx = vertices[x0 + y * patchsize].pos[1] - vertices[x1 + y * patchsize].pos[1];
 					if (x == 0 || x == patchsize - 1)
 						dx *= 2.0f;
-
-					float dy = getHeight(x, y < patchsize - 1 ? y + 1 : y) - getHeight(x, y > 0 ? y - 1 : y);
+					float dy = vertices[x + y0 * patchsize].pos[1] - vertices[x + y1 * patchsize].pos[1];
 					if (y == 0 || y == patchsize - 1)
 						dy *= 2.0f;
 
@@ -142,14 +274,14 @@ namespace vks
 			// Generate indices
 
 			const uint32_t w = (patchsize - 1);
-			uint32_t *indices;
+			std::vector<uint32_t> indices;
 
 			switch (topology)
 			{
 				// Indices for triangles
 			case topologyTriangles:
 			{
-				indices = new uint32_t[w * w * 6];
+				indices.resize(w * w * 6);
 				for (uint32_t x = 0; x < w; x++)
 				{
 					for (uint32_t y = 0; y < w; y++)
@@ -164,15 +296,12 @@ namespace vks
 						indices[index + 5] = indices[index];
 					}
 				}
-				indexCount = (patchsize - 1) * (patchsize - 1) * 6;
-				indexBufferSize = (w * w * 6) * sizeof(uint32_t);
 				break;
 			}
 			// Indices for quad patches (tessellation)
 			case topologyQuads:
 			{
-
-				indices = new uint32_t[w * w * 4];
+				indices.resize(w * w * 4);
 				for (uint32_t x = 0; x < w; x++)
 				{
 					for (uint32_t y = 0; y < w; y++)
@@ -184,76 +313,290 @@ namespace vks
 						indices[index + 3] = indices[index] + 1;
 					}
 				}
-				indexCount = (patchsize - 1) * (patchsize - 1) * 4;
-				indexBufferSize = (w * w * 4) * sizeof(uint32_t);
 				break;
 			}
 
 			}
 
+			indexCount = static_cast<uint32_t>(indices.size());
+			indexBufferSize = indices.size() * sizeof(uint32_t);
+			vertexBufferSize = vertices.size() * sizeof(Vertex);
 			assert(indexBufferSize > 0);
 
-			vertexBufferSize = (patchsize * patchsize * 4) * sizeof(Vertex);
-
 			// Generate Vulkan buffers
+			createDeviceLocalBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, &vertexBuffer, vertexBufferSize, vertices.data());
+			createDeviceLocalBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, &indexBuffer, indexBufferSize, indices.data());
+		}
 
-			vks::Buffer vertexStaging, indexStaging;
-
-			// Create staging buffers
-			device->createBuffer(
-				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-				&vertexStaging,
-				vertexBufferSize,
-				vertices);
-
-			device->createBuffer(
-				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-				&indexStaging,
-				indexBufferSize,
-				indices);
-
-			// Device local (target) buffer
-			device->createBuffer(
-				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-				&vertexBuffer,
-				vertexBufferSize);
-
-			device->createBuffer(
-				VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-				&indexBuffer,
-				indexBufferSize);
-
-			// Copy from staging buffers
-			VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		/**
+		* Split the loaded height data into chunks with a level of detail chain each (geomipmapping)
+		*
+		* Cracks between chunks with different levels of detail are hidden by skirts along the chunk borders (render without backface culling)
+		* Chunk geometry is generated in parallel and uploaded in batches to keep the staging memory bounded
+		*
+		* @param chunkSize Number of quads along a chunk side (power of two, at most 128 so indices fit into 16 bits)
+		* @param lodCount Requested number of detail levels (clamped to what the chunk size allows)
+		* @param extent Size of the whole terrain in world units (x and z)
+		* @param heightScale World height of the maximum height value
+		*/
+		void createChunks(uint32_t chunkSize, uint32_t lodCount, float extent, float heightScale)
+		{
+			assert(device);
+			assert(copyQueue != VK_NULL_HANDLE);
+			assert(!heightdata.empty());
+			assert((chunkSize >= 2) && (chunkSize <= 128) && ((chunkSize & (chunkSize - 1)) == 0));
 
-			VkBufferCopy copyRegion = {};
+			auto tStart = std::chrono::high_resolution_clock::now();
 
-			copyRegion.size = vertexBufferSize;
-			vkCmdCopyBuffer(
-				copyCmd,
-				vertexStaging.buffer,
-				vertexBuffer.buffer,
-				1,
-				&copyRegion);
-
-			copyRegion.size = indexBufferSize;
-			vkCmdCopyBuffer(
-				copyCmd,
-				indexStaging.buffer,
-				indexBuffer.buffer,
-				1,
-				&copyRegion);
+			chunks.vertexBuffer.destroy();
+			chunks.indexBuffer.destroy();
+			chunks.indirectBuffer.destroy();
 
-			device->flushCommandBuffer(copyCmd, copyQueue, true);
+			const uint32_t row = chunkSize + 1;
+			uint32_t maxLods = 1;
+			while ((chunkSize >> maxLods) > 0) {
+				maxLods++;
+			}
+			chunks.size = chunkSize;
+			chunks.lodCount = std::max(1u, std::min(lodCount, maxLods));
+			chunks.chunksPerRow = (dim - 1 + chunkSize - 1) / chunkSize;
+			chunks.vertexCount = row * row + 4 * row;
+			const uint32_t chunkCount = chunks.chunksPerRow * chunks.chunksPerRow;
+
+			ChunkPushConstants &pc = chunks.pushConstants;
+			pc.origin = glm::vec2(-extent / 2.0f);
+			pc.spacing = extent / (float)(dim - 1);
+			pc.heightScale = heightScale;
+			pc.skirtDepth = pc.spacing * (float)chunkSize * 0.25f;
+			pc.chunkSize = chunkSize;
+			pc.chunksPerRow = chunks.chunksPerRow;
+			pc.uvScale = 1.0f / (float)(dim - 1);
+
+			/*
+				Shared index buffer with all levels of detail, a level skips every 2^lod vertices of the full resolution grid
+			*/
+			std::vector<uint16_t> indices;
+			chunks.lodFirstIndex.resize(chunks.lodCount);
+			chunks.lodIndexCount.resize(chunks.lodCount);
+			auto skirtIndex = [row](uint32_t side, uint32_t t) { return (uint16_t)(row * row + side * row + t); };
+			for (uint32_t lod = 0; lod < chunks.lodCount; lod++) {
+				const uint32_t step = 1 << lod;
+				chunks.lodFirstIndex[lod] = static_cast<uint32_t>(indices.size());
+				for (uint32_t y = 0; y < chunkSize; y += step) {
+					for (uint32_t x = 0; x < chunkSize; x += step) {
+						const uint16_t i0 = (uint16_t)(x + y * row);
+						const uint16_t i1 = (uint16_t)(i0 + step * row);
+						indices.insert(indices.end(), { i0, i1, (uint16_t)(i1 + step), (uint16_t)(i1 + step), (uint16_t)(i0 + step), i0 });
+					}
+				}
+				// Skirts hang down from the chunk borders to hide cracks between neighbouring levels of detail
+				for (uint32_t t = 0; t < chunkSize; t += step) {
+					const uint16_t edges[4][2] = {
+						{ (uint16_t)t, (uint16_t)(t + step) },
+						{ (uint16_t)(t + chunkSize * row), (uint16_t)(t + step + chunkSize * row) },
+						{ (uint16_t)(t * row), (uint16_t)((t + step) * row) },
+						{ (uint16_t)(chunkSize + t * row), (uint16_t)(chunkSize + (t + step) * row) },
+					};
+					for (uint32_t side = 0; side < 4; side++) {
+						const uint16_t e0 = edges[side][0], e1 = edges[side][1];
+						const uint16_t s0 = skirtIndex(side, t), s1 = skirtIndex(side, t + step);
+						indices.insert(indices.end(), { e0, s0, e1, e1, s0, s1 });
+					}
+				}
+				chunks.lodIndexCount[lod] = static_cast<uint32_t>(indices.size()) - chunks.lodFirstIndex[lod];
+			}
+			createDeviceLocalBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, &chunks.indexBuffer, indices.size() * sizeof(uint16_t), indices.data());
+
+			/*
+				Chunk vertices and level of detail errors
+			*/
+			chunks.boundingSpheres.resize(chunkCount);
+			chunks.lodErrors.resize(chunkCount * chunks.lodCount);
+			chunks.selectedLods.assign(chunkCount, UINT32_MAX);
+
+			const VkDeviceSize chunkBytes = chunks.vertexCount * sizeof(ChunkVertex);
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &chunks.vertexBuffer, chunkBytes * chunkCount));
+
+			// Chunks are generated directly into a staging buffer that holds a batch of chunks
+			const uint32_t batchSize = std::max(1u, std::min(chunkCount, (uint32_t)((64 * 1024 * 1024) / chunkBytes)));
+			vks::Buffer staging;
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging, chunkBytes * batchSize));
+			VK_CHECK_RESULT(staging.map());
+
+			const uint32_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+			for (uint32_t batchStart = 0; batchStart < chunkCount; batchStart += batchSize) {
+				const uint32_t batchEnd = std::min(chunkCount, batchStart + batchSize);
+				std::atomic<uint32_t> nextChunk(batchStart);
+				std::vector<std::thread> threads;
+				for (uint32_t t = 0; t < threadCount; t++) {
+					threads.push_back(std::thread([&] {
+						uint32_t chunk;
+						while ((chunk = nextChunk++) < batchEnd) {
+							generateChunk(chunk, (ChunkVertex*)staging.mapped + (size_t)(chunk - batchStart) * chunks.vertexCount);
+						}
+					}));
+				}
+				for (auto &thread : threads) {
+					thread.join();
+				}
+
+				VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+				VkBufferCopy copyRegion = {};
+				copyRegion.dstOffset = chunkBytes * batchStart;
+				copyRegion.size = chunkBytes * (batchEnd - batchStart);
+				vkCmdCopyBuffer(copyCmd, staging.buffer, chunks.vertexBuffer.buffer, 1, &copyRegion);
+				device->flushCommandBuffer(copyCmd, copyQueue, true);
+			}
+			staging.destroy();
 
-			vkDestroyBuffer(device->logicalDevice, vertexStaging.buffer, nullptr);
-			vkFreeMemory(device->logicalDevice, vertexStaging.memory, nullptr);
-			vkDestroyBuffer(device->logicalDevice, indexStaging.buffer, nullptr);
-			vkFreeMemory(device->logicalDevice, indexStaging.memory, nullptr);
+			// Host visible so the per frame selection can be written without an upload
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &chunks.indirectBuffer, chunkCount * sizeof(VkDrawIndexedIndirectCommand)));
+			VK_CHECK_RESULT(chunks.indirectBuffer.map());
+			memset(chunks.indirectBuffer.mapped, 0, chunkCount * sizeof(VkDrawIndexedIndirectCommand));
+
+			chunks.generationTime = (float)std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+		}
+
+		/**
+		* Generate the vertices, bounds and level of detail errors of a single chunk
+		*
+		* @param chunk Index of the chunk
+		* @param vertices Destination for chunks.vertexCount vertices
+		*/
+		void generateChunk(uint32_t chunk, ChunkVertex *vertices)
+		{
+			const uint32_t size = chunks.size;
+			const uint32_t row = size + 1;
+			const int32_t baseX = (chunk % chunks.chunksPerRow) * size;
+			const int32_t baseY = (chunk / chunks.chunksPerRow) * size;
+			const ChunkPushConstants &pc = chunks.pushConstants;
+			// Height difference to world space slope
+			const float slopeScale = pc.heightScale / 65535.0f / (2.0f * pc.spacing);
+
+			uint16_t minHeight = 0xFFFF, maxHeight = 0;
+			for (uint32_t y = 0; y < row; y++) {
+				const int32_t gy = baseY + y;
+				for (uint32_t x = 0; x < row; x++) {
+					const int32_t gx = baseX + x;
+					ChunkVertex &vertex = vertices[x + y * row];
+					vertex.height = sample(gx, gy);
+					// Central differences over the whole height map, so normals are continuous across chunk borders
+					const glm::vec3 normal = glm::normalize(glm::vec3(
+						-((float)sample(gx + 1, gy) - (float)sample(gx - 1, gy)) * slopeScale,
+						1.0f,
+						-((float)sample(gx, gy + 1) - (float)sample(gx, gy - 1)) * slopeScale));
+					vertex.normal[0] = (int8_t)(normal.x * 127.0f);
+					vertex.normal[1] = (int8_t)(normal.z * 127.0f);
+					minHeight = std::min(minHeight, vertex.height);
+					maxHeight = std::max(maxHeight, vertex.height);
+				}
+			}
+
+			// Skirt vertices duplicate the border vertices, they're moved down in the vertex shader
+			for (uint32_t t = 0; t < row; t++) {
+				vertices[row * row + 0 * row + t] = vertices[t];
+				vertices[row * row + 1 * row + t] = vertices[t + size * row];
+				vertices[row * row + 2 * row + t] = vertices[t * row];
+				vertices[row * row + 3 * row + t] = vertices[size + t * row];
+			}
+
+			// Bounding sphere in world space (y is up in negative direction)
+			const float halfExtent = size * pc.spacing * 0.5f;
+			const float minY = -(float)maxHeight / 65535.0f * pc.heightScale;
+			const float maxY = -(float)minHeight / 65535.0f * pc.heightScale + pc.skirtDepth;
+			const glm::vec3 center = glm::vec3(pc.origin.x + baseX * pc.spacing + halfExtent, (minY + maxY) * 0.5f, pc.origin.y + baseY * pc.spacing + halfExtent);
+			chunks.boundingSpheres[chunk] = glm::vec4(center, glm::length(glm::vec3(halfExtent, (maxY - minY) * 0.5f, halfExtent)));
+
+			// Geometric error of each level: maximum height difference between the full resolution grid and the triangles of that level
+			float *errors = &chunks.lodErrors[chunk * chunks.lodCount];
+			errors[0] = 0.0f;
+			for (uint32_t lod = 1; lod < chunks.lodCount; lod++) {
+				const uint32_t step = 1 << lod;
+				float maxError = 0.0f;
+				for (uint32_t y = 0; y < row; y++) {
+					const uint32_t y0 = std::min(y / step * step, size - step);
+					const float v = (float)(y - y0) / step;
+					for (uint32_t x = 0; x < row; x++) {
+						const uint32_t x0 = std::min(x / step * step, size - step);
+						const float u = (float)(x - x0) / step;
+						const float ha = vertices[x0 + y0 * row].height;
+						const float hb = vertices[x0 + (y0 + step) * row].height;
+						const float hc = vertices[(x0 + step) + (y0 + step) * row].height;
+						const float hd = vertices[(x0 + step) + y0 * row].height;
+						// Same diagonal split as the index buffer
+						const float h = (v >= u) ? ha + v * (hb - ha) + u * (hc - hb) : ha + u * (hd - ha) + v * (hc - hd);
+						maxError = std::max(maxError, std::abs(h - (float)vertices[x + y * row].height));
+					}
+				}
+				// Keep errors monotonic so coarser levels are never preferred over finer ones
+				errors[lod] = std::max(errors[lod - 1], maxError / 65535.0f * pc.heightScale);
+			}
+		}
+
+		/**
+		* Select the level of detail for each chunk and write the indirect draws for the current frame
+		*
+		* @param projection Projection matrix
+		* @param view View matrix
+		* @param viewportHeight Height of the viewport in pixels
+		* @param maxScreenError Maximum allowed geometric error in pixels
+		*
+		* @note The indirect buffer is written directly, the caller has to make sure it's not in use by the GPU
+		*/
+		void updateChunks(const glm::mat4 &projection, const glm::mat4 &view, float viewportHeight, float maxScreenError)
+		{
+			vks::Frustum frustum;
+			frustum.update(projection * view);
+			const glm::vec3 cameraPos = glm::vec3(glm::inverse(view)[3]);
+			// Converts a world space error at distance 1 into pixels
+			const float errorToPixels = viewportHeight * 0.5f * projection[1][1];
+
+			VkDrawIndexedIndirectCommand *draws = (VkDrawIndexedIndirectCommand*)chunks.indirectBuffer.mapped;
+			chunks.visibleCount = 0;
+			chunks.triangleCount = 0;
+			for (uint32_t chunk = 0; chunk < chunks.boundingSpheres.size(); chunk++) {
+				const glm::vec4 &sphere = chunks.boundingSpheres[chunk];
+				VkDrawIndexedIndirectCommand &draw = draws[chunk];
+				if (!frustum.checkSphere(glm::vec3(sphere), sphere.w)) {
+					chunks.selectedLods[chunk] = UINT32_MAX;
+					draw.indexCount = 0;
+					draw.instanceCount = 0;
+					continue;
+				}
+				const float distance = std::max(glm::length(glm::vec3(sphere) - cameraPos) - sphere.w, 1e-3f);
+				const float *errors = &chunks.lodErrors[chunk * chunks.lodCount];
+				uint32_t lod = 0;
+				while ((lod + 1 < chunks.lodCount) && (errors[lod + 1] * errorToPixels / distance <= maxScreenError)) {
+					lod++;
+				}
+				chunks.selectedLods[chunk] = lod;
+				draw.indexCount = chunks.lodIndexCount[lod];
+				draw.instanceCount = 1;
+				draw.firstIndex = chunks.lodFirstIndex[lod];
+				draw.vertexOffset = chunk * chunks.vertexCount;
+				draw.firstInstance = 0;
+				chunks.visibleCount++;
+				chunks.triangleCount += draw.indexCount / 3;
+			}
+		}
+
+		/** @brief Record the draws for all chunks, uses a single multi draw indirect if supported */
+		void drawChunks(VkCommandBuffer commandBuffer)
+		{
+			const uint32_t chunkCount = static_cast<uint32_t>(chunks.boundingSpheres.size());
+			VkDeviceSize offsets[1] = { 0 };
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &chunks.vertexBuffer.buffer, offsets);
+			vkCmdBindIndexBuffer(commandBuffer, chunks.indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+			if (device->enabledFeatures.multiDrawIndirect) {
+				const uint32_t maxDrawCount = std::max(1u, device->properties.limits.maxDrawIndirectCount);
+				for (uint32_t first = 0; first < chunkCount; first += maxDrawCount) {
+					vkCmdDrawIndexedIndirect(commandBuffer, chunks.indirectBuffer.buffer, first * sizeof(VkDrawIndexedIndirectCommand), std::min(maxDrawCount, chunkCount - first), sizeof(VkDrawIndexedIndirectCommand));
+				}
+			} else {
+				for (uint32_t chunk = 0; chunk < chunkCount; chunk++) {
+					vkCmdDrawIndexedIndirect(commandBuffer, chunks.indirectBuffer.buffer, chunk * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
+				}
+			}
 		}
 	};
 }
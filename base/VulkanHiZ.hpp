@@ -0,0 +1,637 @@
+/*
+* Vulkan hierarchical depth (Hi-Z) pyramid
+*
+* Min/max depth mip chain built with a single compute dispatch, used for occlusion culling against the last frame's depth
+*
+* Copyright (C) 2026 by the colefet/Vulkan contributors
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <glm/glm.hpp>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanDevice.hpp"
+#include "VulkanBuffer.hpp"
+
+namespace vks
+{
+	/**
+	* @brief Min/max depth pyramid of a depth buffer for hierarchical Z occlusion tests
+	*
+	* Level L has ceil(size / 2^(L + 1)) texels and texel (x, y) stores the minimum (r) and maximum (g) depth of the depth pixels
+	* (x, y) * 2^(L + 1) to ((x, y) + 1) * 2^(L + 1) - 1, so the texels of all levels map to whole pixel blocks for any depth buffer size.
+	* hizbuild.comp builds all levels with a single dispatch: every work group reduces a 64x64 pixel tile to the levels 0 - 5 in shared
+	* memory, and the last work group to finish (atomic counter) reduces level 5 to the remaining levels.
+	*
+	* Shaders test bounding volumes against the pyramid with the functions in shaders/base/hiz.h, aabbOccluded and sphereOccluded
+	* are the CPU reference of these tests.
+	*
+	* @note Standard depth (0.0 = near plane), the depth buffer can be at most 4096 pixels wide and high (MAX_LEVELS)
+	* @note The pyramid is kept in VK_IMAGE_LAYOUT_GENERAL, its format (rg32f) requires shaderStorageImageExtendedFormats
+	*/
+	class HiZ
+	{
+	public:
+		static const uint32_t MAX_LEVELS = 12;
+		/** @brief Depth pixels reduced by a single work group in each dimension (must match hizbuild.comp) */
+		static const uint32_t TILE_SIZE = 64;
+
+		/** @brief Host copy of a pyramid level */
+		struct Level {
+			uint32_t width;
+			uint32_t height;
+			// x = min, y = max depth
+			std::vector<glm::vec2> texels;
+		};
+
+		/** @brief Host copy of a pyramid, built by buildReference */
+		struct Pyramid {
+			uint32_t depthWidth = 0;
+			uint32_t depthHeight = 0;
+			std::vector<Level> levels;
+		};
+
+		vks::VulkanDevice *device = nullptr;
+
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+
+		/** @brief Pyramid image (VK_FORMAT_R32G32_SFLOAT, one mip level per pyramid level) */
+		VkImage image = VK_NULL_HANDLE;
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		/** @brief View of all levels, read with texelFetch */
+		VkImageView view = VK_NULL_HANDLE;
+		std::array<VkImageView, MAX_LEVELS> levelViews;
+		VkSampler sampler = VK_NULL_HANDLE;
+		/** @brief Descriptor for sampling the pyramid (nearest filtering, VK_IMAGE_LAYOUT_GENERAL) */
+		VkDescriptorImageInfo descriptor;
+
+		uint32_t depthWidth = 0;
+		uint32_t depthHeight = 0;
+		uint32_t levelCount = 0;
+
+		/** @brief Returns the size of a pyramid level for a depth buffer size */
+		static void getLevelSize(uint32_t depthWidth, uint32_t depthHeight, uint32_t level, uint32_t &width, uint32_t &height)
+		{
+			const uint32_t texelSize = 2u << level;
+			width = (depthWidth + texelSize - 1) / texelSize;
+			height = (depthHeight + texelSize - 1) / texelSize;
+		}
+
+		/** @brief Returns the number of levels down to a single texel for a depth buffer size */
+		static uint32_t getLevelCount(uint32_t depthWidth, uint32_t depthHeight)
+		{
+			uint32_t count = 1;
+			uint32_t width, height;
+			getLevelSize(depthWidth, depthHeight, 0, width, height);
+			while ((width > 1) || (height > 1)) {
+				getLevelSize(depthWidth, depthHeight, count, width, height);
+				count++;
+			}
+			return count;
+		}
+
+		/** @brief Enable the device features required for building the pyramid, call from getEnabledFeatures */
+		static void enableFeatures(const VkPhysicalDeviceFeatures &deviceFeatures, VkPhysicalDeviceFeatures &enabledFeatures)
+		{
+			if (!deviceFeatures.shaderStorageImageExtendedFormats) {
+				vks::tools::exitFatal("Selected GPU does not support rg32f storage images (shaderStorageImageExtendedFormats)!", VK_ERROR_FEATURE_NOT_PRESENT);
+			}
+			enabledFeatures.shaderStorageImageExtendedFormats = VK_TRUE;
+		}
+
+		/** @brief CPU reference implementation, builds the same pyramid as the GPU */
+		static Pyramid buildReference(const std::vector<float> &depth, uint32_t depthWidth, uint32_t depthHeight)
+		{
+			assert(depth.size() == depthWidth * depthHeight);
+			Pyramid pyramid;
+			pyramid.depthWidth = depthWidth;
+			pyramid.depthHeight = depthHeight;
+			const uint32_t levelCount = getLevelCount(depthWidth, depthHeight);
+			pyramid.levels.resize(levelCount);
+			for (uint32_t l = 0; l < levelCount; l++) {
+				Level &level = pyramid.levels[l];
+				getLevelSize(depthWidth, depthHeight, l, level.width, level.height);
+				level.texels.resize(level.width * level.height);
+				const uint32_t srcWidth = (l == 0) ? depthWidth : pyramid.levels[l - 1].width;
+				const uint32_t srcHeight = (l == 0) ? depthHeight : pyramid.levels[l - 1].height;
+				for (uint32_t y = 0; y < level.height; y++) {
+					for (uint32_t x = 0; x < level.width; x++) {
+						// Source texels outside of the source level are ignored
+						glm::vec2 value(1.0f, 0.0f);
+						for (uint32_t sy = y * 2; sy < std::min(y * 2 + 2, srcHeight); sy++) {
+							for (uint32_t sx = x * 2; sx < std::min(x * 2 + 2, srcWidth); sx++) {
+								const glm::vec2 src = (l == 0) ? glm::vec2(depth[sy * srcWidth + sx]) : pyramid.levels[l - 1].texels[sy * srcWidth + sx];
+								value.x = std::min(value.x, src.x);
+								value.y = std::max(value.y, src.y);
+							}
+						}
+						level.texels[y * level.width + x] = value;
+					}
+				}
+			}
+			return pyramid;
+		}
+
+		/**
+		* CPU reference of hizAabbOccluded (shaders/base/hiz.h)
+		*
+		* @param pyramid Pyramid built from the depth buffer rendered with viewProjection
+		* @param viewProjection Projection * view matrix the depth buffer was rendered with
+		* @param aabbMin Minimum corner of the world space bounding box
+		* @param aabbMax Maximum corner of the world space bounding box
+		*
+		* @return True if the box is behind the depth of all pixels it covers
+		*/
+		static bool aabbOccluded(const Pyramid &pyramid, const glm::mat4 &viewProjection, const glm::vec3 &aabbMin, const glm::vec3 &aabbMax)
+		{
+			glm::vec3 ndcMin(1e30f);
+			glm::vec3 ndcMax(-1e30f);
+			for (uint32_t i = 0; i < 8; i++) {
+				const glm::vec3 corner((i & 1) ? aabbMax.x : aabbMin.x, (i & 2) ? aabbMax.y : aabbMin.y, (i & 4) ? aabbMax.z : aabbMin.z);
+				const glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+				// Boxes reaching behind the camera are never occluded
+				if (clip.w <= 0.0f) {
+					return false;
+				}
+				const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+				ndcMin = glm::min(ndcMin, ndc);
+				ndcMax = glm::max(ndcMax, ndc);
+			}
+			// Boxes crossing the near plane are never occluded
+			if (ndcMin.z < 0.0f) {
+				return false;
+			}
+
+			// Covered depth pixels
+			const int32_t width = (int32_t)pyramid.depthWidth;
+			const int32_t height = (int32_t)pyramid.depthHeight;
+			const glm::vec2 uvMin = glm::clamp(glm::vec2(ndcMin) * 0.5f + 0.5f, 0.0f, 1.0f);
+			const glm::vec2 uvMax = glm::clamp(glm::vec2(ndcMax) * 0.5f + 0.5f, 0.0f, 1.0f);
+			const int32_t pMinX = std::min((int32_t)(uvMin.x * (float)width), width - 1);
+			const int32_t pMinY = std::min((int32_t)(uvMin.y * (float)height), height - 1);
+			const int32_t pMaxX = std::min((int32_t)(uvMax.x * (float)width), width - 1);
+			const int32_t pMaxY = std::min((int32_t)(uvMax.y * (float)height), height - 1);
+
+			// Finest level at which the pixels are covered by at most 2x2 texels
+			const int32_t levelCount = (int32_t)pyramid.levels.size();
+			int32_t level = 0;
+			while ((level < levelCount - 1) && (((pMaxX >> (level + 1)) - (pMinX >> (level + 1)) > 1) || ((pMaxY >> (level + 1)) - (pMinY >> (level + 1)) > 1))) {
+				level++;
+			}
+
+			const Level &texels = pyramid.levels[level];
+			float maxDepth = 0.0f;
+			for (int32_t y = pMinY >> (level + 1); y <= (pMaxY >> (level + 1)); y++) {
+				for (int32_t x = pMinX >> (level + 1); x <= (pMaxX >> (level + 1)); x++) {
+					maxDepth = std::max(maxDepth, texels.texels[y * texels.width + x].y);
+				}
+			}
+			return ndcMin.z > maxDepth;
+		}
+
+		/** @brief CPU reference of hizSphereOccluded (shaders/base/hiz.h), tests the bounding box of the sphere */
+		static bool sphereOccluded(const Pyramid &pyramid, const glm::mat4 &viewProjection, const glm::vec3 &center, float radius)
+		{
+			return aabbOccluded(pyramid, viewProjection, center - glm::vec3(radius), center + glm::vec3(radius));
+		}
+
+		/**
+		* Create the compute pipeline used to build the pyramid
+		*
+		* @param device Pointer to the Vulkan device
+		* @param pipelineCache Pipeline cache used for pipeline creation
+		* @param shaderStage Shader stage of hizbuild.comp (the module is owned by the caller)
+		*/
+		void prepare(vks::VulkanDevice *device, VkPipelineCache pipelineCache, VkPipelineShaderStageCreateInfo shaderStage)
+		{
+			this->device = device;
+			levelViews.fill(VK_NULL_HANDLE);
+
+			std::vector<VkDescriptorPoolSize> poolSizes = {
+				vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1),
+				vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, MAX_LEVELS),
+				vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1)
+			};
+			VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 1);
+			VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolInfo, nullptr, &descriptorPool));
+
+			// Binding 0 : Depth buffer, bindings 1 - MAX_LEVELS : Pyramid levels, binding MAX_LEVELS + 1 : Work group counter
+			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 0)
+			};
+			for (uint32_t i = 0; i < MAX_LEVELS; i++) {
+				setLayoutBindings.push_back(vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, i + 1));
+			}
+			setLayoutBindings.push_back(vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, MAX_LEVELS + 1));
+			VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorLayout, nullptr, &descriptorSetLayout));
+
+			VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, &descriptorSet));
+
+			VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(PushConstants), 0);
+			VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+			pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+			pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+			VK_CHECK_RESULT(vkCreatePipelineLayout(device->logicalDevice, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout));
+
+			VkComputePipelineCreateInfo pipelineCreateInfo = vks::initializers::computePipelineCreateInfo(pipelineLayout, 0);
+			pipelineCreateInfo.stage = shaderStage;
+			VK_CHECK_RESULT(vkCreateComputePipelines(device->logicalDevice, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipeline));
+
+			// Reset by the last work group of every build, so it only needs to be cleared once
+			std::vector<uint32_t> counter = { 0 };
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &counterBuffer, sizeof(uint32_t), counter.data()));
+
+			VkSamplerCreateInfo samplerInfo = vks::initializers::samplerCreateInfo();
+			samplerInfo.magFilter = VK_FILTER_NEAREST;
+			samplerInfo.minFilter = VK_FILTER_NEAREST;
+			samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+			samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+			samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+			samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+			samplerInfo.minLod = 0.0f;
+			samplerInfo.maxLod = (float)MAX_LEVELS;
+			samplerInfo.maxAnisotropy = 1.0f;
+			samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+			VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerInfo, nullptr, &sampler));
+			VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerInfo, nullptr, &depthSampler));
+		}
+
+		/**
+		* Set the depth buffer the pyramid is built from and (re)create the pyramid for its size
+		*
+		* @param queue Queue used for the initial layout transition of the pyramid
+		* @param depthImage Depth image (needs VK_IMAGE_USAGE_SAMPLED_BIT)
+		* @param depthFormat Format of the depth image, a stencil aspect is ignored
+		* @param width Width of the depth image
+		* @param height Height of the depth image
+		* @param queueFamilies Queue families the pyramid is used on, e.g. the graphics family for the build and the compute family for the culling
+		*
+		* @note The pyramid is cleared to a depth range of 0.0 - 1.0, so nothing is occluded before the first build
+		* @note Must not be called while a recorded build or a culling pass reading the pyramid is pending, descriptors referencing the pyramid have to be updated
+		*/
+		void setDepthImage(VkQueue queue, VkImage depthImage, VkFormat depthFormat, uint32_t width, uint32_t height, const std::vector<uint32_t> &queueFamilies = {})
+		{
+			assert((width <= TILE_SIZE * TILE_SIZE) && (height <= TILE_SIZE * TILE_SIZE));
+			destroyPyramid();
+
+			this->depthImage = depthImage;
+			depthWidth = width;
+			depthHeight = height;
+			levelCount = getLevelCount(width, height);
+			depthAspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+			if (depthFormat >= VK_FORMAT_D16_UNORM_S8_UINT) {
+				depthAspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+			}
+
+			uint32_t levelWidth, levelHeight;
+			getLevelSize(width, height, 0, levelWidth, levelHeight);
+			VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+			imageCI.imageType = VK_IMAGE_TYPE_2D;
+			imageCI.format = VK_FORMAT_R32G32_SFLOAT;
+			imageCI.extent = { levelWidth, levelHeight, 1 };
+			imageCI.mipLevels = levelCount;
+			imageCI.arrayLayers = 1;
+			imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageCI.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+			imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			// Shared between queue families without ownership transfers
+			std::vector<uint32_t> families = queueFamilies;
+			std::sort(families.begin(), families.end());
+			families.erase(std::unique(families.begin(), families.end()), families.end());
+			if (families.size() > 1) {
+				imageCI.sharingMode = VK_SHARING_MODE_CONCURRENT;
+				imageCI.queueFamilyIndexCount = static_cast<uint32_t>(families.size());
+				imageCI.pQueueFamilyIndices = families.data();
+			}
+			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCI, nullptr, &image));
+
+			VkMemoryRequirements memReqs;
+			vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
+			VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
+			memAllocInfo.allocationSize = memReqs.size;
+			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &memory));
+			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, memory, 0));
+
+			VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+			viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewCI.format = VK_FORMAT_R32G32_SFLOAT;
+			viewCI.image = image;
+			viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount, 0, 1 };
+			VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCI, nullptr, &view));
+			for (uint32_t i = 0; i < levelCount; i++) {
+				viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, i, 1, 0, 1 };
+				VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCI, nullptr, &levelViews[i]));
+			}
+
+			viewCI.format = depthFormat;
+			viewCI.image = depthImage;
+			viewCI.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+			VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCI, nullptr, &depthView));
+
+			descriptor = { sampler, view, VK_IMAGE_LAYOUT_GENERAL };
+
+			VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount, 0, 1 };
+			VkImageMemoryBarrier imageBarrier = vks::initializers::imageMemoryBarrier();
+			imageBarrier.srcAccessMask = 0;
+			imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			imageBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			imageBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+			imageBarrier.image = image;
+			imageBarrier.subresourceRange = subresourceRange;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+			VkClearColorValue clearValue = { { 0.0f, 1.0f, 0.0f, 0.0f } };
+			vkCmdClearColorImage(commandBuffer, image, VK_IMAGE_LAYOUT_GENERAL, &clearValue, 1, &subresourceRange);
+			VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+			memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			device->flushCommandBuffer(commandBuffer, queue);
+
+			// Levels that don't exist for this size are never accessed, but their descriptors must be valid
+			VkDescriptorImageInfo depthDescriptor = { depthSampler, depthView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL };
+			std::array<VkDescriptorImageInfo, MAX_LEVELS> levelDescriptors;
+			for (uint32_t i = 0; i < MAX_LEVELS; i++) {
+				levelDescriptors[i] = { VK_NULL_HANDLE, levelViews[std::min(i, levelCount - 1)], VK_IMAGE_LAYOUT_GENERAL };
+			}
+			std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+				vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &depthDescriptor),
+				vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, levelDescriptors.data(), MAX_LEVELS),
+				vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, MAX_LEVELS + 1, &counterBuffer.descriptor),
+			};
+			vkUpdateDescriptorSets(device->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+		}
+
+		/**
+		* Record building the pyramid from the depth image, must be recorded outside of a render pass
+		*
+		* @param commandBuffer Command buffer to record to
+		* @param depthLayout Layout of the depth image, it's transitioned to VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL for the build and back afterwards
+		*
+		* @note Waits for prior depth writes, the pyramid is made visible to compute, vertex and fragment shader reads
+		*/
+		void recordBuild(VkCommandBuffer commandBuffer, VkImageLayout depthLayout)
+		{
+			assert(levelCount > 0);
+
+			VkImageMemoryBarrier depthBarrier = vks::initializers::imageMemoryBarrier();
+			depthBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			depthBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			depthBarrier.oldLayout = depthLayout;
+			depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+			depthBarrier.image = depthImage;
+			depthBarrier.subresourceRange = { depthAspect, 0, 1, 0, 1 };
+			// The previous build's writes and the culling's reads of the pyramid have to finish before it's overwritten
+			VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+			memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			vkCmdPipelineBarrier(
+				commandBuffer,
+				VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				0, 1, &memoryBarrier, 0, nullptr, 1, &depthBarrier);
+
+			PushConstants pushConstants = { (int32_t)depthWidth, (int32_t)depthHeight, levelCount, getGroupCountX() * getGroupCountY() };
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+			vkCmdDispatch(commandBuffer, getGroupCountX(), getGroupCountY(), 1);
+
+			depthBarrier.srcAccessMask = 0;
+			depthBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+			depthBarrier.newLayout = depthLayout;
+			memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			vkCmdPipelineBarrier(
+				commandBuffer,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+				0, 1, &memoryBarrier, 0, nullptr, 1, &depthBarrier);
+		}
+
+		/**
+		* Build the pyramid of a random depth buffer on the GPU, check the result against buildReference and report the build time
+		*
+		* @param queue Queue to submit to (must support graphics and compute and be of the device's default command pool family)
+		* @param width Width of the depth buffer
+		* @param height Height of the depth buffer
+		*
+		* @return True if the GPU result matches the CPU reference
+		*
+		* @note Rebinds the depth image, call setDepthImage again afterwards
+		*/
+		bool benchmark(VkQueue queue, uint32_t width, uint32_t height)
+		{
+			const VkFormat format = VK_FORMAT_D32_SFLOAT;
+			VkFormatProperties formatProperties;
+			vkGetPhysicalDeviceFormatProperties(device->physicalDevice, format, &formatProperties);
+			if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+				std::cout << "VK_FORMAT_D32_SFLOAT can't be sampled, skipping the Hi-Z pyramid benchmark" << std::endl;
+				return false;
+			}
+
+			// Blocks of constant depth with noise, so every level has structure
+			std::default_random_engine rndEngine(0);
+			std::uniform_real_distribution<float> rndDist(0.0f, 1.0f);
+			std::vector<float> blockDepths(((width + 31) / 32) * ((height + 31) / 32));
+			for (auto &depth : blockDepths) {
+				depth = rndDist(rndEngine);
+			}
+			std::vector<float> depth(width * height);
+			for (uint32_t y = 0; y < height; y++) {
+				for (uint32_t x = 0; x < width; x++) {
+					depth[y * width + x] = std::min(blockDepths[(y / 32) * ((width + 31) / 32) + x / 32] + rndDist(rndEngine) * 0.01f, 1.0f);
+				}
+			}
+
+			VkImage benchmarkDepthImage;
+			VkDeviceMemory benchmarkDepthMemory;
+			VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+			imageCI.imageType = VK_IMAGE_TYPE_2D;
+			imageCI.format = format;
+			imageCI.extent = { width, height, 1 };
+			imageCI.mipLevels = 1;
+			imageCI.arrayLayers = 1;
+			imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageCI.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCI, nullptr, &benchmarkDepthImage));
+			VkMemoryRequirements memReqs;
+			vkGetImageMemoryRequirements(device->logicalDevice, benchmarkDepthImage, &memReqs);
+			VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
+			memAllocInfo.allocationSize = memReqs.size;
+			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &benchmarkDepthMemory));
+			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, benchmarkDepthImage, benchmarkDepthMemory, 0));
+
+			setDepthImage(queue, benchmarkDepthImage, format, width, height);
+
+			// Staging buffer for the depth upload and the readback of all levels
+			VkDeviceSize pyramidSize = 0;
+			std::vector<VkBufferImageCopy> levelCopies(levelCount);
+			for (uint32_t i = 0; i < levelCount; i++) {
+				uint32_t levelWidth, levelHeight;
+				getLevelSize(width, height, i, levelWidth, levelHeight);
+				levelCopies[i] = {};
+				levelCopies[i].bufferOffset = pyramidSize;
+				levelCopies[i].imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1 };
+				levelCopies[i].imageExtent = { levelWidth, levelHeight, 1 };
+				pyramidSize += levelWidth * levelHeight * sizeof(glm::vec2);
+			}
+			vks::Buffer stagingBuffer;
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&stagingBuffer,
+				std::max(pyramidSize, (VkDeviceSize)(depth.size() * sizeof(float)))));
+			VK_CHECK_RESULT(stagingBuffer.map());
+			memcpy(stagingBuffer.mapped, depth.data(), depth.size() * sizeof(float));
+
+			VkQueryPool queryPool;
+			VkQueryPoolCreateInfo queryPoolInfo = {};
+			queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			queryPoolInfo.queryCount = 2;
+			VK_CHECK_RESULT(vkCreateQueryPool(device->logicalDevice, &queryPoolInfo, nullptr, &queryPool));
+
+			VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			vkCmdResetQueryPool(commandBuffer, queryPool, 0, 2);
+			VkImageSubresourceRange depthRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+			vks::tools::setImageLayout(commandBuffer, benchmarkDepthImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, depthRange);
+			VkBufferImageCopy depthCopy = {};
+			depthCopy.imageSubresource = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 0, 1 };
+			depthCopy.imageExtent = { width, height, 1 };
+			vkCmdCopyBufferToImage(commandBuffer, stagingBuffer.buffer, benchmarkDepthImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &depthCopy);
+			VkImageMemoryBarrier imageBarrier = vks::initializers::imageMemoryBarrier();
+			imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			imageBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			imageBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+			imageBarrier.image = benchmarkDepthImage;
+			imageBarrier.subresourceRange = depthRange;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+			recordBuild(commandBuffer, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+			VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+			memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_GENERAL, stagingBuffer.buffer, levelCount, levelCopies.data());
+			memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			device->flushCommandBuffer(commandBuffer, queue);
+
+			uint64_t timestamps[2] = { 0, 0 };
+			VK_CHECK_RESULT(vkGetQueryPoolResults(device->logicalDevice, queryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+			double gpuTime = (double)(timestamps[1] - timestamps[0]) * device->properties.limits.timestampPeriod / 1000000.0;
+
+			auto tStart = std::chrono::high_resolution_clock::now();
+			Pyramid reference = buildReference(depth, width, height);
+			double cpuTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+
+			// Min and max are exact, so the levels have to match bit by bit
+			bool valid = true;
+			for (uint32_t i = 0; i < levelCount; i++) {
+				const glm::vec2 *gpuTexels = (const glm::vec2*)((const uint8_t*)stagingBuffer.mapped + levelCopies[i].bufferOffset);
+				if (memcmp(gpuTexels, reference.levels[i].texels.data(), reference.levels[i].texels.size() * sizeof(glm::vec2)) != 0) {
+					valid = false;
+					break;
+				}
+			}
+
+			std::cout << std::fixed << std::setprecision(3);
+			std::cout << "Hi-Z pyramid of " << width << "x" << height << " (" << levelCount << " levels): " << gpuTime << " ms GPU, " << cpuTime << " ms CPU reference, " << (valid ? "valid" : "INVALID") << std::endl;
+
+			vkDestroyQueryPool(device->logicalDevice, queryPool, nullptr);
+			stagingBuffer.destroy();
+			destroyPyramid();
+			vkDestroyImage(device->logicalDevice, benchmarkDepthImage, nullptr);
+			vkFreeMemory(device->logicalDevice, benchmarkDepthMemory, nullptr);
+
+			return valid;
+		}
+
+		/** @brief Release all Vulkan resources */
+		void destroy()
+		{
+			if (device) {
+				destroyPyramid();
+				counterBuffer.destroy();
+				vkDestroySampler(device->logicalDevice, sampler, nullptr);
+				vkDestroySampler(device->logicalDevice, depthSampler, nullptr);
+				vkDestroyPipeline(device->logicalDevice, pipeline, nullptr);
+				vkDestroyPipelineLayout(device->logicalDevice, pipelineLayout, nullptr);
+				vkDestroyDescriptorSetLayout(device->logicalDevice, descriptorSetLayout, nullptr);
+				vkDestroyDescriptorPool(device->logicalDevice, descriptorPool, nullptr);
+				device = nullptr;
+			}
+		}
+
+	private:
+		struct PushConstants {
+			int32_t depthWidth;
+			int32_t depthHeight;
+			uint32_t levelCount;
+			uint32_t groupCount;
+		};
+
+		VkImage depthImage = VK_NULL_HANDLE;
+		VkImageView depthView = VK_NULL_HANDLE;
+		VkSampler depthSampler = VK_NULL_HANDLE;
+		VkImageAspectFlags depthAspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+		vks::Buffer counterBuffer;
+
+		uint32_t getGroupCountX()
+		{
+			return (depthWidth + TILE_SIZE - 1) / TILE_SIZE;
+		}
+
+		uint32_t getGroupCountY()
+		{
+			return (depthHeight + TILE_SIZE - 1) / TILE_SIZE;
+		}
+
+		void destroyPyramid()
+		{
+			for (auto &levelView : levelViews) {
+				if (levelView != VK_NULL_HANDLE) {
+					vkDestroyImageView(device->logicalDevice, levelView, nullptr);
+					levelView = VK_NULL_HANDLE;
+				}
+			}
+			if (view != VK_NULL_HANDLE) {
+				vkDestroyImageView(device->logicalDevice, view, nullptr);
+				vkDestroyImageView(device->logicalDevice, depthView, nullptr);
+				vkDestroyImage(device->logicalDevice, image, nullptr);
+				vkFreeMemory(device->logicalDevice, memory, nullptr);
+				view = VK_NULL_HANDLE;
+				depthView = VK_NULL_HANDLE;
+				image = VK_NULL_HANDLE;
+				memory = VK_NULL_HANDLE;
+			}
+			levelCount = 0;
+		}
+	};
+}
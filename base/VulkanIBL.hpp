@@ -0,0 +1,657 @@
+/*
+* Vulkan image based lighting maps
+*
+* Generates the BRDF lookup table, irradiance cube and pre-filtered environment cube with compute shaders
+* in a single submission and caches the results on disk as KTX files
+*
+* Copyright (C) 2026 by the colefet/Vulkan contributors
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <array>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanDevice.hpp"
+#include "VulkanBuffer.hpp"
+#include "VulkanTexture.hpp"
+
+#if defined(__ANDROID__)
+#include <android/asset_manager.h>
+#endif
+
+namespace vks
+{
+	/**
+	* @brief Pre-computed image based lighting maps for an environment cube map
+	*
+	* @note Call load() first, it creates the target images and returns true if they could be filled from the disk cache.
+	* On a cache miss call generate(), which filters the environment on the GPU and writes the cache files for the next launch.
+	*/
+	class IBLMaps
+	{
+	public:
+		struct Settings {
+			uint32_t brdfLutDim = 512;
+			uint32_t brdfLutSamples = 1024;
+			uint32_t irradianceDim = 64;
+			// Sampling deltas for the irradiance convolution
+			float irradianceDeltaPhi = (2.0f * float(M_PI)) / 180.0f;
+			float irradianceDeltaTheta = (0.5f * float(M_PI)) / 64.0f;
+			uint32_t prefilteredDim = 512;
+			uint32_t prefilteredSamples = 32;
+			// Cache files are written to this directory, an empty string disables the disk cache
+			// On Android this defaults to the app's internal data path
+#if defined(__ANDROID__)
+			std::string cacheDirectory = (androidApp && androidApp->activity->internalDataPath) ? androidApp->activity->internalDataPath : "";
+#else
+			std::string cacheDirectory = "ibl_cache";
+#endif
+		} settings;
+
+		vks::Texture2D lutBrdf;
+		vks::TextureCubeMap irradianceCube;
+		vks::TextureCubeMap prefilteredCube;
+
+		/** @brief Startup costs of the last load() and generate() calls in milliseconds */
+		struct Timings {
+			bool cached = false;
+			double hash = 0.0;
+			double load = 0.0;
+			double generate = 0.0;
+			double write = 0.0;
+		} timings;
+
+	private:
+		// Bump whenever the filter shaders change so stale cache files are not picked up
+		static const uint32_t cacheVersion = 1;
+
+		struct KTXHeader {
+			uint8_t identifier[12];
+			uint32_t endianness;
+			uint32_t glType;
+			uint32_t glTypeSize;
+			uint32_t glFormat;
+			uint32_t glInternalFormat;
+			uint32_t glBaseInternalFormat;
+			uint32_t pixelWidth;
+			uint32_t pixelHeight;
+			uint32_t pixelDepth;
+			uint32_t numberOfArrayElements;
+			uint32_t numberOfFaces;
+			uint32_t numberOfMipmapLevels;
+			uint32_t bytesOfKeyValueData;
+		};
+
+		struct Target {
+			vks::Texture *texture;
+			VkFormat format;
+			// OpenGL enums stored in the KTX header
+			uint32_t glType;
+			uint32_t glTypeSize;
+			uint32_t glInternalFormat;
+			uint32_t texelSize;
+			const char *name;
+		};
+
+		vks::VulkanDevice *device = nullptr;
+		VkQueue queue = VK_NULL_HANDLE;
+		vks::TextureCubeMap *environmentCube = nullptr;
+		std::string cacheKey;
+
+		std::array<Target, 3> targets()
+		{
+			// GL_HALF_FLOAT / GL_FLOAT, GL_RGBA16F / GL_RGBA32F
+			return {{
+				{ &lutBrdf, VK_FORMAT_R16G16B16A16_SFLOAT, 0x140B, 2, 0x881A, 8, "brdflut" },
+				{ &irradianceCube, VK_FORMAT_R32G32B32A32_SFLOAT, 0x1406, 4, 0x8814, 16, "irradiance" },
+				{ &prefilteredCube, VK_FORMAT_R16G16B16A16_SFLOAT, 0x140B, 2, 0x881A, 8, "prefiltered" },
+			}};
+		}
+
+		static uint32_t mipCount(uint32_t dim)
+		{
+			return static_cast<uint32_t>(floor(log2(dim))) + 1;
+		}
+
+		static VkDeviceSize mipSize(const Target &target, uint32_t level)
+		{
+			VkDeviceSize dim = std::max(target.texture->width >> level, 1u);
+			return dim * dim * target.texelSize;
+		}
+
+		static VkDeviceSize imageSize(const Target &target)
+		{
+			VkDeviceSize size = 0;
+			for (uint32_t m = 0; m < target.texture->mipLevels; m++) {
+				size += mipSize(target, m) * target.texture->layerCount;
+			}
+			return size;
+		}
+
+		static void hash(uint64_t &h, const void *data, size_t size)
+		{
+			// 64 bit FNV-1a
+			const uint8_t *bytes = static_cast<const uint8_t*>(data);
+			for (size_t i = 0; i < size; i++) {
+				h ^= bytes[i];
+				h *= 0x100000001b3ULL;
+			}
+		}
+
+		template <typename T> static void hashValue(uint64_t &h, const T &value)
+		{
+			hash(h, &value, sizeof(T));
+		}
+
+		static bool hashFile(uint64_t &h, const std::string &filename)
+		{
+			std::vector<char> chunk(1 << 16);
+#if defined(__ANDROID__)
+			AAsset* asset = AAssetManager_open(androidApp->activity->assetManager, filename.c_str(), AASSET_MODE_STREAMING);
+			if (!asset) {
+				return false;
+			}
+			int read;
+			while ((read = AAsset_read(asset, chunk.data(), chunk.size())) > 0) {
+				hash(h, chunk.data(), read);
+			}
+			AAsset_close(asset);
+#else
+			std::ifstream file(filename, std::ios::binary);
+			if (!file.is_open()) {
+				return false;
+			}
+			while (file) {
+				file.read(chunk.data(), chunk.size());
+				hash(h, chunk.data(), static_cast<size_t>(file.gcount()));
+			}
+#endif
+			return true;
+		}
+
+		std::string cachePath(const Target &target)
+		{
+			return settings.cacheDirectory + "/" + cacheKey + "_" + target.name + ".ktx";
+		}
+
+		void createTarget(Target &target, uint32_t dim, uint32_t layers, uint32_t mipLevels)
+		{
+			vks::Texture *texture = target.texture;
+			texture->device = device;
+			texture->width = dim;
+			texture->height = dim;
+			texture->mipLevels = mipLevels;
+			texture->layerCount = layers;
+
+			VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+			imageCI.imageType = VK_IMAGE_TYPE_2D;
+			imageCI.format = target.format;
+			imageCI.extent = { dim, dim, 1 };
+			imageCI.mipLevels = mipLevels;
+			imageCI.arrayLayers = layers;
+			imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageCI.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+			imageCI.flags = (layers == 6) ? VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT : 0;
+			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCI, nullptr, &texture->image));
+
+			VkMemoryRequirements memReqs;
+			vkGetImageMemoryRequirements(device->logicalDevice, texture->image, &memReqs);
+			VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+			memAlloc.allocationSize = memReqs.size;
+			memAlloc.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAlloc, nullptr, &texture->deviceMemory));
+			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, texture->image, texture->deviceMemory, 0));
+
+			VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+			viewCI.viewType = (layers == 6) ? VK_IMAGE_VIEW_TYPE_CUBE : VK_IMAGE_VIEW_TYPE_2D;
+			viewCI.format = target.format;
+			viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, layers };
+			viewCI.image = texture->image;
+			VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCI, nullptr, &texture->view));
+
+			VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+			samplerCI.magFilter = VK_FILTER_LINEAR;
+			samplerCI.minFilter = VK_FILTER_LINEAR;
+			samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+			samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+			samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+			samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+			samplerCI.minLod = 0.0f;
+			samplerCI.maxLod = static_cast<float>(mipLevels);
+			samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+			VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerCI, nullptr, &texture->sampler));
+
+			texture->imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			texture->updateDescriptor();
+		}
+
+		/** @brief Reads a cache file written by writeKTX into dst, fails if it does not match the target exactly */
+		bool readKTX(const Target &target, uint8_t *dst)
+		{
+			std::ifstream file(cachePath(target), std::ios::binary);
+			if (!file.is_open()) {
+				return false;
+			}
+			KTXHeader header;
+			if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+				return false;
+			}
+			const vks::Texture *texture = target.texture;
+			if ((header.endianness != 0x04030201) || (header.glInternalFormat != target.glInternalFormat) || (header.pixelWidth != texture->width) ||
+				(header.numberOfFaces != texture->layerCount) || (header.numberOfMipmapLevels != texture->mipLevels)) {
+				return false;
+			}
+			file.seekg(header.bytesOfKeyValueData, std::ios::cur);
+			for (uint32_t m = 0; m < texture->mipLevels; m++) {
+				uint32_t size;
+				if (!file.read(reinterpret_cast<char*>(&size), sizeof(size)) || (size != mipSize(target, m))) {
+					return false;
+				}
+				// Mip and face sizes are multiples of four, so there is no padding between images
+				const VkDeviceSize levelSize = size * texture->layerCount;
+				if (!file.read(reinterpret_cast<char*>(dst), levelSize)) {
+					return false;
+				}
+				dst += levelSize;
+			}
+			return true;
+		}
+
+		/** @brief Writes a KTX 1.1 file, src holds the images mip by mip with all faces of a level packed together */
+		bool writeKTX(const Target &target, const uint8_t *src)
+		{
+			const vks::Texture *texture = target.texture;
+			KTXHeader header = {};
+			const uint8_t identifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+			memcpy(header.identifier, identifier, sizeof(identifier));
+			header.endianness = 0x04030201;
+			header.glType = target.glType;
+			header.glTypeSize = target.glTypeSize;
+			header.glFormat = 0x1908;
+			header.glInternalFormat = target.glInternalFormat;
+			header.glBaseInternalFormat = 0x1908;
+			header.pixelWidth = texture->width;
+			header.pixelHeight = texture->height;
+			header.numberOfFaces = texture->layerCount;
+			header.numberOfMipmapLevels = texture->mipLevels;
+
+			// Write to a temporary file first so an interrupted run never leaves a truncated cache entry behind
+			const std::string filename = cachePath(target);
+			const std::string tempFilename = filename + ".tmp";
+			{
+				std::ofstream file(tempFilename, std::ios::binary);
+				if (!file.is_open()) {
+					return false;
+				}
+				file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+				for (uint32_t m = 0; m < texture->mipLevels; m++) {
+					// For cube maps imageSize is the size of a single face
+					const uint32_t size = static_cast<uint32_t>(mipSize(target, m));
+					const VkDeviceSize levelSize = size * texture->layerCount;
+					file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+					file.write(reinterpret_cast<const char*>(src), levelSize);
+					src += levelSize;
+				}
+				if (!file) {
+					return false;
+				}
+			}
+			remove(filename.c_str());
+			return rename(tempFilename.c_str(), filename.c_str()) == 0;
+		}
+
+		void createCacheDirectory()
+		{
+#if defined(_WIN32)
+			_mkdir(settings.cacheDirectory.c_str());
+#else
+			mkdir(settings.cacheDirectory.c_str(), 0755);
+#endif
+		}
+
+		/** @brief Fills all targets from the cache files with a single staging buffer and submission */
+		bool loadCache()
+		{
+			std::array<Target, 3> targets = this->targets();
+			VkDeviceSize totalSize = 0;
+			for (auto &target : targets) {
+				totalSize += imageSize(target);
+			}
+
+			vks::Buffer staging;
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging, totalSize));
+			VK_CHECK_RESULT(staging.map());
+			VkDeviceSize offset = 0;
+			for (auto &target : targets) {
+				if (!readKTX(target, static_cast<uint8_t*>(staging.mapped) + offset)) {
+					staging.destroy();
+					return false;
+				}
+				offset += imageSize(target);
+			}
+			staging.unmap();
+
+			VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			offset = 0;
+			for (auto &target : targets) {
+				vks::Texture *texture = target.texture;
+				VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, texture->mipLevels, 0, texture->layerCount };
+				vks::tools::setImageLayout(copyCmd, texture->image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
+				std::vector<VkBufferImageCopy> regions;
+				for (uint32_t m = 0; m < texture->mipLevels; m++) {
+					const uint32_t dim = std::max(texture->width >> m, 1u);
+					VkBufferImageCopy region = {};
+					region.bufferOffset = offset;
+					region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, m, 0, texture->layerCount };
+					region.imageExtent = { dim, dim, 1 };
+					regions.push_back(region);
+					offset += mipSize(target, m) * texture->layerCount;
+				}
+				vkCmdCopyBufferToImage(copyCmd, staging.buffer, texture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+				vks::tools::setImageLayout(copyCmd, texture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange);
+			}
+			device->flushCommandBuffer(copyCmd, queue);
+			staging.destroy();
+			return true;
+		}
+
+	public:
+		/**
+		* Create the target images and try to fill them from the disk cache
+		*
+		* @param device Vulkan device used to create the images
+		* @param queue Queue used for uploads and the generation submission
+		* @param environmentCube Environment cube map to be filtered, must stay alive until generate() has finished
+		* @param environmentFile File the environment cube has been loaded from, its contents are part of the cache key
+		*
+		* @return True if all maps were loaded from the cache, false if generate() needs to be called
+		*/
+		bool load(vks::VulkanDevice *device, VkQueue queue, vks::TextureCubeMap *environmentCube, const std::string &environmentFile)
+		{
+			this->device = device;
+			this->queue = queue;
+			this->environmentCube = environmentCube;
+
+			std::array<Target, 3> targets = this->targets();
+			createTarget(targets[0], settings.brdfLutDim, 1, 1);
+			createTarget(targets[1], settings.irradianceDim, 6, mipCount(settings.irradianceDim));
+			createTarget(targets[2], settings.prefilteredDim, 6, mipCount(settings.prefilteredDim));
+
+			timings = {};
+			cacheKey.clear();
+			if (settings.cacheDirectory.empty()) {
+				return false;
+			}
+
+			// Key the cache on the environment contents and everything that affects the filtered results
+			auto tStart = std::chrono::high_resolution_clock::now();
+			uint64_t h = 0xcbf29ce484222325ULL;
+			if (!hashFile(h, environmentFile)) {
+				return false;
+			}
+			hashValue(h, cacheVersion);
+			hashValue(h, settings.brdfLutDim);
+			hashValue(h, settings.brdfLutSamples);
+			hashValue(h, settings.irradianceDim);
+			hashValue(h, settings.irradianceDeltaPhi);
+			hashValue(h, settings.irradianceDeltaTheta);
+			hashValue(h, settings.prefilteredDim);
+			hashValue(h, settings.prefilteredSamples);
+			for (auto &target : targets) {
+				hashValue(h, target.format);
+			}
+			std::stringstream ss;
+			ss << std::hex << std::setw(16) << std::setfill('0') << h;
+			cacheKey = ss.str();
+			auto tHashed = std::chrono::high_resolution_clock::now();
+			timings.hash = std::chrono::duration<double, std::milli>(tHashed - tStart).count();
+
+			timings.cached = loadCache();
+			timings.load = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tHashed).count();
+			return timings.cached;
+		}
+
+		/**
+		* Filter the environment cube into all maps with compute shaders, recorded into a single command buffer
+		* If a cache key is available the results are read back in the same submission and written to the cache directory
+		*
+		* @param pipelineCache Pipeline cache used for the temporary compute pipelines
+		* @param brdfLutShader Shader stage for data/shaders/base/iblbrdflut.comp
+		* @param irradianceShader Shader stage for data/shaders/base/iblirradiance.comp
+		* @param prefilterShader Shader stage for data/shaders/base/iblprefilter.comp
+		*/
+		void generate(VkPipelineCache pipelineCache, VkPipelineShaderStageCreateInfo brdfLutShader, VkPipelineShaderStageCreateInfo irradianceShader, VkPipelineShaderStageCreateInfo prefilterShader)
+		{
+			assert(device && environmentCube);
+			auto tStart = std::chrono::high_resolution_clock::now();
+			VkDevice logicalDevice = device->logicalDevice;
+			std::array<Target, 3> targets = this->targets();
+
+			// Binding 0 is the storage image for the current mip, binding 1 the environment map (unused by the LUT shader)
+			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+			};
+			VkDescriptorSetLayout descriptorSetLayout;
+			VkDescriptorSetLayoutCreateInfo descriptorLayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(logicalDevice, &descriptorLayoutCI, nullptr, &descriptorSetLayout));
+
+			struct PushBlock {
+				float param0;
+				float param1;
+			};
+			VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(PushBlock), 0);
+			VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+			pipelineLayoutCI.pushConstantRangeCount = 1;
+			pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+			VkPipelineLayout pipelineLayout;
+			VK_CHECK_RESULT(vkCreatePipelineLayout(logicalDevice, &pipelineLayoutCI, nullptr, &pipelineLayout));
+
+			// Sample count of the LUT is a specialization constant, as in the original fragment shader
+			VkSpecializationMapEntry specializationEntry = vks::initializers::specializationMapEntry(0, 0, sizeof(uint32_t));
+			VkSpecializationInfo specializationInfo = vks::initializers::specializationInfo(1, &specializationEntry, sizeof(uint32_t), &settings.brdfLutSamples);
+			brdfLutShader.pSpecializationInfo = &specializationInfo;
+
+			std::array<VkPipeline, 3> pipelines;
+			std::array<VkPipelineShaderStageCreateInfo, 3> shaderStages = { brdfLutShader, irradianceShader, prefilterShader };
+			for (size_t i = 0; i < pipelines.size(); i++) {
+				VkComputePipelineCreateInfo pipelineCI = vks::initializers::computePipelineCreateInfo(pipelineLayout, 0);
+				pipelineCI.stage = shaderStages[i];
+				VK_CHECK_RESULT(vkCreateComputePipelines(logicalDevice, pipelineCache, 1, &pipelineCI, nullptr, &pipelines[i]));
+			}
+
+			// One storage view and descriptor set per target mip level
+			struct Dispatch {
+				uint32_t target;
+				uint32_t level;
+				VkImageView view;
+				VkDescriptorSet descriptorSet;
+			};
+			std::vector<Dispatch> dispatches;
+			for (uint32_t t = 0; t < targets.size(); t++) {
+				for (uint32_t m = 0; m < targets[t].texture->mipLevels; m++) {
+					dispatches.push_back({ t, m, VK_NULL_HANDLE, VK_NULL_HANDLE });
+				}
+			}
+			const uint32_t setCount = static_cast<uint32_t>(dispatches.size());
+			std::vector<VkDescriptorPoolSize> poolSizes = {
+				vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, setCount),
+				vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, setCount),
+			};
+			VkDescriptorPool descriptorPool;
+			VkDescriptorPoolCreateInfo descriptorPoolCI = vks::initializers::descriptorPoolCreateInfo(poolSizes, setCount);
+			VK_CHECK_RESULT(vkCreateDescriptorPool(logicalDevice, &descriptorPoolCI, nullptr, &descriptorPool));
+
+			for (auto &dispatch : dispatches) {
+				const Target &target = targets[dispatch.target];
+				VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+				viewCI.viewType = (target.texture->layerCount == 6) ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+				viewCI.format = target.format;
+				viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, dispatch.level, 1, 0, target.texture->layerCount };
+				viewCI.image = target.texture->image;
+				VK_CHECK_RESULT(vkCreateImageView(logicalDevice, &viewCI, nullptr, &dispatch.view));
+
+				VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
+				VK_CHECK_RESULT(vkAllocateDescriptorSets(logicalDevice, &allocInfo, &dispatch.descriptorSet));
+				VkDescriptorImageInfo storageDescriptor = vks::initializers::descriptorImageInfo(VK_NULL_HANDLE, dispatch.view, VK_IMAGE_LAYOUT_GENERAL);
+				std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+					vks::initializers::writeDescriptorSet(dispatch.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0, &storageDescriptor),
+					vks::initializers::writeDescriptorSet(dispatch.descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &environmentCube->descriptor),
+				};
+				vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+			}
+
+			// Read back the results in the same submission if they are to be cached
+			const bool writeCache = !cacheKey.empty();
+			vks::Buffer readback;
+			VkDeviceSize totalSize = 0;
+			for (auto &target : targets) {
+				totalSize += imageSize(target);
+			}
+			if (writeCache) {
+				VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &readback, totalSize));
+			}
+
+			VkCommandBuffer cmdBuf = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+
+			for (auto &target : targets) {
+				VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, target.texture->mipLevels, 0, target.texture->layerCount };
+				vks::tools::setImageLayout(cmdBuf, target.texture->image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, subresourceRange, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+			}
+
+			// All dispatches only read the environment map and write distinct subresources, so no barriers are needed in between
+			for (auto &dispatch : dispatches) {
+				const Target &target = targets[dispatch.target];
+				const uint32_t dim = std::max(target.texture->width >> dispatch.level, 1u);
+				PushBlock pushBlock = {};
+				switch (dispatch.target) {
+				case 1:
+					pushBlock.param0 = settings.irradianceDeltaPhi;
+					pushBlock.param1 = settings.irradianceDeltaTheta;
+					break;
+				case 2:
+					pushBlock.param0 = (float)dispatch.level / (float)(target.texture->mipLevels - 1);
+					memcpy(&pushBlock.param1, &settings.prefilteredSamples, sizeof(uint32_t));
+					break;
+				}
+				vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[dispatch.target]);
+				vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &dispatch.descriptorSet, 0, nullptr);
+				vkCmdPushConstants(cmdBuf, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushBlock), &pushBlock);
+				vkCmdDispatch(cmdBuf, (dim + 7) / 8, (dim + 7) / 8, target.texture->layerCount);
+			}
+
+			VkDeviceSize offset = 0;
+			for (auto &target : targets) {
+				vks::Texture *texture = target.texture;
+				VkImageMemoryBarrier imageBarrier = vks::initializers::imageMemoryBarrier();
+				imageBarrier.image = texture->image;
+				imageBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, texture->mipLevels, 0, texture->layerCount };
+				imageBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+				imageBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+				if (writeCache) {
+					imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+					imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+					vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+
+					std::vector<VkBufferImageCopy> regions;
+					for (uint32_t m = 0; m < texture->mipLevels; m++) {
+						const uint32_t dim = std::max(texture->width >> m, 1u);
+						VkBufferImageCopy region = {};
+						region.bufferOffset = offset;
+						region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, m, 0, texture->layerCount };
+						region.imageExtent = { dim, dim, 1 };
+						regions.push_back(region);
+						offset += mipSize(target, m) * texture->layerCount;
+					}
+					vkCmdCopyImageToBuffer(cmdBuf, texture->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback.buffer, static_cast<uint32_t>(regions.size()), regions.data());
+
+					imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+					imageBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+					imageBarrier.srcAccessMask = 0;
+					imageBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+					vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+				} else {
+					imageBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+					imageBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+					vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+				}
+			}
+
+			if (writeCache) {
+				VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
+				bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+				bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				bufferBarrier.buffer = readback.buffer;
+				bufferBarrier.size = VK_WHOLE_SIZE;
+				vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+			}
+
+			// Single blocking submission for all maps
+			device->flushCommandBuffer(cmdBuf, queue);
+
+			for (auto &dispatch : dispatches) {
+				vkDestroyImageView(logicalDevice, dispatch.view, nullptr);
+			}
+			for (auto pipeline : pipelines) {
+				vkDestroyPipeline(logicalDevice, pipeline, nullptr);
+			}
+			vkDestroyPipelineLayout(logicalDevice, pipelineLayout, nullptr);
+			vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+			vkDestroyDescriptorSetLayout(logicalDevice, descriptorSetLayout, nullptr);
+
+			auto tGenerated = std::chrono::high_resolution_clock::now();
+			timings.generate = std::chrono::duration<double, std::milli>(tGenerated - tStart).count();
+
+			if (writeCache) {
+				createCacheDirectory();
+				VK_CHECK_RESULT(readback.map());
+				offset = 0;
+				for (auto &target : targets) {
+					if (!writeKTX(target, static_cast<const uint8_t*>(readback.mapped) + offset)) {
+						std::cerr << "Could not write IBL cache file " << cachePath(target) << std::endl;
+					}
+					offset += imageSize(target);
+				}
+				readback.destroy();
+				timings.write = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tGenerated).count();
+			}
+		}
+
+		/** @brief Total startup cost of the last load() and generate() calls in milliseconds */
+		double totalTime() const
+		{
+			return timings.hash + timings.load + timings.generate + timings.write;
+		}
+
+		void destroy()
+		{
+			lutBrdf.destroy();
+			irradianceCube.destroy();
+			prefilteredCube.destroy();
+		}
+	};
+}
@@ -0,0 +1,702 @@
+/*
+* Vulkan compute mip chain generation
+*
+* Single pass downsampling of up to 12 mip levels per dispatch, works on formats without blit support
+*
+* Copyright (C) 2026 by the colefet/Vulkan contributors
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <math.h>
+#include <glm/glm.hpp>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanDevice.hpp"
+#include "VulkanBuffer.hpp"
+
+namespace vks
+{
+	/**
+	* @brief Generates the mip chain of an image with compute shaders instead of a chain of vkCmdBlitImage calls
+	*
+	* Level L has max(size >> L, 1) texels like a blit chain, every level is downsampled from the one above it.
+	* mipgen.h builds up to MAX_LEVELS levels with a single dispatch: every work group downsamples a 64x64 texel tile of the base level
+	* to the levels 1 - 6 in shared memory, and the last work group to finish (atomic counter) downsamples level 6 to the levels 7 - 12.
+	* Longer chains and base levels larger than 4096 texels are split into several dispatches.
+	*
+	* Filters:
+	* - filterBox: 2x2 average
+	* - filterKaiser: 4x4 Kaiser windowed sinc (getKaiserWeights), keeps more detail in the lower levels with less aliasing than the box.
+	*   Taps that fall outside of a work group's tile in shared memory are clamped to the tile, which is exact for the first level of each pass
+	* - srgb: the texel values are decoded from sRGB before filtering and encoded afterwards, so bright and dark texels average correctly
+	*
+	* Bloom and HDR downsample chains can keep a Target per image and record a generation every frame with recordGenerate.
+	*
+	* @note The image needs VK_IMAGE_USAGE_STORAGE_BIT and one of the formats supported by isFormatSupported. sRGB textures can't be storage
+	* images on most devices, keep them in VK_FORMAT_R8G8B8A8_UNORM with srgb set and sample through a VK_FORMAT_R8G8B8A8_SRGB view (VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT)
+	*/
+	class MipGenerator
+	{
+	public:
+		/** @brief Levels generated by a single dispatch */
+		static const uint32_t MAX_LEVELS = 12;
+		/** @brief Base level texels downsampled by a single work group in each dimension (must match mipgen.h) */
+		static const uint32_t TILE_SIZE = 64;
+
+		enum Filter { filterBox, filterKaiser };
+
+		/** @brief Views and descriptors for generating the mip chain of one image layer, created with createTarget */
+		struct Target {
+			VkImage image = VK_NULL_HANDLE;
+			VkFormat format = VK_FORMAT_UNDEFINED;
+			uint32_t width = 0;
+			uint32_t height = 0;
+			uint32_t mipLevels = 0;
+			uint32_t layer = 0;
+			std::vector<VkImageView> levelViews;
+			// One per dispatch
+			std::vector<VkDescriptorSet> descriptorSets;
+			vks::Buffer counterBuffer;
+		};
+
+		/** @brief Host copy of a mip level */
+		struct Level {
+			uint32_t width;
+			uint32_t height;
+			std::vector<glm::vec4> texels;
+		};
+
+		vks::VulkanDevice *device = nullptr;
+
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		struct {
+			VkPipeline rgba8 = VK_NULL_HANDLE;
+			VkPipeline rgba16f = VK_NULL_HANDLE;
+		} pipelines;
+
+		/** @brief Shape of the Kaiser window, higher values give a smoother (blurrier) filter */
+		float kaiserAlpha = 4.0f;
+
+		/** @brief Returns the size of a mip level */
+		static void getLevelSize(uint32_t width, uint32_t height, uint32_t level, uint32_t &levelWidth, uint32_t &levelHeight)
+		{
+			levelWidth = std::max(width >> level, 1u);
+			levelHeight = std::max(height >> level, 1u);
+		}
+
+		/** @brief Returns the number of levels down to a single texel */
+		static uint32_t getLevelCount(uint32_t width, uint32_t height)
+		{
+			return static_cast<uint32_t>(floor(log2(std::max(width, height)))) + 1;
+		}
+
+		/**
+		* Returns the number of levels a single dispatch generates below a base level
+		*
+		* @param width Width of the dispatch's base level
+		* @param height Height of the dispatch's base level
+		* @param remainingLevels Levels below the base level that still have to be generated
+		*/
+		static uint32_t getDispatchLevelCount(uint32_t width, uint32_t height, uint32_t remainingLevels)
+		{
+			// The second pass downsamples level 6 with a single work group, which covers at most TILE_SIZE texels in each dimension
+			const uint32_t passLevels = MAX_LEVELS / 2;
+			uint32_t levelWidth, levelHeight;
+			getLevelSize(width, height, passLevels, levelWidth, levelHeight);
+			if ((levelWidth <= TILE_SIZE) && (levelHeight <= TILE_SIZE)) {
+				return std::min(remainingLevels, MAX_LEVELS);
+			}
+			return std::min(remainingLevels, passLevels);
+		}
+
+		/**
+		* Weights of the Kaiser filter for a source texel 0.5 (y) and 1.5 (x) texels from the center of the destination texel
+		*
+		* The sinc is scaled to the destination texel size and the window spans two source texels on either side, the weights are normalized.
+		*/
+		static glm::vec2 getKaiserWeights(float alpha)
+		{
+			// Zeroth order modified Bessel function of the first kind
+			auto bessel0 = [](float x) {
+				float sum = 1.0f;
+				float term = 1.0f;
+				for (uint32_t k = 1; k < 32; k++) {
+					term *= (x / (2.0f * k)) * (x / (2.0f * k));
+					sum += term;
+				}
+				return sum;
+			};
+			auto weight = [&](float x) {
+				const float t = x / 2.0f;
+				const float sinc = sinf((float)M_PI * t) / ((float)M_PI * t);
+				return sinc * bessel0(alpha * sqrtf(1.0f - t * t)) / bessel0(alpha);
+			};
+			const float outer = weight(1.5f);
+			const float inner = weight(0.5f);
+			const float sum = 2.0f * (outer + inner);
+			return glm::vec2(outer / sum, inner / sum);
+		}
+
+		static float srgbToLinear(float value)
+		{
+			return (value <= 0.04045f) ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+		}
+
+		static float linearToSrgb(float value)
+		{
+			return (value <= 0.0031308f) ? value * 12.92f : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+		}
+
+		/**
+		* CPU reference implementation, generates the same levels as the GPU
+		*
+		* @param base Texels of the base level
+		* @param width Width of the base level
+		* @param height Height of the base level
+		* @param levelCount Number of levels including the base level
+		* @param filter Filter used for downsampling
+		* @param srgb Filter in linear space, base and returned texels are sRGB encoded
+		* @param kaiserAlpha Shape of the Kaiser window
+		*
+		* @return All levels, starting with a copy of the base level
+		*/
+		static std::vector<Level> buildReference(const std::vector<glm::vec4> &base, uint32_t width, uint32_t height, uint32_t levelCount, Filter filter, bool srgb, float kaiserAlpha)
+		{
+			assert(base.size() == width * height);
+			std::vector<Level> levels(levelCount);
+			levels[0] = { width, height, base };
+			if (srgb) {
+				for (auto &texel : levels[0].texels) {
+					texel = glm::vec4(srgbToLinear(texel.r), srgbToLinear(texel.g), srgbToLinear(texel.b), texel.a);
+				}
+			}
+
+			const glm::vec2 kaiserWeights = getKaiserWeights(kaiserAlpha);
+			const std::array<float, 4> weights = (filter == filterKaiser) ? std::array<float, 4>{ { kaiserWeights.x, kaiserWeights.y, kaiserWeights.y, kaiserWeights.x } } : std::array<float, 4>{ { 0.0f, 0.5f, 0.5f, 0.0f } };
+			const int32_t firstTap = (filter == filterKaiser) ? -1 : 0;
+			const int32_t lastTap = (filter == filterKaiser) ? 2 : 1;
+
+			uint32_t dispatchBase = 0;
+			while (dispatchBase + 1 < levelCount) {
+				const uint32_t dispatchLevels = getDispatchLevelCount(levels[dispatchBase].width, levels[dispatchBase].height, levelCount - dispatchBase - 1);
+				for (uint32_t l = 1; l <= dispatchLevels; l++) {
+					const Level &src = levels[dispatchBase + l - 1];
+					Level &dst = levels[dispatchBase + l];
+					getLevelSize(width, height, dispatchBase + l, dst.width, dst.height);
+					dst.texels.resize(dst.width * dst.height);
+					// The first level of each pass reads the whole source level, the others the work group's tile in shared memory
+					const uint32_t passLevel = (l - 1) % (MAX_LEVELS / 2);
+					const int32_t tileSize = (passLevel == 0) ? INT32_MAX : (int32_t)((TILE_SIZE / 2) >> (passLevel - 1));
+					for (uint32_t y = 0; y < dst.height; y++) {
+						for (uint32_t x = 0; x < dst.width; x++) {
+							const int32_t minX = (passLevel == 0) ? 0 : ((int32_t)x * 2 / tileSize) * tileSize;
+							const int32_t minY = (passLevel == 0) ? 0 : ((int32_t)y * 2 / tileSize) * tileSize;
+							const int32_t maxX = std::min((passLevel == 0) ? INT32_MAX : minX + tileSize - 1, (int32_t)src.width - 1);
+							const int32_t maxY = std::min((passLevel == 0) ? INT32_MAX : minY + tileSize - 1, (int32_t)src.height - 1);
+							glm::vec4 value(0.0f);
+							for (int32_t ty = firstTap; ty <= lastTap; ty++) {
+								for (int32_t tx = firstTap; tx <= lastTap; tx++) {
+									const int32_t sx = std::min(std::max((int32_t)x * 2 + tx, minX), maxX);
+									const int32_t sy = std::min(std::max((int32_t)y * 2 + ty, minY), maxY);
+									value += weights[tx + 1] * weights[ty + 1] * src.texels[sy * src.width + sx];
+								}
+							}
+							dst.texels[y * dst.width + x] = value;
+						}
+					}
+				}
+				dispatchBase += dispatchLevels;
+			}
+
+			if (srgb) {
+				for (auto &level : levels) {
+					for (auto &texel : level.texels) {
+						texel = glm::vec4(linearToSrgb(texel.r), linearToSrgb(texel.g), linearToSrgb(texel.b), texel.a);
+					}
+				}
+			}
+			return levels;
+		}
+
+		/**
+		* Record generating a mip chain with a vkCmdBlitImage per level, the reference for benchmark
+		*
+		* @param commandBuffer Command buffer to record to
+		* @param image Image with the base level in oldLayout, needs VK_IMAGE_USAGE_TRANSFER_SRC_BIT and VK_IMAGE_USAGE_TRANSFER_DST_BIT
+		* @param width Width of the base level
+		* @param height Height of the base level
+		* @param mipLevels Number of levels including the base level
+		* @param oldLayout Layout of the base level, the contents of the other levels are discarded
+		* @param newLayout Layout all levels are transitioned to
+		*/
+		static void recordBlitChain(VkCommandBuffer commandBuffer, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels, VkImageLayout oldLayout, VkImageLayout newLayout)
+		{
+			VkImageMemoryBarrier imageBarrier = vks::initializers::imageMemoryBarrier();
+			imageBarrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+			imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			imageBarrier.oldLayout = oldLayout;
+			imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			imageBarrier.image = image;
+			imageBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+
+			for (uint32_t i = 1; i < mipLevels; i++) {
+				uint32_t srcWidth, srcHeight, dstWidth, dstHeight;
+				getLevelSize(width, height, i - 1, srcWidth, srcHeight);
+				getLevelSize(width, height, i, dstWidth, dstHeight);
+				VkImageBlit imageBlit = {};
+				imageBlit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i - 1, 0, 1 };
+				imageBlit.srcOffsets[1] = { (int32_t)srcWidth, (int32_t)srcHeight, 1 };
+				imageBlit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1 };
+				imageBlit.dstOffsets[1] = { (int32_t)dstWidth, (int32_t)dstHeight, 1 };
+
+				imageBarrier.srcAccessMask = 0;
+				imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				imageBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+				imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+				imageBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, i, 1, 0, 1 };
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+
+				vkCmdBlitImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageBlit, VK_FILTER_LINEAR);
+
+				imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+				imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+				imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+			}
+
+			imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			imageBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+			imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			imageBarrier.newLayout = newLayout;
+			imageBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1 };
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+		}
+
+		/**
+		* Create the compute pipelines used to generate mip chains
+		*
+		* @param device Pointer to the Vulkan device
+		* @param pipelineCache Pipeline cache used for pipeline creation
+		* @param rgba8Shader Shader stage of data/shaders/base/mipgenrgba8.comp (the module is owned by the caller)
+		* @param rgba16fShader Shader stage of data/shaders/base/mipgenrgba16f.comp (the module is owned by the caller)
+		* @param maxTargets Number of targets that can exist at the same time
+		*/
+		void prepare(vks::VulkanDevice *device, VkPipelineCache pipelineCache, VkPipelineShaderStageCreateInfo rgba8Shader, VkPipelineShaderStageCreateInfo rgba16fShader, uint32_t maxTargets = 8)
+		{
+			this->device = device;
+
+			// A 32k texture needs three dispatches
+			const uint32_t maxSets = maxTargets * 3;
+			std::vector<VkDescriptorPoolSize> poolSizes = {
+				vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, maxSets * (MAX_LEVELS + 1)),
+				vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, maxSets)
+			};
+			VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, maxSets);
+			// Targets are created and destroyed independently
+			descriptorPoolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+			VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolInfo, nullptr, &descriptorPool));
+
+			// Binding 0 : Base level, bindings 1 - MAX_LEVELS : Generated levels, binding MAX_LEVELS + 1 : Work group counter
+			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings;
+			for (uint32_t i = 0; i <= MAX_LEVELS; i++) {
+				setLayoutBindings.push_back(vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, i));
+			}
+			setLayoutBindings.push_back(vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, MAX_LEVELS + 1));
+			VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorLayout, nullptr, &descriptorSetLayout));
+
+			VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(PushConstants), 0);
+			VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+			pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+			pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+			VK_CHECK_RESULT(vkCreatePipelineLayout(device->logicalDevice, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout));
+
+			VkComputePipelineCreateInfo pipelineCreateInfo = vks::initializers::computePipelineCreateInfo(pipelineLayout, 0);
+			pipelineCreateInfo.stage = rgba8Shader;
+			VK_CHECK_RESULT(vkCreateComputePipelines(device->logicalDevice, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.rgba8));
+			pipelineCreateInfo.stage = rgba16fShader;
+			VK_CHECK_RESULT(vkCreateComputePipelines(device->logicalDevice, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.rgba16f));
+		}
+
+		/** @brief True if mip chains of images with this format can be generated on the device */
+		bool isFormatSupported(VkFormat format) const
+		{
+			if (getPipeline(format) == VK_NULL_HANDLE) {
+				return false;
+			}
+			VkFormatProperties formatProperties;
+			vkGetPhysicalDeviceFormatProperties(device->physicalDevice, format, &formatProperties);
+			return (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) != 0;
+		}
+
+		/**
+		* Create the level views and descriptors for generating the mip chain of an image layer
+		*
+		* @param image Image to generate the mip chain of, needs VK_IMAGE_USAGE_STORAGE_BIT
+		* @param format Format of the image (see isFormatSupported)
+		* @param width Width of the base level
+		* @param height Height of the base level
+		* @param mipLevels Number of levels including the base level
+		* @param layer Array layer to generate the mip chain of
+		*/
+		Target createTarget(VkImage image, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels, uint32_t layer = 0)
+		{
+			assert(isFormatSupported(format));
+			assert(mipLevels <= getLevelCount(width, height));
+			Target target;
+			target.image = image;
+			target.format = format;
+			target.width = width;
+			target.height = height;
+			target.mipLevels = mipLevels;
+			target.layer = layer;
+
+			VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+			viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewCI.format = format;
+			viewCI.image = image;
+			target.levelViews.resize(mipLevels);
+			for (uint32_t i = 0; i < mipLevels; i++) {
+				viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, i, 1, layer, 1 };
+				VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCI, nullptr, &target.levelViews[i]));
+			}
+
+			// Reset by the last work group of every dispatch, so it only needs to be cleared once
+			std::vector<uint32_t> counter = { 0 };
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &target.counterBuffer, sizeof(uint32_t), counter.data()));
+
+			uint32_t dispatchBase = 0;
+			while (dispatchBase + 1 < mipLevels) {
+				uint32_t baseWidth, baseHeight;
+				getLevelSize(width, height, dispatchBase, baseWidth, baseHeight);
+				const uint32_t dispatchLevels = getDispatchLevelCount(baseWidth, baseHeight, mipLevels - dispatchBase - 1);
+
+				VkDescriptorSet descriptorSet;
+				VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
+				VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, &descriptorSet));
+				target.descriptorSets.push_back(descriptorSet);
+
+				// Levels that aren't generated by this dispatch are never accessed, but their descriptors must be valid
+				std::array<VkDescriptorImageInfo, MAX_LEVELS + 1> levelDescriptors;
+				for (uint32_t i = 0; i <= MAX_LEVELS; i++) {
+					levelDescriptors[i] = { VK_NULL_HANDLE, target.levelViews[dispatchBase + std::min(i, dispatchLevels)], VK_IMAGE_LAYOUT_GENERAL };
+				}
+				std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+					vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0, levelDescriptors.data(), MAX_LEVELS + 1),
+					vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, MAX_LEVELS + 1, &target.counterBuffer.descriptor),
+				};
+				vkUpdateDescriptorSets(device->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+
+				dispatchBase += dispatchLevels;
+			}
+			return target;
+		}
+
+		/** @brief Release the views and descriptors of a target, no generation using it may be pending */
+		void destroyTarget(Target &target)
+		{
+			for (auto levelView : target.levelViews) {
+				vkDestroyImageView(device->logicalDevice, levelView, nullptr);
+			}
+			if (!target.descriptorSets.empty()) {
+				VK_CHECK_RESULT(vkFreeDescriptorSets(device->logicalDevice, descriptorPool, static_cast<uint32_t>(target.descriptorSets.size()), target.descriptorSets.data()));
+			}
+			target.counterBuffer.destroy();
+			target.counterBuffer = vks::Buffer();
+			target.levelViews.clear();
+			target.descriptorSets.clear();
+			target.image = VK_NULL_HANDLE;
+		}
+
+		/**
+		* Record generating the mip chain of a target, must be recorded outside of a render pass
+		*
+		* @param commandBuffer Command buffer to record to (compute capable queue)
+		* @param target Target created with createTarget
+		* @param filter Filter used for downsampling
+		* @param srgb Filter sRGB encoded values in linear space
+		* @param oldLayout Layout of the base level, the contents of the other levels are discarded
+		* @param newLayout Layout all levels are transitioned to
+		* @param srcStageMask Stages that write the base level or read the generated levels before the generation
+		* @param dstStageMask Stages that read the levels after the generation
+		*/
+		void recordGenerate(VkCommandBuffer commandBuffer, const Target &target, Filter filter, bool srgb, VkImageLayout oldLayout, VkImageLayout newLayout,
+			VkPipelineStageFlags srcStageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VkPipelineStageFlags dstStageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT)
+		{
+			if (target.mipLevels < 2) {
+				return;
+			}
+
+			std::array<VkImageMemoryBarrier, 2> imageBarriers;
+			imageBarriers[0] = vks::initializers::imageMemoryBarrier();
+			imageBarriers[0].srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+			imageBarriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			imageBarriers[0].oldLayout = oldLayout;
+			imageBarriers[0].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+			imageBarriers[0].image = target.image;
+			imageBarriers[0].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, target.layer, 1 };
+			imageBarriers[1] = imageBarriers[0];
+			imageBarriers[1].srcAccessMask = 0;
+			imageBarriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			imageBarriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			imageBarriers[1].subresourceRange.baseMipLevel = 1;
+			imageBarriers[1].subresourceRange.levelCount = target.mipLevels - 1;
+			vkCmdPipelineBarrier(commandBuffer, srcStageMask, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+
+			const glm::vec2 weights = (filter == filterKaiser) ? getKaiserWeights(kaiserAlpha) : glm::vec2(0.0f, 0.5f);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, getPipeline(target.format));
+			uint32_t dispatchBase = 0;
+			for (size_t i = 0; i < target.descriptorSets.size(); i++) {
+				uint32_t baseWidth, baseHeight;
+				getLevelSize(target.width, target.height, dispatchBase, baseWidth, baseHeight);
+				const uint32_t dispatchLevels = getDispatchLevelCount(baseWidth, baseHeight, target.mipLevels - dispatchBase - 1);
+				// Every work group covers a tile of 32x32 texels of the first generated level
+				const uint32_t groupCountX = (std::max(baseWidth >> 1, 1u) + TILE_SIZE / 2 - 1) / (TILE_SIZE / 2);
+				const uint32_t groupCountY = (std::max(baseHeight >> 1, 1u) + TILE_SIZE / 2 - 1) / (TILE_SIZE / 2);
+
+				if (i > 0) {
+					VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+					memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+					memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+					vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+				}
+
+				PushConstants pushConstants = { (int32_t)baseWidth, (int32_t)baseHeight, dispatchLevels, groupCountX * groupCountY, weights.x, weights.y, srgb ? 1u : 0u };
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &target.descriptorSets[i], 0, nullptr);
+				vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+				vkCmdDispatch(commandBuffer, groupCountX, groupCountY, 1);
+
+				dispatchBase += dispatchLevels;
+			}
+
+			VkImageMemoryBarrier imageBarrier = imageBarriers[0];
+			imageBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			imageBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+			imageBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+			imageBarrier.newLayout = newLayout;
+			imageBarrier.subresourceRange.levelCount = target.mipLevels;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStageMask, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+		}
+
+		/**
+		* Generate the mip chain of an image layer and wait for it to finish, for one-off generation at load time
+		*
+		* @param queue Queue to submit to (must support compute and be of the device's default command pool family)
+		*
+		* See createTarget and recordGenerate for the other parameters
+		*/
+		void generate(VkQueue queue, VkImage image, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels, Filter filter, bool srgb, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t layer = 0)
+		{
+			Target target = createTarget(image, format, width, height, mipLevels, layer);
+			VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			recordGenerate(commandBuffer, target, filter, srgb, oldLayout, newLayout);
+			device->flushCommandBuffer(commandBuffer, queue);
+			destroyTarget(target);
+		}
+
+		/**
+		* Generate the mip chain of a random image with the blit chain and all compute filters, check the results against buildReference
+		* and report the GPU times
+		*
+		* @param queue Queue to submit to (must support graphics and compute and be of the device's default command pool family)
+		* @param width Width of the base level
+		* @param height Height of the base level
+		*
+		* @return True if the GPU results of all filters match the CPU reference
+		*/
+		bool benchmark(VkQueue queue, uint32_t width, uint32_t height)
+		{
+			const VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+			const uint32_t levelCount = getLevelCount(width, height);
+
+			// Blocks of constant color with noise, so every level has structure
+			std::default_random_engine rndEngine(0);
+			std::uniform_real_distribution<float> rndDist(0.0f, 1.0f);
+			const uint32_t blocksX = (width + 15) / 16;
+			std::vector<glm::vec4> blockColors(blocksX * ((height + 15) / 16));
+			for (auto &color : blockColors) {
+				color = glm::vec4(rndDist(rndEngine), rndDist(rndEngine), rndDist(rndEngine), rndDist(rndEngine));
+			}
+			std::vector<glm::vec4> base(width * height);
+			std::vector<uint8_t> baseData(width * height * 4);
+			for (uint32_t y = 0; y < height; y++) {
+				for (uint32_t x = 0; x < width; x++) {
+					const glm::vec4 color = blockColors[(y / 16) * blocksX + x / 16];
+					for (uint32_t c = 0; c < 4; c++) {
+						const uint8_t value = (uint8_t)std::min(std::max((color[c] + (rndDist(rndEngine) - 0.5f) * 0.2f) * 255.0f + 0.5f, 0.0f), 255.0f);
+						baseData[(y * width + x) * 4 + c] = value;
+						base[y * width + x][c] = value / 255.0f;
+					}
+				}
+			}
+
+			VkImage image;
+			VkDeviceMemory memory;
+			VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+			imageCI.imageType = VK_IMAGE_TYPE_2D;
+			imageCI.format = format;
+			imageCI.extent = { width, height, 1 };
+			imageCI.mipLevels = levelCount;
+			imageCI.arrayLayers = 1;
+			imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageCI.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCI, nullptr, &image));
+			VkMemoryRequirements memReqs;
+			vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
+			VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
+			memAllocInfo.allocationSize = memReqs.size;
+			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &memory));
+			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, memory, 0));
+
+			// Staging buffer for the base level upload and the readback of all levels
+			VkDeviceSize chainSize = 0;
+			std::vector<VkBufferImageCopy> levelCopies(levelCount);
+			for (uint32_t i = 0; i < levelCount; i++) {
+				uint32_t levelWidth, levelHeight;
+				getLevelSize(width, height, i, levelWidth, levelHeight);
+				levelCopies[i] = {};
+				levelCopies[i].bufferOffset = chainSize;
+				levelCopies[i].imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1 };
+				levelCopies[i].imageExtent = { levelWidth, levelHeight, 1 };
+				chainSize += levelWidth * levelHeight * 4;
+			}
+			vks::Buffer stagingBuffer;
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, chainSize));
+			VK_CHECK_RESULT(stagingBuffer.map());
+			memcpy(stagingBuffer.mapped, baseData.data(), baseData.size());
+
+			VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			vks::tools::setImageLayout(commandBuffer, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
+			vkCmdCopyBufferToImage(commandBuffer, stagingBuffer.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &levelCopies[0]);
+			device->flushCommandBuffer(commandBuffer, queue);
+
+			VkQueryPool queryPool;
+			VkQueryPoolCreateInfo queryPoolInfo = {};
+			queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			queryPoolInfo.queryCount = 2;
+			VK_CHECK_RESULT(vkCreateQueryPool(device->logicalDevice, &queryPoolInfo, nullptr, &queryPool));
+
+			Target target = createTarget(image, format, width, height, levelCount);
+			VkImageLayout baseLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			std::cout << std::fixed << std::setprecision(3);
+			std::cout << "Mip chain of " << width << "x" << height << " (" << levelCount << " levels, " << target.descriptorSets.size() << " dispatches):" << std::endl;
+
+			// Run 0 is the blit chain, runs 1 - 3 the compute filters
+			bool valid = true;
+			const char* runNames[] = { "blit chain", "compute box", "compute Kaiser", "compute box sRGB" };
+			for (uint32_t run = 0; run < 4; run++) {
+				const Filter filter = (run == 2) ? filterKaiser : filterBox;
+				const bool srgb = (run == 3);
+
+				commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+				vkCmdResetQueryPool(commandBuffer, queryPool, 0, 2);
+				vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+				if (run == 0) {
+					recordBlitChain(commandBuffer, image, width, height, levelCount, baseLayout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+				}
+				else {
+					recordGenerate(commandBuffer, target, filter, srgb, baseLayout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+				}
+				vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+				vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, stagingBuffer.buffer, levelCount, levelCopies.data());
+				VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+				memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+				device->flushCommandBuffer(commandBuffer, queue);
+				baseLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+				uint64_t timestamps[2] = { 0, 0 };
+				VK_CHECK_RESULT(vkGetQueryPoolResults(device->logicalDevice, queryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+				const double gpuTime = (double)(timestamps[1] - timestamps[0]) * device->properties.limits.timestampPeriod / 1000000.0;
+				std::cout << "  " << runNames[run] << ": " << gpuTime << " ms GPU";
+
+				if (run > 0) {
+					// Shared memory holds half floats and the levels are stored as 8 bit, so allow a small difference
+					auto tStart = std::chrono::high_resolution_clock::now();
+					std::vector<Level> reference = buildReference(base, width, height, levelCount, filter, srgb, kaiserAlpha);
+					const double cpuTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+					bool runValid = true;
+					for (uint32_t i = 1; (i < levelCount) && runValid; i++) {
+						const uint8_t *gpuTexels = (const uint8_t*)stagingBuffer.mapped + levelCopies[i].bufferOffset;
+						for (size_t t = 0; (t < reference[i].texels.size()) && runValid; t++) {
+							for (uint32_t c = 0; c < 4; c++) {
+								const int32_t expected = (int32_t)(std::min(std::max(reference[i].texels[t][c], 0.0f), 1.0f) * 255.0f + 0.5f);
+								if (abs(expected - (int32_t)gpuTexels[t * 4 + c]) > 2) {
+									runValid = false;
+									break;
+								}
+							}
+						}
+					}
+					std::cout << ", " << cpuTime << " ms CPU reference, " << (runValid ? "valid" : "INVALID");
+					valid = valid && runValid;
+				}
+				std::cout << std::endl;
+			}
+
+			destroyTarget(target);
+			vkDestroyQueryPool(device->logicalDevice, queryPool, nullptr);
+			stagingBuffer.destroy();
+			vkDestroyImage(device->logicalDevice, image, nullptr);
+			vkFreeMemory(device->logicalDevice, memory, nullptr);
+
+			return valid;
+		}
+
+		/** @brief Release all Vulkan resources, all targets have to be destroyed first */
+		void destroy()
+		{
+			if (device) {
+				vkDestroyPipeline(device->logicalDevice, pipelines.rgba8, nullptr);
+				vkDestroyPipeline(device->logicalDevice, pipelines.rgba16f, nullptr);
+				vkDestroyPipelineLayout(device->logicalDevice, pipelineLayout, nullptr);
+				vkDestroyDescriptorSetLayout(device->logicalDevice, descriptorSetLayout, nullptr);
+				vkDestroyDescriptorPool(device->logicalDevice, descriptorPool, nullptr);
+				device = nullptr;
+			}
+		}
+
+	private:
+		struct PushConstants {
+			int32_t baseWidth;
+			int32_t baseHeight;
+			uint32_t levelCount;
+			uint32_t groupCount;
+			// The box filter is a Kaiser filter with an outer weight of 0
+			float kaiserOuter;
+			float kaiserInner;
+			uint32_t srgb;
+		};
+
+		VkPipeline getPipeline(VkFormat format) const
+		{
+			switch (format) {
+			case VK_FORMAT_R8G8B8A8_UNORM:
+				return pipelines.rgba8;
+			case VK_FORMAT_R16G16B16A16_SFLOAT:
+				return pipelines.rgba16f;
+			default:
+				return VK_NULL_HANDLE;
+			}
+		}
+	};
+}
@@ -87,6 +87,8 @@ namespace vks
 		glm::vec3 scale;
 		glm::vec2 uvscale;
 		VkMemoryPropertyFlags memoryPropertyFlags = 0;
+		/** @brief Keep a host copy of the vertex and index data (e.g. for building acceleration structures on the CPU) */
+		bool keepHostData = false;
 
 		ModelCreateInfo() : center(glm::vec3(0.0f)), scale(glm::vec3(1.0f)), uvscale(glm::vec2(1.0f)) {};
 
@@ -122,6 +124,10 @@ namespace vks
 		};
 		std::vector<ModelPart> parts;
 
+		/** @brief Host copies of the vertex (in the requested layout) and index data, only filled if requested with ModelCreateInfo::keepHostData */
+		std::vector<float> vertexData;
+		std::vector<uint32_t> indexData;
+
 		static const int defaultFlags = aiProcess_FlipWindingOrder | aiProcess_Triangulate | aiProcess_PreTransformVertices | aiProcess_CalcTangentSpace | aiProcess_GenSmoothNormals;
 
 		struct Dimension
@@ -365,6 +371,12 @@ namespace vks
 				vkDestroyBuffer(device->logicalDevice, indexStaging.buffer, nullptr);
 				vkFreeMemory(device->logicalDevice, indexStaging.memory, nullptr);
 
+				if (createInfo && createInfo->keepHostData)
+				{
+					vertexData = std::move(vertexBuffer);
+					indexData = std::move(indexBuffer);
+				}
+
 				return true;
 			}
 			else
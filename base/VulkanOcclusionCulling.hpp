@@ -0,0 +1,415 @@
+/*
+* Non-blocking occlusion culling with hardware occlusion queries
+*
+* Copyright (C) 2026 by the colefet/Vulkan contributors
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <glm/glm.hpp>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanDevice.hpp"
+#include "VulkanBuffer.hpp"
+
+namespace vks
+{
+	/**
+	* Occlusion culling for large numbers of objects without stalling the CPU on query results
+	*
+	* Every frame slot has its own query pool with one query per object. The bounding box proxies of objects
+	* with an unknown or stale visibility are drawn against the depth buffer of the current frame and their results
+	* are read back a few frames later with VK_QUERY_RESULT_WITH_AVAILABILITY_BIT, results that are not yet
+	* available simply keep the previous visibility. Objects found visible are trusted for a number of frames
+	* and drawn without a query (temporal coherence).
+	*
+	* If VK_EXT_conditional_rendering is enabled, the results of the previous frame's queries are also copied on
+	* the GPU into a predicate buffer, so objects that are not trusted can be drawn conditionally with a latency
+	* of one frame instead of waiting for the CPU readback
+	*/
+	class OcclusionCuller
+	{
+	public:
+		struct Settings {
+			// Number of frames between issuing a query and reading its result on the host (set before create)
+			uint32_t latency = 2;
+			// Number of frames an object found visible is drawn without being queried again
+			uint32_t coherenceFrames = 8;
+			// Minimum number of passed samples for an object to count as visible
+			uint64_t visibleSamples = 1;
+			// Use the GPU side predicate for objects that are not trusted (if the extension is enabled)
+			bool conditionalRendering = true;
+		} settings;
+
+		struct Statistics {
+			uint32_t objects = 0;
+			// Objects drawn without a query this frame
+			uint32_t trusted = 0;
+			// Proxies issued this frame
+			uint32_t queried = 0;
+			// Objects drawn with the GPU side predicate this frame
+			uint32_t conditional = 0;
+			// Objects skipped based on the host side result
+			uint32_t culled = 0;
+			// Results read this frame and results lost because they weren't available before their slot got reused
+			uint32_t resultsRead = 0;
+			uint32_t resultsDropped = 0;
+		} stats;
+
+		/** @brief How an object should be drawn in the current frame */
+		enum Visibility { Culled = 0, Visible = 1, Conditional = 2 };
+
+		/** @brief Push constant block of the proxy draws (world space bounding box) */
+		struct ProxyPushConstants {
+			glm::vec4 min;
+			glm::vec4 max;
+		};
+
+		/** @brief Returns true if the physical device supports VK_EXT_conditional_rendering */
+		static bool conditionalRenderingSupported(VkPhysicalDevice physicalDevice)
+		{
+			uint32_t count = 0;
+			vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &count, nullptr);
+			std::vector<VkExtensionProperties> extensions(count);
+			vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &count, extensions.data());
+			for (auto &ext : extensions) {
+				if (strcmp(ext.extensionName, VK_EXT_CONDITIONAL_RENDERING_EXTENSION_NAME) == 0) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		/**
+		* Create the query pools and proxy geometry
+		*
+		* @param device Device to create the resources on
+		* @param maxObjects Maximum number of objects (queries per frame slot)
+		* @param conditionalRenderingEnabled VK_EXT_conditional_rendering has been enabled for the logical device
+		*/
+		void create(vks::VulkanDevice *device, uint32_t maxObjects, bool conditionalRenderingEnabled)
+		{
+			this->device = device;
+			this->maxObjects = maxObjects;
+			objects.reserve(maxObjects);
+
+			// One slot for the frame being recorded, latency slots waiting for their results and one extra frame for late results
+			slots.resize(settings.latency + 2);
+			VkQueryPoolCreateInfo queryPoolInfo = {};
+			queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolInfo.queryType = VK_QUERY_TYPE_OCCLUSION;
+			queryPoolInfo.queryCount = maxObjects;
+			for (auto &slot : slots) {
+				VK_CHECK_RESULT(vkCreateQueryPool(device->logicalDevice, &queryPoolInfo, nullptr, &slot.queryPool));
+				slot.queried.reserve(maxObjects);
+				slot.pending.reserve(maxObjects);
+			}
+			results.resize(maxObjects * 2);
+
+			// Unit cube, scaled to the bounding box in the proxy vertex shader
+			const float vertices[8 * 3] = {
+				0.0f, 0.0f, 0.0f,  1.0f, 0.0f, 0.0f,  1.0f, 1.0f, 0.0f,  0.0f, 1.0f, 0.0f,
+				0.0f, 0.0f, 1.0f,  1.0f, 0.0f, 1.0f,  1.0f, 1.0f, 1.0f,  0.0f, 1.0f, 1.0f,
+			};
+			const uint16_t indices[36] = {
+				0, 1, 2, 2, 3, 0,  4, 6, 5, 6, 4, 7,  0, 3, 7, 7, 4, 0,
+				1, 5, 6, 6, 2, 1,  0, 4, 5, 5, 1, 0,  3, 2, 6, 6, 7, 3,
+			};
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &proxyVertices, sizeof(vertices), (void*)vertices));
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &proxyIndices, sizeof(indices), (void*)indices));
+
+			if (conditionalRenderingEnabled) {
+				vkCmdBeginConditionalRenderingEXT = (PFN_vkCmdBeginConditionalRenderingEXT)vkGetDeviceProcAddr(device->logicalDevice, "vkCmdBeginConditionalRenderingEXT");
+				vkCmdEndConditionalRenderingEXT = (PFN_vkCmdEndConditionalRenderingEXT)vkGetDeviceProcAddr(device->logicalDevice, "vkCmdEndConditionalRenderingEXT");
+				if (vkCmdBeginConditionalRenderingEXT && vkCmdEndConditionalRenderingEXT) {
+					// One 32 bit predicate per object, written by vkCmdCopyQueryPoolResults
+					VK_CHECK_RESULT(device->createBuffer(
+						VK_BUFFER_USAGE_CONDITIONAL_RENDERING_BIT_EXT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+						VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+						&predicates,
+						sizeof(uint32_t) * maxObjects));
+				}
+			}
+		}
+
+		void destroy()
+		{
+			if (!device) {
+				return;
+			}
+			for (auto &slot : slots) {
+				vkDestroyQueryPool(device->logicalDevice, slot.queryPool, nullptr);
+			}
+			slots.clear();
+			proxyVertices.destroy();
+			proxyIndices.destroy();
+			predicates.destroy();
+			objects.clear();
+			device = nullptr;
+		}
+
+		/** @brief Returns true if occluded objects can be drawn with a GPU side predicate */
+		bool conditionalRenderingAvailable() const
+		{
+			return predicates.buffer != VK_NULL_HANDLE;
+		}
+
+		/** @brief Add an object with a world space bounding box, returns the object's index */
+		uint32_t addObject(const glm::vec3 &min, const glm::vec3 &max)
+		{
+			assert(objects.size() < maxObjects);
+			Object object;
+			object.min = min;
+			object.max = max;
+			objects.push_back(object);
+			stats.objects = static_cast<uint32_t>(objects.size());
+			return stats.objects - 1;
+		}
+
+		/** @brief Update the bounding box of a moving object */
+		void setBounds(uint32_t index, const glm::vec3 &min, const glm::vec3 &max)
+		{
+			objects[index].min = min;
+			objects[index].max = max;
+		}
+
+		/**
+		* Collect the available query results of older frames and decide which objects are drawn and queried this frame
+		* Never waits for the GPU
+		*
+		* @param cameraPos World space position of the camera, objects with the camera inside their bounds are always visible
+		*/
+		void beginFrame(const glm::vec3 &cameraPos)
+		{
+			frameIndex++;
+			const uint32_t slotCount = static_cast<uint32_t>(slots.size());
+			stats.resultsRead = 0;
+			stats.resultsDropped = 0;
+
+			// Read everything that's at least latency frames old, oldest first so newer results take precedence
+			for (uint64_t age = slotCount - 1; age >= std::max(settings.latency, 1u); age--) {
+				if (age < frameIndex) {
+					collectResults(slots[(frameIndex - age) % slotCount]);
+				}
+			}
+
+			// The slot of this frame is reused, results that are still missing are lost
+			Slot &slot = slots[frameIndex % slotCount];
+			stats.resultsDropped += static_cast<uint32_t>(slot.pending.size());
+			slot.queried.clear();
+			slot.pending.clear();
+			slot.frame = frameIndex;
+
+			const bool predicated = settings.conditionalRendering && conditionalRenderingAvailable();
+
+			stats.trusted = stats.queried = stats.conditional = stats.culled = 0;
+			for (uint32_t i = 0; i < objects.size(); i++) {
+				Object &object = objects[i];
+				// Proxies get clipped by the near plane if the camera is inside the bounds, so the result can't be trusted
+				const glm::vec3 margin(0.1f);
+				if (glm::all(glm::greaterThanEqual(cameraPos, object.min - margin)) && glm::all(glm::lessThanEqual(cameraPos, object.max + margin))) {
+					object.visible = true;
+					object.trustedUntil = frameIndex + settings.coherenceFrames;
+				}
+				if (object.visible && frameIndex < object.trustedUntil) {
+					object.state = Visible;
+					stats.trusted++;
+					continue;
+				}
+				// Objects with a proxy in the previous frame can use the GPU side copy of that result
+				if (predicated && (object.lastQueryFrame == frameIndex - 1)) {
+					object.state = Conditional;
+					stats.conditional++;
+				} else {
+					object.state = object.visible ? Visible : Culled;
+					if (!object.visible) {
+						stats.culled++;
+					}
+				}
+				object.lastQueryFrame = frameIndex;
+				slot.queried.push_back(i);
+			}
+			slot.pending = slot.queried;
+			stats.queried = static_cast<uint32_t>(slot.queried.size());
+		}
+
+		/** @brief Visibility of an object in the current frame */
+		Visibility visibility(uint32_t index) const
+		{
+			return objects[index].state;
+		}
+
+		/** @brief Last known host side visibility of an object */
+		bool visible(uint32_t index) const
+		{
+			return objects[index].visible;
+		}
+
+		/**
+		* Reset this frame's query pool and copy the previous frame's results into the predicate buffer
+		* Must be recorded outside of a render pass
+		*/
+		void cmdPrepare(VkCommandBuffer commandBuffer)
+		{
+			const uint32_t slotCount = static_cast<uint32_t>(slots.size());
+			const Slot &slot = slots[frameIndex % slotCount];
+			vkCmdResetQueryPool(commandBuffer, slot.queryPool, 0, maxObjects);
+
+			if (!conditionalRenderingAvailable() || !settings.conditionalRendering) {
+				return;
+			}
+			const Slot &previous = slots[(frameIndex - 1) % slotCount];
+			if ((previous.frame == 0) || (previous.frame != frameIndex - 1) || previous.queried.empty()) {
+				return;
+			}
+			// Objects are issued in ascending order, so consecutive indices are copied with a single command
+			// The wait is on the GPU timeline only, the previous frame's queries have been submitted earlier
+			size_t first = 0;
+			for (size_t i = 1; i <= previous.queried.size(); i++) {
+				if ((i == previous.queried.size()) || (previous.queried[i] != previous.queried[i - 1] + 1)) {
+					const uint32_t query = previous.queried[first];
+					vkCmdCopyQueryPoolResults(commandBuffer, previous.queryPool, query, static_cast<uint32_t>(i - first), predicates.buffer, sizeof(uint32_t) * query, sizeof(uint32_t), VK_QUERY_RESULT_WAIT_BIT);
+					first = i;
+				}
+			}
+			VkBufferMemoryBarrier barrier = vks::initializers::bufferMemoryBarrier();
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_CONDITIONAL_RENDERING_READ_BIT_EXT;
+			barrier.buffer = predicates.buffer;
+			barrier.offset = 0;
+			barrier.size = VK_WHOLE_SIZE;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_CONDITIONAL_RENDERING_BIT_EXT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+		}
+
+		/**
+		* Begin drawing an object, returns false if the object is culled and nothing should be drawn
+		* Conditionally drawn objects must be finished with cmdEndObject
+		*/
+		bool cmdBeginObject(VkCommandBuffer commandBuffer, uint32_t index)
+		{
+			const Object &object = objects[index];
+			if (object.state == Culled) {
+				return false;
+			}
+			if (object.state == Conditional) {
+				VkConditionalRenderingBeginInfoEXT conditionalRenderingBeginInfo{};
+				conditionalRenderingBeginInfo.sType = VK_STRUCTURE_TYPE_CONDITIONAL_RENDERING_BEGIN_INFO_EXT;
+				conditionalRenderingBeginInfo.buffer = predicates.buffer;
+				conditionalRenderingBeginInfo.offset = sizeof(uint32_t) * index;
+				vkCmdBeginConditionalRenderingEXT(commandBuffer, &conditionalRenderingBeginInfo);
+			}
+			return true;
+		}
+
+		void cmdEndObject(VkCommandBuffer commandBuffer, uint32_t index)
+		{
+			if (objects[index].state == Conditional) {
+				vkCmdEndConditionalRenderingEXT(commandBuffer);
+			}
+		}
+
+		/**
+		* Draw the bounding box proxies of all objects queried this frame
+		* Must be recorded after the occluders inside the render pass, with a pipeline bound that writes neither color nor depth
+		*
+		* @param layout Pipeline layout with a ProxyPushConstants sized push constant range at offset 0
+		* @param stageFlags Stages of that push constant range
+		*/
+		void cmdDrawProxies(VkCommandBuffer commandBuffer, VkPipelineLayout layout, VkShaderStageFlags stageFlags)
+		{
+			const Slot &slot = slots[frameIndex % slots.size()];
+			if (slot.queried.empty()) {
+				return;
+			}
+			VkDeviceSize offsets[1] = { 0 };
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &proxyVertices.buffer, offsets);
+			vkCmdBindIndexBuffer(commandBuffer, proxyIndices.buffer, 0, VK_INDEX_TYPE_UINT16);
+			ProxyPushConstants pushConstants;
+			for (uint32_t index : slot.queried) {
+				pushConstants.min = glm::vec4(objects[index].min, 1.0f);
+				pushConstants.max = glm::vec4(objects[index].max, 1.0f);
+				vkCmdPushConstants(commandBuffer, layout, stageFlags, 0, sizeof(ProxyPushConstants), &pushConstants);
+				vkCmdBeginQuery(commandBuffer, slot.queryPool, index, 0);
+				vkCmdDrawIndexed(commandBuffer, 36, 1, 0, 0, 0);
+				vkCmdEndQuery(commandBuffer, slot.queryPool, index);
+			}
+		}
+
+	private:
+		struct Object {
+			glm::vec3 min;
+			glm::vec3 max;
+			// Host side visibility from the latest available result
+			bool visible = true;
+			uint64_t trustedUntil = 0;
+			uint64_t lastQueryFrame = 0;
+			uint64_t lastResultFrame = 0;
+			Visibility state = Visible;
+		};
+
+		struct Slot {
+			VkQueryPool queryPool = VK_NULL_HANDLE;
+			// Frame the slot was last used for (0 = never)
+			uint64_t frame = 0;
+			// Object indices with a query in this slot (ascending) and those whose result hasn't been read yet
+			std::vector<uint32_t> queried;
+			std::vector<uint32_t> pending;
+		};
+
+		vks::VulkanDevice *device = nullptr;
+		uint32_t maxObjects = 0;
+		uint64_t frameIndex = 0;
+		std::vector<Object> objects;
+		std::vector<Slot> slots;
+		// Result and availability pairs
+		std::vector<uint64_t> results;
+
+		vks::Buffer proxyVertices;
+		vks::Buffer proxyIndices;
+		vks::Buffer predicates;
+
+		PFN_vkCmdBeginConditionalRenderingEXT vkCmdBeginConditionalRenderingEXT = nullptr;
+		PFN_vkCmdEndConditionalRenderingEXT vkCmdEndConditionalRenderingEXT = nullptr;
+
+		/** @brief Read the available results of a slot with a single call, unavailable ones stay pending */
+		void collectResults(Slot &slot)
+		{
+			if (slot.pending.empty()) {
+				return;
+			}
+			const uint32_t first = slot.pending.front();
+			const uint32_t count = slot.pending.back() - first + 1;
+			// Queries in the range that weren't issued are reset and report as unavailable
+			VkResult result = vkGetQueryPoolResults(device->logicalDevice, slot.queryPool, first, count, sizeof(uint64_t) * 2 * count, results.data(), sizeof(uint64_t) * 2, VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+			if ((result != VK_SUCCESS) && (result != VK_NOT_READY)) {
+				VK_CHECK_RESULT(result);
+			}
+			size_t pending = 0;
+			for (uint32_t index : slot.pending) {
+				const uint64_t *value = &results[(index - first) * 2];
+				if (value[1] == 0) {
+					slot.pending[pending++] = index;
+					continue;
+				}
+				stats.resultsRead++;
+				Object &object = objects[index];
+				if (slot.frame < object.lastResultFrame) {
+					continue;
+				}
+				object.lastResultFrame = slot.frame;
+				object.visible = value[0] >= settings.visibleSamples;
+				if (object.visible) {
+					// Spread the re-queries of objects that became visible at the same time over a few frames
+					object.trustedUntil = frameIndex + settings.coherenceFrames + (index & 3);
+				}
+			}
+			slot.pending.resize(pending);
+		}
+	};
+}
@@ -0,0 +1,326 @@
+/*
+* Vulkan compute shader radix sort
+*
+* Stable least significant digit radix sort of 32 bit key/value pairs in a storage buffer
+*
+* Copyright (C) 2026 by the colefet/Vulkan contributors
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanBuffer.hpp"
+#include "VulkanDevice.hpp"
+
+namespace vks
+{
+	/**
+	* @brief Sorts key/value pairs (uvec2) in ascending key order in a storage buffer
+	* @note Unlike vks::BitonicSort the pair count does not have to be padded to a power of two and the cost is linear in the number of pairs
+	* @note The sort is stable, pairs with equal keys keep their input order (same result as sortReference)
+	* @note Each pass sorts by RADIX_BITS bits of the key, the pairs are ping-ponged through an internal scratch buffer and always end up in the bound buffer
+	*/
+	class RadixSort
+	{
+	public:
+		/** @brief Number of pairs handled by a single work group (must match radixsort.comp) */
+		static const uint32_t TILE_SIZE = 1024;
+		/** @brief Number of key bits sorted per pass (must match radixsort.comp) */
+		static const uint32_t RADIX_BITS = 4;
+		static const uint32_t RADIX = 1 << RADIX_BITS;
+
+		struct KeyValue {
+			uint32_t key;
+			uint32_t value;
+		};
+
+		vks::VulkanDevice *device = nullptr;
+
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+		// Set 0 reads the bound buffer and writes the scratch buffer, set 1 the other way round
+		std::array<VkDescriptorSet, 2> descriptorSets;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+
+		/** @brief Scratch buffer for the odd passes, sized for the largest count passed to setBuffer */
+		vks::Buffer scratchBuffer;
+		/** @brief Per tile digit counts, turned into scatter offsets by the scan */
+		vks::Buffer countsBuffer;
+
+		/** @brief Number of pairs in the currently bound buffer */
+		uint32_t count = 0;
+
+		/** @brief Returns the number of work groups used for each pass over count pairs */
+		static uint32_t getGroupCount(uint32_t count)
+		{
+			return (count + TILE_SIZE - 1) / TILE_SIZE;
+		}
+
+		/** @brief CPU reference implementation, produces the same order as the GPU sort */
+		static void sortReference(std::vector<KeyValue> &pairs)
+		{
+			std::stable_sort(pairs.begin(), pairs.end(), [](const KeyValue &a, const KeyValue &b) {
+				return a.key < b.key;
+			});
+		}
+
+		/**
+		* Create the compute pipeline used by the sort
+		*
+		* @param device Pointer to the Vulkan device
+		* @param pipelineCache Pipeline cache used for pipeline creation
+		* @param shaderStage Shader stage of radixsort.comp (the module is owned by the caller)
+		*/
+		void prepare(vks::VulkanDevice *device, VkPipelineCache pipelineCache, VkPipelineShaderStageCreateInfo shaderStage)
+		{
+			this->device = device;
+
+			std::vector<VkDescriptorPoolSize> poolSizes = {
+				vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6)
+			};
+			VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(poolSizes, 2);
+			VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolInfo, nullptr, &descriptorPool));
+
+			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+				// Binding 0 : Source key/value pairs
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+				// Binding 1 : Destination key/value pairs
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+				// Binding 2 : Digit counts
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+			};
+			VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorLayout, nullptr, &descriptorSetLayout));
+
+			std::array<VkDescriptorSetLayout, 2> setLayouts = { descriptorSetLayout, descriptorSetLayout };
+			VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, setLayouts.data(), 2);
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, descriptorSets.data()));
+
+			// Push constants select the sort stage and the key digit for each dispatch
+			VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(PushConstants), 0);
+			VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+			pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+			pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+			VK_CHECK_RESULT(vkCreatePipelineLayout(device->logicalDevice, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout));
+
+			VkComputePipelineCreateInfo pipelineCreateInfo = vks::initializers::computePipelineCreateInfo(pipelineLayout, 0);
+			pipelineCreateInfo.stage = shaderStage;
+			VK_CHECK_RESULT(vkCreateComputePipelines(device->logicalDevice, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipeline));
+		}
+
+		/**
+		* Set the buffer to be sorted
+		*
+		* @param descriptor Descriptor of the buffer range containing the key/value pairs
+		* @param count Number of pairs in the buffer range
+		*
+		* @note (Re)creates the scratch buffers if they are too small, must not be called while a recorded sort is pending
+		*/
+		void setBuffer(VkDescriptorBufferInfo *descriptor, uint32_t count)
+		{
+			assert(count > 0);
+			this->count = count;
+
+			const VkDeviceSize scratchSize = count * sizeof(KeyValue);
+			const VkDeviceSize countsSize = RADIX * getGroupCount(count) * sizeof(uint32_t);
+			if (scratchBuffer.size < scratchSize) {
+				scratchBuffer.destroy();
+				VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &scratchBuffer, scratchSize));
+			}
+			if (countsBuffer.size < countsSize) {
+				countsBuffer.destroy();
+				VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &countsBuffer, countsSize));
+			}
+
+			std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+				vks::initializers::writeDescriptorSet(descriptorSets[0], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, descriptor),
+				vks::initializers::writeDescriptorSet(descriptorSets[0], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &scratchBuffer.descriptor),
+				vks::initializers::writeDescriptorSet(descriptorSets[0], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &countsBuffer.descriptor),
+				vks::initializers::writeDescriptorSet(descriptorSets[1], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &scratchBuffer.descriptor),
+				vks::initializers::writeDescriptorSet(descriptorSets[1], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, descriptor),
+				vks::initializers::writeDescriptorSet(descriptorSets[1], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &countsBuffer.descriptor),
+			};
+			vkUpdateDescriptorSets(device->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+		}
+
+		/**
+		* Record the sort into a command buffer
+		*
+		* @param commandBuffer Command buffer to record to
+		* @param keyBits Number of significant (low) key bits, higher bits are ignored and fewer passes are recorded
+		*
+		* @note The caller has to make prior writes to the buffer visible to compute shader reads, and the sort's writes visible to later consumers
+		*/
+		void recordSort(VkCommandBuffer commandBuffer, uint32_t keyBits = 32)
+		{
+			assert(count > 0 && keyBits > 0 && keyBits <= 32);
+			const uint32_t groupCount = getGroupCount(count);
+
+			// An even number of passes leaves the result in the bound buffer, an extra pass over unused bits keeps the order
+			uint32_t passCount = (keyBits + RADIX_BITS - 1) / RADIX_BITS;
+			passCount += passCount & 1;
+
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+			for (uint32_t pass = 0; pass < passCount; pass++) {
+				const uint32_t shift = pass * RADIX_BITS;
+				if (pass > 0) {
+					barrier(commandBuffer);
+				}
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[pass & 1], 0, nullptr);
+				dispatch(commandBuffer, MODE_HISTOGRAM, shift, groupCount, groupCount);
+				barrier(commandBuffer);
+				dispatch(commandBuffer, MODE_SCAN, shift, groupCount, 1);
+				barrier(commandBuffer);
+				dispatch(commandBuffer, MODE_SCATTER, shift, groupCount, groupCount);
+			}
+		}
+
+		/**
+		* Sort random pairs on the GPU, check the result against sortReference and report the throughput
+		*
+		* @param queue Queue to submit to (must support compute and be of the device's default command pool family)
+		* @param count Number of pairs to sort
+		*
+		* @return True if the GPU result matches the CPU reference
+		*
+		* @note Rebinds the sort buffer, call setBuffer again afterwards
+		*/
+		bool benchmark(VkQueue queue, uint32_t count)
+		{
+			const VkDeviceSize bufferSize = count * sizeof(KeyValue);
+
+			// Narrow key range so the stability of the sort is checked as well
+			std::default_random_engine rndEngine(0);
+			std::uniform_int_distribution<uint32_t> rndDist(0, count / 4);
+			std::vector<KeyValue> pairs(count);
+			for (uint32_t i = 0; i < count; i++) {
+				pairs[i].key = rndDist(rndEngine);
+				pairs[i].value = i;
+			}
+
+			vks::Buffer stagingBuffer, sortBuffer;
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&stagingBuffer,
+				bufferSize,
+				pairs.data()));
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				&sortBuffer,
+				bufferSize));
+			setBuffer(&sortBuffer.descriptor, count);
+
+			VkQueryPool queryPool;
+			VkQueryPoolCreateInfo queryPoolInfo = {};
+			queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			queryPoolInfo.queryCount = 2;
+			VK_CHECK_RESULT(vkCreateQueryPool(device->logicalDevice, &queryPoolInfo, nullptr, &queryPool));
+
+			VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			vkCmdResetQueryPool(commandBuffer, queryPool, 0, 2);
+			VkBufferCopy copyRegion = { 0, 0, bufferSize };
+			vkCmdCopyBuffer(commandBuffer, stagingBuffer.buffer, sortBuffer.buffer, 1, &copyRegion);
+			VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+			memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+			recordSort(commandBuffer);
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+			memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			vkCmdCopyBuffer(commandBuffer, sortBuffer.buffer, stagingBuffer.buffer, 1, &copyRegion);
+			memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			device->flushCommandBuffer(commandBuffer, queue);
+
+			uint64_t timestamps[2] = { 0, 0 };
+			VK_CHECK_RESULT(vkGetQueryPoolResults(device->logicalDevice, queryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+			double gpuTime = (double)(timestamps[1] - timestamps[0]) * device->properties.limits.timestampPeriod / 1000000.0;
+
+			std::vector<KeyValue> gpuResult(count);
+			VK_CHECK_RESULT(stagingBuffer.map());
+			memcpy(gpuResult.data(), stagingBuffer.mapped, bufferSize);
+			stagingBuffer.unmap();
+
+			auto tStart = std::chrono::high_resolution_clock::now();
+			sortReference(pairs);
+			double cpuTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+
+			bool valid = true;
+			for (uint32_t i = 0; i < count; i++) {
+				if ((gpuResult[i].key != pairs[i].key) || (gpuResult[i].value != pairs[i].value)) {
+					valid = false;
+					break;
+				}
+			}
+
+			std::cout << std::fixed << std::setprecision(3);
+			std::cout << "Radix sort of " << count << " pairs: " << gpuTime << " ms GPU (" << ((double)count / gpuTime / 1000.0) << " Mpairs/s), " << cpuTime << " ms CPU reference, " << (valid ? "valid" : "INVALID") << std::endl;
+
+			vkDestroyQueryPool(device->logicalDevice, queryPool, nullptr);
+			sortBuffer.destroy();
+			stagingBuffer.destroy();
+			this->count = 0;
+
+			return valid;
+		}
+
+		/** @brief Release all Vulkan resources */
+		void destroy()
+		{
+			if (device) {
+				scratchBuffer.destroy();
+				countsBuffer.destroy();
+				vkDestroyPipeline(device->logicalDevice, pipeline, nullptr);
+				vkDestroyPipelineLayout(device->logicalDevice, pipelineLayout, nullptr);
+				vkDestroyDescriptorSetLayout(device->logicalDevice, descriptorSetLayout, nullptr);
+				vkDestroyDescriptorPool(device->logicalDevice, descriptorPool, nullptr);
+				device = nullptr;
+			}
+		}
+
+	private:
+		enum Mode { MODE_HISTOGRAM = 0, MODE_SCAN = 1, MODE_SCATTER = 2 };
+
+		struct PushConstants {
+			uint32_t mode;
+			uint32_t shift;
+			uint32_t count;
+			uint32_t groupCount;
+		};
+
+		void dispatch(VkCommandBuffer commandBuffer, Mode mode, uint32_t shift, uint32_t tileCount, uint32_t groupCount)
+		{
+			PushConstants pushConstants = { (uint32_t)mode, shift, count, tileCount };
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+			vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+		}
+
+		void barrier(VkCommandBuffer commandBuffer)
+		{
+			VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+			memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		}
+	};
+}
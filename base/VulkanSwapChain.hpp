@@ -75,6 +75,8 @@ public:
 	std::vector<SwapChainBuffer> buffers;
 	/** @brief Queue family index of the detected graphics and presenting device queue */
 	uint32_t queueNodeIndex = UINT32_MAX;
+	/** @brief Usage flags the swap chain images have been created with */
+	VkImageUsageFlags imageUsage = 0;
 
 	/** @brief Creates the platform specific surface abstraction of the native platform window used for presentation */	
 #if defined(VK_USE_PLATFORM_WIN32_KHR)
@@ -401,6 +403,8 @@ public:
 			swapchainCI.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 		}
 
+		imageUsage = swapchainCI.imageUsage;
+
 		VK_CHECK_RESULT(fpCreateSwapchainKHR(device, &swapchainCI, nullptr, &swapChain));
 
 		// If an existing swap chain is re-created, destroy the old swap chain
@@ -0,0 +1,663 @@
+/*
+* Streaming of large height fields from a tiled file
+*
+* Copyright (C) 2026 by the colefet/Vulkan contributors
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <glm/glm.hpp>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanDevice.hpp"
+#include "VulkanBuffer.hpp"
+#include "VulkanTexture.hpp"
+
+namespace vks
+{
+	/**
+	* Streams the tiles of a large height field around the camera into a texture array
+	*
+	* Tiles are read by worker threads directly into a host visible staging ring and copied into the layers
+	* of a texture array on the main thread. A tile table (storage buffer) maps each tile to its array layer
+	* or -1 if it's not resident, in which case shaders fall back to a small always resident overview image
+	*/
+	class TerrainStreamer
+	{
+	public:
+		/**
+		* Header of the tiled file, followed by the overview image and the tiles (row by row)
+		* Tiles store (tileSize + 1)^2 heights so neighbouring tiles share their border samples
+		*/
+		struct FileHeader {
+			char magic[4];
+			uint32_t version;
+			uint32_t dim;
+			uint32_t tileSize;
+			uint32_t tilesPerRow;
+			uint32_t overviewDim;
+			uint32_t reserved[2];
+		};
+
+		struct Settings {
+			// Device memory available for resident tiles
+			VkDeviceSize memoryBudget = 64 * 1024 * 1024;
+			// Number of tiles that can be in flight between disk and texture array
+			uint32_t stagingSlots = 16;
+			uint32_t workerCount = 2;
+			// Tiles within this distance (world units) of the camera are kept resident
+			float loadRadius = 32.0f;
+			// Seconds of camera movement to look ahead for prefetching
+			float prefetchTime = 1.0f;
+		} settings;
+
+		struct Statistics {
+			uint32_t residentTiles = 0;
+			uint32_t pendingTiles = 0;
+			// Tiles needed around the camera and how many of them were resident at that time
+			uint64_t requests = 0;
+			uint64_t hits = 0;
+			uint64_t loads = 0;
+			uint64_t evictions = 0;
+			// Time from requesting a tile until it's usable by shaders (in ms)
+			float averageLatency = 0.0f;
+			float maxLatency = 0.0f;
+			VkDeviceSize deviceMemory = 0;
+			VkDeviceSize stagingMemory = 0;
+			float hitRate() const { return requests > 0 ? (float)hits / (float)requests : 1.0f; }
+		} stats;
+
+		// Heights of the tiles, one layer per resident tile
+		VkImage image = VK_NULL_HANDLE;
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		VkSampler sampler = VK_NULL_HANDLE;
+		VkDescriptorImageInfo descriptor;
+		// Low resolution version of the whole height field
+		vks::Texture2D overview;
+		// uint tilesPerRow, uint tileSize, uint dim, uint reserved, int layer[tileCount]
+		vks::Buffer tileTable;
+
+		/**
+		* Convert a height field into the tiled file format
+		*
+		* @param filename Name of the tiled file to write
+		* @param heights Height samples (dim * dim)
+		* @param dim Dimension of the height field
+		* @param tileSize Number of quads along a tile side
+		* @param overviewDim Dimension of the always resident overview image
+		*
+		* @return True if the file was written
+		*/
+		static bool writeTiledFile(const std::string &filename, const uint16_t *heights, uint32_t dim, uint32_t tileSize, uint32_t overviewDim = 256)
+		{
+			FILE *file = fopen(filename.c_str(), "wb");
+			if (!file) {
+				return false;
+			}
+			FileHeader header = {};
+			memcpy(header.magic, "VKTT", 4);
+			header.version = 1;
+			header.dim = dim;
+			header.tileSize = tileSize;
+			header.tilesPerRow = (dim - 1 + tileSize - 1) / tileSize;
+			header.overviewDim = overviewDim;
+			bool result = fwrite(&header, sizeof(header), 1, file) == 1;
+
+			auto sample = [heights, dim](int64_t x, int64_t y) {
+				x = std::min<int64_t>(x, dim - 1);
+				y = std::min<int64_t>(y, dim - 1);
+				return heights[x + y * dim];
+			};
+
+			std::vector<uint16_t> data((size_t)overviewDim * overviewDim);
+			for (uint32_t y = 0; y < overviewDim; y++) {
+				for (uint32_t x = 0; x < overviewDim; x++) {
+					data[x + y * overviewDim] = sample((int64_t)x * (dim - 1) / (overviewDim - 1), (int64_t)y * (dim - 1) / (overviewDim - 1));
+				}
+			}
+			result = result && (fwrite(data.data(), sizeof(uint16_t), data.size(), file) == data.size());
+
+			const uint32_t row = tileSize + 1;
+			data.resize(row * row);
+			for (uint32_t tile = 0; result && (tile < header.tilesPerRow * header.tilesPerRow); tile++) {
+				const int64_t baseX = (tile % header.tilesPerRow) * tileSize;
+				const int64_t baseY = (tile / header.tilesPerRow) * tileSize;
+				for (uint32_t y = 0; y < row; y++) {
+					for (uint32_t x = 0; x < row; x++) {
+						data[x + y * row] = sample(baseX + x, baseY + y);
+					}
+				}
+				result = fwrite(data.data(), sizeof(uint16_t), data.size(), file) == data.size();
+			}
+			fclose(file);
+			return result;
+		}
+
+		/**
+		* Open a tiled file and create the resources for streaming it
+		*
+		* @param filename Tiled file created with writeTiledFile
+		* @param device Device used for the streaming resources
+		* @param queue Queue used for uploading tiles, tiles are uploaded in order with the rendering submitted to this queue
+		*
+		* @return True if the file could be opened
+		*/
+		bool open(const std::string &filename, vks::VulkanDevice *device, VkQueue queue)
+		{
+			this->device = device;
+			this->queue = queue;
+
+#if defined(_WIN32)
+			file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE) {
+				return false;
+			}
+#else
+			file = ::open(filename.c_str(), O_RDONLY);
+			if (file < 0) {
+				return false;
+			}
+#endif
+			if (!readFile(0, &header, sizeof(header)) || (memcmp(header.magic, "VKTT", 4) != 0) || (header.version != 1)) {
+				closeFile();
+				return false;
+			}
+
+			const uint32_t tileCount = header.tilesPerRow * header.tilesPerRow;
+			tileBytes = (VkDeviceSize)(header.tileSize + 1) * (header.tileSize + 1) * sizeof(uint16_t);
+			const VkDeviceSize overviewBytes = (VkDeviceSize)header.overviewDim * header.overviewDim * sizeof(uint16_t);
+			tileDataOffset = sizeof(FileHeader) + overviewBytes;
+
+			// Overview is loaded once and stays resident
+			std::vector<uint16_t> overviewData((size_t)header.overviewDim * header.overviewDim);
+			readFile(sizeof(FileHeader), overviewData.data(), overviewBytes);
+			overview.fromBuffer(overviewData.data(), overviewBytes, VK_FORMAT_R16_UNORM, header.overviewDim, header.overviewDim, device, queue);
+
+			// Number of resident tiles is given by the memory budget
+			const uint32_t layerCount = (uint32_t)std::max<VkDeviceSize>(1, std::min<VkDeviceSize>(settings.memoryBudget / tileBytes, std::min(tileCount, device->properties.limits.maxImageArrayLayers)));
+			layers.assign(layerCount, Layer());
+
+			VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+			imageCI.imageType = VK_IMAGE_TYPE_2D;
+			imageCI.format = VK_FORMAT_R16_UNORM;
+			imageCI.extent = { header.tileSize + 1, header.tileSize + 1, 1 };
+			imageCI.mipLevels = 1;
+			imageCI.arrayLayers = layerCount;
+			imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageCI.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+			imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCI, nullptr, &image));
+			VkMemoryRequirements memReqs;
+			vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
+			VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+			memAlloc.allocationSize = memReqs.size;
+			memAlloc.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAlloc, nullptr, &memory));
+			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, memory, 0));
+
+			VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, layerCount };
+			VkCommandBuffer layoutCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			vks::tools::setImageLayout(layoutCmd, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, range);
+			device->flushCommandBuffer(layoutCmd, queue, true);
+
+			VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+			viewCI.image = image;
+			viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+			viewCI.format = VK_FORMAT_R16_UNORM;
+			viewCI.subresourceRange = range;
+			VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCI, nullptr, &view));
+
+			VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+			samplerCI.magFilter = VK_FILTER_LINEAR;
+			samplerCI.minFilter = VK_FILTER_LINEAR;
+			samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+			samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+			samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+			samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+			samplerCI.maxLod = 0.0f;
+			samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+			VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerCI, nullptr, &sampler));
+			descriptor = { sampler, view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+
+			// Tile table is host visible and only written between frames
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &tileTable, sizeof(uint32_t) * 4 + sizeof(int32_t) * tileCount));
+			VK_CHECK_RESULT(tileTable.map());
+			uint32_t *tableHeader = (uint32_t*)tileTable.mapped;
+			tableHeader[0] = header.tilesPerRow;
+			tableHeader[1] = header.tileSize;
+			tableHeader[2] = header.dim;
+			tableHeader[3] = 0;
+			tileLayers = (int32_t*)tileTable.mapped + 4;
+			std::fill(tileLayers, tileLayers + tileCount, -1);
+			tileLoading.assign(tileCount, false);
+
+			// Staging ring the workers read tiles into
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging, tileBytes * settings.stagingSlots));
+			VK_CHECK_RESULT(staging.map());
+			freeStagingSlots.clear();
+			for (uint32_t i = 0; i < settings.stagingSlots; i++) {
+				freeStagingSlots.push_back(i);
+			}
+
+			VkCommandPoolCreateInfo cmdPoolInfo = vks::initializers::commandPoolCreateInfo();
+			cmdPoolInfo.queueFamilyIndex = device->queueFamilyIndices.graphics;
+			cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+			VK_CHECK_RESULT(vkCreateCommandPool(device->logicalDevice, &cmdPoolInfo, nullptr, &commandPool));
+			VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+			VK_CHECK_RESULT(vkAllocateCommandBuffers(device->logicalDevice, &cmdBufAllocateInfo, &uploadCmd));
+			VkFenceCreateInfo fenceInfo = vks::initializers::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
+			VK_CHECK_RESULT(vkCreateFence(device->logicalDevice, &fenceInfo, nullptr, &uploadFence));
+
+			stats = Statistics();
+			stats.deviceMemory = memReqs.size + overviewBytes;
+			stats.stagingMemory = staging.size;
+
+			stop = false;
+			for (uint32_t i = 0; i < std::max(1u, settings.workerCount); i++) {
+				workers.push_back(std::thread(&TerrainStreamer::workerLoop, this));
+			}
+			return true;
+		}
+
+		void destroy()
+		{
+			if (!device) {
+				return;
+			}
+			{
+				std::lock_guard<std::mutex> lock(requestMutex);
+				stop = true;
+			}
+			requestCondition.notify_all();
+			for (auto &worker : workers) {
+				worker.join();
+			}
+			workers.clear();
+			vkWaitForFences(device->logicalDevice, 1, &uploadFence, VK_TRUE, UINT64_MAX);
+			vkDestroyFence(device->logicalDevice, uploadFence, nullptr);
+			vkDestroyCommandPool(device->logicalDevice, commandPool, nullptr);
+			vkDestroySampler(device->logicalDevice, sampler, nullptr);
+			vkDestroyImageView(device->logicalDevice, view, nullptr);
+			vkDestroyImage(device->logicalDevice, image, nullptr);
+			vkFreeMemory(device->logicalDevice, memory, nullptr);
+			overview.destroy();
+			tileTable.destroy();
+			staging.destroy();
+			closeFile();
+			device = nullptr;
+		}
+
+		~TerrainStreamer()
+		{
+			destroy();
+		}
+
+		/** @brief Place the height field in world space, it spans origin to origin + extent on the x and z axes */
+		void setWorldMapping(glm::vec2 origin, float extent)
+		{
+			worldOrigin = origin;
+			worldExtent = extent;
+		}
+
+		uint32_t getTileCount() const
+		{
+			return header.tilesPerRow * header.tilesPerRow;
+		}
+
+		uint32_t getLayerCount() const
+		{
+			return static_cast<uint32_t>(layers.size());
+		}
+
+		/**
+		* Request the tiles around the camera and upload finished tiles, call once per frame before submitting
+		*
+		* @param cameraPos Camera position in world space
+		* @param cameraVelocity Camera velocity in world space (units per second), used to prefetch tiles ahead of the camera
+		*
+		* @note The tile table is written directly, the caller has to make sure it's not in use by the GPU
+		*/
+		void update(glm::vec3 cameraPos, glm::vec3 cameraVelocity)
+		{
+			frame++;
+			finishUploads();
+
+			// Tiles around the camera and around its predicted position, sorted by priority
+			const float tileExtent = worldExtent * (float)header.tileSize / (float)(header.dim - 1);
+			const glm::vec2 current = (glm::vec2(cameraPos.x, cameraPos.z) - worldOrigin) / tileExtent;
+			const glm::vec2 predicted = current + glm::vec2(cameraVelocity.x, cameraVelocity.z) * settings.prefetchTime / tileExtent;
+			const float radius = settings.loadRadius / tileExtent;
+			wanted.clear();
+			gatherTiles(current, radius, 0.0f, true);
+			if (glm::length(predicted - current) > 0.5f) {
+				// Prefetched tiles rank behind the tiles at the same distance around the camera
+				gatherTiles(predicted, radius, 1.0f, false);
+			}
+			std::sort(wanted.begin(), wanted.end(), [](const WantedTile &a, const WantedTile &b) { return a.priority < b.priority; });
+			// Only as many tiles as fit into the budget
+			if (wanted.size() > layers.size()) {
+				wanted.resize(layers.size());
+			}
+			for (auto &w : wanted) {
+				if (tileLayers[w.tile] >= 0) {
+					layers[tileLayers[w.tile]].lastUsed = frame;
+				}
+			}
+
+			// Re-prioritize: drop requests that haven't been picked up by a worker yet and issue the current ones
+			{
+				std::lock_guard<std::mutex> lock(requestMutex);
+				for (auto &request : requests) {
+					tileLoading[request.tile] = false;
+					freeStagingSlots.push_back(request.stagingSlot);
+				}
+				requests.clear();
+				for (auto &w : wanted) {
+					if (freeStagingSlots.empty()) {
+						break;
+					}
+					if ((tileLayers[w.tile] >= 0) || tileLoading[w.tile]) {
+						continue;
+					}
+					Request request;
+					request.tile = w.tile;
+					request.stagingSlot = freeStagingSlots.back();
+					request.requested = requestTimes.count(w.tile) ? requestTimes[w.tile] : std::chrono::high_resolution_clock::now();
+					requestTimes[w.tile] = request.requested;
+					freeStagingSlots.pop_back();
+					tileLoading[w.tile] = true;
+					requests.push_back(request);
+				}
+				// Latency is measured from the first request, forget tiles that are no longer requested
+				for (auto it = requestTimes.begin(); it != requestTimes.end();) {
+					it = tileLoading[it->first] ? std::next(it) : requestTimes.erase(it);
+				}
+				stats.pendingTiles = static_cast<uint32_t>(requestTimes.size());
+			}
+			requestCondition.notify_all();
+
+			startUploads();
+		}
+
+	private:
+		struct Layer {
+			int32_t tile = -1;
+			uint64_t lastUsed = 0;
+		};
+
+		struct Request {
+			uint32_t tile;
+			uint32_t stagingSlot;
+			std::chrono::high_resolution_clock::time_point requested;
+		};
+
+		struct WantedTile {
+			uint32_t tile;
+			float priority;
+		};
+
+		vks::VulkanDevice *device = nullptr;
+		VkQueue queue = VK_NULL_HANDLE;
+		FileHeader header = {};
+		VkDeviceSize tileBytes = 0;
+		VkDeviceSize tileDataOffset = 0;
+#if defined(_WIN32)
+		HANDLE file = INVALID_HANDLE_VALUE;
+#else
+		int file = -1;
+#endif
+
+		glm::vec2 worldOrigin = glm::vec2(0.0f);
+		float worldExtent = 1.0f;
+		uint64_t frame = 0;
+
+		std::vector<Layer> layers;
+		// Points into the tile table
+		int32_t *tileLayers = nullptr;
+		std::vector<bool> tileLoading;
+		std::vector<WantedTile> wanted;
+
+		vks::Buffer staging;
+		std::vector<uint32_t> freeStagingSlots;
+
+		// Requests are consumed by the workers, loaded tiles are handed back for upload
+		std::vector<std::thread> workers;
+		std::mutex requestMutex;
+		std::condition_variable requestCondition;
+		std::deque<Request> requests;
+		std::vector<Request> loaded;
+		std::map<uint32_t, std::chrono::high_resolution_clock::time_point> requestTimes;
+		bool stop = false;
+
+		VkCommandPool commandPool = VK_NULL_HANDLE;
+		VkCommandBuffer uploadCmd = VK_NULL_HANDLE;
+		VkFence uploadFence = VK_NULL_HANDLE;
+		// Tiles (and their target layers) of the upload currently in flight
+		std::vector<std::pair<Request, uint32_t>> uploading;
+
+		bool readFile(uint64_t offset, void *dst, uint64_t size)
+		{
+#if defined(_WIN32)
+			OVERLAPPED overlapped = {};
+			overlapped.Offset = (DWORD)(offset & 0xFFFFFFFF);
+			overlapped.OffsetHigh = (DWORD)(offset >> 32);
+			DWORD bytesRead = 0;
+			return ReadFile(file, dst, (DWORD)size, &bytesRead, &overlapped) && (bytesRead == size);
+#else
+			uint8_t *data = (uint8_t*)dst;
+			while (size > 0) {
+				ssize_t bytesRead = pread(file, data, size, offset);
+				if (bytesRead <= 0) {
+					return false;
+				}
+				data += bytesRead;
+				offset += bytesRead;
+				size -= bytesRead;
+			}
+			return true;
+#endif
+		}
+
+		void closeFile()
+		{
+#if defined(_WIN32)
+			if (file != INVALID_HANDLE_VALUE) {
+				CloseHandle(file);
+				file = INVALID_HANDLE_VALUE;
+			}
+#else
+			if (file >= 0) {
+				close(file);
+				file = -1;
+			}
+#endif
+		}
+
+		void workerLoop()
+		{
+			while (true) {
+				Request request;
+				{
+					std::unique_lock<std::mutex> lock(requestMutex);
+					requestCondition.wait(lock, [this] { return stop || !requests.empty(); });
+					if (stop) {
+						return;
+					}
+					request = requests.front();
+					requests.pop_front();
+				}
+				// Positional reads, so workers don't need to share a file offset
+				readFile(tileDataOffset + request.tile * tileBytes, (uint8_t*)staging.mapped + request.stagingSlot * tileBytes, tileBytes);
+				std::lock_guard<std::mutex> lock(requestMutex);
+				loaded.push_back(request);
+			}
+		}
+
+		void gatherTiles(glm::vec2 center, float radius, float bias, bool countHits)
+		{
+			const int32_t tilesPerRow = (int32_t)header.tilesPerRow;
+			const int32_t x0 = std::max(0, (int32_t)floor(center.x - radius));
+			const int32_t x1 = std::min(tilesPerRow - 1, (int32_t)floor(center.x + radius));
+			const int32_t y0 = std::max(0, (int32_t)floor(center.y - radius));
+			const int32_t y1 = std::min(tilesPerRow - 1, (int32_t)floor(center.y + radius));
+			for (int32_t y = y0; y <= y1; y++) {
+				for (int32_t x = x0; x <= x1; x++) {
+					// Distance to the closest point of the tile
+					const glm::vec2 closest = glm::clamp(center, glm::vec2((float)x, (float)y), glm::vec2((float)(x + 1), (float)(y + 1)));
+					const float distance = glm::length(closest - center);
+					if (distance > radius) {
+						continue;
+					}
+					const uint32_t tile = x + y * tilesPerRow;
+					auto it = std::find_if(wanted.begin(), wanted.end(), [tile](const WantedTile &w) { return w.tile == tile; });
+					if (it != wanted.end()) {
+						it->priority = std::min(it->priority, distance + bias);
+						continue;
+					}
+					wanted.push_back({ tile, distance + bias });
+					if (countHits) {
+						stats.requests++;
+						if (tileLayers[tile] >= 0) {
+							stats.hits++;
+						}
+					}
+				}
+			}
+		}
+
+		// Make tiles of a completed upload visible to shaders and recycle their staging slots
+		void finishUploads()
+		{
+			if (uploading.empty() || (vkGetFenceStatus(device->logicalDevice, uploadFence) != VK_SUCCESS)) {
+				return;
+			}
+			const auto now = std::chrono::high_resolution_clock::now();
+			std::lock_guard<std::mutex> lock(requestMutex);
+			for (auto &upload : uploading) {
+				const Request &request = upload.first;
+				tileLayers[request.tile] = upload.second;
+				layers[upload.second].tile = request.tile;
+				layers[upload.second].lastUsed = frame;
+				tileLoading[request.tile] = false;
+				freeStagingSlots.push_back(request.stagingSlot);
+				const float latency = (float)std::chrono::duration<double, std::milli>(now - request.requested).count();
+				stats.averageLatency = (stats.loads == 0) ? latency : stats.averageLatency * 0.95f + latency * 0.05f;
+				stats.maxLatency = std::max(stats.maxLatency, latency);
+				stats.loads++;
+				requestTimes.erase(request.tile);
+			}
+			uploading.clear();
+			stats.residentTiles = 0;
+			for (auto &layer : layers) {
+				stats.residentTiles += (layer.tile >= 0) ? 1 : 0;
+			}
+		}
+
+		// Copy tiles loaded by the workers into free or least recently used layers
+		void startUploads()
+		{
+			if (!uploading.empty()) {
+				return;
+			}
+			std::vector<Request> batch;
+			{
+				std::lock_guard<std::mutex> lock(requestMutex);
+				batch.swap(loaded);
+			}
+			if (batch.empty()) {
+				return;
+			}
+
+			std::vector<VkImageMemoryBarrier> barriers;
+			std::vector<VkBufferImageCopy> copyRegions;
+			for (auto &request : batch) {
+				// Least recently used layer that's not needed for the current view
+				int32_t target = -1;
+				for (uint32_t i = 0; i < layers.size(); i++) {
+					if ((layers[i].lastUsed < frame) && ((target < 0) || (layers[i].tile < 0 && layers[target].tile >= 0) || ((layers[i].tile >= 0) == (layers[target].tile >= 0) && layers[i].lastUsed < layers[target].lastUsed))) {
+						target = i;
+					}
+				}
+				if (target < 0) {
+					// Budget exhausted by tiles in use, drop the tile
+					std::lock_guard<std::mutex> lock(requestMutex);
+					tileLoading[request.tile] = false;
+					freeStagingSlots.push_back(request.stagingSlot);
+					continue;
+				}
+				if (layers[target].tile >= 0) {
+					tileLayers[layers[target].tile] = -1;
+					stats.evictions++;
+				}
+				layers[target].tile = -1;
+				// Reserve the layer for the rest of this frame
+				layers[target].lastUsed = frame;
+				uploading.push_back(std::make_pair(request, (uint32_t)target));
+
+				VkImageMemoryBarrier barrier = vks::initializers::imageMemoryBarrier();
+				barrier.image = image;
+				barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, (uint32_t)target, 1 };
+				barriers.push_back(barrier);
+
+				VkBufferImageCopy region = {};
+				region.bufferOffset = request.stagingSlot * tileBytes;
+				region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, (uint32_t)target, 1 };
+				region.imageExtent = { header.tileSize + 1, header.tileSize + 1, 1 };
+				copyRegions.push_back(region);
+			}
+			if (uploading.empty()) {
+				return;
+			}
+
+			VK_CHECK_RESULT(vkResetFences(device->logicalDevice, 1, &uploadFence));
+			VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+			cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+			VK_CHECK_RESULT(vkBeginCommandBuffer(uploadCmd, &cmdBufInfo));
+			for (auto &barrier : barriers) {
+				barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+				barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+				barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			}
+			vkCmdPipelineBarrier(uploadCmd, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+			vkCmdCopyBufferToImage(uploadCmd, staging.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(copyRegions.size()), copyRegions.data());
+			for (auto &barrier : barriers) {
+				barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+				barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+				barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			}
+			vkCmdPipelineBarrier(uploadCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+			VK_CHECK_RESULT(vkEndCommandBuffer(uploadCmd));
+
+			VkSubmitInfo submitInfo = vks::initializers::submitInfo();
+			submitInfo.commandBufferCount = 1;
+			submitInfo.pCommandBuffers = &uploadCmd;
+			VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, uploadFence));
+		}
+	};
+}
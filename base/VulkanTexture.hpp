@@ -12,6 +12,7 @@
 #include <string>
 #include <fstream>
 #include <vector>
+#include <algorithm>
 
 #include "vulkan/vulkan.h"
 
@@ -745,6 +746,184 @@ namespace vks
 			// Update descriptor image info member that can be used for setting up descriptor sets
 			updateDescriptor();
 		}
+
+		/**
+		* Create a 2D texture array from separate 2D texture files, one array layer per file
+		*
+		* @param filenames Files to load (supports .ktx), all files must have the same dimensions
+		* @param format Vulkan format of the image data stored in the files
+		* @param device Vulkan device to create the texture on
+		* @param copyQueue Queue used for the texture staging copy commands (must support transfer)
+		* @param (Optional) imageUsageFlags Usage flags for the texture's image (defaults to VK_IMAGE_USAGE_SAMPLED_BIT)
+		* @param (Optional) imageLayout Usage layout for the texture (defaults VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+		*
+		* @note Mip levels not present in all files are dropped
+		*/
+		void loadFromFiles(
+			const std::vector<std::string> &filenames,
+			VkFormat format,
+			vks::VulkanDevice *device,
+			VkQueue copyQueue,
+			VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT,
+			VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+		{
+			assert(!filenames.empty());
+
+			std::vector<ktxTexture*> ktxTextures(filenames.size());
+			for (size_t i = 0; i < filenames.size(); i++) {
+				ktxResult result = loadKTXFile(filenames[i], &ktxTextures[i]);
+				assert(result == KTX_SUCCESS);
+			}
+
+			this->device = device;
+			width = ktxTextures[0]->baseWidth;
+			height = ktxTextures[0]->baseHeight;
+			layerCount = static_cast<uint32_t>(filenames.size());
+			mipLevels = ktxTextures[0]->numLevels;
+			VkDeviceSize stagingSize = 0;
+			for (auto ktxTexture : ktxTextures) {
+				assert((ktxTexture->baseWidth == width) && (ktxTexture->baseHeight == height));
+				mipLevels = std::min(mipLevels, (uint32_t)ktxTexture->numLevels);
+				stagingSize += ktxTexture_GetSize(ktxTexture);
+			}
+
+			VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
+			VkMemoryRequirements memReqs;
+
+			// Create a host-visible staging buffer that contains the raw image data of all files
+			VkBuffer stagingBuffer;
+			VkDeviceMemory stagingMemory;
+
+			VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo();
+			bufferCreateInfo.size = stagingSize;
+			bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+			bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
+
+			vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
+			memAllocInfo.allocationSize = memReqs.size;
+			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
+			VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
+
+			// Copy the files one after another into the staging buffer and setup a copy region for each layer and mip level
+			std::vector<VkBufferImageCopy> bufferCopyRegions;
+			uint8_t *data;
+			VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void **)&data));
+			VkDeviceSize fileOffset = 0;
+			for (uint32_t layer = 0; layer < layerCount; layer++)
+			{
+				ktxTexture *ktxTexture = ktxTextures[layer];
+				ktx_size_t ktxTextureSize = ktxTexture_GetSize(ktxTexture);
+				memcpy(data + fileOffset, ktxTexture_GetData(ktxTexture), ktxTextureSize);
+				for (uint32_t level = 0; level < mipLevels; level++)
+				{
+					ktx_size_t offset;
+					KTX_error_code result = ktxTexture_GetImageOffset(ktxTexture, level, 0, 0, &offset);
+					assert(result == KTX_SUCCESS);
+
+					VkBufferImageCopy bufferCopyRegion = {};
+					bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+					bufferCopyRegion.imageSubresource.mipLevel = level;
+					bufferCopyRegion.imageSubresource.baseArrayLayer = layer;
+					bufferCopyRegion.imageSubresource.layerCount = 1;
+					bufferCopyRegion.imageExtent.width = width >> level;
+					bufferCopyRegion.imageExtent.height = height >> level;
+					bufferCopyRegion.imageExtent.depth = 1;
+					bufferCopyRegion.bufferOffset = fileOffset + offset;
+
+					bufferCopyRegions.push_back(bufferCopyRegion);
+				}
+				fileOffset += ktxTextureSize;
+				ktxTexture_Destroy(ktxTexture);
+			}
+			vkUnmapMemory(device->logicalDevice, stagingMemory);
+
+			// Create optimal tiled target image
+			VkImageCreateInfo imageCreateInfo = vks::initializers::imageCreateInfo();
+			imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+			imageCreateInfo.format = format;
+			imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			imageCreateInfo.extent = { width, height, 1 };
+			imageCreateInfo.usage = imageUsageFlags | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+			imageCreateInfo.arrayLayers = layerCount;
+			imageCreateInfo.mipLevels = mipLevels;
+			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
+
+			vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
+			memAllocInfo.allocationSize = memReqs.size;
+			memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
+			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
+
+			VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+
+			VkImageSubresourceRange subresourceRange = {};
+			subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			subresourceRange.baseMipLevel = 0;
+			subresourceRange.levelCount = mipLevels;
+			subresourceRange.layerCount = layerCount;
+
+			vks::tools::setImageLayout(
+				copyCmd,
+				image,
+				VK_IMAGE_LAYOUT_UNDEFINED,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				subresourceRange);
+
+			vkCmdCopyBufferToImage(
+				copyCmd,
+				stagingBuffer,
+				image,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				static_cast<uint32_t>(bufferCopyRegions.size()),
+				bufferCopyRegions.data());
+
+			this->imageLayout = imageLayout;
+			vks::tools::setImageLayout(
+				copyCmd,
+				image,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				imageLayout,
+				subresourceRange);
+
+			device->flushCommandBuffer(copyCmd, copyQueue);
+
+			// Create sampler
+			VkSamplerCreateInfo samplerCreateInfo = vks::initializers::samplerCreateInfo();
+			samplerCreateInfo.magFilter = VK_FILTER_LINEAR;
+			samplerCreateInfo.minFilter = VK_FILTER_LINEAR;
+			samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+			samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+			samplerCreateInfo.addressModeV = samplerCreateInfo.addressModeU;
+			samplerCreateInfo.addressModeW = samplerCreateInfo.addressModeU;
+			samplerCreateInfo.mipLodBias = 0.0f;
+			samplerCreateInfo.maxAnisotropy = device->enabledFeatures.samplerAnisotropy ? device->properties.limits.maxSamplerAnisotropy : 1.0f;
+			samplerCreateInfo.anisotropyEnable = device->enabledFeatures.samplerAnisotropy;
+			samplerCreateInfo.compareOp = VK_COMPARE_OP_NEVER;
+			samplerCreateInfo.minLod = 0.0f;
+			samplerCreateInfo.maxLod = (float)mipLevels;
+			samplerCreateInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+			VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerCreateInfo, nullptr, &sampler));
+
+			// Create image view
+			VkImageViewCreateInfo viewCreateInfo = vks::initializers::imageViewCreateInfo();
+			viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+			viewCreateInfo.format = format;
+			viewCreateInfo.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
+			viewCreateInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, layerCount };
+			viewCreateInfo.image = image;
+			VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCreateInfo, nullptr, &view));
+
+			// Clean up staging resources
+			vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
+			vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
+
+			updateDescriptor();
+		}
 	};
 
 	/** @brief Cube map texture */
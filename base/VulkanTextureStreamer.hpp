@@ -0,0 +1,850 @@
+/*
+* Asynchronous streaming of KTX textures, coarse mips first
+*
+* Copyright (C) 2026 by the colefet/Vulkan contributors
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanDevice.hpp"
+#include "VulkanBuffer.hpp"
+
+namespace vks
+{
+	/**
+	* Streams the mip levels of KTX textures in the background
+	*
+	* load returns right away with only the mip tail (all levels up to settings.mipTailSize) resident. Worker threads read
+	* the finer levels from the file into a host visible staging ring, one level per texture at a time and coarse to fine
+	* across all textures, and update uploads them on the main thread.
+	* As image views can't be changed, a texture's view always starts at its finest resident level (the level the sampler
+	* would otherwise have to be clamped to with a minimum LOD): with every new level the image is reallocated one level
+	* larger, the resident levels are copied over and a new view replaces the old one in the texture's descriptor.
+	* If the memory budget is exceeded the finest levels of textures not marked as used in the current frame are evicted
+	* the same way.
+	*
+	* @note Supports 2D textures and 2D texture arrays in KTX 1 files (.ktx), reads the files directly (no Android asset support)
+	*/
+	class TextureStreamer
+	{
+	public:
+		typedef uint32_t Handle;
+
+		struct Settings {
+			// Device memory for the texel data of all streamed textures
+			VkDeviceSize memoryBudget = 256 * 1024 * 1024;
+			// Size of the staging ring the workers read levels into, levels larger than this are never streamed in
+			VkDeviceSize stagingSize = 64 * 1024 * 1024;
+			uint32_t workerCount = 2;
+			// Levels up to this size (largest dimension) are loaded synchronously by load and never evicted
+			uint32_t mipTailSize = 128;
+			// Frames that may still use a replaced image before it's destroyed
+			uint32_t framesInFlight = 3;
+		} settings;
+
+		struct Statistics {
+			uint32_t textures = 0;
+			uint32_t pendingLevels = 0;
+			uint64_t loads = 0;
+			uint64_t evictions = 0;
+			VkDeviceSize residentMemory = 0;
+			VkDeviceSize uploadedBytes = 0;
+		} stats;
+
+		/**
+		* Create the staging ring and start the worker threads
+		*
+		* @param device Device used for the streamed textures
+		* @param queue Queue used for uploads, they are ordered with the rendering submitted to this queue
+		*/
+		void prepare(vks::VulkanDevice *device, VkQueue queue)
+		{
+			this->device = device;
+			this->queue = queue;
+
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging, settings.stagingSize));
+			VK_CHECK_RESULT(staging.map());
+			stagingHead = stagingTail = 0;
+			stagingAllocations.clear();
+
+			VkCommandPoolCreateInfo cmdPoolInfo = vks::initializers::commandPoolCreateInfo();
+			cmdPoolInfo.queueFamilyIndex = device->queueFamilyIndices.graphics;
+			cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+			VK_CHECK_RESULT(vkCreateCommandPool(device->logicalDevice, &cmdPoolInfo, nullptr, &commandPool));
+			VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+			VK_CHECK_RESULT(vkAllocateCommandBuffers(device->logicalDevice, &cmdBufAllocateInfo, &uploadCmd));
+			VkFenceCreateInfo fenceInfo = vks::initializers::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
+			VK_CHECK_RESULT(vkCreateFence(device->logicalDevice, &fenceInfo, nullptr, &uploadFence));
+
+			stats = Statistics();
+			stop = false;
+			for (uint32_t i = 0; i < std::max(1u, settings.workerCount); i++) {
+				workers.push_back(std::thread(&TextureStreamer::workerLoop, this));
+			}
+		}
+
+		/**
+		* Load the mip tail of a texture and queue its finer levels for streaming
+		*
+		* @param filename KTX file to load
+		* @param format Vulkan format of the image data stored in the file
+		*
+		* @return Handle of the texture, its descriptor is valid right away
+		*/
+		Handle load(const std::string &filename, VkFormat format)
+		{
+			Texture texture;
+			texture.format = format;
+			if (!openTexture(filename, texture)) {
+				vks::tools::exitFatal("Could not load texture from " + filename + "\n\nThe file may be part of the additional asset pack.\n\nRun \"download_assets.py\" in the repository root to download the latest version.", -1);
+			}
+
+			// Mip tail
+			uint32_t tailLevel = texture.mipLevels - 1;
+			while ((tailLevel > 0) && (std::max(texture.levels[tailLevel - 1].width, texture.levels[tailLevel - 1].height) <= settings.mipTailSize)) {
+				tailLevel--;
+			}
+			texture.tailLevel = tailLevel;
+			// Levels that don't fit into the staging ring can't be streamed
+			texture.minLevel = 0;
+			while ((texture.minLevel < tailLevel) && (texture.levels[texture.minLevel].size > settings.stagingSize)) {
+				texture.minLevel++;
+			}
+			texture.desiredLevel = texture.minLevel;
+
+			VkDeviceSize tailSize = 0;
+			for (uint32_t level = tailLevel; level < texture.mipLevels; level++) {
+				tailSize += texture.levels[level].size;
+			}
+			vks::Buffer tailStaging;
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &tailStaging, tailSize));
+			VK_CHECK_RESULT(tailStaging.map());
+			std::vector<VkBufferImageCopy> copyRegions;
+			VkDeviceSize offset = 0;
+			for (uint32_t level = tailLevel; level < texture.mipLevels; level++) {
+				readFile(texture.file, texture.levels[level].fileOffset, (uint8_t*)tailStaging.mapped + offset, texture.levels[level].size);
+				copyRegions.push_back(levelCopyRegion(texture, level, level - tailLevel, offset));
+				offset += texture.levels[level].size;
+			}
+
+			texture.resident = createImage(texture, tailLevel);
+			VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, texture.mipLevels - tailLevel, 0, texture.layerCount };
+			vks::tools::setImageLayout(copyCmd, texture.resident.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, range);
+			vkCmdCopyBufferToImage(copyCmd, tailStaging.buffer, texture.resident.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(copyRegions.size()), copyRegions.data());
+			vks::tools::setImageLayout(copyCmd, texture.resident.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, range);
+			device->flushCommandBuffer(copyCmd, queue, true);
+			tailStaging.destroy();
+			createView(texture, texture.resident);
+
+			VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+			samplerCI.magFilter = VK_FILTER_LINEAR;
+			samplerCI.minFilter = VK_FILTER_LINEAR;
+			samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+			samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+			samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+			samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+			samplerCI.compareOp = VK_COMPARE_OP_NEVER;
+			samplerCI.minLod = 0.0f;
+			samplerCI.maxLod = (float)texture.mipLevels;
+			samplerCI.maxAnisotropy = device->enabledFeatures.samplerAnisotropy ? device->properties.limits.maxSamplerAnisotropy : 1.0f;
+			samplerCI.anisotropyEnable = device->enabledFeatures.samplerAnisotropy;
+			samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+			VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerCI, nullptr, &texture.sampler));
+			texture.descriptor = { texture.sampler, texture.resident.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+			texture.lastUsed = frame;
+
+			textures.push_back(texture);
+			stats.textures = static_cast<uint32_t>(textures.size());
+			return static_cast<Handle>(textures.size() - 1);
+		}
+
+		/** @brief Descriptor of the texture's current view, changes whenever update returns true */
+		const VkDescriptorImageInfo &getDescriptor(Handle handle) const
+		{
+			return textures[handle].descriptor;
+		}
+
+		/** @brief Finest mip level (of the file) that's resident, it's the view's first level */
+		uint32_t getResidentLevel(Handle handle) const
+		{
+			return textures[handle].resident.firstLevel;
+		}
+
+		uint32_t getMipLevels(Handle handle) const
+		{
+			return textures[handle].mipLevels;
+		}
+
+		uint32_t getLayerCount(Handle handle) const
+		{
+			return textures[handle].layerCount;
+		}
+
+		/** @brief Finest mip level to stream in, coarser levels free memory for other textures (defaults to 0) */
+		void setDesiredLevel(Handle handle, uint32_t level)
+		{
+			Texture &texture = textures[handle];
+			texture.desiredLevel = std::min(std::max(level, texture.minLevel), texture.tailLevel);
+		}
+
+		/** @brief Mark a texture as used by the current frame, its levels won't be evicted in this frame */
+		void markUsed(Handle handle)
+		{
+			textures[handle].lastUsed = frame;
+		}
+
+		/** @brief True if all textures have their desired levels resident */
+		bool isComplete() const
+		{
+			for (auto &texture : textures) {
+				if (texture.busy || (texture.resident.firstLevel != texture.desiredLevel)) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		/**
+		* Swap in uploaded levels, request and upload further levels and evict levels over the budget, call once per frame
+		* before recording and submitting
+		*
+		* @return True if texture descriptors changed, descriptor sets using them have to be updated
+		*
+		* @note Replaced images are destroyed settings.framesInFlight calls later
+		*/
+		bool update()
+		{
+			frame++;
+			destroyRetired(false);
+			bool changed = finishUploads();
+
+			// Levels to load, coarse to fine across all textures
+			std::vector<Handle> candidates;
+			for (Handle i = 0; i < textures.size(); i++) {
+				const Texture &texture = textures[i];
+				if (!texture.busy && (texture.resident.firstLevel > texture.desiredLevel)) {
+					candidates.push_back(i);
+				}
+			}
+			std::sort(candidates.begin(), candidates.end(), [this](Handle a, Handle b) {
+				return textures[a].levels[textures[a].resident.firstLevel - 1].size < textures[b].levels[textures[b].resident.firstLevel - 1].size;
+			});
+
+			{
+				std::lock_guard<std::mutex> lock(requestMutex);
+				VkDeviceSize projectedMemory = getProjectedMemory();
+				for (auto handle : candidates) {
+					Texture &texture = textures[handle];
+					const uint32_t level = texture.resident.firstLevel - 1;
+					const VkDeviceSize size = texture.levels[level].size;
+					// Make room by evicting the finest levels of textures not used in this frame
+					while (projectedMemory + size > settings.memoryBudget) {
+						const VkDeviceSize freed = evictLeastRecentlyUsed(handle);
+						if (freed == 0) {
+							break;
+						}
+						projectedMemory -= freed;
+					}
+					if (projectedMemory + size > settings.memoryBudget) {
+						break;
+					}
+					VkDeviceSize stagingOffset;
+					if (!allocateStaging(size, stagingOffset)) {
+						break;
+					}
+					Request request;
+					request.texture = handle;
+					request.level = level;
+					request.file = texture.file;
+					request.fileOffset = texture.levels[level].fileOffset;
+					request.size = size;
+					request.stagingOffset = stagingOffset;
+					requests.push_back(request);
+					texture.busy = true;
+					projectedMemory += size;
+				}
+				stats.pendingLevels = static_cast<uint32_t>(requests.size() + loaded.size() + uploading.size());
+			}
+			requestCondition.notify_all();
+
+			// Textures asked to drop levels
+			for (Handle i = 0; i < textures.size(); i++) {
+				Texture &texture = textures[i];
+				if (!texture.busy && (texture.resident.firstLevel < texture.desiredLevel)) {
+					evictions.push_back(i);
+					texture.busy = true;
+				}
+			}
+
+			startUploads();
+			return changed;
+		}
+
+		/** @brief Stop the workers and release all resources, the textures must not be in use by the GPU anymore */
+		void destroy()
+		{
+			if (!device) {
+				return;
+			}
+			{
+				std::lock_guard<std::mutex> lock(requestMutex);
+				stop = true;
+			}
+			requestCondition.notify_all();
+			for (auto &worker : workers) {
+				worker.join();
+			}
+			workers.clear();
+			vkWaitForFences(device->logicalDevice, 1, &uploadFence, VK_TRUE, UINT64_MAX);
+			for (auto &upload : uploading) {
+				retire(upload.resident);
+			}
+			uploading.clear();
+			destroyRetired(true);
+			for (auto &texture : textures) {
+				destroyResident(texture.resident);
+				vkDestroySampler(device->logicalDevice, texture.sampler, nullptr);
+				closeFile(texture.file);
+			}
+			textures.clear();
+			vkDestroyFence(device->logicalDevice, uploadFence, nullptr);
+			vkDestroyCommandPool(device->logicalDevice, commandPool, nullptr);
+			staging.destroy();
+			device = nullptr;
+		}
+
+		~TextureStreamer()
+		{
+			destroy();
+		}
+
+	private:
+#if defined(_WIN32)
+		typedef HANDLE FileHandle;
+#else
+		typedef int FileHandle;
+#endif
+
+		/** @brief KTX 1 file header */
+		struct KTXHeader {
+			uint8_t identifier[12];
+			uint32_t endianness;
+			uint32_t glType;
+			uint32_t glTypeSize;
+			uint32_t glFormat;
+			uint32_t glInternalFormat;
+			uint32_t glBaseInternalFormat;
+			uint32_t pixelWidth;
+			uint32_t pixelHeight;
+			uint32_t pixelDepth;
+			uint32_t numberOfArrayElements;
+			uint32_t numberOfFaces;
+			uint32_t numberOfMipmapLevels;
+			uint32_t bytesOfKeyValueData;
+		};
+
+		struct Level {
+			uint64_t fileOffset;
+			// All layers of the level
+			VkDeviceSize size;
+			uint32_t width;
+			uint32_t height;
+		};
+
+		/** @brief Image containing the levels firstLevel to mipLevels - 1 of a texture */
+		struct Resident {
+			VkImage image = VK_NULL_HANDLE;
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkImageView view = VK_NULL_HANDLE;
+			uint32_t firstLevel = 0;
+			VkDeviceSize size = 0;
+		};
+
+		struct Texture {
+			FileHandle file;
+			VkFormat format;
+			uint32_t width;
+			uint32_t height;
+			uint32_t layerCount;
+			bool array;
+			uint32_t mipLevels;
+			std::vector<Level> levels;
+			// First level of the mip tail, first level that fits into the staging ring and first level to stream in
+			uint32_t tailLevel;
+			uint32_t minLevel;
+			uint32_t desiredLevel;
+			Resident resident;
+			VkSampler sampler;
+			VkDescriptorImageInfo descriptor;
+			uint64_t lastUsed;
+			// A level is being loaded or evicted
+			bool busy = false;
+		};
+
+		struct Request {
+			Handle texture;
+			uint32_t level;
+			FileHandle file;
+			uint64_t fileOffset;
+			VkDeviceSize size;
+			VkDeviceSize stagingOffset;
+		};
+
+		/** @brief Image replacing the resident one of a texture once the upload has finished */
+		struct Upload {
+			Handle texture;
+			Resident resident;
+			// Staging range of a loaded level (size is 0 for evictions)
+			VkDeviceSize stagingOffset;
+			VkDeviceSize size;
+		};
+
+		struct StagingAllocation {
+			VkDeviceSize offset;
+			VkDeviceSize size;
+			bool released;
+		};
+
+		struct Retired {
+			Resident resident;
+			uint64_t frame;
+		};
+
+		vks::VulkanDevice *device = nullptr;
+		VkQueue queue = VK_NULL_HANDLE;
+		uint64_t frame = 0;
+		std::vector<Texture> textures;
+
+		// Ring of staging memory, released in allocation order
+		vks::Buffer staging;
+		VkDeviceSize stagingHead = 0;
+		VkDeviceSize stagingTail = 0;
+		std::deque<StagingAllocation> stagingAllocations;
+
+		// Requests are consumed by the workers, loaded levels are handed back for upload
+		std::vector<std::thread> workers;
+		std::mutex requestMutex;
+		std::condition_variable requestCondition;
+		std::deque<Request> requests;
+		std::vector<Request> loaded;
+		bool stop = false;
+
+		// Textures to shrink by one level in the next upload
+		std::vector<Handle> evictions;
+
+		VkCommandPool commandPool = VK_NULL_HANDLE;
+		VkCommandBuffer uploadCmd = VK_NULL_HANDLE;
+		VkFence uploadFence = VK_NULL_HANDLE;
+		std::vector<Upload> uploading;
+		std::vector<Retired> retired;
+
+		bool openTexture(const std::string &filename, Texture &texture)
+		{
+#if defined(_WIN32)
+			texture.file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (texture.file == INVALID_HANDLE_VALUE) {
+				return false;
+			}
+#else
+			texture.file = ::open(filename.c_str(), O_RDONLY);
+			if (texture.file < 0) {
+				return false;
+			}
+#endif
+			static const uint8_t identifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+			KTXHeader header;
+			if (!readFile(texture.file, 0, &header, sizeof(header)) || (memcmp(header.identifier, identifier, sizeof(identifier)) != 0) || (header.endianness != 0x04030201)) {
+				closeFile(texture.file);
+				return false;
+			}
+			// Cube maps and 3D textures are not supported
+			if ((header.numberOfFaces != 1) || (header.pixelDepth > 1)) {
+				closeFile(texture.file);
+				return false;
+			}
+
+			texture.width = header.pixelWidth;
+			texture.height = std::max(header.pixelHeight, 1u);
+			texture.array = header.numberOfArrayElements > 0;
+			texture.layerCount = std::max(header.numberOfArrayElements, 1u);
+			texture.mipLevels = std::max(header.numberOfMipmapLevels, 1u);
+
+			// Every level is prefixed by its size and padded to 4 bytes
+			uint64_t offset = sizeof(KTXHeader) + header.bytesOfKeyValueData;
+			texture.levels.resize(texture.mipLevels);
+			for (uint32_t level = 0; level < texture.mipLevels; level++) {
+				uint32_t imageSize;
+				if (!readFile(texture.file, offset, &imageSize, sizeof(imageSize))) {
+					closeFile(texture.file);
+					return false;
+				}
+				texture.levels[level].fileOffset = offset + sizeof(uint32_t);
+				texture.levels[level].size = imageSize;
+				texture.levels[level].width = std::max(texture.width >> level, 1u);
+				texture.levels[level].height = std::max(texture.height >> level, 1u);
+				offset += sizeof(uint32_t) + ((imageSize + 3) & ~3);
+			}
+			return true;
+		}
+
+		static bool readFile(FileHandle file, uint64_t offset, void *dst, uint64_t size)
+		{
+#if defined(_WIN32)
+			OVERLAPPED overlapped = {};
+			overlapped.Offset = (DWORD)(offset & 0xFFFFFFFF);
+			overlapped.OffsetHigh = (DWORD)(offset >> 32);
+			DWORD bytesRead = 0;
+			return ReadFile(file, dst, (DWORD)size, &bytesRead, &overlapped) && (bytesRead == size);
+#else
+			uint8_t *data = (uint8_t*)dst;
+			while (size > 0) {
+				ssize_t bytesRead = pread(file, data, size, offset);
+				if (bytesRead <= 0) {
+					return false;
+				}
+				data += bytesRead;
+				offset += bytesRead;
+				size -= bytesRead;
+			}
+			return true;
+#endif
+		}
+
+		static void closeFile(FileHandle file)
+		{
+#if defined(_WIN32)
+			CloseHandle(file);
+#else
+			close(file);
+#endif
+		}
+
+		void workerLoop()
+		{
+			while (true) {
+				Request request;
+				{
+					std::unique_lock<std::mutex> lock(requestMutex);
+					requestCondition.wait(lock, [this] { return stop || !requests.empty(); });
+					if (stop) {
+						return;
+					}
+					request = requests.front();
+					requests.pop_front();
+				}
+				// Positional reads, so workers don't need to share a file offset
+				readFile(request.file, request.fileOffset, (uint8_t*)staging.mapped + request.stagingOffset, request.size);
+				std::lock_guard<std::mutex> lock(requestMutex);
+				loaded.push_back(request);
+			}
+		}
+
+		VkBufferImageCopy levelCopyRegion(const Texture &texture, uint32_t level, uint32_t mipLevel, VkDeviceSize bufferOffset)
+		{
+			// Layers of a level are stored one after another
+			VkBufferImageCopy region = {};
+			region.bufferOffset = bufferOffset;
+			region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, mipLevel, 0, texture.layerCount };
+			region.imageExtent = { texture.levels[level].width, texture.levels[level].height, 1 };
+			return region;
+		}
+
+		Resident createImage(const Texture &texture, uint32_t firstLevel)
+		{
+			Resident resident;
+			resident.firstLevel = firstLevel;
+			for (uint32_t level = firstLevel; level < texture.mipLevels; level++) {
+				resident.size += texture.levels[level].size;
+			}
+
+			VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+			imageCI.imageType = VK_IMAGE_TYPE_2D;
+			imageCI.format = texture.format;
+			imageCI.extent = { texture.levels[firstLevel].width, texture.levels[firstLevel].height, 1 };
+			imageCI.mipLevels = texture.mipLevels - firstLevel;
+			imageCI.arrayLayers = texture.layerCount;
+			imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+			// Source of the copy into the next image
+			imageCI.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+			imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCI, nullptr, &resident.image));
+			VkMemoryRequirements memReqs;
+			vkGetImageMemoryRequirements(device->logicalDevice, resident.image, &memReqs);
+			VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+			memAlloc.allocationSize = memReqs.size;
+			memAlloc.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAlloc, nullptr, &resident.memory));
+			VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, resident.image, resident.memory, 0));
+			return resident;
+		}
+
+		void createView(const Texture &texture, Resident &resident)
+		{
+			VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+			viewCI.image = resident.image;
+			viewCI.viewType = texture.array ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+			viewCI.format = texture.format;
+			viewCI.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
+			viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, texture.mipLevels - resident.firstLevel, 0, texture.layerCount };
+			VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCI, nullptr, &resident.view));
+		}
+
+		void destroyResident(Resident &resident)
+		{
+			if (resident.view != VK_NULL_HANDLE) {
+				vkDestroyImageView(device->logicalDevice, resident.view, nullptr);
+			}
+			vkDestroyImage(device->logicalDevice, resident.image, nullptr);
+			vkFreeMemory(device->logicalDevice, resident.memory, nullptr);
+			resident = Resident();
+		}
+
+		void retire(const Resident &resident)
+		{
+			Retired entry = { resident, frame };
+			retired.push_back(entry);
+		}
+
+		void destroyRetired(bool all)
+		{
+			for (auto it = retired.begin(); it != retired.end();) {
+				if (all || (frame >= it->frame + settings.framesInFlight)) {
+					destroyResident(it->resident);
+					it = retired.erase(it);
+				}
+				else {
+					++it;
+				}
+			}
+		}
+
+		// Resident memory once all uploads in flight and pending requests have finished, requestMutex must be held
+		VkDeviceSize getProjectedMemory()
+		{
+			VkDeviceSize size = 0;
+			for (auto &texture : textures) {
+				size += texture.resident.size;
+			}
+			stats.residentMemory = size;
+			for (auto &upload : uploading) {
+				size += upload.resident.size - textures[upload.texture].resident.size;
+			}
+			for (auto &request : requests) {
+				size += request.size;
+			}
+			for (auto &request : loaded) {
+				size += request.size;
+			}
+			for (auto handle : evictions) {
+				size -= textures[handle].levels[textures[handle].resident.firstLevel].size;
+			}
+			return size;
+		}
+
+		// Queue the eviction of the finest level of the least recently used texture that's not used in this frame, returns the freed size
+		VkDeviceSize evictLeastRecentlyUsed(Handle requester)
+		{
+			int32_t victim = -1;
+			for (Handle i = 0; i < textures.size(); i++) {
+				const Texture &texture = textures[i];
+				if ((i == requester) || texture.busy || (texture.lastUsed >= frame) || (texture.resident.firstLevel >= texture.tailLevel)) {
+					continue;
+				}
+				if ((victim < 0) || (texture.lastUsed < textures[victim].lastUsed)) {
+					victim = i;
+				}
+			}
+			if (victim < 0) {
+				return 0;
+			}
+			textures[victim].busy = true;
+			evictions.push_back(victim);
+			return textures[victim].levels[textures[victim].resident.firstLevel].size;
+		}
+
+		bool allocateStaging(VkDeviceSize size, VkDeviceSize &offset)
+		{
+			// Copy offsets have to be a multiple of the texel block size
+			size = (size + 15) & ~(VkDeviceSize)15;
+			if (size > staging.size) {
+				return false;
+			}
+			if (stagingAllocations.empty()) {
+				stagingHead = stagingTail = 0;
+			}
+			if (stagingHead >= stagingTail) {
+				if (stagingHead + size <= staging.size) {
+					offset = stagingHead;
+				}
+				else if ((size < stagingTail) || stagingAllocations.empty()) {
+					// Wrap around, the end of the ring stays unused until the tail passes it
+					offset = 0;
+				}
+				else {
+					return false;
+				}
+			}
+			else if (stagingHead + size < stagingTail) {
+				offset = stagingHead;
+			}
+			else {
+				return false;
+			}
+			stagingHead = offset + size;
+			StagingAllocation allocation = { offset, size, false };
+			stagingAllocations.push_back(allocation);
+			return true;
+		}
+
+		void releaseStaging(VkDeviceSize offset)
+		{
+			for (auto &allocation : stagingAllocations) {
+				if (allocation.offset == offset && !allocation.released) {
+					allocation.released = true;
+					break;
+				}
+			}
+			while (!stagingAllocations.empty() && stagingAllocations.front().released) {
+				stagingTail = stagingAllocations.front().offset + stagingAllocations.front().size;
+				stagingAllocations.pop_front();
+			}
+		}
+
+		// Replace the images of textures with the uploaded ones
+		bool finishUploads()
+		{
+			if (uploading.empty() || (vkGetFenceStatus(device->logicalDevice, uploadFence) != VK_SUCCESS)) {
+				return false;
+			}
+			for (auto &upload : uploading) {
+				Texture &texture = textures[upload.texture];
+				retire(texture.resident);
+				texture.resident = upload.resident;
+				createView(texture, texture.resident);
+				texture.descriptor.imageView = texture.resident.view;
+				texture.busy = false;
+				if (upload.size > 0) {
+					releaseStaging(upload.stagingOffset);
+					stats.loads++;
+					stats.uploadedBytes += upload.size;
+				}
+				else {
+					stats.evictions++;
+				}
+			}
+			uploading.clear();
+			return true;
+		}
+
+		// Copy loaded levels and the resident levels into new images, evicted levels are left out
+		void startUploads()
+		{
+			if (!uploading.empty()) {
+				return;
+			}
+			std::vector<Request> batch;
+			{
+				std::lock_guard<std::mutex> lock(requestMutex);
+				batch.swap(loaded);
+			}
+			if (batch.empty() && evictions.empty()) {
+				return;
+			}
+
+			VK_CHECK_RESULT(vkResetFences(device->logicalDevice, 1, &uploadFence));
+			VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+			cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+			VK_CHECK_RESULT(vkBeginCommandBuffer(uploadCmd, &cmdBufInfo));
+
+			for (auto &request : batch) {
+				Upload upload = { request.texture, createImage(textures[request.texture], request.level), request.stagingOffset, request.size };
+				uploading.push_back(upload);
+			}
+			for (auto handle : evictions) {
+				Upload upload = { handle, createImage(textures[handle], textures[handle].resident.firstLevel + 1), 0, 0 };
+				uploading.push_back(upload);
+			}
+			evictions.clear();
+
+			// Old images are read while they're still in use by frames, so they're transitioned back after the copy
+			std::vector<VkImageMemoryBarrier> barriers;
+			for (auto &upload : uploading) {
+				const Texture &texture = textures[upload.texture];
+				VkImageMemoryBarrier barrier = vks::initializers::imageMemoryBarrier();
+				barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+				barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+				barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+				barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+				barrier.image = texture.resident.image;
+				barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, texture.mipLevels - texture.resident.firstLevel, 0, texture.layerCount };
+				barriers.push_back(barrier);
+				barrier.srcAccessMask = 0;
+				barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+				barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+				barrier.image = upload.resident.image;
+				barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, texture.mipLevels - upload.resident.firstLevel, 0, texture.layerCount };
+				barriers.push_back(barrier);
+			}
+			vkCmdPipelineBarrier(uploadCmd, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+
+			for (auto &upload : uploading) {
+				const Texture &texture = textures[upload.texture];
+				const uint32_t oldFirst = texture.resident.firstLevel;
+				const uint32_t newFirst = upload.resident.firstLevel;
+				std::vector<VkImageCopy> copyRegions;
+				for (uint32_t level = std::max(oldFirst, newFirst); level < texture.mipLevels; level++) {
+					VkImageCopy region = {};
+					region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level - oldFirst, 0, texture.layerCount };
+					region.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level - newFirst, 0, texture.layerCount };
+					region.extent = { texture.levels[level].width, texture.levels[level].height, 1 };
+					copyRegions.push_back(region);
+				}
+				vkCmdCopyImage(uploadCmd, texture.resident.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, upload.resident.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(copyRegions.size()), copyRegions.data());
+				if (upload.size > 0) {
+					VkBufferImageCopy region = levelCopyRegion(texture, newFirst, 0, upload.stagingOffset);
+					vkCmdCopyBufferToImage(uploadCmd, staging.buffer, upload.resident.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+				}
+			}
+
+			for (size_t i = 0; i < barriers.size(); i++) {
+				VkImageMemoryBarrier &barrier = barriers[i];
+				barrier.srcAccessMask = (i % 2 == 0) ? VK_ACCESS_TRANSFER_READ_BIT : VK_ACCESS_TRANSFER_WRITE_BIT;
+				barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+				barrier.oldLayout = (i % 2 == 0) ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+				barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			}
+			vkCmdPipelineBarrier(uploadCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+			VK_CHECK_RESULT(vkEndCommandBuffer(uploadCmd));
+
+			VkSubmitInfo submitInfo = vks::initializers::submitInfo();
+			submitInfo.commandBufferCount = 1;
+			submitInfo.pCommandBuffers = &uploadCmd;
+			VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, uploadFence));
+		}
+	};
+}
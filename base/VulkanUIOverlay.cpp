@@ -230,8 +230,104 @@ namespace vks
 		vkUpdateDescriptorSets(device->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 	}
 
+	/** Prepare the render pass that draws the UI overlay on top of the application's output */
+	void UIOverlay::prepareRenderPass(VkFormat colorFormat)
+	{
+		// Loads and keeps the contents rendered by the application, the image is in present layout before and after
+		VkAttachmentDescription attachment = {};
+		attachment.format = colorFormat;
+		attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachment.initialLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+		VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+
+		VkSubpassDescription subpassDescription = {};
+		subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpassDescription.colorAttachmentCount = 1;
+		subpassDescription.pColorAttachments = &colorReference;
+
+		std::array<VkSubpassDependency, 2> dependencies;
+
+		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[0].dstSubpass = 0;
+		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+		dependencies[1].srcSubpass = 0;
+		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+		dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+		dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+		VkRenderPassCreateInfo renderPassInfo = vks::initializers::renderPassCreateInfo();
+		renderPassInfo.attachmentCount = 1;
+		renderPassInfo.pAttachments = &attachment;
+		renderPassInfo.subpassCount = 1;
+		renderPassInfo.pSubpasses = &subpassDescription;
+		renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+		renderPassInfo.pDependencies = dependencies.data();
+		VK_CHECK_RESULT(vkCreateRenderPass(device->logicalDevice, &renderPassInfo, nullptr, &renderPass));
+
+		// Command buffers for the overlay are allocated from a separate pool, so the application's command buffers are not affected
+		VkCommandPoolCreateInfo cmdPoolInfo = vks::initializers::commandPoolCreateInfo();
+		cmdPoolInfo.queueFamilyIndex = device->queueFamilyIndices.graphics;
+		cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		VK_CHECK_RESULT(vkCreateCommandPool(device->logicalDevice, &cmdPoolInfo, nullptr, &commandPool));
+
+		for (auto &frame : frames) {
+			VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(commandPool, VK_COMMAND_BUFFER_LEVEL_SECONDARY, 1);
+			VK_CHECK_RESULT(vkAllocateCommandBuffers(device->logicalDevice, &cmdBufAllocateInfo, &frame.commandBuffer));
+		}
+	}
+
+	/** (Re)create the frame buffers for the swap chain images the overlay is drawn to */
+	void UIOverlay::setupFrameBuffers(const std::vector<VkImageView> &views, uint32_t width, uint32_t height)
+	{
+		for (auto &frameBuffer : frameBuffers) {
+			vkDestroyFramebuffer(device->logicalDevice, frameBuffer, nullptr);
+		}
+		extent = { width, height };
+		frameBuffers.resize(views.size());
+		for (size_t i = 0; i < views.size(); i++) {
+			VkFramebufferCreateInfo frameBufferCreateInfo = vks::initializers::framebufferCreateInfo();
+			frameBufferCreateInfo.renderPass = renderPass;
+			frameBufferCreateInfo.attachmentCount = 1;
+			frameBufferCreateInfo.pAttachments = &views[i];
+			frameBufferCreateInfo.width = width;
+			frameBufferCreateInfo.height = height;
+			frameBufferCreateInfo.layers = 1;
+			VK_CHECK_RESULT(vkCreateFramebuffer(device->logicalDevice, &frameBufferCreateInfo, nullptr, &frameBuffers[i]));
+		}
+
+		// The number of swap chain images may change
+		while (presentCommandBuffers.size() < views.size()) {
+			PresentCommandBuffer presentCommandBuffer;
+			VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+			VK_CHECK_RESULT(vkAllocateCommandBuffers(device->logicalDevice, &cmdBufAllocateInfo, &presentCommandBuffer.commandBuffer));
+			VkFenceCreateInfo fenceCreateInfo = vks::initializers::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
+			VK_CHECK_RESULT(vkCreateFence(device->logicalDevice, &fenceCreateInfo, nullptr, &presentCommandBuffer.fence));
+			VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
+			VK_CHECK_RESULT(vkCreateSemaphore(device->logicalDevice, &semaphoreCreateInfo, nullptr, &presentCommandBuffer.semaphore));
+			presentCommandBuffers.push_back(presentCommandBuffer);
+		}
+		// Command buffers reference the old frame buffers
+		for (auto &presentCommandBuffer : presentCommandBuffers) {
+			presentCommandBuffer.frameIndex = UINT32_MAX;
+		}
+	}
+
 	/** Prepare a separate pipeline for the UI overlay rendering decoupled from the main application */
-	void UIOverlay::preparePipeline(const VkPipelineCache pipelineCache, const VkRenderPass renderPass)
+	void UIOverlay::preparePipeline(const VkPipelineCache pipelineCache)
 	{
 		// Pipeline layout
 		// Push constants for UI rendering parameters
@@ -269,7 +365,7 @@ namespace vks
 			vks::initializers::pipelineViewportStateCreateInfo(1, 1, 0);
 
 		VkPipelineMultisampleStateCreateInfo multisampleState =
-			vks::initializers::pipelineMultisampleStateCreateInfo(rasterizationSamples);
+			vks::initializers::pipelineMultisampleStateCreateInfo(VK_SAMPLE_COUNT_1_BIT);
 
 		std::vector<VkDynamicState> dynamicStateEnables = {
 			VK_DYNAMIC_STATE_VIEWPORT,
@@ -289,7 +385,6 @@ namespace vks
 		pipelineCreateInfo.pDynamicState = &dynamicState;
 		pipelineCreateInfo.stageCount = static_cast<uint32_t>(shaders.size());
 		pipelineCreateInfo.pStages = shaders.data();
-		pipelineCreateInfo.subpass = subpass;
 
 		// Vertex bindings an attributes based on ImGui vertex definition
 		std::vector<VkVertexInputBindingDescription> vertexInputBindings = {
@@ -311,62 +406,79 @@ namespace vks
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device->logicalDevice, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipeline));
 	}
 
-	/** Update vertex and index buffer containing the imGui elements when required */
+	/** Update vertex and index buffer containing the imGui elements and record the overlay draw commands */
 	bool UIOverlay::update()
 	{
 		ImDrawData* imDrawData = ImGui::GetDrawData();
-		bool updateCmdBuffers = false;
 
 		if (!imDrawData) { return false; };
 
+		// Write to the frame not used by the last update, as that one may still be in use by the GPU
+		const uint32_t index = (frameIndex + 1) % maxFramesInFlight;
+		Frame &frame = frames[index];
+		for (auto &presentCommandBuffer : presentCommandBuffers) {
+			if (presentCommandBuffer.frameIndex == index) {
+				VK_CHECK_RESULT(vkWaitForFences(device->logicalDevice, 1, &presentCommandBuffer.fence, VK_TRUE, UINT64_MAX));
+				// Re-recording the secondary command buffer invalidates the primary command buffers executing it
+				presentCommandBuffer.frameIndex = UINT32_MAX;
+			}
+		}
+
 		// Note: Alignment is done inside buffer creation
 		VkDeviceSize vertexBufferSize = imDrawData->TotalVtxCount * sizeof(ImDrawVert);
 		VkDeviceSize indexBufferSize = imDrawData->TotalIdxCount * sizeof(ImDrawIdx);
 
-		// Update buffers only if vertex or index count has been changed compared to current buffer size
-		if ((vertexBufferSize == 0) || (indexBufferSize == 0)) {
-			return false;
-		}
-
-		// Vertex buffer
-		if ((vertexBuffer.buffer == VK_NULL_HANDLE) || (vertexCount != imDrawData->TotalVtxCount)) {
-			vertexBuffer.unmap();
-			vertexBuffer.destroy();
-			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &vertexBuffer, vertexBufferSize));
-			vertexCount = imDrawData->TotalVtxCount;
-			vertexBuffer.unmap();
-			vertexBuffer.map();
-			updateCmdBuffers = true;
+		// Buffers grow geometrically and are never shrunk, so they're only recreated a few times while the UI changes
+		if (frame.vertexBuffer.size < vertexBufferSize) {
+			VkDeviceSize size = std::max(vertexBufferSize, frame.vertexBuffer.size * 2);
+			frame.vertexBuffer.destroy();
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &frame.vertexBuffer, size));
+			frame.vertexBuffer.map();
 		}
-
-		// Index buffer
-		VkDeviceSize indexSize = imDrawData->TotalIdxCount * sizeof(ImDrawIdx);
-		if ((indexBuffer.buffer == VK_NULL_HANDLE) || (indexCount < imDrawData->TotalIdxCount)) {
-			indexBuffer.unmap();
-			indexBuffer.destroy();
-			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &indexBuffer, indexBufferSize));
-			indexCount = imDrawData->TotalIdxCount;
-			indexBuffer.map();
-			updateCmdBuffers = true;
+		if (frame.indexBuffer.size < indexBufferSize) {
+			VkDeviceSize size = std::max(indexBufferSize, frame.indexBuffer.size * 2);
+			frame.indexBuffer.destroy();
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &frame.indexBuffer, size));
+			frame.indexBuffer.map();
 		}
 
 		// Upload data
-		ImDrawVert* vtxDst = (ImDrawVert*)vertexBuffer.mapped;
-		ImDrawIdx* idxDst = (ImDrawIdx*)indexBuffer.mapped;
-
-		for (int n = 0; n < imDrawData->CmdListsCount; n++) {
-			const ImDrawList* cmd_list = imDrawData->CmdLists[n];
-			memcpy(vtxDst, cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
-			memcpy(idxDst, cmd_list->IdxBuffer.Data, cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx));
-			vtxDst += cmd_list->VtxBuffer.Size;
-			idxDst += cmd_list->IdxBuffer.Size;
+		if ((vertexBufferSize > 0) && (indexBufferSize > 0)) {
+			ImDrawVert* vtxDst = (ImDrawVert*)frame.vertexBuffer.mapped;
+			ImDrawIdx* idxDst = (ImDrawIdx*)frame.indexBuffer.mapped;
+
+			for (int n = 0; n < imDrawData->CmdListsCount; n++) {
+				const ImDrawList* cmd_list = imDrawData->CmdLists[n];
+				memcpy(vtxDst, cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
+				memcpy(idxDst, cmd_list->IdxBuffer.Data, cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx));
+				vtxDst += cmd_list->VtxBuffer.Size;
+				idxDst += cmd_list->IdxBuffer.Size;
+			}
+
+			// Flush to make writes visible to GPU
+			frame.vertexBuffer.flush();
+			frame.indexBuffer.flush();
 		}
 
-		// Flush to make writes visible to GPU
-		vertexBuffer.flush();
-		indexBuffer.flush();
+		frameIndex = index;
+
+		// Record the draw commands into the overlay's own secondary command buffer
+		// The frame buffer is not known at this point, it's inherited from the primary command buffer at submission
+		VkCommandBufferInheritanceInfo inheritanceInfo = vks::initializers::commandBufferInheritanceInfo();
+		inheritanceInfo.renderPass = renderPass;
+		inheritanceInfo.subpass = 0;
+		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+		cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		cmdBufInfo.pInheritanceInfo = &inheritanceInfo;
+		VK_CHECK_RESULT(vkBeginCommandBuffer(frame.commandBuffer, &cmdBufInfo));
+		ImGuiIO& io = ImGui::GetIO();
+		const VkViewport viewport = vks::initializers::viewport(io.DisplaySize.x, io.DisplaySize.y, 0.0f, 1.0f);
+		vkCmdSetViewport(frame.commandBuffer, 0, 1, &viewport);
+		draw(frame.commandBuffer);
+		VK_CHECK_RESULT(vkEndCommandBuffer(frame.commandBuffer));
+		frame.recorded = true;
 
-		return updateCmdBuffers;
+		return true;
 	}
 
 	void UIOverlay::draw(const VkCommandBuffer commandBuffer)
@@ -389,8 +501,8 @@ namespace vks
 		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstBlock), &pushConstBlock);
 
 		VkDeviceSize offsets[1] = { 0 };
-		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer.buffer, offsets);
-		vkCmdBindIndexBuffer(commandBuffer, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &frames[frameIndex].vertexBuffer.buffer, offsets);
+		vkCmdBindIndexBuffer(commandBuffer, frames[frameIndex].indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT16);
 
 		for (int32_t i = 0; i < imDrawData->CmdListsCount; i++)
 		{
@@ -411,6 +523,54 @@ namespace vks
 		}
 	}
 
+	/**
+	* Submit the overlay on top of a swap chain image
+	*
+	* @param queue Queue to submit to
+	* @param imageIndex Index of the swap chain image about to be presented
+	* @param waitSemaphore Semaphore signalled by the application once rendering to the image is finished
+	*
+	* @return Semaphore to wait on before presenting (waitSemaphore if the overlay isn't visible)
+	*/
+	VkSemaphore UIOverlay::submit(VkQueue queue, uint32_t imageIndex, VkSemaphore waitSemaphore)
+	{
+		if (!visible || !frames[frameIndex].recorded || (imageIndex >= presentCommandBuffers.size())) {
+			return waitSemaphore;
+		}
+
+		PresentCommandBuffer &presentCommandBuffer = presentCommandBuffers[imageIndex];
+		VK_CHECK_RESULT(vkWaitForFences(device->logicalDevice, 1, &presentCommandBuffer.fence, VK_TRUE, UINT64_MAX));
+
+		// Only re-recorded if the overlay has been updated since this image was presented the last time
+		if (presentCommandBuffer.frameIndex != frameIndex) {
+			VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+			VK_CHECK_RESULT(vkBeginCommandBuffer(presentCommandBuffer.commandBuffer, &cmdBufInfo));
+			VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+			renderPassBeginInfo.renderPass = renderPass;
+			renderPassBeginInfo.framebuffer = frameBuffers[imageIndex];
+			renderPassBeginInfo.renderArea.extent = extent;
+			vkCmdBeginRenderPass(presentCommandBuffer.commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+			vkCmdExecuteCommands(presentCommandBuffer.commandBuffer, 1, &frames[frameIndex].commandBuffer);
+			vkCmdEndRenderPass(presentCommandBuffer.commandBuffer);
+			VK_CHECK_RESULT(vkEndCommandBuffer(presentCommandBuffer.commandBuffer));
+			presentCommandBuffer.frameIndex = frameIndex;
+		}
+
+		VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		VkSubmitInfo submitInfo = vks::initializers::submitInfo();
+		submitInfo.waitSemaphoreCount = 1;
+		submitInfo.pWaitSemaphores = &waitSemaphore;
+		submitInfo.pWaitDstStageMask = &waitStageMask;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &presentCommandBuffer.commandBuffer;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &presentCommandBuffer.semaphore;
+		VK_CHECK_RESULT(vkResetFences(device->logicalDevice, 1, &presentCommandBuffer.fence));
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, presentCommandBuffer.fence));
+
+		return presentCommandBuffer.semaphore;
+	}
+
 	void UIOverlay::resize(uint32_t width, uint32_t height)
 	{
 		ImGuiIO& io = ImGui::GetIO();
@@ -420,8 +580,19 @@ namespace vks
 	void UIOverlay::freeResources()
 	{
 		ImGui::DestroyContext();
-		vertexBuffer.destroy();
-		indexBuffer.destroy();
+		for (auto &frame : frames) {
+			frame.vertexBuffer.destroy();
+			frame.indexBuffer.destroy();
+		}
+		for (auto &presentCommandBuffer : presentCommandBuffers) {
+			vkDestroyFence(device->logicalDevice, presentCommandBuffer.fence, nullptr);
+			vkDestroySemaphore(device->logicalDevice, presentCommandBuffer.semaphore, nullptr);
+		}
+		for (auto &frameBuffer : frameBuffers) {
+			vkDestroyFramebuffer(device->logicalDevice, frameBuffer, nullptr);
+		}
+		vkDestroyCommandPool(device->logicalDevice, commandPool, nullptr);
+		vkDestroyRenderPass(device->logicalDevice, renderPass, nullptr);
 		vkDestroyImageView(device->logicalDevice, fontView, nullptr);
 		vkDestroyImage(device->logicalDevice, fontImage, nullptr);
 		vkFreeMemory(device->logicalDevice, fontMemory, nullptr);
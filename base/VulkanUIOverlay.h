@@ -16,6 +16,7 @@
 #include <sstream>
 #include <iomanip>
 #include <functional>
+#include <array>
 
 #include <vulkan/vulkan.h>
 #include "VulkanTools.h"
@@ -37,13 +38,35 @@ namespace vks
 		vks::VulkanDevice *device;
 		VkQueue queue;
 
-		VkSampleCountFlagBits rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-		uint32_t subpass = 0;
-
-		vks::Buffer vertexBuffer;
-		vks::Buffer indexBuffer;
-		int32_t vertexCount = 0;
-		int32_t indexCount = 0;
+		/** @brief Number of overlay frames that can be in flight, each one has its own vertex and index buffers */
+		static const uint32_t maxFramesInFlight = 2;
+
+		/** @brief Geometry and draw commands of one overlay update */
+		struct Frame {
+			vks::Buffer vertexBuffer;
+			vks::Buffer indexBuffer;
+			// Secondary command buffer with the draws for this frame's buffers, only recorded when the overlay is updated
+			VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+			bool recorded = false;
+		} frames[maxFramesInFlight];
+		/** @brief Frame containing the most recent overlay update */
+		uint32_t frameIndex = 0;
+
+		/** @brief The overlay is drawn in its own render pass on top of the presented image */
+		VkRenderPass renderPass = VK_NULL_HANDLE;
+		std::vector<VkFramebuffer> frameBuffers;
+		VkExtent2D extent = {};
+		VkCommandPool commandPool = VK_NULL_HANDLE;
+
+		/** @brief Primary command buffers per swap chain image executing the overlay secondary command buffer */
+		struct PresentCommandBuffer {
+			VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+			VkFence fence = VK_NULL_HANDLE;
+			VkSemaphore semaphore = VK_NULL_HANDLE;
+			// Overlay frame the command buffer has been recorded with (UINT32_MAX = needs recording)
+			uint32_t frameIndex = UINT32_MAX;
+		};
+		std::vector<PresentCommandBuffer> presentCommandBuffers;
 
 		std::vector<VkPipelineShaderStageCreateInfo> shaders;
 
@@ -70,11 +93,14 @@ namespace vks
 		UIOverlay();
 		~UIOverlay();
 
-		void preparePipeline(const VkPipelineCache pipelineCache, const VkRenderPass renderPass);
+		void prepareRenderPass(VkFormat colorFormat);
+		void preparePipeline(const VkPipelineCache pipelineCache);
 		void prepareResources();
+		void setupFrameBuffers(const std::vector<VkImageView> &views, uint32_t width, uint32_t height);
 
 		bool update();
 		void draw(const VkCommandBuffer commandBuffer);
+		VkSemaphore submit(VkQueue queue, uint32_t imageIndex, VkSemaphore waitSemaphore);
 		void resize(uint32_t width, uint32_t height);
 
 		void freeResources();
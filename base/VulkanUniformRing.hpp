@@ -0,0 +1,184 @@
+/*
+* Vulkan uniform ring buffer
+*
+* Per-frame bump allocator for uniform data in one persistently mapped buffer, bound with dynamic offsets
+*
+* Copyright (C) 2026 by the colefet/Vulkan contributors
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <string.h>
+
+#include "vulkan/vulkan.h"
+#include "VulkanTools.h"
+#include "VulkanDevice.hpp"
+#include "VulkanBuffer.hpp"
+
+namespace vks
+{
+	/**
+	* @brief Ring of per-frame regions in a single persistently mapped uniform buffer
+	*
+	* Each frame in flight owns one region of the buffer, so uniform data written for a frame never overwrites data the GPU may
+	* still read for an earlier one (which a memcpy into a single uniform buffer does as soon as frames overlap).
+	* Allocations are a pointer bump aligned to minUniformBufferOffsetAlignment and return the dynamic offset to pass to
+	* vkCmdBindDescriptorSets for a VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC descriptor created from getDescriptor.
+	* A frame's region is reused once the fence returned by getFence for its submission has signaled.
+	*
+	* Usage per frame: beginFrame, allocate / push the uniform data while recording, submit with getFence
+	*/
+	class UniformRing
+	{
+	public:
+		/** @brief Mapped memory of an allocation and its dynamic offset */
+		struct Allocation {
+			void *data;
+			uint32_t offset;
+		};
+
+		vks::VulkanDevice *device = nullptr;
+		/** @brief Host visible and coherent buffer containing the regions of all frames */
+		vks::Buffer buffer;
+		/** @brief Alignment of all allocations (minUniformBufferOffsetAlignment) */
+		VkDeviceSize alignment = 1;
+		/** @brief Size of a frame's region */
+		VkDeviceSize frameSize = 0;
+		uint32_t frameCount = 0;
+
+		/** @brief Rounds size up to a multiple of alignment (power of two) */
+		static VkDeviceSize alignUp(VkDeviceSize size, VkDeviceSize alignment)
+		{
+			return (size + alignment - 1) & ~(alignment - 1);
+		}
+
+		/** @brief Size an allocation of size bytes takes up in a frame's region */
+		VkDeviceSize getAlignedSize(VkDeviceSize size) const
+		{
+			return alignUp(size, alignment);
+		}
+
+		/**
+		* Create the buffer and the frame fences
+		*
+		* @param device Pointer to the Vulkan device
+		* @param frameSize Size of the uniform data of a single frame, the sum of all allocation sizes aligned with alignUp to minUniformBufferOffsetAlignment
+		* @param frameCount Number of frames that may be in flight at the same time
+		*/
+		void create(vks::VulkanDevice *device, VkDeviceSize frameSize, uint32_t frameCount)
+		{
+			assert(frameCount > 0);
+			this->device = device;
+			this->frameCount = frameCount;
+			alignment = std::max(device->properties.limits.minUniformBufferOffsetAlignment, (VkDeviceSize)1);
+			this->frameSize = alignUp(frameSize, alignment);
+			// Dynamic offsets are 32 bit
+			assert(this->frameSize * frameCount <= UINT32_MAX);
+
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&buffer,
+				this->frameSize * frameCount));
+			VK_CHECK_RESULT(buffer.map());
+
+			// Signaled, so the first use of every region doesn't wait
+			VkFenceCreateInfo fenceCreateInfo = vks::initializers::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
+			fences.resize(frameCount);
+			for (auto &fence : fences) {
+				VK_CHECK_RESULT(vkCreateFence(device->logicalDevice, &fenceCreateInfo, nullptr, &fence));
+			}
+			frameIndex = frameCount - 1;
+			head = end = 0;
+		}
+
+		/**
+		* Descriptor for a VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC binding, the dynamic offset of an allocation selects the data
+		*
+		* @param range Size of the uniform block bound through the descriptor
+		*/
+		VkDescriptorBufferInfo getDescriptor(VkDeviceSize range) const
+		{
+			VkDescriptorBufferInfo descriptor = { buffer.buffer, 0, range };
+			return descriptor;
+		}
+
+		/** @brief Switch to the region of the next frame, waits until the GPU has finished the frame that used it before */
+		void beginFrame()
+		{
+			frameIndex = (frameIndex + 1) % frameCount;
+			VK_CHECK_RESULT(vkWaitForFences(device->logicalDevice, 1, &fences[frameIndex], VK_TRUE, UINT64_MAX));
+			head = frameIndex * frameSize;
+			end = head + frameSize;
+		}
+
+		/**
+		* Allocate uniform data in the current frame's region
+		*
+		* @param size Size of the data
+		*
+		* @return Pointer to write the data to and dynamic offset to bind it with
+		*/
+		Allocation allocate(VkDeviceSize size)
+		{
+			Allocation allocation = { (uint8_t*)buffer.mapped + head, static_cast<uint32_t>(head) };
+			head += alignUp(size, alignment);
+			if (head > end) {
+				vks::tools::exitFatal("Uniform ring frame size exceeded, increase the frame size passed to create", VK_ERROR_OUT_OF_DEVICE_MEMORY);
+			}
+			return allocation;
+		}
+
+		/** @brief Copy data into the current frame's region and return its dynamic offset */
+		template <typename T>
+		uint32_t push(const T &data)
+		{
+			Allocation allocation = allocate(sizeof(T));
+			memcpy(allocation.data, &data, sizeof(T));
+			return allocation.offset;
+		}
+
+		/** @brief Bytes allocated in the current frame's region (including alignment) */
+		VkDeviceSize getUsedSize() const
+		{
+			return head - frameIndex * frameSize;
+		}
+
+		/**
+		* Fence to pass to the submission of the current frame, its region is reused after the fence has signaled
+		*
+		* @note Resets the fence, the frame must be submitted with it once this has been called
+		*/
+		VkFence getFence()
+		{
+			VK_CHECK_RESULT(vkResetFences(device->logicalDevice, 1, &fences[frameIndex]));
+			return fences[frameIndex];
+		}
+
+		/** @brief Release all Vulkan resources, waits for all frames */
+		void destroy()
+		{
+			if (device) {
+				if (!fences.empty()) {
+					VK_CHECK_RESULT(vkWaitForFences(device->logicalDevice, static_cast<uint32_t>(fences.size()), fences.data(), VK_TRUE, UINT64_MAX));
+				}
+				for (auto &fence : fences) {
+					vkDestroyFence(device->logicalDevice, fence, nullptr);
+				}
+				fences.clear();
+				buffer.destroy();
+				device = nullptr;
+			}
+		}
+
+	private:
+		std::vector<VkFence> fences;
+		uint32_t frameIndex = 0;
+		VkDeviceSize head = 0;
+		VkDeviceSize end = 0;
+	};
+}
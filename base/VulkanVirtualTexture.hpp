@@ -0,0 +1,846 @@
+/*
+* Feedback driven virtual texturing with sparse residency
+*
+* Copyright (C) 2026 by the colefet/Vulkan contributors
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "vulkan/vulkan.h"
+#include <ktx.h>
+#include "VulkanTools.h"
+#include "VulkanDevice.hpp"
+#include "VulkanBuffer.hpp"
+#include "VirtualTextureCache.hpp"
+
+namespace vks
+{
+	/**
+	* Sparse resident texture whose pages are streamed in based on what the rendered frames sample
+	*
+	* Fragment shaders write the page they need for one pixel of every feedbackBlockSize^2 block into the feedback buffer
+	* (see data/shaders/base/virtualtexture.h). update resolves the feedback of the previous frame into page requests
+	* (vks::FeedbackResolver), worker threads read the requested pages from a tiled file into a staging ring and up to
+	* settings.uploadBudget loaded pages per frame are bound to slots of a single pooled memory heap (vks::PageCache,
+	* least recently used pages are evicted) and copied into the image.
+	* The mip tail is always resident. Sparse binding, the page copies and the frame are chained with semaphores: the
+	* binding waits on the previous frame, the copies wait on the binding and the frame waits on the copies.
+	*
+	* Usage per frame: update, then submit the frame waiting on waitSemaphore and signaling frameSemaphore
+	*/
+	class VirtualTexture
+	{
+	public:
+		/** @brief Page layout of a sparse image as reported by the device */
+		struct PageLayout {
+			VkFormat format;
+			uint32_t width;
+			uint32_t height;
+			uint32_t mipLevels;
+			// Sparse image granularity
+			uint32_t pageWidth;
+			uint32_t pageHeight;
+			// Texel data of a page in the tiled file
+			VkDeviceSize pageBytes;
+			// Memory of a page in the pool
+			VkDeviceSize pageMemorySize;
+			// First mip level of the mip tail
+			uint32_t pagedLevels;
+			VkDeviceSize mipTailSize;
+			VkDeviceSize mipTailOffset;
+			uint32_t memoryTypeBits;
+		};
+
+		/**
+		* Header of the tiled file, followed by the pages of all paged levels (level by level, row by row, pageBytes each)
+		* and the levels of the mip tail (tightly packed)
+		*/
+		struct FileHeader {
+			char magic[4];
+			uint32_t version;
+			uint32_t format;
+			uint32_t width;
+			uint32_t height;
+			uint32_t mipLevels;
+			uint32_t pageWidth;
+			uint32_t pageHeight;
+			uint32_t pagedLevels;
+			uint32_t reserved[3];
+		};
+
+		struct Settings {
+			// Pages in the memory pool
+			uint32_t poolPages = 256;
+			// Pages bound and copied per frame
+			uint32_t uploadBudget = 16;
+			// Pages that can be in flight between disk and image
+			uint32_t stagingPages = 64;
+			uint32_t workerCount = 2;
+			// Feedback is written for one pixel of each block of this size
+			uint32_t feedbackBlockSize = 8;
+		} settings;
+
+		struct Statistics {
+			uint32_t residentPages = 0;
+			uint32_t totalPages = 0;
+			// Pages referenced by the last feedback, including their parents
+			uint32_t requestedPages = 0;
+			uint32_t pendingPages = 0;
+			uint32_t frameUploads = 0;
+			uint64_t uploads = 0;
+			uint64_t evictions = 0;
+			float resolveTime = 0.0f;
+			VkDeviceSize poolMemory = 0;
+		} stats;
+
+		PageLayout layout = {};
+		VkImage image = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		VkSampler sampler = VK_NULL_HANDLE;
+		// The image stays in the general layout, pages are copied while other pages are sampled
+		VkDescriptorImageInfo descriptor;
+
+		// One page id per feedbackBlockSize^2 pixel block of the frame
+		vks::Buffer feedbackBuffer;
+		uint32_t feedbackWidth = 0;
+		uint32_t feedbackHeight = 0;
+
+		// Semaphore the frame has to wait on (fragment shader stage), set by update
+		VkSemaphore waitSemaphore = VK_NULL_HANDLE;
+		// Semaphore the frame has to signal, the next update's sparse binding waits on it
+		VkSemaphore frameSemaphore = VK_NULL_HANDLE;
+
+		/** @brief Block dimensions and size of the formats supported by writeTiledFile */
+		static bool getBlockInfo(VkFormat format, uint32_t &blockWidth, uint32_t &blockHeight, uint32_t &blockBytes)
+		{
+			switch (format) {
+			case VK_FORMAT_R8G8B8A8_UNORM:
+			case VK_FORMAT_R8G8B8A8_SRGB:
+				blockWidth = blockHeight = 1;
+				blockBytes = 4;
+				return true;
+			case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+			case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+				blockWidth = blockHeight = 4;
+				blockBytes = 8;
+				return true;
+			case VK_FORMAT_BC2_UNORM_BLOCK:
+			case VK_FORMAT_BC3_UNORM_BLOCK:
+			case VK_FORMAT_BC7_UNORM_BLOCK:
+				blockWidth = blockHeight = 4;
+				blockBytes = 16;
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		/**
+		* Query the page layout of a sparse resident 2D image
+		*
+		* @return False if the device doesn't support sparse residency for the format or size
+		*/
+		static bool getPageLayout(vks::VulkanDevice *device, VkFormat format, uint32_t width, uint32_t height, PageLayout &layout)
+		{
+			uint32_t blockWidth, blockHeight, blockBytes;
+			if (!getBlockInfo(format, blockWidth, blockHeight, blockBytes)) {
+				return false;
+			}
+			uint32_t propertyCount = 0;
+			vkGetPhysicalDeviceSparseImageFormatProperties(device->physicalDevice, format, VK_IMAGE_TYPE_2D, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_IMAGE_TILING_OPTIMAL, &propertyCount, nullptr);
+			if (propertyCount == 0) {
+				return false;
+			}
+
+			layout = {};
+			layout.format = format;
+			layout.width = width;
+			layout.height = height;
+			layout.mipLevels = static_cast<uint32_t>(floor(log2(std::max(width, height)))) + 1;
+
+			VkImage image;
+			VkImageCreateInfo imageCI = getImageCreateInfo(layout);
+			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCI, nullptr, &image));
+			VkMemoryRequirements memReqs;
+			vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
+			uint32_t reqsCount = 0;
+			vkGetImageSparseMemoryRequirements(device->logicalDevice, image, &reqsCount, nullptr);
+			std::vector<VkSparseImageMemoryRequirements> sparseReqs(reqsCount);
+			vkGetImageSparseMemoryRequirements(device->logicalDevice, image, &reqsCount, sparseReqs.data());
+			vkDestroyImage(device->logicalDevice, image, nullptr);
+
+			if (memReqs.size > device->properties.limits.sparseAddressSpaceSize) {
+				return false;
+			}
+			auto colorReqs = std::find_if(sparseReqs.begin(), sparseReqs.end(), [](const VkSparseImageMemoryRequirements &reqs) { return (reqs.formatProperties.aspectMask & VK_IMAGE_ASPECT_COLOR_BIT) != 0; });
+			if (colorReqs == sparseReqs.end()) {
+				return false;
+			}
+			layout.pageWidth = colorReqs->formatProperties.imageGranularity.width;
+			layout.pageHeight = colorReqs->formatProperties.imageGranularity.height;
+			layout.pageBytes = (VkDeviceSize)(layout.pageWidth / blockWidth) * (layout.pageHeight / blockHeight) * blockBytes;
+			layout.pageMemorySize = memReqs.alignment;
+			layout.pagedLevels = std::min(colorReqs->imageMipTailFirstLod, layout.mipLevels);
+			layout.mipTailSize = colorReqs->imageMipTailSize;
+			layout.mipTailOffset = colorReqs->imageMipTailOffset;
+			layout.memoryTypeBits = memReqs.memoryTypeBits;
+			// Page coordinates are packed into 12 bits
+			return (layout.pageBytes <= layout.pageMemorySize) && ((width + layout.pageWidth - 1) / layout.pageWidth <= 4096) && ((height + layout.pageHeight - 1) / layout.pageHeight <= 4096);
+		}
+
+		/**
+		* Write the tiled file for a virtual texture that repeats a KTX texture
+		*
+		* @param filename Name of the tiled file to write
+		* @param source 2D texture of the layout's format with its image data loaded, repeated across the virtual texture
+		* @param layout Page layout of the virtual texture (getPageLayout)
+		*
+		* @return True if the file was written
+		*/
+		static bool writeTiledFile(const std::string &filename, ktxTexture *source, const PageLayout &layout)
+		{
+			uint32_t blockWidth, blockHeight, blockBytes;
+			if (!getBlockInfo(layout.format, blockWidth, blockHeight, blockBytes)) {
+				return false;
+			}
+			FILE *file = fopen(filename.c_str(), "wb");
+			if (!file) {
+				return false;
+			}
+			FileHeader header = {};
+			memcpy(header.magic, "VKVT", 4);
+			header.version = 1;
+			header.format = layout.format;
+			header.width = layout.width;
+			header.height = layout.height;
+			header.mipLevels = layout.mipLevels;
+			header.pageWidth = layout.pageWidth;
+			header.pageHeight = layout.pageHeight;
+			header.pagedLevels = layout.pagedLevels;
+			bool result = fwrite(&header, sizeof(header), 1, file) == 1;
+
+			const ktx_uint8_t *sourceData = ktxTexture_GetData(source);
+			// Copies a rectangle of blocks of a level, repeating the matching level of the source (or its last one)
+			auto copyBlocks = [&](uint32_t level, uint32_t blockX, uint32_t blockY, uint32_t countX, uint32_t countY, uint8_t *dst) {
+				const uint32_t sourceLevel = std::min(level, source->numLevels - 1);
+				const uint32_t sourceBlocksX = (std::max(source->baseWidth >> sourceLevel, 1u) + blockWidth - 1) / blockWidth;
+				const uint32_t sourceBlocksY = (std::max(source->baseHeight >> sourceLevel, 1u) + blockHeight - 1) / blockHeight;
+				ktx_size_t offset;
+				ktxTexture_GetImageOffset(source, sourceLevel, 0, 0, &offset);
+				for (uint32_t y = 0; y < countY; y++) {
+					const uint8_t *row = sourceData + offset + (size_t)((blockY + y) % sourceBlocksY) * sourceBlocksX * blockBytes;
+					uint32_t x = 0;
+					while (x < countX) {
+						const uint32_t sourceX = (blockX + x) % sourceBlocksX;
+						const uint32_t run = std::min(countX - x, sourceBlocksX - sourceX);
+						memcpy(dst, row + (size_t)sourceX * blockBytes, (size_t)run * blockBytes);
+						dst += (size_t)run * blockBytes;
+						x += run;
+					}
+				}
+			};
+
+			std::vector<uint8_t> data(layout.pageBytes);
+			const uint32_t pageBlocksX = layout.pageWidth / blockWidth;
+			const uint32_t pageBlocksY = layout.pageHeight / blockHeight;
+			for (uint32_t level = 0; result && (level < layout.pagedLevels); level++) {
+				const uint32_t pagesX = (std::max(layout.width >> level, 1u) + layout.pageWidth - 1) / layout.pageWidth;
+				const uint32_t pagesY = (std::max(layout.height >> level, 1u) + layout.pageHeight - 1) / layout.pageHeight;
+				for (uint32_t y = 0; result && (y < pagesY); y++) {
+					for (uint32_t x = 0; result && (x < pagesX); x++) {
+						// Pages at the border are stored at full size, the copy only uses the part inside the level
+						copyBlocks(level, x * pageBlocksX, y * pageBlocksY, pageBlocksX, pageBlocksY, data.data());
+						result = fwrite(data.data(), 1, data.size(), file) == data.size();
+					}
+				}
+			}
+			for (uint32_t level = layout.pagedLevels; result && (level < layout.mipLevels); level++) {
+				const uint32_t blocksX = (std::max(layout.width >> level, 1u) + blockWidth - 1) / blockWidth;
+				const uint32_t blocksY = (std::max(layout.height >> level, 1u) + blockHeight - 1) / blockHeight;
+				data.resize((size_t)blocksX * blocksY * blockBytes);
+				copyBlocks(level, 0, 0, blocksX, blocksY, data.data());
+				result = fwrite(data.data(), 1, data.size(), file) == data.size();
+			}
+			fclose(file);
+			return result;
+		}
+
+		/**
+		* Open a tiled file and create the sparse image, the page pool and the streaming resources
+		*
+		* @param filename Tiled file created with writeTiledFile
+		* @param device Device to create the resources on
+		* @param queue Queue used for sparse binding, uploads and rendering, must support sparse binding
+		* @param layout Page layout of the device (getPageLayout)
+		*
+		* @return False if the file can't be read or was written for a different page layout
+		*/
+		bool open(const std::string &filename, vks::VulkanDevice *device, VkQueue queue, const PageLayout &layout)
+		{
+			if (!openFile(filename)) {
+				return false;
+			}
+			FileHeader header;
+			if (!readFile(0, &header, sizeof(header)) || (memcmp(header.magic, "VKVT", 4) != 0) || (header.version != 1) ||
+				(header.format != (uint32_t)layout.format) || (header.width != layout.width) || (header.height != layout.height) || (header.mipLevels != layout.mipLevels) ||
+				(header.pageWidth != layout.pageWidth) || (header.pageHeight != layout.pageHeight) || (header.pagedLevels != layout.pagedLevels)) {
+				closeFile();
+				return false;
+			}
+			if ((device->queueFamilyProperties[device->queueFamilyIndices.graphics].queueFlags & VK_QUEUE_SPARSE_BINDING_BIT) == 0) {
+				vks::tools::exitFatal("The graphics queue does not support sparse binding!", VK_ERROR_FEATURE_NOT_PRESENT);
+			}
+			this->device = device;
+			this->queue = queue;
+			this->layout = layout;
+
+			resolver.setLayout(layout.width, layout.height, layout.pageWidth, layout.pageHeight, layout.pagedLevels);
+			levelFirstPage.resize(layout.pagedLevels);
+			uint32_t pageCount = 0;
+			for (uint32_t level = 0; level < layout.pagedLevels; level++) {
+				levelFirstPage[level] = pageCount;
+				pageCount += resolver.getPagesX(level) * resolver.getPagesY(level);
+			}
+			pageDataOffset = sizeof(FileHeader);
+			stats = Statistics();
+			stats.totalPages = pageCount;
+			cache.resize(settings.poolPages);
+
+			VkImageCreateInfo imageCI = getImageCreateInfo(layout);
+			VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCI, nullptr, &image));
+			const uint32_t memoryType = device->getMemoryType(layout.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+			// All pages share one allocation instead of allocating memory per page
+			VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+			memAlloc.allocationSize = settings.poolPages * layout.pageMemorySize;
+			memAlloc.memoryTypeIndex = memoryType;
+			VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAlloc, nullptr, &poolMemory));
+			stats.poolMemory = memAlloc.allocationSize;
+
+			VkSemaphoreCreateInfo semaphoreCI = vks::initializers::semaphoreCreateInfo();
+			VK_CHECK_RESULT(vkCreateSemaphore(device->logicalDevice, &semaphoreCI, nullptr, &bindSemaphore));
+			VK_CHECK_RESULT(vkCreateSemaphore(device->logicalDevice, &semaphoreCI, nullptr, &uploadSemaphore));
+			VK_CHECK_RESULT(vkCreateSemaphore(device->logicalDevice, &semaphoreCI, nullptr, &frameSemaphore));
+			frameSignaled = false;
+
+			VkCommandPoolCreateInfo cmdPoolInfo = vks::initializers::commandPoolCreateInfo();
+			cmdPoolInfo.queueFamilyIndex = device->queueFamilyIndices.graphics;
+			cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+			VK_CHECK_RESULT(vkCreateCommandPool(device->logicalDevice, &cmdPoolInfo, nullptr, &commandPool));
+			VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+			VK_CHECK_RESULT(vkAllocateCommandBuffers(device->logicalDevice, &cmdBufAllocateInfo, &uploadCmd));
+			VkFenceCreateInfo fenceInfo = vks::initializers::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
+			VK_CHECK_RESULT(vkCreateFence(device->logicalDevice, &fenceInfo, nullptr, &uploadFence));
+
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging, settings.stagingPages * layout.pageBytes));
+			VK_CHECK_RESULT(staging.map());
+			freeStaging.clear();
+			for (uint32_t i = settings.stagingPages; i > 0; i--) {
+				freeStaging.push_back(i - 1);
+			}
+
+			uploadMipTail(memoryType, pageDataOffset + (uint64_t)pageCount * layout.pageBytes);
+
+			VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+			viewCI.image = image;
+			viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewCI.format = layout.format;
+			viewCI.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
+			viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, layout.mipLevels, 0, 1 };
+			VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCI, nullptr, &view));
+
+			VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+			samplerCI.magFilter = VK_FILTER_LINEAR;
+			samplerCI.minFilter = VK_FILTER_LINEAR;
+			samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+			samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+			samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+			samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+			samplerCI.compareOp = VK_COMPARE_OP_NEVER;
+			samplerCI.minLod = 0.0f;
+			samplerCI.maxLod = (float)layout.mipLevels;
+			samplerCI.maxAnisotropy = 1.0f;
+			samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+			VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerCI, nullptr, &sampler));
+			descriptor = { sampler, view, VK_IMAGE_LAYOUT_GENERAL };
+
+			stop = false;
+			for (uint32_t i = 0; i < std::max(1u, settings.workerCount); i++) {
+				workers.push_back(std::thread(&VirtualTexture::workerLoop, this));
+			}
+			return true;
+		}
+
+		/**
+		* (Re)create the feedback buffer for a frame size
+		*
+		* @return True if the buffer was recreated and descriptors referencing it have to be updated
+		*/
+		bool createFeedbackBuffer(uint32_t width, uint32_t height)
+		{
+			feedbackWidth = (width + settings.feedbackBlockSize - 1) / settings.feedbackBlockSize;
+			feedbackHeight = (height + settings.feedbackBlockSize - 1) / settings.feedbackBlockSize;
+			const VkDeviceSize size = (VkDeviceSize)feedbackWidth * feedbackHeight * sizeof(uint32_t);
+			if ((feedbackBuffer.buffer != VK_NULL_HANDLE) && (feedbackBuffer.size >= size)) {
+				return false;
+			}
+			if (feedbackBuffer.buffer != VK_NULL_HANDLE) {
+				vkQueueWaitIdle(queue);
+				feedbackBuffer.destroy();
+			}
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &feedbackBuffer, size));
+			VK_CHECK_RESULT(feedbackBuffer.map());
+			memset(feedbackBuffer.mapped, 0xFF, size);
+			return true;
+		}
+
+		/** @brief Clear the feedback buffer, record before the pass writing the feedback */
+		void recordFeedbackClear(VkCommandBuffer cmdBuffer)
+		{
+			vkCmdFillBuffer(cmdBuffer, feedbackBuffer.buffer, 0, VK_WHOLE_SIZE, VirtualPageId::invalid);
+			VkBufferMemoryBarrier barrier = vks::initializers::bufferMemoryBarrier();
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.buffer = feedbackBuffer.buffer;
+			barrier.size = VK_WHOLE_SIZE;
+			vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+		}
+
+		/** @brief Make the feedback visible to the host, record after the pass writing the feedback */
+		void recordFeedbackBarrier(VkCommandBuffer cmdBuffer)
+		{
+			VkBufferMemoryBarrier barrier = vks::initializers::bufferMemoryBarrier();
+			barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.buffer = feedbackBuffer.buffer;
+			barrier.size = VK_WHOLE_SIZE;
+			vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+		}
+
+		/** @brief Evict all pages in the next update */
+		void flush()
+		{
+			flushRequested = true;
+		}
+
+		/**
+		* Resolve the feedback of the previous frame, request missing pages and bind and upload loaded pages
+		*
+		* @note The frame that wrote the feedback must have completed, the next frame must wait on waitSemaphore and signal frameSemaphore
+		*/
+		void update()
+		{
+			frame++;
+			// Staging pages of the previous upload can be reused once it has completed
+			VK_CHECK_RESULT(vkWaitForFences(device->logicalDevice, 1, &uploadFence, VK_TRUE, UINT64_MAX));
+			freeStaging.insert(freeStaging.end(), uploadingStaging.begin(), uploadingStaging.end());
+			uploadingStaging.clear();
+
+			std::vector<Request> batch;
+			{
+				std::lock_guard<std::mutex> lock(requestMutex);
+				// Requests that haven't been picked up by a worker are replaced by the current ones
+				for (auto &request : requests) {
+					freeStaging.push_back(request.stagingSlot);
+					pending.erase(request.page);
+				}
+				requests.clear();
+
+				auto tStart = std::chrono::high_resolution_clock::now();
+				const std::vector<FeedbackResolver::Request> &resolved = resolver.resolve((const uint32_t*)feedbackBuffer.mapped, (size_t)feedbackWidth * feedbackHeight);
+				for (auto &entry : resolved) {
+					if (cache.touch(entry.page, frame) || (pending.count(entry.page) > 0) || freeStaging.empty()) {
+						continue;
+					}
+					Request request = { entry.page, freeStaging.back() };
+					freeStaging.pop_back();
+					requests.push_back(request);
+					pending.insert(entry.page);
+				}
+				stats.resolveTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+				stats.requestedPages = static_cast<uint32_t>(resolved.size());
+
+				// Per frame upload budget, the remaining pages are uploaded in the next frames
+				const size_t count = std::min(loaded.size(), (size_t)settings.uploadBudget);
+				batch.assign(loaded.begin(), loaded.begin() + count);
+				loaded.erase(loaded.begin(), loaded.begin() + count);
+				for (auto &request : batch) {
+					pending.erase(request.page);
+				}
+				stats.pendingPages = static_cast<uint32_t>(pending.size());
+			}
+			requestCondition.notify_all();
+
+			std::vector<VkSparseImageMemoryBind> binds;
+			std::vector<VkBufferImageCopy> copies;
+			if (flushRequested) {
+				for (auto page : cache.clear()) {
+					binds.push_back(getPageBind(page, VK_NULL_HANDLE, 0));
+				}
+				flushRequested = false;
+			}
+			for (auto &request : batch) {
+				uint32_t slot, evicted;
+				if (!cache.insert(request.page, frame, slot, evicted)) {
+					// All pool pages are needed by the current frame
+					freeStaging.push_back(request.stagingSlot);
+					continue;
+				}
+				if (evicted != VirtualPageId::invalid) {
+					binds.push_back(getPageBind(evicted, VK_NULL_HANDLE, 0));
+					stats.evictions++;
+				}
+				binds.push_back(getPageBind(request.page, poolMemory, slot * layout.pageMemorySize));
+				VkSparseImageMemoryBind &bind = binds.back();
+				VkBufferImageCopy copy = {};
+				copy.bufferOffset = request.stagingSlot * layout.pageBytes;
+				copy.bufferRowLength = layout.pageWidth;
+				copy.bufferImageHeight = layout.pageHeight;
+				copy.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, bind.subresource.mipLevel, 0, 1 };
+				copy.imageOffset = bind.offset;
+				copy.imageExtent = bind.extent;
+				copies.push_back(copy);
+				uploadingStaging.push_back(request.stagingSlot);
+			}
+			stats.frameUploads = static_cast<uint32_t>(copies.size());
+			stats.uploads += copies.size();
+			stats.residentPages = cache.getSize();
+
+			// Binding is done every frame so the semaphores of the previous frame and of this frame are always consumed
+			VkSparseImageMemoryBindInfo imageBindInfo = { image, static_cast<uint32_t>(binds.size()), binds.data() };
+			VkBindSparseInfo bindSparseInfo = vks::initializers::bindSparseInfo();
+			bindSparseInfo.waitSemaphoreCount = frameSignaled ? 1 : 0;
+			bindSparseInfo.pWaitSemaphores = &frameSemaphore;
+			bindSparseInfo.imageBindCount = binds.empty() ? 0 : 1;
+			bindSparseInfo.pImageBinds = &imageBindInfo;
+			bindSparseInfo.signalSemaphoreCount = 1;
+			bindSparseInfo.pSignalSemaphores = &bindSemaphore;
+			VK_CHECK_RESULT(vkQueueBindSparse(queue, 1, &bindSparseInfo, VK_NULL_HANDLE));
+			waitSemaphore = bindSemaphore;
+			frameSignaled = true;
+
+			if (!copies.empty()) {
+				VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+				cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+				VK_CHECK_RESULT(vkBeginCommandBuffer(uploadCmd, &cmdBufInfo));
+				recordImageBarrier(uploadCmd, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+				vkCmdCopyBufferToImage(uploadCmd, staging.buffer, image, VK_IMAGE_LAYOUT_GENERAL, static_cast<uint32_t>(copies.size()), copies.data());
+				recordImageBarrier(uploadCmd, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+				VK_CHECK_RESULT(vkEndCommandBuffer(uploadCmd));
+
+				VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+				VkSubmitInfo submitInfo = vks::initializers::submitInfo();
+				submitInfo.waitSemaphoreCount = 1;
+				submitInfo.pWaitSemaphores = &bindSemaphore;
+				submitInfo.pWaitDstStageMask = &waitStage;
+				submitInfo.commandBufferCount = 1;
+				submitInfo.pCommandBuffers = &uploadCmd;
+				submitInfo.signalSemaphoreCount = 1;
+				submitInfo.pSignalSemaphores = &uploadSemaphore;
+				VK_CHECK_RESULT(vkResetFences(device->logicalDevice, 1, &uploadFence));
+				VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, uploadFence));
+				waitSemaphore = uploadSemaphore;
+			}
+		}
+
+		/** @brief Stop the workers and release all resources */
+		void destroy()
+		{
+			if (!device) {
+				return;
+			}
+			{
+				std::lock_guard<std::mutex> lock(requestMutex);
+				stop = true;
+			}
+			requestCondition.notify_all();
+			for (auto &worker : workers) {
+				worker.join();
+			}
+			workers.clear();
+			requests.clear();
+			loaded.clear();
+			pending.clear();
+			vkQueueWaitIdle(queue);
+			vkDestroySampler(device->logicalDevice, sampler, nullptr);
+			vkDestroyImageView(device->logicalDevice, view, nullptr);
+			vkDestroyImage(device->logicalDevice, image, nullptr);
+			vkFreeMemory(device->logicalDevice, poolMemory, nullptr);
+			if (tailMemory != VK_NULL_HANDLE) {
+				vkFreeMemory(device->logicalDevice, tailMemory, nullptr);
+				tailMemory = VK_NULL_HANDLE;
+			}
+			vkDestroySemaphore(device->logicalDevice, bindSemaphore, nullptr);
+			vkDestroySemaphore(device->logicalDevice, uploadSemaphore, nullptr);
+			vkDestroySemaphore(device->logicalDevice, frameSemaphore, nullptr);
+			vkDestroyFence(device->logicalDevice, uploadFence, nullptr);
+			vkDestroyCommandPool(device->logicalDevice, commandPool, nullptr);
+			staging.destroy();
+			feedbackBuffer.destroy();
+			closeFile();
+			device = nullptr;
+		}
+
+		~VirtualTexture()
+		{
+			destroy();
+		}
+
+	private:
+		struct Request {
+			uint32_t page;
+			uint32_t stagingSlot;
+		};
+
+		vks::VulkanDevice *device = nullptr;
+		VkQueue queue = VK_NULL_HANDLE;
+		uint64_t frame = 0;
+
+#if defined(_WIN32)
+		HANDLE file = INVALID_HANDLE_VALUE;
+#else
+		int file = -1;
+#endif
+		uint64_t pageDataOffset = 0;
+		std::vector<uint32_t> levelFirstPage;
+
+		FeedbackResolver resolver;
+		PageCache cache;
+		VkDeviceMemory poolMemory = VK_NULL_HANDLE;
+		VkDeviceMemory tailMemory = VK_NULL_HANDLE;
+		bool flushRequested = false;
+
+		vks::Buffer staging;
+		std::vector<uint32_t> freeStaging;
+		std::vector<uint32_t> uploadingStaging;
+
+		// Requests are consumed by the workers, loaded pages are handed back for upload
+		std::vector<std::thread> workers;
+		std::mutex requestMutex;
+		std::condition_variable requestCondition;
+		std::deque<Request> requests;
+		std::deque<Request> loaded;
+		// Pages requested, being read or waiting for upload
+		std::unordered_set<uint32_t> pending;
+		bool stop = false;
+
+		VkSemaphore bindSemaphore = VK_NULL_HANDLE;
+		VkSemaphore uploadSemaphore = VK_NULL_HANDLE;
+		bool frameSignaled = false;
+		VkCommandPool commandPool = VK_NULL_HANDLE;
+		VkCommandBuffer uploadCmd = VK_NULL_HANDLE;
+		VkFence uploadFence = VK_NULL_HANDLE;
+
+		static VkImageCreateInfo getImageCreateInfo(const PageLayout &layout)
+		{
+			VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+			imageCI.imageType = VK_IMAGE_TYPE_2D;
+			imageCI.format = layout.format;
+			imageCI.extent = { layout.width, layout.height, 1 };
+			imageCI.mipLevels = layout.mipLevels;
+			imageCI.arrayLayers = 1;
+			imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+			imageCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			imageCI.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+			imageCI.flags = VK_IMAGE_CREATE_SPARSE_BINDING_BIT | VK_IMAGE_CREATE_SPARSE_RESIDENCY_BIT;
+			return imageCI;
+		}
+
+		VkSparseImageMemoryBind getPageBind(uint32_t page, VkDeviceMemory memory, VkDeviceSize memoryOffset)
+		{
+			const uint32_t level = VirtualPageId::mipLevel(page);
+			const uint32_t x = VirtualPageId::x(page) * layout.pageWidth;
+			const uint32_t y = VirtualPageId::y(page) * layout.pageHeight;
+			VkSparseImageMemoryBind bind = {};
+			bind.subresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0 };
+			bind.offset = { (int32_t)x, (int32_t)y, 0 };
+			// Pages at the border of a level may be smaller than the granularity
+			bind.extent = { std::min(layout.pageWidth, std::max(layout.width >> level, 1u) - x), std::min(layout.pageHeight, std::max(layout.height >> level, 1u) - y), 1 };
+			bind.memory = memory;
+			bind.memoryOffset = memoryOffset;
+			return bind;
+		}
+
+		void recordImageBarrier(VkCommandBuffer cmdBuffer, VkAccessFlags srcAccess, VkAccessFlags dstAccess, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage)
+		{
+			VkImageMemoryBarrier barrier = vks::initializers::imageMemoryBarrier();
+			barrier.srcAccessMask = srcAccess;
+			barrier.dstAccessMask = dstAccess;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+			barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+			barrier.image = image;
+			barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, layout.mipLevels, 0, 1 };
+			vkCmdPipelineBarrier(cmdBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+		}
+
+		// Bind memory to the mip tail and copy its levels from the file, also moves the whole image into the general layout
+		void uploadMipTail(uint32_t memoryType, uint64_t tailDataOffset)
+		{
+			uint32_t blockWidth, blockHeight, blockBytes;
+			getBlockInfo(layout.format, blockWidth, blockHeight, blockBytes);
+			std::vector<VkBufferImageCopy> copies;
+			VkDeviceSize tailBytes = 0;
+			for (uint32_t level = layout.pagedLevels; level < layout.mipLevels; level++) {
+				const uint32_t levelWidth = std::max(layout.width >> level, 1u);
+				const uint32_t levelHeight = std::max(layout.height >> level, 1u);
+				VkBufferImageCopy copy = {};
+				copy.bufferOffset = tailBytes;
+				copy.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+				copy.imageExtent = { levelWidth, levelHeight, 1 };
+				copies.push_back(copy);
+				tailBytes += (VkDeviceSize)((levelWidth + blockWidth - 1) / blockWidth) * ((levelHeight + blockHeight - 1) / blockHeight) * blockBytes;
+			}
+
+			VkSparseMemoryBind tailBind = {};
+			VkSparseImageOpaqueMemoryBindInfo opaqueBindInfo = { image, 1, &tailBind };
+			VkBindSparseInfo bindSparseInfo = vks::initializers::bindSparseInfo();
+			if (!copies.empty()) {
+				VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+				memAlloc.allocationSize = layout.mipTailSize;
+				memAlloc.memoryTypeIndex = memoryType;
+				VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAlloc, nullptr, &tailMemory));
+				tailBind.resourceOffset = layout.mipTailOffset;
+				tailBind.size = layout.mipTailSize;
+				tailBind.memory = tailMemory;
+				bindSparseInfo.imageOpaqueBindCount = 1;
+				bindSparseInfo.pImageOpaqueBinds = &opaqueBindInfo;
+			}
+			bindSparseInfo.signalSemaphoreCount = 1;
+			bindSparseInfo.pSignalSemaphores = &bindSemaphore;
+			VK_CHECK_RESULT(vkQueueBindSparse(queue, 1, &bindSparseInfo, VK_NULL_HANDLE));
+
+			vks::Buffer tailStaging;
+			VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &tailStaging, std::max(tailBytes, (VkDeviceSize)4)));
+			VK_CHECK_RESULT(tailStaging.map());
+			if (tailBytes > 0) {
+				readFile(tailDataOffset, tailStaging.mapped, tailBytes);
+			}
+
+			VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+			VK_CHECK_RESULT(vkBeginCommandBuffer(uploadCmd, &cmdBufInfo));
+			VkImageMemoryBarrier barrier = vks::initializers::imageMemoryBarrier();
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+			barrier.image = image;
+			barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, layout.mipLevels, 0, 1 };
+			vkCmdPipelineBarrier(uploadCmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+			if (!copies.empty()) {
+				vkCmdCopyBufferToImage(uploadCmd, tailStaging.buffer, image, VK_IMAGE_LAYOUT_GENERAL, static_cast<uint32_t>(copies.size()), copies.data());
+			}
+			recordImageBarrier(uploadCmd, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+			VK_CHECK_RESULT(vkEndCommandBuffer(uploadCmd));
+
+			VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+			VkSubmitInfo submitInfo = vks::initializers::submitInfo();
+			submitInfo.waitSemaphoreCount = 1;
+			submitInfo.pWaitSemaphores = &bindSemaphore;
+			submitInfo.pWaitDstStageMask = &waitStage;
+			submitInfo.commandBufferCount = 1;
+			submitInfo.pCommandBuffers = &uploadCmd;
+			VK_CHECK_RESULT(vkResetFences(device->logicalDevice, 1, &uploadFence));
+			VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, uploadFence));
+			VK_CHECK_RESULT(vkWaitForFences(device->logicalDevice, 1, &uploadFence, VK_TRUE, UINT64_MAX));
+			tailStaging.destroy();
+		}
+
+		bool openFile(const std::string &filename)
+		{
+#if defined(_WIN32)
+			file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			return file != INVALID_HANDLE_VALUE;
+#else
+			file = ::open(filename.c_str(), O_RDONLY);
+			return file >= 0;
+#endif
+		}
+
+		bool readFile(uint64_t offset, void *dst, uint64_t size)
+		{
+#if defined(_WIN32)
+			OVERLAPPED overlapped = {};
+			overlapped.Offset = (DWORD)(offset & 0xFFFFFFFF);
+			overlapped.OffsetHigh = (DWORD)(offset >> 32);
+			DWORD bytesRead = 0;
+			return ReadFile(file, dst, (DWORD)size, &bytesRead, &overlapped) && (bytesRead == size);
+#else
+			uint8_t *data = (uint8_t*)dst;
+			while (size > 0) {
+				ssize_t bytesRead = pread(file, data, size, offset);
+				if (bytesRead <= 0) {
+					return false;
+				}
+				data += bytesRead;
+				offset += bytesRead;
+				size -= bytesRead;
+			}
+			return true;
+#endif
+		}
+
+		void closeFile()
+		{
+#if defined(_WIN32)
+			if (file != INVALID_HANDLE_VALUE) {
+				CloseHandle(file);
+				file = INVALID_HANDLE_VALUE;
+			}
+#else
+			if (file >= 0) {
+				close(file);
+				file = -1;
+			}
+#endif
+		}
+
+		void workerLoop()
+		{
+			while (true) {
+				Request request;
+				{
+					std::unique_lock<std::mutex> lock(requestMutex);
+					requestCondition.wait(lock, [this] { return stop || !requests.empty(); });
+					if (stop) {
+						return;
+					}
+					request = requests.front();
+					requests.pop_front();
+				}
+				// Positional reads, so workers don't need to share a file offset
+				const uint32_t level = VirtualPageId::mipLevel(request.page);
+				const uint64_t pageIndex = levelFirstPage[level] + VirtualPageId::y(request.page) * resolver.getPagesX(level) + VirtualPageId::x(request.page);
+				readFile(pageDataOffset + pageIndex * layout.pageBytes, (uint8_t*)staging.mapped + request.stagingSlot * layout.pageBytes, layout.pageBytes);
+				std::lock_guard<std::mutex> lock(requestMutex);
+				loaded.push_back(request);
+			}
+		}
+	};
+}
@@ -70,7 +70,8 @@ namespace vks
 			}
 		}
 
-		void saveResults() {
+		/** @brief Save the results to the file, writeExtra can append additional sections (e.g. GPU statistics) */
+		void saveResults(std::function<void(std::ostream&)> writeExtra = nullptr) {
 			std::ofstream result(filename, std::ios::out);
 			if (result.is_open()) {
 				result << std::fixed << std::setprecision(4);
@@ -92,6 +93,11 @@ namespace vks
 					std::cout << std::endl;
 				}
 
+				if (writeExtra) {
+					result << std::endl;
+					writeExtra(result);
+				}
+
 				result.flush();
 #if defined(_WIN32)
 				FreeConsole();
@@ -17,6 +17,7 @@ class Camera
 private:
 	float fov;
 	float znear, zfar;
+	glm::vec3 lastPosition = glm::vec3();
 
 	void updateViewMatrix()
 	{
@@ -46,6 +47,8 @@ public:
 
 	glm::vec3 rotation = glm::vec3();
 	glm::vec3 position = glm::vec3();
+	// Change of position per second, measured across calls to update (e.g. for prefetching around the camera)
+	glm::vec3 velocity = glm::vec3();
 
 	float rotationSpeed = 1.0f;
 	float movementSpeed = 1.0f;
@@ -149,6 +152,12 @@ public:
 				updateViewMatrix();
 			}
 		}
+		if (deltaTime > 0.0f)
+		{
+			// Smoothed to hide frame time jitter
+			velocity = glm::mix(velocity, (position - lastPosition) / deltaTime, 0.25f);
+		}
+		lastPosition = position;
 	};
 
 	// Update camera passing separate axis data (gamepad)
@@ -208,6 +208,7 @@ void VulkanExampleBase::prepare()
 	createCommandPool();
 	setupSwapChain();
 	createCommandBuffers();
+	gpuStats.prepare(vulkanDevice, static_cast<uint32_t>(drawCmdBuffers.size()), enabledFeatures.pipelineStatisticsQuery == VK_TRUE, deviceProperties.limits.timestampPeriod);
 	createSynchronizationPrimitives();
 	setupDepthStencil();
 	setupRenderPass();
@@ -222,8 +223,11 @@ void VulkanExampleBase::prepare()
 			loadShader(getAssetPath() + "shaders/base/uioverlay.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT),
 		};
 		UIOverlay.prepareResources();
-		UIOverlay.preparePipeline(pipelineCache, renderPass);
+		UIOverlay.prepareRenderPass(swapChain.colorFormat);
+		UIOverlay.preparePipeline(pipelineCache);
+		setupOverlayFrameBuffers();
 	}
+	frameCapture.prepare(vulkanDevice, swapChain.colorFormat, swapChain.queueNodeIndex);
 }
 
 VkPipelineShaderStageCreateInfo VulkanExampleBase::loadShader(std::string fileName, VkShaderStageFlagBits stage)
@@ -283,7 +287,6 @@ void VulkanExampleBase::renderFrame()
 		frameCounter = 0;
 		lastTimestamp = tEnd;
 	}
-	// TODO: Cap UI overlay update rates
 	updateOverlay();
 }
 
@@ -292,8 +295,16 @@ void VulkanExampleBase::renderLoop()
 	if (benchmark.active) {
 		benchmark.run([=] { render(); }, vulkanDevice->properties);
 		vkDeviceWaitIdle(device);
+		if (gpuStats.enabled) {
+			gpuStats.collect();
+			gpuStats.writeResults(std::cout);
+		}
 		if (benchmark.filename != "") {
-			benchmark.saveResults();
+			if (gpuStats.enabled) {
+				benchmark.saveResults([=](std::ostream &stream) { gpuStats.writeResults(stream); });
+			} else {
+				benchmark.saveResults();
+			}
 		}
 		return;
 	}
@@ -376,7 +387,6 @@ void VulkanExampleBase::renderLoop()
 				lastTimestamp = tEnd;
 			}
 
-			// TODO: Cap UI overlay update rates/only issue when update requested
 			updateOverlay();
 
 			bool updateView = false;
@@ -581,10 +591,22 @@ void VulkanExampleBase::updateOverlay()
 	if (!settings.overlay)
 		return;
 
+	// Limit the update rate, mouse button changes are always passed on so short clicks don't get lost
+	overlayUpdate.timer += frameTimer;
+	const bool mouseButtonsChanged = (mouseButtons.left != overlayUpdate.left) || (mouseButtons.right != overlayUpdate.right);
+	if ((settings.overlayRefreshRate > 0.0f) && (overlayUpdate.timer < 1.0f / settings.overlayRefreshRate) && !mouseButtonsChanged) {
+		return;
+	}
+
+	auto tStart = std::chrono::high_resolution_clock::now();
+
 	ImGuiIO& io = ImGui::GetIO();
 
 	io.DisplaySize = ImVec2((float)width, (float)height);
-	io.DeltaTime = frameTimer;
+	io.DeltaTime = overlayUpdate.timer;
+	overlayUpdate.timer = 0.0f;
+	overlayUpdate.left = mouseButtons.left;
+	overlayUpdate.right = mouseButtons.right;
 
 	io.MousePos = ImVec2(mousePos.x, mousePos.y);
 	io.MouseDown[0] = mouseButtons.left;
@@ -601,6 +623,13 @@ void VulkanExampleBase::updateOverlay()
 	ImGui::TextUnformatted(title.c_str());
 	ImGui::TextUnformatted(deviceProperties.deviceName);
 	ImGui::Text("%.2f ms/frame (%.1d fps)", (1000.0f / lastFPS), lastFPS);
+	ImGui::Text("UI %.3f ms, cmd buffers %.3f ms", overlayTimings.updateOverlay, overlayTimings.buildCommandBuffers);
+	if (gpuStats.enabled) {
+		for (auto &pass : gpuStats.passes) {
+			ImGui::Text("%s: %.3f ms GPU", pass.name.c_str(), pass.gpuTime);
+			ImGui::Text("  vs %.0f, prim %.0f, fs %.0f, cs %.0f", pass.counters[vks::GpuStatistics::VertexInvocations], pass.counters[vks::GpuStatistics::Primitives], pass.counters[vks::GpuStatistics::FragmentInvocations], pass.counters[vks::GpuStatistics::ComputeInvocations]);
+		}
+	}
 
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
 	ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(0.0f, 5.0f * UIOverlay.scale));
@@ -616,11 +645,19 @@ void VulkanExampleBase::updateOverlay()
 	ImGui::PopStyleVar();
 	ImGui::Render();
 
-	if (UIOverlay.update() || UIOverlay.updated) {
+	// The overlay is drawn from its own command buffers, so only changes to the example's settings require a rebuild
+	UIOverlay.update();
+	if (UIOverlay.updated) {
+		auto tBuildStart = std::chrono::high_resolution_clock::now();
 		buildCommandBuffers();
+		float tBuild = (float)std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tBuildStart).count();
+		overlayTimings.buildCommandBuffers = overlayTimings.buildCommandBuffers * 0.9f + tBuild * 0.1f;
 		UIOverlay.updated = false;
 	}
 
+	float tUpdate = (float)std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+	overlayTimings.updateOverlay = overlayTimings.updateOverlay * 0.9f + tUpdate * 0.1f;
+
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
 	if (mouseButtons.left) {
 		mouseButtons.left = false;
@@ -628,16 +665,13 @@ void VulkanExampleBase::updateOverlay()
 #endif
 }
 
-void VulkanExampleBase::drawUI(const VkCommandBuffer commandBuffer)
+void VulkanExampleBase::setupOverlayFrameBuffers()
 {
-	if (settings.overlay) {
-		const VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
-		const VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
-		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
-
-		UIOverlay.draw(commandBuffer);
+	std::vector<VkImageView> views(swapChain.imageCount);
+	for (uint32_t i = 0; i < swapChain.imageCount; i++) {
+		views[i] = swapChain.buffers[i].view;
 	}
+	UIOverlay.setupFrameBuffers(views, width, height);
 }
 
 void VulkanExampleBase::prepareFrame()
@@ -651,11 +685,25 @@ void VulkanExampleBase::prepareFrame()
 	else {
 		VK_CHECK_RESULT(result);
 	}
+	// Statistics of earlier frames that are available by now
+	gpuStats.collect();
 }
 
 void VulkanExampleBase::submitFrame()
 {
-	VkResult result = swapChain.queuePresent(queue, currentBuffer, semaphores.renderComplete);
+	// Assumes the example submitted the draw command buffer of the current image (no-op for slots without passes)
+	gpuStats.submitted(currentBuffer);
+
+	// The UI overlay is drawn on top of the example's output in a separate submission
+	VkSemaphore waitSemaphore = semaphores.renderComplete;
+	if (settings.overlay) {
+		waitSemaphore = UIOverlay.submit(queue, currentBuffer, waitSemaphore);
+	}
+	// Copies the image for readback if a capture has been requested, presentation then waits on that copy
+	if (swapChain.imageUsage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) {
+		waitSemaphore = frameCapture.captureFrame(queue, swapChain.images[currentBuffer], width, height, waitSemaphore);
+	}
+	VkResult result = swapChain.queuePresent(queue, currentBuffer, waitSemaphore);
 	if (!((result == VK_SUCCESS) || (result == VK_SUBOPTIMAL_KHR))) {
 		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
 			// Swap chain is no longer compatible with the surface and needs to be recreated
@@ -751,6 +799,44 @@ VulkanExampleBase::VulkanExampleBase(bool enableValidation)
 		if ((args[i] == std::string("-bt")) || (args[i] == std::string("--benchframetimes"))) {
 			benchmark.outputFrameTimes = true;
 		}
+		// Maximum number of UI overlay updates per second (0 = no limit)
+		if (args[i] == std::string("--ui-refresh")) {
+			if (args.size() > i + 1) {
+				float rate = strtof(args[i + 1], &numConvPtr);
+				if (numConvPtr != args[i + 1]) {
+					settings.overlayRefreshRate = rate;
+				} else {
+					std::cerr << "UI refresh rate must be specified as a number!" << std::endl;
+				}
+			}
+		}
+		// Collect per pass pipeline statistics and GPU times
+		if (args[i] == std::string("--stats")) {
+			gpuStats.enabled = true;
+		}
+		// Capture a number of consecutive frames to disk
+		if (args[i] == std::string("--capture-frames")) {
+			if (args.size() > i + 1) {
+				uint32_t num = strtol(args[i + 1], &numConvPtr, 10);
+				if (numConvPtr != args[i + 1]) {
+					frameCapture.sequence.frameCount = num;
+				} else {
+					std::cerr << "Number of frames to capture must be specified as a number!" << std::endl;
+				}
+			}
+		}
+		// Image format for captured frames (ppm, png or qoi)
+		if (args[i] == std::string("--capture-format")) {
+			if ((args.size() > i + 1) && !vks::FrameCapture::parseFormat(args[i + 1], frameCapture.sequence.format)) {
+				std::cerr << "Unknown capture format \"" << args[i + 1] << "\", must be ppm, png or qoi!" << std::endl;
+			}
+		}
+		// Filename prefix for captured frames
+		if (args[i] == std::string("--capture-prefix")) {
+			if (args.size() > i + 1) {
+				frameCapture.sequence.prefix = args[i + 1];
+			}
+		}
 	}
 	
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
@@ -813,6 +899,9 @@ VulkanExampleBase::~VulkanExampleBase()
 		UIOverlay.freeResources();
 	}
 
+	frameCapture.destroy();
+	gpuStats.destroy();
+
 	delete vulkanDevice;
 
 	if (settings.validation)
@@ -948,6 +1037,9 @@ bool VulkanExampleBase::initVulkan()
 
 	// Derived examples can override this to set actual features (based on above readings) to enable for logical device creation
 	getEnabledFeatures();
+	if (gpuStats.enabled && deviceFeatures.pipelineStatisticsQuery) {
+		enabledFeatures.pipelineStatisticsQuery = VK_TRUE;
+	}
 
 	// Vulkan device creation
 	// This is handled by a separate class that gets a logical device representation
@@ -2051,7 +2143,7 @@ void VulkanExampleBase::setupDepthStencil()
 	imageCI.arrayLayers = 1;
 	imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
 	imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-	imageCI.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	imageCI.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | depthStencilUsage;
 
 	VK_CHECK_RESULT(vkCreateImage(device, &imageCI, nullptr, &depthStencil.image));
 	VkMemoryRequirements memReqs{};
@@ -2213,6 +2305,9 @@ void VulkanExampleBase::windowResize()
 	if ((width > 0.0f) && (height > 0.0f)) {
 		if (settings.overlay) {
 			UIOverlay.resize(width, height);
+			setupOverlayFrameBuffers();
+			// Update the overlay with the new size in the next frame
+			overlayUpdate.timer = 1.0f;
 		}
 	}
 
@@ -53,6 +53,8 @@
 #include "VulkanSwapChain.hpp"
 #include "camera.hpp"
 #include "benchmark.hpp"
+#include "VulkanFrameCapture.hpp"
+#include "VulkanGpuStatistics.hpp"
 
 class VulkanExampleBase
 {
@@ -70,6 +72,13 @@ private:
 	void handleKeyDown(WPARAM wParam, LPARAM lParam);
 	void handleKeyUp(WPARAM wParam, LPARAM lParam);
 	void handleMouseMove(int32_t x, int32_t y);
+	// Time since the last UI overlay update and mouse button state at that update
+	struct {
+		float timer = 0.0f;
+		bool left = false;
+		bool right = false;
+	} overlayUpdate;
+	void setupOverlayFrameBuffers();
 protected:
 	// Frame counter to display fps
 	uint32_t frameCounter = 0;
@@ -98,6 +107,8 @@ protected:
 	VkQueue queue;
 	// Depth buffer format (selected during Vulkan initialization)
 	VkFormat depthFormat;
+	/** @brief Usage flags added to the depth stencil image, e.g. VK_IMAGE_USAGE_SAMPLED_BIT to read the depth of the last frame (must be set in the derived constructor) */
+	VkImageUsageFlags depthStencilUsage = 0;
 	// Command buffer pool
 	VkCommandPool cmdPool;
 	/** @brief Pipeline stages used to wait at for graphics queue submissions */
@@ -142,6 +153,12 @@ public:
 
 	vks::Benchmark benchmark;
 
+	/** @brief Asynchronous screenshot and image sequence capture of the presented frames */
+	vks::FrameCapture frameCapture;
+
+	/** @brief Per pass pipeline statistics and GPU times (enabled with --stats), examples mark their passes in the draw command buffers */
+	vks::GpuStatistics gpuStats;
+
 	/** @brief Encapsulated physical and logical vulkan device */
 	vks::VulkanDevice *vulkanDevice;
 
@@ -155,8 +172,16 @@ public:
 		bool vsync = false;
 		/** @brief Enable UI overlay */
 		bool overlay = false;
+		/** @brief Maximum number of UI overlay updates per second (0 = update every frame) */
+		float overlayRefreshRate = 30.0f;
 	} settings;
 
+	/** @brief CPU time spent in updateOverlay and in the command buffer rebuilds it triggers (in ms, moving average) */
+	struct {
+		float updateOverlay = 0.0f;
+		float buildCommandBuffers = 0.0f;
+	} overlayTimings;
+
 	VkClearColorValue defaultClearColor = { { 0.025f, 0.025f, 0.025f, 1.0f } };
 
 	float zoom = 0;
@@ -394,7 +419,6 @@ public:
 	void renderFrame();
 
 	void updateOverlay();
-	void drawUI(const VkCommandBuffer commandBuffer);
 
 	// Prepare the frame for workload submission
 	// - Acquires the next image from the swap chain 
@@ -2,6 +2,8 @@ glslangvalidator -V update_counter_begin.comp -o update_counter_begin.comp.spv
 glslangvalidator -V particle_emit.comp -o particle_emit.comp.spv
 glslangvalidator -V particle_simulate.comp -o particle_simulate.comp.spv
 glslangvalidator -V update_counter_end.comp -o update_counter_end.comp.spv
+glslangvalidator -V particle_sort_keys.comp -o particle_sort_keys.comp.spv
+glslangvalidator -V particle_sort_apply.comp -o particle_sort_apply.comp.spv
 glslangvalidator -V particle.frag -o particle.frag.spv
 glslangvalidator -V particle.vert -o particle.vert.spv
 glslangvalidator -V scene.frag -o scene.frag.spv
@@ -11,5 +11,7 @@ layout (location = 0) out vec4 FRAG_COLOR;
 void main () 
 {
 	vec3 color = texture(samplerGradientRamp, vec2(fGradientUV, 0.0)).rgb;
-	FRAG_COLOR.rgb = texture(samplerColorMap, gl_PointCoord).rgb * color;
+	vec4 particle = texture(samplerColorMap, gl_PointCoord);
+	// Alpha is only used by the depth sorted (alpha blended) pipeline
+	FRAG_COLOR = vec4(particle.rgb * color, particle.a);
 }
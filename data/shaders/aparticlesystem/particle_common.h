@@ -6,31 +6,34 @@ struct Particle
     float lifeMax;
 	vec3 vel;
     float life;
-	vec4 param0;//x:gradient U y:scale
+	vec4 param0;//x:gradient U y:scale w:emitter index
 };
-void SetVec4Element(inout uvec4 vec, uint mod_value, uint value) {
-    if(mod_value==0){
-        vec.x = value;
-    }else if(mod_value==1){
-        vec.y = value;
-    }else if(mod_value==2){
-        vec.z = value;
-    }else if(mod_value==3){
-        vec.w = value;
-    }
-}
 
-uint GetVec4Element(uvec4 vec, uint mod_value) {
-    if(mod_value==0){
-        return vec.x;
-    }else if(mod_value==1){
-        return vec.y;
-    }else if(mod_value==2){
-        return vec.z;
-    }else if(mod_value==3){
-        return vec.w;
-    }
-}
+// Per-emitter parameters, written by the host when an emitter changes
+struct EmitterParam
+{
+    mat4 transform;
+    uint particleOffset;//first slot of the emitter's range in the particle and dead list buffers
+    uint maxParticleCount;
+    uint emitCount;//particles emitted per interval
+    uint emitInterval;//(ms)
+    uint particleLifeMax;//(ms)
+    float randomSeed;
+    uint padding0;
+    uint padding1;
+};
 
-float rand(vec2 co){return fract(sin(dot(co.xy ,vec2(12.9898,78.233))) * 43758.5453);}
+// Per-emitter state, only written on the device
+struct EmitterState
+{
+    uint emitCount;//particles emitted this frame
+    uint emitOffset;//exclusive prefix sum of emitCount over all emitters
+    uint deadCount;
+    uint age;//(ms)
+    float deltaTime;//(ms)
+    uint emittedCount;
+    uint padding0;
+    uint padding1;
+};
 
+float rand(vec2 co){return fract(sin(dot(co.xy ,vec2(12.9898,78.233))) * 43758.5453);}
@@ -1,32 +1,43 @@
-layout (binding = 0) uniform UBOEmitter
+layout (binding = 0) uniform UBOFrame
 {
-	uint emitCount;
-	uint particleLifeMax;
+	float deltaT;
 	float randomSeed;
-	float padding2;
-} uboEmitter;
+	uint emitterCount;
+	int padding0;
+} uboFrame;
 
 //Particle storage buffer
 layout(std140, binding = 1) buffer SSBOParticle 
 {
     Particle particles[ ];
 }ssboParticle;
-layout(std140, binding = 2) buffer SSBODead
+layout(std430, binding = 2) buffer SSBODead
 {
-    uvec4 list[ ];
+    uint list[ ];
 }ssboDead;
-layout(std140, binding = 3) buffer SSBOAlive
+layout(std430, binding = 3) buffer SSBOAlive
 {
-    uvec4 list[ ];
+    uint list[ ];
 }ssboAlive;
-layout(std140, binding = 4) buffer SSBOAliveAfterSimulate
+layout(std430, binding = 4) buffer SSBOAliveAfterSimulate
 {
-    uvec4 list[ ];
+    uint list[ ];
 }ssboAliveAfterSimulate;
 layout(std140, binding = 5) buffer SSBOCounter
 {
     uint emitCount;
-    uint deadCount;
+    uint padding0;
     uint aliveCount;
     uint aliveCountAfterSimulate;
 }ssboCounter;
+layout(std430, binding = 6) readonly buffer SSBOEmitter
+{
+    EmitterParam emitters[ ];
+}ssboEmitter;
+layout(std430, binding = 7) buffer SSBOEmitterState
+{
+    EmitterState states[ ];
+}ssboEmitterState;
+
+// Random seed of the emitter currently being evaluated, used by the generated emission code
+float g_random_seed = 0.0;
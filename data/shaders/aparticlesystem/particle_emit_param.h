@@ -1,25 +1,429 @@
 //Hot Update Rigion
-vec3 GetEmitPosition(float particle_random)
+vec3 GetEmitPosition_0(float particle_random)
 {
 	return vec3(0, 0, 0);
 }
-float g_circle_radian =2.0;
-float GetCircleRadian(float particle_random)
+float g_circle_radian_0 =2.0;
+float GetCircleRadian_0(float particle_random)
 {
-	return rand(vec2(uboEmitter.randomSeed, particle_random)) * PI * g_circle_radian;
+	return rand(vec2(g_random_seed, particle_random)) * PI * g_circle_radian_0;
 }
-float g_cone_radian =1.0/6.0;
-float GetConeRadian(float particle_random)
+float g_cone_radian_0 =1.0/6.0;
+float GetConeRadian_0(float particle_random)
 {
-	return rand(vec2(uboEmitter.randomSeed+0.123251,particle_random+0.054385))*PI*g_cone_radian;
+	return rand(vec2(g_random_seed+0.123251,particle_random+0.054385))*PI*g_cone_radian_0;
 }
-vec3 GetEmitVelocity(float particle_random)
+vec3 GetEmitVelocity_0(float particle_random)
 {
-	float radian = GetCircleRadian(particle_random);
-	float cone_radian = GetConeRadian(particle_random);
+	float radian = GetCircleRadian_0(particle_random);
+	float cone_radian = GetConeRadian_0(particle_random);
 	vec3 vel = vec3(
 		sin(cone_radian) * sin(radian),
 		cos(cone_radian),
 		sin(cone_radian) * cos(radian));
 	return vel;
 }
+vec3 GetEmitPosition_1(float particle_random)
+{
+	return vec3(0, 0, 0);
+}
+float g_circle_radian_1 =2.0;
+float GetCircleRadian_1(float particle_random)
+{
+	return rand(vec2(g_random_seed, particle_random)) * PI * g_circle_radian_1;
+}
+float g_cone_radian_1 =1.0/6.0;
+float GetConeRadian_1(float particle_random)
+{
+	return rand(vec2(g_random_seed+0.123251,particle_random+0.054385))*PI*g_cone_radian_1;
+}
+vec3 GetEmitVelocity_1(float particle_random)
+{
+	float radian = GetCircleRadian_1(particle_random);
+	float cone_radian = GetConeRadian_1(particle_random);
+	vec3 vel = vec3(
+		sin(cone_radian) * sin(radian),
+		cos(cone_radian),
+		sin(cone_radian) * cos(radian));
+	return vel;
+}
+vec3 GetEmitPosition_2(float particle_random)
+{
+	return vec3(0, 0, 0);
+}
+float g_circle_radian_2 =2.0;
+float GetCircleRadian_2(float particle_random)
+{
+	return rand(vec2(g_random_seed, particle_random)) * PI * g_circle_radian_2;
+}
+float g_cone_radian_2 =1.0/6.0;
+float GetConeRadian_2(float particle_random)
+{
+	return rand(vec2(g_random_seed+0.123251,particle_random+0.054385))*PI*g_cone_radian_2;
+}
+vec3 GetEmitVelocity_2(float particle_random)
+{
+	float radian = GetCircleRadian_2(particle_random);
+	float cone_radian = GetConeRadian_2(particle_random);
+	vec3 vel = vec3(
+		sin(cone_radian) * sin(radian),
+		cos(cone_radian),
+		sin(cone_radian) * cos(radian));
+	return vel;
+}
+vec3 GetEmitPosition_3(float particle_random)
+{
+	return vec3(0, 0, 0);
+}
+float g_circle_radian_3 =2.0;
+float GetCircleRadian_3(float particle_random)
+{
+	return rand(vec2(g_random_seed, particle_random)) * PI * g_circle_radian_3;
+}
+float g_cone_radian_3 =1.0/6.0;
+float GetConeRadian_3(float particle_random)
+{
+	return rand(vec2(g_random_seed+0.123251,particle_random+0.054385))*PI*g_cone_radian_3;
+}
+vec3 GetEmitVelocity_3(float particle_random)
+{
+	float radian = GetCircleRadian_3(particle_random);
+	float cone_radian = GetConeRadian_3(particle_random);
+	vec3 vel = vec3(
+		sin(cone_radian) * sin(radian),
+		cos(cone_radian),
+		sin(cone_radian) * cos(radian));
+	return vel;
+}
+vec3 GetEmitPosition_4(float particle_random)
+{
+	return vec3(0, 0, 0);
+}
+float g_circle_radian_4 =2.0;
+float GetCircleRadian_4(float particle_random)
+{
+	return rand(vec2(g_random_seed, particle_random)) * PI * g_circle_radian_4;
+}
+float g_cone_radian_4 =1.0/6.0;
+float GetConeRadian_4(float particle_random)
+{
+	return rand(vec2(g_random_seed+0.123251,particle_random+0.054385))*PI*g_cone_radian_4;
+}
+vec3 GetEmitVelocity_4(float particle_random)
+{
+	float radian = GetCircleRadian_4(particle_random);
+	float cone_radian = GetConeRadian_4(particle_random);
+	vec3 vel = vec3(
+		sin(cone_radian) * sin(radian),
+		cos(cone_radian),
+		sin(cone_radian) * cos(radian));
+	return vel;
+}
+vec3 GetEmitPosition_5(float particle_random)
+{
+	return vec3(0, 0, 0);
+}
+float g_circle_radian_5 =2.0;
+float GetCircleRadian_5(float particle_random)
+{
+	return rand(vec2(g_random_seed, particle_random)) * PI * g_circle_radian_5;
+}
+float g_cone_radian_5 =1.0/6.0;
+float GetConeRadian_5(float particle_random)
+{
+	return rand(vec2(g_random_seed+0.123251,particle_random+0.054385))*PI*g_cone_radian_5;
+}
+vec3 GetEmitVelocity_5(float particle_random)
+{
+	float radian = GetCircleRadian_5(particle_random);
+	float cone_radian = GetConeRadian_5(particle_random);
+	vec3 vel = vec3(
+		sin(cone_radian) * sin(radian),
+		cos(cone_radian),
+		sin(cone_radian) * cos(radian));
+	return vel;
+}
+vec3 GetEmitPosition_6(float particle_random)
+{
+	return vec3(0, 0, 0);
+}
+float g_circle_radian_6 =2.0;
+float GetCircleRadian_6(float particle_random)
+{
+	return rand(vec2(g_random_seed, particle_random)) * PI * g_circle_radian_6;
+}
+float g_cone_radian_6 =1.0/6.0;
+float GetConeRadian_6(float particle_random)
+{
+	return rand(vec2(g_random_seed+0.123251,particle_random+0.054385))*PI*g_cone_radian_6;
+}
+vec3 GetEmitVelocity_6(float particle_random)
+{
+	float radian = GetCircleRadian_6(particle_random);
+	float cone_radian = GetConeRadian_6(particle_random);
+	vec3 vel = vec3(
+		sin(cone_radian) * sin(radian),
+		cos(cone_radian),
+		sin(cone_radian) * cos(radian));
+	return vel;
+}
+vec3 GetEmitPosition_7(float particle_random)
+{
+	return vec3(0, 0, 0);
+}
+float g_circle_radian_7 =2.0;
+float GetCircleRadian_7(float particle_random)
+{
+	return rand(vec2(g_random_seed, particle_random)) * PI * g_circle_radian_7;
+}
+float g_cone_radian_7 =1.0/6.0;
+float GetConeRadian_7(float particle_random)
+{
+	return rand(vec2(g_random_seed+0.123251,particle_random+0.054385))*PI*g_cone_radian_7;
+}
+vec3 GetEmitVelocity_7(float particle_random)
+{
+	float radian = GetCircleRadian_7(particle_random);
+	float cone_radian = GetConeRadian_7(particle_random);
+	vec3 vel = vec3(
+		sin(cone_radian) * sin(radian),
+		cos(cone_radian),
+		sin(cone_radian) * cos(radian));
+	return vel;
+}
+vec3 GetEmitPosition_8(float particle_random)
+{
+	return vec3(0, 0, 0);
+}
+float g_circle_radian_8 =2.0;
+float GetCircleRadian_8(float particle_random)
+{
+	return rand(vec2(g_random_seed, particle_random)) * PI * g_circle_radian_8;
+}
+float g_cone_radian_8 =1.0/6.0;
+float GetConeRadian_8(float particle_random)
+{
+	return rand(vec2(g_random_seed+0.123251,particle_random+0.054385))*PI*g_cone_radian_8;
+}
+vec3 GetEmitVelocity_8(float particle_random)
+{
+	float radian = GetCircleRadian_8(particle_random);
+	float cone_radian = GetConeRadian_8(particle_random);
+	vec3 vel = vec3(
+		sin(cone_radian) * sin(radian),
+		cos(cone_radian),
+		sin(cone_radian) * cos(radian));
+	return vel;
+}
+vec3 GetEmitPosition_9(float particle_random)
+{
+	return vec3(0, 0, 0);
+}
+float g_circle_radian_9 =2.0;
+float GetCircleRadian_9(float particle_random)
+{
+	return rand(vec2(g_random_seed, particle_random)) * PI * g_circle_radian_9;
+}
+float g_cone_radian_9 =1.0/6.0;
+float GetConeRadian_9(float particle_random)
+{
+	return rand(vec2(g_random_seed+0.123251,particle_random+0.054385))*PI*g_cone_radian_9;
+}
+vec3 GetEmitVelocity_9(float particle_random)
+{
+	float radian = GetCircleRadian_9(particle_random);
+	float cone_radian = GetConeRadian_9(particle_random);
+	vec3 vel = vec3(
+		sin(cone_radian) * sin(radian),
+		cos(cone_radian),
+		sin(cone_radian) * cos(radian));
+	return vel;
+}
+vec3 GetEmitPosition_10(float particle_random)
+{
+	return vec3(0, 0, 0);
+}
+float g_circle_radian_10 =2.0;
+float GetCircleRadian_10(float particle_random)
+{
+	return rand(vec2(g_random_seed, particle_random)) * PI * g_circle_radian_10;
+}
+float g_cone_radian_10 =1.0/6.0;
+float GetConeRadian_10(float particle_random)
+{
+	return rand(vec2(g_random_seed+0.123251,particle_random+0.054385))*PI*g_cone_radian_10;
+}
+vec3 GetEmitVelocity_10(float particle_random)
+{
+	float radian = GetCircleRadian_10(particle_random);
+	float cone_radian = GetConeRadian_10(particle_random);
+	vec3 vel = vec3(
+		sin(cone_radian) * sin(radian),
+		cos(cone_radian),
+		sin(cone_radian) * cos(radian));
+	return vel;
+}
+vec3 GetEmitPosition_11(float particle_random)
+{
+	return vec3(0, 0, 0);
+}
+float g_circle_radian_11 =2.0;
+float GetCircleRadian_11(float particle_random)
+{
+	return rand(vec2(g_random_seed, particle_random)) * PI * g_circle_radian_11;
+}
+float g_cone_radian_11 =1.0/6.0;
+float GetConeRadian_11(float particle_random)
+{
+	return rand(vec2(g_random_seed+0.123251,particle_random+0.054385))*PI*g_cone_radian_11;
+}
+vec3 GetEmitVelocity_11(float particle_random)
+{
+	float radian = GetCircleRadian_11(particle_random);
+	float cone_radian = GetConeRadian_11(particle_random);
+	vec3 vel = vec3(
+		sin(cone_radian) * sin(radian),
+		cos(cone_radian),
+		sin(cone_radian) * cos(radian));
+	return vel;
+}
+vec3 GetEmitPosition_12(float particle_random)
+{
+	return vec3(0, 0, 0);
+}
+float g_circle_radian_12 =2.0;
+float GetCircleRadian_12(float particle_random)
+{
+	return rand(vec2(g_random_seed, particle_random)) * PI * g_circle_radian_12;
+}
+float g_cone_radian_12 =1.0/6.0;
+float GetConeRadian_12(float particle_random)
+{
+	return rand(vec2(g_random_seed+0.123251,particle_random+0.054385))*PI*g_cone_radian_12;
+}
+vec3 GetEmitVelocity_12(float particle_random)
+{
+	float radian = GetCircleRadian_12(particle_random);
+	float cone_radian = GetConeRadian_12(particle_random);
+	vec3 vel = vec3(
+		sin(cone_radian) * sin(radian),
+		cos(cone_radian),
+		sin(cone_radian) * cos(radian));
+	return vel;
+}
+vec3 GetEmitPosition_13(float particle_random)
+{
+	return vec3(0, 0, 0);
+}
+float g_circle_radian_13 =2.0;
+float GetCircleRadian_13(float particle_random)
+{
+	return rand(vec2(g_random_seed, particle_random)) * PI * g_circle_radian_13;
+}
+float g_cone_radian_13 =1.0/6.0;
+float GetConeRadian_13(float particle_random)
+{
+	return rand(vec2(g_random_seed+0.123251,particle_random+0.054385))*PI*g_cone_radian_13;
+}
+vec3 GetEmitVelocity_13(float particle_random)
+{
+	float radian = GetCircleRadian_13(particle_random);
+	float cone_radian = GetConeRadian_13(particle_random);
+	vec3 vel = vec3(
+		sin(cone_radian) * sin(radian),
+		cos(cone_radian),
+		sin(cone_radian) * cos(radian));
+	return vel;
+}
+vec3 GetEmitPosition_14(float particle_random)
+{
+	return vec3(0, 0, 0);
+}
+float g_circle_radian_14 =2.0;
+float GetCircleRadian_14(float particle_random)
+{
+	return rand(vec2(g_random_seed, particle_random)) * PI * g_circle_radian_14;
+}
+float g_cone_radian_14 =1.0/6.0;
+float GetConeRadian_14(float particle_random)
+{
+	return rand(vec2(g_random_seed+0.123251,particle_random+0.054385))*PI*g_cone_radian_14;
+}
+vec3 GetEmitVelocity_14(float particle_random)
+{
+	float radian = GetCircleRadian_14(particle_random);
+	float cone_radian = GetConeRadian_14(particle_random);
+	vec3 vel = vec3(
+		sin(cone_radian) * sin(radian),
+		cos(cone_radian),
+		sin(cone_radian) * cos(radian));
+	return vel;
+}
+vec3 GetEmitPosition_15(float particle_random)
+{
+	return vec3(0, 0, 0);
+}
+float g_circle_radian_15 =2.0;
+float GetCircleRadian_15(float particle_random)
+{
+	return rand(vec2(g_random_seed, particle_random)) * PI * g_circle_radian_15;
+}
+float g_cone_radian_15 =1.0/6.0;
+float GetConeRadian_15(float particle_random)
+{
+	return rand(vec2(g_random_seed+0.123251,particle_random+0.054385))*PI*g_cone_radian_15;
+}
+vec3 GetEmitVelocity_15(float particle_random)
+{
+	float radian = GetCircleRadian_15(particle_random);
+	float cone_radian = GetConeRadian_15(particle_random);
+	vec3 vel = vec3(
+		sin(cone_radian) * sin(radian),
+		cos(cone_radian),
+		sin(cone_radian) * cos(radian));
+	return vel;
+}
+vec3 GetEmitPosition(uint emitter, float particle_random)
+{
+	switch (emitter) {
+	case 0: return GetEmitPosition_0(particle_random);
+	case 1: return GetEmitPosition_1(particle_random);
+	case 2: return GetEmitPosition_2(particle_random);
+	case 3: return GetEmitPosition_3(particle_random);
+	case 4: return GetEmitPosition_4(particle_random);
+	case 5: return GetEmitPosition_5(particle_random);
+	case 6: return GetEmitPosition_6(particle_random);
+	case 7: return GetEmitPosition_7(particle_random);
+	case 8: return GetEmitPosition_8(particle_random);
+	case 9: return GetEmitPosition_9(particle_random);
+	case 10: return GetEmitPosition_10(particle_random);
+	case 11: return GetEmitPosition_11(particle_random);
+	case 12: return GetEmitPosition_12(particle_random);
+	case 13: return GetEmitPosition_13(particle_random);
+	case 14: return GetEmitPosition_14(particle_random);
+	case 15: return GetEmitPosition_15(particle_random);
+	}
+	return vec3(0.0);
+}
+vec3 GetEmitVelocity(uint emitter, float particle_random)
+{
+	switch (emitter) {
+	case 0: return GetEmitVelocity_0(particle_random);
+	case 1: return GetEmitVelocity_1(particle_random);
+	case 2: return GetEmitVelocity_2(particle_random);
+	case 3: return GetEmitVelocity_3(particle_random);
+	case 4: return GetEmitVelocity_4(particle_random);
+	case 5: return GetEmitVelocity_5(particle_random);
+	case 6: return GetEmitVelocity_6(particle_random);
+	case 7: return GetEmitVelocity_7(particle_random);
+	case 8: return GetEmitVelocity_8(particle_random);
+	case 9: return GetEmitVelocity_9(particle_random);
+	case 10: return GetEmitVelocity_10(particle_random);
+	case 11: return GetEmitVelocity_11(particle_random);
+	case 12: return GetEmitVelocity_12(particle_random);
+	case 13: return GetEmitVelocity_13(particle_random);
+	case 14: return GetEmitVelocity_14(particle_random);
+	case 15: return GetEmitVelocity_15(particle_random);
+	}
+	return vec3(0.0, 1.0, 0.0);
+}
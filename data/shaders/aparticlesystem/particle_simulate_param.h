@@ -1,6 +1,88 @@
 #include "particle_simulate_declare.h"
 //Hot Update Rigion
-float GetParicleScale(uint index)
+float GetParicleScale_0(uint index)
+{
+	return  mix(3.0,1.0,GetParticleAge(index));
+}
+float GetParicleScale_1(uint index)
+{
+	return  mix(3.0,1.0,GetParticleAge(index));
+}
+float GetParicleScale_2(uint index)
+{
+	return  mix(3.0,1.0,GetParticleAge(index));
+}
+float GetParicleScale_3(uint index)
+{
+	return  mix(3.0,1.0,GetParticleAge(index));
+}
+float GetParicleScale_4(uint index)
+{
+	return  mix(3.0,1.0,GetParticleAge(index));
+}
+float GetParicleScale_5(uint index)
+{
+	return  mix(3.0,1.0,GetParticleAge(index));
+}
+float GetParicleScale_6(uint index)
+{
+	return  mix(3.0,1.0,GetParticleAge(index));
+}
+float GetParicleScale_7(uint index)
+{
+	return  mix(3.0,1.0,GetParticleAge(index));
+}
+float GetParicleScale_8(uint index)
 {
 	return  mix(3.0,1.0,GetParticleAge(index));
 }
+float GetParicleScale_9(uint index)
+{
+	return  mix(3.0,1.0,GetParticleAge(index));
+}
+float GetParicleScale_10(uint index)
+{
+	return  mix(3.0,1.0,GetParticleAge(index));
+}
+float GetParicleScale_11(uint index)
+{
+	return  mix(3.0,1.0,GetParticleAge(index));
+}
+float GetParicleScale_12(uint index)
+{
+	return  mix(3.0,1.0,GetParticleAge(index));
+}
+float GetParicleScale_13(uint index)
+{
+	return  mix(3.0,1.0,GetParticleAge(index));
+}
+float GetParicleScale_14(uint index)
+{
+	return  mix(3.0,1.0,GetParticleAge(index));
+}
+float GetParicleScale_15(uint index)
+{
+	return  mix(3.0,1.0,GetParticleAge(index));
+}
+float GetParicleScale(uint index)
+{
+	switch (uint(ssboParticle.particles[index].param0.w)) {
+	case 0: return GetParicleScale_0(index);
+	case 1: return GetParicleScale_1(index);
+	case 2: return GetParicleScale_2(index);
+	case 3: return GetParicleScale_3(index);
+	case 4: return GetParicleScale_4(index);
+	case 5: return GetParicleScale_5(index);
+	case 6: return GetParicleScale_6(index);
+	case 7: return GetParicleScale_7(index);
+	case 8: return GetParicleScale_8(index);
+	case 9: return GetParicleScale_9(index);
+	case 10: return GetParicleScale_10(index);
+	case 11: return GetParicleScale_11(index);
+	case 12: return GetParicleScale_12(index);
+	case 13: return GetParicleScale_13(index);
+	case 14: return GetParicleScale_14(index);
+	case 15: return GetParicleScale_15(index);
+	}
+	return 1.0;
+}
@@ -0,0 +1,32 @@
+#define THREADCOUNT_SORT 256
+// Key of unused sort slots, must match vks::BitonicSort::PADDING_KEY
+#define SORT_PADDING_KEY 0xFFFFFFFFu
+
+layout (binding = 0) uniform UBOSceneMatrices
+{
+	mat4 model;
+	mat4 view;
+	mat4 projection;
+} uboScene;
+
+//Particle storage buffer
+layout(std140, binding = 1) readonly buffer SSBOParticle 
+{
+    Particle particles[ ];
+}ssboParticle;
+layout(std430, binding = 2) buffer SSBOAliveAfterSimulate
+{
+    uint list[ ];
+}ssboAliveAfterSimulate;
+layout(std140, binding = 3) readonly buffer SSBOCounter
+{
+    uint emitCount;
+    uint padding0;
+    uint aliveCount;
+    uint aliveCountAfterSimulate;
+}ssboCounter;
+// x = key, y = particle index
+layout(std430, binding = 4) buffer SSBOSortPairs
+{
+    uvec2 pairs[ ];
+}ssboSort;
@@ -1,2 +1,11 @@
 glslangvalidator -V textoverlay.vert -o textoverlay.vert.spv
-glslangvalidator -V textoverlay.frag -o textoverlay.frag.spv
\ No newline at end of file
+glslangvalidator -V textoverlay.frag -o textoverlay.frag.spv
+glslangvalidator -V bitonicsort.comp -o bitonicsort.comp.spv
+glslangvalidator -V iblbrdflut.comp -o iblbrdflut.comp.spv
+glslangvalidator -V iblirradiance.comp -o iblirradiance.comp.spv
+glslangvalidator -V iblprefilter.comp -o iblprefilter.comp.spv
+glslangvalidator -V radixsort.comp -o radixsort.comp.spv
+glslangvalidator -V gpuculling.comp -o gpuculling.comp.spv
+glslangvalidator -V hizbuild.comp -o hizbuild.comp.spv
+glslangvalidator -V mipgenrgba8.comp -o mipgenrgba8.comp.spv
+glslangvalidator -V mipgenrgba16f.comp -o mipgenrgba16f.comp.spv
\ No newline at end of file
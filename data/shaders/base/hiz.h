@@ -0,0 +1,48 @@
+// Hierarchical depth occlusion tests against the pyramid built by hizbuild.comp, see base/VulkanHiZ.hpp
+// vks::HiZ::aabbOccluded and sphereOccluded are the CPU reference of these functions
+
+// Returns true if the world space box is behind the depth of all pixels it covers
+// depthSize = size of the depth buffer the pyramid was built from, viewProjection = matrix the depth buffer was rendered with
+bool hizAabbOccluded(sampler2D pyramid, ivec2 depthSize, int levelCount, mat4 viewProjection, vec3 aabbMin, vec3 aabbMax)
+{
+	vec3 ndcMin = vec3(1e30);
+	vec3 ndcMax = vec3(-1e30);
+	for (int i = 0; i < 8; i++) {
+		vec3 corner = vec3(((i & 1) != 0) ? aabbMax.x : aabbMin.x, ((i & 2) != 0) ? aabbMax.y : aabbMin.y, ((i & 4) != 0) ? aabbMax.z : aabbMin.z);
+		vec4 clip = viewProjection * vec4(corner, 1.0);
+		// Boxes reaching behind the camera are never occluded
+		if (clip.w <= 0.0) {
+			return false;
+		}
+		vec3 ndc = clip.xyz / clip.w;
+		ndcMin = min(ndcMin, ndc);
+		ndcMax = max(ndcMax, ndc);
+	}
+	// Boxes crossing the near plane are never occluded
+	if (ndcMin.z < 0.0) {
+		return false;
+	}
+
+	// Covered depth pixels
+	ivec2 pMin = min(ivec2(clamp(ndcMin.xy * 0.5 + 0.5, 0.0, 1.0) * vec2(depthSize)), depthSize - 1);
+	ivec2 pMax = min(ivec2(clamp(ndcMax.xy * 0.5 + 0.5, 0.0, 1.0) * vec2(depthSize)), depthSize - 1);
+
+	// Finest level at which the pixels are covered by at most 2x2 texels
+	int level = 0;
+	while ((level < levelCount - 1) && any(greaterThan((pMax >> (level + 1)) - (pMin >> (level + 1)), ivec2(1)))) {
+		level++;
+	}
+
+	ivec2 tMin = pMin >> (level + 1);
+	ivec2 tMax = pMax >> (level + 1);
+	float maxDepth = max(
+		max(texelFetch(pyramid, tMin, level).y, texelFetch(pyramid, ivec2(tMax.x, tMin.y), level).y),
+		max(texelFetch(pyramid, ivec2(tMin.x, tMax.y), level).y, texelFetch(pyramid, tMax, level).y));
+	return ndcMin.z > maxDepth;
+}
+
+// Tests the bounding box of the sphere
+bool hizSphereOccluded(sampler2D pyramid, ivec2 depthSize, int levelCount, mat4 viewProjection, vec3 center, float radius)
+{
+	return hizAabbOccluded(pyramid, depthSize, levelCount, viewProjection, center - vec3(radius), center + vec3(radius));
+}
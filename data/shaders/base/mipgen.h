@@ -0,0 +1,199 @@
+// Single pass mip chain generation, see base/VulkanMipGenerator.hpp
+// Included by mipgenrgba8.comp and mipgenrgba16f.comp, which define the storage format of the levels (MIP_FORMAT)
+// Every work group downsamples a 64x64 texel tile of the base level to the levels 1 - 6 (32x32 - 1x1 texels) in shared memory,
+// the last work group to finish downsamples level 6 to the levels 7 - 12 the same way
+
+#define GROUP_SIZE 256
+#define TILE_TEXELS 32
+#define LEVELS_PER_PASS 6
+
+layout (local_size_x = GROUP_SIZE) in;
+
+layout (binding = 0, MIP_FORMAT) uniform readonly image2D level0;
+// Separate bindings per level, selecting an array element with a non constant index would need shaderStorageImageArrayDynamicIndexing
+layout (binding = 1, MIP_FORMAT) uniform writeonly image2D level1;
+layout (binding = 2, MIP_FORMAT) uniform writeonly image2D level2;
+layout (binding = 3, MIP_FORMAT) uniform writeonly image2D level3;
+layout (binding = 4, MIP_FORMAT) uniform writeonly image2D level4;
+layout (binding = 5, MIP_FORMAT) uniform writeonly image2D level5;
+// Read back by the last work group
+layout (binding = 6, MIP_FORMAT) uniform coherent image2D level6;
+layout (binding = 7, MIP_FORMAT) uniform writeonly image2D level7;
+layout (binding = 8, MIP_FORMAT) uniform writeonly image2D level8;
+layout (binding = 9, MIP_FORMAT) uniform writeonly image2D level9;
+layout (binding = 10, MIP_FORMAT) uniform writeonly image2D level10;
+layout (binding = 11, MIP_FORMAT) uniform writeonly image2D level11;
+layout (binding = 12, MIP_FORMAT) uniform writeonly image2D level12;
+
+// Number of finished work groups, reset by the last one
+layout (std430, binding = 13) buffer Counter
+{
+	uint finishedGroups;
+};
+
+layout (push_constant) uniform PushConstants
+{
+	ivec2 baseSize;
+	uint levelCount;
+	uint groupCount;
+	// Tap weights 1.5 and 0.5 texels from the destination texel center, the box filter has an outer weight of 0
+	float kaiserOuter;
+	float kaiserInner;
+	uint srgb;
+} pc;
+
+// Linear values as half floats, a vec4 tile would take up all of the guaranteed 16 KB of shared memory
+shared uvec2 tile[TILE_TEXELS * TILE_TEXELS];
+shared bool lastGroup;
+
+ivec2 levelSize(uint level)
+{
+	return max(pc.baseSize >> level, ivec2(1));
+}
+
+vec4 srgbToLinear(vec4 color)
+{
+	vec3 linear = mix(pow((color.rgb + 0.055) / 1.055, vec3(2.4)), color.rgb / 12.92, lessThanEqual(color.rgb, vec3(0.04045)));
+	return vec4(linear, color.a);
+}
+
+vec4 linearToSrgb(vec4 color)
+{
+	vec3 srgb = mix(1.055 * pow(color.rgb, vec3(1.0 / 2.4)) - 0.055, color.rgb * 12.92, lessThanEqual(color.rgb, vec3(0.0031308)));
+	return vec4(srgb, color.a);
+}
+
+void storeTile(uint index, vec4 value)
+{
+	tile[index] = uvec2(packHalf2x16(value.rg), packHalf2x16(value.ba));
+}
+
+vec4 loadTile(uint index)
+{
+	return vec4(unpackHalf2x16(tile[index].x), unpackHalf2x16(tile[index].y));
+}
+
+// Texel of the base level or level 6 in linear space, positions outside of the level are clamped to its edge
+vec4 loadSource(bool fromBase, ivec2 pos)
+{
+	pos = clamp(pos, ivec2(0), levelSize(fromBase ? 0 : LEVELS_PER_PASS) - 1);
+	vec4 value = fromBase ? imageLoad(level0, pos) : imageLoad(level6, pos);
+	return (pc.srgb != 0) ? srgbToLinear(value) : value;
+}
+
+void storeLevel(uint level, ivec2 pos, vec4 value)
+{
+	if ((level > pc.levelCount) || any(greaterThanEqual(pos, levelSize(level)))) {
+		return;
+	}
+	vec4 texel = (pc.srgb != 0) ? linearToSrgb(value) : value;
+	switch (level) {
+		case 1: imageStore(level1, pos, texel); break;
+		case 2: imageStore(level2, pos, texel); break;
+		case 3: imageStore(level3, pos, texel); break;
+		case 4: imageStore(level4, pos, texel); break;
+		case 5: imageStore(level5, pos, texel); break;
+		case 6: imageStore(level6, pos, texel); break;
+		case 7: imageStore(level7, pos, texel); break;
+		case 8: imageStore(level8, pos, texel); break;
+		case 9: imageStore(level9, pos, texel); break;
+		case 10: imageStore(level10, pos, texel); break;
+		case 11: imageStore(level11, pos, texel); break;
+		case 12: imageStore(level12, pos, texel); break;
+	}
+}
+
+// Downsamples the source level (base level or level 6) at a texel of the next level
+vec4 downsampleSource(bool fromBase, ivec2 pos)
+{
+	ivec2 src = pos * 2;
+	if (pc.kaiserOuter == 0.0) {
+		return 0.25 * (loadSource(fromBase, src) + loadSource(fromBase, src + ivec2(1, 0)) + loadSource(fromBase, src + ivec2(0, 1)) + loadSource(fromBase, src + ivec2(1, 1)));
+	}
+	vec4 weights = vec4(pc.kaiserOuter, pc.kaiserInner, pc.kaiserInner, pc.kaiserOuter);
+	vec4 value = vec4(0.0);
+	for (int y = 0; y < 4; y++) {
+		for (int x = 0; x < 4; x++) {
+			value += weights[x] * weights[y] * loadSource(fromBase, src + ivec2(x - 1, y - 1));
+		}
+	}
+	return value;
+}
+
+// Downsamples the level in shared memory at a texel of the next level, srcSize is the number of texels of the source level in the tile
+// Positions outside of the tile or the level are clamped to their edge
+vec4 downsampleTile(ivec2 texel, int srcSize, ivec2 maxPos)
+{
+	ivec2 src = texel * 2;
+	if (pc.kaiserOuter == 0.0) {
+		ivec2 src1 = min(src + 1, maxPos);
+		return 0.25 * (loadTile(src.y * srcSize + src.x) + loadTile(src.y * srcSize + src1.x) + loadTile(src1.y * srcSize + src.x) + loadTile(src1.y * srcSize + src1.x));
+	}
+	vec4 weights = vec4(pc.kaiserOuter, pc.kaiserInner, pc.kaiserInner, pc.kaiserOuter);
+	vec4 value = vec4(0.0);
+	for (int y = 0; y < 4; y++) {
+		for (int x = 0; x < 4; x++) {
+			ivec2 pos = clamp(src + ivec2(x - 1, y - 1), ivec2(0), maxPos);
+			value += weights[x] * weights[y] * loadTile(pos.y * srcSize + pos.x);
+		}
+	}
+	return value;
+}
+
+// Downsamples the source (base level or level 6) to LEVELS_PER_PASS levels starting at firstLevel, origin is the first texel of firstLevel covered by the tile
+void downsamplePass(bool fromBase, ivec2 origin, uint firstLevel)
+{
+	uint local = gl_LocalInvocationIndex;
+	for (uint i = local; i < TILE_TEXELS * TILE_TEXELS; i += GROUP_SIZE) {
+		ivec2 pos = origin + ivec2(i % TILE_TEXELS, i / TILE_TEXELS);
+		vec4 value = downsampleSource(fromBase, pos);
+		storeTile(i, value);
+		storeLevel(firstLevel, pos, value);
+	}
+	barrier();
+	for (uint level = 1; level < LEVELS_PER_PASS; level++) {
+		// Same for all invocations
+		if (firstLevel + level > pc.levelCount) {
+			break;
+		}
+		int size = TILE_TEXELS >> level;
+		bool active = local < size * size;
+		ivec2 texel = ivec2(local % size, local / size);
+		vec4 value = vec4(0.0);
+		if (active) {
+			// Last texel of the source level inside the tile
+			ivec2 maxPos = max(min(ivec2(size * 2 - 1), levelSize(firstLevel + level - 1) - 1 - (origin >> (level - 1))), ivec2(0));
+			value = downsampleTile(texel, size * 2, maxPos);
+		}
+		// Downsampled in place, all reads of the previous level have to finish first
+		barrier();
+		if (active) {
+			storeTile(local, value);
+			storeLevel(firstLevel + level, (origin >> level) + texel, value);
+		}
+		barrier();
+	}
+}
+
+void main()
+{
+	downsamplePass(true, ivec2(gl_WorkGroupID.xy) * TILE_TEXELS, 1);
+	if (pc.levelCount <= LEVELS_PER_PASS) {
+		return;
+	}
+
+	// Make this group's level 6 texels visible before it's counted as finished
+	memoryBarrierImage();
+	barrier();
+	if (gl_LocalInvocationIndex == 0) {
+		lastGroup = (atomicAdd(finishedGroups, 1) == pc.groupCount - 1);
+	}
+	barrier();
+	if (!lastGroup) {
+		return;
+	}
+	if (gl_LocalInvocationIndex == 0) {
+		finishedGroups = 0;
+	}
+	downsamplePass(false, ivec2(0), LEVELS_PER_PASS + 1);
+}
@@ -0,0 +1,27 @@
+// Virtual texture feedback, see base/VulkanVirtualTexture.hpp
+// Page ids are packed like vks::VirtualPageId: 8 bit mip level, 12 bit page row, 12 bit page column
+
+#define VT_INVALID_PAGE 0xFFFFFFFFu
+
+// Page needed to sample uv at the given level of detail, VT_INVALID_PAGE for levels in the always resident mip tail
+// size = size of the first mip level, pageSize = sparse image granularity, pagedLevels = first level of the mip tail
+uint vtPageId(vec2 uv, float lod, uvec2 size, uvec2 pageSize, uint pagedLevels)
+{
+	uint level = uint(max(floor(lod), 0.0));
+	if (level >= pagedLevels) {
+		return VT_INVALID_PAGE;
+	}
+	uvec2 levelSize = max(size >> level, uvec2(1));
+	// Repeat addressing
+	uvec2 texel = min(uvec2(fract(uv) * vec2(levelSize)), levelSize - 1u);
+	uvec2 page = texel / pageSize;
+	return (level << 24) | (page.y << 12) | page.x;
+}
+
+// True for the one pixel of each blockSize x blockSize block that writes feedback in this frame
+// The pixel moves through the block from frame to frame, so all pixels are covered over blockSize^2 frames
+bool vtFeedbackPixel(ivec2 pixel, uint blockSize, uint frame)
+{
+	uint index = (frame * 37u) % (blockSize * blockSize);
+	return all(equal(uvec2(pixel) % blockSize, uvec2(index % blockSize, index / blockSize)));
+}
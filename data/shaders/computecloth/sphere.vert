@@ -14,6 +14,11 @@ layout (binding = 0) uniform UBO
 	vec4 lightPos;
 } ubo;
 
+// xyz = position, w = radius
+layout (push_constant) uniform PushConsts {
+	vec4 sphere;
+} pushConsts;
+
 out gl_PerVertex
 {
 	vec4 gl_Position;
@@ -21,9 +26,9 @@ out gl_PerVertex
 
 void main () 
 {
-	vec4 eyePos = ubo.modelview * vec4(inPos.x, inPos.y, inPos.z, 1.0); 
+	vec4 pos = vec4(pushConsts.sphere.xyz + inPos * pushConsts.sphere.w, 1.0);
+	vec4 eyePos = ubo.modelview * pos;
 	gl_Position = ubo.projection * eyePos;
-	vec4 pos = vec4(inPos, 1.0);
 	vec3 lPos = ubo.lightPos.xyz;
 	outLightVec = lPos - pos.xyz;
 	outViewVec = -pos.xyz;
@@ -8,65 +8,110 @@ layout (location = 0) in vec2 inUV;
 
 layout (location = 0) out vec4 outFragcolor;
 
+// Cluster grid, must match the example and the other shaders
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+
+// Only shade the lights assigned to the fragment's cluster by the light culling pass instead of all lights
+layout (constant_id = 0) const bool CLUSTERED = false;
+
 struct Light {
 	vec4 position;
 	vec3 color;
 	float radius;
 };
 
-layout (binding = 4) uniform UBO 
+layout (binding = 4) uniform UBO
 {
-	Light lights[6];
+	mat4 view;
 	vec4 viewPos;
+	uint lightCount;
+	float zNear;
+	float zFar;
+	uint maxLightIndices;
 } ubo;
 
+layout (std430, binding = 5) readonly buffer Lights {
+	Light lights[];
+};
+
+layout (std430, binding = 6) readonly buffer LightGrid {
+	uvec2 lightGrid[];
+};
+
+layout (std430, binding = 7) readonly buffer LightIndices {
+	uint lightIndexCount;
+	uint lightIndices[];
+};
+
+vec3 shadeLight(uint index, vec3 fragPos, vec3 N, vec3 V, vec4 albedo)
+{
+	// Vector to light
+	vec3 L = lights[index].position.xyz - fragPos;
+	// Distance from light to fragment position
+	float dist = length(L);
+	if (dist >= lights[index].radius) {
+		return vec3(0.0);
+	}
+
+	// Light to fragment
+	L = normalize(L);
 
-void main() 
+	// Attenuation, inverse square falloff windowed to reach zero at the light's radius
+	float window = clamp(1.0 - pow(dist / lights[index].radius, 4.0), 0.0, 1.0);
+	float atten = window * window / (dist * dist + 1.0);
+
+	// Diffuse part
+	float NdotL = max(0.0, dot(N, L));
+	vec3 diff = lights[index].color * albedo.rgb * NdotL * atten;
+
+	// Specular part
+	// Specular map values are stored in alpha of albedo mrt
+	vec3 R = reflect(-L, N);
+	float NdotR = max(0.0, dot(R, V));
+	vec3 spec = lights[index].color * albedo.a * pow(NdotR, 16.0) * atten;
+
+	return diff + spec;
+}
+
+void main()
 {
 	// Get G-Buffer values
 	vec3 fragPos = texture(samplerposition, inUV).rgb;
 	vec3 normal = texture(samplerNormal, inUV).rgb;
 	vec4 albedo = texture(samplerAlbedo, inUV);
-	
-	#define lightCount 6
+
 	#define ambient 0.0
-	
+
 	// Ambient part
 	vec3 fragcolor  = albedo.rgb * ambient;
-	
-	for(int i = 0; i < lightCount; ++i)
-	{
-		// Vector to light
-		vec3 L = ubo.lights[i].position.xyz - fragPos;
-		// Distance from light to fragment position
-		float dist = length(L);
-
-		// Viewer to fragment
-		vec3 V = ubo.viewPos.xyz - fragPos;
-		V = normalize(V);
-		
-		//if(dist < ubo.lights[i].radius)
-		{
-			// Light to fragment
-			L = normalize(L);
-
-			// Attenuation
-			float atten = ubo.lights[i].radius / (pow(dist, 2.0) + 1.0);
-
-			// Diffuse part
-			vec3 N = normalize(normal);
-			float NdotL = max(0.0, dot(N, L));
-			vec3 diff = ubo.lights[i].color * albedo.rgb * NdotL * atten;
-
-			// Specular part
-			// Specular map values are stored in alpha of albedo mrt
-			vec3 R = reflect(-L, N);
-			float NdotR = max(0.0, dot(R, V));
-			vec3 spec = ubo.lights[i].color * albedo.a * pow(NdotR, 16.0) * atten;
-
-			fragcolor += diff + spec;	
-		}	
-	}    	
-   
-  outFragcolor = vec4(fragcolor, 1.0);	
-}
\ No newline at end of file
+
+	// Background
+	if (dot(normal, normal) == 0.0) {
+		outFragcolor = vec4(fragcolor, 1.0);
+		return;
+	}
+
+	vec3 N = normalize(normal);
+	// Viewer to fragment
+	vec3 V = normalize(ubo.viewPos.xyz - fragPos);
+
+	if (CLUSTERED) {
+		// Same depth slicing as the cluster bounds (positions in the G-Buffer have y flipped)
+		float depth = -(ubo.view * vec4(fragPos * vec3(1.0, -1.0, 1.0), 1.0)).z;
+		int slice = int(floor(log(depth / ubo.zNear) / log(ubo.zFar / ubo.zNear) * float(CLUSTER_Z)));
+		ivec2 tile = ivec2(inUV * vec2(CLUSTER_X, CLUSTER_Y));
+		ivec3 cluster = clamp(ivec3(tile, slice), ivec3(0), ivec3(CLUSTER_X - 1, CLUSTER_Y - 1, CLUSTER_Z - 1));
+		uvec2 range = lightGrid[(cluster.z * CLUSTER_Y + cluster.y) * CLUSTER_X + cluster.x];
+		for (uint i = 0; i < range.y; i++) {
+			fragcolor += shadeLight(lightIndices[range.x + i], fragPos, N, V, albedo);
+		}
+	} else {
+		for (uint i = 0; i < ubo.lightCount; i++) {
+			fragcolor += shadeLight(i, fragPos, N, V, albedo);
+		}
+	}
+
+	outFragcolor = vec4(fragcolor, 1.0);
+}
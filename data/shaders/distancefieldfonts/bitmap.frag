@@ -1,12 +1,13 @@
 #version 450
 
-layout (binding = 1) uniform sampler2D samplerColor;
+layout (binding = 1) uniform sampler2DArray samplerColor;
 
-layout (location = 0) in vec2 inUV;
+layout (location = 0) in vec3 inUV;
+layout (location = 1) in vec4 inColor;
 
 layout (location = 0) out vec4 outFragColor;
 
 void main() 
 {
-	outFragColor = vec4(texture(samplerColor, inUV).a);
+	outFragColor = vec4(inColor.rgb, 1.0) * texture(samplerColor, inUV).a;
 }
\ No newline at end of file
@@ -1,7 +1,10 @@
 #version 450
 
-layout (location = 0) in vec3 inPos;
-layout (location = 1) in vec2 inUV;
+// Per-instance glyph attributes
+layout (location = 0) in vec4 inRect;
+layout (location = 1) in vec4 inUV;
+layout (location = 2) in uint inLayer;
+layout (location = 3) in vec4 inColor;
 
 layout (binding = 0) uniform UBO 
 {
@@ -9,10 +12,14 @@ layout (binding = 0) uniform UBO
 	mat4 model;
 } ubo;
 
-layout (location = 0) out vec2 outUV;
+layout (location = 0) out vec3 outUV;
+layout (location = 1) out vec4 outColor;
 
 void main() 
 {
-	outUV = inUV;
-	gl_Position = ubo.projection * ubo.model * vec4(inPos.xyz, 1.0);
+	// Quad corner from the glyph quad's vertex index
+	vec2 corner = vec2(gl_VertexIndex & 1, (gl_VertexIndex >> 1) & 1);
+	outUV = vec3(mix(inUV.xy, inUV.zw, corner), float(inLayer));
+	outColor = inColor;
+	gl_Position = ubo.projection * ubo.model * vec4(mix(inRect.xy, inRect.zw, corner), 0.0, 1.0);
 }
@@ -7,11 +7,15 @@ layout (location = 2) in vec3 inColor;
 layout (binding = 0) uniform UBO 
 {
 	mat4 projection;
-	mat4 modelview;
+	mat4 view;
 	vec4 lightPos;
-	float visible;
 } ubo;
 
+layout (push_constant) uniform PushConsts {
+	mat4 model;
+	float visible;
+} pushConsts;
+
 layout (location = 0) out vec3 outNormal;
 layout (location = 1) out vec3 outColor;
 layout (location = 2) out float outVisible;
@@ -25,14 +29,15 @@ out gl_PerVertex
 
 void main() 
 {
-	outNormal = inNormal;
+	mat4 modelView = ubo.view * pushConsts.model;
+
 	outColor = inColor;
-	outVisible = ubo.visible;
+	outVisible = pushConsts.visible;
 	
-	gl_Position = ubo.projection * ubo.modelview * vec4(inPos.xyz, 1.0);
+	gl_Position = ubo.projection * modelView * vec4(inPos.xyz, 1.0);
 	
-    vec4 pos = ubo.modelview * vec4(inPos, 1.0);
-    outNormal = mat3(ubo.modelview) * inNormal;
-    outLightVec = ubo.lightPos.xyz - pos.xyz;
-    outViewVec = -pos.xyz;
+	vec4 pos = modelView * vec4(inPos, 1.0);
+	outNormal = mat3(modelView) * inNormal;
+	outLightVec = ubo.lightPos.xyz - pos.xyz;
+	outViewVec = -pos.xyz;
 }
\ No newline at end of file
@@ -7,10 +7,15 @@ layout (location = 2) in vec3 inColor;
 layout (binding = 0) uniform UBO 
 {
 	mat4 projection;
-	mat4 modelview;
+	mat4 view;
 	vec4 lightPos;
 } ubo;
 
+layout (push_constant) uniform PushConsts {
+	mat4 model;
+	float visible;
+} pushConsts;
+
 layout (location = 0) out vec3 outColor;
 
 out gl_PerVertex
@@ -21,5 +26,5 @@ out gl_PerVertex
 void main() 
 {
 	outColor = inColor;
-	gl_Position = ubo.projection * ubo.modelview * vec4(inPos.xyz, 1.0);
+	gl_Position = ubo.projection * ubo.view * pushConsts.model * vec4(inPos.xyz, 1.0);
 }
\ No newline at end of file
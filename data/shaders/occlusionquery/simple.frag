@@ -1,10 +1,6 @@
 #version 450
 
-layout (location = 0) in vec3 inColor;
-
-layout (location = 0) out vec4 outFragColor;
-
+// Proxies only write samples for the occlusion query, color writes are disabled
 void main() 
 {
-    outFragColor = vec4(1.0);	
 }
\ No newline at end of file
@@ -1,15 +1,19 @@
 #version 450
 
+// Unit cube scaled to an object's bounding box for the occlusion query proxies
 layout (location = 0) in vec3 inPos;
 
 layout (binding = 0) uniform UBO 
 {
 	mat4 projection;
-	mat4 modelview;
+	mat4 view;
 	vec4 lightPos;
 } ubo;
 
-layout (location = 0) out vec3 outColor;
+layout (push_constant) uniform PushConsts {
+	vec4 min;
+	vec4 max;
+} pushConsts;
 
 out gl_PerVertex
 {
@@ -18,5 +22,6 @@ out gl_PerVertex
 
 void main() 
 {
-	gl_Position = ubo.projection * ubo.modelview * vec4(inPos.xyz, 1.0);
+	vec3 pos = mix(pushConsts.min.xyz, pushConsts.max.xyz, inPos);
+	gl_Position = ubo.projection * ubo.view * vec4(pos, 1.0);
 }
\ No newline at end of file
@@ -4,4 +4,7 @@ glslangvalidator -V skysphere.vert -o skysphere.vert.spv
 glslangvalidator -V skysphere.frag -o skysphere.frag.spv
 glslangvalidator -V terrain.tesc -o terrain.tesc.spv
 glslangvalidator -V terrain.tese -o terrain.tese.spv
-
+glslangvalidator -V terrain_chunk.vert -o terrain_chunk.vert.spv
+glslangvalidator -V -DSTREAMING terrain.tesc -o terrain_streaming.tesc.spv
+glslangvalidator -V -DSTREAMING terrain.tese -o terrain_streaming.tese.spv
+glslangvalidator -V -DSTREAMING terrain.frag -o terrain_streaming.frag.spv
@@ -1,6 +1,7 @@
 #version 450
+#extension GL_GOOGLE_include_directive : enable
 
-layout (set = 0, binding = 1) uniform sampler2D samplerHeight; 
+#include "terrain_height.h"
 layout (set = 0, binding = 2) uniform sampler2DArray samplerLayers;
 
 layout (location = 0) in vec3 inNormal;
@@ -26,7 +27,7 @@ vec3 sampleTerrainLayer()
 	vec3 color = vec3(0.0);
 	
 	// Get height from displacement map
-	float height = textureLod(samplerHeight, inUV, 0.0).r * 255.0;
+	float height = sampleHeight(inUV) * 255.0;
 	
 	for (int i = 0; i < 6; i++)
 	{
@@ -0,0 +1,65 @@
+#version 450
+
+layout (location = 0) in float inHeight;
+layout (location = 1) in vec2 inNormal;
+
+layout (set = 0, binding = 0) uniform UBO 
+{
+	mat4 projection;
+	mat4 modelview;
+	vec4 lightPos;
+	vec4 frustumPlanes[6];
+	float displacementFactor;
+	float tessellationFactor;
+	vec2 viewportDim;
+	float tessellatedEdgeSize;
+} ubo; 
+
+layout (push_constant) uniform PushConsts {
+	vec2 origin;
+	float spacing;
+	float heightScale;
+	float skirtDepth;
+	uint chunkSize;
+	uint chunksPerRow;
+	float uvScale;
+} chunk;
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec2 outUV;
+layout (location = 2) out vec3 outViewVec;
+layout (location = 3) out vec3 outLightVec;
+layout (location = 4) out vec3 outEyePos;
+layout (location = 5) out vec3 outWorldPos;
+
+void main()
+{
+	// Grid position is derived from the vertex index, each chunk has (size + 1)^2 grid vertices followed by the skirt vertices
+	uint row = chunk.chunkSize + 1;
+	uint vertexCount = row * row + 4 * row;
+	uint chunkIndex = uint(gl_VertexIndex) / vertexCount;
+	uint local = uint(gl_VertexIndex) % vertexCount;
+
+	uvec2 grid;
+	float skirt = 0.0;
+	if (local < row * row) {
+		grid = uvec2(local % row, local / row);
+	} else {
+		uint side = (local - row * row) / row;
+		uint t = (local - row * row) % row;
+		grid = (side == 0) ? uvec2(t, 0) : (side == 1) ? uvec2(t, chunk.chunkSize) : (side == 2) ? uvec2(0, t) : uvec2(chunk.chunkSize, t);
+		skirt = chunk.skirtDepth;
+	}
+	grid += uvec2(chunkIndex % chunk.chunksPerRow, chunkIndex / chunk.chunksPerRow) * chunk.chunkSize;
+
+	vec4 pos = vec4(chunk.origin.x + grid.x * chunk.spacing, -inHeight * chunk.heightScale + skirt, chunk.origin.y + grid.y * chunk.spacing, 1.0);
+	gl_Position = ubo.projection * ubo.modelview * pos;
+
+	outUV = vec2(grid) * chunk.uvScale;
+	outNormal = vec3(inNormal.x, sqrt(max(1.0 - dot(inNormal, inNormal), 0.0)), inNormal.y);
+
+	outViewVec = -pos.xyz;
+	outLightVec = normalize(ubo.lightPos.xyz + outViewVec);
+	outWorldPos = pos.xyz;
+	outEyePos = vec3(ubo.modelview * pos);
+}
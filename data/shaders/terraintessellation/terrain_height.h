@@ -0,0 +1,42 @@
+// Height sampling shared by the terrain shaders
+// STREAMING samples the tiles streamed by vks::TerrainStreamer instead of a single height map
+
+#ifdef STREAMING
+
+layout (set = 0, binding = 1) uniform sampler2DArray samplerTiles;
+layout (set = 0, binding = 3) uniform sampler2D samplerOverview;
+layout (set = 0, binding = 4) readonly buffer TileTable
+{
+	uint tilesPerRow;
+	uint tileSize;
+	uint dim;
+	uint reserved;
+	// Array layer of each tile, -1 if the tile is not resident
+	int layers[];
+} tileTable;
+
+float sampleHeight(vec2 uv)
+{
+	uv = clamp(uv, 0.0, 1.0);
+	vec2 pos = uv * float(tileTable.dim - 1);
+	uvec2 tile = min(uvec2(pos / float(tileTable.tileSize)), uvec2(tileTable.tilesPerRow - 1));
+	int layer = tileTable.layers[tile.x + tile.y * tileTable.tilesPerRow];
+	if (layer < 0) {
+		// Fall back to the low resolution overview until the tile has been streamed in
+		return textureLod(samplerOverview, uv, 0.0).r;
+	}
+	// Tiles store tileSize + 1 samples per side, the outer ones are shared with the neighbours
+	vec2 local = pos - vec2(tile * tileTable.tileSize);
+	return textureLod(samplerTiles, vec3((local + 0.5) / float(tileTable.tileSize + 1), float(layer)), 0.0).r;
+}
+
+#else
+
+layout (set = 0, binding = 1) uniform sampler2D samplerHeight;
+
+float sampleHeight(vec2 uv)
+{
+	return textureLod(samplerHeight, uv, 0.0).r;
+}
+
+#endif
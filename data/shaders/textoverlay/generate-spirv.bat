@@ -0,0 +1,5 @@
+glslangvalidator -V mesh.vert -o mesh.vert.spv
+glslangvalidator -V mesh.frag -o mesh.frag.spv
+
+glslangvalidator -V text.vert -o text.vert.spv
+glslangvalidator -V text.frag -o text.frag.spv
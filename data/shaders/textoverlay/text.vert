@@ -1,9 +1,17 @@
 #version 450 core
 
-layout (location = 0) in vec2 inPos;
-layout (location = 1) in vec2 inUV;
+// Per-instance glyph attributes
+layout (location = 0) in vec4 inRect;
+layout (location = 1) in vec4 inUV;
+layout (location = 2) in vec4 inColor;
+
+layout (push_constant) uniform PushConsts {
+	// Converts framebuffer pixels to normalized device coordinates
+	vec2 pixelScale;
+} pushConsts;
 
 layout (location = 0) out vec2 outUV;
+layout (location = 1) out vec4 outColor;
 
 out gl_PerVertex 
 {
@@ -12,6 +20,10 @@ out gl_PerVertex
 
 void main(void)
 {
-	gl_Position = vec4(inPos, 0.0, 1.0);
-	outUV = inUV;
+	// Quad corner from the glyph quad's vertex index (0 = top left .. 3 = bottom right)
+	vec2 corner = vec2(gl_VertexIndex & 1, (gl_VertexIndex >> 1) & 1);
+	vec2 pos = mix(inRect.xy, inRect.zw, corner);
+	gl_Position = vec4(pos * pushConsts.pixelScale - 1.0, 0.0, 1.0);
+	outUV = mix(inUV.xy, inUV.zw, corner);
+	outColor = inColor;
 }
@@ -2,9 +2,36 @@
 
 #extension GL_ARB_sparse_texture2 : enable
 #extension GL_ARB_sparse_texture_clamp : enable
+#extension GL_GOOGLE_include_directive : enable
+
+#include "../base/virtualtexture.h"
+
+// Feedback writes are side effects, only visible fragments must write them
+layout (early_fragment_tests) in;
+
+layout (binding = 0) uniform UBO 
+{
+	mat4 projection;
+	mat4 model;
+	vec4 viewPos;
+	float lodBias;
+	uint feedbackFrame;
+	uint feedbackWidth;
+	uint feedbackBlockSize;
+	// xy = size of the virtual texture, zw = page size
+	uvec4 virtualSize;
+	uint pagedLevels;
+	uint showPages;
+} ubo;
 
 layout (binding = 1) uniform sampler2D samplerColor;
 
+// Page ids needed by the frame, read back by the CPU
+layout (std430, binding = 2) writeonly buffer Feedback
+{
+	uint feedback[];
+};
+
 layout (location = 0) in vec2 inUV;
 layout (location = 1) in float inLodBias;
 layout (location = 2) in vec3 inNormal;
@@ -15,25 +42,31 @@ layout (location = 0) out vec4 outFragColor;
 
 void main() 
 {
+	float lod = textureQueryLod(samplerColor, inUV).y + inLodBias;
+
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	if (vtFeedbackPixel(pixel, ubo.feedbackBlockSize, ubo.feedbackFrame)) {
+		ivec2 block = pixel / int(ubo.feedbackBlockSize);
+		feedback[block.y * ubo.feedbackWidth + block.x] = vtPageId(inUV, lod, ubo.virtualSize.xy, ubo.virtualSize.zw, ubo.pagedLevels);
+	}
+
 	vec4 color = vec4(0.0);
 
 	// Get residency code for current texel
 	int residencyCode = sparseTextureARB(samplerColor, inUV, color, inLodBias);
 
-	// Fetch sparse until we get a valid texel
-	float minLod = 1.0;
+	// Fall back to coarser levels until we get a resident texel, the mip tail is always resident
+	float minLod = max(floor(lod), 0.0) + 1.0;
 	while (!sparseTexelsResidentARB(residencyCode)) 
 	{
 		residencyCode = sparseTextureClampARB(samplerColor, inUV, minLod, color);
 		minLod += 1.0f;
 	} 
 
-	// Check if texel is resident
-	bool texelResident = sparseTexelsResidentARB(residencyCode);
-
-	if (!texelResident)
-	{
-		color = vec4(1.0, 0.0, 0.0, 0.0);
+	// Tint by the resolution actually sampled
+	if (ubo.showPages != 0) {
+		const vec3 tints[4] = vec3[](vec3(1.0, 0.4, 0.4), vec3(0.4, 1.0, 0.4), vec3(0.4, 0.4, 1.0), vec3(1.0, 1.0, 0.4));
+		color.rgb *= tints[int(max(minLod - 1.0, 0.0)) % 4];
 	}
 
 	vec3 N = normalize(inNormal);
@@ -44,4 +77,4 @@ void main()
 	vec3 R = reflect(-L, N);
 	vec3 diffuse = max(dot(N, L), 0.25) * color.rgb;
 	outFragColor = vec4(diffuse, 1.0);	
-}
\ No newline at end of file
+}
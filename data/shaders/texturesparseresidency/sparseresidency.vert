@@ -10,6 +10,12 @@ layout (binding = 0) uniform UBO
 	mat4 model;
 	vec4 viewPos;
 	float lodBias;
+	uint feedbackFrame;
+	uint feedbackWidth;
+	uint feedbackBlockSize;
+	uvec4 virtualSize;
+	uint pagedLevels;
+	uint showPages;
 } ubo;
 
 layout (location = 0) out vec2 outUV;
@@ -20,6 +20,8 @@
 #include "vulkanexamplebase.h"
 #include "VulkanTexture.hpp"
 #include "VulkanModel.hpp"
+#include "VulkanBitonicSort.hpp"
+#include "VulkanAsyncCompute.hpp"
 
 #define ENABLE_VALIDATION true
 
@@ -30,6 +32,10 @@
 #else
 #define MAX_PARTICLE_COUNT 256 * 1024
 #endif
+// Number of emitters batched into the shared particle buffers
+#define EMITTER_COUNT 16
+// Indirect dispatch commands reserved for the depth sort stages (must match update_counter_end.comp)
+#define SORT_STAGE_COUNT 16
 #define PI 3.1415926535898f
 
 
@@ -56,7 +62,8 @@ class CEmitShape
 public:
 	void SetEmitShape(EmitShape shape) { m_emit_shape = shape; };
 	EmitShape GetEmitShape() { return m_emit_shape; };
-	virtual std::string GetPositionCode() = 0;
+	// suffix makes the generated names unique per emitter
+	virtual std::string GetPositionCode(const std::string& suffix) = 0;
 private:
 	EmitShape m_emit_shape = ES_POINT;
 };
@@ -66,10 +73,10 @@ class CEmitShapePoint: public CEmitShape
 public:
 	CEmitShapePoint() { SetEmitShape(ES_POINT); };
 	~CEmitShapePoint() {};
-	std::string GetPositionCode()
+	std::string GetPositionCode(const std::string& suffix)
 	{
 		std::string str;
-		str += "vec3 GetEmitPosition(float particle_random)\n\
+		str += "vec3 GetEmitPosition" + suffix + "(float particle_random)\n\
 {\n\
 	return vec3(0, 0, 0);\n\
 }\n";
@@ -82,7 +89,7 @@ class CEmitShapeRing : public CEmitShape
 public:
 	CEmitShapeRing() { SetEmitShape(ES_RING); };
 	~CEmitShapeRing() {};
-	std::string GetPositionCode() { return ""; };
+	std::string GetPositionCode(const std::string& suffix) { return ""; };
 private:
 	float m_radius=0;
 };
@@ -97,7 +104,8 @@ class CVelocityType
 public:
 	void SetVelocityType(VelocityType velocity) { m_emit_velocity = velocity; };
 	VelocityType GetVelocityType() { return m_emit_velocity; };
-	virtual std::string GetVelocityCode() = 0;
+	// suffix makes the generated names unique per emitter
+	virtual std::string GetVelocityCode(const std::string& suffix) = 0;
 private:
 	VelocityType m_emit_velocity = VT_CONE;
 };
@@ -108,38 +116,38 @@ public:
 	CVelocityTypeCone() { SetVelocityType(VT_CONE); };
 	~CVelocityTypeCone() {};
 
-	std::string GetRadianCode()
+	std::string GetRadianCode(const std::string& suffix)
 	{
 		std::string str;
-		str += "float g_circle_radian ="+ m_radian_str +";\n";
-		str += "float GetCircleRadian(float particle_random)\n\
+		str += "float g_circle_radian" + suffix + " =" + m_radian_str + ";\n";
+		str += "float GetCircleRadian" + suffix + "(float particle_random)\n\
 {\n\
-	return rand(vec2(uboEmitter.randomSeed, particle_random)) * PI * g_circle_radian;\n\
+	return rand(vec2(g_random_seed, particle_random)) * PI * g_circle_radian" + suffix + ";\n\
 }\n";
 		return str;
 	}
-	std::string GetConeRadianCode()
+	std::string GetConeRadianCode(const std::string& suffix)
 	{
 		std::string str;
-		str += "float g_cone_radian =" + m_cone_radian_str + ";\n";
-		str += "float GetConeRadian(float particle_random)\n\
+		str += "float g_cone_radian" + suffix + " =" + m_cone_radian_str + ";\n";
+		str += "float GetConeRadian" + suffix + "(float particle_random)\n\
 {\n\
-	return rand(vec2(uboEmitter.randomSeed+0.123251,particle_random+0.054385))*PI*g_cone_radian;\n\
+	return rand(vec2(g_random_seed+0.123251,particle_random+0.054385))*PI*g_cone_radian" + suffix + ";\n\
 }\n";
 		return str;
 	}
-	std::string GetVelocityCode()
+	std::string GetVelocityCode(const std::string& suffix)
 	{
 		//todo:transfer to bytecode and interprete
 		//std::string str="vec3(sin("+m_cone_radian_code +") * sin(" + m_radian_code + "), cos(" + m_cone_radian_code + "), sin(" + m_cone_radian_code + ")* cos(" + m_radian_code + "))";
 
 		std::string str;
-		str += GetRadianCode();
-		str += GetConeRadianCode();
-		str+= "vec3 GetEmitVelocity(float particle_random)\n\
+		str += GetRadianCode(suffix);
+		str += GetConeRadianCode(suffix);
+		str += "vec3 GetEmitVelocity" + suffix + "(float particle_random)\n\
 {\n\
-	float radian = GetCircleRadian(particle_random);\n\
-	float cone_radian = GetConeRadian(particle_random);\n\
+	float radian = GetCircleRadian" + suffix + "(particle_random);\n\
+	float cone_radian = GetConeRadian" + suffix + "(particle_random);\n\
 	vec3 vel = vec3(\n\
 		sin(cone_radian) * sin(radian),\n\
 		cos(cone_radian),\n\
@@ -165,7 +173,7 @@ class CVelocityTypeRadial : public CVelocityType
 public:
 	CVelocityTypeRadial() { SetVelocityType(VT_RADIAL); };
 	~CVelocityTypeRadial() {};
-	std::string GetVelocityCode() { return ""; };
+	std::string GetVelocityCode(const std::string& suffix) { return ""; };
 };
 
 class CParticleScale
@@ -173,13 +181,14 @@ class CParticleScale
 public:
 	void SetParticleScale(const std::string& str) { m_scale_str = str; };
 	const std::string& GetParticleScale() { return m_scale_str; };
-	std::string GetParticleScaleCode()
+	// suffix makes the generated names unique per emitter
+	std::string GetParticleScaleCode(const std::string& suffix)
 	{
 		std::string scale_str = TransferVariable(m_scale_str);
 
 		std::string str;
 		//str += "float g_particle_scale =" + scale_str + ";\n";
-		str += "float GetParicleScale(uint index)\n\
+		str += "float GetParicleScale" + suffix + "(uint index)\n\
 {\n\
 	return  " + scale_str + ";\n\
 }\n";
@@ -201,7 +210,6 @@ public:
 	~CParticleSystem(){};
 	void Initial(float timer)
 	{
-		m_age = 0;
 	}
 	void Destroy(VkDevice device)
 	{
@@ -241,22 +249,7 @@ public:
 		}
 		return true;
 	}
-	void Reset()
-	{
-		m_age = 0;
-		m_delta_time = 0;
-		m_emitted_count = 0;
-		m_next_emit_count = 0;
-	}
-	void Update(float timer)
-	{
-		m_delta_time += (timer * 1000 );
-		m_age += floorf(m_delta_time);
-		m_delta_time -= floorf(m_delta_time);
-
-		m_next_emit_count = (m_age / m_emit_interval + 1)*m_emit_count-m_emitted_count;
-		m_emitted_count += m_next_emit_count;
-	};
+	// Emission scheduling (age, emitted count) is tracked per emitter on the GPU (see update_counter_begin.comp)
 	
 	const std::string& GetTex() { return m_particle_tex; }
 	const std::string& GetGradientTex() { return m_gradient_tex; }
@@ -267,6 +260,15 @@ public:
 	void SetRot(const glm::vec3& rot) { m_rot = rot; };
 	const glm::vec3& GetRot() { return m_rot; };
 
+	// Emitter local to world transform, applied to emitted particles
+	glm::mat4 GetTransform()
+	{
+		glm::mat4 local = glm::mat4(1.0f);
+		local = glm::rotate(local, m_rot[0] * PI, glm::vec3(1, 0, 0));
+		local = glm::translate(local, m_pos);
+		return local;
+	}
+
 	void SetMaxParticleCount(uint32_t num) { m_max_particle_count = ceil(num/4.0f)*4; };
 	uint32_t GetMaxParticleCount() { return m_max_particle_count; };
 	//uint32_t GetParticleCount() { return m_particle_count; };
@@ -280,7 +282,8 @@ public:
 	void SetVelocityType(VelocityType velocity) { InitEmitVelocity(velocity); };
 	VelocityType GetVelocityType() { if (!m_velocity_type) { return VT_CONE; }   return m_velocity_type->GetVelocityType(); };
 	
-	uint32_t GetEmitParticleCount() { return m_next_emit_count; };
+	uint32_t GetEmitCount() { return m_emit_count; };
+	uint32_t GetEmitInterval() { return m_emit_interval; };
 	uint32_t GetEmitParticleLifeMax() { return m_particle_life_max; };
 
 	void SetStr(const std::string& str){m_str = str;};
@@ -289,11 +292,6 @@ public:
 	CParticleScale* GetParticleScaleObject() { return m_particle_scale.get(); };
 
 private:
-	uint32_t m_age = 0;//(ms)Particle system age
-	float m_delta_time = 0;//(ms)delta teme for update
-	uint32_t m_emitted_count = 0;//emitted particle count
-	uint32_t m_next_emit_count = 0;//emit particle count next time
-	
 	//General
 	glm::vec3 m_pos = { 0.0f, 0.0f, 0.0f };
 	glm::vec3 m_rot = { 0.0f, 0.0f, 0.0f };
@@ -319,11 +317,18 @@ class VulkanExample : public VulkanExampleBase
 {
 public:
 	vks::Model m_scene;
-	CParticleSystem m_particles;
+	// All emitters share one set of particle buffers, each owning a fixed range of particle slots
+	std::vector<std::unique_ptr<CParticleSystem>> m_emitters;
+	// Emitter edited in the UI
+	int32_t m_selected_emitter = 0;
 	float timer = 0.0f;
 	float animStart = 20.0f;
 	
 	bool m_animate = true;
+	// Sort particles back to front and render them alpha blended instead of additive
+	bool m_depth_sort = true;
+	// Emitter parameters changed in the UI, written at the start of the next frame
+	bool m_emitter_params_dirty = false;
 
 	//-------------------ParticleSystemRenderer-----------------------
 	struct {
@@ -338,16 +343,16 @@ public:
 
 	struct UBOs
 	{
-		struct SEmitterParam {					// Compute shader uniform block object
-			uint32_t emitCount;					//		Frame emit particle count
-			uint32_t particleLifeMax;
+		struct SFrameParam {					// Compute shader uniform block object shared by all emitters
+			float deltaT;						//		Frame delta time (ms)
 			float randomSeed;
-			int32_t padding2;
-		} emitterParams;
-		vks::Buffer uboEmitter;				// Uniform buffer object containing particle system parameters
+			uint32_t emitterCount;				//		Number of emitters in the batch
+			int32_t padding0;
+		} frameParams;
+		vks::Buffer uboFrame;				// Uniform buffer object containing per-frame parameters
 		void Destroy()
 		{
-			uboEmitter.destroy();
+			uboFrame.destroy();
 		}
 		
 	} m_UBOs;
@@ -357,23 +362,65 @@ public:
 			float lifeMax;
 			glm::vec3 vel;							// Particle velocity
 			float life;
-			glm::vec4 gradientPos;					// Texture coordiantes for the gradient ramp map
+			glm::vec4 gradientPos;					// Texture coordiantes for the gradient ramp map, w: emitter index
 		};
+		struct SEmitterParam {						// Per-emitter parameters (std430), only updated on change
+			glm::mat4 transform;					// Emitter local to world transform
+			uint32_t particleOffset;				// First slot of this emitter's range in the particle and dead list buffers
+			uint32_t maxParticleCount;				// Size of this emitter's range
+			uint32_t emitCount;						// Particles emitted per interval
+			uint32_t emitInterval;					// Emit interval (ms)
+			uint32_t particleLifeMax;				// (ms)
+			float randomSeed;
+			uint32_t padding0;
+			uint32_t padding1;
+		};
+		struct SEmitterState {						// Per-emitter state (std430), only written by the GPU
+			uint32_t emitCount;						// Particles emitted this frame
+			uint32_t emitOffset;					// Exclusive prefix sum of emitCount, maps emission threads to emitters
+			uint32_t deadCount;						// Number of free slots in this emitter's dead list range
+			uint32_t age;							// (ms)
+			float deltaTime;						// (ms) Fractional part of the age
+			uint32_t emittedCount;
+			uint32_t padding0;
+			uint32_t padding1;
+		};
+		vks::Buffer ssboEmitters;
+		vks::Buffer ssboEmitterStates;
 		vks::Buffer ssboParticles;
 		vks::Buffer ssboDeadList;
 		vks::Buffer ssboAliveList;
 		vks::Buffer ssboAliveListAfterSimulate;
 		vks::Buffer ssboStagingBuffer; //used for swapping alive list
 		vks::Buffer ssboCounter;
-
+		vks::Buffer ssboSortPairs;					// Depth sort key/value pairs, padded to the bitonic sort capacity
+		uint32_t sortCapacity = 0;
+
+		struct SIndirectParam {					// Indirect commands written by the compute passes (std140)
+			glm::u32vec3 dispatchEmit;
+			float padding0;
+			glm::u32vec3 dispatchSimulate;
+			float padding1;
+			glm::u32vec4 dispatchDraw;
+			uint32_t drawFirstInstance;				// Last member of VkDrawIndexedIndirectCommand
+			uint32_t padding2[3];
+			glm::u32vec3 dispatchSort;				// Depth sort key and apply passes
+			float padding3;
+			glm::u32vec4 dispatchSortStages[SORT_STAGE_COUNT];	// Bitonic sort stages (see vks::BitonicSort::recordSortIndirect)
+		};
 		uint32_t EMIT_OFFSET = 0;
 		uint32_t SIMULATE_OFFSET = EMIT_OFFSET+ 4 * 4;
 		uint32_t DRAW_OFFSET = SIMULATE_OFFSET + 4 * 4;
+		uint32_t SORT_OFFSET = DRAW_OFFSET + 8 * 4;
+		uint32_t SORT_STAGES_OFFSET = SORT_OFFSET + 4 * 4;
 		
 		vks::Buffer ssboIndirect;
 		void Destroy()
 		{
 			ssboIndirect.destroy();
+			ssboSortPairs.destroy();
+			ssboEmitterStates.destroy();
+			ssboEmitters.destroy();
 			ssboCounter.destroy();
 			ssboStagingBuffer.destroy();
 			ssboAliveListAfterSimulate.destroy();
@@ -383,7 +430,7 @@ public:
 		}
 	} m_SSBOs;
 	
-	uint32_t m_discriptor_count = 6;
+	uint32_t m_discriptor_count = 7;
 	// Resources for the compute particle simulation
 	struct SComputeUpdateCounterBegin {
 		VkDescriptorSetLayout descriptorSetLayout;	// shader binding layout
@@ -454,6 +501,22 @@ public:
 			vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 		}
 	} m_updater_end_binding;
+	// Back to front depth sort of the alive list between simulation and composition
+	struct SComputeDepthSort {
+		VkDescriptorSetLayout descriptorSetLayout;	// shader binding layout
+		VkDescriptorSet descriptorSet;				// shader bindings
+		VkPipelineLayout pipelineLayout;			// Layout of pipelines
+		VkPipeline keysPipeline;					// Builds the sort keys from the alive list
+		VkPipeline applyPipeline;					// Writes the sorted indices back to the alive list
+		void Destroy(VkDevice device)
+		{
+			vkDestroyPipeline(device, keysPipeline, nullptr);
+			vkDestroyPipeline(device, applyPipeline, nullptr);
+			vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+			vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+		}
+	} m_sort_binding;
+	vks::BitonicSort m_bitonic_sort;
 
 	// Resources for the graphics part of the example
 	struct SGraphicEnvironment {
@@ -506,18 +569,23 @@ public:
 
 	// Resources for the compute part of the example
 	struct {
-		VkQueue queue;								// Separate queue for compute commands (queue family may differ from the one used for graphics)
+		VkQueue queue = VK_NULL_HANDLE;				// Separate queue for compute commands (queue family may differ from the one used for graphics)
 		VkCommandPool commandPool;					// Use a separate command pool (queue family may differ from the one used for graphics)
 		VkCommandBuffer commandBuffer;				// Command buffer storing the dispatch commands and barriers
-		VkFence fence;								// Synchronization fence to avoid rewriting compute CB if still in use
+		uint32_t job;								// Scheduler job of the compute command buffer
+		uint32_t graphicsJob;						// Scheduler job of the graphics command buffers
 		
 	} compute;
+	// Semaphores between the compute and graphics submissions, required for the queue ownership transfers
+	vks::AsyncComputeScheduler m_scheduler;
 	//-------------------~ParticleSystemRenderer----------------------
 
 	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
 	{
 		title = "Particle system";
 		settings.overlay = true;
+		m_scheduler.parseCommandLine(args);
+		vks::AsyncComputeScheduler::requestInstanceExtensions(enabledInstanceExtensions);
 
 		//setting camera
 		/*camera.type = Camera::CameraType::firstperson;
@@ -534,10 +602,33 @@ public:
 		camera.setPosition(glm::vec3(0.0f, 0.0f, -80.0f));
 		zoomSpeed = 10.0f;
 
-		//particle system start play
-		m_particles.Initial(frameTimer);
-		m_particles.SetPos(glm::vec3 (0.0f, 7.0f, 0.0f));
-		m_particles.SetRot(glm::vec3(0.0f, 0.0f, 0.0f));
+		//particle systems start play, arranged on a ring around the scene center
+		const float ringRadius = 15.0f;
+		for (uint32_t i = 0; i < EMITTER_COUNT; ++i)
+		{
+			std::unique_ptr<CParticleSystem> emitter = std::make_unique<CParticleSystem>();
+			float angle = 2.0f * PI * (float)i / (float)EMITTER_COUNT;
+			glm::vec3 offset = (EMITTER_COUNT > 1) ? glm::vec3(cos(angle), 0.0f, sin(angle)) * ringRadius : glm::vec3(0.0f);
+			emitter->Initial(frameTimer);
+			emitter->SetPos(glm::vec3(0.0f, 7.0f, 0.0f) + offset);
+			emitter->SetRot(glm::vec3(0.0f, 0.0f, 0.0f));
+			m_emitters.push_back(std::move(emitter));
+		}
+	}
+
+	// Total particle slots of all emitters in the shared buffers
+	uint32_t GetTotalParticleCount()
+	{
+		uint32_t count = 0;
+		for (auto& emitter : m_emitters) {
+			count += emitter->GetMaxParticleCount();
+		}
+		return count;
+	}
+
+	CParticleSystem& GetSelectedEmitter()
+	{
+		return *m_emitters[m_selected_emitter];
 	}
 
 	~VulkanExample()
@@ -546,24 +637,48 @@ public:
 		m_emission_binding.Destroy(device);
 		m_simulation_binding.Destroy(device);
 		m_updater_end_binding.Destroy(device);
+		m_sort_binding.Destroy(device);
+		m_bitonic_sort.destroy();
 		m_environment_binding.Destroy(device);
 		m_composition_binding.Destroy(device);
 
 		// Compute
-		vkDestroyFence(device, compute.fence, nullptr);
 		vkDestroyCommandPool(device, compute.commandPool, nullptr);
+		m_scheduler.destroy();
 
 		m_SSBOs.Destroy();
 		m_UBOs.Destroy();
 		m_textures.Destroy();
 		m_scene.destroy();
 	}
+	// Generates a function that calls the emitter's variant of a generated function, emitters without a variant return fallback
+	std::string GetEmitterSwitchCode(const std::string& signature, const std::string& emitter, const std::string& cases, const std::string& fallback)
+	{
+		return signature + "\n{\n\tswitch (" + emitter + ") {\n" + cases + "\t}\n\treturn " + fallback + ";\n}\n";
+	}
+
 	//generate emit shader code
 	std::string GetEmitCode()
 	{
+		// Every emitter gets its own functions, selected by the emitter index of the emission thread
 		std::string str;
-		str += m_particles.GetEmitShapeObject()->GetPositionCode();
-		str += m_particles.GetVelocityTypeObject()->GetVelocityCode();
+		std::string position_cases;
+		std::string velocity_cases;
+		for (size_t i = 0; i < m_emitters.size(); ++i)
+		{
+			const std::string suffix = "_" + std::to_string(i);
+			const std::string position = m_emitters[i]->GetEmitShapeObject()->GetPositionCode(suffix);
+			const std::string velocity = m_emitters[i]->GetVelocityTypeObject()->GetVelocityCode(suffix);
+			str += position + velocity;
+			if (!position.empty()) {
+				position_cases += "\tcase " + std::to_string(i) + ": return GetEmitPosition" + suffix + "(particle_random);\n";
+			}
+			if (!velocity.empty()) {
+				velocity_cases += "\tcase " + std::to_string(i) + ": return GetEmitVelocity" + suffix + "(particle_random);\n";
+			}
+		}
+		str += GetEmitterSwitchCode("vec3 GetEmitPosition(uint emitter, float particle_random)", "emitter", position_cases, "vec3(0.0)");
+		str += GetEmitterSwitchCode("vec3 GetEmitVelocity(uint emitter, float particle_random)", "emitter", velocity_cases, "vec3(0.0, 1.0, 0.0)");
 		return str;
 	}
 	
@@ -612,8 +727,16 @@ public:
 	//generate simulate shader code
 	std::string GetSimulateCode()
 	{
+		// Every emitter gets its own functions, selected by the emitter index stored with the particle
 		std::string str;
-		str += m_particles.GetParticleScaleObject()->GetParticleScaleCode();
+		std::string scale_cases;
+		for (size_t i = 0; i < m_emitters.size(); ++i)
+		{
+			const std::string suffix = "_" + std::to_string(i);
+			str += m_emitters[i]->GetParticleScaleObject()->GetParticleScaleCode(suffix);
+			scale_cases += "\tcase " + std::to_string(i) + ": return GetParicleScale" + suffix + "(index);\n";
+		}
+		str += GetEmitterSwitchCode("float GetParicleScale(uint index)", "uint(ssboParticle.particles[index].param0.w)", scale_cases, "1.0");
 		return str;
 	}
 
@@ -669,18 +792,20 @@ public:
 		});
 		m_scene.loadFromFile(getAssetPath() + "models/shadowscene_fire.dae", vertexLayout, 1.0f, vulkanDevice, queue);
 		
-		m_textures.particle.loadFromFile(getAssetPath() + m_particles.GetTex(), VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
-		m_textures.gradient.loadFromFile(getAssetPath() + m_particles.GetGradientTex(), VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
+		m_textures.particle.loadFromFile(getAssetPath() + GetSelectedEmitter().GetTex(), VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
+		m_textures.gradient.loadFromFile(getAssetPath() + GetSelectedEmitter().GetGradientTex(), VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
 	}
 
 	void Reset()
 	{
-		m_particles.Reset();
+		vkQueueWaitIdle(compute.queue);
+		vkQueueWaitIdle(queue);
 
 		m_updater_begin_binding.Destroy(device);
 		m_emission_binding.Destroy(device);
 		m_simulation_binding.Destroy(device);
 		m_updater_end_binding.Destroy(device);
+		m_sort_binding.Destroy(device);
 		m_environment_binding.Destroy(device);
 		m_composition_binding.Destroy(device);
 
@@ -689,6 +814,7 @@ public:
 		//BuildSSBOsWithParticle();
 		BuildSSBOs();
 
+		vkDestroyDescriptorPool(device, descriptorPool, nullptr);
 		SetupDescriptorPool();
 		BuildComputeUpdateCounterBegin();
 		BuildComputeEmission();
@@ -696,6 +822,8 @@ public:
 		BuildComputeUpdateCounterEnd();
 		BuildGraphicEnvironment();
 		BuildGraphicComposition();
+		// Reads the composition scene matrices
+		BuildComputeDepthSort();
 
 		buildComputeCommandBuffer();
 		buildCommandBuffers();
@@ -705,8 +833,9 @@ public:
 	{
 		std::vector<VkDescriptorPoolSize> poolSizes =
 		{
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1+2+1),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1+4),
+			// Counter begin, emission, simulation, counter end, depth sort, environment, composition
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1+1+1+1+1+1+1),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4+7+7+2+4),
 			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2)
 		};
 		VkDescriptorPoolCreateInfo descriptorPoolInfo = vks::initializers::descriptorPoolCreateInfo(static_cast<uint32_t>(poolSizes.size()), poolSizes.data(), m_discriptor_count);
@@ -722,6 +851,10 @@ public:
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
 			// indirect buffer
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+			// emitter parameters shader storage buffer
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+			// emitter state shader storage buffer
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 4),
 		};
 		VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
 		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &m_updater_begin_binding.descriptorSetLayout));
@@ -734,9 +867,11 @@ public:
 
 		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
 			// same as setLayoutBindings
-			vks::initializers::writeDescriptorSet(m_updater_begin_binding.descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &m_UBOs.uboEmitter.descriptor),
+			vks::initializers::writeDescriptorSet(m_updater_begin_binding.descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &m_UBOs.uboFrame.descriptor),
 			vks::initializers::writeDescriptorSet(m_updater_begin_binding.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &m_SSBOs.ssboCounter.descriptor),
 			vks::initializers::writeDescriptorSet(m_updater_begin_binding.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &m_SSBOs.ssboIndirect.descriptor),
+			vks::initializers::writeDescriptorSet(m_updater_begin_binding.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &m_SSBOs.ssboEmitters.descriptor),
+			vks::initializers::writeDescriptorSet(m_updater_begin_binding.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, &m_SSBOs.ssboEmitterStates.descriptor),
 		};
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
 
@@ -761,6 +896,10 @@ public:
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 4),
 			// counter shader storage buffer
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 5),
+			// emitter parameters shader storage buffer
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 6),
+			// emitter state shader storage buffer
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 7),
 		};
 		VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
 		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &m_emission_binding.descriptorSetLayout));
@@ -773,12 +912,14 @@ public:
 
 		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
 			// same as setLayoutBindings
-			vks::initializers::writeDescriptorSet(m_emission_binding.descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &m_UBOs.uboEmitter.descriptor),
+			vks::initializers::writeDescriptorSet(m_emission_binding.descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &m_UBOs.uboFrame.descriptor),
 			vks::initializers::writeDescriptorSet(m_emission_binding.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &m_SSBOs.ssboParticles.descriptor),
 			vks::initializers::writeDescriptorSet(m_emission_binding.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &m_SSBOs.ssboDeadList.descriptor),
 			vks::initializers::writeDescriptorSet(m_emission_binding.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &m_SSBOs.ssboAliveList.descriptor),
 			vks::initializers::writeDescriptorSet(m_emission_binding.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, &m_SSBOs.ssboAliveListAfterSimulate.descriptor),
 			vks::initializers::writeDescriptorSet(m_emission_binding.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5, &m_SSBOs.ssboCounter.descriptor),
+			vks::initializers::writeDescriptorSet(m_emission_binding.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6, &m_SSBOs.ssboEmitters.descriptor),
+			vks::initializers::writeDescriptorSet(m_emission_binding.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 7, &m_SSBOs.ssboEmitterStates.descriptor),
 		};
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
 
@@ -810,6 +951,10 @@ public:
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 4),
 			// counter shader storage buffer
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 5),
+			// emitter parameters shader storage buffer
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 6),
+			// emitter state shader storage buffer
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 7),
 		};
 		VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
 		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &m_simulation_binding.descriptorSetLayout));
@@ -829,6 +974,8 @@ public:
 			vks::initializers::writeDescriptorSet(m_simulation_binding.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &m_SSBOs.ssboAliveList.descriptor),
 			vks::initializers::writeDescriptorSet(m_simulation_binding.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, &m_SSBOs.ssboAliveListAfterSimulate.descriptor),
 			vks::initializers::writeDescriptorSet(m_simulation_binding.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5, &m_SSBOs.ssboCounter.descriptor),
+			vks::initializers::writeDescriptorSet(m_simulation_binding.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6, &m_SSBOs.ssboEmitters.descriptor),
+			vks::initializers::writeDescriptorSet(m_simulation_binding.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 7, &m_SSBOs.ssboEmitterStates.descriptor),
 		};
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
 
@@ -859,7 +1006,7 @@ public:
 
 		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
 			// same as setLayoutBindings
-			vks::initializers::writeDescriptorSet(m_updater_end_binding.descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &m_UBOs.uboEmitter.descriptor),
+			vks::initializers::writeDescriptorSet(m_updater_end_binding.descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &m_UBOs.uboFrame.descriptor),
 			vks::initializers::writeDescriptorSet(m_updater_end_binding.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &m_SSBOs.ssboCounter.descriptor),
 			vks::initializers::writeDescriptorSet(m_updater_end_binding.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &m_SSBOs.ssboIndirect.descriptor),
 		};
@@ -871,6 +1018,50 @@ public:
 		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &m_updater_end_binding.pipeline));
 	}
 
+	void BuildComputeDepthSort()
+	{
+		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+			// Scene matrices of the composition pass
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+			// Particle shader storage buffer
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+			// alive list after simulate
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+			// counter shader storage buffer
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+			// sort key/value pairs
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 4),
+		};
+		VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &m_sort_binding.descriptorSetLayout));
+
+		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&m_sort_binding.descriptorSetLayout, 1);
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &m_sort_binding.pipelineLayout));
+
+		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &m_sort_binding.descriptorSetLayout, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &m_sort_binding.descriptorSet));
+
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+			// same as setLayoutBindings
+			vks::initializers::writeDescriptorSet(m_sort_binding.descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &m_composition_binding.uboSceneMatrices.descriptor),
+			vks::initializers::writeDescriptorSet(m_sort_binding.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &m_SSBOs.ssboParticles.descriptor),
+			vks::initializers::writeDescriptorSet(m_sort_binding.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &m_SSBOs.ssboAliveListAfterSimulate.descriptor),
+			vks::initializers::writeDescriptorSet(m_sort_binding.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &m_SSBOs.ssboCounter.descriptor),
+			vks::initializers::writeDescriptorSet(m_sort_binding.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, &m_SSBOs.ssboSortPairs.descriptor),
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+
+		// Create pipelines
+		VkComputePipelineCreateInfo pipelineCreateInfo = vks::initializers::computePipelineCreateInfo(m_sort_binding.pipelineLayout, 0);
+		pipelineCreateInfo.stage = loadShader(getAssetPath() + "shaders/aparticlesystem/particle_sort_keys.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &m_sort_binding.keysPipeline));
+		pipelineCreateInfo.stage = loadShader(getAssetPath() + "shaders/aparticlesystem/particle_sort_apply.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &m_sort_binding.applyPipeline));
+
+		m_bitonic_sort.setBuffer(&m_SSBOs.ssboSortPairs.descriptor, m_SSBOs.sortCapacity);
+		assert(m_bitonic_sort.getIndirectCommandCount() <= SORT_STAGE_COUNT);
+	}
+
 	void BuildGraphicEnvironment()
 	{
 		// Scene matrices ubo
@@ -1029,6 +1220,13 @@ public:
 			blendAttachmentState.alphaBlendOp = VK_BLEND_OP_ADD;
 			blendAttachmentState.srcAlphaBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
 			blendAttachmentState.dstAlphaBlendFactor = VK_BLEND_FACTOR_DST_ALPHA;
+			if (m_depth_sort) {
+				// Alpha blending, requires the particles to be drawn back to front
+				blendAttachmentState.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+				blendAttachmentState.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+				blendAttachmentState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+				blendAttachmentState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+			}
 
 			// Vertex input state for scene rendering
 			const std::vector<VkVertexInputBindingDescription> vertexInputBindings = {
@@ -1083,9 +1281,12 @@ public:
 		VkCommandBufferAllocateInfo cmdBufAllocateInfo =vks::initializers::commandBufferAllocateInfo(compute.commandPool,VK_COMMAND_BUFFER_LEVEL_PRIMARY,1);
 		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &compute.commandBuffer));
 
-		// Fence for compute CB sync
-		VkFenceCreateInfo fenceCreateInfo = vks::initializers::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
-		VK_CHECK_RESULT(vkCreateFence(device, &fenceCreateInfo, nullptr, &compute.fence));
+		// Graphics reads what compute wrote in the same frame, compute overwrites what graphics read in the previous frame
+		compute.job = m_scheduler.addJob("particles", vks::AsyncComputeScheduler::COMPUTE);
+		compute.graphicsJob = m_scheduler.addJob("graphics", vks::AsyncComputeScheduler::GRAPHICS);
+		m_scheduler.addDependency(compute.graphicsJob, compute.job, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0);
+		m_scheduler.addDependency(compute.job, compute.graphicsJob, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 1);
+		m_scheduler.prepare(vulkanDevice, queue, compute.queue);
 
 		// Build a single command buffer containing the compute dispatch commands
 		buildComputeCommandBuffer();
@@ -1123,6 +1324,18 @@ public:
 
 			// Draw the particle system using the update vertex buffer
 
+			// Acquire the buffers released at the end of the compute command buffer
+			if (SeparateQueueFamilies()) {
+				AddSharedBufferBarrier(
+					drawCmdBuffers[i],
+					VK_ACCESS_SHADER_WRITE_BIT,
+					VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+					VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+					VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+					vulkanDevice->queueFamilyIndices.compute,
+					vulkanDevice->queueFamilyIndices.graphics);
+			}
+
 			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 			VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
@@ -1151,58 +1364,87 @@ public:
 			vkCmdDrawIndexedIndirect(drawCmdBuffers[i], m_SSBOs.ssboIndirect.buffer, m_SSBOs.DRAW_OFFSET, 1, 4*4);
 			//vkCmdDraw(drawCmdBuffers[i], m_particles.GetParticleCount(), 1, 0, 0);
 			
-			drawUI(drawCmdBuffers[i]);
-
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
 
+			// Release the buffers to the compute queue for the next frame
+			if (SeparateQueueFamilies()) {
+				AddSharedBufferBarrier(
+					drawCmdBuffers[i],
+					VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+					VK_ACCESS_SHADER_WRITE_BIT,
+					VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+					VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+					vulkanDevice->queueFamilyIndices.graphics,
+					vulkanDevice->queueFamilyIndices.compute);
+			}
+
 			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
 		}
 	}
 
+	// Compute and graphics queue may have different queue families (see VulkanDevice::createLogicalDevice)
+	bool SeparateQueueFamilies()
+	{
+		return vulkanDevice->queueFamilyIndices.graphics != vulkanDevice->queueFamilyIndices.compute;
+	}
+
+	// Barrier for the buffers written by the compute passes and read by the composition pass (indirect draw, index and vertex buffer)
+	// If the queue family indices differ, this is the release (on the source queue) or acquire (on the destination queue) half of an ownership transfer
+	void AddSharedBufferBarrier(VkCommandBuffer commandBuffer, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask, VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask, uint32_t srcQueueFamilyIndex, uint32_t dstQueueFamilyIndex)
+	{
+		const std::array<VkBuffer, 3> buffers = { m_SSBOs.ssboIndirect.buffer, m_SSBOs.ssboAliveListAfterSimulate.buffer, m_SSBOs.ssboParticles.buffer };
+		std::array<VkBufferMemoryBarrier, 3> bufferBarriers;
+		for (size_t i = 0; i < buffers.size(); ++i)
+		{
+			bufferBarriers[i] = vks::initializers::bufferMemoryBarrier();
+			bufferBarriers[i].buffer = buffers[i];
+			bufferBarriers[i].size = VK_WHOLE_SIZE;
+			bufferBarriers[i].srcAccessMask = srcAccessMask;
+			bufferBarriers[i].dstAccessMask = dstAccessMask;
+			bufferBarriers[i].srcQueueFamilyIndex = srcQueueFamilyIndex;
+			bufferBarriers[i].dstQueueFamilyIndex = dstQueueFamilyIndex;
+		}
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			srcStageMask, dstStageMask,
+			VK_FLAGS_NONE,
+			0, nullptr,
+			static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+			0, nullptr);
+	}
+
 	void buildComputeCommandBuffer()
 	{
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
 		VK_CHECK_RESULT(vkBeginCommandBuffer(compute.commandBuffer, &cmdBufInfo));
 
-		{// Add memory barrier to ensure that the (graphics) indirect commad has fetched attributes before compute starts to write to the buffer
-			VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
-			bufferBarrier.buffer = m_SSBOs.ssboIndirect.buffer;
-			bufferBarrier.size = m_SSBOs.ssboIndirect.descriptor.range;
-			bufferBarrier.srcAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;						// Vertex shader invocations have finished reading from the buffer
-			bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;								// Compute shader wants to write to the buffer
-			// Compute and graphics queue may have different queue families (see VulkanDevice::createLogicalDevice)
-			// For the barrier to work across different queues, we need to set their family indices
-			bufferBarrier.srcQueueFamilyIndex = vulkanDevice->queueFamilyIndices.graphics;			// Required as compute and graphics queue may have different families
-			bufferBarrier.dstQueueFamilyIndex = vulkanDevice->queueFamilyIndices.compute;			// Required as compute and graphics queue may have different families
-			vkCmdPipelineBarrier(
-				compute.commandBuffer,
-				VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-				VK_FLAGS_NONE,
-				0, nullptr,
-				1, &bufferBarrier,
-				0, nullptr);
-		}
+		// Acquire the buffers read by the composition pass before compute starts to write to them
+		// With separate queue families this acquires the ownership released at the end of the graphics command buffer
+		AddSharedBufferBarrier(
+			compute.commandBuffer,
+			VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+			VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT,
+			SeparateQueueFamilies() ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+			vulkanDevice->queueFamilyIndices.graphics,
+			vulkanDevice->queueFamilyIndices.compute);
 		//update counter
 		{
 			vkCmdBindPipeline(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_updater_begin_binding.pipeline);
 			vkCmdBindDescriptorSets(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_updater_begin_binding.pipelineLayout, 0, 1, &m_updater_begin_binding.descriptorSet, 0, 0);
 			vkCmdDispatch(compute.commandBuffer,1, 1, 1);
 		}
-		{// Add memory barrier to ensure that compute shader has finished writing to the buffer
-			VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
-			bufferBarrier.buffer = m_SSBOs.ssboIndirect.buffer;
-			bufferBarrier.size = m_SSBOs.ssboIndirect.descriptor.range;
-			bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;						// Vertex shader invocations have finished reading from the buffer
-			bufferBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;								// Compute shader wants to write to the buffer
-			bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-			bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		{// Add memory barrier to ensure that compute shader has finished writing the indirect dispatch arguments and the emitter states
+			VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+			memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
 			vkCmdPipelineBarrier(
 				compute.commandBuffer,
-				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
 				VK_FLAGS_NONE,
+				1, &memoryBarrier,
 				0, nullptr,
-				1, &bufferBarrier,
 				0, nullptr);
 		}
 		//emit
@@ -1212,20 +1454,16 @@ public:
 			vkCmdDispatchIndirect(compute.commandBuffer, m_SSBOs.ssboIndirect.buffer , m_SSBOs.EMIT_OFFSET);
 		}
 		{// Add memory barrier to ensure that compute shader has finished initialize to particle buffer
-			VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
-			bufferBarrier.buffer = m_SSBOs.ssboAliveList.buffer;
-			bufferBarrier.size = m_SSBOs.ssboAliveList.descriptor.range;
-			//VkMemoryBarrier bufferBarrier = vks::initializers::memoryBarrier();
-			bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;						// Vertex shader invocations have finished reading from the buffer
-			bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;								// Compute shader wants to write to the buffer
-			//bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-			//bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			// Emission writes the particles, the alive list and the per-emitter dead counts of all emitters
+			VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+			memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
 			vkCmdPipelineBarrier(
 				compute.commandBuffer,
 				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
 				VK_FLAGS_NONE,
+				1, &memoryBarrier,
 				0, nullptr,
-				1, & bufferBarrier,
 				0, nullptr);
 		}
 		
@@ -1260,12 +1498,12 @@ public:
 			bufferBarrier.buffer = m_SSBOs.ssboAliveListAfterSimulate.buffer;
 			bufferBarrier.size = m_SSBOs.ssboAliveListAfterSimulate.descriptor.range;
 			bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-			bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
 			bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 			bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 			vkCmdPipelineBarrier(
 				compute.commandBuffer,
-				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
 				VK_FLAGS_NONE,
 				0, nullptr,
 				1, &bufferBarrier,
@@ -1277,39 +1515,83 @@ public:
 			vkCmdBindDescriptorSets(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_updater_end_binding.pipelineLayout, 0, 1, &m_updater_end_binding.descriptorSet, 0, 0);
 			vkCmdDispatch(compute.commandBuffer, 1, 1, 1);
 		}
-		{// Add memory barrier to ensure that compute shader has finished writing to the buffer
-		// Without this the (rendering) vertex shader may display incomplete results (partial data from last frame)
+		// Swap CURRENT alivelist with NEW alivelist for the next frame's emission and simulation
+		// Recorded here instead of a separate blocking submit per frame
+		{
+			VkBufferCopy copyRegion = {};
+			copyRegion.size = m_SSBOs.ssboAliveListAfterSimulate.size;
+			vkCmdCopyBuffer(compute.commandBuffer, m_SSBOs.ssboAliveListAfterSimulate.buffer, m_SSBOs.ssboAliveList.buffer, 1, &copyRegion);
+
 			VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
-			bufferBarrier.buffer = m_SSBOs.ssboIndirect.buffer;
-			bufferBarrier.size = m_SSBOs.ssboIndirect.descriptor.range;
-			bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;								// Compute shader has finished writes to the buffer
-			bufferBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;						// Vertex shader invocations want to read from the buffer
-			// Compute and graphics queue may have different queue families (see VulkanDevice::createLogicalDevice)
-			// For the barrier to work across different queues, we need to set their family indices
-			bufferBarrier.srcQueueFamilyIndex = vulkanDevice->queueFamilyIndices.compute;			// Required as compute and graphics queue may have different families
-			bufferBarrier.dstQueueFamilyIndex = vulkanDevice->queueFamilyIndices.graphics;			// Required as compute and graphics queue may have different families
+			bufferBarrier.buffer = m_SSBOs.ssboAliveList.buffer;
+			bufferBarrier.size = m_SSBOs.ssboAliveList.size;
+			bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 			vkCmdPipelineBarrier(
 				compute.commandBuffer,
-				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
 				VK_FLAGS_NONE,
 				0, nullptr,
 				1, &bufferBarrier,
 				0, nullptr);
-			
 		}
-		
+		// Sort the alive list back to front for alpha blending
+		// The dispatches are sized to the alive count by update_counter_end.comp, so only the range covering the alive particles is sorted
+		if (m_depth_sort) {
+			auto computeBarrier = [&](VkPipelineStageFlags srcStageMask) {
+				VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+				memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+				memoryBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+				vkCmdPipelineBarrier(
+					compute.commandBuffer,
+					srcStageMask, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+					VK_FLAGS_NONE,
+					1, &memoryBarrier,
+					0, nullptr,
+					0, nullptr);
+			};
+
+			// The alive list copy has to be done before the sorted indices are written back
+			computeBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT);
+			vkCmdBindPipeline(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_sort_binding.keysPipeline);
+			vkCmdBindDescriptorSets(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_sort_binding.pipelineLayout, 0, 1, &m_sort_binding.descriptorSet, 0, 0);
+			vkCmdDispatchIndirect(compute.commandBuffer, m_SSBOs.ssboIndirect.buffer, m_SSBOs.SORT_OFFSET);
+
+			computeBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+			m_bitonic_sort.recordSortIndirect(compute.commandBuffer, m_SSBOs.ssboIndirect.buffer, m_SSBOs.SORT_STAGES_OFFSET, 4 * 4);
+
+			computeBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+			vkCmdBindPipeline(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_sort_binding.applyPipeline);
+			vkCmdBindDescriptorSets(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_sort_binding.pipelineLayout, 0, 1, &m_sort_binding.descriptorSet, 0, 0);
+			vkCmdDispatchIndirect(compute.commandBuffer, m_SSBOs.ssboIndirect.buffer, m_SSBOs.SORT_OFFSET);
+		}
+		// Make the indirect draw, the (sorted) index buffer and the particles visible to the composition pass
+		// Without this the (rendering) vertex shader may display incomplete results (partial data from last frame)
+		// With separate queue families this releases the ownership acquired at the start of the graphics command buffer
+		AddSharedBufferBarrier(
+			compute.commandBuffer,
+			VK_ACCESS_SHADER_WRITE_BIT,
+			VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			SeparateQueueFamilies() ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+			vulkanDevice->queueFamilyIndices.compute,
+			vulkanDevice->queueFamilyIndices.graphics);
+
+
 		vkEndCommandBuffer(compute.commandBuffer);
 	}
 
 	// Setup and fill the compute shader storage buffers containing the particles
 	void BuildUBOs()
 	{
-		// Emitter ubo
+		// Frame ubo
 		vulkanDevice->createBuffer(
 			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&m_UBOs.uboEmitter,
-			sizeof(m_UBOs.emitterParams));
+			&m_UBOs.uboFrame,
+			sizeof(m_UBOs.frameParams));
 	}
 	// Setup and fill the compute shader storage buffers containing the particles
 	void BuildSSBOsWithParticle()
@@ -1320,14 +1602,14 @@ public:
 			//std::uniform_real_distribution<float> rndDist(-1.0f, 1.0f);
 
 			//// Initial particle positions
-			//std::vector<SSBOs::SParticle> particleBuffer(m_particles.GetMaxParticleCount());
+			//std::vector<SSBOs::SParticle> particleBuffer(GetTotalParticleCount());
 			//for (auto& particle : particleBuffer) {
 			//	particle.pos = glm::vec3(rndDist(rndEngine), rndDist(rndEngine),0.0f);
 			//	particle.vel = glm::vec3(0.0f);
 			//	particle.gradientPos.x = particle.pos.x / 2.0f;
 			//}
 
-			std::vector<SSBOs::SParticle> particleBuffer(m_particles.GetMaxParticleCount());
+			std::vector<SSBOs::SParticle> particleBuffer(GetTotalParticleCount());
 
 			// Staging
 			// SSBO won't be changed on the host after upload so copy to device local memory
@@ -1357,7 +1639,8 @@ public:
 		}
 		//dead list
 		{
-			std::vector<uint32_t> dead_list(m_particles.GetMaxParticleCount());
+			// Emitter ranges are contiguous, so every emitter's range of the dead list initially holds its own particle slots
+			std::vector<uint32_t> dead_list(GetTotalParticleCount());
 			for (uint32_t i = 0; i < dead_list.size(); ++i)
 			{
 				dead_list[i] = i;
@@ -1391,7 +1674,7 @@ public:
 		}
 		// alive list
 		{
-			std::vector<uint32_t> alive_list(m_particles.GetMaxParticleCount());
+			std::vector<uint32_t> alive_list(GetTotalParticleCount());
 
 			// SSBO won't be changed on the host after upload so copy to device local memory
 			VkDeviceSize storageBufferSize = alive_list.size() * sizeof(uint32_t);
@@ -1404,7 +1687,7 @@ public:
 		}
 		// alive list after simulate
 		{
-			std::vector<uint32_t> alive_list_after_simulate(m_particles.GetMaxParticleCount());
+			std::vector<uint32_t> alive_list_after_simulate(GetTotalParticleCount());
 
 			// SSBO won't be changed on the host after upload so copy to device local memory
 			VkDeviceSize storageBufferSize = alive_list_after_simulate.size() * sizeof(uint32_t);
@@ -1417,7 +1700,7 @@ public:
 		}
 		//staging buffer
 		{
-			std::vector<uint32_t> list(m_particles.GetMaxParticleCount());
+			std::vector<uint32_t> list(GetTotalParticleCount());
 
 			// SSBO won't be changed on the host after upload so copy to device local memory
 			VkDeviceSize storageBufferSize = list.size() * sizeof(uint32_t);
@@ -1430,10 +1713,10 @@ public:
 		// counter
 		{
 			uint32_t emit_count = 0;
-			uint32_t dead_count = m_particles.GetMaxParticleCount();
+			uint32_t padding = 0; // Dead counts are tracked per emitter
 			uint32_t alive_count = 0;
 			uint32_t alive_count_after_simulate = 0;
-			std::vector<uint32_t> counter = { emit_count, dead_count, alive_count, alive_count_after_simulate };
+			std::vector<uint32_t> counter = { emit_count, padding, alive_count, alive_count_after_simulate };
 
 			// Staging
 			// SSBO won't be changed on the host after upload so copy to device local memory
@@ -1461,6 +1744,50 @@ public:
 			VulkanExampleBase::flushCommandBuffer(copyCmd, queue, true);
 			stagingBuffer.destroy();
 		}
+		// emitter parameters
+		{
+			// Host visible as it's only updated when an emitter is changed in the UI
+			vulkanDevice->createBuffer(
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&m_SSBOs.ssboEmitters,
+				m_emitters.size() * sizeof(SSBOs::SEmitterParam));
+			UpdateEmitterParams();
+		}
+		// emitter states
+		{
+			std::vector<SSBOs::SEmitterState> states(m_emitters.size());
+			for (size_t i = 0; i < m_emitters.size(); ++i)
+			{
+				states[i] = {};
+				states[i].deadCount = m_emitters[i]->GetMaxParticleCount();
+			}
+
+			// Staging
+			// SSBO won't be changed on the host after upload so copy to device local memory
+			vks::Buffer stagingBuffer;
+			VkDeviceSize storageBufferSize = states.size() * sizeof(SSBOs::SEmitterState);
+			vulkanDevice->createBuffer(
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&stagingBuffer,
+				storageBufferSize,
+				states.data());
+
+			vulkanDevice->createBuffer(
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				&m_SSBOs.ssboEmitterStates,
+				storageBufferSize);
+
+			// Copy to staging buffer
+			VkCommandBuffer copyCmd = VulkanExampleBase::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			VkBufferCopy copyRegion = {};
+			copyRegion.size = storageBufferSize;
+			vkCmdCopyBuffer(copyCmd, stagingBuffer.buffer, m_SSBOs.ssboEmitterStates.buffer, 1, &copyRegion);
+			VulkanExampleBase::flushCommandBuffer(copyCmd, queue, true);
+			stagingBuffer.destroy();
+		}
 	}
 	void BuildSSBOs()
 	{
@@ -1468,16 +1795,7 @@ public:
 		
 		// indirect buffer
 		{
-			struct SIndirectParam
-			{
-				glm::u32vec3 dispatchEmit;
-				float padding0;
-				glm::u32vec3 dispatchSimulate;
-				float padding1;
-				glm::u32vec4 dispatchDraw;
-			};
-
-			VkDeviceSize storageBufferSize = sizeof(SIndirectParam);
+			VkDeviceSize storageBufferSize = sizeof(SSBOs::SIndirectParam);
 			vulkanDevice->createBuffer(
 				// The SSBO will be used as a storage buffer for the compute pipeline and as a vertex buffer in the graphics pipeline
 				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
@@ -1485,19 +1803,53 @@ public:
 				&m_SSBOs.ssboIndirect,
 				storageBufferSize);
 		}
+		// depth sort buffer, covers all particle slots, the sort dispatches are sized to the alive count on the GPU
+		{
+			m_SSBOs.sortCapacity = vks::BitonicSort::getCapacity(GetTotalParticleCount());
+			vulkanDevice->createBuffer(
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				&m_SSBOs.ssboSortPairs,
+				m_SSBOs.sortCapacity * sizeof(vks::BitonicSort::KeyValue));
+		}
+	}
+
+	// Per-frame parameters are shared by all emitters, so the per-frame CPU cost doesn't depend on the emitter count
+	void UpdateUBOFrame()
+	{
+		m_UBOs.frameParams.deltaT = frameTimer * 1000;//:ms
+		m_UBOs.frameParams.randomSeed = frameTimer * 1000;//:ms
+		m_UBOs.frameParams.emitterCount = static_cast<uint32_t>(m_emitters.size());
+
+		// Map for host access
+		VK_CHECK_RESULT(m_UBOs.uboFrame.map());
+		memcpy(m_UBOs.uboFrame.mapped, &m_UBOs.frameParams, sizeof(m_UBOs.frameParams));
+		m_UBOs.uboFrame.unmap();
 	}
 
-	void UpdateUBOEmitter()
+	// Only called when emitters are created or changed, must not overlap with the compute passes reading the buffer (see draw)
+	void UpdateEmitterParams()
 	{
-		m_UBOs.emitterParams.emitCount = m_particles.GetEmitParticleCount();
-		m_UBOs.emitterParams.particleLifeMax = m_particles.GetEmitParticleLifeMax();
-		m_UBOs.emitterParams.randomSeed = frameTimer * 1000;//:ms
-		//std::cout << m_UBOs.emitterParams.emitCount << std::endl;
+		std::vector<SSBOs::SEmitterParam> params(m_emitters.size());
+		uint32_t particleOffset = 0;
+		for (size_t i = 0; i < m_emitters.size(); ++i)
+		{
+			CParticleSystem& emitter = *m_emitters[i];
+			params[i] = {};
+			params[i].transform = emitter.GetTransform();
+			params[i].particleOffset = particleOffset;
+			params[i].maxParticleCount = emitter.GetMaxParticleCount();
+			params[i].emitCount = emitter.GetEmitCount();
+			params[i].emitInterval = emitter.GetEmitInterval();
+			params[i].particleLifeMax = emitter.GetEmitParticleLifeMax();
+			params[i].randomSeed = (float)i * 0.7123f;
+			particleOffset += emitter.GetMaxParticleCount();
+		}
 
 		// Map for host access
-		VK_CHECK_RESULT(m_UBOs.uboEmitter.map());
-		memcpy(m_UBOs.uboEmitter.mapped, &m_UBOs.emitterParams, sizeof(m_UBOs.emitterParams));
-		m_UBOs.uboEmitter.unmap();
+		VK_CHECK_RESULT(m_SSBOs.ssboEmitters.map());
+		memcpy(m_SSBOs.ssboEmitters.mapped, params.data(), params.size() * sizeof(SSBOs::SEmitterParam));
+		m_SSBOs.ssboEmitters.unmap();
 	}
 	
 	void UpdateUBOAttractor()
@@ -1540,10 +1892,8 @@ public:
 		}
 		
 		//particle matrix
+		// Emitter transforms are applied at emission, particles are simulated in world space
 		glm::mat4 local = glm::mat4(1.0f);
-		//local = glm::scale(local, glm::vec3(0.5f));
-		local = glm::rotate(local, m_particles.GetRot()[0]*PI, glm::vec3(1, 0, 0));
-		local = glm::translate(local, m_particles.GetPos());
 
 		m_composition_binding.sceneMatrices.projection = camera.matrices.perspective;
 		m_composition_binding.sceneMatrices.view = camera.matrices.view;
@@ -1556,47 +1906,41 @@ public:
 	}
 	void UpdateUBO()
 	{
-		UpdateUBOEmitter();
+		UpdateUBOFrame();
 		UpdateUBOAttractor();
 		UpdateUBOMatrices();
 	}
 
 	void Update()
 	{
-		m_particles.Update(frameTimer);
+		// Emission scheduling and the alive list swap run on the GPU (see buildComputeCommandBuffer)
 		UpdateUBO();
-
-		// Swap CURRENT alivelist with NEW alivelist
-		// Copy to staging buffer
-		VkCommandBuffer copyCmd = VulkanExampleBase::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-		VkBufferCopy copyRegion = {};
-		copyRegion.size = m_SSBOs.ssboAliveListAfterSimulate.size;
-		//vkCmdCopyBuffer(copyCmd, m_SSBOs.ssboAliveList.buffer, m_SSBOs.ssboStagingBuffer.buffer, 1, &copyRegion);
-		vkCmdCopyBuffer(copyCmd, m_SSBOs.ssboAliveListAfterSimulate.buffer, m_SSBOs.ssboAliveList.buffer, 1, &copyRegion);
-		//vkCmdCopyBuffer(copyCmd, m_SSBOs.ssboStagingBuffer.buffer, m_SSBOs.ssboAliveListAfterSimulate.buffer, 1, &copyRegion);
-		VulkanExampleBase::flushCommandBuffer(copyCmd, queue, true);
 	}
 	
 	void draw()
 	{
-		VkSubmitInfo computeSubmitInfo = vks::initializers::submitInfo();
-		computeSubmitInfo.commandBufferCount = 1;
-		computeSubmitInfo.pCommandBuffers = &compute.commandBuffer;
+		// The previous frame's compute commands, the only readers of the emitter parameters, have finished (see below)
+		if (m_emitter_params_dirty) {
+			UpdateEmitterParams();
+			m_emitter_params_dirty = false;
+		}
 
-		VK_CHECK_RESULT(vkQueueSubmit(compute.queue, 1, &computeSubmitInfo, compute.fence));
+		// Submit compute commands, the scheduler makes them wait for the previous frame's graphics commands
+		m_scheduler.submit(compute.job, compute.commandBuffer);
 
-		// Submit graphics commands
+		// Submit graphics commands, waits for this frame's compute commands
 		VulkanExampleBase::prepareFrame();
-
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
-
+		m_scheduler.submit(compute.graphicsJob, drawCmdBuffers[currentBuffer], { semaphores.presentComplete }, { submitPipelineStages }, { semaphores.renderComplete });
 		VulkanExampleBase::submitFrame();
 
-		// Submit compute commands
-		vkWaitForFences(device, 1, &compute.fence, VK_TRUE, UINT64_MAX);
-		vkResetFences(device, 1, &compute.fence);
+		// The compute command buffer is rebuilt on changes
+		m_scheduler.wait(compute.job);
+	}
+
+	// Enable timeline semaphores for the scheduler if supported
+	virtual void getEnabledFeatures()
+	{
+		m_scheduler.requestTimelineSemaphores(physicalDevice, enabledDeviceExtensions, deviceCreatepNextChain);
 	}
 
 	void prepare()
@@ -1611,9 +1955,13 @@ public:
 		BuildComputeUpdateCounterBegin();
 		BuildComputeEmission();
 		BuildComputeSimulation();
+		m_bitonic_sort.prepare(vulkanDevice, pipelineCache, loadShader(getAssetPath() + "shaders/base/bitonicsort.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT));
+		SortBenchmark();
 		BuildComputeUpdateCounterEnd();
 		BuildGraphicEnvironment();
 		BuildGraphicComposition();
+		// Reads the composition scene matrices
+		BuildComputeDepthSort();
 
 		UpdateUBO();
 
@@ -1622,6 +1970,23 @@ public:
 		prepared = true;
 	}
 
+	// Sort throughput and correctness check against the CPU reference, enabled with "-sortbenchmark"
+	void SortBenchmark()
+	{
+		bool enabled = false;
+		for (auto arg : args) {
+			if (std::string(arg) == "-sortbenchmark") {
+				enabled = true;
+			}
+		}
+		if (!enabled) {
+			return;
+		}
+		for (uint32_t count : { 256u * 1024u, 1024u * 1024u }) {
+			m_bitonic_sort.benchmark(queue, count);
+		}
+	}
+
 	virtual void render()
 	{
 		if (!prepared)
@@ -1647,23 +2012,30 @@ public:
 	virtual void OnUpdateUIOverlay(vks::UIOverlay* overlay)
 	{
 		if (overlay->header("Particle System")) {
+			overlay->text("Emitters: %d (%d particles)", (int32_t)m_emitters.size(), (int32_t)GetTotalParticleCount());
+			overlay->sliderInt("Emitter", &m_selected_emitter, 0, (int32_t)m_emitters.size() - 1);
+			if (overlay->checkBox("Depth sort", &m_depth_sort)) {
+				Reset();
+			}
+			CParticleSystem& emitter = GetSelectedEmitter();
 			if (overlay->treeNodeBegin("General")) {
-				glm::vec3 pos = m_particles.GetPos();
+				glm::vec3 pos = emitter.GetPos();
 				if (overlay->inputFloat3("Position", &pos[0], 2)) {
 					//m_environment_binding.sceneMatrices.lightPos = glm::vec4(pos.x * 1.0f, pos.y * -10.0f, pos.z * -1.0f, 1.0);
-					m_particles.SetPos(pos);
-					UpdateUBOMatrices();
+					emitter.SetPos(pos);
+					m_emitter_params_dirty = true;
 				}
 				
-				glm::vec3 rot = m_particles.GetRot();
+				glm::vec3 rot = emitter.GetRot();
 				if (overlay->sliderFloat3("Rotate", &rot[0], 0.0f, 2.0f)) {
-					m_particles.SetRot(rot);
-					UpdateUBOMatrices();
+					emitter.SetRot(rot);
+					m_emitter_params_dirty = true;
 				}
 
-				int32_t num = m_particles.GetMaxParticleCount();
+				int32_t num = emitter.GetMaxParticleCount();
 				if (overlay->sliderInt("Max Particle", &num, 4, 4 * 1024)) {
-					m_particles.SetMaxParticleCount(num);
+					// Changes the particle ranges of all following emitters
+					emitter.SetMaxParticleCount(num);
 					Reset();
 				}
 				overlay->treeNodeEnd();
@@ -1678,20 +2050,20 @@ public:
 				}
 				if (overlay->treeNodeBegin("Shape")) {
 					//overlay->text("Shape");
-					int32_t shape_index = m_particles.GetEmitShape();
+					int32_t shape_index = emitter.GetEmitShape();
 					if (overlay->comboBox("##Shape", &shape_index, { "point", "ring" })) {
-						m_particles.SetEmitShape((EmitShape)shape_index);
+						emitter.SetEmitShape((EmitShape)shape_index);
 						//updateUniformBuffers();
 					}
 					switch (shape_index) {
 					case EmitShape::ES_POINT:
 					{
-						CEmitShapePoint* shape_obj = (CEmitShapePoint*)m_particles.GetEmitShape();
+						CEmitShapePoint* shape_obj = (CEmitShapePoint*)emitter.GetEmitShape();
 						if (!shape_obj) { break; }
 					}break;
 					case EmitShape::ES_RING:
 					{
-						CEmitShapeRing* shape_obj = (CEmitShapeRing*)m_particles.GetEmitShape();
+						CEmitShapeRing* shape_obj = (CEmitShapeRing*)emitter.GetEmitShape();
 						if (!shape_obj) { break; }
 							
 						//overlay->text("Radius");
@@ -1707,12 +2079,12 @@ public:
 							data->Buf = new char(data->BufSize);
 							return 0;
 						};
-						std::string str = m_particles.GetStr();
+						std::string str = emitter.GetStr();
 						char* buffer = new char[1024];
 						str.copy(buffer, str.size());
 						buffer[str.size()] = '\0';
 						if (overlay->inputEditor("Velocity", buffer, 1024, func)) {
-							m_particles.SetStr(buffer);
+							emitter.SetStr(buffer);
 						}
 						delete buffer;
 
@@ -1727,14 +2099,14 @@ public:
 				
 				if (overlay->treeNodeBegin("Velocity")) {
 					//overlay->text("Velocity");
-					int32_t velocity_type = m_particles.GetVelocityType();
+					int32_t velocity_type = emitter.GetVelocityType();
 					if (overlay->comboBox("__________________________", &velocity_type, { "cone", "radial" })) {
-						m_particles.SetVelocityType((VelocityType)velocity_type);
+						emitter.SetVelocityType((VelocityType)velocity_type);
 						//updateUniformBuffers();
 					}
 					switch (velocity_type) {
 					case VelocityType::VT_CONE: {
-						CVelocityTypeCone* velocity_type_obj = (CVelocityTypeCone*)m_particles.GetVelocityTypeObject();
+						CVelocityTypeCone* velocity_type_obj = (CVelocityTypeCone*)emitter.GetVelocityTypeObject();
 						if (!velocity_type_obj) { break; }
 						char* buffer = new char[1024];
 						{
@@ -1782,7 +2154,7 @@ public:
 					overlay->treeNodeEnd();
 				}
 				if (overlay->treeNodeBegin("Size")) {
-					CParticleScale* particle_scale_obj = (CParticleScale*)m_particles.GetParticleScaleObject();
+					CParticleScale* particle_scale_obj = (CParticleScale*)emitter.GetParticleScaleObject();
 					if (particle_scale_obj)
 					{
 						char* buffer = new char[1024];
@@ -1,6 +1,9 @@
 /*
 * Vulkan Example - Compute shader sloth simulation
 *
+* Mass spring solver (optionally reading the spring neighbourhood from shared memory tiles) and
+* a position based solver with graph colored constraint batches, both with a configurable number of substeps
+*
 * Copyright (C) 2016-2017 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
@@ -12,6 +15,9 @@
 #include <assert.h>
 #include <vector>
 #include <random>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -22,18 +28,180 @@
 #include "vulkanexamplebase.h"
 #include "VulkanTexture.hpp"
 #include "VulkanModel.hpp"
+#include "VulkanAsyncCompute.hpp"
 
 #define ENABLE_VALIDATION false
+// Work group size of the cloth compute shaders
+#define CLOTH_WORKGROUP_SIZE 16
+#define MAX_SPHERES 4
+
+// Compute shader uniform block object
+struct ClothParameters {
+	float deltaT = 0.0f;
+	float particleMass = 0.1f;
+	float springStiffness = 2000.0f;
+	float damping = 0.25f;
+	float restDistH;
+	float restDistV;
+	float restDistD;
+	float compliance = 0.0f;						// Inverse stiffness of the position based distance constraints
+	glm::vec4 gravity = glm::vec4(0.0f, 9.8f, 0.0f, 0.0f);
+	glm::ivec2 particleCount;
+	int32_t sphereCount = 0;
+	float _pad0;
+	glm::vec4 spheres[MAX_SPHERES];					// xyz = position, w = radius
+};
+
+/*
+	CPU reference of both cloth solvers for correctness checks
+	Follows the GPU passes step by step (see data/shaders/computecloth/cloth.comp and cloth_pbd.comp)
+*/
+class ClothReference
+{
+public:
+	ClothParameters params;
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> velocities;
+	std::vector<bool> pinned;
+
+	/** @brief Advance the mass spring solver by one substep, all particles are updated from the previous state like the ping-ponged GPU dispatches */
+	void springsSubstep()
+	{
+		// Same order as the shader, so the forces are summed up the same way
+		const struct { glm::ivec2 offset; float restDist; } springs[8] = {
+			{ glm::ivec2(-1, 0), params.restDistH }, { glm::ivec2(1, 0), params.restDistH },
+			{ glm::ivec2(0, 1), params.restDistV }, { glm::ivec2(0, -1), params.restDistV },
+			{ glm::ivec2(-1, 1), params.restDistD }, { glm::ivec2(-1, -1), params.restDistD },
+			{ glm::ivec2(1, 1), params.restDistD }, { glm::ivec2(1, -1), params.restDistD }
+		};
+		std::vector<glm::vec3> newPositions(positions);
+		std::vector<glm::vec3> newVelocities(velocities);
+		for (int32_t y = 0; y < params.particleCount.y; y++) {
+			for (int32_t x = 0; x < params.particleCount.x; x++) {
+				const uint32_t index = y * params.particleCount.x + x;
+				if (pinned[index]) {
+					newVelocities[index] = glm::vec3(0.0f);
+					continue;
+				}
+				const glm::vec3 pos = positions[index];
+				const glm::vec3 vel = velocities[index];
+				glm::vec3 force = glm::vec3(params.gravity) * params.particleMass;
+				for (auto &spring : springs) {
+					const glm::ivec2 neighbour = glm::ivec2(x, y) + spring.offset;
+					if ((neighbour.x >= 0) && (neighbour.y >= 0) && (neighbour.x < params.particleCount.x) && (neighbour.y < params.particleCount.y)) {
+						const glm::vec3 dist = positions[neighbour.y * params.particleCount.x + neighbour.x] - pos;
+						force += glm::normalize(dist) * params.springStiffness * (glm::length(dist) - spring.restDist);
+					}
+				}
+				force += -params.damping * vel;
+				const glm::vec3 f = force * (1.0f / params.particleMass);
+				newPositions[index] = pos + vel * params.deltaT + 0.5f * f * params.deltaT * params.deltaT;
+				newVelocities[index] = vel + f * params.deltaT;
+				collide(newPositions[index], &newVelocities[index]);
+			}
+		}
+		positions.swap(newPositions);
+		velocities.swap(newVelocities);
+	}
+
+	/** @brief Advance the position based solver by one substep, the constraint batches are solved in the same order as on the GPU */
+	void positionBasedSubstep()
+	{
+		const std::vector<glm::vec3> previous(positions);
+		for (size_t i = 0; i < positions.size(); i++) {
+			if (!pinned[i]) {
+				const glm::vec3 vel = velocities[i] + (glm::vec3(params.gravity) - params.damping * velocities[i] / params.particleMass) * params.deltaT;
+				positions[i] = previous[i] + vel * params.deltaT;
+			}
+		}
+		const glm::ivec2 count = params.particleCount;
+		for (int32_t parity = 0; parity < 2; parity++) {
+			for (int32_t y = 0; y < count.y; y++) {
+				for (int32_t x = parity; x + 1 < count.x; x += 2) {
+					solveDistance(glm::ivec2(x, y), glm::ivec2(x + 1, y), params.restDistH);
+				}
+			}
+		}
+		for (int32_t parity = 0; parity < 2; parity++) {
+			for (int32_t y = parity; y + 1 < count.y; y += 2) {
+				for (int32_t x = 0; x < count.x; x++) {
+					solveDistance(glm::ivec2(x, y), glm::ivec2(x, y + 1), params.restDistV);
+				}
+			}
+		}
+		for (int32_t parity = 0; parity < 2; parity++) {
+			for (int32_t y = 0; y + 1 < count.y; y++) {
+				for (int32_t x = parity; x + 1 < count.x; x += 2) {
+					solveDistance(glm::ivec2(x, y), glm::ivec2(x + 1, y + 1), params.restDistD);
+				}
+			}
+		}
+		for (int32_t parity = 0; parity < 2; parity++) {
+			for (int32_t y = 0; y + 1 < count.y; y++) {
+				for (int32_t x = parity; x + 1 < count.x; x += 2) {
+					solveDistance(glm::ivec2(x + 1, y), glm::ivec2(x, y + 1), params.restDistD);
+				}
+			}
+		}
+		for (size_t i = 0; i < positions.size(); i++) {
+			if (!pinned[i]) {
+				collide(positions[i], nullptr);
+				velocities[i] = (positions[i] - previous[i]) / params.deltaT;
+			}
+		}
+	}
+
+private:
+	void collide(glm::vec3 &pos, glm::vec3 *vel)
+	{
+		for (int32_t i = 0; i < params.sphereCount; i++) {
+			const glm::vec3 sphereDist = pos - glm::vec3(params.spheres[i]);
+			if (glm::length(sphereDist) < params.spheres[i].w + 0.01f) {
+				pos = glm::vec3(params.spheres[i]) + glm::normalize(sphereDist) * (params.spheres[i].w + 0.01f);
+				if (vel) {
+					*vel = glm::vec3(0.0f);
+				}
+			}
+		}
+	}
+
+	void solveDistance(glm::ivec2 p0, glm::ivec2 p1, float restDist)
+	{
+		const uint32_t i0 = p0.y * params.particleCount.x + p0.x;
+		const uint32_t i1 = p1.y * params.particleCount.x + p1.x;
+		const float w0 = pinned[i0] ? 0.0f : 1.0f / params.particleMass;
+		const float w1 = pinned[i1] ? 0.0f : 1.0f / params.particleMass;
+		const glm::vec3 dist = positions[i0] - positions[i1];
+		const float len = glm::length(dist);
+		if ((w0 + w1 == 0.0f) || (len == 0.0f)) {
+			return;
+		}
+		const float alpha = params.compliance / (params.deltaT * params.deltaT);
+		const float lambda = -(len - restDist) / (w0 + w1 + alpha);
+		const glm::vec3 n = dist / len;
+		positions[i0] += w0 * lambda * n;
+		positions[i1] -= w1 * lambda * n;
+	}
+};
 
 class VulkanExample : public VulkanExampleBase
 {
 public:
 	uint32_t sceneSetup = 0;
-	uint32_t readSet = 0;
 	uint32_t indexCount;
 	bool simulateWind = false;
 	bool specializedComputeQueue = false;
 
+	// The mass spring solver reads the spring neighbourhood of each particle either from global memory or from shared memory tiles
+	// The position based solver stays stable at much larger time steps
+	enum Solver { SOLVER_SPRINGS = 0, SOLVER_SPRINGS_SHARED = 1, SOLVER_POSITION_BASED = 2 };
+	int32_t solver = SOLVER_SPRINGS_SHARED;
+	// Simulation substeps per frame, always even as the mass spring solver ping-pongs between the storage buffers
+	int32_t substeps = 64;
+	// Grid sizes that can be selected in the UI, "-gridsize" adds another one
+	std::vector<uint32_t> gridSizes = { 60, 128, 256, 512, 1024 };
+	int32_t gridSizeIndex = 0;
+
 	vks::Texture2D textureCloth;
 
 	vks::VertexLayout vertexLayout = vks::VertexLayout({
@@ -54,6 +222,7 @@ public:
 		} pipelines;
 		vks::Buffer indices;
 		vks::Buffer uniformBuffer;
+		uint32_t job;
 		struct graphicsUBO {
 			glm::mat4 projection;
 			glm::mat4 view;
@@ -67,33 +236,25 @@ public:
 			vks::Buffer input;
 			vks::Buffer output;
 		} storageBuffers;
-		struct Semaphores {
-			VkSemaphore ready{ 0L };
-			VkSemaphore complete{ 0L };
-		} semaphores;
 		vks::Buffer uniformBuffer;
 		VkQueue queue;
 		VkCommandPool commandPool;
-		std::array<VkCommandBuffer,2> commandBuffers;
+		VkCommandBuffer commandBuffer;
 		VkDescriptorSetLayout descriptorSetLayout;
 		std::array<VkDescriptorSet,2> descriptorSets;
 		VkPipelineLayout pipelineLayout;
-		VkPipeline pipeline;
-		struct computeUBO {
-			float deltaT = 0.0f;
-			float particleMass = 0.1f;
-			float springStiffness = 2000.0f;
-			float damping = 0.25f;
-			float restDistH;
-			float restDistV;
-			float restDistD;
-			float sphereRadius = 0.5f;
-			glm::vec4 spherePos = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
-			glm::vec4 gravity = glm::vec4(0.0f, 9.8f, 0.0f, 0.0f);
-			glm::ivec2 particleCount;
-		} ubo;
+		struct Pipelines {
+			VkPipeline springs;
+			VkPipeline springsShared;
+			VkPipeline positionBased;
+		} pipelines;
+		uint32_t job;
+		ClothParameters ubo;
 	} compute;
 
+	// Synchronizes the compute and graphics submissions sharing the particle buffers
+	vks::AsyncComputeScheduler scheduler;
+
 	// SSBO cloth grid particle declaration
 	struct Particle {
 		glm::vec4 pos;
@@ -104,6 +265,17 @@ public:
 		glm::vec3 _pad0;
 	};
 
+	// Position based solver passes (see data/shaders/computecloth/cloth_pbd.comp)
+	enum PositionBasedMode { MODE_PREDICT = 0, MODE_SOLVE = 1, MODE_COLLIDE = 2, MODE_FINALIZE = 3 };
+	static const uint32_t CONSTRAINT_BATCH_COUNT = 8;
+	static const uint32_t CONSTRAINT_VERTICAL = 1;
+
+	struct PushConstants {
+		uint32_t calculateNormals;
+		uint32_t mode;
+		uint32_t batch;
+	};
+
 	struct Cloth {
 		glm::uvec2 gridsize = glm::uvec2(60, 60);
 		glm::vec2 size = glm::vec2(2.5f, 2.5f);
@@ -117,12 +289,32 @@ public:
 		camera.setRotation(glm::vec3(-30.0f, -45.0f, 0.0f));
 		camera.setTranslation(glm::vec3(0.0f, 0.0f, -3.5f));
 		settings.overlay = true;
+		for (size_t i = 0; i < args.size(); i++) {
+			if ((std::string(args[i]) == "-gridsize") && (i + 1 < args.size())) {
+				const uint32_t gridSize = std::max(std::stoi(args[i + 1]), 2);
+				auto it = std::find(gridSizes.begin(), gridSizes.end(), gridSize);
+				if (it == gridSizes.end()) {
+					it = gridSizes.insert(std::upper_bound(gridSizes.begin(), gridSizes.end(), gridSize), gridSize);
+				}
+				gridSizeIndex = static_cast<int32_t>(it - gridSizes.begin());
+			}
+			if ((std::string(args[i]) == "-substeps") && (i + 1 < args.size())) {
+				substeps = std::max((std::stoi(args[i + 1]) + 1) & ~1, 2);
+			}
+			if (std::string(args[i]) == "-pbd") {
+				solver = SOLVER_POSITION_BASED;
+			}
+		}
+		cloth.gridsize = glm::uvec2(gridSizes[gridSizeIndex]);
+		scheduler.parseCommandLine(args);
+		vks::AsyncComputeScheduler::requestInstanceExtensions(enabledInstanceExtensions);
 	}
 
 	~VulkanExample()
 	{
 		// Graphics
 		graphics.uniformBuffer.destroy();
+		graphics.indices.destroy();
 		vkDestroyPipeline(device, graphics.pipelines.cloth, nullptr);
 		vkDestroyPipeline(device, graphics.pipelines.sphere, nullptr);
 		vkDestroyPipelineLayout(device, graphics.pipelineLayout, nullptr);
@@ -136,27 +328,36 @@ public:
 		compute.uniformBuffer.destroy();
 		vkDestroyPipelineLayout(device, compute.pipelineLayout, nullptr);
 		vkDestroyDescriptorSetLayout(device, compute.descriptorSetLayout, nullptr);
-		vkDestroyPipeline(device, compute.pipeline, nullptr);
-		vkDestroySemaphore(device, compute.semaphores.ready, nullptr);
-		vkDestroySemaphore(device, compute.semaphores.complete, nullptr);
+		vkDestroyPipeline(device, compute.pipelines.springs, nullptr);
+		vkDestroyPipeline(device, compute.pipelines.springsShared, nullptr);
+		vkDestroyPipeline(device, compute.pipelines.positionBased, nullptr);
 		vkDestroyCommandPool(device, compute.commandPool, nullptr);
+		scheduler.destroy();
 	}
 
-	// Enable physical device features required for this example				
+	// Enable physical device features required for this example
 	virtual void getEnabledFeatures()
 	{
 		if (deviceFeatures.samplerAnisotropy) {
 			enabledFeatures.samplerAnisotropy = VK_TRUE;
 		}
+		scheduler.requestTimelineSemaphores(physicalDevice, enabledDeviceExtensions, deviceCreatepNextChain);
 	};
 
 	void loadAssets()
 	{
 		textureCloth.loadFromFile(getAssetPath() + "textures/vulkan_cloth_rgba.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
-		modelSphere.loadFromFile(getAssetPath() + "models/geosphere.obj", vertexLayout, compute.ubo.sphereRadius * 0.05f, vulkanDevice, queue);
+		// Scaled to a radius of one, the spheres are scaled to their radius in the vertex shader
+		modelSphere.loadFromFile(getAssetPath() + "models/geosphere.obj", vertexLayout, 0.05f, vulkanDevice, queue);
 	}
 
-	void addGraphicsToComputeBarriers(VkCommandBuffer commandBuffer) 
+	// Simulated seconds per frame, the mass spring solver needs much smaller time steps to stay stable
+	float frameTime(int32_t solver)
+	{
+		return (solver == SOLVER_POSITION_BASED) ? 1.0f / 60.0f : 0.00032f;
+	}
+
+	void addGraphicsToComputeBarriers(VkCommandBuffer commandBuffer)
 	{
 		if (specializedComputeQueue) {
 			VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
@@ -179,9 +380,9 @@ public:
 				static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
 				0, nullptr);
 		}
-	} 
+	}
 
-	void addComputeToComputeBarriers(VkCommandBuffer commandBuffer) 
+	void addComputeToComputeBarriers(VkCommandBuffer commandBuffer)
 	{
 		VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
 		bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
@@ -202,7 +403,7 @@ public:
 			0, nullptr,
 			static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
 			0, nullptr);
-	} 
+	}
 
 	void addComputeToGraphicsBarriers(VkCommandBuffer commandBuffer)
 	{
@@ -227,7 +428,7 @@ public:
 				static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
 				0, nullptr);
 		}
-	} 
+	}
 
 	void buildCommandBuffers()
 	{
@@ -275,13 +476,16 @@ public:
 
 			VkDeviceSize offsets[1] = { 0 };
 
-			// Render sphere
-			if (sceneSetup == 0) {
+			// Render spheres
+			if (compute.ubo.sphereCount > 0) {
 				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelines.sphere);
 				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelineLayout, 0, 1, &graphics.descriptorSet, 0, NULL);
 				vkCmdBindIndexBuffer(drawCmdBuffers[i], modelSphere.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
 				vkCmdBindVertexBuffers(drawCmdBuffers[i], 0, 1, &modelSphere.vertices.buffer, offsets);
-				vkCmdDrawIndexed(drawCmdBuffers[i], modelSphere.indexCount, 1, 0, 0, 0);
+				for (int32_t j = 0; j < compute.ubo.sphereCount; j++) {
+					vkCmdPushConstants(drawCmdBuffers[i], graphics.pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::vec4), &compute.ubo.spheres[j]);
+					vkCmdDrawIndexed(drawCmdBuffers[i], modelSphere.indexCount, 1, 0, 0, 0);
+				}
 			}
 
 			// Render cloth
@@ -291,8 +495,6 @@ public:
 			vkCmdBindVertexBuffers(drawCmdBuffers[i], 0, 1, &compute.storageBuffers.output.buffer, offsets);
 			vkCmdDrawIndexed(drawCmdBuffers[i], indexCount, 1, 0, 0, 0);
 
-			drawUI(drawCmdBuffers[i]);
-
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
 
 			// release the storage buffers to the compute queue
@@ -303,52 +505,89 @@ public:
 
 	}
 
+	/**
+	* Record the substeps of one frame, the result is stored in the output buffer
+	*
+	* @param commandBuffer Command buffer to record to
+	* @param solver Solver to use
+	* @param substeps Number of substeps (must be even)
+	*/
+	void recordSimulation(VkCommandBuffer commandBuffer, int32_t solver, uint32_t substeps)
+	{
+		const glm::uvec2 groupCount = (cloth.gridsize + glm::uvec2(CLOTH_WORKGROUP_SIZE - 1)) / glm::uvec2(CLOTH_WORKGROUP_SIZE);
+		PushConstants pushConstants = {};
+
+		if (solver == SOLVER_POSITION_BASED) {
+			// Positions at the start of the substep are kept in the input buffer, the output buffer is updated in place
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelines.positionBased);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSets[0], 0, 0);
+			// Each batch solves every other constraint along x (along y for vertical constraints)
+			const glm::uvec2 halfGrid = (cloth.gridsize + glm::uvec2(1)) / glm::uvec2(2);
+			const glm::uvec2 batchGroupCount = (glm::uvec2(halfGrid.x, cloth.gridsize.y) + glm::uvec2(CLOTH_WORKGROUP_SIZE - 1)) / glm::uvec2(CLOTH_WORKGROUP_SIZE);
+			const glm::uvec2 verticalBatchGroupCount = (glm::uvec2(cloth.gridsize.x, halfGrid.y) + glm::uvec2(CLOTH_WORKGROUP_SIZE - 1)) / glm::uvec2(CLOTH_WORKGROUP_SIZE);
+			for (uint32_t i = 0; i < substeps; i++) {
+				pushConstants.calculateNormals = (i == substeps - 1) ? 1 : 0;
+				pushConstants.mode = MODE_PREDICT;
+				vkCmdPushConstants(commandBuffer, compute.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+				vkCmdDispatch(commandBuffer, groupCount.x, groupCount.y, 1);
+				addComputeToComputeBarriers(commandBuffer);
+				pushConstants.mode = MODE_SOLVE;
+				for (uint32_t batch = 0; batch < CONSTRAINT_BATCH_COUNT; batch++) {
+					pushConstants.batch = batch;
+					vkCmdPushConstants(commandBuffer, compute.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+					const glm::uvec2 &count = (batch / 2 == CONSTRAINT_VERTICAL) ? verticalBatchGroupCount : batchGroupCount;
+					vkCmdDispatch(commandBuffer, count.x, count.y, 1);
+					addComputeToComputeBarriers(commandBuffer);
+				}
+				pushConstants.mode = MODE_COLLIDE;
+				vkCmdPushConstants(commandBuffer, compute.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+				vkCmdDispatch(commandBuffer, groupCount.x, groupCount.y, 1);
+				addComputeToComputeBarriers(commandBuffer);
+				pushConstants.mode = MODE_FINALIZE;
+				vkCmdPushConstants(commandBuffer, compute.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+				vkCmdDispatch(commandBuffer, groupCount.x, groupCount.y, 1);
+				// Don't add a barrier after the last substep, the caller adds the barrier (or release) it needs
+				if (i != substeps - 1) {
+					addComputeToComputeBarriers(commandBuffer);
+				}
+			}
+			return;
+		}
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, (solver == SOLVER_SPRINGS_SHARED) ? compute.pipelines.springsShared : compute.pipelines.springs);
+		for (uint32_t i = 0; i < substeps; i++) {
+			// Ping-pong between the storage buffers, the last substep writes to the output buffer
+			const uint32_t readSet = 1 - (i % 2);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSets[readSet], 0, 0);
+			pushConstants.calculateNormals = (i == substeps - 1) ? 1 : 0;
+			vkCmdPushConstants(commandBuffer, compute.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+			vkCmdDispatch(commandBuffer, groupCount.x, groupCount.y, 1);
+			if (i != substeps - 1) {
+				addComputeToComputeBarriers(commandBuffer);
+			}
+		}
+	}
+
 	// todo: check barriers (validation, separate compute queue)
 	void buildComputeCommandBuffer()
 	{
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 		cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
 
-		for (uint32_t i = 0; i < 2; i++) {
-
-			VK_CHECK_RESULT(vkBeginCommandBuffer(compute.commandBuffers[i], &cmdBufInfo));
-
-			// Acquire the storage buffers from the graphics queue
-			addGraphicsToComputeBarriers(compute.commandBuffers[i]);
+		VK_CHECK_RESULT(vkBeginCommandBuffer(compute.commandBuffer, &cmdBufInfo));
 
-			vkCmdBindPipeline(compute.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipeline);
+		// Acquire the storage buffers from the graphics queue
+		addGraphicsToComputeBarriers(compute.commandBuffer);
 
-			uint32_t calculateNormals = 0;
-			vkCmdPushConstants(compute.commandBuffers[i], compute.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &calculateNormals);
-
-			// Dispatch the compute job
-			const uint32_t iterations = 64;
-			for (uint32_t j = 0; j < iterations; j++) {
-				readSet = 1 - readSet;
-				vkCmdBindDescriptorSets(compute.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSets[readSet], 0, 0);
-
-				if (j == iterations - 1) {
-					calculateNormals = 1;
-					vkCmdPushConstants(compute.commandBuffers[i], compute.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &calculateNormals);
-				}
+		recordSimulation(compute.commandBuffer, solver, substeps);
 
-				vkCmdDispatch(compute.commandBuffers[i], cloth.gridsize.x / 10, cloth.gridsize.y / 10, 1);
-
-				// Don't add a barrier on the last iteration of the loop, since we'll have an explicit release to the graphics queue
-				if (j != iterations - 1) {
-					addComputeToComputeBarriers(compute.commandBuffers[i]);
-				}
-
-			}
-
-			// release the storage buffers back to the graphics queue
-			addComputeToGraphicsBarriers(compute.commandBuffers[i]);
-			vkEndCommandBuffer(compute.commandBuffers[i]);
-		}
+		// release the storage buffers back to the graphics queue
+		addComputeToGraphicsBarriers(compute.commandBuffer);
+		vkEndCommandBuffer(compute.commandBuffer);
 	}
 
-	// Setup and fill the compute shader storage buffers containing the particles
-	void prepareStorageBuffers()
+	// Generate the particles of the current scene and grid size and place the collision spheres
+	std::vector<Particle> generateParticles()
 	{
 		std::vector<Particle> particleBuffer(cloth.gridsize.x *  cloth.gridsize.y);
 
@@ -360,7 +599,7 @@ public:
 		switch (sceneSetup) {
 			case 0 :
 			{
-				// Horz. cloth falls onto sphere
+				// Horz. cloth falls onto spheres
 				glm::mat4 transM = glm::translate(glm::mat4(1.0f), glm::vec3(- cloth.size.x / 2.0f, -2.0f, - cloth.size.y / 2.0f));
 				for (uint32_t i = 0; i <  cloth.gridsize.y; i++) {
 					for (uint32_t j = 0; j <  cloth.gridsize.x; j++) {
@@ -369,6 +608,10 @@ public:
 						particleBuffer[i + j * cloth.gridsize.y].uv = glm::vec4(1.0f - du * i, dv * j, 0.0f, 0.0f);
 					}
 				}
+				compute.ubo.sphereCount = 3;
+				compute.ubo.spheres[0] = glm::vec4(0.0f, 0.0f, 0.0f, 0.5f);
+				compute.ubo.spheres[1] = glm::vec4(-0.75f, 0.25f, 0.75f, 0.25f);
+				compute.ubo.spheres[2] = glm::vec4(0.8f, 0.35f, -0.6f, 0.3f);
 				break;
 			}
 			case 1:
@@ -382,18 +625,38 @@ public:
 						particleBuffer[i + j * cloth.gridsize.y].uv = glm::vec4(du * j, dv * i, 0.0f, 0.0f);
 						// Pin some particles
 						particleBuffer[i + j * cloth.gridsize.y].pinned = (i == 0) && ((j == 0) || (j ==  cloth.gridsize.x / 3) || (j ==  cloth.gridsize.x -  cloth.gridsize.x / 3) || (j ==  cloth.gridsize.x - 1));
-						// Remove sphere
-						compute.ubo.spherePos.z = -10.0f;
 					}
 				}
+				// No spheres
+				compute.ubo.sphereCount = 0;
 				break;
 			}
 		}
 
+		return particleBuffer;
+	}
+
+	// Setup and fill the compute shader storage buffers containing the particles, existing buffers are replaced (the device must be idle)
+	void prepareStorageBuffers()
+	{
+		compute.storageBuffers.input.destroy();
+		compute.storageBuffers.output.destroy();
+		graphics.indices.destroy();
+
+		std::vector<Particle> particleBuffer = generateParticles();
+
+		// Grid dependent parameters
+		float dx = cloth.size.x / (cloth.gridsize.x - 1);
+		float dy = cloth.size.y / (cloth.gridsize.y - 1);
+		compute.ubo.restDistH = dx;
+		compute.ubo.restDistV = dy;
+		compute.ubo.restDistD = sqrtf(dx * dx + dy * dy);
+		compute.ubo.particleCount = cloth.gridsize;
+
 		VkDeviceSize storageBufferSize = particleBuffer.size() * sizeof(Particle);
 
 		// Staging
-		// SSBO won't be changed on the host after upload so copy to device local memory 
+		// SSBO won't be changed on the host after upload so copy to device local memory
 
 		vks::Buffer stagingBuffer;
 
@@ -405,13 +668,13 @@ public:
 			particleBuffer.data());
 
 		vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 			&compute.storageBuffers.input,
 			storageBufferSize);
 
 		vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 			&compute.storageBuffers.output,
 			storageBufferSize);
@@ -422,7 +685,7 @@ public:
 		copyRegion.size = storageBufferSize;
 		vkCmdCopyBuffer(copyCmd, stagingBuffer.buffer, compute.storageBuffers.input.buffer, 1, &copyRegion);
 		vkCmdCopyBuffer(copyCmd, stagingBuffer.buffer, compute.storageBuffers.output.buffer, 1, &copyRegion);
-		// Add an initial release barrier to the graphics queue, 
+		// Add an initial release barrier to the graphics queue,
 		// so that when the compute command buffer executes for the first time
 		// it doesn't complain about a lack of a corresponding "release" to it's "acquire"
 		addGraphicsToComputeBarriers(copyCmd);
@@ -493,10 +756,14 @@ public:
 
 		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo =
 			vks::initializers::pipelineLayoutCreateInfo(&graphics.descriptorSetLayout, 1);
+		// Sphere position and radius
+		VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_VERTEX_BIT, sizeof(glm::vec4), 0);
+		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
 		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &graphics.pipelineLayout));
 
 		// Set
-		VkDescriptorSetAllocateInfo allocInfo = 
+		VkDescriptorSetAllocateInfo allocInfo =
 			vks::initializers::descriptorSetAllocateInfo(descriptorPool, &graphics.descriptorSetLayout, 1);
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &graphics.descriptorSet));
 
@@ -549,7 +816,7 @@ public:
 				renderPass,
 				0);
 
-		// Input attributes	
+		// Input attributes
 
 		// Binding description
 		std::vector<VkVertexInputBindingDescription> inputBindings = {
@@ -602,6 +869,22 @@ public:
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &graphics.pipelines.sphere));
 	}
 
+	// Point the compute descriptor sets to the current storage buffers
+	void updateComputeDescriptorSets()
+	{
+		std::vector<VkWriteDescriptorSet> computeWriteDescriptorSets = {
+			vks::initializers::writeDescriptorSet(compute.descriptorSets[0], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &compute.storageBuffers.input.descriptor),
+			vks::initializers::writeDescriptorSet(compute.descriptorSets[0], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &compute.storageBuffers.output.descriptor),
+			vks::initializers::writeDescriptorSet(compute.descriptorSets[0], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &compute.uniformBuffer.descriptor),
+
+			vks::initializers::writeDescriptorSet(compute.descriptorSets[1], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &compute.storageBuffers.output.descriptor),
+			vks::initializers::writeDescriptorSet(compute.descriptorSets[1], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &compute.storageBuffers.input.descriptor),
+			vks::initializers::writeDescriptorSet(compute.descriptorSets[1], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &compute.uniformBuffer.descriptor)
+		};
+
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(computeWriteDescriptorSets.size()), computeWriteDescriptorSets.data(), 0, NULL);
+	}
+
 	void prepareCompute()
 	{
 		// Create a compute capable device queue
@@ -624,7 +907,7 @@ public:
 
 		// Push constants used to pass some parameters
 		VkPushConstantRange pushConstantRange =
-			vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(uint32_t), 0);
+			vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(PushConstants), 0);
 		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
 		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
 
@@ -633,26 +916,26 @@ public:
 		VkDescriptorSetAllocateInfo allocInfo =
 			vks::initializers::descriptorSetAllocateInfo(descriptorPool, &compute.descriptorSetLayout, 1);
 
-		// Create two descriptor sets with input and output buffers switched 
+		// Create two descriptor sets with input and output buffers switched
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &compute.descriptorSets[0]));
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &compute.descriptorSets[1]));
 
-		std::vector<VkWriteDescriptorSet> computeWriteDescriptorSets = {
-			vks::initializers::writeDescriptorSet(compute.descriptorSets[0], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &compute.storageBuffers.input.descriptor),
-			vks::initializers::writeDescriptorSet(compute.descriptorSets[0], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &compute.storageBuffers.output.descriptor),
-			vks::initializers::writeDescriptorSet(compute.descriptorSets[0], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &compute.uniformBuffer.descriptor),
-
-			vks::initializers::writeDescriptorSet(compute.descriptorSets[1], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &compute.storageBuffers.output.descriptor),
-			vks::initializers::writeDescriptorSet(compute.descriptorSets[1], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &compute.storageBuffers.input.descriptor),
-			vks::initializers::writeDescriptorSet(compute.descriptorSets[1], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2, &compute.uniformBuffer.descriptor)
-		};
-
-		vkUpdateDescriptorSets(device, static_cast<uint32_t>(computeWriteDescriptorSets.size()), computeWriteDescriptorSets.data(), 0, NULL);
+		updateComputeDescriptorSets();
 
-		// Create pipeline		
+		// Create pipelines
 		VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(compute.pipelineLayout, 0);
 		computePipelineCreateInfo.stage = loadShader(getAssetPath() + "shaders/computecloth/cloth.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
-		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.pipeline));
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.pipelines.springs));
+
+		// Mass spring solver reading the neighbourhood from shared memory, selected with a specialization constant
+		VkBool32 sharedTiles = VK_TRUE;
+		VkSpecializationMapEntry specializationMapEntry = vks::initializers::specializationMapEntry(0, 0, sizeof(VkBool32));
+		VkSpecializationInfo specializationInfo = vks::initializers::specializationInfo(1, &specializationMapEntry, sizeof(VkBool32), &sharedTiles);
+		computePipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.pipelines.springsShared));
+
+		computePipelineCreateInfo.stage = loadShader(getAssetPath() + "shaders/computecloth/cloth_pbd.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.pipelines.positionBased));
 
 		// Separate command pool as queue family for compute may be different than graphics
 		VkCommandPoolCreateInfo cmdPoolInfo = {};
@@ -663,14 +946,17 @@ public:
 
 		// Create a command buffer for compute operations
 		VkCommandBufferAllocateInfo cmdBufAllocateInfo =
-			vks::initializers::commandBufferAllocateInfo(compute.commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 2);	
+			vks::initializers::commandBufferAllocateInfo(compute.commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
 
-		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &compute.commandBuffers[0]));
+		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &compute.commandBuffer));
 
-		// Semaphores for graphics / compute synchronization
-		VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
-		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &compute.semaphores.ready));
-		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &compute.semaphores.complete));
+		// The particle buffers are updated in place, so a frame's simulation step has to wait until the previous frame has been rendered
+		// Queue family ownership of the buffers is transferred by the barriers in both command buffers
+		compute.job = scheduler.addJob("simulation", vks::AsyncComputeScheduler::COMPUTE);
+		graphics.job = scheduler.addJob("graphics", vks::AsyncComputeScheduler::GRAPHICS);
+		scheduler.addDependency(graphics.job, compute.job, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0);
+		scheduler.addDependency(compute.job, graphics.job, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 1);
+		scheduler.prepare(vulkanDevice, queue, compute.queue);
 
 		// Build a single command buffer containing the compute dispatch commands
 		buildComputeCommandBuffer();
@@ -686,15 +972,6 @@ public:
 			&compute.uniformBuffer,
 			sizeof(compute.ubo));
 		VK_CHECK_RESULT(compute.uniformBuffer.map());
-	
-		// Initial values
-		float dx = cloth.size.x / (cloth.gridsize.x - 1);
-		float dy = cloth.size.y / (cloth.gridsize.y - 1);
-
-		compute.ubo.restDistH = dx;
-		compute.ubo.restDistV = dy;
-		compute.ubo.restDistD = sqrtf(dx * dx + dy * dy);
-		compute.ubo.particleCount = cloth.gridsize;
 
 		updateComputeUBO();
 
@@ -712,9 +989,7 @@ public:
 	void updateComputeUBO()
 	{
 		if (!paused) {
-			compute.ubo.deltaT = 0.000005f;
-			// todo: base on frametime
-			//compute.ubo.deltaT = frameTimer * 0.0075f;
+			compute.ubo.deltaT = frameTime(solver) / substeps;
 
 			if (simulateWind) {
 				std::default_random_engine rndEngine(benchmark.active ? 0 : (unsigned)time(nullptr));
@@ -740,48 +1015,168 @@ public:
 		memcpy(graphics.uniformBuffer.mapped, &graphics.ubo, sizeof(graphics.ubo));
 	}
 
-	void draw()
+	// Restart the simulation with a new grid size, the device must be idle
+	void setGridSize(uint32_t gridSize)
 	{
-		static bool firstDraw = true;
-		VkSubmitInfo computeSubmitInfo = vks::initializers::submitInfo();
-		// FIXME find a better way to do this (without using fences, which is much slower)
-		VkPipelineStageFlags computeWaitDstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
-		if (!firstDraw) {
-			computeSubmitInfo.waitSemaphoreCount = 1;
-			computeSubmitInfo.pWaitSemaphores = &compute.semaphores.ready;
-			computeSubmitInfo.pWaitDstStageMask = &computeWaitDstStageMask;
-		} else {
-			firstDraw = false;
+		cloth.gridsize = glm::uvec2(gridSize);
+		prepareStorageBuffers();
+		updateComputeDescriptorSets();
+		updateComputeUBO();
+	}
+
+	VkCommandBuffer createComputeCommandBuffer()
+	{
+		VkCommandBuffer commandBuffer;
+		VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(compute.commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &commandBuffer));
+		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+		VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufInfo));
+		return commandBuffer;
+	}
+
+	// Submit a command buffer from the compute command pool to the compute queue and wait until it has finished
+	void flushComputeCommandBuffer(VkCommandBuffer commandBuffer)
+	{
+		VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+		VkSubmitInfo submitInfo = vks::initializers::submitInfo();
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+		VK_CHECK_RESULT(vkQueueSubmit(compute.queue, 1, &submitInfo, VK_NULL_HANDLE));
+		VK_CHECK_RESULT(vkQueueWaitIdle(compute.queue));
+		vkFreeCommandBuffers(device, compute.commandPool, 1, &commandBuffer);
+	}
+
+	/*
+		GPU time per simulated second of all solvers at several grid sizes and a check of the GPU solvers against CPU references, enabled with "-clothbenchmark"
+		Use "-substeps" to run it with a different number of substeps per frame
+	*/
+	void ClothBenchmark()
+	{
+		bool enabled = false;
+		for (auto arg : args) {
+			if (std::string(arg) == "-clothbenchmark") {
+				enabled = true;
+			}
+		}
+		if (!enabled) {
+			return;
 		}
-		computeSubmitInfo.signalSemaphoreCount = 1;
-		computeSubmitInfo.pSignalSemaphores = &compute.semaphores.complete;
-		computeSubmitInfo.commandBufferCount = 1;
-		computeSubmitInfo.pCommandBuffers = &compute.commandBuffers[readSet];
 
-		VK_CHECK_RESULT( vkQueueSubmit( compute.queue, 1, &computeSubmitInfo, VK_NULL_HANDLE) );
+		const std::vector<std::string> solverNames = { "Springs", "Springs (shared memory tiles)", "Position based" };
+		const uint32_t gridSize = cloth.gridsize.x;
+		const ClothParameters ubo = compute.ubo;
+		compute.ubo.gravity = glm::vec4(0.0f, 9.8f, 0.0f, 0.0f);
+
+		std::cout << std::fixed << std::setprecision(3);
+
+		// Correctness: Simulate 50 ms on the GPU and on the CPU and compare the resulting positions
+		const uint32_t checkGridSize = 60;
+		const float checkTime = 0.05f;
+		for (int32_t checkSolver : { SOLVER_SPRINGS, SOLVER_SPRINGS_SHARED, SOLVER_POSITION_BASED }) {
+			setGridSize(checkGridSize);
+			compute.ubo.deltaT = frameTime(checkSolver) / substeps;
+			memcpy(compute.uniformBuffer.mapped, &compute.ubo, sizeof(compute.ubo));
+			const uint32_t frameCount = static_cast<uint32_t>(ceilf(checkTime / frameTime(checkSolver)));
+
+			const std::vector<Particle> initialParticles = generateParticles();
+			const VkDeviceSize bufferSize = initialParticles.size() * sizeof(Particle);
+			vks::Buffer hostBuffer;
+			VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &hostBuffer, bufferSize));
+			VK_CHECK_RESULT(hostBuffer.map());
+
+			VkCommandBuffer commandBuffer = createComputeCommandBuffer();
+			addGraphicsToComputeBarriers(commandBuffer);
+			for (uint32_t i = 0; i < frameCount; i++) {
+				recordSimulation(commandBuffer, checkSolver, substeps);
+				addComputeToComputeBarriers(commandBuffer);
+			}
+			VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+			memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_FLAGS_NONE, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			VkBufferCopy copyRegion = { 0, 0, bufferSize };
+			vkCmdCopyBuffer(commandBuffer, compute.storageBuffers.output.buffer, hostBuffer.buffer, 1, &copyRegion);
+			flushComputeCommandBuffer(commandBuffer);
+
+			ClothReference reference;
+			reference.params = compute.ubo;
+			for (auto &particle : initialParticles) {
+				reference.positions.push_back(glm::vec3(particle.pos));
+				reference.velocities.push_back(glm::vec3(particle.vel));
+				reference.pinned.push_back(particle.pinned == 1.0f);
+			}
+			for (uint32_t i = 0; i < frameCount * substeps; i++) {
+				if (checkSolver == SOLVER_POSITION_BASED) {
+					reference.positionBasedSubstep();
+				} else {
+					reference.springsSubstep();
+				}
+			}
 
-		// Submit graphics commands
-		VulkanExampleBase::prepareFrame();
+			const Particle *particles = (Particle*)hostBuffer.mapped;
+			double maxError = 0.0, meanError = 0.0, maxDisplacement = 0.0;
+			for (size_t i = 0; i < initialParticles.size(); i++) {
+				const double error = glm::length(glm::vec3(particles[i].pos) - reference.positions[i]);
+				maxError = std::max(maxError, error);
+				meanError += error;
+				maxDisplacement = std::max(maxDisplacement, (double)glm::length(reference.positions[i] - glm::vec3(initialParticles[i].pos)));
+			}
+			hostBuffer.destroy();
 
-		VkPipelineStageFlags waitDstStageMask[2] = {
-			submitPipelineStages, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
-		};
-		VkSemaphore waitSemaphores[2] = {
-			semaphores.presentComplete, compute.semaphores.complete
-		};
-		VkSemaphore signalSemaphores[2] = {
-			semaphores.renderComplete, compute.semaphores.ready
-		};
+			std::cout << solverNames[checkSolver] << ", " << checkGridSize << "x" << checkGridSize << " grid, " << checkTime * 1000.0f << " ms simulated: position error vs. CPU reference mean "
+				<< std::scientific << meanError / initialParticles.size() << ", max " << maxError << std::fixed << " (max. displacement " << maxDisplacement << ")" << std::endl;
+		}
 
-		submitInfo.waitSemaphoreCount = 2;
-		submitInfo.pWaitDstStageMask = waitDstStageMask;
-		submitInfo.pWaitSemaphores = waitSemaphores;
-		submitInfo.signalSemaphoreCount = 2;
-		submitInfo.pSignalSemaphores = signalSemaphores;
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+		// Timings
+		if (vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.compute].timestampValidBits == 0) {
+			std::cout << "Compute queue does not support timestamps, skipping timings" << std::endl;
+		} else {
+			VkQueryPool queryPool;
+			VkQueryPoolCreateInfo queryPoolInfo = {};
+			queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			queryPoolInfo.queryCount = 2;
+			VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &queryPool));
+			const uint32_t frameCount = 4;
+			for (uint32_t size : { 64, 128, 256, 512, 1024 }) {
+				std::cout << "Cloth " << size << "x" << size << " with " << substeps << " substeps per frame:" << std::endl;
+				for (int32_t timedSolver : { SOLVER_SPRINGS, SOLVER_SPRINGS_SHARED, SOLVER_POSITION_BASED }) {
+					setGridSize(size);
+					compute.ubo.deltaT = frameTime(timedSolver) / substeps;
+					memcpy(compute.uniformBuffer.mapped, &compute.ubo, sizeof(compute.ubo));
+					VkCommandBuffer commandBuffer = createComputeCommandBuffer();
+					addGraphicsToComputeBarriers(commandBuffer);
+					vkCmdResetQueryPool(commandBuffer, queryPool, 0, 2);
+					vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+					for (uint32_t i = 0; i < frameCount; i++) {
+						recordSimulation(commandBuffer, timedSolver, substeps);
+						addComputeToComputeBarriers(commandBuffer);
+					}
+					vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+					flushComputeCommandBuffer(commandBuffer);
+					uint64_t timestamps[2] = { 0, 0 };
+					VK_CHECK_RESULT(vkGetQueryPoolResults(device, queryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+					const double frameMs = (double)(timestamps[1] - timestamps[0]) * vulkanDevice->properties.limits.timestampPeriod / 1000000.0 / frameCount;
+					std::cout << "  " << solverNames[timedSolver] << ": " << frameMs << " ms GPU per frame (" << frameTime(timedSolver) * 1000.0f << " ms simulated), "
+						<< frameMs / frameTime(timedSolver) << " ms GPU per simulated second" << std::endl;
+				}
+			}
+			vkDestroyQueryPool(device, queryPool, nullptr);
+		}
 
+		// Restart with the selected grid size
+		compute.ubo = ubo;
+		setGridSize(gridSize);
+	}
+
+	void draw()
+	{
+		// Submit compute commands, the scheduler makes them wait for the previous frame's graphics commands that read the particles
+		scheduler.submit(compute.job, compute.commandBuffer);
+
+		// Submit graphics commands
+		VulkanExampleBase::prepareFrame();
+		scheduler.submit(graphics.job, drawCmdBuffers[currentBuffer], { semaphores.presentComplete }, { submitPipelineStages }, { semaphores.renderComplete });
 		VulkanExampleBase::submitFrame();
 	}
 
@@ -801,6 +1196,7 @@ public:
 		setupLayoutsAndDescriptors();
 		preparePipelines();
 		prepareCompute();
+		ClothBenchmark();
 		buildCommandBuffers();
 		prepared = true;
 	}
@@ -823,6 +1219,28 @@ public:
 	{
 		if (overlay->header("Settings")) {
 			overlay->checkBox("Simulate wind", &simulateWind);
+			bool rebuild = false;
+			if (overlay->comboBox("Solver", &solver, { "Springs", "Springs (shared memory)", "Position based" })) {
+				rebuild = true;
+			}
+			if (overlay->sliderInt("Substeps", &substeps, 2, 128)) {
+				substeps = (substeps + 1) & ~1;
+				rebuild = true;
+			}
+			std::vector<std::string> gridSizeNames;
+			for (auto size : gridSizes) {
+				gridSizeNames.push_back(std::to_string(size) + "x" + std::to_string(size));
+			}
+			if (overlay->comboBox("Grid", &gridSizeIndex, gridSizeNames)) {
+				VK_CHECK_RESULT(vkDeviceWaitIdle(device));
+				setGridSize(gridSizes[gridSizeIndex]);
+				rebuild = true;
+			}
+			if (rebuild) {
+				// The compute command buffer may still be executing
+				VK_CHECK_RESULT(vkQueueWaitIdle(compute.queue));
+				buildComputeCommandBuffer();
+			}
 		}
 	}
 };
@@ -24,6 +24,8 @@
 #include "vulkanexamplebase.h"
 #include "VulkanBuffer.hpp"
 #include "VulkanModel.hpp"
+#include "VulkanFrameBuffer.hpp"
+#include "VulkanHiZ.hpp"
 #include "frustum.hpp"
 
 #define VERTEX_BUFFER_BIND_ID 0
@@ -43,6 +45,8 @@ class VulkanExample : public VulkanExampleBase
 {
 public:
 	bool fixedFrustum = false;
+	bool occlusionCulling = true;
+	bool hizBenchmark = false;
 
 	struct {
 		VkPipelineVertexInputStateCreateInfo inputState;
@@ -77,6 +81,7 @@ public:
 	struct {
 		uint32_t drawCount;						// Total number of indirect draw counts to be issued
 		uint32_t lodCount[MAX_LOD_LEVEL + 1];	// Statistics for number of draws per LOD level (written by compute shader)
+		uint32_t occludedCount;					// Objects inside the frustum culled by the Hi-Z occlusion test
 	} indirectStats;
 
 	// Store the indirect draw commands containing index offsets and instance count per object
@@ -87,6 +92,9 @@ public:
 		glm::mat4 modelview;
 		glm::vec4 cameraPos;
 		glm::vec4 frustumPlanes[6];
+		glm::mat4 hizViewProjection;
+		glm::ivec4 hizParams;
+		float objectRadius;
 	} uboScene;
 
 	struct {
@@ -110,7 +118,7 @@ public:
 		VkFence fence;								// Synchronization fence to avoid rewriting compute CB if still in use
 		VkSemaphore semaphore;						// Used as a wait semaphore for graphics submission
 		VkDescriptorSetLayout descriptorSetLayout;	// Compute shader binding layout
-		VkDescriptorSet descriptorSet;				// Compute shader bindings
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;	// Compute shader bindings
 		VkPipelineLayout pipelineLayout;			// Layout of the compute pipeline
 		VkPipeline pipeline;						// Compute pipeline for updating particle positions
 	} compute;
@@ -118,6 +126,11 @@ public:
 	// View frustum for culling invisible objects
 	vks::Frustum frustum;
 
+	// Hierarchical depth pyramid of the last frame's depth buffer for occlusion culling
+	vks::HiZ hiz;
+	// Matrix the last frame was rendered with, the pyramid is tested with it
+	glm::mat4 lastViewProjection = glm::mat4(1.0f);
+
 	uint32_t objectCount = 0;
 
 	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
@@ -129,6 +142,16 @@ public:
 		camera.movementSpeed = 5.0f;
 		settings.overlay = true;
 		memset(&indirectStats, 0, sizeof(indirectStats));
+		// The depth buffer is read to build the Hi-Z pyramid
+		depthStencilUsage = VK_IMAGE_USAGE_SAMPLED_BIT;
+		for (size_t i = 0; i < args.size(); i++) {
+			if (std::string(args[i]) == "-nohiz") {
+				occlusionCulling = false;
+			}
+			if (std::string(args[i]) == "-hizbenchmark") {
+				hizBenchmark = true;
+			}
+		}
 	}
 
 	~VulkanExample()
@@ -148,6 +171,7 @@ public:
 		vkDestroyFence(device, compute.fence, nullptr);
 		vkDestroyCommandPool(device, compute.commandPool, nullptr);
 		vkDestroySemaphore(device, compute.semaphore, nullptr);
+		hiz.destroy();
 	}
 
 	virtual void getEnabledFeatures()
@@ -156,6 +180,33 @@ public:
 		if (deviceFeatures.multiDrawIndirect) {
 			enabledFeatures.multiDrawIndirect = VK_TRUE;
 		}
+		vks::HiZ::enableFeatures(deviceFeatures, enabledFeatures);
+	}
+
+	void drawScene(VkCommandBuffer commandBuffer)
+	{
+		VkDeviceSize offsets[1] = { 0 };
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
+
+		// Mesh containing the LODs
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.plants);
+		vkCmdBindVertexBuffers(commandBuffer, VERTEX_BUFFER_BIND_ID, 1, &models.lodObject.vertices.buffer, offsets);
+		vkCmdBindVertexBuffers(commandBuffer, INSTANCE_BUFFER_BIND_ID, 1, &instanceBuffer.buffer, offsets);
+
+		vkCmdBindIndexBuffer(commandBuffer, models.lodObject.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+
+		if (vulkanDevice->features.multiDrawIndirect)
+		{
+			vkCmdDrawIndexedIndirect(commandBuffer, indirectCommandsBuffer.buffer, 0, indirectCommands.size(), sizeof(VkDrawIndexedIndirectCommand));
+		}
+		else
+		{
+			// If multi draw is not available, we must issue separate draw commands
+			for (auto j = 0; j < indirectCommands.size(); j++)
+			{
+				vkCmdDrawIndexedIndirect(commandBuffer, indirectCommandsBuffer.buffer, j * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
+			}
+		}
 	}
 
 	void buildCommandBuffers()
@@ -188,33 +239,13 @@ public:
 			VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
 			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
 
-			VkDeviceSize offsets[1] = { 0 };
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
-
-			// Mesh containing the LODs
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.plants);
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &models.lodObject.vertices.buffer, offsets);
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], INSTANCE_BUFFER_BIND_ID, 1, &instanceBuffer.buffer, offsets);
-			
-			vkCmdBindIndexBuffer(drawCmdBuffers[i], models.lodObject.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-
-			if (vulkanDevice->features.multiDrawIndirect)
-			{
-				vkCmdDrawIndexedIndirect(drawCmdBuffers[i], indirectCommandsBuffer.buffer, 0, indirectCommands.size(), sizeof(VkDrawIndexedIndirectCommand));
-			}
-			else
-			{
-				// If multi draw is not available, we must issue separate draw commands
-				for (auto j = 0; j < indirectCommands.size(); j++)
-				{
-					vkCmdDrawIndexedIndirect(drawCmdBuffers[i], indirectCommandsBuffer.buffer, j * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
-				}
-			}	
-
-			drawUI(drawCmdBuffers[i]);
+			drawScene(drawCmdBuffers[i]);
 
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
 
+			// Build the Hi-Z pyramid from this frame's depth for the culling of the next frame
+			hiz.recordBuild(drawCmdBuffers[i], VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+
 			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
 		}
 	}
@@ -345,7 +376,8 @@ public:
 		std::vector<VkDescriptorPoolSize> poolSizes =
 		{
 			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4)
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1)
 		};
 
 		VkDescriptorPoolCreateInfo descriptorPoolInfo =
@@ -600,6 +632,11 @@ public:
 
 		stagingBuffer.destroy();
 
+		// Bounding sphere of the object for the occlusion test (model scale * instance scale)
+		glm::vec3 extent = glm::max(glm::abs(models.lodObject.dim.min), glm::abs(models.lodObject.dim.max));
+		uboScene.objectRadius = glm::length(extent) * 0.1f * 2.0f;
+		uboScene.hizParams = glm::ivec4(0);
+
 		// Scene uniform buffer
 		VK_CHECK_RESULT(vulkanDevice->createBuffer(
 			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
@@ -646,6 +683,11 @@ public:
 				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
 				VK_SHADER_STAGE_COMPUTE_BIT,
 				4),
+			// Binding 5: Hi-Z pyramid (input)
+			vks::initializers::descriptorSetLayoutBinding(
+				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				VK_SHADER_STAGE_COMPUTE_BIT,
+				5),
 		};
 
 		VkDescriptorSetLayoutCreateInfo descriptorLayout =
@@ -701,7 +743,13 @@ public:
 				compute.descriptorSet,
 				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
 				4,
-				&compute.lodLevelsBuffers.descriptor)
+				&compute.lodLevelsBuffers.descriptor),
+			// Binding 5: Hi-Z pyramid
+			vks::initializers::writeDescriptorSet(
+				compute.descriptorSet,
+				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				5,
+				&hiz.descriptor)
 		};
 
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(computeWriteDescriptorSets.size()), computeWriteDescriptorSets.data(), 0, NULL);
@@ -755,6 +803,24 @@ public:
 		buildComputeCommandBuffer();
 	}
 
+	void prepareHiZ()
+	{
+		hiz.prepare(vulkanDevice, pipelineCache, loadShader(getAssetPath() + "shaders/base/hizbuild.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT));
+		setHiZDepthImage(depthStencil.image, width, height);
+	}
+
+	// (Re)creates the pyramid for a depth image, the compute command buffer has to be rebuilt afterwards
+	void setHiZDepthImage(VkImage depthImage, uint32_t depthWidth, uint32_t depthHeight)
+	{
+		// Built on the graphics queue, read on the compute queue
+		hiz.setDepthImage(queue, depthImage, depthFormat, depthWidth, depthHeight, { vulkanDevice->queueFamilyIndices.graphics, vulkanDevice->queueFamilyIndices.compute });
+		uboScene.hizParams = glm::ivec4(depthWidth, depthHeight, hiz.levelCount, occlusionCulling ? 1 : 0);
+		if (compute.descriptorSet != VK_NULL_HANDLE) {
+			VkWriteDescriptorSet writeDescriptorSet = vks::initializers::writeDescriptorSet(compute.descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 5, &hiz.descriptor);
+			vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
+		}
+	}
+
 	void updateUniformBuffer(bool viewChanged)
 	{
 		if (viewChanged)
@@ -782,6 +848,12 @@ public:
 		vkWaitForFences(device, 1, &compute.fence, VK_TRUE, UINT64_MAX);
 		vkResetFences(device, 1, &compute.fence);
 
+		// The pyramid was built from the last frame's depth, so it's tested with the last frame's matrix
+		uboScene.hizViewProjection = lastViewProjection;
+		uboScene.hizParams.w = occlusionCulling ? 1 : 0;
+		memcpy(uniformData.scene.mapped, &uboScene, sizeof(uboScene));
+		lastViewProjection = uboScene.projection * uboScene.modelview;
+
 		VkSubmitInfo computeSubmitInfo = vks::initializers::submitInfo();
 		computeSubmitInfo.commandBufferCount = 1;
 		computeSubmitInfo.pCommandBuffers = &compute.commandBuffer;
@@ -818,6 +890,116 @@ public:
 		memcpy(&indirectStats, indirectDrawCountBuffer.mapped, sizeof(indirectStats));
 	}
 
+	// Renders the current view offscreen without and with Hi-Z occlusion culling and reports the culling rates and GPU times
+	void HiZBenchmark()
+	{
+		hiz.benchmark(queue, width, height);
+
+		vks::Framebuffer offscreen(vulkanDevice);
+		offscreen.width = width;
+		offscreen.height = height;
+		vks::AttachmentCreateInfo attachmentInfo = {};
+		attachmentInfo.width = width;
+		attachmentInfo.height = height;
+		attachmentInfo.layerCount = 1;
+		// Same formats as the swap chain render pass, so the pipeline can be used
+		attachmentInfo.format = swapChain.colorFormat;
+		attachmentInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+		offscreen.addAttachment(attachmentInfo);
+		attachmentInfo.format = depthFormat;
+		attachmentInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		offscreen.addAttachment(attachmentInfo);
+		VK_CHECK_RESULT(offscreen.createSampler(VK_FILTER_NEAREST, VK_FILTER_NEAREST, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE));
+		VK_CHECK_RESULT(offscreen.createRenderPass());
+
+		setHiZDepthImage(offscreen.attachments[1].image, width, height);
+
+		VkQueryPool queryPool;
+		VkQueryPoolCreateInfo queryPoolInfo = {};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolInfo.queryCount = 3;
+		VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &queryPool));
+
+		VkClearValue clearValues[2];
+		clearValues[0].color = { { 0.18f, 0.27f, 0.5f, 0.0f } };
+		clearValues[1].depthStencil = { 1.0f, 0 };
+		VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+		renderPassBeginInfo.renderPass = offscreen.renderPass;
+		renderPassBeginInfo.framebuffer = offscreen.framebuffer;
+		renderPassBeginInfo.renderArea.extent.width = width;
+		renderPassBeginInfo.renderArea.extent.height = height;
+		renderPassBeginInfo.clearValueCount = 2;
+		renderPassBeginInfo.pClearValues = clearValues;
+
+		struct {
+			uint32_t visible;
+			uint32_t occluded;
+			double cullTime;
+			double drawTime;
+		} results[2];
+
+		const glm::mat4 viewProjection = uboScene.projection * uboScene.modelview;
+		for (uint32_t pass = 0; pass < 2; pass++) {
+			// The first pass is culled against the frustum only and builds the pyramid the second pass is tested against
+			uboScene.hizViewProjection = viewProjection;
+			uboScene.hizParams = glm::ivec4(width, height, hiz.levelCount, pass);
+			memcpy(uniformData.scene.mapped, &uboScene, sizeof(uboScene));
+
+			VkCommandBuffer commandBuffer = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			vkCmdResetQueryPool(commandBuffer, queryPool, 0, 3);
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipeline);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSet, 0, 0);
+			vkCmdDispatch(commandBuffer, objectCount / 16, 1, 1);
+			VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+			memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+
+			vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+			VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+			vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+			VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
+			vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+			drawScene(commandBuffer);
+			vkCmdEndRenderPass(commandBuffer);
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 2);
+
+			if (pass == 0) {
+				hiz.recordBuild(commandBuffer, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+			}
+			vulkanDevice->flushCommandBuffer(commandBuffer, queue);
+
+			uint64_t timestamps[3];
+			VK_CHECK_RESULT(vkGetQueryPoolResults(device, queryPool, 0, 3, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+			memcpy(&indirectStats, indirectDrawCountBuffer.mapped, sizeof(indirectStats));
+			const double timestampPeriod = vulkanDevice->properties.limits.timestampPeriod / 1000000.0;
+			results[pass].visible = indirectStats.drawCount;
+			results[pass].occluded = indirectStats.occludedCount;
+			results[pass].cullTime = (double)(timestamps[1] - timestamps[0]) * timestampPeriod;
+			results[pass].drawTime = (double)(timestamps[2] - timestamps[1]) * timestampPeriod;
+		}
+
+		std::cout << std::fixed << std::setprecision(3);
+		std::cout << "Hi-Z occlusion culling of " << objectCount << " objects at " << width << "x" << height << ":" << std::endl;
+		for (uint32_t pass = 0; pass < 2; pass++) {
+			std::cout << ((pass == 0) ? "  Frustum culling:        " : "  Frustum + Hi-Z culling: ") << results[pass].visible << " visible, " << results[pass].occluded << " occluded, "
+				<< results[pass].cullTime << " ms cull, " << results[pass].drawTime << " ms draw (GPU)" << std::endl;
+		}
+		const uint32_t inFrustum = results[1].visible + results[1].occluded;
+		std::cout << "  " << std::setprecision(1) << ((inFrustum > 0) ? 100.0 * (double)results[1].occluded / (double)inFrustum : 0.0) << "% of the objects inside the frustum occluded, "
+			<< std::setprecision(3) << (results[0].cullTime + results[0].drawTime) - (results[1].cullTime + results[1].drawTime) << " ms saved" << std::endl;
+
+		vkDestroyQueryPool(device, queryPool, nullptr);
+
+		// Back to the swap chain's depth buffer
+		setHiZDepthImage(depthStencil.image, width, height);
+		buildComputeCommandBuffer();
+	}
+
 	void prepare()
 	{
 		VulkanExampleBase::prepare();
@@ -828,7 +1010,11 @@ public:
 		preparePipelines();
 		setupDescriptorPool();
 		setupDescriptorSet();
+		prepareHiZ();
 		prepareCompute();
+		if (hizBenchmark) {
+			HiZBenchmark();
+		}
 		buildCommandBuffers();
 		prepared = true;
 	}
@@ -847,18 +1033,31 @@ public:
 		updateUniformBuffer(true);
 	}
 
+	virtual void windowResized()
+	{
+		if ((width == 0) || (height == 0)) {
+			return;
+		}
+		// The depth buffer has been recreated
+		setHiZDepthImage(depthStencil.image, width, height);
+		buildComputeCommandBuffer();
+		buildCommandBuffers();
+	}
+
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
 	{
 		if (overlay->header("Settings")) {
 			if (overlay->checkBox("Freeze frustum", &fixedFrustum)) {
 				updateUniformBuffer(true);
 			}
+			overlay->checkBox("Hi-Z occlusion culling", &occlusionCulling);
 		}
 		if (overlay->header("Statistics")) {
 			overlay->text("Visible objects: %d", indirectStats.drawCount);
 			for (uint32_t i = 0; i < MAX_LOD_LEVEL + 1; i++) {
 				overlay->text("LOD %d: %d", i, indirectStats.lodCount[i]);
 			}
+			overlay->text("Occluded: %d", indirectStats.occludedCount);
 		}
 	}
 };
@@ -1,6 +1,8 @@
 /*
 * Vulkan Example - Compute shader N-body simulation using two passes and shared compute shader memory
 *
+* Optionally uses a Barnes-Hut approximation built on the GPU each step (Morton codes, radix sort, linear BVH) for large particle counts
+*
 * Copyright (C) by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
@@ -12,6 +14,8 @@
 #include <assert.h>
 #include <vector>
 #include <random>
+#include <iostream>
+#include <iomanip>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -21,6 +25,8 @@
 #include <vulkan/vulkan.h>
 #include "vulkanexamplebase.h"
 #include "VulkanTexture.hpp"
+#include "VulkanRadixSort.hpp"
+#include "VulkanAsyncCompute.hpp"
 
 #define VERTEX_BUFFER_BIND_ID 0
 #define ENABLE_VALIDATION false
@@ -30,11 +36,220 @@
 #else
 #define PARTICLES_PER_ATTRACTOR 4 * 1024
 #endif
+// The all pairs forces take too long for a single submission beyond this particle count
+#define BENCHMARK_ALL_PAIRS_MAX_PARTICLES 512 * 1024
+
+/*
+	CPU reference of the Barnes-Hut force calculation for correctness checks
+	Uses the same Morton codes, tree layout and opening criterion as the GPU passes (see data/shaders/computenbody/lbvh_build.comp)
+*/
+class BarnesHutReference
+{
+public:
+	static const uint32_t LEAF_FLAG = 0x80000000;
+	static const uint32_t STACK_SIZE = 64;
+
+	struct Node {
+		glm::vec4 centerOfMass;
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+		float size;
+		uint32_t left;
+		uint32_t right;
+	};
+
+	float gravity;
+	float power;
+	float soften;
+
+	std::vector<vks::RadixSort::KeyValue> pairs;
+	std::vector<glm::vec4> leaves;
+	std::vector<Node> nodes;
+
+	BarnesHutReference(float gravity, float power, float soften) : gravity(gravity), power(power), soften(soften) {}
+
+	/** @brief Build the tree over the given positions (w = mass) */
+	void build(const std::vector<glm::vec4> &positions)
+	{
+		const uint32_t count = static_cast<uint32_t>(positions.size());
+		assert(count > 1);
+
+		glm::vec3 boundsMin(positions[0]), boundsMax(positions[0]);
+		for (auto &position : positions) {
+			boundsMin = glm::min(boundsMin, glm::vec3(position));
+			boundsMax = glm::max(boundsMax, glm::vec3(position));
+		}
+		glm::vec3 extent = boundsMax - boundsMin;
+		float size = std::max(std::max(std::max(extent.x, extent.y), extent.z), 1e-6f);
+
+		pairs.resize(count);
+		for (uint32_t i = 0; i < count; i++) {
+			glm::vec3 cell = glm::clamp((glm::vec3(positions[i]) - boundsMin) / size * 1024.0f, glm::vec3(0.0f), glm::vec3(1023.0f));
+			pairs[i].key = expandBits((uint32_t)cell.x) * 4 + expandBits((uint32_t)cell.y) * 2 + expandBits((uint32_t)cell.z);
+			pairs[i].value = i;
+		}
+		vks::RadixSort::sortReference(pairs);
+
+		leaves.resize(count);
+		for (uint32_t i = 0; i < count; i++) {
+			leaves[i] = positions[pairs[i].value];
+		}
+
+		nodes.resize(count - 1);
+		for (int32_t i = 0; i < (int32_t)count - 1; i++) {
+			buildNode(i);
+		}
+		aggregate(0);
+	}
+
+	/** @brief Acceleration at a position from the tree traversal with the given opening angle */
+	glm::vec3 acceleration(const glm::vec3 &position, float theta) const
+	{
+		glm::vec3 acceleration(0.0f);
+		uint32_t stack[STACK_SIZE];
+		uint32_t stackSize = 0;
+		stack[stackSize++] = 0;
+		while (stackSize > 0) {
+			uint32_t child = stack[--stackSize];
+			glm::vec4 other;
+			if (child & LEAF_FLAG) {
+				other = leaves[child & ~LEAF_FLAG];
+			} else {
+				const Node &node = nodes[child];
+				other = node.centerOfMass;
+				glm::vec3 len = glm::vec3(other) - position;
+				if ((node.size * node.size >= theta * theta * glm::dot(len, len)) && (stackSize + 2 <= STACK_SIZE)) {
+					stack[stackSize++] = node.right;
+					stack[stackSize++] = node.left;
+					continue;
+				}
+			}
+			acceleration += force(position, other);
+		}
+		return acceleration;
+	}
+
+	/** @brief Exact acceleration at a position summed over all particles */
+	glm::vec3 directSum(const glm::vec3 &position) const
+	{
+		glm::vec3 acceleration(0.0f);
+		for (auto &other : leaves) {
+			acceleration += force(position, other);
+		}
+		return acceleration;
+	}
+
+private:
+	glm::vec3 force(const glm::vec3 &position, const glm::vec4 &other) const
+	{
+		glm::vec3 len = glm::vec3(other) - position;
+		return gravity * len * other.w / std::pow(glm::dot(len, len) + soften, power);
+	}
+
+	static uint32_t expandBits(uint32_t value)
+	{
+		value = (value * 0x00010001u) & 0xFF0000FFu;
+		value = (value * 0x00000101u) & 0x0F00F00Fu;
+		value = (value * 0x00000011u) & 0xC30C30C3u;
+		value = (value * 0x00000005u) & 0x49249249u;
+		return value;
+	}
+
+	static int32_t highestBit(uint32_t value)
+	{
+		int32_t bit = -1;
+		while (value) {
+			value >>= 1;
+			bit++;
+		}
+		return bit;
+	}
+
+	int32_t commonPrefix(int32_t i, int32_t j) const
+	{
+		if ((j < 0) || (j >= (int32_t)pairs.size())) {
+			return -1;
+		}
+		if (pairs[i].key == pairs[j].key) {
+			return 32 + 31 - highestBit((uint32_t)(i ^ j));
+		}
+		return 31 - highestBit(pairs[i].key ^ pairs[j].key);
+	}
+
+	void buildNode(int32_t i)
+	{
+		int32_t d = (commonPrefix(i, i + 1) - commonPrefix(i, i - 1)) >= 0 ? 1 : -1;
+		int32_t prefixMin = commonPrefix(i, i - d);
+		int32_t lengthMax = 2;
+		while (commonPrefix(i, i + lengthMax * d) > prefixMin) {
+			lengthMax *= 2;
+		}
+		int32_t l = 0;
+		for (int32_t t = lengthMax / 2; t >= 1; t /= 2) {
+			if (commonPrefix(i, i + (l + t) * d) > prefixMin) {
+				l += t;
+			}
+		}
+		int32_t j = i + l * d;
+		int32_t prefixNode = commonPrefix(i, j);
+		int32_t s = 0;
+		int32_t divisor = 2;
+		int32_t t = (l + divisor - 1) / divisor;
+		while (true) {
+			if (commonPrefix(i, i + (s + t) * d) > prefixNode) {
+				s += t;
+			}
+			if (t == 1) {
+				break;
+			}
+			divisor *= 2;
+			t = (l + divisor - 1) / divisor;
+		}
+		int32_t split = i + s * d + std::min(d, 0);
+		nodes[i].left = (std::min(i, j) == split) ? (split | LEAF_FLAG) : split;
+		nodes[i].right = (std::max(i, j) == split + 1) ? ((split + 1) | LEAF_FLAG) : (split + 1);
+	}
+
+	void aggregate(uint32_t child, glm::vec4 &centerOfMass, glm::vec3 &boundsMin, glm::vec3 &boundsMax)
+	{
+		if (child & LEAF_FLAG) {
+			centerOfMass = leaves[child & ~LEAF_FLAG];
+			boundsMin = boundsMax = glm::vec3(centerOfMass);
+		} else {
+			aggregate(child);
+			centerOfMass = nodes[child].centerOfMass;
+			boundsMin = nodes[child].boundsMin;
+			boundsMax = nodes[child].boundsMax;
+		}
+	}
+
+	void aggregate(uint32_t index)
+	{
+		Node &node = nodes[index];
+		glm::vec4 left, right;
+		glm::vec3 leftMin, leftMax, rightMin, rightMax;
+		aggregate(node.left, left, leftMin, leftMax);
+		aggregate(node.right, right, rightMin, rightMax);
+		float mass = left.w + right.w;
+		glm::vec3 center = (mass > 0.0f) ? (glm::vec3(left) * left.w + glm::vec3(right) * right.w) / mass : (glm::vec3(left) + glm::vec3(right)) * 0.5f;
+		node.centerOfMass = glm::vec4(center, mass);
+		node.boundsMin = glm::min(leftMin, rightMin);
+		node.boundsMax = glm::max(leftMax, rightMax);
+		glm::vec3 extent = node.boundsMax - node.boundsMin;
+		node.size = std::max(std::max(extent.x, extent.y), extent.z);
+	}
+};
 
 class VulkanExample : public VulkanExampleBase
 {
 public:
 	uint32_t numParticles;
+	// Particle count requested with "-particles", 0 = default
+	uint32_t requestedParticleCount = 0;
+
+	// All pairs forces are O(n^2), Barnes-Hut builds a tree every step and is O(n log n)
+	enum Algorithm { ALL_PAIRS = 0, BARNES_HUT = 1 };
+	int32_t algorithm = ALL_PAIRS;
 
 	struct {
 		vks::Texture2D particle;
@@ -54,7 +269,8 @@ public:
 		VkDescriptorSet descriptorSet;				// Particle system rendering shader bindings
 		VkPipelineLayout pipelineLayout;			// Layout of the graphics pipeline
 		VkPipeline pipeline;						// Particle rendering pipeline
-		VkSemaphore semaphore;                      // Execution dependency between compute & graphic submission
+		std::array<vks::Buffer, 2> renderBuffers;	// Copies of the particles for rendering, alternately written at the end of each simulation step
+		uint32_t job;								// Scheduler job of the graphics submissions
 		struct {
 			glm::mat4 projection;
 			glm::mat4 view;
@@ -68,13 +284,28 @@ public:
 		vks::Buffer uniformBuffer;					// Uniform buffer object containing particle system parameters
 		VkQueue queue;								// Separate queue for compute commands (queue family may differ from the one used for graphics)
 		VkCommandPool commandPool;					// Use a separate command pool (queue family may differ from the one used for graphics)
-		VkCommandBuffer commandBuffer;				// Command buffer storing the dispatch commands and barriers
-		VkSemaphore semaphore;                      // Execution dependency between compute & graphic submission
+		std::array<VkCommandBuffer, 2> commandBuffers;	// Command buffers storing the dispatch commands and barriers, one per render buffer
+		uint32_t job;								// Scheduler job of the compute submissions
 		VkDescriptorSetLayout descriptorSetLayout;	// Compute shader binding layout
 		VkDescriptorSet descriptorSet;				// Compute shader bindings
 		VkPipelineLayout pipelineLayout;			// Layout of the compute pipeline
 		VkPipeline pipelineCalculate;				// Compute pipeline for N-Body velocity calculation (1st pass)
 		VkPipeline pipelineIntegrate;				// Compute pipeline for euler integration (2nd pass)
+		uint32_t statsSlot;							// GPU statistics slot of the compute command buffer (--stats)
+		struct {
+			vks::Buffer bounds;						// Bounding box of all particles (order preserving unsigned integers)
+			vks::Buffer pairs;						// Morton code / particle index pairs, sorted by the radix sort
+			vks::Buffer nodes;						// Internal tree nodes (mass, center of mass, bounds, links)
+			vks::Buffer leaves;						// Particle positions and masses in Morton order
+			vks::Buffer leafParents;				// Parent node of each leaf
+			vks::Buffer visits;						// Per node child counters for the bottom up pass
+			VkPipeline pipelineBounds;
+			VkPipeline pipelineMorton;
+			VkPipeline pipelineBuild;
+			VkPipeline pipelineAggregate;
+			VkPipeline pipelineForces;
+			vks::RadixSort radixSort;
+		} barnesHut;
 		VkPipeline blur;
 		VkPipelineLayout pipelineLayoutBlur;
 		VkDescriptorSetLayout descriptorSetLayoutBlur;
@@ -82,9 +313,13 @@ public:
 		struct computeUBO {							// Compute shader uniform block object
 			float deltaT;							//		Frame delta time
 			int32_t particleCount;
+			float theta;							//		Barnes-Hut opening angle
 		} ubo;
 	} compute;
 
+	// Runs the simulation step for the next frame on the compute queue while the current frame is rendered
+	vks::AsyncComputeScheduler scheduler;
+
 	// SSBO particle declaration
 	struct Particle {
 		glm::vec4 pos;								// xyz = position, w = mass
@@ -100,6 +335,17 @@ public:
 		camera.setRotation(glm::vec3(-26.0f, 75.0f, 0.0f));
 		camera.setTranslation(glm::vec3(0.0f, 0.0f, -14.0f));
 		camera.movementSpeed = 2.5f;
+		compute.ubo.theta = 0.5f;
+		for (size_t i = 0; i < args.size(); i++) {
+			if ((std::string(args[i]) == "-particles") && (i + 1 < args.size())) {
+				requestedParticleCount = std::stoi(args[i + 1]);
+			}
+			if (std::string(args[i]) == "-barneshut") {
+				algorithm = BARNES_HUT;
+			}
+		}
+		scheduler.parseCommandLine(args);
+		vks::AsyncComputeScheduler::requestInstanceExtensions(enabledInstanceExtensions);
 	}
 
 	~VulkanExample()
@@ -109,7 +355,8 @@ public:
 		vkDestroyPipeline(device, graphics.pipeline, nullptr);
 		vkDestroyPipelineLayout(device, graphics.pipelineLayout, nullptr);
 		vkDestroyDescriptorSetLayout(device, graphics.descriptorSetLayout, nullptr);
-		vkDestroySemaphore(device, graphics.semaphore, nullptr);
+		graphics.renderBuffers[0].destroy();
+		graphics.renderBuffers[1].destroy();
 
 		// Compute
 		compute.storageBuffer.destroy();
@@ -118,28 +365,44 @@ public:
 		vkDestroyDescriptorSetLayout(device, compute.descriptorSetLayout, nullptr);
 		vkDestroyPipeline(device, compute.pipelineCalculate, nullptr);
 		vkDestroyPipeline(device, compute.pipelineIntegrate, nullptr);
-		vkDestroySemaphore(device, compute.semaphore, nullptr);
+		vkDestroyPipeline(device, compute.barnesHut.pipelineBounds, nullptr);
+		vkDestroyPipeline(device, compute.barnesHut.pipelineMorton, nullptr);
+		vkDestroyPipeline(device, compute.barnesHut.pipelineBuild, nullptr);
+		vkDestroyPipeline(device, compute.barnesHut.pipelineAggregate, nullptr);
+		vkDestroyPipeline(device, compute.barnesHut.pipelineForces, nullptr);
+		compute.barnesHut.radixSort.destroy();
+		compute.barnesHut.bounds.destroy();
+		compute.barnesHut.pairs.destroy();
+		compute.barnesHut.nodes.destroy();
+		compute.barnesHut.leaves.destroy();
+		compute.barnesHut.leafParents.destroy();
+		compute.barnesHut.visits.destroy();
 		vkDestroyCommandPool(device, compute.commandPool, nullptr);
+		scheduler.destroy();
 
 		textures.particle.destroy();
 		textures.gradient.destroy();
 	}
 
+	// Enable timeline semaphores for the scheduler if supported
+	virtual void getEnabledFeatures()
+	{
+		scheduler.requestTimelineSemaphores(physicalDevice, enabledDeviceExtensions, deviceCreatepNextChain);
+	}
+
 	void loadAssets()
 	{
 		textures.particle.loadFromFile(getAssetPath() + "textures/particle01_rgba.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
 		textures.gradient.loadFromFile(getAssetPath() + "textures/particle_gradient_rgba.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
 	}
 
+	// Command buffers are recorded every frame in draw() as the render buffer alternates between frames
 	void buildCommandBuffers()
 	{
-		// Destroy command buffers if already present
-		if (!checkCommandBuffers())
-		{
-			destroyCommandBuffers();
-			createCommandBuffers();
-		}
+	}
 
+	void recordCommandBuffer(uint32_t index, const vks::Buffer &particles)
+	{
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
 		VkClearValue clearValues[2];
@@ -154,51 +417,111 @@ public:
 		renderPassBeginInfo.renderArea.extent.height = height;
 		renderPassBeginInfo.clearValueCount = 2;
 		renderPassBeginInfo.pClearValues = clearValues;
+		// Set target frame buffer
+		renderPassBeginInfo.framebuffer = frameBuffers[index];
 
-		for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
-		{
-			// Set target frame buffer
-			renderPassBeginInfo.framebuffer = frameBuffers[i];
-
-			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
+		VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[index], &cmdBufInfo));
 
-			// Draw the particle system using the update vertex buffer
+		// Draw the particle system using the update vertex buffer
 
-			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBeginRenderPass(drawCmdBuffers[index], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-			VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
-			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
+		VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+		vkCmdSetViewport(drawCmdBuffers[index], 0, 1, &viewport);
 
-			VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
-			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+		VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
+		vkCmdSetScissor(drawCmdBuffers[index], 0, 1, &scissor);
 
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipeline);
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelineLayout, 0, 1, &graphics.descriptorSet, 0, NULL);
+		vkCmdBindPipeline(drawCmdBuffers[index], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipeline);
+		vkCmdBindDescriptorSets(drawCmdBuffers[index], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipelineLayout, 0, 1, &graphics.descriptorSet, 0, NULL);
 
-			VkDeviceSize offsets[1] = { 0 };
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &compute.storageBuffer.buffer, offsets);
-			vkCmdDraw(drawCmdBuffers[i], numParticles, 1, 0, 0);
-			
-			drawUI(drawCmdBuffers[i]);
+		VkDeviceSize offsets[1] = { 0 };
+		vkCmdBindVertexBuffers(drawCmdBuffers[index], VERTEX_BUFFER_BIND_ID, 1, &particles.buffer, offsets);
+		vkCmdDraw(drawCmdBuffers[index], numParticles, 1, 0, 0);
 
-			vkCmdEndRenderPass(drawCmdBuffers[i]);
-
-			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
-		}
+		vkCmdEndRenderPass(drawCmdBuffers[index]);
 
+		VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[index]));
 	}
 
-	void buildComputeCommandBuffer()
+	// Make compute shader writes visible to the following compute shader and transfer commands
+	void computeBarrier(VkCommandBuffer commandBuffer)
 	{
-		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+		VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_FLAGS_NONE, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	}
 
-		VK_CHECK_RESULT(vkBeginCommandBuffer(compute.commandBuffer, &cmdBufInfo));
+	/**
+	* Record the force calculation and (optionally) the integration of one simulation step
+	*
+	* @param commandBuffer Command buffer to record to
+	* @param algorithm Force calculation (ALL_PAIRS or BARNES_HUT)
+	* @param integrate Integrate the particle positions after updating the velocities
+	* @param statsSlot GPU statistics slot for the passes, UINT32_MAX to not record statistics
+	*/
+	void recordSimulationStep(VkCommandBuffer commandBuffer, int32_t algorithm, bool integrate, uint32_t statsSlot)
+	{
+		const uint32_t groupCount = (numParticles + 255) / 256;
+
+		if (algorithm == BARNES_HUT) {
+			// The tree is rebuilt from scratch for every step
+			// -------------------------------------------------------------------------------------------------------
+			// Previous steps may still read the bounds and visit counters
+			computeBarrier(commandBuffer);
+			vkCmdFillBuffer(commandBuffer, compute.barnesHut.bounds.buffer, 0, sizeof(glm::uvec4), 0xFFFFFFFF);
+			vkCmdFillBuffer(commandBuffer, compute.barnesHut.bounds.buffer, sizeof(glm::uvec4), sizeof(glm::uvec4), 0);
+			vkCmdFillBuffer(commandBuffer, compute.barnesHut.visits.buffer, 0, VK_WHOLE_SIZE, 0);
+			VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+			memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_FLAGS_NONE, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+			gpuStats.cmdBeginPass(commandBuffer, statsSlot, "Bounds and Morton codes");
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSet, 0, 0);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.barnesHut.pipelineBounds);
+			vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+			computeBarrier(commandBuffer);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.barnesHut.pipelineMorton);
+			vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+			gpuStats.cmdEndPass(commandBuffer, statsSlot);
+			computeBarrier(commandBuffer);
+
+			// Codes only use the lower 30 bits
+			gpuStats.cmdBeginPass(commandBuffer, statsSlot, "Radix sort");
+			compute.barnesHut.radixSort.recordSort(commandBuffer, 30);
+			gpuStats.cmdEndPass(commandBuffer, statsSlot);
+			computeBarrier(commandBuffer);
+
+			// The sort binds its own pipeline layout
+			gpuStats.cmdBeginPass(commandBuffer, statsSlot, "Tree build");
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSet, 0, 0);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.barnesHut.pipelineBuild);
+			vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+			computeBarrier(commandBuffer);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.barnesHut.pipelineAggregate);
+			vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+			gpuStats.cmdEndPass(commandBuffer, statsSlot);
+			computeBarrier(commandBuffer);
+
+			gpuStats.cmdBeginPass(commandBuffer, statsSlot, "Barnes-Hut forces");
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.barnesHut.pipelineForces);
+			vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+			gpuStats.cmdEndPass(commandBuffer, statsSlot);
+		} else {
+			// First pass: Calculate particle movement
+			// -------------------------------------------------------------------------------------------------------
+			gpuStats.cmdBeginPass(commandBuffer, statsSlot, "All pairs forces");
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineCalculate);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSet, 0, 0);
+			vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+			gpuStats.cmdEndPass(commandBuffer, statsSlot);
+		}
 
-		// First pass: Calculate particle movement
-		// -------------------------------------------------------------------------------------------------------
-		vkCmdBindPipeline(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineCalculate);
-		vkCmdBindDescriptorSets(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSet, 0, 0);
-		vkCmdDispatch(compute.commandBuffer, numParticles / 256, 1, 1);
+		if (!integrate) {
+			return;
+		}
 
 		// Add memory barrier to ensure that the computer shader has finished writing to the buffer
 		VkBufferMemoryBarrier bufferBarrier = vks::initializers::bufferMemoryBarrier();
@@ -211,7 +534,7 @@ public:
 		bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 
 		vkCmdPipelineBarrier(
-			compute.commandBuffer,
+			commandBuffer,
 			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
 			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
 			VK_FLAGS_NONE,
@@ -221,10 +544,30 @@ public:
 
 		// Second pass: Integrate particles
 		// -------------------------------------------------------------------------------------------------------
-		vkCmdBindPipeline(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineIntegrate);
-		vkCmdDispatch(compute.commandBuffer, numParticles / 256, 1, 1);
+		gpuStats.cmdBeginPass(commandBuffer, statsSlot, "Integrate");
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineIntegrate);
+		vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+		gpuStats.cmdEndPass(commandBuffer, statsSlot);
+	}
+
+	void buildComputeCommandBuffer()
+	{
+		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+
+		for (uint32_t i = 0; i < compute.commandBuffers.size(); i++) {
+			VkCommandBuffer commandBuffer = compute.commandBuffers[i];
+			VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufInfo));
+
+			gpuStats.cmdReset(commandBuffer, compute.statsSlot);
+			recordSimulationStep(commandBuffer, algorithm, true, compute.statsSlot);
 
-		vkEndCommandBuffer(compute.commandBuffer);
+			// Copy the result to this command buffer's render buffer, so the next step can start before the frame using it has been rendered
+			computeBarrier(commandBuffer);
+			VkBufferCopy copyRegion = { 0, 0, numParticles * sizeof(Particle) };
+			vkCmdCopyBuffer(commandBuffer, compute.storageBuffer.buffer, graphics.renderBuffers[i].buffer, 1, &copyRegion);
+
+			VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+		}
 	}
 
 	// Setup and fill the compute shader storage buffers containing the particles
@@ -246,7 +589,12 @@ public:
 		};
 #endif
 
-		numParticles = static_cast<uint32_t>(attractors.size()) * PARTICLES_PER_ATTRACTOR;
+		uint32_t particlesPerAttractor = PARTICLES_PER_ATTRACTOR;
+		if (requestedParticleCount > 0) {
+			// Keep the particle count a multiple of the work group size
+			particlesPerAttractor = std::max(256u, requestedParticleCount / static_cast<uint32_t>(attractors.size()) / 256 * 256);
+		}
+		numParticles = static_cast<uint32_t>(attractors.size()) * particlesPerAttractor;
 
 		// Initial particle positions
 		std::vector<Particle> particleBuffer(numParticles);
@@ -256,9 +604,9 @@ public:
 
 		for (uint32_t i = 0; i < static_cast<uint32_t>(attractors.size()); i++)
 		{
-			for (uint32_t j = 0; j < PARTICLES_PER_ATTRACTOR; j++)
+			for (uint32_t j = 0; j < particlesPerAttractor; j++)
 			{
-				Particle &particle = particleBuffer[i * PARTICLES_PER_ATTRACTOR + j];
+				Particle &particle = particleBuffer[i * particlesPerAttractor + j];
 
 				// First particle in group as heavy center of gravity
 				if (j == 0)
@@ -305,7 +653,7 @@ public:
 
 		vulkanDevice->createBuffer(
 			// The SSBO will be used as a storage buffer for the compute pipeline and as a vertex buffer in the graphics pipeline
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 			&compute.storageBuffer,
 			storageBufferSize);
@@ -319,6 +667,15 @@ public:
 
 		stagingBuffer.destroy();
 
+		// Rendering reads a copy of the particles, so the simulation can update the storage buffer while a frame is rendered
+		for (auto &renderBuffer : graphics.renderBuffers) {
+			vulkanDevice->createBuffer(
+				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				&renderBuffer,
+				storageBufferSize);
+		}
+
 		// Binding description
 		vertices.bindingDescriptions.resize(1);
 		vertices.bindingDescriptions[0] =
@@ -353,12 +710,33 @@ public:
 		vertices.inputState.pVertexAttributeDescriptions = vertices.attributeDescriptions.data();
 	}
 
+	// Setup the buffers used by the Barnes-Hut passes, all of them are only accessed on the device
+	void prepareBarnesHutBuffers()
+	{
+		struct Node {
+			glm::vec4 centerOfMass;
+			glm::vec4 boundsMin;
+			glm::vec4 boundsMax;
+			glm::uvec4 links;
+		};
+
+		const VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+		const VkMemoryPropertyFlags memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		// Bounds and visit counters are cleared with vkCmdFillBuffer every step
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, memoryProperties, &compute.barnesHut.bounds, 2 * sizeof(glm::uvec4)));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(usage, memoryProperties, &compute.barnesHut.pairs, numParticles * sizeof(vks::RadixSort::KeyValue)));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(usage, memoryProperties, &compute.barnesHut.nodes, (numParticles - 1) * sizeof(Node)));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(usage, memoryProperties, &compute.barnesHut.leaves, numParticles * sizeof(glm::vec4)));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(usage, memoryProperties, &compute.barnesHut.leafParents, numParticles * sizeof(uint32_t)));
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, memoryProperties, &compute.barnesHut.visits, (numParticles - 1) * sizeof(uint32_t)));
+	}
+
 	void setupDescriptorPool()
 	{
 		std::vector<VkDescriptorPoolSize> poolSizes =
 		{
 			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 7),
 			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2)
 		};
 
@@ -508,10 +886,6 @@ public:
 		setupDescriptorSetLayout();
 		preparePipelines();
 		setupDescriptorSet();
-
-		// Semaphore for compute & graphics sync
-		VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
-		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &graphics.semaphore));
 	}
 
 	void prepareCompute()
@@ -527,6 +901,8 @@ public:
 		queueCreateInfo.queueCount = 1;
 		vkGetDeviceQueue(device, vulkanDevice->queueFamilyIndices.compute, 0, &compute.queue);
 
+		prepareBarnesHutBuffers();
+
 		// Create compute pipeline
 		// Compute pipelines are created separate from graphics pipelines even if they use the same queue (family index)
 
@@ -541,6 +917,13 @@ public:
 				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
 				VK_SHADER_STAGE_COMPUTE_BIT,
 				1),
+			// Bindings 2..7 : Barnes-Hut bounds, sort pairs, tree nodes, leaves, leaf parents and visit counters
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 4),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 5),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 6),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 7),
 		};
 
 		VkDescriptorSetLayoutCreateInfo descriptorLayout =
@@ -578,7 +961,14 @@ public:
 				compute.descriptorSet,
 				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
 				1,
-				&compute.uniformBuffer.descriptor)
+				&compute.uniformBuffer.descriptor),
+			// Bindings 2..7 : Barnes-Hut buffers
+			vks::initializers::writeDescriptorSet(compute.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &compute.barnesHut.bounds.descriptor),
+			vks::initializers::writeDescriptorSet(compute.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &compute.barnesHut.pairs.descriptor),
+			vks::initializers::writeDescriptorSet(compute.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, &compute.barnesHut.nodes.descriptor),
+			vks::initializers::writeDescriptorSet(compute.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5, &compute.barnesHut.leaves.descriptor),
+			vks::initializers::writeDescriptorSet(compute.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6, &compute.barnesHut.leafParents.descriptor),
+			vks::initializers::writeDescriptorSet(compute.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 7, &compute.barnesHut.visits.descriptor),
 		};
 
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(computeWriteDescriptorSets.size()), computeWriteDescriptorSets.data(), 0, NULL);
@@ -603,7 +993,8 @@ public:
 		specializationMapEntries.push_back(vks::initializers::specializationMapEntry(2, offsetof(SpecializationData, power), sizeof(float)));
 		specializationMapEntries.push_back(vks::initializers::specializationMapEntry(3, offsetof(SpecializationData, soften), sizeof(float)));
 
-		specializationData.sharedDataSize = std::min((uint32_t)1024, (uint32_t)(vulkanDevice->properties.limits.maxComputeSharedMemorySize / sizeof(glm::vec4)));
+		// Each pass through the particles loads one position per invocation of the 256 wide work group
+		specializationData.sharedDataSize = 256;
 
 		specializationData.gravity = 0.002f;
 		specializationData.power = 0.75f;
@@ -619,6 +1010,22 @@ public:
 		computePipelineCreateInfo.stage = loadShader(getAssetPath() + "shaders/computenbody/particle_integrate.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
 		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.pipelineIntegrate));
 
+		// Barnes-Hut passes, the force pass uses the same specialization constants as the all pairs calculation
+		computePipelineCreateInfo.stage = loadShader(getAssetPath() + "shaders/computenbody/particle_bounds.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.barnesHut.pipelineBounds));
+		computePipelineCreateInfo.stage = loadShader(getAssetPath() + "shaders/computenbody/particle_morton.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.barnesHut.pipelineMorton));
+		computePipelineCreateInfo.stage = loadShader(getAssetPath() + "shaders/computenbody/lbvh_build.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.barnesHut.pipelineBuild));
+		computePipelineCreateInfo.stage = loadShader(getAssetPath() + "shaders/computenbody/lbvh_aggregate.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.barnesHut.pipelineAggregate));
+		computePipelineCreateInfo.stage = loadShader(getAssetPath() + "shaders/computenbody/particle_barneshut.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		computePipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.barnesHut.pipelineForces));
+
+		compute.barnesHut.radixSort.prepare(vulkanDevice, pipelineCache, loadShader(getAssetPath() + "shaders/base/radixsort.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT));
+		compute.barnesHut.radixSort.setBuffer(&compute.barnesHut.pairs.descriptor, numParticles);
+
 		// Separate command pool as queue family for compute may be different than graphics
 		VkCommandPoolCreateInfo cmdPoolInfo = {};
 		cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
@@ -626,27 +1033,17 @@ public:
 		cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 		VK_CHECK_RESULT(vkCreateCommandPool(device, &cmdPoolInfo, nullptr, &compute.commandPool));
 
-		// Create a command buffer for compute operations
+		// Create the command buffers for compute operations
 		VkCommandBufferAllocateInfo cmdBufAllocateInfo =
 			vks::initializers::commandBufferAllocateInfo(
 				compute.commandPool,
 				VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-				1);	
+				static_cast<uint32_t>(compute.commandBuffers.size()));
 
-		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &compute.commandBuffer));
+		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, compute.commandBuffers.data()));
 
-		// Semaphore for compute & graphics sync
-		VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
-		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &compute.semaphore));
-
-		// Signal the semaphore
-		VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
-		submitInfo.signalSemaphoreCount = 1;
-		submitInfo.pSignalSemaphores = &compute.semaphore;
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
-		VK_CHECK_RESULT(vkQueueWaitIdle(queue));
-
-		// Build a single command buffer containing the compute dispatch commands
+		// Build the command buffers containing the compute dispatch commands
+		compute.statsSlot = gpuStats.createSlot(vulkanDevice->queueFamilyIndices.compute);
 		buildComputeCommandBuffer();
 	}
 
@@ -691,39 +1088,177 @@ public:
 		memcpy(graphics.uniformBuffer.mapped, &graphics.ubo, sizeof(graphics.ubo));
 	}
 
+	// Submit the simulation step that writes the render buffer of the next frame
+	void submitCompute()
+	{
+		const uint64_t step = scheduler.getSubmissionCount(compute.job);
+		scheduler.submit(compute.job, compute.commandBuffers[step % 2]);
+		gpuStats.submitted(compute.statsSlot);
+	}
+
 	void draw()
 	{
 		VulkanExampleBase::prepareFrame();
 
-		VkPipelineStageFlags graphicsWaitStageMasks[] = { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-		VkSemaphore graphicsWaitSemaphores[] = { compute.semaphore, semaphores.presentComplete };
-		VkSemaphore graphicsSignalSemaphores[] = { graphics.semaphore, semaphores.renderComplete };
+		// Draw the result of the simulation step with the same index, the scheduler makes this submission wait for it
+		const uint64_t frame = scheduler.getSubmissionCount(graphics.job);
+		recordCommandBuffer(currentBuffer, graphics.renderBuffers[frame % 2]);
+		scheduler.submit(graphics.job, drawCmdBuffers[currentBuffer], { semaphores.presentComplete }, { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT }, { semaphores.renderComplete });
 
-		// Submit graphics commands
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
-		submitInfo.waitSemaphoreCount = 2;
-		submitInfo.pWaitSemaphores = graphicsWaitSemaphores;
-		submitInfo.pWaitDstStageMask = graphicsWaitStageMasks;
-		submitInfo.signalSemaphoreCount = 2;
-		submitInfo.pSignalSemaphores = graphicsSignalSemaphores;
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+		// The next simulation step runs on the compute queue while this frame is rendered
+		// Its parameters can only be updated once the current step, which this frame waits for, has finished
+		scheduler.wait(compute.job);
+		updateComputeUniformBuffers();
+		submitCompute();
 
 		VulkanExampleBase::submitFrame();
+	}
+
+	// Copy the particle storage buffer from or to a host visible buffer
+	void copyParticles(vks::Buffer &hostBuffer, bool download)
+	{
+		VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		VkBufferCopy copyRegion = { 0, 0, numParticles * sizeof(Particle) };
+		if (download) {
+			vkCmdCopyBuffer(copyCmd, compute.storageBuffer.buffer, hostBuffer.buffer, 1, &copyRegion);
+		} else {
+			vkCmdCopyBuffer(copyCmd, hostBuffer.buffer, compute.storageBuffer.buffer, 1, &copyRegion);
+		}
+		vulkanDevice->flushCommandBuffer(copyCmd, queue);
+	}
 
-		// Wait for rendering finished
-		VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	/*
+		GPU time per simulation step of both force algorithms and a check of the GPU forces against CPU references, enabled with "-nbodybenchmark"
+		Use "-particles" to run it for different particle counts
+	*/
+	void NBodyBenchmark()
+	{
+		bool enabled = false;
+		for (auto arg : args) {
+			if (std::string(arg) == "-nbodybenchmark") {
+				enabled = true;
+			}
+		}
+		if (!enabled) {
+			return;
+		}
+
+		compute.barnesHut.radixSort.benchmark(queue, numParticles);
+		compute.barnesHut.radixSort.setBuffer(&compute.barnesHut.pairs.descriptor, numParticles);
+
+		const VkDeviceSize bufferSize = numParticles * sizeof(Particle);
+		vks::Buffer hostBuffer;
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&hostBuffer,
+			bufferSize));
+		VK_CHECK_RESULT(hostBuffer.map());
+
+		// Keep the initial state, it's restored afterwards
+		copyParticles(hostBuffer, true);
+		std::vector<Particle> initialParticles(numParticles);
+		memcpy(initialParticles.data(), hostBuffer.mapped, bufferSize);
+		const auto ubo = compute.ubo;
+		const bool allPairs = numParticles <= BENCHMARK_ALL_PAIRS_MAX_PARTICLES;
+
+		// Forces: With zero velocities and a time step of one the velocities after the force pass are the accelerations
+		std::vector<glm::vec3> accelerations[2];
+		for (int32_t algorithm : { ALL_PAIRS, BARNES_HUT }) {
+			if ((algorithm == ALL_PAIRS) && !allPairs) {
+				continue;
+			}
+			Particle *particles = (Particle*)hostBuffer.mapped;
+			for (uint32_t i = 0; i < numParticles; i++) {
+				particles[i].pos = initialParticles[i].pos;
+				particles[i].vel = glm::vec4(0.0f);
+			}
+			copyParticles(hostBuffer, false);
+			compute.ubo.deltaT = 1.0f;
+			memcpy(compute.uniformBuffer.mapped, &compute.ubo, sizeof(compute.ubo));
+
+			VkCommandBuffer commandBuffer = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			recordSimulationStep(commandBuffer, algorithm, false, UINT32_MAX);
+			vulkanDevice->flushCommandBuffer(commandBuffer, queue);
+			copyParticles(hostBuffer, true);
+
+			accelerations[algorithm].resize(numParticles);
+			for (uint32_t i = 0; i < numParticles; i++) {
+				accelerations[algorithm][i] = glm::vec3(particles[i].vel);
+			}
+		}
 
-		// Submit compute commands
-		VkSubmitInfo computeSubmitInfo = vks::initializers::submitInfo();
-		computeSubmitInfo.commandBufferCount = 1;
-		computeSubmitInfo.pCommandBuffers = &compute.commandBuffer;
-		computeSubmitInfo.waitSemaphoreCount = 1;
-		computeSubmitInfo.pWaitSemaphores = &graphics.semaphore;
-		computeSubmitInfo.pWaitDstStageMask = &waitStageMask;
-		computeSubmitInfo.signalSemaphoreCount = 1;
-		computeSubmitInfo.pSignalSemaphores = &compute.semaphore;
-		VK_CHECK_RESULT(vkQueueSubmit(compute.queue, 1, &computeSubmitInfo, VK_NULL_HANDLE));
+		// Timings: A time step of zero keeps the particle distribution (and with it the tree) constant over all steps
+		const uint32_t stepCount = 8;
+		VkQueryPool queryPool;
+		VkQueryPoolCreateInfo queryPoolInfo = {};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolInfo.queryCount = 2;
+		VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &queryPool));
+		compute.ubo.deltaT = 0.0f;
+		memcpy(compute.uniformBuffer.mapped, &compute.ubo, sizeof(compute.ubo));
+		double stepTimes[2] = { 0.0, 0.0 };
+		for (int32_t algorithm : { ALL_PAIRS, BARNES_HUT }) {
+			if ((algorithm == ALL_PAIRS) && !allPairs) {
+				continue;
+			}
+			VkCommandBuffer commandBuffer = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			vkCmdResetQueryPool(commandBuffer, queryPool, 0, 2);
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+			for (uint32_t i = 0; i < stepCount; i++) {
+				recordSimulationStep(commandBuffer, algorithm, true, UINT32_MAX);
+				computeBarrier(commandBuffer);
+			}
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+			vulkanDevice->flushCommandBuffer(commandBuffer, queue);
+			uint64_t timestamps[2] = { 0, 0 };
+			VK_CHECK_RESULT(vkGetQueryPoolResults(device, queryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+			stepTimes[algorithm] = (double)(timestamps[1] - timestamps[0]) * vulkanDevice->properties.limits.timestampPeriod / 1000000.0 / stepCount;
+		}
+		vkDestroyQueryPool(device, queryPool, nullptr);
+
+		// CPU references for a subset of the particles
+		std::vector<glm::vec4> positions(numParticles);
+		for (uint32_t i = 0; i < numParticles; i++) {
+			positions[i] = initialParticles[i].pos;
+		}
+		BarnesHutReference reference(0.002f, 0.75f, 0.05f);
+		reference.build(positions);
+
+		const uint32_t sampleCount = std::min(numParticles, 256u);
+		double errorTree = 0.0, errorBarnesHut = 0.0, errorAllPairs = 0.0, maxErrorTree = 0.0;
+		for (uint32_t s = 0; s < sampleCount; s++) {
+			const uint32_t i = s * (numParticles / sampleCount);
+			const glm::vec3 exact = reference.directSum(glm::vec3(positions[i]));
+			const glm::vec3 tree = reference.acceleration(glm::vec3(positions[i]), compute.ubo.theta);
+			const float scale = std::max(glm::length(exact), 1e-12f);
+			// GPU and CPU trees may differ where rounding changes a Morton code
+			const double error = glm::length(accelerations[BARNES_HUT][i] - tree) / std::max(glm::length(tree), 1e-12f);
+			errorTree += error;
+			maxErrorTree = std::max(maxErrorTree, error);
+			errorBarnesHut += glm::length(accelerations[BARNES_HUT][i] - exact) / scale;
+			if (allPairs) {
+				errorAllPairs += glm::length(accelerations[ALL_PAIRS][i] - exact) / scale;
+			}
+		}
+
+		std::cout << std::fixed << std::setprecision(3);
+		std::cout << "N-body step with " << numParticles << " particles:" << std::endl;
+		if (allPairs) {
+			std::cout << "  All pairs: " << stepTimes[ALL_PAIRS] << " ms GPU, mean relative force error vs. direct sum " << std::scientific << errorAllPairs / sampleCount << std::fixed << std::endl;
+		} else {
+			std::cout << "  All pairs: skipped (more than " << BENCHMARK_ALL_PAIRS_MAX_PARTICLES << " particles)" << std::endl;
+		}
+		std::cout << "  Barnes-Hut (theta " << compute.ubo.theta << "): " << stepTimes[BARNES_HUT] << " ms GPU, mean relative force error vs. direct sum " << std::scientific << errorBarnesHut / sampleCount
+			<< ", vs. CPU Barnes-Hut " << errorTree / sampleCount << " (max " << maxErrorTree << ")" << std::fixed << std::endl;
+
+		// Restore the initial state
+		memcpy(hostBuffer.mapped, initialParticles.data(), bufferSize);
+		copyParticles(hostBuffer, false);
+		hostBuffer.destroy();
+		compute.ubo = ubo;
+		memcpy(compute.uniformBuffer.mapped, &compute.ubo, sizeof(compute.ubo));
 	}
 
 	void prepare()
@@ -733,7 +1268,15 @@ public:
 		setupDescriptorPool();
 		prepareGraphics();
 		prepareCompute();
-		buildCommandBuffers();
+		NBodyBenchmark();
+		// Frame n draws the particles of simulation step n
+		// Step n overwrites the render buffer read by frame n - 2, the step for the next frame overlaps with the current frame's rendering
+		graphics.job = scheduler.addJob("graphics", vks::AsyncComputeScheduler::GRAPHICS);
+		compute.job = scheduler.addJob("simulation", vks::AsyncComputeScheduler::COMPUTE);
+		scheduler.addDependency(graphics.job, compute.job, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0);
+		scheduler.addDependency(compute.job, graphics.job, VK_PIPELINE_STAGE_TRANSFER_BIT, 2);
+		scheduler.prepare(vulkanDevice, queue, compute.queue);
+		submitCompute();
 		prepared = true;
 	}
 
@@ -742,11 +1285,25 @@ public:
 		if (!prepared)
 			return;
 		draw();
-		updateComputeUniformBuffers();
 		if (camera.updated) {
 			updateGraphicsUniformBuffers();
 		}
 	}
+
+	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
+	{
+		if (overlay->header("Settings")) {
+			overlay->text("%d particles", numParticles);
+			if (overlay->comboBox("Forces", &algorithm, { "All pairs", "Barnes-Hut" })) {
+				// The compute command buffers may still be executing
+				VK_CHECK_RESULT(vkQueueWaitIdle(compute.queue));
+				buildComputeCommandBuffer();
+			}
+			if (algorithm == BARNES_HUT) {
+				overlay->sliderFloat("Theta", &compute.ubo.theta, 0.1f, 1.0f);
+			}
+		}
+	}
 };
 
 VULKAN_EXAMPLE_MAIN()
\ No newline at end of file
@@ -23,6 +23,7 @@
 #include <vulkan/vulkan.h>
 #include "vulkanexamplebase.h"
 #include "VulkanTexture.hpp"
+#include "VulkanAsyncCompute.hpp"
 
 #define VERTEX_BUFFER_BIND_ID 0
 #define ENABLE_VALIDATION false
@@ -57,6 +58,7 @@ public:
 		VkDescriptorSet descriptorSet;				// Particle system rendering shader bindings
 		VkPipelineLayout pipelineLayout;			// Layout of the graphics pipeline
 		VkPipeline pipeline;						// Particle rendering pipeline
+		uint32_t job;								// Scheduler job of the graphics submissions
 	} graphics;
 
 	// Resources for the compute part of the example
@@ -66,11 +68,12 @@ public:
 		VkQueue queue;								// Separate queue for compute commands (queue family may differ from the one used for graphics)
 		VkCommandPool commandPool;					// Use a separate command pool (queue family may differ from the one used for graphics)
 		VkCommandBuffer commandBuffer;				// Command buffer storing the dispatch commands and barriers
-		VkFence fence;								// Synchronization fence to avoid rewriting compute CB if still in use
 		VkDescriptorSetLayout descriptorSetLayout;	// Compute shader binding layout
 		VkDescriptorSet descriptorSet;				// Compute shader bindings
 		VkPipelineLayout pipelineLayout;			// Layout of the compute pipeline
 		VkPipeline pipeline;						// Compute pipeline for updating particle positions
+		uint32_t statsSlot;							// GPU statistics slot of the compute command buffer (--stats)
+		uint32_t job;								// Scheduler job of the compute submissions
 		struct computeUBO {							// Compute shader uniform block object
 			float deltaT;							//		Frame delta time
 			float destX;							//		x position of the attractor
@@ -79,6 +82,9 @@ public:
 		} ubo;
 	} compute;
 
+	// Synchronizes the compute and graphics submissions sharing the particle buffer
+	vks::AsyncComputeScheduler scheduler;
+
 	// SSBO particle declaration
 	struct Particle {
 		glm::vec2 pos;								// Particle position
@@ -90,6 +96,8 @@ public:
 	{
 		title = "Compute shader particle system";
 		settings.overlay = true;
+		scheduler.parseCommandLine(args);
+		vks::AsyncComputeScheduler::requestInstanceExtensions(enabledInstanceExtensions);
 	}
 
 	~VulkanExample()
@@ -105,13 +113,19 @@ public:
 		vkDestroyPipelineLayout(device, compute.pipelineLayout, nullptr);
 		vkDestroyDescriptorSetLayout(device, compute.descriptorSetLayout, nullptr);
 		vkDestroyPipeline(device, compute.pipeline, nullptr);
-		vkDestroyFence(device, compute.fence, nullptr);
 		vkDestroyCommandPool(device, compute.commandPool, nullptr);
+		scheduler.destroy();
 
 		textures.particle.destroy();
 		textures.gradient.destroy();
 	}
 
+	// Enable timeline semaphores for the scheduler if supported
+	virtual void getEnabledFeatures()
+	{
+		scheduler.requestTimelineSemaphores(physicalDevice, enabledDeviceExtensions, deviceCreatepNextChain);
+	}
+
 	void loadAssets()
 	{
 		textures.particle.loadFromFile(getAssetPath() + "textures/particle01_rgba.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
@@ -149,6 +163,8 @@ public:
 
 			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
+			gpuStats.cmdReset(drawCmdBuffers[i], i);
+
 			// Draw the particle system using the update vertex buffer
 
 			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
@@ -164,9 +180,9 @@ public:
 
 			VkDeviceSize offsets[1] = { 0 };
 			vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &compute.storageBuffer.buffer, offsets);
+			gpuStats.cmdBeginPass(drawCmdBuffers[i], i, "Particle rendering");
 			vkCmdDraw(drawCmdBuffers[i], PARTICLE_COUNT, 1, 0, 0);
-
-			drawUI(drawCmdBuffers[i]);
+			gpuStats.cmdEndPass(drawCmdBuffers[i], i);
 
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
 
@@ -181,6 +197,8 @@ public:
 
 		VK_CHECK_RESULT(vkBeginCommandBuffer(compute.commandBuffer, &cmdBufInfo));
 
+		gpuStats.cmdReset(compute.commandBuffer, compute.statsSlot);
+
 		// Compute particle movement
 
 		// Add memory barrier to ensure that the (graphics) vertex shader has fetched attributes before compute starts to write to the buffer
@@ -207,7 +225,9 @@ public:
 		vkCmdBindDescriptorSets(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSet, 0, 0);
 
 		// Dispatch the compute job
+		gpuStats.cmdBeginPass(compute.commandBuffer, compute.statsSlot, "Particle update");
 		vkCmdDispatch(compute.commandBuffer, PARTICLE_COUNT / 256, 1, 1);
+		gpuStats.cmdEndPass(compute.commandBuffer, compute.statsSlot);
 
 		// Add memory barrier to ensure that compute shader has finished writing to the buffer
 		// Without this the (rendering) vertex shader may display incomplete results (partial data from last frame) 
@@ -556,11 +576,15 @@ public:
 
 		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &compute.commandBuffer));
 
-		// Fence for compute CB sync
-		VkFenceCreateInfo fenceCreateInfo = vks::initializers::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
-		VK_CHECK_RESULT(vkCreateFence(device, &fenceCreateInfo, nullptr, &compute.fence));
+		// The particles are updated in place, so a frame's compute commands have to wait until the previous frame has been rendered
+		compute.job = scheduler.addJob("particles", vks::AsyncComputeScheduler::COMPUTE);
+		graphics.job = scheduler.addJob("graphics", vks::AsyncComputeScheduler::GRAPHICS);
+		scheduler.addDependency(graphics.job, compute.job, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0);
+		scheduler.addDependency(compute.job, graphics.job, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 1);
+		scheduler.prepare(vulkanDevice, queue, compute.queue);
 
 		// Build a single command buffer containing the compute dispatch commands
+		compute.statsSlot = gpuStats.createSlot(vulkanDevice->queueFamilyIndices.compute);
 		buildComputeCommandBuffer();
 	}
 
@@ -601,24 +625,17 @@ public:
 
 	void draw()
 	{
-	VkSubmitInfo computeSubmitInfo = vks::initializers::submitInfo();
-	computeSubmitInfo.commandBufferCount = 1;
-	computeSubmitInfo.pCommandBuffers = &compute.commandBuffer;
-
-	VK_CHECK_RESULT( vkQueueSubmit( compute.queue, 1, &computeSubmitInfo, compute.fence ) );
+		// Submit compute commands, the scheduler makes them wait for the previous frame's graphics commands reading the particles
+		scheduler.submit(compute.job, compute.commandBuffer);
+		gpuStats.submitted(compute.statsSlot);
 
 		// Submit graphics commands
 		VulkanExampleBase::prepareFrame();
-
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
-
+		scheduler.submit(graphics.job, drawCmdBuffers[currentBuffer], { semaphores.presentComplete }, { submitPipelineStages }, { semaphores.renderComplete });
 		VulkanExampleBase::submitFrame();
 
-		// Submit compute commands
-		vkWaitForFences(device, 1, &compute.fence, VK_TRUE, UINT64_MAX);
-		vkResetFences(device, 1, &compute.fence);
+		// The compute uniform buffer is updated after this
+		scheduler.wait(compute.job);
 	}
 
 	void prepare()
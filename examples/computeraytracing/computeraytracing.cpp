@@ -1,6 +1,9 @@
 /*
 * Vulkan Example - Compute shader ray tracing
 *
+* Triangle meshes are traced through a BVH built on the CPU (binned SAH) and flattened for stackless traversal on the GPU
+* The image is traced in tiles and progressively accumulated over frames
+*
 * Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
@@ -11,6 +14,11 @@
 #include <string.h>
 #include <assert.h>
 #include <vector>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <iostream>
+#include <iomanip>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -20,6 +28,7 @@
 #include <vulkan/vulkan.h>
 #include "vulkanexamplebase.h"
 #include "VulkanTexture.hpp"
+#include "VulkanModel.hpp"
 
 #define VERTEX_BUFFER_BIND_ID 0
 #define ENABLE_VALIDATION false
@@ -30,10 +39,535 @@
 #define TEX_DIM 2048
 #endif
 
+// SSBO sphere declaration
+struct Sphere {									// Shader uses std140 layout (so we only use vec4 instead of vec3)
+	glm::vec3 pos;
+	float radius;
+	glm::vec3 diffuse;
+	float specular;
+	uint32_t id;								// Id used to identify sphere for raytracing
+	glm::ivec3 _pad;
+};
+
+// SSBO plane declaration
+struct Plane {
+	glm::vec3 normal;
+	float distance;
+	glm::vec3 diffuse;
+	float specular;
+	uint32_t id;
+	glm::ivec3 _pad;
+};
+
+/*
+	Bounding volume hierarchy over the triangles of a mesh, built with a binned surface area heuristic
+	The tree is flattened in depth first order, so the left child of an inner node directly follows it, and
+	every node stores the index of the node to continue with if a ray misses it (stackless traversal)
+*/
+class TriangleBVH
+{
+public:
+	static const uint32_t LEAF_COUNT_BITS = 4;
+	static const uint32_t MAX_LEAF_TRIANGLES = 8;
+	static const uint32_t BIN_COUNT = 16;
+	static const uint32_t INVALID = 0xFFFFFFFF;
+
+	// Node and triangle layouts match the compute shader (std430)
+	struct Node {
+		glm::vec3 aabbMin;
+		uint32_t miss;
+		glm::vec3 aabbMax;
+		uint32_t primitives;					// First triangle << LEAF_COUNT_BITS | triangle count, the count is zero for inner nodes
+	};
+
+	struct Triangle {
+		glm::vec3 v0;
+		uint32_t index;							// Index of the triangle in the source index buffer
+		glm::vec3 e1;
+		float _pad0;
+		glm::vec3 e2;
+		float _pad1;
+	};
+
+	std::vector<Node> nodes;
+	// Triangles in the order referenced by the leaves
+	std::vector<Triangle> triangles;
+	// Expected cost of a ray hitting the root, with a traversal step and a triangle test costing one
+	float sahCost = 0.0f;
+	uint32_t depth = 0;
+
+	/**
+	* Build the tree
+	*
+	* @param positions Vertex positions
+	* @param indices Three indices per triangle
+	*/
+	void build(const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &indices)
+	{
+		nodes.clear();
+		triangles.clear();
+		sahCost = 0.0f;
+		depth = 0;
+
+		const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+		if (triangleCount == 0) {
+			return;
+		}
+		std::vector<Reference> references(triangleCount);
+		for (uint32_t i = 0; i < triangleCount; i++) {
+			references[i].aabbMin = glm::vec3(FLT_MAX);
+			references[i].aabbMax = glm::vec3(-FLT_MAX);
+			for (uint32_t j = 0; j < 3; j++) {
+				references[i].aabbMin = glm::min(references[i].aabbMin, positions[indices[i * 3 + j]]);
+				references[i].aabbMax = glm::max(references[i].aabbMax, positions[indices[i * 3 + j]]);
+			}
+			references[i].centroid = (references[i].aabbMin + references[i].aabbMax) * 0.5f;
+			references[i].index = i;
+		}
+
+		nodes.reserve(triangleCount * 2);
+		triangles.reserve(triangleCount);
+		buildNode(references, 0, triangleCount, 1, positions, indices);
+
+		// Missing the last node of the depth first order ends the traversal
+		for (auto &node : nodes) {
+			if (node.miss == nodes.size()) {
+				node.miss = INVALID;
+			}
+		}
+		const float rootArea = surfaceArea(nodes[0].aabbMin, nodes[0].aabbMax);
+		if (rootArea > 0.0f) {
+			sahCost /= rootArea;
+		}
+	}
+
+	/** @brief Same traversal as the compute shader, returns the closest triangle (or the first one found if anyHit is set) closer than resT */
+	uint32_t intersect(const glm::vec3 &rayO, const glm::vec3 &rayD, float &resT, glm::vec2 &bary, bool anyHit) const
+	{
+		uint32_t hit = INVALID;
+		if (nodes.empty()) {
+			return hit;
+		}
+		const glm::vec3 invD = 1.0f / rayD;
+		uint32_t nodeIndex = 0;
+		while (nodeIndex != INVALID) {
+			const Node &node = nodes[nodeIndex];
+			if (!intersectAABB(rayO, invD, node.aabbMin, node.aabbMax, resT)) {
+				nodeIndex = node.miss;
+				continue;
+			}
+			const uint32_t count = node.primitives & ((1 << LEAF_COUNT_BITS) - 1);
+			if (count == 0) {
+				nodeIndex++;
+				continue;
+			}
+			const uint32_t first = node.primitives >> LEAF_COUNT_BITS;
+			for (uint32_t i = first; i < first + count; i++) {
+				glm::vec2 b;
+				const float t = intersectTriangle(rayO, rayD, triangles[i], b);
+				if ((t > 0.0001f) && (t < resT)) {
+					resT = t;
+					bary = b;
+					hit = i;
+					if (anyHit) {
+						return hit;
+					}
+				}
+			}
+			nodeIndex = node.miss;
+		}
+		return hit;
+	}
+
+	/** @brief Closest hit by testing all triangles, used to validate the tree */
+	uint32_t intersectBruteForce(const glm::vec3 &rayO, const glm::vec3 &rayD, float &resT) const
+	{
+		uint32_t hit = INVALID;
+		for (uint32_t i = 0; i < triangles.size(); i++) {
+			glm::vec2 b;
+			const float t = intersectTriangle(rayO, rayD, triangles[i], b);
+			if ((t > 0.0001f) && (t < resT)) {
+				resT = t;
+				hit = i;
+			}
+		}
+		return hit;
+	}
+
+	static float intersectTriangle(const glm::vec3 &rayO, const glm::vec3 &rayD, const Triangle &triangle, glm::vec2 &bary)
+	{
+		const glm::vec3 p = glm::cross(rayD, triangle.e2);
+		const float det = glm::dot(triangle.e1, p);
+		if (det == 0.0f) {
+			return -1.0f;
+		}
+		const float invDet = 1.0f / det;
+		const glm::vec3 s = rayO - triangle.v0;
+		bary.x = glm::dot(s, p) * invDet;
+		const glm::vec3 q = glm::cross(s, triangle.e1);
+		bary.y = glm::dot(rayD, q) * invDet;
+		if ((bary.x < 0.0f) || (bary.y < 0.0f) || (bary.x + bary.y > 1.0f)) {
+			return -1.0f;
+		}
+		return glm::dot(triangle.e2, q) * invDet;
+	}
+
+private:
+	struct Reference {
+		glm::vec3 aabbMin;
+		glm::vec3 aabbMax;
+		glm::vec3 centroid;
+		uint32_t index;
+	};
+
+	struct Bin {
+		glm::vec3 aabbMin = glm::vec3(FLT_MAX);
+		glm::vec3 aabbMax = glm::vec3(-FLT_MAX);
+		uint32_t count = 0;
+	};
+
+	static float surfaceArea(const glm::vec3 &aabbMin, const glm::vec3 &aabbMax)
+	{
+		const glm::vec3 extent = glm::max(aabbMax - aabbMin, glm::vec3(0.0f));
+		return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+	}
+
+	static bool intersectAABB(const glm::vec3 &rayO, const glm::vec3 &invD, const glm::vec3 &aabbMin, const glm::vec3 &aabbMax, float tMax)
+	{
+		const glm::vec3 t0 = (aabbMin - rayO) * invD;
+		const glm::vec3 t1 = (aabbMax - rayO) * invD;
+		const glm::vec3 tNear = glm::min(t0, t1);
+		const glm::vec3 tFar = glm::max(t0, t1);
+		const float tEnter = std::max(std::max(tNear.x, tNear.y), tNear.z);
+		const float tExit = std::min(std::min(tFar.x, tFar.y), tFar.z);
+		return (tEnter <= tExit) && (tExit > 0.0f) && (tEnter < tMax);
+	}
+
+	void buildNode(std::vector<Reference> &references, uint32_t begin, uint32_t end, uint32_t level, const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &indices)
+	{
+		const uint32_t nodeIndex = static_cast<uint32_t>(nodes.size());
+		nodes.push_back(Node());
+		depth = std::max(depth, level);
+
+		glm::vec3 aabbMin(FLT_MAX), aabbMax(-FLT_MAX), centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+		for (uint32_t i = begin; i < end; i++) {
+			aabbMin = glm::min(aabbMin, references[i].aabbMin);
+			aabbMax = glm::max(aabbMax, references[i].aabbMax);
+			centroidMin = glm::min(centroidMin, references[i].centroid);
+			centroidMax = glm::max(centroidMax, references[i].centroid);
+		}
+		nodes[nodeIndex].aabbMin = aabbMin;
+		nodes[nodeIndex].aabbMax = aabbMax;
+		const uint32_t count = end - begin;
+		const float area = surfaceArea(aabbMin, aabbMax);
+
+		// Find the cheapest split between the centroid bins of all axes
+		float bestCost = FLT_MAX;
+		int32_t bestAxis = -1;
+		uint32_t bestSplit = 0;
+		for (int32_t axis = 0; axis < 3; axis++) {
+			const float extent = centroidMax[axis] - centroidMin[axis];
+			if (extent <= 0.0f) {
+				continue;
+			}
+			const float binScale = BIN_COUNT / extent;
+			Bin bins[BIN_COUNT];
+			for (uint32_t i = begin; i < end; i++) {
+				const uint32_t bin = std::min(static_cast<uint32_t>((references[i].centroid[axis] - centroidMin[axis]) * binScale), BIN_COUNT - 1);
+				bins[bin].count++;
+				bins[bin].aabbMin = glm::min(bins[bin].aabbMin, references[i].aabbMin);
+				bins[bin].aabbMax = glm::max(bins[bin].aabbMax, references[i].aabbMax);
+			}
+			// Sweep from the right for the cost of the right side of each split, then from the left
+			float rightCost[BIN_COUNT];
+			uint32_t rightCount[BIN_COUNT];
+			Bin right;
+			for (uint32_t i = BIN_COUNT - 1; i > 0; i--) {
+				right.count += bins[i].count;
+				right.aabbMin = glm::min(right.aabbMin, bins[i].aabbMin);
+				right.aabbMax = glm::max(right.aabbMax, bins[i].aabbMax);
+				rightCount[i] = right.count;
+				rightCost[i] = right.count * surfaceArea(right.aabbMin, right.aabbMax);
+			}
+			Bin left;
+			for (uint32_t i = 0; i < BIN_COUNT - 1; i++) {
+				left.count += bins[i].count;
+				left.aabbMin = glm::min(left.aabbMin, bins[i].aabbMin);
+				left.aabbMax = glm::max(left.aabbMax, bins[i].aabbMax);
+				if ((left.count == 0) || (rightCount[i + 1] == 0)) {
+					continue;
+				}
+				const float cost = left.count * surfaceArea(left.aabbMin, left.aabbMax) + rightCost[i + 1];
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = i + 1;
+				}
+			}
+		}
+
+		// Splitting costs a traversal step plus the triangle tests in the children weighted by the probability of hitting them
+		const float splitCost = (bestAxis >= 0) ? ((area > 0.0f) ? 1.0f + bestCost / area : 1.0f) : FLT_MAX;
+		if ((count <= MAX_LEAF_TRIANGLES) && ((float)count <= splitCost)) {
+			const uint32_t first = static_cast<uint32_t>(triangles.size());
+			for (uint32_t i = begin; i < end; i++) {
+				const uint32_t index = references[i].index;
+				const glm::vec3 &v0 = positions[indices[index * 3]];
+				Triangle triangle = {};
+				triangle.v0 = v0;
+				triangle.index = index;
+				triangle.e1 = positions[indices[index * 3 + 1]] - v0;
+				triangle.e2 = positions[indices[index * 3 + 2]] - v0;
+				triangles.push_back(triangle);
+			}
+			nodes[nodeIndex].primitives = (first << LEAF_COUNT_BITS) | count;
+			nodes[nodeIndex].miss = nodeIndex + 1;
+			sahCost += area * count;
+			return;
+		}
+
+		uint32_t mid;
+		if (bestAxis >= 0) {
+			const float binScale = BIN_COUNT / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+			const float minCentroid = centroidMin[bestAxis];
+			auto it = std::partition(references.begin() + begin, references.begin() + end, [&](const Reference &reference) {
+				return std::min(static_cast<uint32_t>((reference.centroid[bestAxis] - minCentroid) * binScale), BIN_COUNT - 1) < bestSplit;
+			});
+			mid = static_cast<uint32_t>(it - references.begin());
+		} else {
+			// All centroids are equal, split in half
+			mid = begin + count / 2;
+		}
+		if ((mid == begin) || (mid == end)) {
+			mid = begin + count / 2;
+		}
+
+		sahCost += area;
+		buildNode(references, begin, mid, level + 1, positions, indices);
+		buildNode(references, mid, end, level + 1, positions, indices);
+		nodes[nodeIndex].primitives = 0;
+		nodes[nodeIndex].miss = static_cast<uint32_t>(nodes.size());
+	}
+};
+
+/*
+	CPU reference of the compute shader for the first (unjittered) sample of a pixel
+	Follows data/shaders/computeraytracing/raytracing.comp step by step
+*/
+class RaytracingReference
+{
+public:
+	std::vector<Sphere> spheres;
+	std::vector<Plane> planes;
+	const TriangleBVH *bvh = nullptr;
+	// Model vertex normals (as loaded, with y flipped) and indices for shading
+	std::vector<glm::vec3> normals;
+	std::vector<uint32_t> indices;
+	glm::vec3 lightPos;
+	glm::vec3 fogColor;
+	glm::vec3 cameraPos;
+	glm::vec4 meshMaterial;
+	int32_t meshId;
+	float aspectRatio;
+
+	glm::vec3 tracePixel(glm::ivec2 pixel, glm::ivec2 dim) const
+	{
+		const glm::vec2 uv = glm::vec2(pixel) / glm::vec2(dim);
+		glm::vec3 rayO = cameraPos;
+		glm::vec3 rayD = glm::normalize(glm::vec3((-1.0f + 2.0f * uv) * glm::vec2(aspectRatio, 1.0f), -1.0f));
+
+		int32_t id = 0;
+		glm::vec3 finalColor = renderScene(rayO, rayD, id);
+		float reflectionStrength = REFLECTIONSTRENGTH;
+		for (int32_t i = 0; i < RAYBOUNCES; i++) {
+			const glm::vec3 reflectionColor = renderScene(rayO, rayD, id);
+			finalColor = (1.0f - reflectionStrength) * finalColor + reflectionStrength * glm::mix(reflectionColor, finalColor, 1.0f - reflectionStrength);
+			reflectionStrength *= REFLECTIONFALLOFF;
+		}
+		return finalColor;
+	}
+
+private:
+	const float EPSILON = 0.0001f;
+	const float MAXLEN = 1000.0f;
+	const float SHADOW = 0.5f;
+	const int32_t RAYBOUNCES = 2;
+	const float REFLECTIONSTRENGTH = 0.4f;
+	const float REFLECTIONFALLOFF = 0.5f;
+	const float MESH_OFFSET = 0.001f;
+
+	float lightDiffuse(const glm::vec3 &normal, const glm::vec3 &lightDir) const
+	{
+		return glm::clamp(glm::dot(normal, lightDir), 0.1f, 1.0f);
+	}
+
+	float lightSpecular(const glm::vec3 &normal, const glm::vec3 &lightDir, float specularFactor) const
+	{
+		const glm::vec3 viewVec = glm::normalize(cameraPos);
+		const glm::vec3 halfVec = glm::normalize(lightDir + viewVec);
+		return powf(glm::clamp(glm::dot(normal, halfVec), 0.0f, 1.0f), specularFactor);
+	}
+
+	float sphereIntersect(const glm::vec3 &rayO, const glm::vec3 &rayD, const Sphere &sphere) const
+	{
+		const glm::vec3 oc = rayO - sphere.pos;
+		const float b = 2.0f * glm::dot(oc, rayD);
+		const float c = glm::dot(oc, oc) - sphere.radius * sphere.radius;
+		const float h = b * b - 4.0f * c;
+		if (h < 0.0f) {
+			return -1.0f;
+		}
+		return (-b - sqrtf(h)) / 2.0f;
+	}
+
+	float planeIntersect(const glm::vec3 &rayO, const glm::vec3 &rayD, const Plane &plane) const
+	{
+		const float d = glm::dot(rayD, plane.normal);
+		if (d == 0.0f) {
+			return 0.0f;
+		}
+		const float t = -(plane.distance + glm::dot(rayO, plane.normal)) / d;
+		return (t < 0.0f) ? 0.0f : t;
+	}
+
+	glm::vec3 meshNormal(uint32_t triangle, const glm::vec2 &bary) const
+	{
+		const uint32_t index = bvh->triangles[triangle].index * 3;
+		const float weights[3] = { 1.0f - bary.x - bary.y, bary.x, bary.y };
+		glm::vec3 normal(0.0f);
+		for (uint32_t i = 0; i < 3; i++) {
+			normal += weights[i] * normals[indices[index + i]];
+		}
+		normal.y = -normal.y;
+		return glm::normalize(normal);
+	}
+
+	int32_t intersect(const glm::vec3 &rayO, const glm::vec3 &rayD, float &resT, uint32_t &triangle, glm::vec2 &bary) const
+	{
+		int32_t id = -1;
+		for (auto &sphere : spheres) {
+			const float tSphere = sphereIntersect(rayO, rayD, sphere);
+			if ((tSphere > EPSILON) && (tSphere < resT)) {
+				id = sphere.id;
+				resT = tSphere;
+			}
+		}
+		for (auto &plane : planes) {
+			const float tPlane = planeIntersect(rayO, rayD, plane);
+			if ((tPlane > EPSILON) && (tPlane < resT)) {
+				id = plane.id;
+				resT = tPlane;
+			}
+		}
+		triangle = bvh->intersect(rayO, rayD, resT, bary, false);
+		if (triangle != TriangleBVH::INVALID) {
+			id = meshId;
+		}
+		return id;
+	}
+
+	float calcShadow(const glm::vec3 &rayO, const glm::vec3 &rayD, int32_t objectId, float &t) const
+	{
+		for (auto &sphere : spheres) {
+			if ((int32_t)sphere.id == objectId) {
+				continue;
+			}
+			const float tSphere = sphereIntersect(rayO, rayD, sphere);
+			if ((tSphere > EPSILON) && (tSphere < t)) {
+				t = tSphere;
+				return SHADOW;
+			}
+		}
+		glm::vec2 bary;
+		if (bvh->intersect(rayO, rayD, t, bary, true) != TriangleBVH::INVALID) {
+			return SHADOW;
+		}
+		return 1.0f;
+	}
+
+	glm::vec3 renderScene(glm::vec3 &rayO, glm::vec3 &rayD, int32_t &id) const
+	{
+		glm::vec3 color(0.0f);
+		float t = MAXLEN;
+
+		uint32_t triangle;
+		glm::vec2 bary;
+		const int32_t objectID = intersect(rayO, rayD, t, triangle, bary);
+		if (objectID == -1) {
+			return color;
+		}
+
+		glm::vec3 pos = rayO + t * rayD;
+		const glm::vec3 lightVec = glm::normalize(lightPos - pos);
+		glm::vec3 normal;
+
+		for (auto &plane : planes) {
+			if (objectID == (int32_t)plane.id) {
+				normal = plane.normal;
+				color = lightDiffuse(normal, lightVec) * plane.diffuse + lightSpecular(normal, lightVec, plane.specular);
+			}
+		}
+		for (auto &sphere : spheres) {
+			if (objectID == (int32_t)sphere.id) {
+				normal = (pos - sphere.pos) / sphere.radius;
+				color = lightDiffuse(normal, lightVec) * sphere.diffuse + lightSpecular(normal, lightVec, sphere.specular);
+			}
+		}
+		if (objectID == meshId) {
+			normal = meshNormal(triangle, bary);
+			if (glm::dot(normal, rayD) > 0.0f) {
+				normal = -normal;
+			}
+			color = lightDiffuse(normal, lightVec) * glm::vec3(meshMaterial) + lightSpecular(normal, lightVec, meshMaterial.a);
+			pos += normal * MESH_OFFSET;
+		}
+
+		if (id == -1) {
+			return color;
+		}
+		id = objectID;
+
+		// Shadows
+		t = glm::length(lightPos - pos);
+		color *= calcShadow(pos, lightVec, id, t);
+
+		// Fog
+		color = glm::mix(color, fogColor, glm::clamp(sqrtf(t * t) / 20.0f, 0.0f, 1.0f));
+
+		// Reflect ray for next render pass
+		rayD = rayD + 2.0f * -glm::dot(normal, rayD) * normal;
+		rayO = pos;
+
+		return color;
+	}
+};
+
 class VulkanExample : public VulkanExampleBase
 {
 public:
 	vks::Texture textureComputeTarget;
+	vks::Texture textureAccumulation;			// Sum of the samples since the last reset (32 bit float)
+
+	// Meshes from data/models that can be traced, "-mesh" adds another one
+	std::vector<std::string> meshes = { "geosphere.obj", "torusknot.obj", "teapot.dae", "suzanne.obj", "venus.fbx" };
+	int32_t meshIndex = 2;
+	vks::Model model;
+	vks::VertexLayout vertexLayout = vks::VertexLayout({
+		vks::VERTEX_COMPONENT_POSITION,
+		vks::VERTEX_COMPONENT_NORMAL,
+	});
+	TriangleBVH bvh;
+	float bvhBuildTime = 0.0f;
+	RaytracingReference reference;
+
+	// The image is traced in square tiles with one dispatch per tile
+	uint32_t tileSize = 256;
+	int32_t tilesPerFrame;
+	// Samples accumulated per tile, tiles stop being traced once they reach the maximum
+	std::vector<uint32_t> tileSamples;
+	uint32_t nextTile = 0;
+	int32_t maxSamples = 256;
+	bool accumulate = true;
 
 	// Resources for the graphics part of the example
 	struct {
@@ -49,6 +583,9 @@ public:
 		struct {
 			vks::Buffer spheres;						// (Shader) storage buffer object with scene spheres
 			vks::Buffer planes;						// (Shader) storage buffer object with scene planes
+			vks::Buffer nodes;						// (Shader) storage buffer object with the flattened BVH of the mesh
+			vks::Buffer triangles;					// (Shader) storage buffer object with the mesh triangles in BVH order
+			vks::Buffer rayStats;					// Host visible ray counter for the benchmark
 		} storageBuffers;
 		vks::Buffer uniformBuffer;					// Uniform buffer object containing scene data
 		VkQueue queue;								// Separate queue for compute commands (queue family may differ from the one used for graphics)
@@ -56,39 +593,30 @@ public:
 		VkCommandBuffer commandBuffer;				// Command buffer storing the dispatch commands and barriers
 		VkFence fence;								// Synchronization fence to avoid rewriting compute CB if still in use
 		VkDescriptorSetLayout descriptorSetLayout;	// Compute shader binding layout
-		VkDescriptorSet descriptorSet;				// Compute shader bindings
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;	// Compute shader bindings
 		VkPipelineLayout pipelineLayout;			// Layout of the compute pipeline
 		VkPipeline pipeline;						// Compute raytracing pipeline
+		VkPipeline pipelineRayStats;				// Compute raytracing pipeline counting the traced rays
 		struct UBOCompute {							// Compute shader uniform block object
 			glm::vec3 lightPos;
 			float aspectRatio;						// Aspect ratio of the viewport
 			glm::vec4 fogColor = glm::vec4(0.0f);
 			struct {
 				glm::vec3 pos = glm::vec3(0.0f, 0.0f, 4.0f);
+				float _pad0;
 				glm::vec3 lookat = glm::vec3(0.0f, 0.5f, 0.0f);
 				float fov = 10.0f;
 			} camera;
+			glm::vec4 meshMaterial = glm::vec4(0.65f, 0.77f, 0.97f, 32.0f);
+			int32_t meshId;
+			float lightRadius = 0.25f;				// Radius of the spherical light, sampled over multiple frames for soft shadows
+			uint32_t triangleCount = 0;
 		} ubo;
 	} compute;
 
-	// SSBO sphere declaration 
-	struct Sphere {									// Shader uses std140 layout (so we only use vec4 instead of vec3)
-		glm::vec3 pos;								
-		float radius;
-		glm::vec3 diffuse;
-		float specular;
-		uint32_t id;								// Id used to identify sphere for raytracing
-		glm::ivec3 _pad;
-	};
-
-	// SSBO plane declaration
-	struct Plane {
-		glm::vec3 normal;
-		float distance;
-		glm::vec3 diffuse;
-		float specular;
-		uint32_t id;
-		glm::ivec3 _pad;
+	struct PushConstants {
+		glm::ivec2 tileOffset;
+		uint32_t sampleIndex;
 	};
 
 	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
@@ -104,6 +632,23 @@ public:
 		camera.setTranslation(glm::vec3(0.0f, 0.0f, -4.0f));
 		camera.rotationSpeed = 0.0f;
 		camera.movementSpeed = 2.5f;
+
+		for (size_t i = 0; i < args.size(); i++) {
+			if ((std::string(args[i]) == "-mesh") && (i + 1 < args.size())) {
+				auto it = std::find(meshes.begin(), meshes.end(), std::string(args[i + 1]));
+				if (it == meshes.end()) {
+					it = meshes.insert(meshes.end(), std::string(args[i + 1]));
+				}
+				meshIndex = static_cast<int32_t>(it - meshes.begin());
+			}
+			// Must be a multiple of the work group size
+			if ((std::string(args[i]) == "-tilesize") && (i + 1 < args.size())) {
+				tileSize = std::max((std::stoi(args[i + 1]) + 15) & ~15, 16);
+			}
+		}
+		const uint32_t tilesPerRow = (TEX_DIM + tileSize - 1) / tileSize;
+		tileSamples.resize(tilesPerRow * tilesPerRow, 0);
+		tilesPerFrame = static_cast<int32_t>(tileSamples.size());
 	}
 
 	~VulkanExample()
@@ -115,6 +660,7 @@ public:
 
 		// Compute
 		vkDestroyPipeline(device, compute.pipeline, nullptr);
+		vkDestroyPipeline(device, compute.pipelineRayStats, nullptr);
 		vkDestroyPipelineLayout(device, compute.pipelineLayout, nullptr);
 		vkDestroyDescriptorSetLayout(device, compute.descriptorSetLayout, nullptr);
 		vkDestroyFence(device, compute.fence, nullptr);
@@ -122,8 +668,13 @@ public:
 		compute.uniformBuffer.destroy();
 		compute.storageBuffers.spheres.destroy();
 		compute.storageBuffers.planes.destroy();
+		compute.storageBuffers.nodes.destroy();
+		compute.storageBuffers.triangles.destroy();
+		compute.storageBuffers.rayStats.destroy();
+		model.destroy();
 
 		textureComputeTarget.destroy();
+		textureAccumulation.destroy();
 	}
 
 	// Prepare a texture target that is used to store compute shader calculations
@@ -149,7 +700,8 @@ public:
 		imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
 		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 		// Image will be sampled in the fragment shader and used as storage target in the compute shader
-		imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
+		// The benchmark copies it to the host
+		imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 		imageCreateInfo.flags = 0;
 
 		VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
@@ -166,9 +718,9 @@ public:
 
 		tex->imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 		vks::tools::setImageLayout(
-			layoutCmd, 
+			layoutCmd,
 			tex->image,
-			VK_IMAGE_ASPECT_COLOR_BIT, 
+			VK_IMAGE_ASPECT_COLOR_BIT,
 			VK_IMAGE_LAYOUT_UNDEFINED,
 			tex->imageLayout);
 
@@ -269,8 +821,6 @@ public:
 			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics.pipeline);
 			vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
 
-			drawUI(drawCmdBuffers[i]);
-
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
 
 			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
@@ -278,6 +828,18 @@ public:
 
 	}
 
+	// Trace one tile of the image
+	void recordTile(VkCommandBuffer commandBuffer, uint32_t tile, uint32_t sampleIndex)
+	{
+		const uint32_t tilesPerRow = (textureComputeTarget.width + tileSize - 1) / tileSize;
+		PushConstants pushConstants;
+		pushConstants.tileOffset = glm::ivec2(tile % tilesPerRow, tile / tilesPerRow) * glm::ivec2(tileSize);
+		pushConstants.sampleIndex = sampleIndex;
+		vkCmdPushConstants(commandBuffer, compute.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+		vkCmdDispatch(commandBuffer, tileSize / 16, tileSize / 16, 1);
+	}
+
+	// Record the tiles traced this frame, tiles that reached the maximum sample count are skipped
 	void buildComputeCommandBuffer()
 	{
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
@@ -287,11 +849,30 @@ public:
 		vkCmdBindPipeline(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipeline);
 		vkCmdBindDescriptorSets(compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSet, 0, 0);
 
-		vkCmdDispatch(compute.commandBuffer, textureComputeTarget.width / 16, textureComputeTarget.height / 16, 1);
+		const uint32_t tileCount = static_cast<uint32_t>(tileSamples.size());
+		int32_t tilesTraced = 0;
+		for (uint32_t i = 0; (i < tileCount) && (tilesTraced < tilesPerFrame); i++) {
+			const uint32_t tile = (nextTile + i) % tileCount;
+			if (tileSamples[tile] >= (uint32_t)maxSamples) {
+				continue;
+			}
+			recordTile(compute.commandBuffer, tile, tileSamples[tile]);
+			tileSamples[tile]++;
+			tilesTraced++;
+			if (tilesTraced == tilesPerFrame) {
+				nextTile = (tile + 1) % tileCount;
+			}
+		}
 
 		vkEndCommandBuffer(compute.commandBuffer);
 	}
 
+	// Restart the accumulation of all tiles with their next frame
+	void resetAccumulation()
+	{
+		std::fill(tileSamples.begin(), tileSamples.end(), 0);
+	}
+
 	uint32_t currentId = 0;	// Id used to identify objects by the ray tracing shader
 
 	Sphere newSphere(glm::vec3 pos, float radius, glm::vec3 diffuse, float specular)
@@ -316,41 +897,42 @@ public:
 		return plane;
 	}
 
-	// Setup and fill the compute shader storage buffers containing primitives for the raytraced scene
-	void prepareStorageBuffers()
+	// Create a device local storage buffer and fill it through a staging buffer
+	void createStorageBuffer(vks::Buffer *buffer, const void *data, VkDeviceSize size)
 	{
-		// Spheres
-		std::vector<Sphere> spheres;
-		spheres.push_back(newSphere(glm::vec3(1.75f, -0.5f, 0.0f), 1.0f, glm::vec3(0.0f, 1.0f, 0.0f), 32.0f));
-		spheres.push_back(newSphere(glm::vec3(0.0f, 1.0f, -0.5f), 1.0f, glm::vec3(0.65f, 0.77f, 0.97f), 32.0f));
-		spheres.push_back(newSphere(glm::vec3(-1.75f, -0.75f, -0.5f), 1.25f, glm::vec3(0.9f, 0.76f, 0.46f), 32.0f));
-		VkDeviceSize storageBufferSize = spheres.size() * sizeof(Sphere);
-
-		// Stage
 		vks::Buffer stagingBuffer;
 
 		vulkanDevice->createBuffer(
 			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
 			&stagingBuffer,
-			storageBufferSize,
-			spheres.data());
+			size,
+			(void*)data);
 
 		vulkanDevice->createBuffer(
-			// The SSBO will be used as a storage buffer for the compute pipeline and as a vertex buffer in the graphics pipeline
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			&compute.storageBuffers.spheres,
-			storageBufferSize);
+			buffer,
+			size);
 
-		// Copy to staging buffer
+		// Copy from staging buffer
 		VkCommandBuffer copyCmd = VulkanExampleBase::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
 		VkBufferCopy copyRegion = {};
-		copyRegion.size = storageBufferSize;
-		vkCmdCopyBuffer(copyCmd, stagingBuffer.buffer, compute.storageBuffers.spheres.buffer, 1, &copyRegion);
+		copyRegion.size = size;
+		vkCmdCopyBuffer(copyCmd, stagingBuffer.buffer, buffer->buffer, 1, &copyRegion);
 		VulkanExampleBase::flushCommandBuffer(copyCmd, queue, true);
 
 		stagingBuffer.destroy();
+	}
+
+	// Setup and fill the compute shader storage buffers containing primitives for the raytraced scene
+	void prepareStorageBuffers()
+	{
+		// Spheres
+		std::vector<Sphere> spheres;
+		spheres.push_back(newSphere(glm::vec3(1.75f, -0.5f, 0.0f), 1.0f, glm::vec3(0.0f, 1.0f, 0.0f), 32.0f));
+		spheres.push_back(newSphere(glm::vec3(-1.75f, -0.75f, -0.5f), 1.25f, glm::vec3(0.9f, 0.76f, 0.46f), 32.0f));
+		createStorageBuffer(&compute.storageBuffers.spheres, spheres.data(), spheres.size() * sizeof(Sphere));
 
 		// Planes
 		std::vector<Plane> planes;
@@ -361,30 +943,80 @@ public:
 		planes.push_back(newPlane(glm::vec3(0.0f, 0.0f, -1.0f), roomDim, glm::vec3(0.0f), 32.0f));
 		planes.push_back(newPlane(glm::vec3(-1.0f, 0.0f, 0.0f), roomDim, glm::vec3(1.0f, 0.0f, 0.0f), 32.0f));
 		planes.push_back(newPlane(glm::vec3(1.0f, 0.0f, 0.0f), roomDim, glm::vec3(0.0f, 1.0f, 0.0f), 32.0f));
-		storageBufferSize = planes.size() * sizeof(Plane);
+		createStorageBuffer(&compute.storageBuffers.planes, planes.data(), planes.size() * sizeof(Plane));
 
-		// Stage
-		vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&stagingBuffer,
-			storageBufferSize,
-			planes.data());
+		// The mesh takes the place of the center sphere
+		compute.ubo.meshId = currentId++;
+
+		reference.spheres = spheres;
+		reference.planes = planes;
+		reference.bvh = &bvh;
 
+		// Ray counter for the benchmark
 		vulkanDevice->createBuffer(
-			// The SSBO will be used as a storage buffer for the compute pipeline and as a vertex buffer in the graphics pipeline
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			&compute.storageBuffers.planes,
-			storageBufferSize);
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&compute.storageBuffers.rayStats,
+			sizeof(uint32_t));
+		VK_CHECK_RESULT(compute.storageBuffers.rayStats.map());
 
-		// Copy to staging buffer
-		copyCmd = VulkanExampleBase::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-		copyRegion.size = storageBufferSize;
-		vkCmdCopyBuffer(copyCmd, stagingBuffer.buffer, compute.storageBuffers.planes.buffer, 1, &copyRegion);
-		VulkanExampleBase::flushCommandBuffer(copyCmd, queue, true);
+		loadMesh(meshIndex);
+	}
 
-		stagingBuffer.destroy();
+	// Load a mesh, build its BVH and upload it, the device must be idle
+	void loadMesh(uint32_t index)
+	{
+		if (model.device) {
+			model.destroy();
+		}
+		compute.storageBuffers.nodes.destroy();
+		compute.storageBuffers.triangles.destroy();
+
+		// The shader reads the vertices and indices for shading (the "memory property" flags are added to the buffer usage)
+		vks::ModelCreateInfo modelCreateInfo(1.0f, 1.0f, 0.0f);
+		modelCreateInfo.memoryPropertyFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+		modelCreateInfo.keepHostData = true;
+		model.loadFromFile(getAssetPath() + "models/" + meshes[index], vertexLayout, &modelCreateInfo, vulkanDevice, queue);
+
+		// Fit the mesh into the space of the center sphere, the model loader flips y for the rasterization examples
+		const uint32_t stride = vertexLayout.stride() / sizeof(float);
+		const uint32_t vertexCount = static_cast<uint32_t>(model.vertexData.size() / stride);
+		std::vector<glm::vec3> positions(vertexCount);
+		reference.normals.resize(vertexCount);
+		glm::vec3 aabbMin(FLT_MAX), aabbMax(-FLT_MAX);
+		for (uint32_t i = 0; i < vertexCount; i++) {
+			const float *vertex = &model.vertexData[i * stride];
+			positions[i] = glm::vec3(vertex[0], -vertex[1], vertex[2]);
+			reference.normals[i] = glm::vec3(vertex[3], vertex[4], vertex[5]);
+			aabbMin = glm::min(aabbMin, positions[i]);
+			aabbMax = glm::max(aabbMax, positions[i]);
+		}
+		const glm::vec3 extent = aabbMax - aabbMin;
+		const float scale = 2.0f / std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-6f));
+		const glm::vec3 center = (aabbMin + aabbMax) * 0.5f;
+		for (auto &position : positions) {
+			position = (position - center) * scale + glm::vec3(0.0f, 0.75f, -0.5f);
+		}
+		reference.indices = model.indexData;
+
+		auto tStart = std::chrono::high_resolution_clock::now();
+		bvh.build(positions, model.indexData);
+		bvhBuildTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+		compute.ubo.triangleCount = static_cast<uint32_t>(bvh.triangles.size());
+
+		// Storage buffers can't be empty
+		std::vector<TriangleBVH::Node> nodes = bvh.nodes;
+		std::vector<TriangleBVH::Triangle> triangles = bvh.triangles;
+		nodes.resize(std::max(nodes.size(), (size_t)1));
+		triangles.resize(std::max(triangles.size(), (size_t)1));
+		createStorageBuffer(&compute.storageBuffers.nodes, nodes.data(), nodes.size() * sizeof(TriangleBVH::Node));
+		createStorageBuffer(&compute.storageBuffers.triangles, triangles.data(), triangles.size() * sizeof(TriangleBVH::Triangle));
+
+		if (compute.descriptorSet != VK_NULL_HANDLE) {
+			updateComputeDescriptorSet();
+			updateUniformBuffers();
+		}
+		resetAccumulation();
 	}
 
 	void setupDescriptorPool()
@@ -393,8 +1025,8 @@ public:
 		{
 			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2),			// Compute UBO
 			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4),	// Graphics image samplers
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1),				// Storage image for ray traced image output
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2),			// Storage buffer for the scene primitives
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2),				// Storage images for ray traced image output and accumulation
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 7),			// Storage buffers for the scene primitives, the BVH, the model and the ray counter
 		};
 
 		VkDescriptorPoolCreateInfo descriptorPoolInfo =
@@ -538,6 +1170,75 @@ public:
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &graphics.pipeline));
 	}
 
+	void updateComputeDescriptorSet()
+	{
+		std::vector<VkWriteDescriptorSet> computeWriteDescriptorSets =
+		{
+			// Binding 0: Output storage image
+			vks::initializers::writeDescriptorSet(
+				compute.descriptorSet,
+				VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+				0,
+				&textureComputeTarget.descriptor),
+			// Binding 1: Uniform buffer block
+			vks::initializers::writeDescriptorSet(
+				compute.descriptorSet,
+				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+				1,
+				&compute.uniformBuffer.descriptor),
+			// Binding 2: Shader storage buffer for the spheres
+			vks::initializers::writeDescriptorSet(
+				compute.descriptorSet,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				2,
+				&compute.storageBuffers.spheres.descriptor),
+			// Binding 3: Shader storage buffer for the planes
+			vks::initializers::writeDescriptorSet(
+				compute.descriptorSet,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				3,
+				&compute.storageBuffers.planes.descriptor),
+			// Binding 4: Shader storage buffer for the BVH nodes
+			vks::initializers::writeDescriptorSet(
+				compute.descriptorSet,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				4,
+				&compute.storageBuffers.nodes.descriptor),
+			// Binding 5: Shader storage buffer for the mesh triangles
+			vks::initializers::writeDescriptorSet(
+				compute.descriptorSet,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				5,
+				&compute.storageBuffers.triangles.descriptor),
+			// Binding 6: Model vertex buffer
+			vks::initializers::writeDescriptorSet(
+				compute.descriptorSet,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				6,
+				&model.vertices.descriptor),
+			// Binding 7: Model index buffer
+			vks::initializers::writeDescriptorSet(
+				compute.descriptorSet,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				7,
+				&model.indices.descriptor),
+			// Binding 8: Accumulation storage image
+			vks::initializers::writeDescriptorSet(
+				compute.descriptorSet,
+				VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+				8,
+				&textureAccumulation.descriptor),
+			// Binding 9: Ray counter
+			vks::initializers::writeDescriptorSet(
+				compute.descriptorSet,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				9,
+				&compute.storageBuffers.rayStats.descriptor)
+		};
+
+		vkUpdateDescriptorSets(device, computeWriteDescriptorSets.size(), computeWriteDescriptorSets.data(), 0, NULL);
+	}
+
 	// Prepare the compute pipeline that generates the ray traced image
 	void prepareCompute()
 	{
@@ -563,16 +1264,46 @@ public:
 				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
 				VK_SHADER_STAGE_COMPUTE_BIT,
 				1),
-			// Binding 1: Shader storage buffer for the spheres
+			// Binding 2: Shader storage buffer for the spheres
 			vks::initializers::descriptorSetLayoutBinding(
 				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
 				VK_SHADER_STAGE_COMPUTE_BIT,
 				2),
-			// Binding 1: Shader storage buffer for the planes
+			// Binding 3: Shader storage buffer for the planes
+			vks::initializers::descriptorSetLayoutBinding(
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				VK_SHADER_STAGE_COMPUTE_BIT,
+				3),
+			// Binding 4: Shader storage buffer for the BVH nodes
 			vks::initializers::descriptorSetLayoutBinding(
 				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
 				VK_SHADER_STAGE_COMPUTE_BIT,
-				3)
+				4),
+			// Binding 5: Shader storage buffer for the mesh triangles
+			vks::initializers::descriptorSetLayoutBinding(
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				VK_SHADER_STAGE_COMPUTE_BIT,
+				5),
+			// Binding 6: Model vertex buffer
+			vks::initializers::descriptorSetLayoutBinding(
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				VK_SHADER_STAGE_COMPUTE_BIT,
+				6),
+			// Binding 7: Model index buffer
+			vks::initializers::descriptorSetLayoutBinding(
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				VK_SHADER_STAGE_COMPUTE_BIT,
+				7),
+			// Binding 8: Storage image (accumulation)
+			vks::initializers::descriptorSetLayoutBinding(
+				VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+				VK_SHADER_STAGE_COMPUTE_BIT,
+				8),
+			// Binding 9: Ray counter
+			vks::initializers::descriptorSetLayoutBinding(
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				VK_SHADER_STAGE_COMPUTE_BIT,
+				9)
 		};
 
 		VkDescriptorSetLayoutCreateInfo descriptorLayout =
@@ -587,6 +1318,11 @@ public:
 				&compute.descriptorSetLayout,
 				1);
 
+		// Push constants for the tile offset and the sample index
+		VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(PushConstants), 0);
+		pPipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pPipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
 		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pPipelineLayoutCreateInfo, nullptr, &compute.pipelineLayout));
 
 		VkDescriptorSetAllocateInfo allocInfo =
@@ -597,35 +1333,7 @@ public:
 
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &compute.descriptorSet));
 
-		std::vector<VkWriteDescriptorSet> computeWriteDescriptorSets =
-		{
-			// Binding 0: Output storage image
-			vks::initializers::writeDescriptorSet(
-				compute.descriptorSet,
-				VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-				0,
-				&textureComputeTarget.descriptor),
-			// Binding 1: Uniform buffer block
-			vks::initializers::writeDescriptorSet(
-				compute.descriptorSet,
-				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-				1,
-				&compute.uniformBuffer.descriptor),
-			// Binding 2: Shader storage buffer for the spheres
-			vks::initializers::writeDescriptorSet(
-				compute.descriptorSet,
-				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-				2,
-				&compute.storageBuffers.spheres.descriptor),
-			// Binding 2: Shader storage buffer for the planes
-			vks::initializers::writeDescriptorSet(
-				compute.descriptorSet,
-				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-				3,
-				&compute.storageBuffers.planes.descriptor)
-		};
-
-		vkUpdateDescriptorSets(device, computeWriteDescriptorSets.size(), computeWriteDescriptorSets.data(), 0, NULL);
+		updateComputeDescriptorSet();
 
 		// Create compute shader pipelines
 		VkComputePipelineCreateInfo computePipelineCreateInfo =
@@ -636,6 +1344,13 @@ public:
 		computePipelineCreateInfo.stage = loadShader(getAssetPath() + "shaders/computeraytracing/raytracing.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
 		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.pipeline));
 
+		// Variant counting the traced rays, selected with a specialization constant
+		VkBool32 rayStats = VK_TRUE;
+		VkSpecializationMapEntry specializationMapEntry = vks::initializers::specializationMapEntry(0, 0, sizeof(VkBool32));
+		VkSpecializationInfo specializationInfo = vks::initializers::specializationInfo(1, &specializationMapEntry, sizeof(VkBool32), &rayStats);
+		computePipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &compute.pipelineRayStats));
+
 		// Separate command pool as queue family for compute may be different than graphics
 		VkCommandPoolCreateInfo cmdPoolInfo = {};
 		cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
@@ -655,9 +1370,6 @@ public:
 		// Fence for compute CB sync
 		VkFenceCreateInfo fenceCreateInfo = vks::initializers::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
 		VK_CHECK_RESULT(vkCreateFence(device, &fenceCreateInfo, nullptr, &compute.fence));
-
-		// Build a single command buffer containing the compute dispatch commands
-		buildComputeCommandBuffer();
 	}
 
 	// Prepare and initialize uniform buffer containing shader uniforms
@@ -684,6 +1396,175 @@ public:
 		compute.uniformBuffer.unmap();
 	}
 
+	VkCommandBuffer createComputeCommandBuffer()
+	{
+		VkCommandBuffer commandBuffer;
+		VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(compute.commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &commandBuffer));
+		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+		VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufInfo));
+		return commandBuffer;
+	}
+
+	// Submit a command buffer from the compute command pool to the compute queue and wait until it has finished
+	void flushComputeCommandBuffer(VkCommandBuffer commandBuffer)
+	{
+		VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+		VkSubmitInfo submitInfo = vks::initializers::submitInfo();
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+		VK_CHECK_RESULT(vkQueueSubmit(compute.queue, 1, &submitInfo, VK_NULL_HANDLE));
+		VK_CHECK_RESULT(vkQueueWaitIdle(compute.queue));
+		vkFreeCommandBuffers(device, compute.commandPool, 1, &commandBuffer);
+	}
+
+	// Trace the first sample of all tiles
+	void recordFullImage(VkCommandBuffer commandBuffer, VkPipeline pipeline)
+	{
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute.pipelineLayout, 0, 1, &compute.descriptorSet, 0, 0);
+		for (uint32_t tile = 0; tile < tileSamples.size(); tile++) {
+			recordTile(commandBuffer, tile, 0);
+		}
+	}
+
+	/*
+		Rays per second for all meshes and a check of the GPU image against the CPU reference tracer, enabled with "-raytracingbenchmark"
+		Also checks the BVH traversal against testing all triangles
+	*/
+	void RaytracingBenchmark()
+	{
+		bool enabled = false;
+		for (auto arg : args) {
+			if (std::string(arg) == "-raytracingbenchmark") {
+				enabled = true;
+			}
+		}
+		if (!enabled) {
+			return;
+		}
+
+		const bool timestamps = vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.compute].timestampValidBits != 0;
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		if (timestamps) {
+			VkQueryPoolCreateInfo queryPoolInfo = {};
+			queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			queryPoolInfo.queryCount = 2;
+			VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &queryPool));
+		} else {
+			std::cout << "Compute queue does not support timestamps, skipping timings" << std::endl;
+		}
+
+		const uint32_t imageDim = textureAccumulation.width;
+		const VkDeviceSize imageSize = imageDim * imageDim * sizeof(glm::vec4);
+		vks::Buffer hostBuffer;
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &hostBuffer, imageSize));
+		VK_CHECK_RESULT(hostBuffer.map());
+
+		std::cout << std::fixed << std::setprecision(3);
+		for (uint32_t i = 0; i < meshes.size(); i++) {
+			loadMesh(i);
+			updateComputeDescriptorSet();
+			updateUniformBuffers();
+			std::cout << meshes[i] << ": " << bvh.triangles.size() << " triangles, BVH with " << bvh.nodes.size() << " nodes (depth " << bvh.depth << ", SAH cost " << bvh.sahCost
+				<< ") built in " << bvhBuildTime << " ms" << std::endl;
+
+			// Traversal vs. all triangles for random rays through the mesh bounds
+			std::default_random_engine rndEngine(i);
+			std::uniform_real_distribution<float> rndDist(-1.0f, 1.0f);
+			const uint32_t rayCount = 1024;
+			uint32_t mismatches = 0;
+			for (uint32_t r = 0; r < rayCount; r++) {
+				const glm::vec3 rayO = compute.ubo.camera.pos + glm::vec3(rndDist(rndEngine), rndDist(rndEngine), rndDist(rndEngine)) * 0.5f;
+				const glm::vec3 target = glm::vec3(0.0f, 0.75f, -0.5f) + glm::vec3(rndDist(rndEngine), rndDist(rndEngine), rndDist(rndEngine));
+				const glm::vec3 rayD = glm::normalize(target - rayO);
+				float tTree = FLT_MAX, tAll = FLT_MAX;
+				glm::vec2 bary;
+				const uint32_t hitTree = bvh.intersect(rayO, rayD, tTree, bary, false);
+				const uint32_t hitAll = bvh.intersectBruteForce(rayO, rayD, tAll);
+				if ((hitTree == TriangleBVH::INVALID) != (hitAll == TriangleBVH::INVALID) || (fabs(tTree - tAll) > 1e-5f * std::max(tAll, 1.0f))) {
+					mismatches++;
+				}
+			}
+			std::cout << "  BVH vs. all triangles: " << mismatches << " of " << rayCount << " rays differ" << std::endl;
+
+			// Timing of the first sample for the whole image
+			if (timestamps) {
+				const uint32_t frameCount = 4;
+				VkCommandBuffer commandBuffer = createComputeCommandBuffer();
+				vkCmdResetQueryPool(commandBuffer, queryPool, 0, 2);
+				vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+				for (uint32_t f = 0; f < frameCount; f++) {
+					recordFullImage(commandBuffer, compute.pipeline);
+				}
+				vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+				flushComputeCommandBuffer(commandBuffer);
+				uint64_t queryResults[2] = { 0, 0 };
+				VK_CHECK_RESULT(vkGetQueryPoolResults(device, queryPool, 0, 2, sizeof(queryResults), queryResults, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+				const double frameMs = (double)(queryResults[1] - queryResults[0]) * vulkanDevice->properties.limits.timestampPeriod / 1000000.0 / frameCount;
+
+				// Count the rays of one frame with the pipeline variant
+				memset(compute.storageBuffers.rayStats.mapped, 0, sizeof(uint32_t));
+				commandBuffer = createComputeCommandBuffer();
+				recordFullImage(commandBuffer, compute.pipelineRayStats);
+				flushComputeCommandBuffer(commandBuffer);
+				const uint32_t frameRays = *(uint32_t*)compute.storageBuffers.rayStats.mapped;
+
+				std::cout << "  " << imageDim << "x" << imageDim << ": " << frameMs << " ms GPU per frame, " << frameRays << " rays (incl. shadow rays), "
+					<< frameRays / frameMs / 1000.0 << " Mrays/s" << std::endl;
+			}
+
+			// GPU image vs. CPU reference for a grid of pixels
+			VkCommandBuffer commandBuffer = createComputeCommandBuffer();
+			recordFullImage(commandBuffer, compute.pipeline);
+			VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+			memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_FLAGS_NONE, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			VkBufferImageCopy copyRegion = {};
+			copyRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+			copyRegion.imageExtent = { imageDim, imageDim, 1 };
+			vkCmdCopyImageToBuffer(commandBuffer, textureAccumulation.image, VK_IMAGE_LAYOUT_GENERAL, hostBuffer.buffer, 1, &copyRegion);
+			flushComputeCommandBuffer(commandBuffer);
+
+			reference.lightPos = compute.ubo.lightPos;
+			reference.fogColor = glm::vec3(compute.ubo.fogColor);
+			reference.cameraPos = compute.ubo.camera.pos;
+			reference.meshMaterial = compute.ubo.meshMaterial;
+			reference.meshId = compute.ubo.meshId;
+			reference.aspectRatio = compute.ubo.aspectRatio;
+			const glm::vec4 *pixels = (glm::vec4*)hostBuffer.mapped;
+			const uint32_t step = 16;
+			double meanError = 0.0, maxError = 0.0;
+			uint32_t pixelCount = 0, differingPixels = 0;
+			for (uint32_t y = step / 2; y < imageDim; y += step) {
+				for (uint32_t x = step / 2; x < imageDim; x += step) {
+					const glm::vec3 color = reference.tracePixel(glm::ivec2(x, y), glm::ivec2(imageDim));
+					const glm::vec3 diff = glm::abs(color - glm::vec3(pixels[y * imageDim + x]));
+					const double error = std::max(std::max(diff.x, diff.y), diff.z);
+					meanError += error;
+					maxError = std::max(maxError, error);
+					// More than one step of the 8 bit output
+					if (error > 1.0 / 255.0) {
+						differingPixels++;
+					}
+					pixelCount++;
+				}
+			}
+			std::cout << "  GPU vs. CPU reference (" << pixelCount << " pixels): mean error " << std::scientific << meanError / pixelCount << ", max " << maxError << std::fixed
+				<< ", " << 100.0 * differingPixels / pixelCount << "% of the pixels differ by more than 1/255" << std::endl;
+		}
+
+		hostBuffer.destroy();
+		if (queryPool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(device, queryPool, nullptr);
+		}
+
+		// Restore the selected mesh
+		loadMesh(meshIndex);
+	}
+
 	void draw()
 	{
 		VulkanExampleBase::prepareFrame();
@@ -700,6 +1581,12 @@ public:
 		vkWaitForFences(device, 1, &compute.fence, VK_TRUE, UINT64_MAX);
 		vkResetFences(device, 1, &compute.fence);
 
+		// The traced tiles change every frame
+		if (!accumulate) {
+			resetAccumulation();
+		}
+		buildComputeCommandBuffer();
+
 		VkSubmitInfo computeSubmitInfo = vks::initializers::submitInfo();
 		computeSubmitInfo.commandBufferCount = 1;
 		computeSubmitInfo.pCommandBuffers = &compute.commandBuffer;
@@ -713,12 +1600,14 @@ public:
 		prepareStorageBuffers();
 		prepareUniformBuffers();
 		prepareTextureTarget(&textureComputeTarget, TEX_DIM, TEX_DIM, VK_FORMAT_R8G8B8A8_UNORM);
+		prepareTextureTarget(&textureAccumulation, TEX_DIM, TEX_DIM, VK_FORMAT_R32G32B32A32_SFLOAT);
 		setupDescriptorSetLayout();
 		preparePipelines();
 		setupDescriptorPool();
 		setupDescriptorSet();
 		prepareCompute();
-		buildCommandBuffers(); 
+		RaytracingBenchmark();
+		buildCommandBuffers();
 		prepared = true;
 	}
 
@@ -729,7 +1618,9 @@ public:
 		draw();
 		if (!paused)
 		{
+			// The light moves, so samples of previous frames can't be used
 			updateUniformBuffers();
+			resetAccumulation();
 		}
 	}
 
@@ -737,7 +1628,30 @@ public:
 	{
 		compute.ubo.aspectRatio = (float)width / (float)height;
 		updateUniformBuffers();
+		resetAccumulation();
+	}
+
+	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
+	{
+		if (overlay->header("Settings")) {
+			if (overlay->comboBox("Mesh", &meshIndex, meshes)) {
+				VK_CHECK_RESULT(vkDeviceWaitIdle(device));
+				loadMesh(meshIndex);
+			}
+			if (overlay->sliderFloat("Light radius", &compute.ubo.lightRadius, 0.0f, 1.0f)) {
+				updateUniformBuffers();
+				resetAccumulation();
+			}
+			overlay->checkBox("Accumulate", &accumulate);
+			overlay->sliderInt("Tiles per frame", &tilesPerFrame, 1, static_cast<int32_t>(tileSamples.size()));
+			overlay->sliderInt("Max. samples", &maxSamples, 1, 4096);
+		}
+		if (overlay->header("Statistics")) {
+			overlay->text("%d triangles, %d BVH nodes (depth %d)", bvh.triangles.size(), bvh.nodes.size(), bvh.depth);
+			overlay->text("BVH built in %.2f ms, SAH cost %.1f", bvhBuildTime, bvh.sahCost);
+			overlay->text("%d samples", *std::min_element(tileSamples.begin(), tileSamples.end()));
+		}
 	}
 };
 
-VULKAN_EXAMPLE_MAIN()
\ No newline at end of file
+VULKAN_EXAMPLE_MAIN()
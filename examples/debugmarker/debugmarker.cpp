@@ -606,8 +606,6 @@ public:
 					DebugMarker::endRegion(drawCmdBuffers[i]);
 				}
 
-				drawUI(drawCmdBuffers[i]);
-
 				vkCmdEndRenderPass(drawCmdBuffers[i]);
 
 				// End current debug marker region
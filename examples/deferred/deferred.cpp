@@ -1,6 +1,9 @@
 /*
 * Vulkan Example - Deferred shading with multiple render targets (aka G-Buffer) example
 *
+* Thousands of animated point lights are assigned to a clustered (froxel) grid by a compute pass,
+* the composition pass only shades the lights of a fragment's cluster
+*
 * Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
@@ -11,6 +14,15 @@
 #include <string.h>
 #include <assert.h>
 #include <vector>
+#include <random>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define LIGHTS_SSE2
+#include <emmintrin.h>
+#endif
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -22,6 +34,7 @@
 #include "VulkanBuffer.hpp"
 #include "VulkanTexture.hpp"
 #include "VulkanModel.hpp"
+#include "VulkanFrameBuffer.hpp"
 
 #define VERTEX_BUFFER_BIND_ID 0
 #define ENABLE_VALIDATION false
@@ -33,10 +46,130 @@
 // Offscreen frame buffer properties
 #define FB_DIM TEX_DIM
 
+// Light cluster grid (screen tiles x depth slices), must match the shaders
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define CLUSTER_COUNT (CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+// Size of the light index list shared by all clusters
+#define MAX_LIGHT_INDICES (CLUSTER_COUNT * 128)
+#define MAX_LIGHTS 16384
+
+// Must match the shader storage buffer layout
+struct Light {
+	glm::vec4 position;
+	glm::vec3 color;
+	float radius;
+};
+
+/*
+	Point lights orbiting around random origins above the floor
+	The animation state is stored as structure of arrays and updated four lights at a time with SSE2 (if available)
+	Sine and cosine use a parabolic approximation in both paths, so the results don't depend on the path taken
+*/
+class AnimatedLights
+{
+public:
+	uint32_t count = 0;
+
+	/** @brief Generate a deterministic set of lights, the first lights are the same for all counts */
+	void generate(uint32_t count, Light *lights)
+	{
+		this->count = count;
+		originX.resize(count);
+		originY.resize(count);
+		originZ.resize(count);
+		orbit.resize(count);
+		bob.resize(count);
+		phase.resize(count);
+		speed.resize(count);
+
+		std::default_random_engine rndEngine(0);
+		std::uniform_real_distribution<float> rndDist(0.0f, 1.0f);
+		// Keep the overall brightness roughly constant
+		const float intensity = std::min(1.0f, 256.0f / (float)count);
+		for (uint32_t i = 0; i < count; i++) {
+			originX[i] = (rndDist(rndEngine) * 2.0f - 1.0f) * 10.0f;
+			originY[i] = -2.2f + rndDist(rndEngine) * 3.2f;
+			originZ[i] = (rndDist(rndEngine) * 2.0f - 1.0f) * 10.0f;
+			orbit[i] = 0.5f + rndDist(rndEngine) * 2.5f;
+			bob[i] = rndDist(rndEngine) * 0.5f;
+			phase[i] = rndDist(rndEngine) * 2.0f * (float)M_PI;
+			// Whole turns per timer period, so the animation doesn't jump when the timer wraps around
+			speed[i] = (rndDist(rndEngine) < 0.5f) ? -1.0f : 1.0f;
+			const glm::vec3 color = glm::vec3(rndDist(rndEngine), rndDist(rndEngine), rndDist(rndEngine));
+			lights[i].color = color / std::max(std::max(color.r, color.g), std::max(color.b, 0.1f)) * 1.5f * intensity;
+			lights[i].radius = 0.75f + rndDist(rndEngine) * 1.25f;
+		}
+		update(0.0f, lights);
+	}
+
+	/** @brief Write the light positions for the given timer value (0..1), colors and radii are left untouched */
+	void update(float timer, Light *lights) const
+	{
+		const float angle = timer * 2.0f * (float)M_PI;
+		uint32_t i = 0;
+#if defined(LIGHTS_SSE2)
+		const __m128 baseAngle = _mm_set1_ps(angle);
+		const __m128 halfPi = _mm_set1_ps((float)(M_PI / 2.0));
+		for (; i + 4 <= count; i += 4) {
+			const __m128 a = _mm_add_ps(_mm_loadu_ps(&phase[i]), _mm_mul_ps(baseAngle, _mm_loadu_ps(&speed[i])));
+			const __m128 s = sin(a);
+			const __m128 c = sin(_mm_add_ps(a, halfPi));
+			const __m128 r = _mm_loadu_ps(&orbit[i]);
+			__m128 x = _mm_add_ps(_mm_loadu_ps(&originX[i]), _mm_mul_ps(s, r));
+			__m128 y = _mm_add_ps(_mm_loadu_ps(&originY[i]), _mm_mul_ps(_mm_mul_ps(s, c), _mm_loadu_ps(&bob[i])));
+			__m128 z = _mm_add_ps(_mm_loadu_ps(&originZ[i]), _mm_mul_ps(c, r));
+			__m128 w = _mm_set1_ps(1.0f);
+			// Four positions from the coordinate vectors
+			_MM_TRANSPOSE4_PS(x, y, z, w);
+			_mm_storeu_ps(&lights[i + 0].position.x, x);
+			_mm_storeu_ps(&lights[i + 1].position.x, y);
+			_mm_storeu_ps(&lights[i + 2].position.x, z);
+			_mm_storeu_ps(&lights[i + 3].position.x, w);
+		}
+#endif
+		for (; i < count; i++) {
+			const float a = phase[i] + angle * speed[i];
+			const float s = sin(a);
+			const float c = sin(a + (float)(M_PI / 2.0));
+			lights[i].position = glm::vec4(originX[i] + s * orbit[i], originY[i] + s * c * bob[i], originZ[i] + c * orbit[i], 1.0f);
+		}
+	}
+
+private:
+	std::vector<float> originX, originY, originZ;
+	std::vector<float> orbit, bob, phase, speed;
+
+	// Parabolic sine approximation (max. error ~0.001) after wrapping x to [-pi, pi]
+	static float sin(float x)
+	{
+		x -= 2.0f * (float)M_PI * std::nearbyint(x * (float)(0.5 / M_PI));
+		float y = x * (1.27323954f - 0.405284735f * fabsf(x));
+		return y + 0.225f * (y * fabsf(y) - y);
+	}
+
+#if defined(LIGHTS_SSE2)
+	static __m128 sin(__m128 x)
+	{
+		const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+		// Conversion rounds to nearest like std::nearbyint
+		const __m128 turns = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps((float)(0.5 / M_PI)))));
+		x = _mm_sub_ps(x, _mm_mul_ps(turns, _mm_set1_ps(2.0f * (float)M_PI)));
+		__m128 y = _mm_mul_ps(x, _mm_sub_ps(_mm_set1_ps(1.27323954f), _mm_mul_ps(_mm_set1_ps(0.405284735f), _mm_and_ps(x, absMask))));
+		return _mm_add_ps(y, _mm_mul_ps(_mm_set1_ps(0.225f), _mm_sub_ps(_mm_mul_ps(y, _mm_and_ps(y, absMask)), y)));
+	}
+#endif
+};
+
 class VulkanExample : public VulkanExampleBase
 {
 public:
 	bool debugDisplay = false;
+	// Shade only the lights assigned to a fragment's cluster, otherwise all lights are shaded for every fragment
+	bool clustered = true;
+	int32_t lightCount = 4096;
+	AnimatedLights animatedLights;
 
 	struct {
 		struct {
@@ -77,15 +210,14 @@ public:
 		glm::vec4 instancePos[3];
 	} uboVS, uboOffscreenVS;
 
-	struct Light {
-		glm::vec4 position;
-		glm::vec3 color;
-		float radius;
-	};
-
+	// Shared by the light culling and the composition pass
 	struct {
-		Light lights[6];
+		glm::mat4 view;
 		glm::vec4 viewPos;
+		uint32_t lightCount;
+		float zNear;
+		float zFar;
+		uint32_t maxLightIndices = MAX_LIGHT_INDICES;
 	} uboFragmentLights;
 
 	struct {
@@ -94,17 +226,41 @@ public:
 		vks::Buffer fsLights;
 	} uniformBuffers;
 
+	struct {
+		vks::Buffer lights;				// Host visible, the light positions are animated on the CPU
+		vks::Buffer clusters;			// View space bounding boxes of the clusters
+		vks::Buffer lightGrid;			// Range in the light index list per cluster
+		vks::Buffer lightIndices;		// Counter followed by the light index lists of all clusters
+	} storageBuffers;
+
 	struct {
 		VkPipeline deferred;
+		VkPipeline deferredClustered;
 		VkPipeline offscreen;
 		VkPipeline debug;
+		VkPipeline clusterBounds;
+		VkPipeline lightCulling;
 	} pipelines;
 
 	struct {
 		VkPipelineLayout deferred; 
 		VkPipelineLayout offscreen;
+		VkPipelineLayout lightCulling;
 	} pipelineLayouts;
 
+	struct {
+		VkDescriptorSetLayout descriptorSetLayout;
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		// Projection the cluster bounds have been built for
+		glm::mat4 projection;
+	} lightCulling;
+
+	struct ClusterBoundsPushConstants {
+		glm::mat4 invProjection;
+		float zNear;
+		float zFar;
+	};
+
 	struct {
 		VkDescriptorSet model;
 		VkDescriptorSet floor;
@@ -136,6 +292,9 @@ public:
 	// Semaphore used to synchronize between offscreen and final scene rendering
 	VkSemaphore offscreenSemaphore = VK_NULL_HANDLE;
 
+	// Statistics slot for the offscreen command buffer (G-Buffer and light culling)
+	uint32_t offscreenStatsSlot = 0;
+
 	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
 	{
 		title = "Deferred shading (2016 by Sascha Willems)";
@@ -148,6 +307,15 @@ public:
 		camera.setRotation(glm::vec3(-0.75f, 12.5f, 0.0f));
 		camera.setPerspective(60.0f, (float)width / (float)height, 0.1f, 256.0f);
 		settings.overlay = true;
+
+		for (size_t i = 0; i < args.size(); i++) {
+			if ((std::string(args[i]) == "-lights") && (i + 1 < args.size())) {
+				lightCount = std::max(1, std::min(std::stoi(args[i + 1]), MAX_LIGHTS));
+			}
+			if (std::string(args[i]) == "-naivelighting") {
+				clustered = false;
+			}
+		}
 	}
 
 	~VulkanExample()
@@ -180,13 +348,18 @@ public:
 		vkDestroyFramebuffer(device, offScreenFrameBuf.frameBuffer, nullptr);
 
 		vkDestroyPipeline(device, pipelines.deferred, nullptr);
+		vkDestroyPipeline(device, pipelines.deferredClustered, nullptr);
 		vkDestroyPipeline(device, pipelines.offscreen, nullptr);
 		vkDestroyPipeline(device, pipelines.debug, nullptr);
+		vkDestroyPipeline(device, pipelines.clusterBounds, nullptr);
+		vkDestroyPipeline(device, pipelines.lightCulling, nullptr);
 
 		vkDestroyPipelineLayout(device, pipelineLayouts.deferred, nullptr);
 		vkDestroyPipelineLayout(device, pipelineLayouts.offscreen, nullptr);
+		vkDestroyPipelineLayout(device, pipelineLayouts.lightCulling, nullptr);
 
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+		vkDestroyDescriptorSetLayout(device, lightCulling.descriptorSetLayout, nullptr);
 
 		// Meshes
 		models.model.destroy();
@@ -198,6 +371,11 @@ public:
 		uniformBuffers.vsFullScreen.destroy();
 		uniformBuffers.fsLights.destroy();
 
+		storageBuffers.lights.destroy();
+		storageBuffers.clusters.destroy();
+		storageBuffers.lightGrid.destroy();
+		storageBuffers.lightIndices.destroy();
+
 		vkFreeCommandBuffers(device, cmdPool, 1, &offScreenCmdBuffer);
 
 		vkDestroyRenderPass(device, offScreenFrameBuf.renderPass, nullptr);
@@ -433,17 +611,41 @@ public:
 		VK_CHECK_RESULT(vkCreateSampler(device, &sampler, nullptr, &colorSampler));
 	}
 
+	// Assign the lights to the clusters, the light index lists are read by the composition pass
+	void recordLightCulling(VkCommandBuffer commandBuffer)
+	{
+		// Reset the index list counter
+		vkCmdFillBuffer(commandBuffer, storageBuffers.lightIndices.buffer, 0, sizeof(uint32_t), 0);
+		VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_FLAGS_NONE, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.lightCulling);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts.lightCulling, 0, 1, &lightCulling.descriptorSet, 0, nullptr);
+		vkCmdDispatch(commandBuffer, (CLUSTER_COUNT + 127) / 128, 1, 1);
+
+		// The light grid and index lists are read by the composition pass, the counter may be reset by the next frame
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_FLAGS_NONE, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+	}
+
 	// Build command buffer for rendering the scene to the offscreen frame buffer attachments
 	void buildDeferredCommandBuffer()
 	{
 		if (offScreenCmdBuffer == VK_NULL_HANDLE)
 		{
 			offScreenCmdBuffer = VulkanExampleBase::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, false);
+			offscreenStatsSlot = gpuStats.createSlot(vulkanDevice->queueFamilyIndices.graphics);
 		}
 
 		// Create a semaphore used to synchronize offscreen rendering and usage
-		VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
-		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &offscreenSemaphore));
+		if (offscreenSemaphore == VK_NULL_HANDLE)
+		{
+			VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
+			VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &offscreenSemaphore));
+		}
 
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
@@ -463,7 +665,9 @@ public:
 		renderPassBeginInfo.pClearValues = clearValues.data();
 
 		VK_CHECK_RESULT(vkBeginCommandBuffer(offScreenCmdBuffer, &cmdBufInfo));
+		gpuStats.cmdReset(offScreenCmdBuffer, offscreenStatsSlot);
 
+		gpuStats.cmdBeginPass(offScreenCmdBuffer, offscreenStatsSlot, "G-Buffer");
 		vkCmdBeginRenderPass(offScreenCmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 		VkViewport viewport = vks::initializers::viewport((float)offScreenFrameBuf.width, (float)offScreenFrameBuf.height, 0.0f, 1.0f);
@@ -489,6 +693,14 @@ public:
 		vkCmdDrawIndexed(offScreenCmdBuffer, models.model.indexCount, 3, 0, 0, 0);
 
 		vkCmdEndRenderPass(offScreenCmdBuffer);
+		gpuStats.cmdEndPass(offScreenCmdBuffer, offscreenStatsSlot);
+
+		if (clustered)
+		{
+			gpuStats.cmdBeginPass(offScreenCmdBuffer, offscreenStatsSlot, "Light culling");
+			recordLightCulling(offScreenCmdBuffer);
+			gpuStats.cmdEndPass(offScreenCmdBuffer, offscreenStatsSlot);
+		}
 
 		VK_CHECK_RESULT(vkEndCommandBuffer(offScreenCmdBuffer));
 	}
@@ -562,6 +774,7 @@ public:
 			renderPassBeginInfo.framebuffer = frameBuffers[i];
 
 			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
+			gpuStats.cmdReset(drawCmdBuffers[i], i);
 
 			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
@@ -588,13 +801,11 @@ public:
 				vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
 			}
 
-			// Final composition as full screen quad
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.deferred);
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &models.quad.vertices.buffer, offsets);
-			vkCmdBindIndexBuffer(drawCmdBuffers[i], models.quad.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdDrawIndexed(drawCmdBuffers[i], 6, 1, 0, 0, 1);
-
-			drawUI(drawCmdBuffers[i]);
+			// Final composition as a full screen triangle generated in the vertex shader (a quad would shade the pixels along its diagonal twice)
+			gpuStats.cmdBeginPass(drawCmdBuffers[i], i, "Composition");
+			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, clustered ? pipelines.deferredClustered : pipelines.deferred);
+			vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
+			gpuStats.cmdEndPass(drawCmdBuffers[i], i);
 
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
 
@@ -723,15 +934,17 @@ public:
 	{
 		std::vector<VkDescriptorPoolSize> poolSizes =
 		{
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 8),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 9)
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 9),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 9),
+			// Lights, light grid and index lists for the composition, lights, clusters, light grid and index lists for the light culling
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 7)
 		};
 
 		VkDescriptorPoolCreateInfo descriptorPoolInfo =
 			vks::initializers::descriptorPoolCreateInfo(
 				static_cast<uint32_t>(poolSizes.size()),
 				poolSizes.data(),
-				3);
+				4);
 
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
 	}
@@ -766,6 +979,21 @@ public:
 				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
 				VK_SHADER_STAGE_FRAGMENT_BIT,
 				4),
+			// Binding 5 : Lights
+			vks::initializers::descriptorSetLayoutBinding(
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				VK_SHADER_STAGE_FRAGMENT_BIT,
+				5),
+			// Binding 6 : Light grid
+			vks::initializers::descriptorSetLayoutBinding(
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				VK_SHADER_STAGE_FRAGMENT_BIT,
+				6),
+			// Binding 7 : Light index lists
+			vks::initializers::descriptorSetLayoutBinding(
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				VK_SHADER_STAGE_FRAGMENT_BIT,
+				7),
 		};
 
 		VkDescriptorSetLayoutCreateInfo descriptorLayout =
@@ -849,6 +1077,24 @@ public:
 				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
 				4,
 				&uniformBuffers.fsLights.descriptor),
+			// Binding 5 : Lights
+			vks::initializers::writeDescriptorSet(
+				descriptorSet,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				5,
+				&storageBuffers.lights.descriptor),
+			// Binding 6 : Light grid
+			vks::initializers::writeDescriptorSet(
+				descriptorSet,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				6,
+				&storageBuffers.lightGrid.descriptor),
+			// Binding 7 : Light index lists
+			vks::initializers::writeDescriptorSet(
+				descriptorSet,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				7,
+				&storageBuffers.lightIndices.descriptor),
 		};
 
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
@@ -982,6 +1228,13 @@ public:
 		pipelineCreateInfo.layout = pipelineLayouts.deferred;
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.deferred));
 
+		// Same composition, but only shading the lights of the fragment's cluster
+		VkBool32 clusteredShading = VK_TRUE;
+		VkSpecializationMapEntry specializationMapEntry = vks::initializers::specializationMapEntry(0, 0, sizeof(VkBool32));
+		VkSpecializationInfo specializationInfo = vks::initializers::specializationInfo(1, &specializationMapEntry, sizeof(VkBool32), &clusteredShading);
+		shaderStages[1].pSpecializationInfo = &specializationInfo;
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.deferredClustered));
+
 		// Debug display pipeline
 		pipelineCreateInfo.pVertexInputState = &vertices.inputState;
 		shaderStages[0] = loadShader(getAssetPath() + "shaders/deferred/debug.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
@@ -1050,6 +1303,39 @@ public:
 		// Update
 		updateUniformBuffersScreen();
 		updateUniformBufferDeferredMatrices();
+	}
+
+	// Prepare the storage buffers for the lights and the light clusters
+	void prepareStorageBuffers()
+	{
+		// Lights are written by the CPU every frame
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&storageBuffers.lights,
+			MAX_LIGHTS * sizeof(Light)));
+		VK_CHECK_RESULT(storageBuffers.lights.map());
+
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&storageBuffers.clusters,
+			CLUSTER_COUNT * sizeof(glm::vec4) * 2));
+
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&storageBuffers.lightGrid,
+			CLUSTER_COUNT * sizeof(uint32_t) * 2));
+
+		// Transfer source for reading back the counter in the benchmark
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&storageBuffers.lightIndices,
+			(MAX_LIGHT_INDICES + 1) * sizeof(uint32_t)));
+
+		animatedLights.generate(lightCount, (Light*)storageBuffers.lights.mapped);
 		updateUniformBufferDeferredLights();
 	}
 
@@ -1077,48 +1363,15 @@ public:
 		memcpy(uniformBuffers.vsOffscreen.mapped, &uboOffscreenVS, sizeof(uboOffscreenVS));
 	}
 
-	// Update fragment shader light position uniform block
+	// Update the light positions and the light uniform block shared by the light culling and composition
 	void updateUniformBufferDeferredLights()
 	{
-		// White
-		uboFragmentLights.lights[0].position = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
-		uboFragmentLights.lights[0].color = glm::vec3(1.5f);
-		uboFragmentLights.lights[0].radius = 15.0f * 0.25f;
-		// Red
-		uboFragmentLights.lights[1].position = glm::vec4(-2.0f, 0.0f, 0.0f, 0.0f);
-		uboFragmentLights.lights[1].color = glm::vec3(1.0f, 0.0f, 0.0f);
-		uboFragmentLights.lights[1].radius = 15.0f;
-		// Blue
-		uboFragmentLights.lights[2].position = glm::vec4(2.0f, 1.0f, 0.0f, 0.0f);
-		uboFragmentLights.lights[2].color = glm::vec3(0.0f, 0.0f, 2.5f);
-		uboFragmentLights.lights[2].radius = 5.0f;
-		// Yellow
-		uboFragmentLights.lights[3].position = glm::vec4(0.0f, 0.9f, 0.5f, 0.0f);
-		uboFragmentLights.lights[3].color = glm::vec3(1.0f, 1.0f, 0.0f);
-		uboFragmentLights.lights[3].radius = 2.0f;
-		// Green
-		uboFragmentLights.lights[4].position = glm::vec4(0.0f, 0.5f, 0.0f, 0.0f);
-		uboFragmentLights.lights[4].color = glm::vec3(0.0f, 1.0f, 0.2f);
-		uboFragmentLights.lights[4].radius = 5.0f;
-		// Yellow
-		uboFragmentLights.lights[5].position = glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
-		uboFragmentLights.lights[5].color = glm::vec3(1.0f, 0.7f, 0.3f);
-		uboFragmentLights.lights[5].radius = 25.0f;
-
-		uboFragmentLights.lights[0].position.x = sin(glm::radians(360.0f * timer)) * 5.0f;
-		uboFragmentLights.lights[0].position.z = cos(glm::radians(360.0f * timer)) * 5.0f;
-
-		uboFragmentLights.lights[1].position.x = -4.0f + sin(glm::radians(360.0f * timer) + 45.0f) * 2.0f;
-		uboFragmentLights.lights[1].position.z =  0.0f + cos(glm::radians(360.0f * timer) + 45.0f) * 2.0f;
-
-		uboFragmentLights.lights[2].position.x = 4.0f + sin(glm::radians(360.0f * timer)) * 2.0f;
-		uboFragmentLights.lights[2].position.z = 0.0f + cos(glm::radians(360.0f * timer)) * 2.0f;
-
-		uboFragmentLights.lights[4].position.x = 0.0f + sin(glm::radians(360.0f * timer + 90.0f)) * 5.0f;
-		uboFragmentLights.lights[4].position.z = 0.0f - cos(glm::radians(360.0f * timer + 45.0f)) * 5.0f;
-
-		uboFragmentLights.lights[5].position.x = 0.0f + sin(glm::radians(-360.0f * timer + 135.0f)) * 10.0f;
-		uboFragmentLights.lights[5].position.z = 0.0f - cos(glm::radians(-360.0f * timer - 45.0f)) * 10.0f;
+		animatedLights.update(timer, (Light*)storageBuffers.lights.mapped);
+
+		uboFragmentLights.view = camera.matrices.view;
+		uboFragmentLights.lightCount = animatedLights.count;
+		uboFragmentLights.zNear = camera.getNearClip();
+		uboFragmentLights.zFar = camera.getFarClip();
 
 		// Current view position
 		uboFragmentLights.viewPos = glm::vec4(camera.position, 0.0f) * glm::vec4(-1.0f, 1.0f, -1.0f, 1.0f);
@@ -1126,6 +1379,263 @@ public:
 		memcpy(uniformBuffers.fsLights.mapped, &uboFragmentLights, sizeof(uboFragmentLights));
 	}
 
+	// Descriptors and pipelines for building the cluster bounds and assigning the lights to the clusters
+	void prepareLightCulling()
+	{
+		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings =
+		{
+			// Binding 0 : Light uniform block
+			vks::initializers::descriptorSetLayoutBinding(
+				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+				VK_SHADER_STAGE_COMPUTE_BIT,
+				0),
+			// Binding 1 : Lights
+			vks::initializers::descriptorSetLayoutBinding(
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				VK_SHADER_STAGE_COMPUTE_BIT,
+				1),
+			// Binding 2 : Cluster bounds
+			vks::initializers::descriptorSetLayoutBinding(
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				VK_SHADER_STAGE_COMPUTE_BIT,
+				2),
+			// Binding 3 : Light grid
+			vks::initializers::descriptorSetLayoutBinding(
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				VK_SHADER_STAGE_COMPUTE_BIT,
+				3),
+			// Binding 4 : Light index lists
+			vks::initializers::descriptorSetLayoutBinding(
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				VK_SHADER_STAGE_COMPUTE_BIT,
+				4),
+		};
+
+		VkDescriptorSetLayoutCreateInfo descriptorLayout =
+			vks::initializers::descriptorSetLayoutCreateInfo(
+				setLayoutBindings.data(),
+				static_cast<uint32_t>(setLayoutBindings.size()));
+
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &lightCulling.descriptorSetLayout));
+
+		VkPipelineLayoutCreateInfo pPipelineLayoutCreateInfo =
+			vks::initializers::pipelineLayoutCreateInfo(
+				&lightCulling.descriptorSetLayout,
+				1);
+
+		// The cluster bounds get the inverse projection and the depth range as push constants
+		VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(ClusterBoundsPushConstants), 0);
+		pPipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pPipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pPipelineLayoutCreateInfo, nullptr, &pipelineLayouts.lightCulling));
+
+		VkDescriptorSetAllocateInfo allocInfo =
+			vks::initializers::descriptorSetAllocateInfo(
+				descriptorPool,
+				&lightCulling.descriptorSetLayout,
+				1);
+
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &lightCulling.descriptorSet));
+
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets =
+		{
+			// Binding 0 : Light uniform block
+			vks::initializers::writeDescriptorSet(
+				lightCulling.descriptorSet,
+				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+				0,
+				&uniformBuffers.fsLights.descriptor),
+			// Binding 1 : Lights
+			vks::initializers::writeDescriptorSet(
+				lightCulling.descriptorSet,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				1,
+				&storageBuffers.lights.descriptor),
+			// Binding 2 : Cluster bounds
+			vks::initializers::writeDescriptorSet(
+				lightCulling.descriptorSet,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				2,
+				&storageBuffers.clusters.descriptor),
+			// Binding 3 : Light grid
+			vks::initializers::writeDescriptorSet(
+				lightCulling.descriptorSet,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				3,
+				&storageBuffers.lightGrid.descriptor),
+			// Binding 4 : Light index lists
+			vks::initializers::writeDescriptorSet(
+				lightCulling.descriptorSet,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				4,
+				&storageBuffers.lightIndices.descriptor),
+		};
+
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+
+		VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(pipelineLayouts.lightCulling, 0);
+		computePipelineCreateInfo.stage = loadShader(getAssetPath() + "shaders/deferred/clusterbounds.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &pipelines.clusterBounds));
+		computePipelineCreateInfo.stage = loadShader(getAssetPath() + "shaders/deferred/lightculling.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &pipelines.lightCulling));
+	}
+
+	// Build the view space bounds of the clusters, only needs to be done again if the projection changes
+	void buildClusterBounds()
+	{
+		ClusterBoundsPushConstants pushConstants;
+		pushConstants.invProjection = glm::inverse(camera.matrices.perspective);
+		pushConstants.zNear = camera.getNearClip();
+		pushConstants.zFar = camera.getFarClip();
+
+		VkCommandBuffer commandBuffer = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines.clusterBounds);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts.lightCulling, 0, 1, &lightCulling.descriptorSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, pipelineLayouts.lightCulling, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ClusterBoundsPushConstants), &pushConstants);
+		vkCmdDispatch(commandBuffer, (CLUSTER_COUNT + 63) / 64, 1, 1);
+		vulkanDevice->flushCommandBuffer(commandBuffer, queue);
+
+		lightCulling.projection = camera.matrices.perspective;
+	}
+
+	/*
+		GPU time of the naive and the clustered composition for increasing light counts, enabled with "-lightingbenchmark"
+		The clustered time is split into the light culling and the composition pass
+	*/
+	void LightingBenchmark()
+	{
+		bool enabled = false;
+		for (auto arg : args) {
+			if (std::string(arg) == "-lightingbenchmark") {
+				enabled = true;
+			}
+		}
+		if (!enabled) {
+			return;
+		}
+		if (vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.graphics].timestampValidBits == 0) {
+			std::cout << "Graphics queue does not support timestamps, skipping the lighting benchmark" << std::endl;
+			return;
+		}
+
+		// Render target compatible with the example's render pass, so the composition pipelines can be used without presenting
+		vks::Framebuffer framebuffer(vulkanDevice);
+		framebuffer.width = width;
+		framebuffer.height = height;
+		vks::AttachmentCreateInfo attachmentInfo = {};
+		attachmentInfo.width = width;
+		attachmentInfo.height = height;
+		attachmentInfo.layerCount = 1;
+		attachmentInfo.format = swapChain.colorFormat;
+		attachmentInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		framebuffer.addAttachment(attachmentInfo);
+		attachmentInfo.format = depthFormat;
+		attachmentInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+		framebuffer.addAttachment(attachmentInfo);
+		VK_CHECK_RESULT(framebuffer.createSampler(VK_FILTER_NEAREST, VK_FILTER_NEAREST, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE));
+		VK_CHECK_RESULT(framebuffer.createRenderPass());
+
+		VkClearValue clearValues[2];
+		clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+		clearValues[1].depthStencil = { 1.0f, 0 };
+		VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+		renderPassBeginInfo.renderPass = framebuffer.renderPass;
+		renderPassBeginInfo.framebuffer = framebuffer.framebuffer;
+		renderPassBeginInfo.renderArea.extent.width = width;
+		renderPassBeginInfo.renderArea.extent.height = height;
+		renderPassBeginInfo.clearValueCount = 2;
+		renderPassBeginInfo.pClearValues = clearValues;
+
+		VkQueryPool queryPool;
+		VkQueryPoolCreateInfo queryPoolInfo = {};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolInfo.queryCount = 3;
+		VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &queryPool));
+
+		// Number of entries in the light index lists
+		vks::Buffer hostBuffer;
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &hostBuffer, sizeof(uint32_t)));
+		VK_CHECK_RESULT(hostBuffer.map());
+
+		// Fill the G-Buffer
+		VkSubmitInfo offscreenSubmitInfo = vks::initializers::submitInfo();
+		offscreenSubmitInfo.commandBufferCount = 1;
+		offscreenSubmitInfo.pCommandBuffers = &offScreenCmdBuffer;
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &offscreenSubmitInfo, VK_NULL_HANDLE));
+		VK_CHECK_RESULT(vkQueueWaitIdle(queue));
+
+		const uint32_t iterations = 4;
+		// Every fragment shading all lights gets too slow beyond this (and may trigger a device timeout)
+		const uint32_t naiveMaxLights = 4096;
+		std::cout << std::fixed << std::setprecision(3);
+		std::cout << "Lighting benchmark at " << width << "x" << height << ", " << CLUSTER_X << "x" << CLUSTER_Y << "x" << CLUSTER_Z << " clusters, GPU ms per frame" << std::endl;
+		for (uint32_t count : { 64, 256, 1024, 4096, 8192, 16384 }) {
+			animatedLights.generate(count, (Light*)storageBuffers.lights.mapped);
+			updateUniformBufferDeferredLights();
+
+			double times[2][2] = {};
+			for (bool clusteredPath : { false, true }) {
+				if (!clusteredPath && (count > naiveMaxLights)) {
+					continue;
+				}
+				VkCommandBuffer commandBuffer = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+				vkCmdResetQueryPool(commandBuffer, queryPool, 0, 3);
+				vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+				if (clusteredPath) {
+					for (uint32_t i = 0; i < iterations; i++) {
+						recordLightCulling(commandBuffer);
+					}
+				}
+				vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+				for (uint32_t i = 0; i < iterations; i++) {
+					vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+					VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+					vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+					VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
+					vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+					vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.deferred, 0, 1, &descriptorSet, 0, NULL);
+					vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, clusteredPath ? pipelines.deferredClustered : pipelines.deferred);
+					vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+					vkCmdEndRenderPass(commandBuffer);
+				}
+				vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 2);
+				if (clusteredPath) {
+					VkBufferCopy copyRegion = { 0, 0, sizeof(uint32_t) };
+					vkCmdCopyBuffer(commandBuffer, storageBuffers.lightIndices.buffer, hostBuffer.buffer, 1, &copyRegion);
+				}
+				vulkanDevice->flushCommandBuffer(commandBuffer, queue);
+
+				uint64_t timestamps[3] = { 0, 0, 0 };
+				VK_CHECK_RESULT(vkGetQueryPoolResults(device, queryPool, 0, 3, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+				const double timestampPeriod = vulkanDevice->properties.limits.timestampPeriod / 1000000.0 / iterations;
+				times[clusteredPath][0] = (double)(timestamps[1] - timestamps[0]) * timestampPeriod;
+				times[clusteredPath][1] = (double)(timestamps[2] - timestamps[1]) * timestampPeriod;
+			}
+
+			std::cout << std::setw(6) << count << " lights: naive ";
+			if (count > naiveMaxLights) {
+				std::cout << "skipped";
+			} else {
+				std::cout << times[0][1];
+			}
+			std::cout << ", clustered " << times[1][0] + times[1][1] << " (culling " << times[1][0] << ", composition " << times[1][1] << ")";
+			const uint32_t indexCount = *(uint32_t*)hostBuffer.mapped;
+			std::cout << ", " << (double)std::min(indexCount, (uint32_t)MAX_LIGHT_INDICES) / CLUSTER_COUNT << " lights per cluster";
+			if (indexCount > MAX_LIGHT_INDICES) {
+				std::cout << " (index lists full, " << indexCount - MAX_LIGHT_INDICES << " dropped)";
+			}
+			std::cout << std::endl;
+		}
+
+		hostBuffer.destroy();
+		vkDestroyQueryPool(device, queryPool, nullptr);
+
+		animatedLights.generate(lightCount, (Light*)storageBuffers.lights.mapped);
+		updateUniformBufferDeferredLights();
+	}
+
 	void draw()
 	{
 		VulkanExampleBase::prepareFrame();
@@ -1152,6 +1662,7 @@ public:
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &offScreenCmdBuffer;
 		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+		gpuStats.submitted(offscreenStatsSlot);
 
 		// Scene rendering
 
@@ -1175,12 +1686,16 @@ public:
 		setupVertexDescriptions();
 		prepareOffscreenFramebuffer();
 		prepareUniformBuffers();
+		prepareStorageBuffers();
 		setupDescriptorSetLayout();
 		preparePipelines();
 		setupDescriptorPool();
 		setupDescriptorSet();
+		prepareLightCulling();
+		buildClusterBounds();
 		buildCommandBuffers();
 		buildDeferredCommandBuffer(); 
+		LightingBenchmark();
 		prepared = true;
 	}
 
@@ -1195,6 +1710,11 @@ public:
 	virtual void viewChanged()
 	{
 		updateUniformBufferDeferredMatrices();
+		// The cluster bounds only depend on the projection (e.g. the aspect ratio after a resize)
+		if ((lightCulling.descriptorSet != VK_NULL_HANDLE) && (camera.matrices.perspective != lightCulling.projection)) {
+			VK_CHECK_RESULT(vkQueueWaitIdle(queue));
+			buildClusterBounds();
+		}
 	}
 
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
@@ -1204,6 +1724,15 @@ public:
 				buildCommandBuffers();
 				updateUniformBuffersScreen();
 			}
+			if (overlay->checkBox("Clustered light culling", &clustered)) {
+				VK_CHECK_RESULT(vkQueueWaitIdle(queue));
+				buildDeferredCommandBuffer();
+				buildCommandBuffers();
+			}
+			if (overlay->sliderInt("Lights", &lightCount, 1, MAX_LIGHTS)) {
+				animatedLights.generate(lightCount, (Light*)storageBuffers.lights.mapped);
+				updateUniformBufferDeferredLights();
+			}
 		}
 	}
 };
@@ -12,6 +12,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sstream>
+#include <fstream>
 #include <assert.h>
 #include <vector>
 #include <array>
@@ -25,49 +26,20 @@
 #include "vulkanexamplebase.h"
 #include "VulkanTexture.hpp"
 #include "VulkanBuffer.hpp"
+#include "VulkanFont.hpp"
 
 #define VERTEX_BUFFER_BIND_ID 0
 #define ENABLE_VALIDATION false
 
-// Vertex layout for this example
-struct Vertex {
-	float pos[3];
-	float uv[2];
-};
-
-// AngelCode .fnt format structs and classes
-struct bmchar {
-	uint32_t x, y;
-	uint32_t width;
-	uint32_t height;
-	int32_t xoffset;
-	int32_t yoffset;
-	int32_t xadvance;
-	uint32_t page;
-};
-
-// Quick and dirty : complete ASCII table
-// Only chars present in the .fnt are filled with data!
-std::array<bmchar, 255> fontChars;
-
-int32_t nextValuePair(std::stringstream *stream)
-{
-	std::string pair;
-	*stream >> pair;
-	uint32_t spos = pair.find("=");
-	std::string value = pair.substr(spos + 1);
-	int32_t val = std::stoi(value);
-	return val;
-}
-
 class VulkanExample : public VulkanExampleBase
 {
 public:
 	bool splitScreen = true;
 
+	// Font atlases, one array layer per font
 	struct {
-		vks::Texture2D fontSDF;
-		vks::Texture2D fontBitmap;
+		vks::Texture2DArray fontSDF;
+		vks::Texture2DArray fontBitmap;
 	} textures;
 
 	struct {
@@ -76,9 +48,19 @@ public:
 		std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
 	} vertices;
 
-	vks::Buffer vertexBuffer;
-	vks::Buffer indexBuffer;
-	uint32_t indexCount;
+	vks::Font font;
+	vks::TextBuffer textBuffer;
+	uint32_t titleBlock;
+
+	// Optional large document for testing incremental text updates (-document <glyph count>)
+	// One of its paragraphs changes every frame, so only that paragraph is laid out and written again
+	struct {
+		uint32_t glyphCount = 0;
+		std::vector<uint32_t> blocks;
+		std::vector<std::string> paragraphs;
+		std::vector<glm::vec2> origins;
+		uint32_t frame = 0;
+	} document;
 
 	struct {
 		vks::Buffer vs;
@@ -114,6 +96,11 @@ public:
 		zoom = -2.0f;
 		title = "Distance field font rendering";
 		settings.overlay = true;
+		for (size_t i = 0; i < args.size(); i++) {
+			if ((std::string(args[i]) == "-document") && (i + 1 < args.size())) {
+				document.glyphCount = std::stoi(args[i + 1]);
+			}
+		}
 	}
 
 	~VulkanExample()
@@ -131,74 +118,49 @@ public:
 		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 
-		vertexBuffer.destroy();
-		indexBuffer.destroy();
+		textBuffer.destroy();
 
 		uniformBuffers.vs.destroy();
 		uniformBuffers.fs.destroy();
 	}
 
-	// Basic parser fpr AngelCode bitmap font format files
-	// See http://www.angelcode.com/products/bmfont/doc/file_format.html for details
-	void parsebmFont()
+	// Loads the binary font, which is compiled from the AngelCode .fnt file if it doesn't exist yet
+	// The binary font is memory mapped, so no text parsing is done on later runs
+	void loadFont()
 	{
-		std::string fileName = getAssetPath() + "font.fnt";
-
+		const std::string fntFileName = getAssetPath() + "font.fnt";
+		const std::string fileName = getAssetPath() + "font.vkfont";
 #if defined(__ANDROID__)
-		// Font description file is stored inside the apk
-		// So we need to load it using the asset manager
-		AAsset* asset = AAssetManager_open(androidApp->activity->assetManager, fileName.c_str(), AASSET_MODE_STREAMING);
-		assert(asset);
-		size_t size = AAsset_getLength(asset);
-
-		assert(size > 0);
-
-		void *fileData = malloc(size);
-		AAsset_read(asset, fileData, size);
-		AAsset_close(asset);
-
-		std::stringbuf sbuf((const char*)fileData);
-		std::istream istream(&sbuf);
+		// Use the binary font if it has been packaged, otherwise compile the .fnt file in memory
+		if (!font.loadFromFile(fileName, androidApp->activity->assetManager)) {
+			AAsset* asset = AAssetManager_open(androidApp->activity->assetManager, fntFileName.c_str(), AASSET_MODE_STREAMING);
+			assert(asset);
+			size_t size = AAsset_getLength(asset);
+			assert(size > 0);
+			std::string fnt(size, '\0');
+			AAsset_read(asset, &fnt[0], size);
+			AAsset_close(asset);
+			font.loadFromMemory(vks::Font::compile(fnt));
+		}
 #else
-		std::filebuf fileBuffer;
-		fileBuffer.open(fileName, std::ios::in);
-		std::istream istream(&fileBuffer);
-#endif
-
-		assert(istream.good());
-
-		while (!istream.eof())
-		{
-			std::string line;
-			std::stringstream lineStream;
-			std::getline(istream, line);
-			lineStream << line;
-
-			std::string info;
-			lineStream >> info;
-
-			if (info == "char")
-			{
-				// char id
-				uint32_t charid = nextValuePair(&lineStream);
-				// Char properties
-				fontChars[charid].x = nextValuePair(&lineStream);
-				fontChars[charid].y = nextValuePair(&lineStream);
-				fontChars[charid].width = nextValuePair(&lineStream);
-				fontChars[charid].height = nextValuePair(&lineStream);
-				fontChars[charid].xoffset = nextValuePair(&lineStream);
-				fontChars[charid].yoffset = nextValuePair(&lineStream);
-				fontChars[charid].xadvance = nextValuePair(&lineStream);
-				fontChars[charid].page = nextValuePair(&lineStream);
+		if (!font.loadFromFile(fileName)) {
+			if (!vks::Font::compileFile(fntFileName, fileName) || !font.loadFromFile(fileName)) {
+				// Asset folder may not be writable
+				std::ifstream input(fntFileName, std::ios::in | std::ios::binary);
+				std::stringstream fnt;
+				fnt << input.rdbuf();
+				font.loadFromMemory(vks::Font::compile(fnt.str()));
 			}
 		}
-
+#endif
+		// Atlas layer of this font in the texture arrays, further fonts would be added as additional layers
+		font.layer = 0;
 	}
 
 	void loadAssets()
 	{
-		textures.fontSDF.loadFromFile(getAssetPath() + "textures/font_sdf_rgba.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
-		textures.fontBitmap.loadFromFile(getAssetPath() + "textures/font_bitmap_rgba.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
+		textures.fontSDF.loadFromFiles({ getAssetPath() + "textures/font_sdf_rgba.ktx" }, VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
+		textures.fontBitmap.loadFromFiles({ getAssetPath() + "textures/font_bitmap_rgba.ktx" }, VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
 	}
 
 	void reBuildCommandBuffers()
@@ -242,14 +204,10 @@ public:
 			VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
 			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
 
-			VkDeviceSize offsets[1] = { 0 };
-
 			// Signed distance field font
 			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.sdf, 0, NULL);
 			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.sdf);
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &vertexBuffer.buffer, offsets);
-			vkCmdBindIndexBuffer(drawCmdBuffers[i], indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdDrawIndexed(drawCmdBuffers[i], indexCount, 1, 0, 0, 0);
+			textBuffer.draw(drawCmdBuffers[i]);
 
 			// Linear filtered bitmap font
 			if (splitScreen)
@@ -258,118 +216,103 @@ public:
 				vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
 				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.bitmap, 0, NULL);
 				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.bitmap);
-				vkCmdDrawIndexed(drawCmdBuffers[i], indexCount, 1, 0, 0, 0);
+				textBuffer.draw(drawCmdBuffers[i]);
 			}
 
-			drawUI(drawCmdBuffers[i]);
-
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
 
 			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
 		}
 	}
 
-	// Creates a vertex buffer containing quads for the passed text
-	void generateText(std:: string text)
+	// Sets up the text blocks, all text is stored in a single persistently mapped glyph instance buffer
+	void generateText()
 	{
-		std::vector<Vertex> vertices;
-		std::vector<uint32_t> indices;
-		uint32_t indexOffset = 0;
+		textBuffer.create(vulkanDevice);
 
-		float w = textures.fontSDF.width;
+		vks::TextBuffer::Style style;
+		style.align = vks::TextBuffer::alignCenter;
+		style.centerVertically = true;
+		titleBlock = textBuffer.addBlock();
+		textBuffer.setText(titleBlock, &font, "Vulkan", style);
 
-		float posx = 0.0f;
-		float posy = 0.0f;
-
-		for (uint32_t i = 0; i < text.size(); i++)
-		{
-			bmchar *charInfo = &fontChars[(int)text[i]];
-
-			if (charInfo->width == 0)
-				charInfo->width = 36;
-
-			float charw = ((float)(charInfo->width) / 36.0f);
-			float dimx = 1.0f * charw;
-			float charh = ((float)(charInfo->height) / 36.0f);
-			float dimy = 1.0f * charh;
-			posy = 1.0f - charh;
-
-			float us = charInfo->x / w;
-			float ue = (charInfo->x + charInfo->width) / w;
-			float ts = charInfo->y / w;
-			float te = (charInfo->y + charInfo->height) / w;
-
-			float xo = charInfo->xoffset / 36.0f;
-			float yo = charInfo->yoffset / 36.0f;
+		if (document.glyphCount > 0) {
+			generateDocument();
+		}
 
-			vertices.push_back({ { posx + dimx + xo,  posy + dimy, 0.0f }, { ue, te } });
-			vertices.push_back({ { posx + xo,         posy + dimy, 0.0f }, { us, te } });
-			vertices.push_back({ { posx + xo,         posy,        0.0f }, { us, ts } });
-			vertices.push_back({ { posx + dimx + xo,  posy,        0.0f }, { ue, ts } });
+		textBuffer.update();
+	}
 
-			std::array<uint32_t, 6> letterIndices = { 0,1,2, 2,3,0 };
-			for (auto& index : letterIndices)
-			{
-				indices.push_back(indexOffset + index);
+	// Generates a document of about the requested number of glyphs, split into wrapped paragraphs below the title
+	void generateDocument()
+	{
+		const std::vector<std::string> words = {
+			"Vulkan", "signed", "distance", "field", "font", "glyph", "atlas", "kerning", "layout", "buffer",
+			"instance", "shader", "texture", "array", "line", "wrap", "paragraph", "update", "frame", "render" };
+		const uint32_t glyphsPerParagraph = 2000;
+		const uint32_t paragraphCount = std::max(1u, document.glyphCount / glyphsPerParagraph);
+
+		vks::TextBuffer::Style style;
+		style.size = 0.05f;
+		style.wrapWidth = 6.0f;
+		style.color = glm::vec4(0.8f, 0.8f, 0.8f, 1.0f);
+		// Rough height of a wrapped paragraph for placement
+		const float lineHeight = style.size * (float)font.getHeader().lineHeight / (float)font.getHeader().base;
+
+		uint32_t seed = 1;
+		float y = 1.0f;
+		for (uint32_t p = 0; p < paragraphCount; p++) {
+			std::string text;
+			while (text.size() < glyphsPerParagraph) {
+				seed = seed * 1664525u + 1013904223u;
+				text += words[(seed >> 16) % words.size()] + " ";
 			}
-			indexOffset += 4;
-
-			float advance = ((float)(charInfo->xadvance) / 36.0f);
-			posx += advance;
+			document.paragraphs.push_back(text);
+			style.origin = glm::vec2(-style.wrapWidth / 2.0f, y);
+			document.origins.push_back(style.origin);
+			uint32_t block = textBuffer.addBlock();
+			textBuffer.setText(block, &font, text, style);
+			document.blocks.push_back(block);
+			// Lines are approximated with the average glyph width of this font, roughly half its size
+			y += (ceil((float)text.size() * style.size * 0.55f / style.wrapWidth) + 1.0f) * lineHeight;
 		}
-		indexCount = indices.size();
+	}
 
-		// Center
-		for (auto& v : vertices)
-		{
-			v.pos[0] -= posx / 2.0f;
-			v.pos[1] -= 0.5f;
+	// Changes the first line of one paragraph per frame
+	void updateDocument()
+	{
+		const uint32_t paragraph = document.frame % (uint32_t)document.blocks.size();
+		std::stringstream ss;
+		ss << "Paragraph " << paragraph << " changed in frame " << document.frame << "\n" << document.paragraphs[paragraph];
+
+		vks::TextBuffer::Style style;
+		style.size = 0.05f;
+		style.wrapWidth = 6.0f;
+		style.color = glm::vec4(1.0f, 0.8f, 0.2f, 1.0f);
+		style.origin = document.origins[paragraph];
+		textBuffer.setText(document.blocks[paragraph], &font, ss.str(), style);
+
+		// Restore the previously changed paragraph
+		if (document.frame > 0) {
+			const uint32_t previous = (document.frame - 1) % (uint32_t)document.blocks.size();
+			if (previous != paragraph) {
+				style.color = glm::vec4(0.8f, 0.8f, 0.8f, 1.0f);
+				style.origin = document.origins[previous];
+				textBuffer.setText(document.blocks[previous], &font, document.paragraphs[previous], style);
+			}
 		}
+		document.frame++;
 
-		// Generate host accesible buffers for the text vertices and indices and upload the data
-
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&vertexBuffer,
-			vertices.size() * sizeof(Vertex),
-			vertices.data()));
-
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&indexBuffer,
-			indices.size() * sizeof(uint32_t),
-			indices.data()));
+		if (textBuffer.update()) {
+			buildCommandBuffers();
+		}
 	}
 
 	void setupVertexDescriptions()
 	{
-		// Binding description
-		vertices.bindingDescriptions.resize(1);
-		vertices.bindingDescriptions[0] =
-			vks::initializers::vertexInputBindingDescription(
-				VERTEX_BUFFER_BIND_ID, 
-				sizeof(Vertex), 
-				VK_VERTEX_INPUT_RATE_VERTEX);
-
-		// Attribute descriptions
-		// Describes memory layout and shader positions
-		vertices.attributeDescriptions.resize(2);
-		// Location 0 : Position
-		vertices.attributeDescriptions[0] =
-			vks::initializers::vertexInputAttributeDescription(
-				VERTEX_BUFFER_BIND_ID,
-				0,
-				VK_FORMAT_R32G32B32_SFLOAT,
-				0);			
-		// Location 1 : Texture coordinates
-		vertices.attributeDescriptions[1] =
-			vks::initializers::vertexInputAttributeDescription(
-				VERTEX_BUFFER_BIND_ID,
-				1,
-				VK_FORMAT_R32G32_SFLOAT,
-				sizeof(float) * 3);
+		// Glyphs are instances, the quad corners are derived from the vertex index in the shader
+		vertices.bindingDescriptions = { vks::TextBuffer::vertexInputBinding(VERTEX_BUFFER_BIND_ID) };
+		vertices.attributeDescriptions = vks::TextBuffer::vertexInputAttributes(VERTEX_BUFFER_BIND_ID);
 
 		vertices.inputState = vks::initializers::pipelineVertexInputStateCreateInfo();
 		vertices.inputState.vertexBindingDescriptionCount = vertices.bindingDescriptions.size();
@@ -653,9 +596,9 @@ public:
 	void prepare()
 	{
 		VulkanExampleBase::prepare();
-		parsebmFont();
+		loadFont();
 		loadAssets();
-		generateText("Vulkan");
+		generateText();
 		setupVertexDescriptions();
 		prepareUniformBuffers();
 		setupDescriptorSetLayout();
@@ -670,6 +613,9 @@ public:
 	{
 		if (!prepared)
 			return;
+		if (!document.blocks.empty()) {
+			updateDocument();
+		}
 		draw();
 	}
 
@@ -691,6 +637,11 @@ public:
 				updateUniformBuffers();
 			}
 		}
+		if (overlay->header("Text")) {
+			overlay->text("%d blocks, %d glyphs", textBuffer.stats.blocks, textBuffer.stats.glyphs);
+			overlay->text("Last update: %d glyphs written", textBuffer.stats.writtenGlyphs);
+			overlay->text("Update time: %.3f ms", textBuffer.stats.updateTime);
+		}
 	}
 };
 
@@ -8,12 +8,15 @@
 * Summary:
 * Demonstrates the use of dynamic uniform buffers.
 *
-* Instead of using one uniform buffer per-object, this example allocates one big uniform buffer
-* with respect to the alignment reported by the device via minUniformBufferOffsetAlignment that
-* contains all matrices for the objects in the scene.
+* Instead of using one uniform buffer per-object, this example writes all matrices for the objects in the scene
+* to a vks::UniformRing: one big persistently mapped uniform buffer with a region per frame in flight, in which
+* every allocation is a pointer bump aligned to the minUniformBufferOffsetAlignment reported by the device.
 *
 * The used descriptor type VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC then allows to set a dynamic
 * offset used to pass data from the single uniform buffer to the connected shader binding point.
+* As the offsets change every frame, the command buffer is recorded every frame.
+*
+* Use -objects <count> to render more objects (e.g. -objects 100000).
 */
 
 #include <stdio.h>
@@ -23,6 +26,7 @@
 #include <vector>
 #include <array>
 #include <random>
+#include <chrono>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -33,6 +37,7 @@
 #include "vulkanexamplebase.h"
 #include "VulkanDevice.hpp"
 #include "VulkanBuffer.hpp"
+#include "VulkanUniformRing.hpp"
 
 #define VERTEX_BUFFER_BIND_ID 0
 #define ENABLE_VALIDATION false
@@ -44,30 +49,6 @@ struct Vertex {
 	float color[3];
 };
 
-// Wrapper functions for aligned memory allocation
-// There is currently no standard for this in C++ that works across all platforms and vendors, so we abstract this
-void* alignedAlloc(size_t size, size_t alignment)
-{
-	void *data = nullptr;
-#if defined(_MSC_VER) || defined(__MINGW32__)
-	data = _aligned_malloc(size, alignment);
-#else 
-	int res = posix_memalign(&data, alignment, size);
-	if (res != 0)
-		data = nullptr;
-#endif
-	return data;
-}
-
-void alignedFree(void* data)
-{
-#if	defined(_MSC_VER) || defined(__MINGW32__)
-	_aligned_free(data);
-#else 
-	free(data);
-#endif
-}
-
 class VulkanExample : public VulkanExampleBase
 {
 public:
@@ -81,51 +62,48 @@ public:
 	vks::Buffer indexBuffer;
 	uint32_t indexCount;
 
-	struct {
-		vks::Buffer view;
-		vks::Buffer dynamic;
-	} uniformBuffers;
+	// Per-frame regions for the view and all model matrices, bound with dynamic offsets
+	vks::UniformRing uniformRing;
 
-	struct {
+	struct UboView {
 		glm::mat4 projection;
 		glm::mat4 view;
 	} uboVS;
 
-	// Store random per-object rotations
-	glm::vec3 rotations[OBJECT_INSTANCES];
-	glm::vec3 rotationSpeeds[OBJECT_INSTANCES];
+	uint32_t objectCount = OBJECT_INSTANCES;
 
-	// One big uniform buffer that contains all matrices
-	// Note that we need to manually allocate the data to cope for GPU-specific uniform buffer offset alignments
-	struct UboDataDynamic {
-		glm::mat4 *model = nullptr;
-	} uboDataDynamic;
+	// Store per-object positions and random rotations
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> rotations;
+	std::vector<glm::vec3> rotationSpeeds;
 
 	VkPipeline pipeline;
 	VkPipelineLayout pipelineLayout;
 	VkDescriptorSet descriptorSet;
 	VkDescriptorSetLayout descriptorSetLayout;
 
-	float animationTimer = 0.0f;
-
-	size_t dynamicAlignment;
+	// CPU time for writing the matrices and recording the command buffer
+	float recordTime = 0.0f;
 
 	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
 	{
 		title = "Dynamic uniform buffers";
+		for (size_t i = 0; i < args.size(); i++) {
+			if ((std::string(args[i]) == "-objects") && (i + 1 < args.size())) {
+				objectCount = std::max(static_cast<uint32_t>(atoi(args[i + 1])), 1u);
+			}
+		}
+		// Objects are placed on a grid, move the camera back to keep them in view
+		const float dim = ceilf(powf((float)objectCount, 1.0f / 3.0f));
 		camera.type = Camera::CameraType::lookat;
-		camera.setPosition(glm::vec3(0.0f, 0.0f, -30.0f));
+		camera.setPosition(glm::vec3(0.0f, 0.0f, -6.0f * dim));
 		camera.setRotation(glm::vec3(0.0f));
-		camera.setPerspective(60.0f, (float)width / (float)height, 0.1f, 256.0f);
+		camera.setPerspective(60.0f, (float)width / (float)height, 0.1f, std::max(256.0f, 20.0f * dim));
 		settings.overlay = true;
 	}
 
 	~VulkanExample()
 	{
-		if (uboDataDynamic.model) {
-			alignedFree(uboDataDynamic.model);
-		}
-
 		// Clean up used Vulkan resources 
 		// Note : Inherited destructor cleans up resources stored in base class
 		vkDestroyPipeline(device, pipeline, nullptr);
@@ -136,12 +114,14 @@ public:
 		vertexBuffer.destroy();
 		indexBuffer.destroy();
 
-		uniformBuffers.view.destroy();
-		uniformBuffers.dynamic.destroy();
+		uniformRing.destroy();
 	}
 
-	void buildCommandBuffers()
+	// Writes this frame's uniform data to the ring and records the command buffer binding it
+	void buildCommandBuffer(uint32_t index)
 	{
+		auto tStart = std::chrono::high_resolution_clock::now();
+
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
 		VkClearValue clearValues[2];
@@ -157,55 +137,74 @@ public:
 		renderPassBeginInfo.clearValueCount = 2;
 		renderPassBeginInfo.pClearValues = clearValues;
 
-		for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
-		{
-			renderPassBeginInfo.framebuffer = frameBuffers[i];
+		renderPassBeginInfo.framebuffer = frameBuffers[index];
 
-			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
+		VkCommandBuffer commandBuffer = drawCmdBuffers[index];
+		VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufInfo));
 
-			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-			VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
-			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
+		VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
-			VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
-			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+		VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 
-			VkDeviceSize offsets[1] = { 0 };
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &vertexBuffer.buffer, offsets);
-			vkCmdBindIndexBuffer(drawCmdBuffers[i], indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+		VkDeviceSize offsets[1] = { 0 };
+		vkCmdBindVertexBuffers(commandBuffer, VERTEX_BUFFER_BIND_ID, 1, &vertexBuffer.buffer, offsets);
+		vkCmdBindIndexBuffer(commandBuffer, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
 
-			// Render multiple objects using different model matrices by dynamically offsetting into one uniform buffer
-			for (uint32_t j = 0; j < OBJECT_INSTANCES; j++)
-			{
-				// One dynamic offset per dynamic descriptor to offset into the ubo containing all model matrices
-				uint32_t dynamicOffset = j * static_cast<uint32_t>(dynamicAlignment);
-				// Bind the descriptor set for rendering a mesh using the dynamic offset
-				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 1, &dynamicOffset);
+		// One dynamic offset per dynamic descriptor (in binding order): the view matrices shared by all objects and the object's model matrix
+		std::array<uint32_t, 2> dynamicOffsets;
+		dynamicOffsets[0] = uniformRing.push(uboVS);
 
-				vkCmdDrawIndexed(drawCmdBuffers[i], indexCount, 1, 0, 0, 0);
-			}
+		// Render multiple objects using different model matrices by dynamically offsetting into one uniform buffer
+		const float animationStep = paused ? 0.0f : frameTimer;
+		for (uint32_t j = 0; j < objectCount; j++)
+		{
+			// Update rotations
+			rotations[j] += animationStep * rotationSpeeds[j];
+
+			glm::mat4 modelMat = glm::translate(glm::mat4(1.0f), positions[j]);
+			modelMat = glm::rotate(modelMat, rotations[j].x, glm::vec3(1.0f, 1.0f, 0.0f));
+			modelMat = glm::rotate(modelMat, rotations[j].y, glm::vec3(0.0f, 1.0f, 0.0f));
+			modelMat = glm::rotate(modelMat, rotations[j].z, glm::vec3(0.0f, 0.0f, 1.0f));
 
-			drawUI(drawCmdBuffers[i]);
+			// Allocating the matrix is a pointer bump, it's written straight to the mapped buffer
+			vks::UniformRing::Allocation allocation = uniformRing.allocate(sizeof(glm::mat4));
+			memcpy(allocation.data, &modelMat, sizeof(glm::mat4));
+			dynamicOffsets[1] = allocation.offset;
 
-			vkCmdEndRenderPass(drawCmdBuffers[i]);
+			// Bind the descriptor set for rendering a mesh using the dynamic offsets
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data());
 
-			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
+			vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, 0);
 		}
+
+		vkCmdEndRenderPass(commandBuffer);
+
+		VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+
+		float tDiff = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+		recordTime = recordTime * 0.9f + tDiff * 0.1f;
 	}
 
 	void draw()
 	{
 		VulkanExampleBase::prepareFrame();
 
+		// Waits for the frame that used this frame's ring region before, then records with the new offsets
+		uniformRing.beginFrame();
+		buildCommandBuffer(currentBuffer);
+
 		// Command buffer to be sumitted to the queue
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
 
-		// Submit to queue
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+		// Submit to queue, the fence releases the ring region once the frame is done
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, uniformRing.getFence()));
 
 		VulkanExampleBase::submitFrame();
 	}
@@ -273,8 +272,7 @@ public:
 		// Example uses one ubo and one image sampler
 		std::vector<VkDescriptorPoolSize> poolSizes =
 		{
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 2),
 			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1)
 		};
 
@@ -291,7 +289,7 @@ public:
 	{
 		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings =
 		{
-			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0),
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT, 0),
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT, 1),
 			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 2)
 		};
@@ -321,11 +319,14 @@ public:
 
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet));
 
+		// Both bindings point to the uniform ring, the dynamic offsets select the data
+		VkDescriptorBufferInfo viewDescriptor = uniformRing.getDescriptor(sizeof(UboView));
+		VkDescriptorBufferInfo modelDescriptor = uniformRing.getDescriptor(sizeof(glm::mat4));
 		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
-			// Binding 0 : Projection/View matrix uniform buffer			
-			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.view.descriptor),
+			// Binding 0 : Projection/View matrix as dynamic uniform buffer
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 0, &viewDescriptor),
 			// Binding 1 : Instance matrix as dynamic uniform buffer
-			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, &uniformBuffers.dynamic.descriptor),
+			vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, &modelDescriptor),
 		};
 
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
@@ -406,112 +407,45 @@ public:
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipeline));
 	}
 
-	// Prepare and initialize uniform buffer containing shader uniforms
+	// Prepare the uniform ring containing shader uniforms
 	void prepareUniformBuffers()
 	{
-		// Allocate data for the dynamic uniform buffer object
-		// We allocate this manually as the alignment of the offset differs between GPUs
-
-		// Calculate required alignment based on minimum device offset alignment
-		size_t minUboAlignment = vulkanDevice->properties.limits.minUniformBufferOffsetAlignment;
-		dynamicAlignment = sizeof(glm::mat4);
-		if (minUboAlignment > 0) {
-			dynamicAlignment = (dynamicAlignment + minUboAlignment - 1) & ~(minUboAlignment - 1);
-		}
-
-		size_t bufferSize = OBJECT_INSTANCES * dynamicAlignment;
-
-		uboDataDynamic.model = (glm::mat4*)alignedAlloc(bufferSize, dynamicAlignment);
-		assert(uboDataDynamic.model);
+		// All allocations are aligned to the minimum device offset alignment by the ring
+		const VkDeviceSize minUboAlignment = vulkanDevice->properties.limits.minUniformBufferOffsetAlignment;
+		const VkDeviceSize frameSize = vks::UniformRing::alignUp(sizeof(UboView), minUboAlignment) + objectCount * vks::UniformRing::alignUp(sizeof(glm::mat4), minUboAlignment);
+		// One region per command buffer that may be in flight
+		uniformRing.create(vulkanDevice, frameSize, static_cast<uint32_t>(drawCmdBuffers.size()));
 
 		std::cout << "minUniformBufferOffsetAlignment = " << minUboAlignment << std::endl;
-		std::cout << "dynamicAlignment = " << dynamicAlignment << std::endl;
-
-		// Vertex shader uniform buffer block
-
-		// Static shared uniform buffer object with projection and view matrix
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&uniformBuffers.view,
-			sizeof(uboVS)));
-
-		// Uniform buffer object with per-object matrices
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-			&uniformBuffers.dynamic,
-			bufferSize));
-
-		// Map persistent
-		VK_CHECK_RESULT(uniformBuffers.view.map());
-		VK_CHECK_RESULT(uniformBuffers.dynamic.map());
-
-		// Prepare per-object matrices with offsets and random rotations
+		std::cout << "Uniform ring: " << uniformRing.frameCount << " frames of " << uniformRing.frameSize << " bytes" << std::endl;
+
+		// Prepare per-object positions on a grid and random rotations
+		positions.resize(objectCount);
+		rotations.resize(objectCount);
+		rotationSpeeds.resize(objectCount);
+		const uint32_t dim = static_cast<uint32_t>(ceilf(powf((float)objectCount, 1.0f / 3.0f)));
+		const glm::vec3 offset(5.0f);
+		for (uint32_t index = 0; index < objectCount; index++) {
+			const uint32_t x = index / (dim * dim);
+			const uint32_t y = (index / dim) % dim;
+			const uint32_t z = index % dim;
+			positions[index] = glm::vec3(-((dim * offset.x) / 2.0f) + offset.x / 2.0f + x * offset.x, -((dim * offset.y) / 2.0f) + offset.y / 2.0f + y * offset.y, -((dim * offset.z) / 2.0f) + offset.z / 2.0f + z * offset.z);
+		}
 		std::default_random_engine rndEngine(benchmark.active ? 0 : (unsigned)time(nullptr));
 		std::normal_distribution<float> rndDist(-1.0f, 1.0f);
-		for (uint32_t i = 0; i < OBJECT_INSTANCES; i++) {
+		for (uint32_t i = 0; i < objectCount; i++) {
 			rotations[i] = glm::vec3(rndDist(rndEngine), rndDist(rndEngine), rndDist(rndEngine)) * 2.0f * (float)M_PI;
 			rotationSpeeds[i] = glm::vec3(rndDist(rndEngine), rndDist(rndEngine), rndDist(rndEngine));
 		}
 
 		updateUniformBuffers();
-		updateDynamicUniformBuffer(true);
 	}
 
 	void updateUniformBuffers()
 	{
-		// Fixed ubo with projection and view matrices
+		// Projection and view matrices, pushed to the ring with every frame
 		uboVS.projection = camera.matrices.perspective;
 		uboVS.view = camera.matrices.view;
-
-		memcpy(uniformBuffers.view.mapped, &uboVS, sizeof(uboVS));
-	}
-
-	void updateDynamicUniformBuffer(bool force = false)
-	{
-		// Update at max. 60 fps
-		animationTimer += frameTimer;
-		if ((animationTimer <= 1.0f / 60.0f) && (!force)) {
-			return;
-		}
-
-		// Dynamic ubo with per-object model matrices indexed by offsets in the command buffer
-		uint32_t dim = static_cast<uint32_t>(pow(OBJECT_INSTANCES, (1.0f / 3.0f)));
-		glm::vec3 offset(5.0f);
-
-		for (uint32_t x = 0; x < dim; x++)
-		{
-			for (uint32_t y = 0; y < dim; y++)
-			{
-				for (uint32_t z = 0; z < dim; z++)
-				{
-					uint32_t index = x * dim * dim + y * dim + z;
-
-					// Aligned offset
-					glm::mat4* modelMat = (glm::mat4*)(((uint64_t)uboDataDynamic.model + (index * dynamicAlignment)));
-
-					// Update rotations
-					rotations[index] += animationTimer * rotationSpeeds[index];
-
-					// Update matrices
-					glm::vec3 pos = glm::vec3(-((dim * offset.x) / 2.0f) + offset.x / 2.0f + x * offset.x, -((dim * offset.y) / 2.0f) + offset.y / 2.0f + y * offset.y, -((dim * offset.z) / 2.0f) + offset.z / 2.0f + z * offset.z);
-					*modelMat = glm::translate(glm::mat4(1.0f), pos);
-					*modelMat = glm::rotate(*modelMat, rotations[index].x, glm::vec3(1.0f, 1.0f, 0.0f));
-					*modelMat = glm::rotate(*modelMat, rotations[index].y, glm::vec3(0.0f, 1.0f, 0.0f));
-					*modelMat = glm::rotate(*modelMat, rotations[index].z, glm::vec3(0.0f, 0.0f, 1.0f));
-				}
-			}
-		}
-
-		animationTimer = 0.0f;
-
-		memcpy(uniformBuffers.dynamic.mapped, uboDataDynamic.model, uniformBuffers.dynamic.size);
-		// Flush to make changes visible to the host 
-		VkMappedMemoryRange memoryRange = vks::initializers::mappedMemoryRange();
-		memoryRange.memory = uniformBuffers.dynamic.memory;
-		memoryRange.size = uniformBuffers.dynamic.size;
-		vkFlushMappedMemoryRanges(device, 1, &memoryRange);
 	}
 
 	void prepare()
@@ -524,7 +458,6 @@ public:
 		preparePipelines();
 		setupDescriptorPool();
 		setupDescriptorSet();
-		buildCommandBuffers();
 		prepared = true;
 	}
 
@@ -533,14 +466,21 @@ public:
 		if (!prepared)
 			return;
 		draw();
-		if (!paused)
-			updateDynamicUniformBuffer();
 	}
 
 	virtual void viewChanged()
 	{
 		updateUniformBuffers();
 	}
+
+	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
+	{
+		if (overlay->header("Statistics")) {
+			overlay->text("Objects: %d", objectCount);
+			overlay->text("Uniform data: %.2f MB per frame", (float)uniformRing.getUsedSize() / (1024.0f * 1024.0f));
+			overlay->text("Update and record: %.2f ms", recordTime);
+		}
+	}
 };
 
 VULKAN_EXAMPLE_MAIN()
@@ -26,6 +26,7 @@
 #include <time.h> 
 #include <vector>
 #include <random>
+#include <string>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -37,6 +38,7 @@
 #include "VulkanBuffer.hpp"
 #include "VulkanTexture.hpp"
 #include "VulkanModel.hpp"
+#include "VulkanGpuCulling.hpp"
 
 #define VERTEX_BUFFER_BIND_ID 0
 #define INSTANCE_BUFFER_BIND_ID 1
@@ -121,6 +123,14 @@ public:
 	// Store the indirect draw commands containing index offsets and instance count per object
 	std::vector<VkDrawIndexedIndirectCommand> indirectCommands;
 
+	// Frustum culls the plants on the GPU and writes the indirect draw commands for the visible ones, created on first use (disabled with "-nogpuculling" or in the UI)
+	vks::GpuCulling gpuCulling;
+	bool gpuCullingEnabled = true;
+	bool cullingBenchmark = false;
+	// Bounding spheres and mesh (plant type) of every instance, kept for creating the GPU culling later on
+	std::vector<vks::GpuCulling::InstanceBounds> instanceBounds;
+	std::vector<uint32_t> instanceMeshIndices;
+
 	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
 	{
 		title = "Indirect rendering";
@@ -130,6 +140,15 @@ public:
 		camera.setTranslation(glm::vec3(0.4f, 1.25f, 0.0f));
 		camera.movementSpeed = 5.0f;
 		settings.overlay = true;
+		for (auto arg : args) {
+			if (std::string(arg) == "-nogpuculling") {
+				gpuCullingEnabled = false;
+			}
+			if (std::string(arg) == "-cullingbenchmark") {
+				cullingBenchmark = true;
+			}
+		}
+		gpuCulling.parseCommandLine(args);
 	}
 
 	~VulkanExample()
@@ -147,6 +166,7 @@ public:
 		instanceBuffer.destroy();
 		indirectCommandsBuffer.destroy();
 		uniformData.scene.destroy();
+		gpuCulling.destroy();
 	}
 
 	// Enable physical device features required for this example				
@@ -170,6 +190,10 @@ public:
 		else if (deviceFeatures.textureCompressionETC2) {
 			enabledFeatures.textureCompressionETC2 = VK_TRUE;
 		}
+		// Per draw first instances and multi draw for the culled draws if supported
+		vks::GpuCulling::enableFeatures(deviceFeatures, enabledFeatures);
+		// The number of indirect draws is read from a buffer written by the culling if supported
+		gpuCulling.requestDrawIndirectCount(physicalDevice, enabledDeviceExtensions);
 	};
 
 	void buildCommandBuffers()
@@ -194,6 +218,10 @@ public:
 
 			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
+			if (gpuCullingEnabled) {
+				gpuCulling.recordCulling(drawCmdBuffers[i]);
+			}
+
 			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 			VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
@@ -209,15 +237,20 @@ public:
 			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.plants);
 			// Binding point 0 : Mesh vertex buffer
 			vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &models.plants.vertices.buffer, offsets);
-			// Binding point 1 : Instance data buffer
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], INSTANCE_BUFFER_BIND_ID, 1, &instanceBuffer.buffer, offsets);
+			// Binding point 1 : Instance data buffer (only the visible instances with GPU culling)
+			vkCmdBindVertexBuffers(drawCmdBuffers[i], INSTANCE_BUFFER_BIND_ID, 1, gpuCullingEnabled ? &gpuCulling.culledInstanceBuffer.buffer : &instanceBuffer.buffer, offsets);
 			
 			vkCmdBindIndexBuffer(drawCmdBuffers[i], models.plants.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
 
+			if (gpuCullingEnabled)
+			{
+				// Draws the commands written by the culling, the number of draws is taken from the GPU if supported
+				gpuCulling.cmdDraw(drawCmdBuffers[i], INSTANCE_BUFFER_BIND_ID);
+			}
 			// If the multi draw feature is supported:
 			// One draw call for an arbitrary number of ojects
 			// Index offsets and instance count are taken from the indirect buffer
-			if (vulkanDevice->features.multiDrawIndirect)
+			else if (vulkanDevice->features.multiDrawIndirect)
 			{
 				vkCmdDrawIndexedIndirect(drawCmdBuffers[i], indirectCommandsBuffer.buffer, 0, indirectDrawCount, sizeof(VkDrawIndexedIndirectCommand));
 			}
@@ -241,8 +274,6 @@ public:
 			vkCmdBindIndexBuffer(drawCmdBuffers[i], models.skysphere.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
 			vkCmdDrawIndexed(drawCmdBuffers[i], models.skysphere.indexCount, 1, 0, 0, 0);
 
-			drawUI(drawCmdBuffers[i]);
-
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
 
 			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
@@ -617,7 +648,7 @@ public:
 			instanceData.data()));
 
 		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 			&instanceBuffer,
 			stagingBuffer.size));
@@ -625,6 +656,38 @@ public:
 		vulkanDevice->copyBuffer(&stagingBuffer, &instanceBuffer, queue);
 
 		stagingBuffer.destroy();
+
+		// Bounding spheres for the GPU culling
+		const glm::vec3 plantExtent = glm::max(glm::abs(models.plants.dim.min), glm::abs(models.plants.dim.max));
+		const float plantRadius = glm::length(plantExtent) * 0.0025f;
+		instanceBounds.resize(objectCount);
+		instanceMeshIndices.resize(objectCount);
+		for (uint32_t i = 0; i < objectCount; i++) {
+			// indirectdraw.vert multiplies the instance position with the rotation from the left, which rotates in the direction of glm::rotate
+			glm::mat4 rotation = glm::rotate(glm::mat4(1.0f), instanceData[i].rot.y, glm::vec3(0.0f, 1.0f, 0.0f));
+			instanceBounds[i].center = glm::vec3(rotation * glm::vec4(instanceData[i].pos, 1.0f));
+			instanceBounds[i].radius = plantRadius * instanceData[i].scale;
+			instanceMeshIndices[i] = i / OBJECT_INSTANCE_COUNT;
+		}
+	}
+
+	// Create the GPU culling with one draw per plant mesh on first use
+	void prepareGpuCulling()
+	{
+		if (gpuCulling.pipeline != VK_NULL_HANDLE) {
+			return;
+		}
+
+		// The plants have no LODs, every mesh has a single LOD that is drawn at all distances
+		std::vector<vks::GpuCulling::Mesh> meshes;
+		std::vector<vks::GpuCulling::Lod> lods;
+		for (auto& indirectCmd : indirectCommands) {
+			meshes.push_back({ static_cast<uint32_t>(lods.size()), 1 });
+			lods.push_back({ indirectCmd.firstIndex, indirectCmd.indexCount, 0, 0.0f });
+		}
+
+		gpuCulling.prepare(vulkanDevice, pipelineCache, loadShader(getAssetPath() + "shaders/base/gpuculling.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT));
+		gpuCulling.setInstances(queue, instanceBounds, instanceMeshIndices, meshes, lods, &instanceBuffer.descriptor, sizeof(InstanceData));
 	}
 
 	void prepareUniformBuffers()
@@ -646,6 +709,7 @@ public:
 		{
 			uboVS.projection = camera.matrices.perspective;
 			uboVS.view = camera.matrices.view;
+			gpuCulling.updateView(uboVS.projection * uboVS.view, glm::vec3(glm::inverse(uboVS.view)[3]));
 		}
 
 		memcpy(uniformData.scene.mapped, &uboVS, sizeof(uboVS));
@@ -677,7 +741,13 @@ public:
 		preparePipelines();
 		setupDescriptorPool();
 		setupDescriptorSet();
+		if (gpuCullingEnabled || cullingBenchmark) {
+			prepareGpuCulling();
+		}
 		buildCommandBuffers();
+		if (cullingBenchmark) {
+			gpuCulling.benchmark(queue);
+		}
 		prepared = true;
 	}
 
@@ -702,8 +772,21 @@ public:
 				overlay->text("multiDrawIndirect not supported");
 			}
 		}
+		if (overlay->header("Settings")) {
+			if (overlay->checkBox("GPU culling", &gpuCullingEnabled)) {
+				if (gpuCullingEnabled) {
+					prepareGpuCulling();
+				}
+				buildCommandBuffers();
+			}
+		}
 		if (overlay->header("Statistics")) {
 			overlay->text("Objects: %d", objectCount);
+			if (gpuCullingEnabled) {
+				vks::GpuCulling::Statistics statistics = gpuCulling.getStatistics();
+				overlay->text("Visible: %d", statistics.visibleCount);
+				overlay->text("Draws: %d", statistics.drawCount);
+			}
 		}
 	}
 };
@@ -13,6 +13,7 @@
 #include <time.h> 
 #include <vector>
 #include <random>
+#include <string>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -24,6 +25,7 @@
 #include "VulkanBuffer.hpp"
 #include "VulkanTexture.hpp"
 #include "VulkanModel.hpp"
+#include "VulkanGpuCulling.hpp"
 
 #define VERTEX_BUFFER_BIND_ID 0
 #define INSTANCE_BUFFER_BIND_ID 1
@@ -95,6 +97,16 @@ public:
 		VkDescriptorSet planet;
 	} descriptorSets;
 
+	// Number of rocks, can be changed with -instances (e.g. 1000000)
+	uint32_t instanceCount = INSTANCE_COUNT;
+
+	// Frustum culls the rocks on the GPU and draws only the visible ones, created on first use (disabled with "-nogpuculling" or in the UI)
+	vks::GpuCulling gpuCulling;
+	bool gpuCullingEnabled = true;
+	bool cullingBenchmark = false;
+	// Bounding spheres of the rocks, kept for creating the GPU culling later on
+	std::vector<vks::GpuCulling::InstanceBounds> instanceBounds;
+
 	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
 	{
 		title = "Instanced mesh rendering";
@@ -103,6 +115,19 @@ public:
 		cameraPos = { 5.5f, -1.85f, 0.0f };
 		rotationSpeed = 0.25f;
 		settings.overlay = true;
+		for (size_t i = 0; i < args.size(); i++) {
+			if ((std::string(args[i]) == "-instances") && (i + 1 < args.size())) {
+				// Rocks are distributed in pairs over the two rings
+				instanceCount = std::max(std::stoi(args[i + 1]), 2) & ~1;
+			}
+			if (std::string(args[i]) == "-nogpuculling") {
+				gpuCullingEnabled = false;
+			}
+			if (std::string(args[i]) == "-cullingbenchmark") {
+				cullingBenchmark = true;
+			}
+		}
+		gpuCulling.parseCommandLine(args);
 	}
 
 	~VulkanExample()
@@ -119,6 +144,7 @@ public:
 		textures.rocks.destroy();
 		textures.planet.destroy();
 		uniformBuffers.scene.destroy();
+		gpuCulling.destroy();
 	}
 
 	// Enable physical device features required for this example				
@@ -138,6 +164,10 @@ public:
 		else if (deviceFeatures.textureCompressionETC2) {
 			enabledFeatures.textureCompressionETC2 = VK_TRUE;
 		}
+		// Per draw first instances and multi draw for the culled draws if supported
+		vks::GpuCulling::enableFeatures(deviceFeatures, enabledFeatures);
+		// The number of indirect draws is read from a buffer written by the culling if supported
+		gpuCulling.requestDrawIndirectCount(physicalDevice, enabledDeviceExtensions);
 	};	
 
 	void buildCommandBuffers()
@@ -162,6 +192,10 @@ public:
 
 			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
+			if (gpuCullingEnabled) {
+				gpuCulling.recordCulling(drawCmdBuffers[i]);
+			}
+
 			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 			VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
@@ -189,15 +223,18 @@ public:
 			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.instancedRocks);
 			// Binding point 0 : Mesh vertex buffer
 			vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &models.rock.vertices.buffer, offsets);
-			// Binding point 1 : Instance data buffer
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], INSTANCE_BUFFER_BIND_ID, 1, &instanceBuffer.buffer, offsets);
+			// Binding point 1 : Instance data buffer (only the visible instances with GPU culling)
+			vkCmdBindVertexBuffers(drawCmdBuffers[i], INSTANCE_BUFFER_BIND_ID, 1, gpuCullingEnabled ? &gpuCulling.culledInstanceBuffer.buffer : &instanceBuffer.buffer, offsets);
 
 			vkCmdBindIndexBuffer(drawCmdBuffers[i], models.rock.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
 
 			// Render instances
-			vkCmdDrawIndexed(drawCmdBuffers[i], models.rock.indexCount, INSTANCE_COUNT, 0, 0, 0);
-
-			drawUI(drawCmdBuffers[i]);
+			if (gpuCullingEnabled) {
+				// Instance count and offset are taken from the indirect command written by the culling
+				gpuCulling.cmdDraw(drawCmdBuffers[i], INSTANCE_BUFFER_BIND_ID);
+			} else {
+				vkCmdDrawIndexed(drawCmdBuffers[i], models.rock.indexCount, instanceCount, 0, 0, 0);
+			}
 
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
 
@@ -445,14 +482,14 @@ public:
 	void prepareInstanceData()
 	{
 		std::vector<InstanceData> instanceData;
-		instanceData.resize(INSTANCE_COUNT);
+		instanceData.resize(instanceCount);
 
 		std::default_random_engine rndGenerator(benchmark.active ? 0 : (unsigned)time(nullptr));
 		std::uniform_real_distribution<float> uniformDist(0.0, 1.0);
 		std::uniform_int_distribution<uint32_t> rndTextureIndex(0, textures.rocks.layerCount);
 
 		// Distribute rocks randomly on two different rings
-		for (auto i = 0; i < INSTANCE_COUNT / 2; i++) {		
+		for (uint32_t i = 0; i < instanceCount / 2; i++) {		
 			glm::vec2 ring0 { 7.0f, 11.0f };
 			glm::vec2 ring1 { 14.0f, 18.0f };
 
@@ -479,6 +516,17 @@ public:
 
 		instanceBuffer.size = instanceData.size() * sizeof(InstanceData);
 
+		// Bounding spheres for the GPU culling
+		// The rotation around the y axis by instanceRot.y in instancing.vert is static and baked into the centers, the animated part is applied in updateUniformBuffer
+		const glm::vec3 rockExtent = glm::max(glm::abs(models.rock.dim.min), glm::abs(models.rock.dim.max));
+		const float rockRadius = glm::length(rockExtent) * 0.1f;
+		instanceBounds.resize(instanceCount);
+		for (uint32_t i = 0; i < instanceCount; i++) {
+			glm::mat4 rotation = glm::rotate(glm::mat4(1.0f), -instanceData[i].rot.y, glm::vec3(0.0f, 1.0f, 0.0f));
+			instanceBounds[i].center = glm::vec3(rotation * glm::vec4(instanceData[i].pos, 1.0f));
+			instanceBounds[i].radius = rockRadius * instanceData[i].scale;
+		}
+
 		// Staging
 		// Instanced data is static, copy to device local memory 
 		// This results in better performance
@@ -497,7 +545,7 @@ public:
 			instanceData.data()));
 
 		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 			instanceBuffer.size,
 			&instanceBuffer.buffer,
@@ -526,6 +574,20 @@ public:
 		vkFreeMemory(device, stagingBuffer.memory, nullptr);
 	}
 
+	// Create the GPU culling on first use
+	void prepareGpuCulling()
+	{
+		if (gpuCulling.pipeline != VK_NULL_HANDLE) {
+			return;
+		}
+		// All rocks use the same mesh with a single LOD, so there is only one indirect draw
+		std::vector<uint32_t> meshIndices(instanceCount, 0);
+		std::vector<vks::GpuCulling::Mesh> meshes = { { 0, 1 } };
+		std::vector<vks::GpuCulling::Lod> lods = { { 0, models.rock.indexCount, 0, 0.0f } };
+		gpuCulling.prepare(vulkanDevice, pipelineCache, loadShader(getAssetPath() + "shaders/base/gpuculling.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT));
+		gpuCulling.setInstances(queue, instanceBounds, meshIndices, meshes, lods, &instanceBuffer.descriptor, sizeof(InstanceData));
+	}
+
 	void prepareUniformBuffers()
 	{
 		VK_CHECK_RESULT(vulkanDevice->createBuffer(
@@ -558,6 +620,10 @@ public:
 		}
 
 		memcpy(uniformBuffers.scene.mapped, &uboVS, sizeof(uboVS));
+
+		// Animated part of the rotation around the y axis in instancing.vert (the shader's matrix rotates in the opposite direction of glm::rotate)
+		glm::mat4 model = glm::rotate(glm::mat4(1.0f), -uboVS.globSpeed, glm::vec3(0.0f, 1.0f, 0.0f));
+		gpuCulling.updateView(uboVS.projection * uboVS.view, glm::vec3(glm::inverse(uboVS.view)[3]), model);
 	}
 
 	void draw()
@@ -584,7 +650,13 @@ public:
 		preparePipelines();
 		setupDescriptorPool();
 		setupDescriptorSet();
+		if (gpuCullingEnabled || cullingBenchmark) {
+			prepareGpuCulling();
+		}
 		buildCommandBuffers();
+		if (cullingBenchmark) {
+			gpuCulling.benchmark(queue);
+		}
 		prepared = true;
 	}
 
@@ -608,8 +680,20 @@ public:
 
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
 	{
+		if (overlay->header("Settings")) {
+			if (overlay->checkBox("GPU culling", &gpuCullingEnabled)) {
+				if (gpuCullingEnabled) {
+					prepareGpuCulling();
+				}
+				buildCommandBuffers();
+			}
+		}
 		if (overlay->header("Statistics")) {
-			overlay->text("Instances: %d", INSTANCE_COUNT);
+			overlay->text("Instances: %d", instanceCount);
+			if (gpuCullingEnabled) {
+				overlay->text("Visible: %d", gpuCulling.getStatistics().visibleCount);
+				overlay->text(gpuCulling.usesDrawIndirectCount() ? "Draw count from GPU" : "Instance count from GPU");
+			}
 		}
 	}
 };
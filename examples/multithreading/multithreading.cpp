@@ -61,10 +61,9 @@ public:
 
 	VkCommandBuffer primaryCommandBuffer;
 	
-	// Secondary scene command buffers used to store backgdrop and user interface
+	// Secondary scene command buffer used to store the backdrop
 	struct SecondaryCommandBuffers {
 		VkCommandBuffer background;
-		VkCommandBuffer ui;
 	} secondaryCommandBuffers;
 
 	// Number of animated objects to be renderer
@@ -180,10 +179,9 @@ public:
 				1);
 		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &primaryCommandBuffer));
 
-		// Create additional secondary CBs for background and ui
+		// Create additional secondary CB for the background
 		cmdBufAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
 		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &secondaryCommandBuffers.background));
-		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &secondaryCommandBuffers.ui));
 
 		threadData.resize(numThreads);
 
@@ -340,26 +338,6 @@ public:
 		vkCmdDrawIndexed(secondaryCommandBuffers.background, models.skysphere.indexCount, 1, 0, 0, 0);
 
 		VK_CHECK_RESULT(vkEndCommandBuffer(secondaryCommandBuffers.background));
-
-		/*
-			User interface
-
-			With VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS, the primary command buffer's content has to be defined
-			by secondary command buffers, which also applies to the UI overlay command buffer
-		*/
-
-		VK_CHECK_RESULT(vkBeginCommandBuffer(secondaryCommandBuffers.ui, &commandBufferBeginInfo));
-
-		vkCmdSetViewport(secondaryCommandBuffers.ui, 0, 1, &viewport);
-		vkCmdSetScissor(secondaryCommandBuffers.ui, 0, 1, &scissor);
-
-		vkCmdBindPipeline(secondaryCommandBuffers.ui, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.starsphere);
-
-		if (settings.overlay) {
-			drawUI(secondaryCommandBuffers.ui);
-		}
-
-		VK_CHECK_RESULT(vkEndCommandBuffer(secondaryCommandBuffers.ui));
 	}
 
 	// Updates the secondary command buffers using a thread pool 
@@ -430,11 +408,6 @@ public:
 			}
 		}
 
-		// Render ui last
-		if (UIOverlay.visible) {
-			commandBuffers.push_back(secondaryCommandBuffers.ui);
-		}
-
 		// Execute render commands from the secondary command buffer
 		vkCmdExecuteCommands(primaryCommandBuffer, commandBuffers.size(), commandBuffers.data());
 
@@ -21,6 +21,7 @@
 #include "vulkanexamplebase.h"
 #include "VulkanBuffer.hpp"
 #include "VulkanModel.hpp"
+#include "VulkanOcclusionCulling.hpp"
 
 #define VERTEX_BUFFER_BIND_ID 0
 #define ENABLE_VALIDATION false
@@ -41,19 +42,26 @@ public:
 		vks::Model sphere;
 	} models;
 
-	struct {
-		vks::Buffer occluder;
-		vks::Buffer teapot;
-		vks::Buffer sphere;
-	} uniformBuffers;
+	vks::Buffer uniformBuffer;
 
 	struct UBOVS {
 		glm::mat4 projection;
-		glm::mat4 model;
+		glm::mat4 view;
 		glm::vec4 lightPos = glm::vec4(10.0f, 10.0f, 10.0f, 1.0f);
-		float visible;
 	} uboVS;
 
+	// Per object transform and visibility (used for coloring occluded objects)
+	struct PushConstants {
+		glm::mat4 model;
+		float visible;
+	};
+
+	struct SceneObject {
+		vks::Model *model;
+		glm::mat4 matrix;
+	};
+	std::vector<SceneObject> sceneObjects;
+
 	struct {
 		VkPipelineVertexInputStateCreateInfo inputState;
 		std::vector<VkVertexInputBindingDescription> bindingDescriptions;
@@ -63,24 +71,22 @@ public:
 	struct {
 		VkPipeline solid;
 		VkPipeline occluder;
-		// Pipeline with basic shaders used for occlusion pass
+		// Pipeline with basic shaders used for the bounding box proxies of the occlusion queries
 		VkPipeline simple;
 	} pipelines;
 
-	struct {
-		VkDescriptorSet teapot;
-		VkDescriptorSet sphere;
-	} descriptorSets;
-
 	VkPipelineLayout pipelineLayout;
 	VkDescriptorSet descriptorSet;
 	VkDescriptorSetLayout descriptorSetLayout;
 
-	// Pool that stores all occlusion queries
-	VkQueryPool queryPool;
+	// Issues the occlusion queries and reads their results a few frames later without waiting
+	vks::OcclusionCuller culler;
+	bool conditionalRenderingSupported = false;
 
-	// Passed query samples
-	uint64_t passedSamples[2] = { 1,1 };
+	// Number of objects for the stress test (0 = teapot and sphere on both sides of the occluder)
+	uint32_t objectCount = 0;
+	// Skip occluded objects instead of drawing them darkened
+	bool cullOccluded = false;
 
 	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
 	{
@@ -90,6 +96,12 @@ public:
 		rotation = { 0.0, -123.75, 0.0 };
 		title = "Occlusion queries";
 		settings.overlay = true;
+		for (size_t i = 0; i < args.size(); i++) {
+			if ((std::string(args[i]) == "-objects") && (i + 1 < args.size())) {
+				objectCount = std::stoi(args[i + 1]);
+				cullOccluded = true;
+			}
+		}
 	}
 
 	~VulkanExample()
@@ -103,47 +115,66 @@ public:
 		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 
-		vkDestroyQueryPool(device, queryPool, nullptr);
+		culler.destroy();
 
-		uniformBuffers.occluder.destroy();
-		uniformBuffers.sphere.destroy();
-		uniformBuffers.teapot.destroy();
+		uniformBuffer.destroy();
 
 		models.sphere.destroy();
 		models.plane.destroy();
 		models.teapot.destroy();
 	}
 
-	// Create a query pool for storing the occlusion query result
-	void setupQueryPool()
+	virtual void getEnabledFeatures()
 	{
-		VkQueryPoolCreateInfo queryPoolInfo = {};
-		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
-		queryPoolInfo.queryType = VK_QUERY_TYPE_OCCLUSION;
-		queryPoolInfo.queryCount = 2;
-		VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, NULL, &queryPool));
+		// Conditional rendering lets the GPU skip objects whose proxies failed the previous frame's query
+		conditionalRenderingSupported = vks::OcclusionCuller::conditionalRenderingSupported(physicalDevice);
+		if (conditionalRenderingSupported) {
+			enabledDeviceExtensions.push_back(VK_EXT_CONDITIONAL_RENDERING_EXTENSION_NAME);
+		}
 	}
 
-	// Retrieves the results of the occlusion queries submitted to the command buffer
-	void getQueryResults()
+	// Place the objects and register their world space bounding boxes with the culler
+	void setupScene()
 	{
-		// We use vkGetQueryResults to copy the results into a host visible buffer
-		vkGetQueryPoolResults(
-			device, 
-			queryPool,
-			0,
-			2,
-			sizeof(passedSamples),
-			passedSamples,
-			sizeof(uint64_t),
-			// Store results a 64 bit values and wait until the results have been finished
-			// If you don't want to wait, you can use VK_QUERY_RESULT_WITH_AVAILABILITY_BIT
-			// which also returns the state of the result (ready) in the result
-			VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+		if (objectCount == 0) {
+			sceneObjects.push_back({ &models.teapot, glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -10.0f)) });
+			sceneObjects.push_back({ &models.sphere, glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 10.0f)) });
+		} else {
+			// Grid of smaller objects on both sides of the occluder
+			const uint32_t dim = std::max(1u, static_cast<uint32_t>(ceil(cbrt((float)objectCount))));
+			const float spacing = 24.0f / (float)dim;
+			for (uint32_t i = 0; i < objectCount; i++) {
+				const glm::vec3 cell = glm::vec3((float)(i % dim), (float)((i / dim) % dim), (float)(i / (dim * dim)));
+				glm::vec3 pos = (cell - glm::vec3((float)(dim - 1) * 0.5f)) * spacing;
+				// Keep the objects clear of the occluder plane
+				pos.z += (pos.z < 0.0f) ? -2.0f : 2.0f;
+				glm::mat4 matrix = glm::translate(glm::mat4(1.0f), pos) * glm::scale(glm::mat4(1.0f), glm::vec3(spacing * 0.1f));
+				sceneObjects.push_back({ (i % 2 == 0) ? &models.teapot : &models.sphere, matrix });
+			}
+		}
+
+		culler.create(vulkanDevice, static_cast<uint32_t>(sceneObjects.size()), conditionalRenderingSupported);
+		for (auto &object : sceneObjects) {
+			glm::vec3 min(FLT_MAX), max(-FLT_MAX);
+			for (uint32_t c = 0; c < 8; c++) {
+				const glm::vec3 corner((c & 1) ? object.model->dim.max.x : object.model->dim.min.x, (c & 2) ? object.model->dim.max.y : object.model->dim.min.y, (c & 4) ? object.model->dim.max.z : object.model->dim.min.z);
+				const glm::vec3 pos = glm::vec3(object.matrix * glm::vec4(corner, 1.0f));
+				min = glm::min(min, pos);
+				max = glm::max(max, pos);
+			}
+			culler.addObject(min, max);
+		}
 	}
 
+	// Command buffers are recorded every frame in draw() as the set of queried and drawn objects changes
 	void buildCommandBuffers()
 	{
+	}
+
+	void recordCommandBuffer(uint32_t index)
+	{
+		VkCommandBuffer commandBuffer = drawCmdBuffers[index];
+
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
 		VkClearValue clearValues[2];
@@ -158,117 +189,69 @@ public:
 		renderPassBeginInfo.renderArea.extent.height = height;
 		renderPassBeginInfo.clearValueCount = 2;
 		renderPassBeginInfo.pClearValues = clearValues;
-
-		for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
-		{
-			// Set target frame buffer
-			renderPassBeginInfo.framebuffer = frameBuffers[i];
-
-			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
-
-			// Reset query pool
-			// Must be done outside of render pass
-			vkCmdResetQueryPool(drawCmdBuffers[i], queryPool, 0, 2);
-
-			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-			VkViewport viewport = vks::initializers::viewport(
-				(float)width,
-				(float)height,
-				0.0f,
-				1.0f);
-			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-
-			VkRect2D scissor = vks::initializers::rect2D(
-				width,
-				height,
-				0,
-				0);
-			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
-
-			VkDeviceSize offsets[1] = { 0 };
-
-			glm::mat4 modelMatrix = glm::mat4(1.0f);
-
-			// Occlusion pass
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.simple);
-
-			// Occluder first
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &models.plane.vertices.buffer, offsets);
-			vkCmdBindIndexBuffer(drawCmdBuffers[i], models.plane.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdDrawIndexed(drawCmdBuffers[i], models.plane.indexCount, 1, 0, 0, 0);
-
-			// Teapot
-			vkCmdBeginQuery(drawCmdBuffers[i], queryPool, 0, VK_FLAGS_NONE);
-
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.teapot, 0, NULL);
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &models.teapot.vertices.buffer, offsets);
-			vkCmdBindIndexBuffer(drawCmdBuffers[i], models.teapot.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdDrawIndexed(drawCmdBuffers[i], models.teapot.indexCount, 1, 0, 0, 0);
-
-			vkCmdEndQuery(drawCmdBuffers[i], queryPool, 0);
-
-			// Sphere
-			vkCmdBeginQuery(drawCmdBuffers[i], queryPool, 1, VK_FLAGS_NONE);
-
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.sphere, 0, NULL);
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &models.sphere.vertices.buffer, offsets);
-			vkCmdBindIndexBuffer(drawCmdBuffers[i], models.sphere.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdDrawIndexed(drawCmdBuffers[i], models.sphere.indexCount, 1, 0, 0, 0);
-
-			vkCmdEndQuery(drawCmdBuffers[i], queryPool, 1);
-
-			// Visible pass
-			// Clear color and depth attachments
-			VkClearAttachment clearAttachments[2] = {};
-
-			clearAttachments[0].aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			clearAttachments[0].clearValue.color = defaultClearColor;
-			clearAttachments[0].colorAttachment = 0;
-
-			clearAttachments[1].aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-			clearAttachments[1].clearValue.depthStencil = { 1.0f, 0 };
-
-			VkClearRect clearRect = {};
-			clearRect.layerCount = 1;
-			clearRect.rect.offset = { 0, 0 };
-			clearRect.rect.extent = { width, height };
-
-			vkCmdClearAttachments(
-				drawCmdBuffers[i],
-				2,
-				clearAttachments,
-				1,
-				&clearRect);
-
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.solid);
-
-			// Teapot
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.teapot, 0, NULL);
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &models.teapot.vertices.buffer, offsets);
-			vkCmdBindIndexBuffer(drawCmdBuffers[i], models.teapot.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdDrawIndexed(drawCmdBuffers[i], models.teapot.indexCount, 1, 0, 0, 0);
-
-			// Sphere
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets.sphere, 0, NULL);
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &models.sphere.vertices.buffer, offsets);
-			vkCmdBindIndexBuffer(drawCmdBuffers[i], models.sphere.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdDrawIndexed(drawCmdBuffers[i], models.sphere.indexCount, 1, 0, 0, 0);
-
-			// Occluder
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.occluder);
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &models.plane.vertices.buffer, offsets);
-			vkCmdBindIndexBuffer(drawCmdBuffers[i], models.plane.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdDrawIndexed(drawCmdBuffers[i], models.plane.indexCount, 1, 0, 0, 0);
-
-			drawUI(drawCmdBuffers[i]);
-
-			vkCmdEndRenderPass(drawCmdBuffers[i]);
-
-			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
+		renderPassBeginInfo.framebuffer = frameBuffers[index];
+
+		VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufInfo));
+
+		// Reset this frame's query pool and copy the previous frame's results for conditional rendering
+		// Must be done outside of render pass
+		culler.cmdPrepare(commandBuffer);
+		gpuStats.cmdReset(commandBuffer, index);
+
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+		VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+		VkDeviceSize offsets[1] = { 0 };
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
+
+		// Objects
+		gpuStats.cmdBeginPass(commandBuffer, index, "Scene");
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.solid);
+		vks::Model *boundModel = nullptr;
+		for (uint32_t i = 0; i < sceneObjects.size(); i++) {
+			PushConstants pushConstants;
+			pushConstants.model = sceneObjects[i].matrix;
+			pushConstants.visible = culler.visible(i) ? 1.0f : 0.0f;
+			if (cullOccluded && !culler.cmdBeginObject(commandBuffer, i)) {
+				continue;
+			}
+			if (sceneObjects[i].model != boundModel) {
+				boundModel = sceneObjects[i].model;
+				vkCmdBindVertexBuffers(commandBuffer, VERTEX_BUFFER_BIND_ID, 1, &boundModel->vertices.buffer, offsets);
+				vkCmdBindIndexBuffer(commandBuffer, boundModel->indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+			}
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstants), &pushConstants);
+			vkCmdDrawIndexed(commandBuffer, boundModel->indexCount, 1, 0, 0, 0);
+			if (cullOccluded) {
+				culler.cmdEndObject(commandBuffer, i);
+			}
 		}
+
+		// Occluder
+		PushConstants pushConstants;
+		pushConstants.model = glm::mat4(1.0f);
+		pushConstants.visible = 1.0f;
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.occluder);
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstants), &pushConstants);
+		vkCmdBindVertexBuffers(commandBuffer, VERTEX_BUFFER_BIND_ID, 1, &models.plane.vertices.buffer, offsets);
+		vkCmdBindIndexBuffer(commandBuffer, models.plane.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+		vkCmdDrawIndexed(commandBuffer, models.plane.indexCount, 1, 0, 0, 0);
+		gpuStats.cmdEndPass(commandBuffer, index);
+
+		// Bounding box proxies of all objects queried this frame, tested against the depth of everything drawn so far
+		gpuStats.cmdBeginPass(commandBuffer, index, "Occlusion proxies");
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.simple);
+		culler.cmdDrawProxies(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT);
+		gpuStats.cmdEndPass(commandBuffer, index);
+
+		vkCmdEndRenderPass(commandBuffer);
+
+		VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
 	}
 
 	void draw()
@@ -276,13 +259,16 @@ public:
 		updateUniformBuffers();
 		VulkanExampleBase::prepareFrame();
 
+		// Collect the results that are available by now and record this frame's draws and queries
+		const glm::vec3 cameraPos = glm::vec3(glm::inverse(uboVS.view) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+		culler.settings.conditionalRendering = cullOccluded;
+		culler.beginFrame(cameraPos);
+		recordCommandBuffer(currentBuffer);
+
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
 		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
 
-		// Read query results for displaying in next frame
-		getQueryResults();
-
 		VulkanExampleBase::submitFrame();
 	}
 
@@ -339,15 +325,15 @@ public:
 	{
 		std::vector<VkDescriptorPoolSize> poolSizes =
 		{
-			// One uniform buffer block for each mesh
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3)
+			// Uniform buffer block shared by all meshes, per object data is passed via push constants
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1)
 		};
 
 		VkDescriptorPoolCreateInfo descriptorPoolInfo =
 			vks::initializers::descriptorPoolCreateInfo(
 				poolSizes.size(),
 				poolSizes.data(),
-				3);
+				1);
 
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
 	}
@@ -375,6 +361,15 @@ public:
 				&descriptorSetLayout,
 				1);
 
+		// Object transforms and the proxies' bounding boxes share the same push constant range
+		VkPushConstantRange pushConstantRange =
+			vks::initializers::pushConstantRange(
+				VK_SHADER_STAGE_VERTEX_BIT,
+				static_cast<uint32_t>(std::max(sizeof(PushConstants), sizeof(vks::OcclusionCuller::ProxyPushConstants))),
+				0);
+		pPipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pPipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
 		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pPipelineLayoutCreateInfo, nullptr, &pipelineLayout));
 	}
 
@@ -386,7 +381,6 @@ public:
 				&descriptorSetLayout,
 				1);
 
-		// Occluder (plane)
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet));
 
 		std::vector<VkWriteDescriptorSet> writeDescriptorSets =
@@ -396,22 +390,10 @@ public:
 				descriptorSet,
 				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
 				0,
-				&uniformBuffers.occluder.descriptor)
+				&uniformBuffer.descriptor)
 		};
 
 		vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
-
-		// Teapot
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets.teapot));
-		writeDescriptorSets[0].dstSet = descriptorSets.teapot;
-		writeDescriptorSets[0].pBufferInfo = &uniformBuffers.teapot.descriptor;
-		vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
-
-		// Sphere
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets.sphere));
-		writeDescriptorSets[0].dstSet = descriptorSets.sphere;
-		writeDescriptorSets[0].pBufferInfo = &uniformBuffers.sphere.descriptor;
-		vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
 	}
 
 	void preparePipelines()
@@ -489,13 +471,6 @@ public:
 
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.solid));
 
-		// Basic pipeline for coloring occluded objects
-		shaderStages[0] = loadShader(getAssetPath() + "shaders/occlusionquery/simple.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-		shaderStages[1] = loadShader(getAssetPath() + "shaders/occlusionquery/simple.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-		rasterizationState.cullMode = VK_CULL_MODE_NONE;
-
-		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.simple));
-
 		// Visual pipeline for the occluder
 		shaderStages[0] = loadShader(getAssetPath() + "shaders/occlusionquery/occluder.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
 		shaderStages[1] = loadShader(getAssetPath() + "shaders/occlusionquery/occluder.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
@@ -507,6 +482,26 @@ public:
 		blendAttachmentState.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_COLOR;
 
 		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.occluder));
+
+		// Bounding box proxies for the occlusion queries
+		// Only positions of the unit cube, no color or depth writes so the proxies don't show up or occlude each other
+		VkVertexInputBindingDescription proxyBinding = vks::initializers::vertexInputBindingDescription(0, sizeof(float) * 3, VK_VERTEX_INPUT_RATE_VERTEX);
+		VkVertexInputAttributeDescription proxyAttribute = vks::initializers::vertexInputAttributeDescription(0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0);
+		VkPipelineVertexInputStateCreateInfo proxyInputState = vks::initializers::pipelineVertexInputStateCreateInfo();
+		proxyInputState.vertexBindingDescriptionCount = 1;
+		proxyInputState.pVertexBindingDescriptions = &proxyBinding;
+		proxyInputState.vertexAttributeDescriptionCount = 1;
+		proxyInputState.pVertexAttributeDescriptions = &proxyAttribute;
+		pipelineCreateInfo.pVertexInputState = &proxyInputState;
+
+		shaderStages[0] = loadShader(getAssetPath() + "shaders/occlusionquery/simple.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+		shaderStages[1] = loadShader(getAssetPath() + "shaders/occlusionquery/simple.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+		rasterizationState.cullMode = VK_CULL_MODE_NONE;
+		blendAttachmentState.blendEnable = VK_FALSE;
+		blendAttachmentState.colorWriteMask = 0;
+		depthStencilState.depthWriteEnable = VK_FALSE;
+
+		VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.simple));
 	}
 
 	// Prepare and initialize uniform buffer containing shader uniforms
@@ -516,27 +511,11 @@ public:
 		VK_CHECK_RESULT(vulkanDevice->createBuffer(
 			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&uniformBuffers.occluder,
-			sizeof(uboVS)));
-
-		// Teapot
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&uniformBuffers.teapot,
-			sizeof(uboVS)));
-
-		// Sphere
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&uniformBuffers.sphere,
+			&uniformBuffer,
 			sizeof(uboVS)));
 
 		// Map persistent
-		VK_CHECK_RESULT(uniformBuffers.occluder.map());
-		VK_CHECK_RESULT(uniformBuffers.teapot.map());
-		VK_CHECK_RESULT(uniformBuffers.sphere.map());
+		VK_CHECK_RESULT(uniformBuffer.map());
 
 		updateUniformBuffers();
 	}
@@ -552,39 +531,22 @@ public:
 		rotMatrix = glm::rotate(rotMatrix, glm::radians(rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
 		rotMatrix = glm::rotate(rotMatrix, glm::radians(rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
 
-		uboVS.model = viewMatrix * rotMatrix;
-
-		uint8_t *pData;
+		uboVS.view = viewMatrix * rotMatrix;
 
-		// Occluder
-		uboVS.visible = 1.0f;
-		memcpy(uniformBuffers.occluder.mapped, &uboVS, sizeof(uboVS));
-
-		// Teapot
-		// Toggle color depending on visibility
-		uboVS.visible = (passedSamples[0] > 0) ? 1.0f : 0.0f;
-		uboVS.model = viewMatrix * rotMatrix * glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -10.0f));
-		memcpy(uniformBuffers.teapot.mapped, &uboVS, sizeof(uboVS));
-
-		// Sphere
-		// Toggle color depending on visibility
-		uboVS.visible = (passedSamples[1] > 0) ? 1.0f : 0.0f;
-		uboVS.model = viewMatrix * rotMatrix * glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 10.0f));
-		memcpy(uniformBuffers.sphere.mapped, &uboVS, sizeof(uboVS));
+		memcpy(uniformBuffer.mapped, &uboVS, sizeof(uboVS));
 	}
 
 	void prepare()
 	{
 		VulkanExampleBase::prepare();
 		loadAssets();
-		setupQueryPool();
+		setupScene();
 		setupVertexDescriptions();
 		prepareUniformBuffers();
 		setupDescriptorSetLayout();
 		preparePipelines();
 		setupDescriptorPool();
 		setupDescriptorSets();
-		buildCommandBuffers();
 		prepared = true;
 	}
 
@@ -597,9 +559,23 @@ public:
 
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
 	{
+		if (overlay->header("Settings")) {
+			overlay->checkBox("Cull occluded objects", &cullOccluded);
+			if (culler.conditionalRenderingAvailable()) {
+				overlay->text("Conditional rendering enabled");
+			}
+		}
 		if (overlay->header("Occlusion query results")) {
-			overlay->text("Teapot: %d samples passed", passedSamples[0]);
-			overlay->text("Sphere: %d samples passed", passedSamples[1]);
+			if (objectCount == 0) {
+				overlay->text("Teapot: %s", culler.visible(0) ? "visible" : "occluded");
+				overlay->text("Sphere: %s", culler.visible(1) ? "visible" : "occluded");
+			}
+			overlay->text("Objects: %d", culler.stats.objects);
+			overlay->text("Trusted: %d", culler.stats.trusted);
+			overlay->text("Queried: %d", culler.stats.queried);
+			overlay->text("Conditional: %d", culler.stats.conditional);
+			overlay->text("Culled: %d", culler.stats.culled);
+			overlay->text("Results read: %d (dropped %d)", culler.stats.resultsRead, culler.stats.resultsDropped);
 		}
 	}
 
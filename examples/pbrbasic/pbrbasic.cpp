@@ -206,7 +206,6 @@ public:
 				}
 			}
 #endif
-			drawUI(drawCmdBuffers[i]);
 
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
 
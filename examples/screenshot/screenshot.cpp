@@ -49,6 +49,8 @@ public:
 	VkDescriptorSet descriptorSet;
 
 	bool screenshotSaved = false;
+	int32_t screenshotFormat = 0;
+	std::string screenshotFilename;
 
 	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
 	{
@@ -116,8 +118,6 @@ public:
 
 			vkCmdDrawIndexed(drawCmdBuffers[i], model.indexCount, 1, 0, 0, 0);
 
-			drawUI(drawCmdBuffers[i]);
-
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
 
 			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
@@ -475,11 +475,27 @@ public:
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
 	{
 		if (overlay->header("Functions")) {
+			overlay->comboBox("Format", &screenshotFormat, { "ppm", "png", "qoi" });
+			// Copied to a readback buffer at present time and written by the frame capture worker thread, doesn't stall the frame
 			if (overlay->button("Take screenshot")) {
-				saveScreenshot("screenshot.ppm");
+				const std::vector<std::string> extensions = { "ppm", "png", "qoi" };
+				screenshotFilename = "screenshot." + extensions[screenshotFormat];
+				screenshotSaved = false;
+				frameCapture.savedCount = 0;
+				frameCapture.requestScreenshot(screenshotFilename);
+			}
+			// Blit to a linear image and write on the calling thread, waits for the device to become idle
+			if (overlay->button("Take screenshot (blocking)")) {
+				screenshotFilename = "screenshot.ppm";
+				saveScreenshot(screenshotFilename.c_str());
+			}
+			if (frameCapture.savedCount > 0) {
+				screenshotSaved = true;
 			}
 			if (screenshotSaved) {
-				overlay->text("Screenshot saved as screenshot.ppm");
+				overlay->text("Screenshot saved as %s", screenshotFilename.c_str());
+			} else if (frameCapture.busy()) {
+				overlay->text("Saving screenshot...");
 			}
 		}
 	}
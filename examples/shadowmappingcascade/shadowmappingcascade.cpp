@@ -15,6 +15,12 @@
 
 	A further optimization could be done using a geometry shader to do a single-pass render for the depth map
 	cascades instead of multiple passes (geometry shaders are not supported on all target devices).
+
+	To cut the cost of the depth passes, cascades are cached: the nearest cascade is rendered whenever the view or
+	light changes, farther cascades keep their depth layer until the light has moved past a threshold, the camera
+	has left the cascade's padded bounds or their refresh interval has passed. Cascade matrices are snapped to whole
+	shadow map texels so cached and freshly rendered cascades stay stable. Each cascade only draws the objects inside
+	its light frustum and is recorded into a secondary command buffer on a worker thread.
 */
 
 #include <stdio.h>
@@ -22,6 +28,8 @@
 #include <string.h>
 #include <assert.h>
 #include <vector>
+#include <thread>
+#include <chrono>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -33,6 +41,7 @@
 #include "VulkanBuffer.hpp"
 #include "VulkanTexture.hpp"
 #include "VulkanModel.hpp"
+#include "threadpool.hpp"
 
 #define ENABLE_VALIDATION false
 
@@ -54,6 +63,23 @@ public:
 
 	float cascadeSplitLambda = 0.95f;
 
+	// Cascade caching
+	bool cacheCascades = true;
+	// Far cascades are re-rendered at least every n frames
+	int32_t cascadeRefreshInterval = 8;
+	// Light direction change (in degrees) after which cached cascades are re-rendered
+	float lightMoveThreshold = 0.25f;
+	// Cached cascades cover a slightly larger area so the camera can move before they need to be re-rendered
+	float cascadePadding = 0.15f;
+	bool cullCascades = true;
+	bool multithreadedRecording = true;
+	uint32_t shadowFrame = 0;
+
+	struct {
+		uint32_t cascadesRendered = 0;
+		float recordingTime = 0.0f;
+	} stats;
+
 	float zNear = 0.5f;
 	float zFar = 48.0f;
 
@@ -75,6 +101,16 @@ public:
 	};
 	std::vector<Material> materials;
 
+	// Model instances with world space bounds used for per-cascade culling
+	struct SceneObject {
+		uint32_t model;
+		uint32_t material;
+		glm::vec3 position;
+		glm::vec3 min;
+		glm::vec3 max;
+	};
+	std::vector<SceneObject> sceneObjects;
+
 	struct uniformBuffers {
 		vks::Buffer VS;
 		vks::Buffer FS;
@@ -151,13 +187,30 @@ public:
 		float splitDepth;
 		glm::mat4 viewProjMatrix;
 
+		// Bounds and light direction the cached depth layer was rendered with
+		glm::vec3 center;
+		float radius = 0.0f;
+		glm::vec3 lightDir;
+		uint32_t lastUpdate = 0;
+		// Set if the depth layer needs to be rendered in the next frame
+		bool update = true;
+		uint32_t visibleObjects = 0;
+
+		// Secondary command buffers (one per frame buffer) recorded on the thread pool
+		// Each cascade has its own pool as command pools must not be used from multiple threads at once
+		VkCommandPool commandPool;
+		std::vector<VkCommandBuffer> commandBuffers;
+
 		void destroy(VkDevice device) {
 			vkDestroyImageView(device, view, nullptr);
 			vkDestroyFramebuffer(device, frameBuffer, nullptr);
+			vkDestroyCommandPool(device, commandPool, nullptr);
 		}
 	};
 	std::array<Cascade, SHADOW_MAP_CASCADE_COUNT> cascades;
 
+	vks::ThreadPool threadPool;
+
 	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
 	{
 		title = "Cascaded shadow mapping";
@@ -169,6 +222,8 @@ public:
 		camera.setRotation(glm::vec3(-17.0f, 7.0f, 0.0f));
 		settings.overlay = true;
 		timer = 0.2f;
+		// One worker per cascade at most
+		threadPool.setThreadCount(std::max(1u, std::min(std::thread::hardware_concurrency(), (uint32_t)SHADOW_MAP_CASCADE_COUNT)));
 	}
 
 	~VulkanExample()
@@ -210,50 +265,53 @@ public:
 		enabledFeatures.depthClamp = deviceFeatures.depthClamp;		
 	}
 
+	/*
+		Checks the world space bounds of an object against a cascade's light frustum
+		Objects between the light and the near plane are kept, as they still cast shadows into the cascade (depth clamp)
+	*/
+	bool objectInCascade(const SceneObject &object, const Cascade &cascade)
+	{
+		glm::vec3 clipMin = glm::vec3(FLT_MAX);
+		glm::vec3 clipMax = glm::vec3(-FLT_MAX);
+		for (uint32_t i = 0; i < 8; i++) {
+			glm::vec3 corner = glm::vec3((i & 1) ? object.max.x : object.min.x, (i & 2) ? object.max.y : object.min.y, (i & 4) ? object.max.z : object.min.z);
+			// Orthographic projection, no perspective divide required
+			glm::vec3 clip = glm::vec3(cascade.viewProjMatrix * glm::vec4(corner, 1.0f));
+			clipMin = glm::min(clipMin, clip);
+			clipMax = glm::max(clipMax, clip);
+		}
+		return (clipMax.x >= -1.0f) && (clipMin.x <= 1.0f) && (clipMax.y >= -1.0f) && (clipMin.y <= 1.0f) && (clipMin.z <= 1.0f);
+	}
+
 	/*
 		Render the example scene with given command buffer, pipeline layout and dscriptor set
 		Used by the scene rendering and depth pass generation command buffer
+		If a cascade is passed, objects outside of its light frustum are skipped
+		Returns the number of objects drawn
 	*/
-	void renderScene(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, VkDescriptorSet descriptorSet, uint32_t cascadeIndex = 0) {
+	uint32_t renderScene(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, VkDescriptorSet descriptorSet, uint32_t cascadeIndex = 0, const Cascade *cascade = nullptr) {
 		const VkDeviceSize offsets[1] = { 0 };
 		PushConstBlock pushConstBlock = { glm::vec4(0.0f), cascadeIndex };
 
 		std::array<VkDescriptorSet, 2> sets;
 		sets[0] = descriptorSet;
 
-		// Floor
-		sets[1] = materials[0].descriptorSet;
-		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 2, sets.data(), 0, NULL);
-		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstBlock), &pushConstBlock);
-		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &models[0].vertices.buffer, offsets);
-		vkCmdBindIndexBuffer(commandBuffer, models[0].indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-		vkCmdDrawIndexed(commandBuffer, models[0].indexCount, 1, 0, 0, 0);
-
-		// Trees
-		const std::vector<glm::vec3> positions = {
-			glm::vec3(0.0f, 0.0f, 0.0f),
-			glm::vec3(1.25f, 0.25f, 1.25f),
-			glm::vec3(-1.25f, -0.2f, 1.25f),
-			glm::vec3(1.25f, 0.1f, -1.25f),
-			glm::vec3(-1.25f, -0.25f, -1.25f),
-		};
-
-		for (auto position : positions) {
-			pushConstBlock.position = glm::vec4(position, 0.0f);
+		uint32_t drawn = 0;
+		for (auto &object : sceneObjects) {
+			if (cascade && cullCascades && !objectInCascade(object, *cascade)) {
+				continue;
+			}
+			pushConstBlock.position = glm::vec4(object.position, 0.0f);
 			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstBlock), &pushConstBlock);
 
-			sets[1] = materials[1].descriptorSet;
-			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 2, sets.data(), 0, NULL);
-			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &models[1].vertices.buffer, offsets);
-			vkCmdBindIndexBuffer(commandBuffer, models[1].indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdDrawIndexed(commandBuffer, models[1].indexCount, 1, 0, 0, 0);
-
-			sets[1] = materials[2].descriptorSet;
+			sets[1] = materials[object.material].descriptorSet;
 			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 2, sets.data(), 0, NULL);
-			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &models[2].vertices.buffer, offsets);
-			vkCmdBindIndexBuffer(commandBuffer, models[2].indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdDrawIndexed(commandBuffer, models[2].indexCount, 1, 0, 0, 0);
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &models[object.model].vertices.buffer, offsets);
+			vkCmdBindIndexBuffer(commandBuffer, models[object.model].indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+			vkCmdDrawIndexed(commandBuffer, models[object.model].indexCount, 1, 0, 0, 0);
+			drawn++;
 		}
+		return drawn;
 	}
 
 	/*
@@ -393,104 +451,173 @@ public:
 		sampler.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
 		VK_CHECK_RESULT(vkCreateSampler(device, &sampler, nullptr, &depth.sampler));
 	}
+	/*
+		Allocate the secondary command buffers for the cascade depth passes
+		One command pool per cascade so cascades can be recorded on different threads
+	*/
+	void prepareCascadeCommandBuffers()
+	{
+		for (auto &cascade : cascades) {
+			VkCommandPoolCreateInfo cmdPoolInfo = vks::initializers::commandPoolCreateInfo();
+			cmdPoolInfo.queueFamilyIndex = swapChain.queueNodeIndex;
+			cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+			VK_CHECK_RESULT(vkCreateCommandPool(device, &cmdPoolInfo, nullptr, &cascade.commandPool));
+			cascade.commandBuffers.resize(drawCmdBuffers.size());
+			VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(cascade.commandPool, VK_COMMAND_BUFFER_LEVEL_SECONDARY, static_cast<uint32_t>(cascade.commandBuffers.size()));
+			VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, cascade.commandBuffers.data()));
+		}
+	}
+
+	// Records the depth pass of a single cascade, called from the thread pool
+	void recordCascade(uint32_t cascadeIndex, uint32_t bufferIndex)
+	{
+		Cascade &cascade = cascades[cascadeIndex];
+		VkCommandBuffer commandBuffer = cascade.commandBuffers[bufferIndex];
+
+		VkCommandBufferInheritanceInfo inheritanceInfo = vks::initializers::commandBufferInheritanceInfo();
+		inheritanceInfo.renderPass = depthPass.renderPass;
+		inheritanceInfo.framebuffer = cascade.frameBuffer;
+
+		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+		cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		cmdBufInfo.pInheritanceInfo = &inheritanceInfo;
+		VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufInfo));
+
+		VkViewport viewport = vks::initializers::viewport((float)SHADOWMAP_DIM, (float)SHADOWMAP_DIM, 0.0f, 1.0f);
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		VkRect2D scissor = vks::initializers::rect2D(SHADOWMAP_DIM, SHADOWMAP_DIM, 0, 0);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, depthPass.pipeline);
+		cascade.visibleObjects = renderScene(commandBuffer, depthPass.pipelineLayout, cascade.descriptorSet, cascadeIndex, &cascade);
+
+		VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+	}
+
+	// Command buffers are recorded every frame in draw() as the set of cascades to be rendered changes
 	void buildCommandBuffers()
 	{
+	}
+
+	void recordCommandBuffer(uint32_t index)
+	{
+		auto tStart = std::chrono::high_resolution_clock::now();
+
+		// Cached cascades keep the contents of their depth layer and are skipped
+		std::vector<uint32_t> renderCascades;
+		for (uint32_t j = 0; j < SHADOW_MAP_CASCADE_COUNT; j++) {
+			if (cascades[j].update || !cacheCascades) {
+				renderCascades.push_back(j);
+			}
+		}
+		stats.cascadesRendered = static_cast<uint32_t>(renderCascades.size());
+
+		// Record the cascade depth passes into secondary command buffers, either on the thread pool or on this thread
+		for (uint32_t j : renderCascades) {
+			if (multithreadedRecording) {
+				threadPool.threads[j % threadPool.threads.size()]->addJob([=] { recordCascade(j, index); });
+			} else {
+				recordCascade(j, index);
+			}
+		}
+
+		VkCommandBuffer commandBuffer = drawCmdBuffers[index];
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+		VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufInfo));
+		gpuStats.cmdReset(commandBuffer, index);
+
+		/*
+			Generate depth map cascades
 
-		VkDeviceSize offsets[1] = { 0 };
-
-		for (int32_t i = 0; i < drawCmdBuffers.size(); i++) {
-			
-			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
-
-			/*
-				Generate depth map cascades
-
-				Uses multiple passes with each pass rendering the scene to the cascade's depth image layer
-				Could be optimized using a geometry shader (and layered frame buffer) on devices that support geometry shaders
-			*/
-			{
-				VkClearValue clearValues[1];
-				clearValues[0].depthStencil = { 1.0f, 0 };
-
-				VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-				renderPassBeginInfo.renderPass = depthPass.renderPass;
-				renderPassBeginInfo.renderArea.offset.x = 0;
-				renderPassBeginInfo.renderArea.offset.y = 0;
-				renderPassBeginInfo.renderArea.extent.width = SHADOWMAP_DIM;
-				renderPassBeginInfo.renderArea.extent.height = SHADOWMAP_DIM;
-				renderPassBeginInfo.clearValueCount = 1;
-				renderPassBeginInfo.pClearValues = clearValues;
-
-				VkViewport viewport = vks::initializers::viewport((float)SHADOWMAP_DIM, (float)SHADOWMAP_DIM, 0.0f, 1.0f);
-				vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-
-				VkRect2D scissor = vks::initializers::rect2D(SHADOWMAP_DIM, SHADOWMAP_DIM, 0, 0);
-				vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
-
-				// One pass per cascade
-				// The layer that this pass renders to is defined by the cascade's image view (selected via the cascade's decsriptor set)
-				for (uint32_t j = 0; j < SHADOW_MAP_CASCADE_COUNT; j++) {
-					renderPassBeginInfo.framebuffer = cascades[j].frameBuffer;
-					vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-					vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, depthPass.pipeline);
-					renderScene(drawCmdBuffers[i], depthPass.pipelineLayout, cascades[j].descriptorSet, j);
-					vkCmdEndRenderPass(drawCmdBuffers[i]);
-				}
+			Uses multiple passes with each pass rendering the scene to the cascade's depth image layer
+			Could be optimized using a geometry shader (and layered frame buffer) on devices that support geometry shaders
+		*/
+		{
+			VkClearValue clearValues[1];
+			clearValues[0].depthStencil = { 1.0f, 0 };
+
+			VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+			renderPassBeginInfo.renderPass = depthPass.renderPass;
+			renderPassBeginInfo.renderArea.offset.x = 0;
+			renderPassBeginInfo.renderArea.offset.y = 0;
+			renderPassBeginInfo.renderArea.extent.width = SHADOWMAP_DIM;
+			renderPassBeginInfo.renderArea.extent.height = SHADOWMAP_DIM;
+			renderPassBeginInfo.clearValueCount = 1;
+			renderPassBeginInfo.pClearValues = clearValues;
+
+			// Secondary command buffers must have finished recording before they can be executed
+			if (multithreadedRecording) {
+				threadPool.wait();
 			}
 
-			/*
-				Note: Explicit synchronization is not required between the render pass, as this is done implicit via sub pass dependencies
-			*/
-
-			/*
-				Scene rendering using depth cascades for shadow mapping
-			*/
-
-			{
-				VkClearValue clearValues[2];
-				clearValues[0].color = { { 0.0f, 0.0f, 0.2f, 1.0f } };
-				clearValues[1].depthStencil = { 1.0f, 0 };
-
-				VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
-				renderPassBeginInfo.renderPass = renderPass;
-				renderPassBeginInfo.framebuffer = frameBuffers[i];
-				renderPassBeginInfo.renderArea.offset.x = 0;
-				renderPassBeginInfo.renderArea.offset.y = 0;
-				renderPassBeginInfo.renderArea.extent.width = width;
-				renderPassBeginInfo.renderArea.extent.height = height;
-				renderPassBeginInfo.clearValueCount = 2;
-				renderPassBeginInfo.pClearValues = clearValues;
-
-				vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-				VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
-				vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-
-				VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
-				vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
-
-				// Visualize shadow map cascade
-				if (displayDepthMap) {
-					vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
-					vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.debugShadowMap);
-					PushConstBlock pushConstBlock = {};
-					pushConstBlock.cascadeIndex = displayDepthMapCascadeIndex;
-					vkCmdPushConstants(drawCmdBuffers[i], pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstBlock), &pushConstBlock);
-					vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
-				}
-
-				// Render shadowed scene
-				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, (filterPCF) ? pipelines.sceneShadowPCF : pipelines.sceneShadow);
-				renderScene(drawCmdBuffers[i], pipelineLayout, descriptorSet);
-
-				drawUI(drawCmdBuffers[i]);
-
-				vkCmdEndRenderPass(drawCmdBuffers[i]);
+			// One pass per cascade
+			// The layer that this pass renders to is defined by the cascade's image view (selected via the cascade's decsriptor set)
+			gpuStats.cmdBeginPass(commandBuffer, index, "Shadow cascades");
+			for (uint32_t j : renderCascades) {
+				renderPassBeginInfo.framebuffer = cascades[j].frameBuffer;
+				vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+				vkCmdExecuteCommands(commandBuffer, 1, &cascades[j].commandBuffers[index]);
+				vkCmdEndRenderPass(commandBuffer);
 			}
+			gpuStats.cmdEndPass(commandBuffer, index);
+		}
+
+		/*
+			Note: Explicit synchronization is not required between the render pass, as this is done implicit via sub pass dependencies
+		*/
+
+		/*
+			Scene rendering using depth cascades for shadow mapping
+		*/
 
-			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
+		{
+			VkClearValue clearValues[2];
+			clearValues[0].color = { { 0.0f, 0.0f, 0.2f, 1.0f } };
+			clearValues[1].depthStencil = { 1.0f, 0 };
+
+			VkRenderPassBeginInfo renderPassBeginInfo = vks::initializers::renderPassBeginInfo();
+			renderPassBeginInfo.renderPass = renderPass;
+			renderPassBeginInfo.framebuffer = frameBuffers[index];
+			renderPassBeginInfo.renderArea.offset.x = 0;
+			renderPassBeginInfo.renderArea.offset.y = 0;
+			renderPassBeginInfo.renderArea.extent.width = width;
+			renderPassBeginInfo.renderArea.extent.height = height;
+			renderPassBeginInfo.clearValueCount = 2;
+			renderPassBeginInfo.pClearValues = clearValues;
+
+			gpuStats.cmdBeginPass(commandBuffer, index, "Scene");
+			vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+			VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+			vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+			VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
+			vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+			// Visualize shadow map cascade
+			if (displayDepthMap) {
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.debugShadowMap);
+				PushConstBlock pushConstBlock = {};
+				pushConstBlock.cascadeIndex = displayDepthMapCascadeIndex;
+				vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstBlock), &pushConstBlock);
+				vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+			}
+
+			// Render shadowed scene
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, (filterPCF) ? pipelines.sceneShadowPCF : pipelines.sceneShadow);
+			renderScene(commandBuffer, pipelineLayout, descriptorSet);
+
+			vkCmdEndRenderPass(commandBuffer);
+			gpuStats.cmdEndPass(commandBuffer, index);
 		}
+
+		VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+
+		// Smoothed CPU time for recording all command buffers of this frame
+		auto tEnd = std::chrono::high_resolution_clock::now();
+		float tDiff = std::chrono::duration<float, std::milli>(tEnd - tStart).count();
+		stats.recordingTime = (stats.recordingTime == 0.0f) ? tDiff : glm::mix(stats.recordingTime, tDiff, 0.05f);
 	}
 
 	void loadAssets()
@@ -504,6 +631,34 @@ public:
 		models[0].loadFromFile(getAssetPath() + "models/terrain_simple.dae", vertexLayout, 1.0f, vulkanDevice, queue);
 		models[1].loadFromFile(getAssetPath() + "models/oak_trunk.dae", vertexLayout, 2.0f, vulkanDevice, queue);
 		models[2].loadFromFile(getAssetPath() + "models/oak_leafs.dae", vertexLayout, 2.0f, vulkanDevice, queue);
+		const std::vector<float> modelScales = { 1.0f, 2.0f, 2.0f };
+
+		auto addObject = [&](uint32_t model, uint32_t material, glm::vec3 position) {
+			SceneObject object;
+			object.model = model;
+			object.material = material;
+			object.position = position;
+			// Model dimensions are stored unscaled
+			object.min = models[model].dim.min * modelScales[model] + position;
+			object.max = models[model].dim.max * modelScales[model] + position;
+			sceneObjects.push_back(object);
+		};
+
+		// Floor
+		addObject(0, 0, glm::vec3(0.0f));
+
+		// Trees
+		const std::vector<glm::vec3> positions = {
+			glm::vec3(0.0f, 0.0f, 0.0f),
+			glm::vec3(1.25f, 0.25f, 1.25f),
+			glm::vec3(-1.25f, -0.2f, 1.25f),
+			glm::vec3(1.25f, 0.1f, -1.25f),
+			glm::vec3(-1.25f, -0.25f, -1.25f),
+		};
+		for (auto position : positions) {
+			addObject(1, 1, position);
+			addObject(2, 2, position);
+		}
 	}
 
 	void setupLayoutsAndDescriptors() 
@@ -722,8 +877,9 @@ public:
 	/*
 		Calculate frustum split depths and matrices for the shadow map cascades
 		Based on https://johanmedestrom.wordpress.com/2016/03/18/opengl-cascaded-shadow-maps/
+		Cascades that are still valid keep their matrix and cached depth layer, force re-renders all of them
 	*/
-	void updateCascades()
+	void updateCascades(bool force = false)
 	{
 		float cascadeSplits[SHADOW_MAP_CASCADE_COUNT];
 	
@@ -747,6 +903,9 @@ public:
 			cascadeSplits[i] = (d - nearClip) / clipRange;
 		}
 
+		const glm::vec3 lightDir = normalize(-lightPos);
+		const float lightThreshold = std::cos(glm::radians(lightMoveThreshold));
+
 		// Calculate orthographic projection matrix for each cascade
 		float lastSplitDist = 0.0;
 		for (uint32_t i = 0; i < SHADOW_MAP_CASCADE_COUNT; i++) {
@@ -788,20 +947,50 @@ public:
 				float distance = glm::length(frustumCorners[i] - frustumCenter);
 				radius = glm::max(radius, distance);
 			}
+			Cascade &cascade = cascades[i];
+
+			// Split distances always follow the camera
+			cascade.splitDepth = (camera.getNearClip() + splitDist * clipRange) * -1.0f;
+			lastSplitDist = cascadeSplits[i];
+
+			// The nearest cascade is always updated, farther cascades only if their cached layer no longer covers the split
+			bool update = force || !cacheCascades || (i == 0);
+			if (!update) {
+				const bool lightMoved = glm::dot(lightDir, cascade.lightDir) < lightThreshold;
+				const bool outsideBounds = glm::length(frustumCenter - cascade.center) + radius > cascade.radius;
+				const bool expired = (shadowFrame - cascade.lastUpdate) >= static_cast<uint32_t>(cascadeRefreshInterval);
+				update = lightMoved || outsideBounds || expired;
+			}
+			if (!update) {
+				continue;
+			}
+
+			if (cacheCascades && (i > 0)) {
+				radius *= 1.0f + cascadePadding;
+			}
 			radius = std::ceil(radius * 16.0f) / 16.0f;
 
 			glm::vec3 maxExtents = glm::vec3(radius);
 			glm::vec3 minExtents = -maxExtents;
 
-			glm::vec3 lightDir = normalize(-lightPos);
 			glm::mat4 lightViewMatrix = glm::lookAt(frustumCenter - lightDir * -minExtents.z, frustumCenter, glm::vec3(0.0f, 1.0f, 0.0f));
 			glm::mat4 lightOrthoMatrix = glm::ortho(minExtents.x, maxExtents.x, minExtents.y, maxExtents.y, 0.0f, maxExtents.z - minExtents.z);
 
-			// Store split distance and matrix in cascade
-			cascades[i].splitDepth = (camera.getNearClip() + splitDist * clipRange) * -1.0f;
-			cascades[i].viewProjMatrix = lightOrthoMatrix * lightViewMatrix;
-
-			lastSplitDist = cascadeSplits[i];
+			// Snap the projection to whole shadow map texels, so the depth layer does not shimmer when the camera moves
+			glm::vec4 shadowOrigin = (lightOrthoMatrix * lightViewMatrix) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+			shadowOrigin *= (float)SHADOWMAP_DIM / 2.0f;
+			glm::vec4 roundOffset = (glm::round(shadowOrigin) - shadowOrigin) * (2.0f / (float)SHADOWMAP_DIM);
+			roundOffset.z = 0.0f;
+			roundOffset.w = 0.0f;
+			lightOrthoMatrix[3] += roundOffset;
+
+			// Store matrix and the bounds the depth layer is rendered with in cascade
+			cascade.viewProjMatrix = lightOrthoMatrix * lightViewMatrix;
+			cascade.center = frustumCenter;
+			cascade.radius = radius;
+			cascade.lightDir = lightDir;
+			cascade.lastUpdate = shadowFrame;
+			cascade.update = true;
 		}
 	}
 
@@ -846,10 +1035,16 @@ public:
 	void draw()
 	{
 		VulkanExampleBase::prepareFrame();
+		recordCommandBuffer(currentBuffer);
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
 		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
 		VulkanExampleBase::submitFrame();
+		// Depth layers rendered in this frame are now cached
+		for (auto &cascade : cascades) {
+			cascade.update = false;
+		}
+		shadowFrame++;
 	}
 
 	void prepare()
@@ -857,12 +1052,12 @@ public:
 		VulkanExampleBase::prepare();
 		loadAssets();
 		updateLight();
-		updateCascades();
+		updateCascades(true);
 		prepareDepthPass();
+		prepareCascadeCommandBuffers();
 		prepareUniformBuffers();
 		setupLayoutsAndDescriptors();
 		preparePipelines();
-		buildCommandBuffers();
 		prepared = true;
 	}
 
@@ -882,23 +1077,34 @@ public:
 	{
 		if (overlay->header("Settings")) {
 			if (overlay->sliderFloat("Split lambda", &cascadeSplitLambda, 0.1f, 1.0f)) {
-				updateCascades();
+				updateCascades(true);
 				updateUniformBuffers();
 			}
 			if (overlay->checkBox("Color cascades", &colorCascades)) {
 				updateUniformBuffers();
 			}
-			if (overlay->checkBox("Display depth map", &displayDepthMap)) {
-				buildCommandBuffers();
-			}
+			overlay->checkBox("Display depth map", &displayDepthMap);
 			if (displayDepthMap) {
-				if (overlay->sliderInt("Cascade", &displayDepthMapCascadeIndex, 0, SHADOW_MAP_CASCADE_COUNT - 1)) {
-					buildCommandBuffers();
-				}
+				overlay->sliderInt("Cascade", &displayDepthMapCascadeIndex, 0, SHADOW_MAP_CASCADE_COUNT - 1);
+			}
+			overlay->checkBox("PCF filtering", &filterPCF);
+			if (overlay->checkBox("Cache cascades", &cacheCascades)) {
+				// Cached cascades use padded bounds, so all matrices need to be recalculated
+				updateCascades(true);
+				updateUniformBuffers();
+			}
+			if (cacheCascades) {
+				overlay->sliderInt("Refresh interval", &cascadeRefreshInterval, 1, 64);
 			}
-			if (overlay->checkBox("PCF filtering", &filterPCF)) {
-				buildCommandBuffers();
+			overlay->checkBox("Cull per cascade", &cullCascades);
+			overlay->checkBox("Multithreaded recording", &multithreadedRecording);
+		}
+		if (overlay->header("Statistics")) {
+			overlay->text("Cascades rendered: %d / %d", stats.cascadesRendered, SHADOW_MAP_CASCADE_COUNT);
+			for (uint32_t i = 0; i < SHADOW_MAP_CASCADE_COUNT; i++) {
+				overlay->text("Cascade %d: %d / %d objects", i, cascades[i].visibleObjects, static_cast<uint32_t>(sceneObjects.size()));
 			}
+			overlay->text("Recording: %.3f ms", stats.recordingTime);
 		}
 	}
 };
@@ -12,6 +12,8 @@
 #include <assert.h>
 #include <vector>
 #include <map>
+#include <algorithm>
+#include <chrono>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -87,15 +89,41 @@ struct VertexBoneData
 struct BoneInfo
 {
 	aiMatrix4x4 offset;
-	aiMatrix4x4 finalTransformation;
 
 	BoneInfo()
 	{
 		offset = aiMatrix4x4();
-		finalTransformation = aiMatrix4x4();
 	};
 };
 
+// Node of the flattened node hierarchy
+// Nodes are stored in depth-first order, so parents are always evaluated before their children
+struct HierarchyNode
+{
+	// Index of the parent node, -1 for the root node
+	int32_t parent;
+	// Index of the animation channel driving this node, -1 if not animated
+	int32_t channel;
+	// Index of the bone attached to this node, -1 if none
+	int32_t bone;
+	// Static node transformation used if the node is not animated
+	aiMatrix4x4 transformation;
+};
+
+// Playback state for one animated instance of a skinned mesh
+// All storage is allocated in SkinnedMesh::initAnimationState, so updates don't allocate
+struct AnimationState
+{
+	// Last used keyframe per channel, the key search starts at these cursors
+	std::vector<uint32_t> positionCursors;
+	std::vector<uint32_t> rotationCursors;
+	std::vector<uint32_t> scalingCursors;
+	// Global transformations per hierarchy node
+	std::vector<aiMatrix4x4> globalTransforms;
+	// Final bone transformations
+	std::vector<aiMatrix4x4> boneTransforms;
+};
+
 class SkinnedMesh 
 {
 public:
@@ -110,8 +138,10 @@ public:
 	aiMatrix4x4 globalInverseTransform;
 	// Per-vertex bone info
 	std::vector<VertexBoneData> bones;
-	// Bone transformations
-	std::vector<aiMatrix4x4> boneTransforms;
+	// Flattened node hierarchy, compiled at load time so no names are looked up during playback
+	std::vector<HierarchyNode> nodes;
+	// Playback state of the rendered instance
+	AnimationState animationState;
 
 	// Modifier for the animation 
 	float animationSpeed = 0.75f;
@@ -164,22 +194,63 @@ public:
 				Bones[vertexID].add(index, pMesh->mBones[i]->mWeights[j].mWeight);
 			}
 		}
-		boneTransforms.resize(numBones);
 	}
 
-	// Recursive bone transformation for given animation time
+	// Flatten the node hierarchy of the scene and resolve the channel and bone of each node
+	// Must be called after all bones have been loaded and whenever the active animation changes
+	void compileHierarchy()
+	{
+		nodes.clear();
+		compileNode(scene->mRootNode, -1);
+		initAnimationState(animationState);
+	}
+
+	// Allocate the playback state of an instance
+	void initAnimationState(AnimationState& state)
+	{
+		state.positionCursors.assign(pAnimation->mNumChannels, 0);
+		state.rotationCursors.assign(pAnimation->mNumChannels, 0);
+		state.scalingCursors.assign(pAnimation->mNumChannels, 0);
+		state.globalTransforms.resize(nodes.size());
+		state.boneTransforms.resize(numBones);
+	}
+
+	// Update the rendered instance for given animation time
 	void update(float time)
 	{
-		float TicksPerSecond = (float)(scene->mAnimations[0]->mTicksPerSecond != 0 ? scene->mAnimations[0]->mTicksPerSecond : 25.0f);
-		float TimeInTicks = time * TicksPerSecond;
-		float AnimationTime = fmod(TimeInTicks, (float)scene->mAnimations[0]->mDuration);
+		update(time, animationState);
+	}
 
-		aiMatrix4x4 identity = aiMatrix4x4();
-		readNodeHierarchy(AnimationTime, scene->mRootNode, identity);
+	// Update the bone transformations of an instance for given animation time
+	void update(float time, AnimationState& state)
+	{
+		float TicksPerSecond = (float)(pAnimation->mTicksPerSecond != 0 ? pAnimation->mTicksPerSecond : 25.0f);
+		float TimeInTicks = time * TicksPerSecond;
+		float AnimationTime = fmod(TimeInTicks, (float)pAnimation->mDuration);
 
-		for (uint32_t i = 0; i < boneTransforms.size(); i++)
+		for (size_t i = 0; i < nodes.size(); i++)
 		{
-			boneTransforms[i] = boneInfo[i].finalTransformation;
+			const HierarchyNode& node = nodes[i];
+
+			aiMatrix4x4 NodeTransformation(node.transformation);
+
+			if (node.channel >= 0)
+			{
+				const aiNodeAnim* pNodeAnim = pAnimation->mChannels[node.channel];
+				// Get interpolated matrices between current and next frame
+				aiMatrix4x4 matScale = interpolateScale(AnimationTime, pNodeAnim, state.scalingCursors[node.channel]);
+				aiMatrix4x4 matRotation = interpolateRotation(AnimationTime, pNodeAnim, state.rotationCursors[node.channel]);
+				aiMatrix4x4 matTranslation = interpolateTranslation(AnimationTime, pNodeAnim, state.positionCursors[node.channel]);
+
+				NodeTransformation = matTranslation * matRotation * matScale;
+			}
+
+			state.globalTransforms[i] = (node.parent >= 0) ? state.globalTransforms[node.parent] * NodeTransformation : NodeTransformation;
+
+			if (node.bone >= 0)
+			{
+				state.boneTransforms[node.bone] = globalInverseTransform * state.globalTransforms[i] * boneInfo[node.bone].offset;
+			}
 		}
 	}
 
@@ -190,22 +261,65 @@ public:
 	}
 
 private:
-	// Find animation for a given node
-	const aiNodeAnim* findNodeAnim(const aiAnimation* animation, const std::string nodeName)
+	void compileNode(const aiNode* pNode, int32_t parent)
 	{
-		for (uint32_t i = 0; i < animation->mNumChannels; i++)
+		HierarchyNode node;
+		node.parent = parent;
+		node.channel = -1;
+		node.bone = -1;
+		node.transformation = pNode->mTransformation;
+
+		for (uint32_t i = 0; i < pAnimation->mNumChannels; i++)
 		{
-			const aiNodeAnim* nodeAnim = animation->mChannels[i];
-			if (std::string(nodeAnim->mNodeName.data) == nodeName)
+			if (pAnimation->mChannels[i]->mNodeName == pNode->mName)
 			{
-				return nodeAnim;
+				node.channel = static_cast<int32_t>(i);
+				break;
 			}
 		}
-		return nullptr;
+
+		auto bone = boneMapping.find(std::string(pNode->mName.data));
+		if (bone != boneMapping.end())
+		{
+			node.bone = static_cast<int32_t>(bone->second);
+		}
+
+		int32_t index = static_cast<int32_t>(nodes.size());
+		nodes.push_back(node);
+
+		for (uint32_t i = 0; i < pNode->mNumChildren; i++)
+		{
+			compileNode(pNode->mChildren[i], index);
+		}
+	}
+
+	// Returns the index of the keyframe preceding the given time
+	// Playback usually moves forward by less than a keyframe per update, so the search continues from the last position
+	template <typename T>
+	uint32_t findKeyframe(float time, const T* keys, uint32_t numKeys, uint32_t& cursor)
+	{
+		// Animation wrapped around
+		if (cursor >= numKeys - 1 || time < (float)keys[cursor].mTime)
+		{
+			cursor = 0;
+		}
+		while (cursor < numKeys - 2 && time >= (float)keys[cursor + 1].mTime)
+		{
+			cursor++;
+		}
+		return cursor;
+	}
+
+	// Interpolation factor between two keyframes, clamped for times outside of the keyframe range
+	template <typename T>
+	float keyframeDelta(float time, const T& currentFrame, const T& nextFrame)
+	{
+		float delta = (time - (float)currentFrame.mTime) / (float)(nextFrame.mTime - currentFrame.mTime);
+		return std::min(std::max(delta, 0.0f), 1.0f);
 	}
 
 	// Returns a 4x4 matrix with interpolated translation between current and next frame
-	aiMatrix4x4 interpolateTranslation(float time, const aiNodeAnim* pNodeAnim)
+	aiMatrix4x4 interpolateTranslation(float time, const aiNodeAnim* pNodeAnim, uint32_t& cursor)
 	{
 		aiVector3D translation;
 
@@ -215,20 +329,12 @@ private:
 		}
 		else
 		{
-			uint32_t frameIndex = 0;
-			for (uint32_t i = 0; i < pNodeAnim->mNumPositionKeys - 1; i++)
-			{
-				if (time < (float)pNodeAnim->mPositionKeys[i + 1].mTime)
-				{
-					frameIndex = i;
-					break;
-				}
-			}
+			uint32_t frameIndex = findKeyframe(time, pNodeAnim->mPositionKeys, pNodeAnim->mNumPositionKeys, cursor);
 
-			aiVectorKey currentFrame = pNodeAnim->mPositionKeys[frameIndex];
-			aiVectorKey nextFrame = pNodeAnim->mPositionKeys[(frameIndex + 1) % pNodeAnim->mNumPositionKeys];
+			const aiVectorKey& currentFrame = pNodeAnim->mPositionKeys[frameIndex];
+			const aiVectorKey& nextFrame = pNodeAnim->mPositionKeys[frameIndex + 1];
 
-			float delta = (time - (float)currentFrame.mTime) / (float)(nextFrame.mTime - currentFrame.mTime);
+			float delta = keyframeDelta(time, currentFrame, nextFrame);
 
 			const aiVector3D& start = currentFrame.mValue;
 			const aiVector3D& end = nextFrame.mValue;
@@ -242,7 +348,7 @@ private:
 	}
 
 	// Returns a 4x4 matrix with interpolated rotation between current and next frame
-	aiMatrix4x4 interpolateRotation(float time, const aiNodeAnim* pNodeAnim)
+	aiMatrix4x4 interpolateRotation(float time, const aiNodeAnim* pNodeAnim, uint32_t& cursor)
 	{
 		aiQuaternion rotation;
 
@@ -252,20 +358,12 @@ private:
 		}
 		else
 		{
-			uint32_t frameIndex = 0;
-			for (uint32_t i = 0; i < pNodeAnim->mNumRotationKeys - 1; i++)
-			{
-				if (time < (float)pNodeAnim->mRotationKeys[i + 1].mTime)
-				{
-					frameIndex = i;
-					break;
-				}
-			}
+			uint32_t frameIndex = findKeyframe(time, pNodeAnim->mRotationKeys, pNodeAnim->mNumRotationKeys, cursor);
 
-			aiQuatKey currentFrame = pNodeAnim->mRotationKeys[frameIndex];
-			aiQuatKey nextFrame = pNodeAnim->mRotationKeys[(frameIndex + 1) % pNodeAnim->mNumRotationKeys];
+			const aiQuatKey& currentFrame = pNodeAnim->mRotationKeys[frameIndex];
+			const aiQuatKey& nextFrame = pNodeAnim->mRotationKeys[frameIndex + 1];
 
-			float delta = (time - (float)currentFrame.mTime) / (float)(nextFrame.mTime - currentFrame.mTime);
+			float delta = keyframeDelta(time, currentFrame, nextFrame);
 
 			const aiQuaternion& start = currentFrame.mValue;
 			const aiQuaternion& end = nextFrame.mValue;
@@ -280,7 +378,7 @@ private:
 
 
 	// Returns a 4x4 matrix with interpolated scaling between current and next frame
-	aiMatrix4x4 interpolateScale(float time, const aiNodeAnim* pNodeAnim)
+	aiMatrix4x4 interpolateScale(float time, const aiNodeAnim* pNodeAnim, uint32_t& cursor)
 	{
 		aiVector3D scale;
 
@@ -290,20 +388,12 @@ private:
 		}
 		else
 		{
-			uint32_t frameIndex = 0;
-			for (uint32_t i = 0; i < pNodeAnim->mNumScalingKeys - 1; i++)
-			{
-				if (time < (float)pNodeAnim->mScalingKeys[i + 1].mTime)
-				{
-					frameIndex = i;
-					break;
-				}
-			}
+			uint32_t frameIndex = findKeyframe(time, pNodeAnim->mScalingKeys, pNodeAnim->mNumScalingKeys, cursor);
 
-			aiVectorKey currentFrame = pNodeAnim->mScalingKeys[frameIndex];
-			aiVectorKey nextFrame = pNodeAnim->mScalingKeys[(frameIndex + 1) % pNodeAnim->mNumScalingKeys];
+			const aiVectorKey& currentFrame = pNodeAnim->mScalingKeys[frameIndex];
+			const aiVectorKey& nextFrame = pNodeAnim->mScalingKeys[frameIndex + 1];
 
-			float delta = (time - (float)currentFrame.mTime) / (float)(nextFrame.mTime - currentFrame.mTime);
+			float delta = keyframeDelta(time, currentFrame, nextFrame);
 
 			const aiVector3D& start = currentFrame.mValue;
 			const aiVector3D& end = nextFrame.mValue;
@@ -315,39 +405,6 @@ private:
 		aiMatrix4x4::Scaling(scale, mat);
 		return mat;
 	}
-
-	// Get node hierarchy for current animation time
-	void readNodeHierarchy(float AnimationTime, const aiNode* pNode, const aiMatrix4x4& ParentTransform)
-	{
-		std::string NodeName(pNode->mName.data);
-
-		aiMatrix4x4 NodeTransformation(pNode->mTransformation);
-
-		const aiNodeAnim* pNodeAnim = findNodeAnim(pAnimation, NodeName);
-
-		if (pNodeAnim)
-		{
-			// Get interpolated matrices between current and next frame
-			aiMatrix4x4 matScale = interpolateScale(AnimationTime, pNodeAnim);
-			aiMatrix4x4 matRotation = interpolateRotation(AnimationTime, pNodeAnim);
-			aiMatrix4x4 matTranslation = interpolateTranslation(AnimationTime, pNodeAnim);
-
-			NodeTransformation = matTranslation * matRotation * matScale;
-		}
-
-		aiMatrix4x4 GlobalTransformation = ParentTransform * NodeTransformation;
-
-		if (boneMapping.find(NodeName) != boneMapping.end())
-		{
-			uint32_t BoneIndex = boneMapping[NodeName];
-			boneInfo[BoneIndex].finalTransformation = globalInverseTransform * GlobalTransformation * boneInfo[BoneIndex].offset;
-		}
-
-		for (uint32_t i = 0; i < pNode->mNumChildren; i++)
-		{
-			readNodeHierarchy(AnimationTime, pNode->mChildren[i], GlobalTransformation);
-		}
-	}
 };
 
 class VulkanExample : public VulkanExampleBase
@@ -403,6 +460,17 @@ public:
 
 	float runningTime = 0.0f;
 
+	// Many-instance mode for measuring the CPU cost of animation updates
+	// Only the first instance is rendered, additional instances are evaluated with per-instance time offsets
+	struct {
+		int32_t count = 1;
+		// Playback states of the additional instances (the first one is owned by the skinned mesh)
+		std::vector<AnimationState> states;
+		std::vector<float> timeOffsets;
+		// Averaged CPU time for updating all instances (ms)
+		float updateTime = 0.0f;
+	} instances;
+
 	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
 	{
 		zoom = -150.0f;
@@ -412,6 +480,12 @@ public:
 		title = "Skeletal animation (GPU skinning)";
 		cameraPos = { 0.0f, 0.0f, 12.0f };
 		settings.overlay = true;
+		// "-instances <count>" sets the number of animated instances at startup
+		for (size_t i = 0; i < args.size(); i++) {
+			if ((std::string(args[i]) == "-instances") && (i + 1 < args.size())) {
+				instances.count = std::max(atoi(args[i + 1]), 1);
+			}
+		}
 	}
 
 	~VulkanExample()
@@ -502,8 +576,6 @@ public:
 			vkCmdBindIndexBuffer(drawCmdBuffers[i], models.floor.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
 			vkCmdDrawIndexed(drawCmdBuffers[i], models.floor.indexCount, 1, 0, 0, 0);
 
-			drawUI(drawCmdBuffers[i]);
-
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
 
 			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
@@ -558,6 +630,8 @@ public:
 			}
 			vertexBase += skinnedMesh->scene->mMeshes[m]->mNumVertices;
 		}
+		skinnedMesh->compileHierarchy();
+		setInstanceCount(instances.count);
 
 		// Generate vertex buffer
 		std::vector<Vertex> vertexBuffer;
@@ -957,10 +1031,19 @@ public:
 		}
 
 		// Update bones
+		auto tStart = std::chrono::high_resolution_clock::now();
 		skinnedMesh->update(runningTime);
-		for (uint32_t i = 0; i < skinnedMesh->boneTransforms.size(); i++)
+		for (size_t i = 0; i < instances.states.size(); i++)
 		{
-			uboVS.bones[i] = glm::transpose(glm::make_mat4(&skinnedMesh->boneTransforms[i].a1));
+			skinnedMesh->update(runningTime + instances.timeOffsets[i], instances.states[i]);
+		}
+		float tDiff = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+		instances.updateTime = (instances.updateTime == 0.0f) ? tDiff : glm::mix(instances.updateTime, tDiff, 0.05f);
+
+		const std::vector<aiMatrix4x4>& boneTransforms = skinnedMesh->animationState.boneTransforms;
+		for (uint32_t i = 0; i < boneTransforms.size(); i++)
+		{
+			uboVS.bones[i] = glm::transpose(glm::make_mat4(&boneTransforms[i].a1));
 		}
 
 		uniformBuffers.mesh.copyTo(&uboVS, sizeof(uboVS));
@@ -1017,11 +1100,37 @@ public:
 		skinnedMesh->animationSpeed += delta;
 	}
 
+	void setInstanceCount(int32_t count)
+	{
+		instances.count = count;
+		size_t additionalCount = static_cast<size_t>(std::max(count - 1, 0));
+		size_t oldCount = instances.states.size();
+		instances.states.resize(additionalCount);
+		instances.timeOffsets.resize(additionalCount);
+		for (size_t i = oldCount; i < additionalCount; i++)
+		{
+			skinnedMesh->initAnimationState(instances.states[i]);
+			// Spread the instances over the animation so their keyframe cursors differ
+			instances.timeOffsets[i] = (float)(i + 1) * 0.37f;
+		}
+		instances.updateTime = 0.0f;
+	}
+
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
 	{
 		if (overlay->header("Settings")) {
 			overlay->sliderFloat("Animation speed", &skinnedMesh->animationSpeed, 0.0f, 10.0f);
 		}
+		if (overlay->header("CPU animation")) {
+			if (overlay->sliderInt("Instances", &instances.count, 1, 1024)) {
+				setInstanceCount(instances.count);
+			}
+			overlay->text("%d bones, %d nodes", (int32_t)skinnedMesh->numBones, (int32_t)skinnedMesh->nodes.size());
+			overlay->text("Update: %.3f ms", instances.updateTime);
+			if (instances.updateTime > 0.0f) {
+				overlay->text("%.0f instances/s", (float)instances.count * 1000.0f / instances.updateTime);
+			}
+		}
 	}
 };
 
@@ -24,6 +24,8 @@
 #include "VulkanTexture.hpp"
 #include "VulkanModel.hpp"
 #include "frustum.hpp"
+#include "VulkanHeightmap.hpp"
+#include "VulkanTerrainStreamer.hpp"
 #include <ktx.h>
 #include <ktxvulkan.h>
 
@@ -35,6 +37,20 @@ class VulkanExample : public VulkanExampleBase
 public:
 	bool wireframe = false;
 	bool tessellation = true;
+	// Render the terrain as chunks with a CPU generated level of detail chain instead of tessellating it
+	bool chunkedLod = false;
+	// Maximum geometric error of the chunk level of detail selection in pixels
+	float maxScreenError = 2.0f;
+	// Resolution the height map is resampled to for the chunked terrain (0 = source resolution)
+	uint32_t terrainSize = 0;
+	vks::HeightMap *chunkedTerrain = nullptr;
+	// Stream the height map in tiles around the camera instead of using a single texture
+	bool streaming = false;
+	// Tiled version of the height map, created from the KTX height map if it doesn't exist
+	std::string tileFile = "terrain_heightmap.tiles";
+	// Device memory budget for streamed tiles in MB
+	uint32_t streamingBudget = 2;
+	vks::TerrainStreamer *terrainStreamer = nullptr;
 
 	struct {
 		vks::Texture2D heightMap;
@@ -81,21 +97,28 @@ public:
 		VkPipeline terrain;
 		VkPipeline wireframe = VK_NULL_HANDLE;
 		VkPipeline skysphere;
+		VkPipeline chunked = VK_NULL_HANDLE;
+		VkPipeline chunkedWireframe = VK_NULL_HANDLE;
+		VkPipeline streaming = VK_NULL_HANDLE;
+		VkPipeline streamingWireframe = VK_NULL_HANDLE;
 	} pipelines;
 
 	struct {
 		VkDescriptorSetLayout terrain;
 		VkDescriptorSetLayout skysphere;
+		VkDescriptorSetLayout streaming = VK_NULL_HANDLE;
 	} descriptorSetLayouts;
 
 	struct {
 		VkPipelineLayout terrain;
 		VkPipelineLayout skysphere;
+		VkPipelineLayout streaming = VK_NULL_HANDLE;
 	} pipelineLayouts;
 
 	struct {
 		VkDescriptorSet terrain;
 		VkDescriptorSet skysphere;
+		VkDescriptorSet streaming;
 	} descriptorSets;
 
 	// Pipeline statistics
@@ -118,26 +141,48 @@ public:
 		camera.setTranslation(glm::vec3(18.0f, 22.5f, 57.5f));
 		camera.movementSpeed = 7.5f;
 		settings.overlay = true;
+		// "-chunkedlod" starts with the chunked terrain, "-terrainsize <n>" resamples its height map (e.g. 8192)
+		for (size_t i = 0; i < args.size(); i++) {
+			if (std::string(args[i]) == "-chunkedlod") {
+				chunkedLod = true;
+			}
+			if ((std::string(args[i]) == "-terrainsize") && (i + 1 < args.size())) {
+				terrainSize = std::max(atoi(args[i + 1]), 0);
+			}
+			// "-streaming" streams the height map from "-terraintiles <file>" with a budget of "-streamingbudget <MB>"
+			if (std::string(args[i]) == "-streaming") {
+				streaming = true;
+			}
+			if ((std::string(args[i]) == "-terraintiles") && (i + 1 < args.size())) {
+				tileFile = args[i + 1];
+			}
+			if ((std::string(args[i]) == "-streamingbudget") && (i + 1 < args.size())) {
+				streamingBudget = std::max(atoi(args[i + 1]), 1);
+			}
+		}
+		if (streaming && chunkedLod) {
+			chunkedLod = false;
+		}
 	}
 
 	~VulkanExample()
 	{
 		// Clean up used Vulkan resources 
 		// Note : Inherited destructor cleans up resources stored in base class
-		vkDestroyPipeline(device, pipelines.terrain, nullptr);
-		if (pipelines.wireframe != VK_NULL_HANDLE) {
-			vkDestroyPipeline(device, pipelines.wireframe, nullptr);
-		}
-		vkDestroyPipeline(device, pipelines.skysphere, nullptr);
+		destroyPipelines();
 
 		vkDestroyPipelineLayout(device, pipelineLayouts.skysphere, nullptr);
 		vkDestroyPipelineLayout(device, pipelineLayouts.terrain, nullptr);
+		vkDestroyPipelineLayout(device, pipelineLayouts.streaming, nullptr);
 
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.terrain, nullptr);
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.skysphere, nullptr);
+		vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.streaming, nullptr);
 
 		models.terrain.destroy();
 		models.skysphere.destroy();
+		delete chunkedTerrain;
+		delete terrainStreamer;
 
 		uniformBuffers.skysphereVertex.destroy();
 		uniformBuffers.terrainTessellation.destroy();
@@ -153,6 +198,18 @@ public:
 		}
 	}
 
+	void destroyPipelines()
+	{
+		vkDestroyPipeline(device, pipelines.terrain, nullptr);
+		vkDestroyPipeline(device, pipelines.wireframe, nullptr);
+		vkDestroyPipeline(device, pipelines.skysphere, nullptr);
+		vkDestroyPipeline(device, pipelines.chunked, nullptr);
+		vkDestroyPipeline(device, pipelines.chunkedWireframe, nullptr);
+		vkDestroyPipeline(device, pipelines.streaming, nullptr);
+		vkDestroyPipeline(device, pipelines.streamingWireframe, nullptr);
+		pipelines = {};
+	}
+
 	// Enable physical device features required for this example				
 	virtual void getEnabledFeatures()
 	{
@@ -171,6 +228,10 @@ public:
 		if (deviceFeatures.pipelineStatisticsQuery) {
 			enabledFeatures.pipelineStatisticsQuery = VK_TRUE;
 		};
+		// Draw all terrain chunks with a single indirect call if supported
+		if (deviceFeatures.multiDrawIndirect) {
+			enabledFeatures.multiDrawIndirect = VK_TRUE;
+		};
 		// Enable anisotropic filtering if supported
 		if (deviceFeatures.samplerAnisotropy) {
 			enabledFeatures.samplerAnisotropy = VK_TRUE;
@@ -367,18 +428,31 @@ public:
 				vkCmdBeginQuery(drawCmdBuffers[i], queryPool, 0, 0);
 			}
 			// Render
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, wireframe ? pipelines.wireframe : pipelines.terrain);
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.terrain, 0, 1, &descriptorSets.terrain, 0, NULL);
-			vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &models.terrain.vertices.buffer, offsets);
-			vkCmdBindIndexBuffer(drawCmdBuffers[i], models.terrain.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdDrawIndexed(drawCmdBuffers[i], models.terrain.indexCount, 1, 0, 0, 0);
+			if (streaming) {
+				// Same patches as the tessellated terrain, heights come from the streamed tiles
+				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, wireframe ? pipelines.streamingWireframe : pipelines.streaming);
+				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.streaming, 0, 1, &descriptorSets.streaming, 0, NULL);
+				vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &models.terrain.vertices.buffer, offsets);
+				vkCmdBindIndexBuffer(drawCmdBuffers[i], models.terrain.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+				vkCmdDrawIndexed(drawCmdBuffers[i], models.terrain.indexCount, 1, 0, 0, 0);
+			} else if (chunkedLod) {
+				// Level of detail and visibility are selected on the CPU and passed via the indirect buffer
+				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, wireframe ? pipelines.chunkedWireframe : pipelines.chunked);
+				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.terrain, 0, 1, &descriptorSets.terrain, 0, NULL);
+				vkCmdPushConstants(drawCmdBuffers[i], pipelineLayouts.terrain, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(vks::HeightMap::ChunkPushConstants), &chunkedTerrain->chunks.pushConstants);
+				chunkedTerrain->drawChunks(drawCmdBuffers[i]);
+			} else {
+				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, wireframe ? pipelines.wireframe : pipelines.terrain);
+				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.terrain, 0, 1, &descriptorSets.terrain, 0, NULL);
+				vkCmdBindVertexBuffers(drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &models.terrain.vertices.buffer, offsets);
+				vkCmdBindIndexBuffer(drawCmdBuffers[i], models.terrain.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+				vkCmdDrawIndexed(drawCmdBuffers[i], models.terrain.indexCount, 1, 0, 0, 0);
+			}
 			if (deviceFeatures.pipelineStatisticsQuery) {
 				// End pipeline statistics query
 				vkCmdEndQuery(drawCmdBuffers[i], queryPool, 0);
 			}
 
-			drawUI(drawCmdBuffers[i]);
-
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
 
 			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
@@ -595,19 +669,94 @@ public:
 		delete[] indices;
 	}
 
+	// Generate the chunked terrain with its level of detail chains from the height map
+	void generateChunkedTerrain()
+	{
+		chunkedTerrain = new vks::HeightMap(vulkanDevice, queue);
+#if defined(__ANDROID__)
+		chunkedTerrain->loadHeightData(getAssetPath() + "textures/terrain_heightmap_r16.ktx", androidApp->activity->assetManager);
+#else
+		chunkedTerrain->loadHeightData(getAssetPath() + "textures/terrain_heightmap_r16.ktx");
+#endif
+		if ((terrainSize > 1) && (terrainSize != chunkedTerrain->getDim())) {
+			chunkedTerrain->resample(terrainSize);
+		}
+		// Covers the same area as the tessellated patches (64 patches of two units)
+		chunkedTerrain->createChunks(64, 6, 128.0f, uboTess.displacementFactor);
+		updateUniformBuffers();
+	}
+
+	// Set up streaming of the height map tiles around the camera
+	bool prepareStreaming()
+	{
+		terrainStreamer = new vks::TerrainStreamer();
+		terrainStreamer->settings.memoryBudget = (VkDeviceSize)streamingBudget * 1024 * 1024;
+		terrainStreamer->settings.loadRadius = 24.0f;
+		if (!terrainStreamer->open(tileFile, vulkanDevice, queue)) {
+			// Convert the height map into the tiled format on first use
+			vks::HeightMap heightMap(vulkanDevice, queue);
+#if defined(__ANDROID__)
+			heightMap.loadHeightData(getAssetPath() + "textures/terrain_heightmap_r16.ktx", androidApp->activity->assetManager);
+#else
+			heightMap.loadHeightData(getAssetPath() + "textures/terrain_heightmap_r16.ktx");
+#endif
+			if ((terrainSize > 1) && (terrainSize != heightMap.getDim())) {
+				heightMap.resample(terrainSize);
+			}
+			if (!vks::TerrainStreamer::writeTiledFile(tileFile, heightMap.getHeightData().data(), heightMap.getDim(), 64) || !terrainStreamer->open(tileFile, vulkanDevice, queue)) {
+				std::cerr << "Could not create tiled height map \"" << tileFile << "\", streaming disabled" << std::endl;
+				delete terrainStreamer;
+				terrainStreamer = nullptr;
+				return false;
+			}
+		}
+		// Same area as the tessellated patches
+		terrainStreamer->setWorldMapping(glm::vec2(-64.0f), 128.0f);
+
+		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+			// Binding 0 : Shared Tessellation shader ubo
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT, 0),
+			// Binding 1 : Streamed height tiles
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 1),
+			// Binding 2 : Terrain texture array layers
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 2),
+			// Binding 3 : Height map overview for tiles that are not resident
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 3),
+			// Binding 4 : Tile table
+			vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 4),
+		};
+		VkDescriptorSetLayoutCreateInfo descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), static_cast<uint32_t>(setLayoutBindings.size()));
+		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &descriptorSetLayouts.streaming));
+		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayouts.streaming, 1);
+		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayouts.streaming));
+
+		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayouts.streaming, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets.streaming));
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+			vks::initializers::writeDescriptorSet(descriptorSets.streaming, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.terrainTessellation.descriptor),
+			vks::initializers::writeDescriptorSet(descriptorSets.streaming, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &terrainStreamer->descriptor),
+			vks::initializers::writeDescriptorSet(descriptorSets.streaming, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &textures.terrainArray.descriptor),
+			vks::initializers::writeDescriptorSet(descriptorSets.streaming, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3, &terrainStreamer->overview.descriptor),
+			vks::initializers::writeDescriptorSet(descriptorSets.streaming, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, &terrainStreamer->tileTable.descriptor),
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+		return true;
+	}
+
 	void setupDescriptorPool()
 	{
 		std::vector<VkDescriptorPoolSize> poolSizes =
 		{
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3)
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 4),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 6),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1)
 		};
 
 		VkDescriptorPoolCreateInfo descriptorPoolInfo =
 			vks::initializers::descriptorPoolCreateInfo(
 				static_cast<uint32_t>(poolSizes.size()),
 				poolSizes.data(),
-				2);
+				3);
 
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
 	}
@@ -621,10 +770,10 @@ public:
 		// Terrain
 		setLayoutBindings =
 		{
-			// Binding 0 : Shared Tessellation shader ubo
+			// Binding 0 : Shared Tessellation shader ubo (also used by the chunked terrain vertex shader)
 			vks::initializers::descriptorSetLayoutBinding(
 				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 
-				VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT,
+				VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT,
 				0),
 			// Binding 1 : Height map
 			vks::initializers::descriptorSetLayoutBinding(
@@ -641,6 +790,10 @@ public:
 		descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), static_cast<uint32_t>(setLayoutBindings.size()));
 		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &descriptorSetLayouts.terrain));
 		pipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayouts.terrain, 1);
+		// Chunk layout for the chunked terrain
+		VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_VERTEX_BIT, sizeof(vks::HeightMap::ChunkPushConstants), 0);
+		pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+		pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
 		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayouts.terrain));
 
 		// Skysphere
@@ -824,12 +977,64 @@ public:
 			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.wireframe));
 		};
 
-		// Skysphere pipeline
-		rasterizationState.polygonMode = VK_POLYGON_MODE_FILL;
+		// Streaming terrain pipeline (only created once streaming has been set up)
+		if (terrainStreamer) {
+			std::array<VkPipelineShaderStageCreateInfo, 4> streamingStages = {
+				loadShader(getAssetPath() + "shaders/terraintessellation/terrain.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
+				loadShader(getAssetPath() + "shaders/terraintessellation/terrain_streaming.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT),
+				loadShader(getAssetPath() + "shaders/terraintessellation/terrain_streaming.tesc.spv", VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT),
+				loadShader(getAssetPath() + "shaders/terraintessellation/terrain_streaming.tese.spv", VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT),
+			};
+			VkGraphicsPipelineCreateInfo streamingPipelineCI = pipelineCreateInfo;
+			streamingPipelineCI.layout = pipelineLayouts.streaming;
+			streamingPipelineCI.pStages = streamingStages.data();
+			streamingPipelineCI.stageCount = static_cast<uint32_t>(streamingStages.size());
+			rasterizationState.polygonMode = VK_POLYGON_MODE_FILL;
+			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &streamingPipelineCI, nullptr, &pipelines.streaming));
+			if (deviceFeatures.fillModeNonSolid) {
+				rasterizationState.polygonMode = VK_POLYGON_MODE_LINE;
+				VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &streamingPipelineCI, nullptr, &pipelines.streamingWireframe));
+			}
+		}
+
 		// Revert to triangle list topology
 		inputAssemblyState.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 		// Reset tessellation state
 		pipelineCreateInfo.pTessellationState = nullptr;
+
+		// Chunked terrain pipeline (only created once the chunked terrain has been generated)
+		// Compact vertices with the grid position derived from the vertex index
+		std::vector<VkVertexInputBindingDescription> chunkInputBindings = {
+			vks::initializers::vertexInputBindingDescription(0, sizeof(vks::HeightMap::ChunkVertex), VK_VERTEX_INPUT_RATE_VERTEX),
+		};
+		std::vector<VkVertexInputAttributeDescription> chunkInputAttributes = {
+			vks::initializers::vertexInputAttributeDescription(0, 0, VK_FORMAT_R16_UNORM, offsetof(vks::HeightMap::ChunkVertex, height)),	// Height
+			vks::initializers::vertexInputAttributeDescription(0, 1, VK_FORMAT_R8G8_SNORM, offsetof(vks::HeightMap::ChunkVertex, normal)),	// Normal (xz)
+		};
+		VkPipelineVertexInputStateCreateInfo chunkInputState = vks::initializers::pipelineVertexInputStateCreateInfo();
+		chunkInputState.vertexBindingDescriptionCount = static_cast<uint32_t>(chunkInputBindings.size());
+		chunkInputState.pVertexBindingDescriptions = chunkInputBindings.data();
+		chunkInputState.vertexAttributeDescriptionCount = static_cast<uint32_t>(chunkInputAttributes.size());
+		chunkInputState.pVertexAttributeDescriptions = chunkInputAttributes.data();
+		if (chunkedTerrain) {
+			pipelineCreateInfo.pVertexInputState = &chunkInputState;
+			// Skirts are seen from both sides
+			rasterizationState.cullMode = VK_CULL_MODE_NONE;
+			rasterizationState.polygonMode = VK_POLYGON_MODE_FILL;
+			pipelineCreateInfo.stageCount = 2;
+			shaderStages[0] = loadShader(getAssetPath() + "shaders/terraintessellation/terrain_chunk.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+			shaderStages[1] = loadShader(getAssetPath() + "shaders/terraintessellation/terrain.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.chunked));
+			if (deviceFeatures.fillModeNonSolid) {
+				rasterizationState.polygonMode = VK_POLYGON_MODE_LINE;
+				VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.chunkedWireframe));
+			};
+			pipelineCreateInfo.pVertexInputState = &vertexInputState;
+			rasterizationState.cullMode = VK_CULL_MODE_BACK_BIT;
+		}
+
+		// Skysphere pipeline
+		rasterizationState.polygonMode = VK_POLYGON_MODE_FILL;
 		// Don't write to depth buffer
 		depthStencilState.depthWriteEnable = VK_FALSE;
 		pipelineCreateInfo.stageCount = 2;
@@ -889,6 +1094,11 @@ public:
 			uboTess.tessellationFactor = savedFactor;
 		}
 
+		// Select chunk levels of detail for the new view
+		if (chunkedLod && chunkedTerrain) {
+			chunkedTerrain->updateChunks(camera.matrices.perspective, camera.matrices.view, (float)height, maxScreenError);
+		}
+
 		// Skysphere vertex shader
 		uboVS.mvp = camera.matrices.perspective * glm::mat4(glm::mat3(camera.matrices.view));
 		memcpy(uniformBuffers.skysphereVertex.mapped, &uboVS, sizeof(uboVS));
@@ -918,14 +1128,20 @@ public:
 		VulkanExampleBase::prepare();
 		loadAssets();
 		generateTerrain();
+		if (chunkedLod) {
+			generateChunkedTerrain();
+		}
 		if (deviceFeatures.pipelineStatisticsQuery) {
 			setupQueryResultBuffer();
 		}
 		prepareUniformBuffers();
 		setupDescriptorSetLayouts();
-		preparePipelines();
 		setupDescriptorPool();
 		setupDescriptorSets();
+		if (streaming) {
+			streaming = prepareStreaming();
+		}
+		preparePipelines();
 		buildCommandBuffers();
 		prepared = true;
 	}
@@ -934,6 +1150,10 @@ public:
 	{
 		if (!prepared)
 			return;
+		if (streaming) {
+			// Camera position is stored negated for the first person camera
+			terrainStreamer->update(glm::vec3(glm::inverse(camera.matrices.view)[3]), -camera.velocity);
+		}
 		draw();
 	}
 
@@ -957,6 +1177,61 @@ public:
 					buildCommandBuffers();
 				}
 			}
+			if (overlay->checkBox("Streaming", &streaming)) {
+				if (streaming && !terrainStreamer) {
+					vkDeviceWaitIdle(device);
+					if (prepareStreaming()) {
+						// Pipelines for the streamed terrain are only created on demand
+						destroyPipelines();
+						preparePipelines();
+					} else {
+						streaming = false;
+					}
+				}
+				if (streaming) {
+					chunkedLod = false;
+				}
+				buildCommandBuffers();
+			}
+			if (overlay->checkBox("Chunked LOD", &chunkedLod)) {
+				if (chunkedLod) {
+					streaming = false;
+				}
+				if (chunkedLod && !chunkedTerrain) {
+					generateChunkedTerrain();
+					// Pipelines for the chunked terrain are only created on demand
+					vkDeviceWaitIdle(device);
+					destroyPipelines();
+					preparePipelines();
+				}
+				updateUniformBuffers();
+				buildCommandBuffers();
+			}
+			if (chunkedLod) {
+				if (overlay->sliderFloat("Max. pixel error", &maxScreenError, 0.5f, 16.0f)) {
+					updateUniformBuffers();
+				}
+			}
+		}
+		if (chunkedLod && chunkedTerrain) {
+			if (overlay->header("Chunked terrain")) {
+				const uint32_t chunkCount = static_cast<uint32_t>(chunkedTerrain->chunks.boundingSpheres.size());
+				overlay->text("Heights: %d x %d", chunkedTerrain->getDim(), chunkedTerrain->getDim());
+				overlay->text("Visible chunks: %d / %d", chunkedTerrain->chunks.visibleCount, chunkCount);
+				overlay->text("Triangles: %d", (uint32_t)chunkedTerrain->chunks.triangleCount);
+				overlay->text("Generation: %.1f ms", chunkedTerrain->chunks.generationTime);
+			}
+		}
+		if (streaming && terrainStreamer) {
+			if (overlay->header("Terrain streaming")) {
+				const vks::TerrainStreamer::Statistics &stats = terrainStreamer->stats;
+				overlay->text("Resident tiles: %d / %d (%d total)", stats.residentTiles, terrainStreamer->getLayerCount(), terrainStreamer->getTileCount());
+				overlay->text("Pending tiles: %d", stats.pendingTiles);
+				overlay->text("Hit rate: %.1f %%", stats.hitRate() * 100.0f);
+				overlay->text("Load latency: %.2f ms (max %.2f ms)", stats.averageLatency, stats.maxLatency);
+				overlay->text("Evictions: %d", (uint32_t)stats.evictions);
+				overlay->text("Memory: %.2f MB (+ %.2f MB staging)", stats.deviceMemory / (1024.0f * 1024.0f), stats.stagingMemory / (1024.0f * 1024.0f));
+			}
 		}
 		if (deviceFeatures.pipelineStatisticsQuery) {
 			if (overlay->header("Pipeline statistics")) {
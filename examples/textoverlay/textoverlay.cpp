@@ -13,6 +13,9 @@
 #include <vector>
 #include <sstream>
 #include <iomanip>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -32,11 +35,17 @@
 #define VERTEX_BUFFER_BIND_ID 0
 #define ENABLE_VALIDATION false
 
-// Max. number of chars the text overlay buffer can hold
-#define TEXTOVERLAY_MAX_CHAR_COUNT 2048
+// Initial number of glyphs the text overlay instance buffer can hold, grows on demand
+#define TEXTOVERLAY_INITIAL_GLYPH_CAPACITY 4096
 
 /*
 	Mostly self-contained text overlay class
+
+	Every glyph is a single instance of a shared, indexed quad. Laid out strings ("runs") are cached by
+	text, position, alignment and color, and keep their range in the persistently mapped instance buffer
+	for as long as they are added each update. Only new or changed runs are laid out and written,
+	and the instance count is read from an indirect buffer, so the command buffers are only recorded
+	again if the instance buffer had to grow or the framebuffer changed.
 */
 class TextOverlay
 {
@@ -53,8 +62,6 @@ private:
 	VkSampler sampler;
 	VkImage image;
 	VkImageView view;
-	VkBuffer buffer;
-	VkDeviceMemory memory;
 	VkDeviceMemory imageMemory;
 	VkDescriptorPool descriptorPool;
 	VkDescriptorSetLayout descriptorSetLayout;
@@ -68,17 +75,194 @@ private:
 	std::vector<VkFramebuffer*> frameBuffers;
 	std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
 
-	// Pointer to mapped vertex buffer
-	glm::vec4 *mapped = nullptr;
+	// Per-instance glyph data
+	struct GlyphInstance {
+		// Glyph rectangle (x0, y0, x1, y1) in framebuffer pixels
+		glm::vec4 rect;
+		// Font texture coordinates (s0, t0, s1, t1), normalized
+		uint16_t uv[4];
+		// RGBA8
+		uint32_t color;
+	};
+
+	// Cache key for a laid out string
+	struct RunKey {
+		std::string text;
+		float x, y;
+		uint32_t align;
+		uint32_t color;
+		bool operator==(const RunKey &other) const {
+			return x == other.x && y == other.y && align == other.align && color == other.color && text == other.text;
+		}
+	};
+	struct RunKeyHash {
+		size_t operator()(const RunKey &key) const {
+			size_t hash = std::hash<std::string>()(key.text);
+			uint32_t bits[4] = { 0, 0, key.align, key.color };
+			memcpy(&bits[0], &key.x, sizeof(float));
+			memcpy(&bits[1], &key.y, sizeof(float));
+			for (auto b : bits) {
+				hash ^= std::hash<uint32_t>()(b) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+			}
+			return hash;
+		}
+	};
+	// Range of a cached run in the instance buffer
+	struct Run {
+		uint32_t first;
+		uint32_t count;
+		uint32_t lastUpdate;
+	};
+	struct GlyphRange {
+		uint32_t first;
+		uint32_t count;
+	};
+
+	std::unordered_map<RunKey, Run, RunKeyHash> runs;
+	// Unused ranges below the high water mark
+	std::vector<GlyphRange> freeRanges;
+	uint32_t freeGlyphs = 0;
+	// CPU copy of the instance buffer, so compaction and growing never read back from mapped memory
+	std::vector<GlyphInstance> glyphs;
+	// Number of instances drawn (high water mark of all allocated ranges)
+	uint32_t glyphCount = 0;
+	uint32_t glyphCapacity = 0;
+	uint32_t updateIndex = 0;
+
+	// Persistently mapped instance buffer
+	vks::Buffer instanceBuffer;
+	// Index buffer for a single glyph quad
+	vks::Buffer indexBuffer;
+	// Holds the indexed indirect draw, the instance count is written by the host
+	vks::Buffer indirectBuffer;
+
+	// Framebuffer size the command buffers have been recorded for
+	uint32_t recordedWidth = 0;
+	uint32_t recordedHeight = 0;
+	bool commandBuffersDirty = true;
+
+	std::vector<GlyphInstance> layoutGlyphs;
+	std::chrono::time_point<std::chrono::high_resolution_clock> updateStart;
 
 	stb_fontchar stbFontData[STB_FONT_consolas_24_latin1_NUM_CHARS];
-	uint32_t numLetters;
+
+	// Allocates a range of instances, first fit from the free list or appended at the high water mark
+	uint32_t allocateGlyphs(uint32_t count)
+	{
+		for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+			if (it->count >= count) {
+				uint32_t first = it->first;
+				it->first += count;
+				it->count -= count;
+				if (it->count == 0) {
+					freeRanges.erase(it);
+				}
+				freeGlyphs -= count;
+				return first;
+			}
+		}
+		if (glyphCount + count > glyphCapacity) {
+			uint32_t capacity = std::max(glyphCapacity, (uint32_t)TEXTOVERLAY_INITIAL_GLYPH_CAPACITY);
+			while (capacity < glyphCount + count) {
+				capacity *= 2;
+			}
+			createInstanceBuffer(capacity);
+		}
+		uint32_t first = glyphCount;
+		glyphCount += count;
+		return first;
+	}
+
+	// Writes degenerate glyphs into a no longer used range and returns it to the free list
+	void freeGlyphRange(uint32_t first, uint32_t count)
+	{
+		if (count == 0) {
+			return;
+		}
+		GlyphInstance *mapped = (GlyphInstance*)instanceBuffer.mapped;
+		memset(&glyphs[first], 0, count * sizeof(GlyphInstance));
+		memset(&mapped[first], 0, count * sizeof(GlyphInstance));
+		freeRanges.push_back({ first, count });
+		freeGlyphs += count;
+	}
+
+	// Sorts and merges the free list, and lowers the high water mark if the last ranges are unused
+	void mergeFreeRanges()
+	{
+		std::sort(freeRanges.begin(), freeRanges.end(), [](const GlyphRange &a, const GlyphRange &b) { return a.first < b.first; });
+		std::vector<GlyphRange> merged;
+		for (auto &range : freeRanges) {
+			if (!merged.empty() && (merged.back().first + merged.back().count == range.first)) {
+				merged.back().count += range.count;
+			} else {
+				merged.push_back(range);
+			}
+		}
+		if (!merged.empty() && (merged.back().first + merged.back().count == glyphCount)) {
+			glyphCount = merged.back().first;
+			freeGlyphs -= merged.back().count;
+			merged.pop_back();
+		}
+		freeRanges.swap(merged);
+	}
+
+	// Moves all live runs to the start of the instance buffer once too much of it is unused
+	void compact()
+	{
+		std::vector<GlyphInstance> compacted;
+		compacted.reserve(glyphCount - freeGlyphs);
+		for (auto &run : runs) {
+			uint32_t first = (uint32_t)compacted.size();
+			compacted.insert(compacted.end(), glyphs.begin() + run.second.first, glyphs.begin() + run.second.first + run.second.count);
+			run.second.first = first;
+		}
+		glyphCount = (uint32_t)compacted.size();
+		memcpy(glyphs.data(), compacted.data(), glyphCount * sizeof(GlyphInstance));
+		memcpy(instanceBuffer.mapped, compacted.data(), glyphCount * sizeof(GlyphInstance));
+		freeRanges.clear();
+		freeGlyphs = 0;
+		stats.writtenGlyphs += glyphCount;
+	}
+
+	// (Re)creates the persistently mapped instance buffer, existing glyphs are carried over from the CPU copy
+	void createInstanceBuffer(uint32_t capacity)
+	{
+		if (instanceBuffer.buffer != VK_NULL_HANDLE) {
+			// The buffer may still be referenced by submitted command buffers
+			vkDeviceWaitIdle(vulkanDevice->logicalDevice);
+			instanceBuffer.destroy();
+		}
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&instanceBuffer,
+			capacity * sizeof(GlyphInstance)));
+		VK_CHECK_RESULT(instanceBuffer.map());
+		glyphs.resize(capacity);
+		if (glyphCount > 0) {
+			memcpy(instanceBuffer.mapped, glyphs.data(), glyphCount * sizeof(GlyphInstance));
+		}
+		glyphCapacity = capacity;
+		commandBuffersDirty = true;
+	}
+
 public:
 
 	enum TextAlign { alignLeft, alignCenter, alignRight };
 
 	bool visible = true;
 
+	// Statistics of the last text update
+	struct Statistics {
+		uint32_t runs = 0;
+		uint32_t glyphs = 0;
+		// Glyphs of runs that were found in the cache
+		uint32_t cachedGlyphs = 0;
+		// Glyphs laid out and written to the instance buffer
+		uint32_t writtenGlyphs = 0;
+		double updateTime = 0.0;
+	} stats;
+
 	TextOverlay(
 		vks::VulkanDevice *vulkanDevice,
 		VkQueue queue,
@@ -117,8 +301,9 @@ public:
 		vkDestroySampler(vulkanDevice->logicalDevice, sampler, nullptr);
 		vkDestroyImage(vulkanDevice->logicalDevice, image, nullptr);
 		vkDestroyImageView(vulkanDevice->logicalDevice, view, nullptr);
-		vkDestroyBuffer(vulkanDevice->logicalDevice, buffer, nullptr);
-		vkFreeMemory(vulkanDevice->logicalDevice, memory, nullptr);
+		instanceBuffer.destroy();
+		indexBuffer.destroy();
+		indirectBuffer.destroy();
 		vkFreeMemory(vulkanDevice->logicalDevice, imageMemory, nullptr);
 		vkDestroyDescriptorSetLayout(vulkanDevice->logicalDevice, descriptorSetLayout, nullptr);
 		vkDestroyDescriptorPool(vulkanDevice->logicalDevice, descriptorPool, nullptr);
@@ -156,22 +341,31 @@ public:
 
 		VK_CHECK_RESULT(vkAllocateCommandBuffers(vulkanDevice->logicalDevice, &cmdBufAllocateInfo, cmdBuffers.data()));
 
-		// Vertex buffer
-		VkDeviceSize bufferSize = TEXTOVERLAY_MAX_CHAR_COUNT * sizeof(glm::vec4);
+		// Glyph instance buffer
+		createInstanceBuffer(TEXTOVERLAY_INITIAL_GLYPH_CAPACITY);
 
-		VkBufferCreateInfo bufferInfo = vks::initializers::bufferCreateInfo(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, bufferSize);
-		VK_CHECK_RESULT(vkCreateBuffer(vulkanDevice->logicalDevice, &bufferInfo, nullptr, &buffer));
+		// Glyph quad indices, same winding as the triangle strip (x0,y0), (x1,y0), (x0,y1), (x1,y1)
+		std::vector<uint16_t> indices = { 0, 1, 2, 2, 1, 3 };
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&indexBuffer,
+			indices.size() * sizeof(uint16_t),
+			indices.data()));
+
+		VkDrawIndexedIndirectCommand indirectCmd{};
+		indirectCmd.indexCount = static_cast<uint32_t>(indices.size());
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&indirectBuffer,
+			sizeof(VkDrawIndexedIndirectCommand),
+			&indirectCmd));
+		VK_CHECK_RESULT(indirectBuffer.map());
 
 		VkMemoryRequirements memReqs;
 		VkMemoryAllocateInfo allocInfo = vks::initializers::memoryAllocateInfo();
 
-		vkGetBufferMemoryRequirements(vulkanDevice->logicalDevice, buffer, &memReqs);
-		allocInfo.allocationSize = memReqs.size;
-		allocInfo.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-		VK_CHECK_RESULT(vkAllocateMemory(vulkanDevice->logicalDevice, &allocInfo, nullptr, &memory));
-		VK_CHECK_RESULT(vkBindBufferMemory(vulkanDevice->logicalDevice, buffer, memory, 0));
-
 		// Font texture
 		VkImageCreateInfo imageInfo = vks::initializers::imageCreateInfo();
 		imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -328,10 +522,14 @@ public:
 		VK_CHECK_RESULT(vkCreateDescriptorSetLayout(vulkanDevice->logicalDevice, &descriptorSetLayoutInfo, nullptr, &descriptorSetLayout));
 
 		// Pipeline layout
+		// Push constant for the pixel to normalized device coordinate scale
+		VkPushConstantRange pushConstantRange = vks::initializers::pushConstantRange(VK_SHADER_STAGE_VERTEX_BIT, sizeof(glm::vec2), 0);
 		VkPipelineLayoutCreateInfo pipelineLayoutInfo =
 			vks::initializers::pipelineLayoutCreateInfo(
 				&descriptorSetLayout,
 				1);
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
 		VK_CHECK_RESULT(vkCreatePipelineLayout(vulkanDevice->logicalDevice, &pipelineLayoutInfo, nullptr, &pipelineLayout));
 
 		// Descriptor set
@@ -373,7 +571,7 @@ public:
 		blendAttachmentState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
 		blendAttachmentState.alphaBlendOp = VK_BLEND_OP_ADD;
 
-		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = vks::initializers::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP, 0, VK_FALSE);
+		VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = vks::initializers::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
 		VkPipelineRasterizationStateCreateInfo rasterizationState = vks::initializers::pipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_CLOCKWISE, 0);
 		VkPipelineColorBlendStateCreateInfo colorBlendState = vks::initializers::pipelineColorBlendStateCreateInfo(1, &blendAttachmentState);
 		VkPipelineDepthStencilStateCreateInfo depthStencilState = vks::initializers::pipelineDepthStencilStateCreateInfo(VK_TRUE, VK_TRUE, VK_COMPARE_OP_LESS_OR_EQUAL);
@@ -382,13 +580,14 @@ public:
 		std::vector<VkDynamicState> dynamicStateEnables = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
 		VkPipelineDynamicStateCreateInfo dynamicState = vks::initializers::pipelineDynamicStateCreateInfo(dynamicStateEnables);
 
-		std::array<VkVertexInputBindingDescription, 2> vertexInputBindings = {
-			vks::initializers::vertexInputBindingDescription(0, sizeof(glm::vec4), VK_VERTEX_INPUT_RATE_VERTEX),
-			vks::initializers::vertexInputBindingDescription(1, sizeof(glm::vec4), VK_VERTEX_INPUT_RATE_VERTEX),
+		// Glyphs are instances, the quad corner is derived from the vertex index in the shader
+		std::array<VkVertexInputBindingDescription, 1> vertexInputBindings = {
+			vks::initializers::vertexInputBindingDescription(0, sizeof(GlyphInstance), VK_VERTEX_INPUT_RATE_INSTANCE),
 		};
-		std::array<VkVertexInputAttributeDescription, 2> vertexInputAttributes = {
-			vks::initializers::vertexInputAttributeDescription(0, 0, VK_FORMAT_R32G32_SFLOAT, 0),					// Location 0: Position
-			vks::initializers::vertexInputAttributeDescription(1, 1, VK_FORMAT_R32G32_SFLOAT, sizeof(glm::vec2)),	// Location 1: UV
+		std::array<VkVertexInputAttributeDescription, 3> vertexInputAttributes = {
+			vks::initializers::vertexInputAttributeDescription(0, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(GlyphInstance, rect)),	// Location 0: Rectangle
+			vks::initializers::vertexInputAttributeDescription(0, 1, VK_FORMAT_R16G16B16A16_UNORM, offsetof(GlyphInstance, uv)),		// Location 1: UV rectangle
+			vks::initializers::vertexInputAttributeDescription(0, 2, VK_FORMAT_R8G8B8A8_UNORM, offsetof(GlyphInstance, color)),		// Location 2: Color
 		};
 	
 		VkPipelineVertexInputStateCreateInfo vertexInputState = vks::initializers::pipelineVertexInputStateCreateInfo();
@@ -492,88 +691,120 @@ public:
 		VK_CHECK_RESULT(vkCreateRenderPass(vulkanDevice->logicalDevice, &renderPassInfo, nullptr, &renderPass));
 	}
 
-	// Map buffer 
+	// Start a new text update, runs not added again until endTextUpdate are released
 	void beginTextUpdate()
 	{
-		VK_CHECK_RESULT(vkMapMemory(vulkanDevice->logicalDevice, memory, 0, VK_WHOLE_SIZE, 0, (void **)&mapped));
-		numLetters = 0;
+		updateIndex++;
+		stats = {};
+		updateStart = std::chrono::high_resolution_clock::now();
 	}
 
-	// Add text to the current buffer
-	// todo : drop shadow? color attribute?
-	void addText(std::string text, float x, float y, TextAlign align)
+	// Add text to the current update
+	// Strings already added with the same position, alignment and color in the previous update are taken from the cache
+	void addText(std::string text, float x, float y, TextAlign align, glm::vec4 color = glm::vec4(1.0f))
 	{
 		const uint32_t firstChar = STB_FONT_consolas_24_latin1_FIRST_CHAR;
+		// Font units to framebuffer pixels
+		const float charScale = 0.75f;
 
-		assert(mapped != nullptr);
+		glm::vec4 c = glm::clamp(color, glm::vec4(0.0f), glm::vec4(1.0f)) * 255.0f + 0.5f;
+		RunKey key = { std::move(text), x, y, (uint32_t)align, (uint32_t)c.r | ((uint32_t)c.g << 8) | ((uint32_t)c.b << 16) | ((uint32_t)c.a << 24) };
 
-		const float charW = 1.5f / *frameBufferWidth;
-		const float charH = 1.5f / *frameBufferHeight;
+		stats.runs++;
 
-		float fbW = (float)*frameBufferWidth;
-		float fbH = (float)*frameBufferHeight;
-		x = (x / fbW * 2.0f) - 1.0f;
-		y = (y / fbH * 2.0f) - 1.0f;
+		auto cached = runs.find(key);
+		if (cached != runs.end()) {
+			cached->second.lastUpdate = updateIndex;
+			stats.cachedGlyphs += cached->second.count;
+			stats.glyphs += cached->second.count;
+			return;
+		}
 
-		// Calculate text width
-		float textWidth = 0;
-		for (auto letter : text)
+		// Generate a uv mapped quad per visible char in a single pass
+		layoutGlyphs.clear();
+		float penX = 0.0f;
+		for (auto letter : key.text)
 		{
-			stb_fontchar *charData = &stbFontData[(uint32_t)letter - firstChar];
-			textWidth += charData->advance * charW;
+			uint32_t charIndex = (uint8_t)letter;
+			if ((charIndex < firstChar) || (charIndex >= firstChar + STB_FONT_consolas_24_latin1_NUM_CHARS)) {
+				continue;
+			}
+			stb_fontchar *charData = &stbFontData[charIndex - firstChar];
+			// Whitespace only advances the pen
+			if ((charData->x0 != charData->x1) && (charData->y0 != charData->y1)) {
+				GlyphInstance glyph;
+				glyph.rect = glm::vec4(
+					penX + (float)charData->x0 * charScale,
+					y + (float)charData->y0 * charScale,
+					penX + (float)charData->x1 * charScale,
+					y + (float)charData->y1 * charScale);
+				glyph.uv[0] = (uint16_t)(charData->s0 * 65535.0f + 0.5f);
+				glyph.uv[1] = (uint16_t)(charData->t0 * 65535.0f + 0.5f);
+				glyph.uv[2] = (uint16_t)(charData->s1 * 65535.0f + 0.5f);
+				glyph.uv[3] = (uint16_t)(charData->t1 * 65535.0f + 0.5f);
+				glyph.color = key.color;
+				layoutGlyphs.push_back(glyph);
+			}
+			penX += charData->advance * charScale;
 		}
 
+		// The text width is only known after the layout, so alignment is applied to the emitted glyphs
+		float offset = x;
 		switch (align)
 		{
 			case alignRight:
-				x -= textWidth;
+				offset -= penX;
 				break;
 			case alignCenter:
-				x -= textWidth / 2.0f;
+				offset -= penX / 2.0f;
+				break;
+			default:
 				break;
 		}
+		for (auto &glyph : layoutGlyphs) {
+			glyph.rect.x += offset;
+			glyph.rect.z += offset;
+		}
 
-		// Generate a uv mapped quad per char in the new text
-		for (auto letter : text)
-		{
-			stb_fontchar *charData = &stbFontData[(uint32_t)letter - firstChar];
-
-			mapped->x = (x + (float)charData->x0 * charW);
-			mapped->y = (y + (float)charData->y0 * charH);
-			mapped->z = charData->s0;
-			mapped->w = charData->t0;
-			mapped++;
-
-			mapped->x = (x + (float)charData->x1 * charW);
-			mapped->y = (y + (float)charData->y0 * charH);
-			mapped->z = charData->s1;
-			mapped->w = charData->t0;
-			mapped++;
-
-			mapped->x = (x + (float)charData->x0 * charW);
-			mapped->y = (y + (float)charData->y1 * charH);
-			mapped->z = charData->s0;
-			mapped->w = charData->t1;
-			mapped++;
-
-			mapped->x = (x + (float)charData->x1 * charW);
-			mapped->y = (y + (float)charData->y1 * charH);
-			mapped->z = charData->s1;
-			mapped->w = charData->t1;
-			mapped++;
-
-			x += charData->advance * charW;
-
-			numLetters++;
+		Run run;
+		run.count = (uint32_t)layoutGlyphs.size();
+		run.first = (run.count > 0) ? allocateGlyphs(run.count) : 0;
+		run.lastUpdate = updateIndex;
+		if (run.count > 0) {
+			memcpy(&glyphs[run.first], layoutGlyphs.data(), run.count * sizeof(GlyphInstance));
+			memcpy((GlyphInstance*)instanceBuffer.mapped + run.first, layoutGlyphs.data(), run.count * sizeof(GlyphInstance));
 		}
+		runs.emplace(std::move(key), run);
+
+		stats.writtenGlyphs += run.count;
+		stats.glyphs += run.count;
 	}
 
-	// Unmap buffer and update command buffers
+	// Release runs that have not been added in this update and update the instance count
+	// Command buffers are only recorded again if required
 	void endTextUpdate()
 	{
-		vkUnmapMemory(vulkanDevice->logicalDevice, memory);
-		mapped = nullptr;
-		updateCommandBuffers();
+		for (auto it = runs.begin(); it != runs.end();) {
+			if (it->second.lastUpdate != updateIndex) {
+				freeGlyphRange(it->second.first, it->second.count);
+				it = runs.erase(it);
+			} else {
+				++it;
+			}
+		}
+		mergeFreeRanges();
+		if ((glyphCount > TEXTOVERLAY_INITIAL_GLYPH_CAPACITY) && (freeGlyphs > glyphCount / 2)) {
+			compact();
+		}
+
+		VkDrawIndexedIndirectCommand *indirectCmd = (VkDrawIndexedIndirectCommand*)indirectBuffer.mapped;
+		indirectCmd->instanceCount = glyphCount;
+
+		if (commandBuffersDirty || (recordedWidth != *frameBufferWidth) || (recordedHeight != *frameBufferHeight)) {
+			updateCommandBuffers();
+		}
+
+		stats.updateTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - updateStart).count();
 	}
 
 	// Needs to be called by the application
@@ -608,19 +839,23 @@ public:
 			vkCmdBindPipeline(cmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 			vkCmdBindDescriptorSets(cmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
 
-			VkDeviceSize offsets = 0;
-			vkCmdBindVertexBuffers(cmdBuffers[i], 0, 1, &buffer, &offsets);
-			vkCmdBindVertexBuffers(cmdBuffers[i], 1, 1, &buffer, &offsets);
-			for (uint32_t j = 0; j < numLetters; j++)
-			{
-				vkCmdDraw(cmdBuffers[i], 4, 1, j * 4, 0);
-			}
+			glm::vec2 pixelScale = glm::vec2(2.0f / (float)*frameBufferWidth, 2.0f / (float)*frameBufferHeight);
+			vkCmdPushConstants(cmdBuffers[i], pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::vec2), &pixelScale);
 
+			// All glyphs are drawn with a single instanced draw, the instance count is taken from the indirect buffer
+			VkDeviceSize offsets = 0;
+			vkCmdBindVertexBuffers(cmdBuffers[i], 0, 1, &instanceBuffer.buffer, &offsets);
+			vkCmdBindIndexBuffer(cmdBuffers[i], indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+			vkCmdDrawIndexedIndirect(cmdBuffers[i], indirectBuffer.buffer, 0, 1, sizeof(VkDrawIndexedIndirectCommand));
 
 			vkCmdEndRenderPass(cmdBuffers[i]);
 
 			VK_CHECK_RESULT(vkEndCommandBuffer(cmdBuffers[i]));
 		}
+
+		recordedWidth = *frameBufferWidth;
+		recordedHeight = *frameBufferHeight;
+		commandBuffersDirty = false;
 	}
 
 	// Submit the text command buffers to a queue
@@ -676,6 +911,11 @@ public:
 	VkDescriptorSetLayout descriptorSetLayout;
 	VkDescriptorSet descriptorSet;
 
+	// Number of additional on-screen labels for stress testing the text overlay (-labels)
+	// If set, the text overlay is updated every frame
+	uint32_t labelCount = 0;
+	uint32_t labelFrame = 0;
+
 	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
 	{
 		title = "Vulkan Example - Text overlay";
@@ -684,6 +924,11 @@ public:
 		camera.setPosition(glm::vec3(0.0f, 0.0f, -4.5f));
 		camera.setRotation(glm::vec3(-25.0f, -0.0f, 0.0f));
 		camera.setPerspective(60.0f, (float)width / (float)height, 0.1f, 256.0f);
+		for (size_t i = 0; i < args.size(); i++) {
+			if ((std::string(args[i]) == "-labels") && (i + 1 < args.size())) {
+				labelCount = std::stoi(args[i + 1]);
+			}
+		}
 	}
 
 	~VulkanExample()
@@ -747,6 +992,8 @@ public:
 	// Update the text buffer displayed by the text overlay
 	void updateTextOverlay(void)
 	{
+		const TextOverlay::Statistics textStats = textOverlay->stats;
+
 		textOverlay->beginTextUpdate();
 
 		textOverlay->addText(title, 5.0f, 5.0f, TextOverlay::alignLeft);
@@ -792,6 +1039,34 @@ public:
 		textOverlay->addText("Press \"space\" to toggle text overlay", 5.0f, 65.0f, TextOverlay::alignLeft);
 		textOverlay->addText("Hold middle mouse button and drag to move", 5.0f, 85.0f, TextOverlay::alignLeft);
 #endif
+
+		// Statistics of the previous text update
+		ss.str("");
+		ss << std::noshowpos << textStats.runs << " strings, " << textStats.glyphs << " glyphs, " << textStats.writtenGlyphs << " written";
+		textOverlay->addText(ss.str(), 5.0f, 105.0f, TextOverlay::alignLeft);
+		ss.str("");
+		ss << std::fixed << std::setprecision(3) << "Text update: " << textStats.updateTime << " ms";
+		textOverlay->addText(ss.str(), 5.0f, 125.0f, TextOverlay::alignLeft);
+
+		// Stress test labels spread on a grid over the screen
+		// One in a hundred labels changes every frame, all others are taken from the text overlay's cache
+		if (labelCount > 0) {
+			const float top = 150.0f;
+			const uint32_t columns = std::max(1u, (uint32_t)ceil(sqrt((float)labelCount * (float)width / ((float)height - top))));
+			const uint32_t rows = (labelCount + columns - 1) / columns;
+			const glm::vec2 cell = glm::vec2((float)width / (float)columns, ((float)height - top) / (float)rows);
+			for (uint32_t i = 0; i < labelCount; i++) {
+				std::string label = "#" + std::to_string(i);
+				if (i % 100 == labelFrame % 100) {
+					label += ":" + std::to_string(labelFrame);
+				}
+				float x = ((float)(i % columns) + 0.5f) * cell.x;
+				float y = top + (float)(i / columns) * cell.y;
+				textOverlay->addText(label, x, y, TextOverlay::alignCenter, glm::vec4(1.0f, 0.8f, 0.2f, 1.0f));
+			}
+			labelFrame++;
+		}
+
 		textOverlay->endTextUpdate();
 	}
 
@@ -968,7 +1243,7 @@ public:
 		if (!prepared)
 			return;
 		draw();
-		if (frameCounter == 0)
+		if ((frameCounter == 0) || (labelCount > 0))
 		{
 			vkDeviceWaitIdle(device);
 			updateTextOverlay();
@@ -984,6 +1259,8 @@ public:
 
 	virtual void windowResized()
 	{
+		// Framebuffers have been recreated
+		textOverlay->updateCommandBuffers();
 		updateTextOverlay();
 	}
 
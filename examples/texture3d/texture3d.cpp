@@ -14,6 +14,8 @@
 #include <random>
 #include <numeric>
 #include <ctime>
+#include <algorithm>
+#include <chrono>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -25,6 +27,7 @@
 #include "VulkanDevice.hpp"
 #include "VulkanBuffer.hpp"
 #include "VulkanModel.hpp"
+#include "threadpool.hpp"
 
 #define VERTEX_BUFFER_BIND_ID 0
 #define ENABLE_VALIDATION false
@@ -36,21 +39,26 @@ struct Vertex {
 	float normal[3];
 };
 
+// Number of points evaluated per batched noise call
+#define NOISE_BATCH_SIZE 8
+// Edge length of the bricks the noise volume is generated and uploaded in
+#define NOISE_BRICK_SIZE 32
+
 // Translation of Ken Perlin's JAVA implementation (http://mrl.nyu.edu/~perlin/noise/)
 template <typename T>
 class PerlinNoise
 {
 private:
 	uint32_t permutations[512];
-	T fade(T t) 
+	T fade(T t) const
 	{ 
 		return t * t * t * (t * (t * (T)6 - (T)15) + (T)10); 
 	}
-	T lerp(T t, T a, T b) 
+	T lerp(T t, T a, T b) const
 	{ 
 		return a + t * (b - a); 
 	}
-	T grad(int hash, T x, T y, T z) 
+	T grad(int hash, T x, T y, T z) const
 	{
 		// Convert LO 4 bits of hash code into 12 gradient directions
 		int h = hash & 15;                     
@@ -73,7 +81,7 @@ public:
 			permutations[i] = permutations[256 + i] = plookup[i];
 		}		
 	}
-	T noise(T x, T y, T z)
+	T noise(T x, T y, T z) const
 	{
 		// Find unit cube that contains point
 		int32_t X = (int32_t)floor(x) & 255;
@@ -103,6 +111,44 @@ public:
 			lerp(v, lerp(u, grad(permutations[AA + 1], x, y, z - 1), grad(permutations[BA + 1], x - 1, y, z - 1)), lerp(u, grad(permutations[AB + 1], x, y - 1, z - 1), grad(permutations[BB + 1], x - 1, y - 1, z - 1))));
 		return res;
 	}
+	// Evaluates NOISE_BATCH_SIZE points that share y and z (e.g. consecutive voxels of a row)
+	// The work is split into fixed length per-lane loops, so the compiler can vectorize them for the target instruction set
+	void noise(const T* xs, T y, T z, T* result) const
+	{
+		// Parts depending on y and z only are shared by all lanes
+		const T fy = floor(y);
+		const T fz = floor(z);
+		const uint32_t Y = (int32_t)fy & 255;
+		const uint32_t Z = (int32_t)fz & 255;
+		y -= fy;
+		z -= fz;
+		const T v = fade(y);
+		const T w = fade(z);
+
+		uint32_t X[NOISE_BATCH_SIZE];
+		T x[NOISE_BATCH_SIZE];
+		T u[NOISE_BATCH_SIZE];
+		for (uint32_t l = 0; l < NOISE_BATCH_SIZE; l++)
+		{
+			const T fx = floor(xs[l]);
+			X[l] = (int32_t)fx & 255;
+			x[l] = xs[l] - fx;
+			u[l] = fade(x[l]);
+		}
+
+		for (uint32_t l = 0; l < NOISE_BATCH_SIZE; l++)
+		{
+			const uint32_t A = permutations[X[l]] + Y;
+			const uint32_t AA = permutations[A] + Z;
+			const uint32_t AB = permutations[A + 1] + Z;
+			const uint32_t B = permutations[X[l] + 1] + Y;
+			const uint32_t BA = permutations[B] + Z;
+			const uint32_t BB = permutations[B + 1] + Z;
+			result[l] = lerp(w, lerp(v,
+				lerp(u[l], grad(permutations[AA], x[l], y, z), grad(permutations[BA], x[l] - 1, y, z)), lerp(u[l], grad(permutations[AB], x[l], y - 1, z), grad(permutations[BB], x[l] - 1, y - 1, z))),
+				lerp(v, lerp(u[l], grad(permutations[AA + 1], x[l], y, z - 1), grad(permutations[BA + 1], x[l] - 1, y, z - 1)), lerp(u[l], grad(permutations[AB + 1], x[l], y - 1, z - 1), grad(permutations[BB + 1], x[l] - 1, y - 1, z - 1))));
+		}
+	}
 };
 
 // Fractal noise generator based on perlin noise above
@@ -110,21 +156,21 @@ template <typename T>
 class FractalNoise
 {
 private:
-	PerlinNoise<float> perlinNoise;
+	PerlinNoise<T> perlinNoise;
 	uint32_t octaves; 
 	T frequency;
 	T amplitude;
 	T persistence;
 public:
 
-	FractalNoise(const PerlinNoise<T> &perlinNoise) 
+	FractalNoise(const PerlinNoise<T> &perlinNoise, uint32_t octaves = 6, T persistence = (T)0.5) 
 	{
 		this->perlinNoise = perlinNoise;
-		octaves = 6;
-		persistence = (T)0.5;
+		this->octaves = octaves;
+		this->persistence = persistence;
 	}
 
-	T noise(T x, T y, T z)
+	T noise(T x, T y, T z) const
 	{
 		T sum = 0;
 		T frequency = (T)1;
@@ -141,6 +187,37 @@ public:
 		sum = sum / max;
 		return (sum + (T)1.0) / (T)2.0;
 	}
+
+	// Batched version for NOISE_BATCH_SIZE points sharing y and z
+	void noise(const T* xs, T y, T z, T* result) const
+	{
+		T sum[NOISE_BATCH_SIZE] = {};
+		T x[NOISE_BATCH_SIZE];
+		T octave[NOISE_BATCH_SIZE];
+		T frequency = (T)1;
+		T amplitude = (T)1;
+		T max = (T)0;
+		for (uint32_t i = 0; i < octaves; i++)
+		{
+			for (uint32_t l = 0; l < NOISE_BATCH_SIZE; l++)
+			{
+				x[l] = xs[l] * frequency;
+			}
+			perlinNoise.noise(x, y * frequency, z * frequency, octave);
+			for (uint32_t l = 0; l < NOISE_BATCH_SIZE; l++)
+			{
+				sum[l] += octave[l] * amplitude;
+			}
+			max += amplitude;
+			amplitude *= persistence;
+			frequency *= (T)2;
+		}
+
+		for (uint32_t l = 0; l < NOISE_BATCH_SIZE; l++)
+		{
+			result[l] = (sum[l] / max + (T)1.0) / (T)2.0;
+		}
+	}
 };
 
 class VulkanExample : public VulkanExampleBase
@@ -190,6 +267,24 @@ public:
 	VkDescriptorSet descriptorSet;
 	VkDescriptorSetLayout descriptorSetLayout;
 
+	// Noise generation
+	// The volume is split into bricks, so parameter changes only regenerate and upload the bricks marked as dirty
+	struct {
+		PerlinNoise<float> perlinNoise;
+		float scale = 8.0f;
+		int32_t octaves = 6;
+		float persistence = 0.5f;
+		// Host visible staging buffer with the same layout as the texture, persistently mapped
+		vks::Buffer staging;
+		std::vector<bool> dirtyBricks;
+		int32_t bricksPerFrame = 64;
+		double voxelsPerSecond = 0.0;
+		int32_t sizeIndex = 0;
+	} noise;
+	const std::vector<uint32_t> volumeSizes = { 128, 256, 512 };
+
+	vks::ThreadPool threadPool;
+
 	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
 	{
 		zoom = -2.5f;
@@ -197,6 +292,7 @@ public:
 		title = "3D textures";
 		settings.overlay = true;
 		srand((unsigned int)time(NULL));
+		threadPool.setThreadCount(std::max(std::thread::hardware_concurrency(), 1u));
 	}
 
 	~VulkanExample()
@@ -205,6 +301,7 @@ public:
 		// Note : Inherited destructor cleans up resources stored in base class
 
 		destroyTextureImage(texture);
+		noise.staging.destroy();
 
 		vkDestroyPipeline(device, pipelines.solid, nullptr);
 
@@ -216,10 +313,11 @@ public:
 		uniformBufferVS.destroy();
 	}
 
-	// Prepare all Vulkan resources for the 3D texture (including descriptors)
-	// Does not fill the texture with data
+	// Prepare all Vulkan resources for the 3D texture (including descriptors) and fill it with noise
 	void prepareNoiseTexture(uint32_t width, uint32_t height, uint32_t depth)
 	{
+		assert((width % NOISE_BRICK_SIZE == 0) && (height % NOISE_BRICK_SIZE == 0) && (depth % NOISE_BRICK_SIZE == 0));
+
 		// A 3D texture is described as width x height x depth
 		texture.width = width;
 		texture.height = height;
@@ -305,82 +403,71 @@ public:
 		texture.descriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 		texture.descriptor.imageView = texture.view;
 		texture.descriptor.sampler = texture.sampler;
+		texture.imageLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		// Staging buffer for the noise voxels, stays mapped so the noise generator can write to it directly
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			&noise.staging,
+			(VkDeviceSize)width * height * depth));
+		VK_CHECK_RESULT(noise.staging.map());
+		noise.dirtyBricks.assign((width / NOISE_BRICK_SIZE) * (height / NOISE_BRICK_SIZE) * (depth / NOISE_BRICK_SIZE), true);
 
 		updateNoiseTexture();
 	}
 
-	// Generate randomized noise and upload it to the 3D texture using staging
-	void updateNoiseTexture()
+	// Generate the given bricks of a noise volume with the current noise parameters
+	// Bricks are distributed over the thread pool, each thread writes its voxels straight to the destination (e.g. mapped staging memory)
+	void generateNoiseBricks(const std::vector<uint32_t> &bricks, uint8_t *dst, uint32_t width, uint32_t height, uint32_t depth)
 	{
-		const uint32_t texMemSize = texture.width * texture.height * texture.depth;
-
-		uint8_t *data = new uint8_t[texMemSize];
-		memset(data, 0, texMemSize);
-
-		// Generate perlin based noise
-		std::cout << "Generating " << texture.width << " x " << texture.height << " x " << texture.depth << " noise texture..." << std::endl;
-
-		auto tStart = std::chrono::high_resolution_clock::now();
-
-		PerlinNoise<float> perlinNoise;
-		FractalNoise<float> fractalNoise(perlinNoise);
-
-		const float noiseScale = static_cast<float>(rand() % 10) + 4.0f;
+		const FractalNoise<float> fractalNoise(noise.perlinNoise, noise.octaves, noise.persistence);
+		const float noiseScale = noise.scale;
+		const uint32_t bricksX = width / NOISE_BRICK_SIZE;
+		const uint32_t bricksY = height / NOISE_BRICK_SIZE;
+		const uint32_t threadCount = static_cast<uint32_t>(threadPool.threads.size());
 
-#pragma omp parallel for
-		for (uint32_t z = 0; z < texture.depth; z++)
+		for (uint32_t t = 0; t < threadCount; t++)
 		{
-			for (uint32_t y = 0; y < texture.height; y++)
+			threadPool.threads[t]->addJob([=, &fractalNoise, &bricks]
 			{
-				for (uint32_t x = 0; x < texture.width; x++)
+				float xs[NOISE_BATCH_SIZE];
+				float n[NOISE_BATCH_SIZE];
+				for (size_t i = t; i < bricks.size(); i += threadCount)
 				{
-					float nx = (float)x / (float)texture.width;
-					float ny = (float)y / (float)texture.height;
-					float nz = (float)z / (float)texture.depth;
-#define FRACTAL
-#ifdef FRACTAL
-					float n = fractalNoise.noise(nx * noiseScale, ny * noiseScale, nz * noiseScale);
-#else
-					float n = 20.0 * perlinNoise.noise(nx, ny, nz);
-#endif
-					n = n - floor(n);
-
-					data[x + y * texture.width + z * texture.width * texture.height] = static_cast<uint8_t>(floor(n * 255));
+					const uint32_t x0 = (bricks[i] % bricksX) * NOISE_BRICK_SIZE;
+					const uint32_t y0 = ((bricks[i] / bricksX) % bricksY) * NOISE_BRICK_SIZE;
+					const uint32_t z0 = (bricks[i] / (bricksX * bricksY)) * NOISE_BRICK_SIZE;
+					for (uint32_t z = z0; z < z0 + NOISE_BRICK_SIZE; z++)
+					{
+						const float nz = (float)z / (float)depth * noiseScale;
+						for (uint32_t y = y0; y < y0 + NOISE_BRICK_SIZE; y++)
+						{
+							const float ny = (float)y / (float)height * noiseScale;
+							uint8_t *row = dst + (size_t)y * width + (size_t)z * width * height;
+							for (uint32_t x = x0; x < x0 + NOISE_BRICK_SIZE; x += NOISE_BATCH_SIZE)
+							{
+								for (uint32_t l = 0; l < NOISE_BATCH_SIZE; l++)
+								{
+									xs[l] = (float)(x + l) / (float)width * noiseScale;
+								}
+								fractalNoise.noise(xs, ny, nz, n);
+								for (uint32_t l = 0; l < NOISE_BATCH_SIZE; l++)
+								{
+									row[x + l] = static_cast<uint8_t>(floor((n[l] - floor(n[l])) * 255));
+								}
+							}
+						}
+					}
 				}
-			}
+			});
 		}
+		threadPool.wait();
+	}
 
-		auto tEnd = std::chrono::high_resolution_clock::now();
-		auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
-
-		std::cout << "Done in " << tDiff << "ms" << std::endl;
-
-		// Create a host-visible staging buffer that contains the raw image data
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingMemory;
-
-		// Buffer object
-		VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo();
-		bufferCreateInfo.size = texMemSize;
-		bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;			
-		VK_CHECK_RESULT(vkCreateBuffer(device, &bufferCreateInfo, nullptr, &stagingBuffer));
-
-		// Allocate host visible memory for data upload
-		VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
-		VkMemoryRequirements memReqs = {};
-		vkGetBufferMemoryRequirements(device, stagingBuffer, &memReqs);
-		memAllocInfo.allocationSize = memReqs.size;
-		memAllocInfo.memoryTypeIndex = vulkanDevice->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device, &memAllocInfo, nullptr, &stagingMemory));
-		VK_CHECK_RESULT(vkBindBufferMemory(device, stagingBuffer, stagingMemory, 0));
-
-		// Copy texture data into staging buffer
-		uint8_t *mapped;
-		VK_CHECK_RESULT(vkMapMemory(device, stagingMemory, 0, memReqs.size, 0, (void **)&mapped));
-		memcpy(mapped, data, texMemSize);
-		vkUnmapMemory(device, stagingMemory);
-
+	// Copy the given bricks from the staging buffer to the 3D texture
+	void uploadNoiseBricks(const std::vector<uint32_t> &bricks)
+	{
 		VkCommandBuffer copyCmd = VulkanExampleBase::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
 
 		// The sub resource range describes the regions of the image we will be transitioned
@@ -390,36 +477,46 @@ public:
 		subresourceRange.levelCount = 1;
 		subresourceRange.layerCount = 1;
 
-		// Optimal image will be used as destination for the copy, so we must transfer from our
-		// initial undefined image layout to the transfer destination layout
+		// Optimal image will be used as destination for the copy
+		// Bricks that are not updated are preserved unless the image has never been filled (undefined layout)
 		vks::tools::setImageLayout(
 			copyCmd,
 			texture.image,
-			VK_IMAGE_LAYOUT_UNDEFINED,
+			texture.imageLayout,
 			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 			subresourceRange);
 
-		// Copy 3D noise data to texture
-
-		// Setup buffer copy regions
-		VkBufferImageCopy bufferCopyRegion{};
-		bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		bufferCopyRegion.imageSubresource.mipLevel = 0;
-		bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
-		bufferCopyRegion.imageSubresource.layerCount = 1;
-		bufferCopyRegion.imageExtent.width = texture.width;
-		bufferCopyRegion.imageExtent.height = texture.height;
-		bufferCopyRegion.imageExtent.depth = texture.depth;
+		// The staging buffer has the same layout as the texture, so each brick is a sub region of it
+		const uint32_t bricksX = texture.width / NOISE_BRICK_SIZE;
+		const uint32_t bricksY = texture.height / NOISE_BRICK_SIZE;
+		std::vector<VkBufferImageCopy> bufferCopyRegions(bricks.size());
+		for (size_t i = 0; i < bricks.size(); i++)
+		{
+			const uint32_t x0 = (bricks[i] % bricksX) * NOISE_BRICK_SIZE;
+			const uint32_t y0 = ((bricks[i] / bricksX) % bricksY) * NOISE_BRICK_SIZE;
+			const uint32_t z0 = (bricks[i] / (bricksX * bricksY)) * NOISE_BRICK_SIZE;
+			VkBufferImageCopy &bufferCopyRegion = bufferCopyRegions[i];
+			bufferCopyRegion = {};
+			bufferCopyRegion.bufferOffset = (VkDeviceSize)x0 + (VkDeviceSize)y0 * texture.width + (VkDeviceSize)z0 * texture.width * texture.height;
+			bufferCopyRegion.bufferRowLength = texture.width;
+			bufferCopyRegion.bufferImageHeight = texture.height;
+			bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			bufferCopyRegion.imageSubresource.mipLevel = 0;
+			bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
+			bufferCopyRegion.imageSubresource.layerCount = 1;
+			bufferCopyRegion.imageOffset = { (int32_t)x0, (int32_t)y0, (int32_t)z0 };
+			bufferCopyRegion.imageExtent = { NOISE_BRICK_SIZE, NOISE_BRICK_SIZE, NOISE_BRICK_SIZE };
+		}
 
 		vkCmdCopyBufferToImage(
 			copyCmd,
-			stagingBuffer,
+			noise.staging.buffer,
 			texture.image,
 			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			1, 
-			&bufferCopyRegion);
+			static_cast<uint32_t>(bufferCopyRegions.size()),
+			bufferCopyRegions.data());
 
-		// Change texture image layout to shader read after all mip levels have been copied
+		// Change texture image layout to shader read after all bricks have been copied
 		texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 		vks::tools::setImageLayout(
 			copyCmd,
@@ -429,11 +526,86 @@ public:
 			subresourceRange);
 
 		VulkanExampleBase::flushCommandBuffer(copyCmd, queue, true);
+	}
+
+	// Generate randomized noise and upload it to the 3D texture using staging
+	void updateNoiseTexture()
+	{
+		// New permutations and scale, all bricks have to be regenerated
+		noise.perlinNoise = PerlinNoise<float>();
+		noise.scale = static_cast<float>(rand() % 10) + 4.0f;
+
+		std::vector<uint32_t> bricks(noise.dirtyBricks.size());
+		std::iota(bricks.begin(), bricks.end(), 0);
+
+		// Generate perlin based noise
+		std::cout << "Generating " << texture.width << " x " << texture.height << " x " << texture.depth << " noise texture..." << std::endl;
+
+		auto tStart = std::chrono::high_resolution_clock::now();
+
+		generateNoiseBricks(bricks, (uint8_t*)noise.staging.mapped, texture.width, texture.height, texture.depth);
+
+		auto tEnd = std::chrono::high_resolution_clock::now();
+		auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+		noise.voxelsPerSecond = (double)texture.width * texture.height * texture.depth / (tDiff / 1000.0);
 
-		// Clean up staging resources
-		delete[] data;
-		vkFreeMemory(device, stagingMemory, nullptr);
-		vkDestroyBuffer(device, stagingBuffer, nullptr);
+		std::cout << "Done in " << tDiff << "ms (" << noise.voxelsPerSecond / 1000000.0 << " Mvoxels/s, " << threadPool.threads.size() << " threads)" << std::endl;
+
+		uploadNoiseBricks(bricks);
+		std::fill(noise.dirtyBricks.begin(), noise.dirtyBricks.end(), false);
+	}
+
+	// Regenerate and upload a limited number of dirty bricks per frame, starting with the bricks of the displayed slice
+	void updateDirtyBricks()
+	{
+		const uint32_t bricksX = texture.width / NOISE_BRICK_SIZE;
+		const uint32_t bricksY = texture.height / NOISE_BRICK_SIZE;
+		const uint32_t bricksZ = texture.depth / NOISE_BRICK_SIZE;
+		const uint32_t sliceBricks = bricksX * bricksY;
+		const uint32_t sliceZ = std::min((uint32_t)(uboVS.depth * bricksZ), bricksZ - 1);
+
+		std::vector<uint32_t> bricks;
+		for (uint32_t i = 0; (i < noise.dirtyBricks.size()) && (bricks.size() < (size_t)noise.bricksPerFrame); i++)
+		{
+			// Start at the first brick of the displayed slice and wrap around
+			uint32_t brick = (sliceZ * sliceBricks + i) % noise.dirtyBricks.size();
+			if (noise.dirtyBricks[brick])
+			{
+				bricks.push_back(brick);
+				noise.dirtyBricks[brick] = false;
+			}
+		}
+		if (bricks.empty())
+		{
+			return;
+		}
+
+		generateNoiseBricks(bricks, (uint8_t*)noise.staging.mapped, texture.width, texture.height, texture.depth);
+		uploadNoiseBricks(bricks);
+	}
+
+	// Noise parameters have changed, the bricks are regenerated over the next frames
+	void markAllBricksDirty()
+	{
+		std::fill(noise.dirtyBricks.begin(), noise.dirtyBricks.end(), true);
+	}
+
+	// CPU only noise generation benchmark for larger volumes, enabled with "-noisebenchmark"
+	void benchmarkNoise()
+	{
+		for (uint32_t size : { 256u, 512u })
+		{
+			const uint32_t brickCount = (size / NOISE_BRICK_SIZE) * (size / NOISE_BRICK_SIZE) * (size / NOISE_BRICK_SIZE);
+			std::vector<uint32_t> bricks(brickCount);
+			std::iota(bricks.begin(), bricks.end(), 0);
+			std::vector<uint8_t> data((size_t)size * size * size);
+
+			auto tStart = std::chrono::high_resolution_clock::now();
+			generateNoiseBricks(bricks, data.data(), size, size, size);
+			auto tDiff = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+
+			std::cout << "Noise " << size << " x " << size << " x " << size << ": " << tDiff << "ms (" << (double)data.size() / (tDiff / 1000.0) / 1000000.0 << " Mvoxels/s, " << threadPool.threads.size() << " threads)" << std::endl;
+		}
 	}
 
 	// Free all Vulkan resources used a texture object
@@ -489,8 +661,6 @@ public:
 			vkCmdBindIndexBuffer(drawCmdBuffers[i], indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
 			vkCmdDrawIndexed(drawCmdBuffers[i], indexCount, 1, 0, 0, 0);
 
-			drawUI(drawCmdBuffers[i]);
-
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
 
 			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
@@ -785,7 +955,12 @@ public:
 		generateQuad();
 		setupVertexDescriptions();
 		prepareUniformBuffers();
-		prepareNoiseTexture(128, 128, 128);
+		for (auto arg : args) {
+			if (std::string(arg) == "-noisebenchmark") {
+				benchmarkNoise();
+			}
+		}
+		prepareNoiseTexture(volumeSizes[noise.sizeIndex], volumeSizes[noise.sizeIndex], volumeSizes[noise.sizeIndex]);
 		setupDescriptorSetLayout();
 		preparePipelines();
 		setupDescriptorPool();
@@ -801,6 +976,21 @@ public:
 		draw();
 		if (!paused || camera.updated)
 			updateUniformBuffers(camera.updated);
+		updateDirtyBricks();
+	}
+
+	// Recreate the 3D texture with a different size
+	void resizeNoiseTexture(uint32_t size)
+	{
+		vkDeviceWaitIdle(device);
+		destroyTextureImage(texture);
+		texture = {};
+		noise.staging.destroy();
+		prepareNoiseTexture(size, size, size);
+
+		VkWriteDescriptorSet writeDescriptorSet = vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &texture.descriptor);
+		vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
+		buildCommandBuffers();
 	}
 
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
@@ -809,6 +999,20 @@ public:
 			if (overlay->button("Generate new texture")) {
 				updateNoiseTexture();
 			}
+			if (overlay->comboBox("Size", &noise.sizeIndex, { "128^3", "256^3", "512^3" })) {
+				resizeNoiseTexture(volumeSizes[noise.sizeIndex]);
+			}
+			overlay->text("%.1f Mvoxels/s (%d threads)", noise.voxelsPerSecond / 1000000.0, (int32_t)threadPool.threads.size());
+		}
+		if (overlay->header("Noise")) {
+			bool changed = overlay->sliderFloat("Scale", &noise.scale, 1.0f, 16.0f);
+			changed |= overlay->sliderInt("Octaves", &noise.octaves, 1, 8);
+			changed |= overlay->sliderFloat("Persistence", &noise.persistence, 0.1f, 1.0f);
+			if (changed) {
+				markAllBricksDirty();
+			}
+			overlay->sliderInt("Bricks per frame", &noise.bricksPerFrame, 1, 512);
+			overlay->text("%d dirty bricks", (int32_t)std::count(noise.dirtyBricks.begin(), noise.dirtyBricks.end(), true));
 		}
 	}
 };
@@ -12,6 +12,7 @@
 #include <assert.h>
 #include <time.h>
 #include <vector>
+#include <chrono>
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -22,6 +23,7 @@
 #include "vulkanexamplebase.h"
 #include "VulkanTexture.hpp"
 #include "VulkanBuffer.hpp"
+#include "VulkanTextureStreamer.hpp"
 #include <ktx.h>
 #include <ktxvulkan.h>
 
@@ -41,6 +43,14 @@ public:
 	uint32_t layerCount;
 	vks::Texture textureArray;
 
+	// The texture array's levels are streamed in mip tail first unless started with -nostreaming
+	bool textureStreaming = true;
+	vks::TextureStreamer textureStreamer;
+	vks::TextureStreamer::Handle streamedArray;
+	std::chrono::time_point<std::chrono::high_resolution_clock> textureLoadStart;
+	float textureLoadTime = 0.0f;
+	float textureResidencyTime = 0.0f;
+
 	vks::Buffer vertexBuffer;
 	vks::Buffer indexBuffer;
 	uint32_t indexCount;
@@ -79,6 +89,15 @@ public:
 		camera.setPosition(glm::vec3(0.0f, 0.0f, -7.5f));
 		camera.setRotation(glm::vec3(-35.0f, 0.0f, 0.0f));
 		camera.setPerspective(45.0f, (float)width / (float)height, 0.1f, 256.0f);
+		for (auto arg : args) {
+			if (std::string(arg) == "-nostreaming") {
+				textureStreaming = false;
+			}
+		}
+#if defined(__ANDROID__)
+		// The streamer reads files directly, not through the asset manager
+		textureStreaming = false;
+#endif
 	}
 
 	~VulkanExample()
@@ -86,10 +105,15 @@ public:
 		// Clean up used Vulkan resources
 		// Note : Inherited destructor cleans up resources stored in base class
 
-		vkDestroyImageView(device, textureArray.view, nullptr);
-		vkDestroyImage(device, textureArray.image, nullptr);
-		vkDestroySampler(device, textureArray.sampler, nullptr);
-		vkFreeMemory(device, textureArray.deviceMemory, nullptr);
+		if (textureStreaming) {
+			textureStreamer.destroy();
+		}
+		else {
+			vkDestroyImageView(device, textureArray.view, nullptr);
+			vkDestroyImage(device, textureArray.image, nullptr);
+			vkDestroySampler(device, textureArray.sampler, nullptr);
+			vkFreeMemory(device, textureArray.deviceMemory, nullptr);
+		}
 
 		vkDestroyPipeline(device, pipeline, nullptr);
 
@@ -308,7 +332,18 @@ public:
 		else {
 			vks::tools::exitFatal("Device does not support any compressed texture format!", VK_ERROR_FEATURE_NOT_PRESENT);
 		}
-		loadTextureArray(getAssetPath() + "textures/" + filename, format);
+		textureLoadStart = std::chrono::high_resolution_clock::now();
+		if (textureStreaming) {
+			// Only the mip tail is loaded here, all layers of the finer levels are streamed in while rendering
+			textureStreamer.prepare(vulkanDevice, queue);
+			streamedArray = textureStreamer.load(getAssetPath() + "textures/" + filename, format);
+			layerCount = textureStreamer.getLayerCount(streamedArray);
+		}
+		else {
+			loadTextureArray(getAssetPath() + "textures/" + filename, format);
+		}
+		textureLoadTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - textureLoadStart).count();
+		std::cout << "Texture array ready after " << textureLoadTime << " ms" << (textureStreaming ? " (mip tail)" : "") << std::endl;
 	}
 
 	void buildCommandBuffers()
@@ -352,8 +387,6 @@ public:
 
 			vkCmdDrawIndexed(drawCmdBuffers[i], indexCount, layerCount, 0, 0, 0);
 
-			drawUI(drawCmdBuffers[i]);
-
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
 
 			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
@@ -451,6 +484,9 @@ public:
 				textureArray.sampler,
 				textureArray.view,
 				textureArray.imageLayout);
+		if (textureStreaming) {
+			textureDescriptor = textureStreamer.getDescriptor(streamedArray);
+		}
 
 		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
 			// Binding 0 : Vertex shader uniform buffer
@@ -580,11 +616,39 @@ public:
 	{
 		if (!prepared)
 			return;
+		if (textureStreaming) {
+			textureStreamer.markUsed(streamedArray);
+			// Frames are waited for in submitFrame, so the descriptor can be rewritten right away
+			if (textureStreamer.update()) {
+				VkDescriptorImageInfo textureDescriptor = textureStreamer.getDescriptor(streamedArray);
+				VkWriteDescriptorSet writeDescriptorSet = vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &textureDescriptor);
+				vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, NULL);
+				buildCommandBuffers();
+			}
+			if ((textureResidencyTime == 0.0f) && textureStreamer.isComplete()) {
+				textureResidencyTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - textureLoadStart).count();
+				std::cout << "All texture array levels resident after " << textureResidencyTime << " ms" << std::endl;
+			}
+		}
 		draw();
 		if (camera.updated)
 			updateUniformBuffersCamera();
 	}
 
+	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
+	{
+		if (overlay->header("Texture")) {
+			overlay->text("Ready after: %.1f ms", textureLoadTime);
+			if (textureStreaming) {
+				overlay->text("Resident level: %d / %d", textureStreamer.getResidentLevel(streamedArray), textureStreamer.getMipLevels(streamedArray));
+				overlay->text("Memory: %.2f MB", textureStreamer.stats.residentMemory / (1024.0f * 1024.0f));
+				if (textureResidencyTime > 0.0f) {
+					overlay->text("Fully resident after: %.1f ms", textureResidencyTime);
+				}
+			}
+		}
+	}
+
 };
 
 VULKAN_EXAMPLE_MAIN()
\ No newline at end of file
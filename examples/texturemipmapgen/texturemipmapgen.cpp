@@ -23,6 +23,7 @@
 #include "VulkanDevice.hpp"
 #include "VulkanBuffer.hpp"
 #include "VulkanModel.hpp"
+#include "VulkanMipGenerator.hpp"
 #include <ktx.h>
 #include <ktxvulkan.h>
 
@@ -40,6 +41,17 @@ public:
 		uint32_t mipLevels;
 	} texture;
 
+	// The mip chain can be generated with image blits or with compute shaders (vks::MipGenerator)
+	std::vector<std::string> mipGenNames{ "Blit chain", "Compute (box)", "Compute (Kaiser)", "Compute (box, sRGB)" };
+	int32_t mipGenMethod = 1;
+	vks::MipGenerator mipGenerator;
+	vks::MipGenerator::Target mipTarget;
+	bool blitSupported = false;
+	// GPU time of the last generation
+	VkQueryPool queryPool = VK_NULL_HANDLE;
+	float mipGenTime = 0.0f;
+	bool mipGenBenchmark = false;
+
 	// To demonstrate mip mapping and filtering this example uses separate samplers
 	std::vector<std::string> samplerNames{ "No mip maps" , "Mip maps (bilinear)" , "Mip maps (anisotropic)" };
 	std::vector<VkSampler> samplers;
@@ -92,10 +104,20 @@ public:
 		settings.overlay = true;
 		timerSpeed *= 0.05f;
 		paused = true;
+		for (size_t i = 0; i < args.size(); i++) {
+			if (std::string(args[i]) == "-mipgenbenchmark") {
+				mipGenBenchmark = true;
+			}
+		}
 	}
 
 	~VulkanExample()
 	{
+		mipGenerator.destroyTarget(mipTarget);
+		mipGenerator.destroy();
+		if (queryPool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(device, queryPool, nullptr);
+		}
 		destroyTextureImage(texture);
 		vkDestroyPipeline(device, pipelines.solid, nullptr);
 		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
@@ -156,9 +178,15 @@ public:
 		// Get device properites for the requested texture format
 		VkFormatProperties formatProperties;
 		vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
-		// Mip-chain generation requires support for blit source and destination
-		assert(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT);
-		assert(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT);
+		// Mip-chain generation with blits requires support for blit source and destination, the compute generator works without
+		blitSupported = (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT) && (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT);
+		if (!mipGenerator.isFormatSupported(format)) {
+			assert(blitSupported);
+			mipGenMethod = 0;
+		}
+		else if (!blitSupported) {
+			mipGenMethod = std::max(mipGenMethod, 1);
+		}
 
 		VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
 		VkMemoryRequirements memReqs = {};
@@ -197,6 +225,10 @@ public:
 		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 		imageCreateInfo.extent = { texture.width, texture.height, 1 };
 		imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		if (mipGenerator.isFormatSupported(format)) {
+			// The compute generator writes the mip levels as storage images
+			imageCreateInfo.usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+		}
 		VK_CHECK_RESULT(vkCreateImage(device, &imageCreateInfo, nullptr, &texture.image));
 		vkGetImageMemoryRequirements(device, texture.image, &memReqs);
 		memAllocInfo.allocationSize = memReqs.size;
@@ -255,89 +287,10 @@ public:
 		ktxTexture_Destroy(ktxTexture);
 
 		// Generate the mip chain
-		// ---------------------------------------------------------------
-		// We copy down the whole mip chain doing a blit from mip-1 to mip
-		// An alternative way would be to always blit from the first mip level and sample that one down
-		VkCommandBuffer blitCmd = VulkanExampleBase::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-		// Copy down mips from n-1 to n
-		for (int32_t i = 1; i < texture.mipLevels; i++)
-		{
-			VkImageBlit imageBlit{};				
-
-			// Source
-			imageBlit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			imageBlit.srcSubresource.layerCount = 1;
-			imageBlit.srcSubresource.mipLevel = i-1;
-			imageBlit.srcOffsets[1].x = int32_t(texture.width >> (i - 1));
-			imageBlit.srcOffsets[1].y = int32_t(texture.height >> (i - 1));
-			imageBlit.srcOffsets[1].z = 1;
-
-			// Destination
-			imageBlit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			imageBlit.dstSubresource.layerCount = 1;
-			imageBlit.dstSubresource.mipLevel = i;
-			imageBlit.dstOffsets[1].x = int32_t(texture.width >> i);
-			imageBlit.dstOffsets[1].y = int32_t(texture.height >> i);
-			imageBlit.dstOffsets[1].z = 1;
-
-			VkImageSubresourceRange mipSubRange = {};
-			mipSubRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			mipSubRange.baseMipLevel = i;
-			mipSubRange.levelCount = 1;
-			mipSubRange.layerCount = 1;
-
-			// Prepare current mip level as image blit destination
-			vks::tools::insertImageMemoryBarrier(
-				blitCmd,
-				texture.image,
-				0,
-				VK_ACCESS_TRANSFER_WRITE_BIT,
-				VK_IMAGE_LAYOUT_UNDEFINED,
-				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				VK_PIPELINE_STAGE_TRANSFER_BIT,
-				VK_PIPELINE_STAGE_TRANSFER_BIT,
-				mipSubRange);
-
-			// Blit from previous level
-			vkCmdBlitImage(
-				blitCmd,
-				texture.image,
-				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-				texture.image,
-				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				1,
-				&imageBlit,
-				VK_FILTER_LINEAR);
-
-			// Prepare current mip level as image blit source for next level
-			vks::tools::insertImageMemoryBarrier(
-				blitCmd,
-				texture.image,
-				VK_ACCESS_TRANSFER_WRITE_BIT,
-				VK_ACCESS_TRANSFER_READ_BIT,
-				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-				VK_PIPELINE_STAGE_TRANSFER_BIT,
-				VK_PIPELINE_STAGE_TRANSFER_BIT,
-				mipSubRange);
+		if (mipGenerator.isFormatSupported(format)) {
+			mipTarget = mipGenerator.createTarget(texture.image, format, texture.width, texture.height, texture.mipLevels);
 		}
-
-		// After the loop, all mip layers are in TRANSFER_SRC layout, so transition all to SHADER_READ
-		subresourceRange.levelCount = texture.mipLevels;
-		vks::tools::insertImageMemoryBarrier(
-			blitCmd,
-			texture.image,
-			VK_ACCESS_TRANSFER_READ_BIT,
-			VK_ACCESS_SHADER_READ_BIT,
-			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-			VK_PIPELINE_STAGE_TRANSFER_BIT,
-			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-			subresourceRange);
-
-		VulkanExampleBase::flushCommandBuffer(blitCmd, queue, true);
-		// ---------------------------------------------------------------
+		generateMipmaps(VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
 
 		// Create samplers
 		samplers.resize(3);
@@ -385,6 +338,131 @@ public:
 		VK_CHECK_RESULT(vkCreateImageView(device, &view, nullptr, &texture.view));
 	}
 
+	// Generate the mip chain from the base level with the selected method, baseLayout is the current layout of the base level
+	void generateMipmaps(VkImageLayout baseLayout)
+	{
+		VkCommandBuffer blitCmd = VulkanExampleBase::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		if (queryPool != VK_NULL_HANDLE) {
+			vkCmdResetQueryPool(blitCmd, queryPool, 0, 2);
+			vkCmdWriteTimestamp(blitCmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+		}
+
+		if (mipGenMethod > 0) {
+			// Compute shaders generate up to 12 levels with a single dispatch, see base/VulkanMipGenerator.hpp
+			const vks::MipGenerator::Filter filter = (mipGenMethod == 2) ? vks::MipGenerator::filterKaiser : vks::MipGenerator::filterBox;
+			const bool srgb = (mipGenMethod == 3);
+			mipGenerator.recordGenerate(blitCmd, mipTarget, filter, srgb, baseLayout, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+		}
+		else {
+			// We copy down the whole mip chain doing a blit from mip-1 to mip
+			// An alternative way would be to always blit from the first mip level and sample that one down
+			if (baseLayout != VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL) {
+				// Regenerating, the base level is sampled by the previous frames
+				VkImageSubresourceRange baseSubRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+				vks::tools::insertImageMemoryBarrier(
+					blitCmd,
+					texture.image,
+					VK_ACCESS_SHADER_READ_BIT,
+					VK_ACCESS_TRANSFER_READ_BIT,
+					baseLayout,
+					VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+					VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+					VK_PIPELINE_STAGE_TRANSFER_BIT,
+					baseSubRange);
+			}
+
+			// Copy down mips from n-1 to n
+			for (int32_t i = 1; i < texture.mipLevels; i++)
+			{
+				VkImageBlit imageBlit{};				
+
+				// Source
+				imageBlit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				imageBlit.srcSubresource.layerCount = 1;
+				imageBlit.srcSubresource.mipLevel = i-1;
+				imageBlit.srcOffsets[1].x = int32_t(texture.width >> (i - 1));
+				imageBlit.srcOffsets[1].y = int32_t(texture.height >> (i - 1));
+				imageBlit.srcOffsets[1].z = 1;
+
+				// Destination
+				imageBlit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				imageBlit.dstSubresource.layerCount = 1;
+				imageBlit.dstSubresource.mipLevel = i;
+				imageBlit.dstOffsets[1].x = int32_t(texture.width >> i);
+				imageBlit.dstOffsets[1].y = int32_t(texture.height >> i);
+				imageBlit.dstOffsets[1].z = 1;
+
+				VkImageSubresourceRange mipSubRange = {};
+				mipSubRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				mipSubRange.baseMipLevel = i;
+				mipSubRange.levelCount = 1;
+				mipSubRange.layerCount = 1;
+
+				// Prepare current mip level as image blit destination
+				vks::tools::insertImageMemoryBarrier(
+					blitCmd,
+					texture.image,
+					0,
+					VK_ACCESS_TRANSFER_WRITE_BIT,
+					VK_IMAGE_LAYOUT_UNDEFINED,
+					VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+					VK_PIPELINE_STAGE_TRANSFER_BIT,
+					VK_PIPELINE_STAGE_TRANSFER_BIT,
+					mipSubRange);
+
+				// Blit from previous level
+				vkCmdBlitImage(
+					blitCmd,
+					texture.image,
+					VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+					texture.image,
+					VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+					1,
+					&imageBlit,
+					VK_FILTER_LINEAR);
+
+				// Prepare current mip level as image blit source for next level
+				vks::tools::insertImageMemoryBarrier(
+					blitCmd,
+					texture.image,
+					VK_ACCESS_TRANSFER_WRITE_BIT,
+					VK_ACCESS_TRANSFER_READ_BIT,
+					VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+					VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+					VK_PIPELINE_STAGE_TRANSFER_BIT,
+					VK_PIPELINE_STAGE_TRANSFER_BIT,
+					mipSubRange);
+			}
+
+			// After the loop, all mip layers are in TRANSFER_SRC layout, so transition all to SHADER_READ
+			VkImageSubresourceRange subresourceRange = {};
+			subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			subresourceRange.levelCount = texture.mipLevels;
+			subresourceRange.layerCount = 1;
+			vks::tools::insertImageMemoryBarrier(
+				blitCmd,
+				texture.image,
+				VK_ACCESS_TRANSFER_READ_BIT,
+				VK_ACCESS_SHADER_READ_BIT,
+				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+				VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+				subresourceRange);
+		}
+
+		if (queryPool != VK_NULL_HANDLE) {
+			vkCmdWriteTimestamp(blitCmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+		}
+		VulkanExampleBase::flushCommandBuffer(blitCmd, queue, true);
+
+		if (queryPool != VK_NULL_HANDLE) {
+			uint64_t timestamps[2] = { 0, 0 };
+			VK_CHECK_RESULT(vkGetQueryPoolResults(device, queryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+			mipGenTime = (float)((double)(timestamps[1] - timestamps[0]) * vulkanDevice->properties.limits.timestampPeriod / 1000000.0);
+		}
+	}
+
 	// Free all Vulkan resources used a texture object
 	void destroyTextureImage(Texture texture)
 	{
@@ -434,8 +512,6 @@ public:
 
 			vkCmdDrawIndexed(drawCmdBuffers[i], models.tunnel.indexCount, 1, 0, 0, 0);
 
-			drawUI(drawCmdBuffers[i]);
-
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
 
 			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
@@ -695,6 +771,21 @@ public:
 	void prepare()
 	{
 		VulkanExampleBase::prepare();
+		mipGenerator.prepare(
+			vulkanDevice,
+			pipelineCache,
+			loadShader(getAssetPath() + "shaders/base/mipgenrgba8.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT),
+			loadShader(getAssetPath() + "shaders/base/mipgenrgba16f.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT));
+		if (mipGenBenchmark) {
+			mipGenerator.benchmark(queue, 4096, 4096);
+		}
+		if (vulkanDevice->properties.limits.timestampComputeAndGraphics) {
+			VkQueryPoolCreateInfo queryPoolInfo = {};
+			queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+			queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+			queryPoolInfo.queryCount = 2;
+			VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &queryPool));
+		}
 		loadAssets();
 		setupVertexDescriptions();
 		prepareUniformBuffers();
@@ -731,6 +822,19 @@ public:
 			if (overlay->comboBox("Sampler type", &uboVS.samplerIndex, samplerNames)) {
 				updateUniformBuffers();
 			}
+			if (overlay->comboBox("Mip generation", &mipGenMethod, mipGenNames)) {
+				// Fall back to the methods the texture format supports
+				if ((mipGenMethod == 0) && !blitSupported) {
+					mipGenMethod = 1;
+				}
+				if ((mipGenMethod > 0) && mipTarget.levelViews.empty()) {
+					mipGenMethod = 0;
+				}
+				generateMipmaps(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			}
+			if (queryPool != VK_NULL_HANDLE) {
+				overlay->text("Generation: %.3f ms", mipGenTime);
+			}
 		}
 	}
 };
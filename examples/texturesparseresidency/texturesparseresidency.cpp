@@ -6,12 +6,16 @@
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
+/*
+* Feedback driven virtual texturing: the fragment shader writes the pages it needs into a feedback buffer, which is
+* resolved on the CPU into page requests that are streamed from a tiled file into a pooled sparse texture
+* See base/VulkanVirtualTexture.hpp
+*/
+
 /*
 todos: 
-- check sparse binding support on queue
 - residencyNonResidentStrict
 - meta data
-- Run-time image data upload
 */
 
 #include <stdio.h>
@@ -20,7 +24,6 @@ todos:
 #include <assert.h>
 #include <vector>
 #include <algorithm>
-#include <random>
 #include <chrono>
 
 #define GLM_FORCE_RADIANS
@@ -34,6 +37,7 @@ todos:
 #include "VulkanDevice.hpp"
 #include "VulkanBuffer.hpp"
 #include "VulkanHeightmap.hpp"
+#include "VulkanVirtualTexture.hpp"
 
 #define VERTEX_BUFFER_BIND_ID 0
 #define ENABLE_VALIDATION false
@@ -45,157 +49,14 @@ struct Vertex {
 	float uv[2];
 };
 
-// Virtual texture page as a part of the partially resident texture
-// Contains memory bindings, offsets and status information
-struct VirtualTexturePage
-{	
-	VkOffset3D offset;
-	VkExtent3D extent;
-	VkSparseImageMemoryBind imageMemoryBind;							// Sparse image memory bind for this page
-	VkDeviceSize size;													// Page (memory) size in bytes
-	uint32_t mipLevel;													// Mip level that this page belongs to
-	uint32_t layer;														// Array layer that this page belongs to
-	uint32_t index;	
-
-	VirtualTexturePage()
-	{
-		imageMemoryBind.memory = VK_NULL_HANDLE;						// Page initially not backed up by memory
-	}
-
-	// Allocate Vulkan memory for the virtual page
-	void allocate(VkDevice device, uint32_t memoryTypeIndex)
-	{
-		if (imageMemoryBind.memory != VK_NULL_HANDLE)
-		{
-			//std::cout << "Page " << index << " already allocated" << std::endl;
-			return;
-		};
-
-		imageMemoryBind = {};
-
-		VkMemoryAllocateInfo allocInfo = vks::initializers::memoryAllocateInfo();
-		allocInfo.allocationSize = size;
-		allocInfo.memoryTypeIndex = memoryTypeIndex;
-		VK_CHECK_RESULT(vkAllocateMemory(device, &allocInfo, nullptr, &imageMemoryBind.memory));
-
-		VkImageSubresource subResource{};
-		subResource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		subResource.mipLevel = mipLevel;
-		subResource.arrayLayer = layer;
-
-		// Sparse image memory binding
-		imageMemoryBind.subresource = subResource;
-		imageMemoryBind.extent = extent;
-		imageMemoryBind.offset = offset;
-	}
-
-	// Release Vulkan memory allocated for this page
-	void release(VkDevice device)
-	{
-		if (imageMemoryBind.memory != VK_NULL_HANDLE)
-		{
-			vkFreeMemory(device, imageMemoryBind.memory, nullptr);
-			imageMemoryBind.memory = VK_NULL_HANDLE;
-			//std::cout << "Page " << index << " released" << std::endl;
-		}
-	}
-};
-
-// Virtual texture object containing all pages 
-struct VirtualTexture
-{
-	VkDevice device;
-	VkImage image;														// Texture image handle
-	VkBindSparseInfo bindSparseInfo;									// Sparse queue binding information
-	std::vector<VirtualTexturePage> pages;								// Contains all virtual pages of the texture
-	std::vector<VkSparseImageMemoryBind> sparseImageMemoryBinds;		// Sparse image memory bindings of all memory-backed virtual tables
-	std::vector<VkSparseMemoryBind>	opaqueMemoryBinds;					// Sparse ópaque memory bindings for the mip tail (if present)
-	VkSparseImageMemoryBindInfo imageMemoryBindInfo;					// Sparse image memory bind info 
-	VkSparseImageOpaqueMemoryBindInfo opaqueMemoryBindInfo;				// Sparse image opaque memory bind info (mip tail)
-	uint32_t mipTailStart;												// First mip level in mip tail
-	
-	VirtualTexturePage* addPage(VkOffset3D offset, VkExtent3D extent, const VkDeviceSize size, const uint32_t mipLevel, uint32_t layer)
-	{
-		VirtualTexturePage newPage;
-		newPage.offset = offset;
-		newPage.extent = extent;
-		newPage.size = size;
-		newPage.mipLevel = mipLevel;
-		newPage.layer = layer;
-		newPage.index = static_cast<uint32_t>(pages.size());
-		newPage.imageMemoryBind.offset = offset;
-		newPage.imageMemoryBind.extent = extent;
-		pages.push_back(newPage);
-		return &pages.back();
-	}
-
-	// Call before sparse binding to update memory bind list etc.
-	void updateSparseBindInfo()
-	{
-		// Update list of memory-backed sparse image memory binds
-		sparseImageMemoryBinds.resize(pages.size());
-		uint32_t index = 0;
-		for (auto page : pages)
-		{
-			sparseImageMemoryBinds[index] = page.imageMemoryBind;
-			index++;
-		}
-		// Update sparse bind info
-		bindSparseInfo = vks::initializers::bindSparseInfo();
-		// todo: Semaphore for queue submission
-		// bindSparseInfo.signalSemaphoreCount = 1;
-		// bindSparseInfo.pSignalSemaphores = &bindSparseSemaphore;
-
-		// Image memory binds
-		imageMemoryBindInfo.image = image;
-		imageMemoryBindInfo.bindCount = static_cast<uint32_t>(sparseImageMemoryBinds.size());
-		imageMemoryBindInfo.pBinds = sparseImageMemoryBinds.data();
-		bindSparseInfo.imageBindCount = (imageMemoryBindInfo.bindCount > 0) ? 1 : 0;
-		bindSparseInfo.pImageBinds = &imageMemoryBindInfo;
-
-		// Opaque image memory binds (mip tail)
-		opaqueMemoryBindInfo.image = image;
-		opaqueMemoryBindInfo.bindCount = static_cast<uint32_t>(opaqueMemoryBinds.size());
-		opaqueMemoryBindInfo.pBinds = opaqueMemoryBinds.data();
-		bindSparseInfo.imageOpaqueBindCount = (opaqueMemoryBindInfo.bindCount > 0) ? 1 : 0;
-		bindSparseInfo.pImageOpaqueBinds = &opaqueMemoryBindInfo;
-	}
-
-	// Release all Vulkan resources
-	void destroy()
-	{
-		for (auto page : pages)
-		{
-			page.release(device);
-		}
-		for (auto bind : opaqueMemoryBinds)
-		{
-			vkFreeMemory(device, bind.memory, nullptr);
-		}
-	}
-};
-
-uint32_t memoryTypeIndex;
-int32_t lastFilledMip = 0;
-
 class VulkanExample : public VulkanExampleBase
 {
 public:
-	//todo: comments
-	struct SparseTexture : VirtualTexture {
-		VkSampler sampler;
-		VkImageLayout imageLayout;
-		VkImageView view;
-		VkDescriptorImageInfo descriptor;
-		VkFormat format;
-		uint32_t width, height;
-		uint32_t mipLevels;
-		uint32_t layerCount;
-	} texture;
-
-	struct {
-		vks::Texture2D source;
-	} textures;
+	// Virtual texture repeating the ground texture, its pages are streamed in based on the feedback of the rendered frames
+	vks::VirtualTexture virtualTexture;
+	uint32_t virtualSize = 8192;
+	std::string tileFile = "texturesparseresidency.tiles";
+	bool showPages = false;
 
 	vks::HeightMap *heightMap = nullptr;
 
@@ -214,6 +75,13 @@ public:
 		glm::mat4 model;
 		glm::vec4 viewPos;
 		float lodBias = 0.0f;
+		// Feedback pixel selection and page layout for the fragment shader
+		uint32_t feedbackFrame = 0;
+		uint32_t feedbackWidth;
+		uint32_t feedbackBlockSize;
+		glm::uvec4 virtualSize;
+		uint32_t pagedLevels;
+		uint32_t showPages = 0;
 	} uboVS;
 
 	struct {
@@ -224,9 +92,6 @@ public:
 	VkDescriptorSet descriptorSet;
 	VkDescriptorSetLayout descriptorSetLayout;
 
-	//todo: comment
-	VkSemaphore bindSparseSemaphore = VK_NULL_HANDLE;
-
 	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
 	{
 		title = "Sparse texture residency";
@@ -243,6 +108,21 @@ public:
 		// Device features to be enabled for this example 
 		enabledFeatures.shaderResourceResidency = VK_TRUE;
 		enabledFeatures.shaderResourceMinLod = VK_TRUE;
+
+		for (size_t i = 0; i < args.size(); i++) {
+			if ((std::string(args[i]) == "-vtpool") && (i + 1 < args.size())) {
+				virtualTexture.settings.poolPages = std::max(atoi(args[i + 1]), 1);
+			}
+			if ((std::string(args[i]) == "-vtbudget") && (i + 1 < args.size())) {
+				virtualTexture.settings.uploadBudget = std::max(atoi(args[i + 1]), 1);
+			}
+			if ((std::string(args[i]) == "-vtfile") && (i + 1 < args.size())) {
+				tileFile = args[i + 1];
+			}
+		}
+#if defined(__ANDROID__)
+		tileFile = std::string(androidApp->activity->internalDataPath) + "/" + tileFile;
+#endif
 	}
 
 	~VulkanExample()
@@ -253,9 +133,7 @@ public:
 		if (heightMap)
 			delete heightMap;
 
-		destroyTextureImage(texture);
-
-		vkDestroySemaphore(device, bindSparseSemaphore, nullptr);
+		virtualTexture.destroy();
 
 		vkDestroyPipeline(device, pipelines.solid, nullptr);
 
@@ -274,324 +152,53 @@ public:
 		else {
 			std::cout << "Sparse binding not supported" << std::endl;
 		}
-	}
-
-	glm::uvec3 alignedDivision(const VkExtent3D& extent, const VkExtent3D& granularity)
-	{
-		glm::uvec3 res;
-		res.x = extent.width / granularity.width + ((extent.width  % granularity.width) ? 1u : 0u);
-		res.y = extent.height / granularity.height + ((extent.height % granularity.height) ? 1u : 0u);
-		res.z = extent.depth / granularity.depth + ((extent.depth  % granularity.depth) ? 1u : 0u);
-		return res;
-	}
-
-	void prepareSparseTexture(uint32_t width, uint32_t height, uint32_t layerCount, VkFormat format)
-	{
-		texture.device = vulkanDevice->logicalDevice;
-		texture.width = width;
-		texture.height = height;
-		texture.mipLevels = floor(log2(std::max(width, height))) + 1; 
-		texture.layerCount = layerCount;
-		texture.format = format;
-
-		// Get device properites for the requested texture format
-		VkFormatProperties formatProperties;
-		vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
-
-		// Get sparse image properties
-		std::vector<VkSparseImageFormatProperties> sparseProperties;
-		// Sparse properties count for the desired format
-		uint32_t sparsePropertiesCount;
-		vkGetPhysicalDeviceSparseImageFormatProperties(
-			physicalDevice,
-			format,
-			VK_IMAGE_TYPE_2D,
-			VK_SAMPLE_COUNT_1_BIT,
-			VK_IMAGE_USAGE_SAMPLED_BIT,
-			VK_IMAGE_TILING_OPTIMAL,
-			&sparsePropertiesCount,
-			nullptr);
-		// Check if sparse is supported for this format
-		if (sparsePropertiesCount == 0)
-		{
-			std::cout << "Error: Requested format does not support sparse features!" << std::endl;
-			return;
+		// Feedback is written from the fragment shader, the virtual texture is BC3 compressed
+		if (deviceFeatures.fragmentStoresAndAtomics) {
+			enabledFeatures.fragmentStoresAndAtomics = VK_TRUE;
 		}
-
-		// Get actual image format properties
-		sparseProperties.resize(sparsePropertiesCount);
-		vkGetPhysicalDeviceSparseImageFormatProperties(
-			physicalDevice,
-			format,
-			VK_IMAGE_TYPE_2D,
-			VK_SAMPLE_COUNT_1_BIT,
-			VK_IMAGE_USAGE_SAMPLED_BIT,
-			VK_IMAGE_TILING_OPTIMAL,
-			&sparsePropertiesCount,
-			sparseProperties.data());
-
-		std::cout << "Sparse image format properties: " << sparsePropertiesCount << std::endl;
-		for (auto props : sparseProperties)
-		{
-			std::cout << "\t Image granularity: w = " << props.imageGranularity.width << " h = " << props.imageGranularity.height << " d = " << props.imageGranularity.depth << std::endl;
-			std::cout << "\t Aspect mask: " << props.aspectMask << std::endl;
-			std::cout << "\t Flags: " << props.flags << std::endl;
+		if (deviceFeatures.textureCompressionBC) {
+			enabledFeatures.textureCompressionBC = VK_TRUE;
 		}
+	}
 
-		// Create sparse image
-		VkImageCreateInfo sparseImageCreateInfo = vks::initializers::imageCreateInfo();
-		sparseImageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-		sparseImageCreateInfo.format = texture.format;
-		sparseImageCreateInfo.mipLevels = texture.mipLevels;
-		sparseImageCreateInfo.arrayLayers = texture.layerCount;
-		sparseImageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-		sparseImageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-		sparseImageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		sparseImageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		sparseImageCreateInfo.extent = { texture.width, texture.height, 1 };
-		sparseImageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-		sparseImageCreateInfo.flags = VK_IMAGE_CREATE_SPARSE_BINDING_BIT | VK_IMAGE_CREATE_SPARSE_RESIDENCY_BIT;
-		VK_CHECK_RESULT(vkCreateImage(device, &sparseImageCreateInfo, nullptr, &texture.image));
-
-		// Get memory requirements
-		VkMemoryRequirements sparseImageMemoryReqs;
-		// Sparse image memory requirement counts
-		vkGetImageMemoryRequirements(device, texture.image, &sparseImageMemoryReqs);
-
-		std::cout << "Image memory requirements:" << std::endl;
-		std::cout << "\t Size: " << sparseImageMemoryReqs.size << std::endl;
-		std::cout << "\t Alignment: " << sparseImageMemoryReqs.alignment << std::endl;
-
-		// Check requested image size against hardware sparse limit
-		if (sparseImageMemoryReqs.size > vulkanDevice->properties.limits.sparseAddressSpaceSize)
-		{
-			std::cout << "Error: Requested sparse image size exceeds supportes sparse address space size!" << std::endl;
-			return;
-		};
-
-		// Get sparse memory requirements
-		// Count
-		uint32_t sparseMemoryReqsCount = 32;
-		std::vector<VkSparseImageMemoryRequirements> sparseMemoryReqs(sparseMemoryReqsCount);
-		vkGetImageSparseMemoryRequirements(device, texture.image, &sparseMemoryReqsCount, sparseMemoryReqs.data());
-		if (sparseMemoryReqsCount == 0)
-		{
-			std::cout << "Error: No memory requirements for the sparse image!" << std::endl;
-			return;
-		}
-		sparseMemoryReqs.resize(sparseMemoryReqsCount);
-		// Get actual requirements
-		vkGetImageSparseMemoryRequirements(device, texture.image, &sparseMemoryReqsCount, sparseMemoryReqs.data());
-
-		std::cout << "Sparse image memory requirements: " << sparseMemoryReqsCount << std::endl;
-		for (auto reqs : sparseMemoryReqs)
-		{
-			std::cout << "\t Image granularity: w = " << reqs.formatProperties.imageGranularity.width << " h = " << reqs.formatProperties.imageGranularity.height << " d = " << reqs.formatProperties.imageGranularity.depth << std::endl;
-			std::cout << "\t Mip tail first LOD: " << reqs.imageMipTailFirstLod << std::endl;
-			std::cout << "\t Mip tail size: " << reqs.imageMipTailSize << std::endl;
-			std::cout << "\t Mip tail offset: " << reqs.imageMipTailOffset << std::endl;
-			std::cout << "\t Mip tail stride: " << reqs.imageMipTailStride << std::endl;
-			//todo:multiple reqs
-			texture.mipTailStart = reqs.imageMipTailFirstLod;
+	// Create the virtual texture from its tiled file, the file is (re)written from the source texture if it doesn't match the device's page layout
+	void prepareVirtualTexture()
+	{
+		vks::VirtualTexture::PageLayout layout;
+		if (!vks::VirtualTexture::getPageLayout(vulkanDevice, VK_FORMAT_BC3_UNORM_BLOCK, virtualSize, virtualSize, layout)) {
+			vks::tools::exitFatal("Device does not support sparse residency for BC3 images of this size!", VK_ERROR_FORMAT_NOT_SUPPORTED);
 		}
-		
-		lastFilledMip = texture.mipTailStart - 1;
+		std::cout << "Virtual texture: " << layout.width << " x " << layout.height << ", " << layout.pageWidth << " x " << layout.pageHeight << " texel pages, mip tail starts at level " << layout.pagedLevels << std::endl;
 
-		// Get sparse image requirements for the color aspect
-		VkSparseImageMemoryRequirements sparseMemoryReq;
-		bool colorAspectFound = false;
-		for (auto reqs : sparseMemoryReqs)
-		{
-			if (reqs.formatProperties.aspectMask & VK_IMAGE_ASPECT_COLOR_BIT)
-			{
-				sparseMemoryReq = reqs;
-				colorAspectFound = true;
-				break;
+		if (!virtualTexture.open(tileFile, vulkanDevice, queue, layout)) {
+			std::cout << "Writing tiled virtual texture \"" << tileFile << "\"" << std::endl;
+			const std::string filename = getAssetPath() + "textures/ground_dry_bc3_unorm.ktx";
+			ktxTexture *source = nullptr;
+			ktxResult result;
+#if defined(__ANDROID__)
+			AAsset *asset = AAssetManager_open(androidApp->activity->assetManager, filename.c_str(), AASSET_MODE_STREAMING);
+			if (!asset) {
+				vks::tools::exitFatal("Could not load texture from " + filename + "\n\nThe file may be part of the additional asset pack.\n\nRun \"download_assets.py\" in the repository root to download the latest version.", -1);
 			}
-		}
-		if (!colorAspectFound)
-		{
-			std::cout << "Error: Could not find sparse image memory requirements for color aspect bit!" << std::endl;
-			return;
-		}
-
-		// todo:
-		// Calculate number of required sparse memory bindings by alignment
-		assert((sparseImageMemoryReqs.size % sparseImageMemoryReqs.alignment) == 0);
-		memoryTypeIndex = vulkanDevice->getMemoryType(sparseImageMemoryReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-		// Get sparse bindings
-		uint32_t sparseBindsCount = static_cast<uint32_t>(sparseImageMemoryReqs.size / sparseImageMemoryReqs.alignment);		
-		std::vector<VkSparseMemoryBind>	sparseMemoryBinds(sparseBindsCount);
-
-		// Check if the format has a single mip tail for all layers or one mip tail for each layer
-		// The mip tail contains all mip levels > sparseMemoryReq.imageMipTailFirstLod
-		bool singleMipTail = sparseMemoryReq.formatProperties.flags & VK_SPARSE_IMAGE_FORMAT_SINGLE_MIPTAIL_BIT;
-
-		// Sparse bindings for each mip level of all layers outside of the mip tail
-		for (uint32_t layer = 0; layer < texture.layerCount; layer++)
-		{
-			// sparseMemoryReq.imageMipTailFirstLod is the first mip level that's stored inside the mip tail
-			for (uint32_t mipLevel = 0; mipLevel < sparseMemoryReq.imageMipTailFirstLod; mipLevel++)
-			{
-				VkExtent3D extent;
-				extent.width = std::max(sparseImageCreateInfo.extent.width >> mipLevel, 1u);
-				extent.height = std::max(sparseImageCreateInfo.extent.height >> mipLevel, 1u);
-				extent.depth = std::max(sparseImageCreateInfo.extent.depth >> mipLevel, 1u);
-
-				VkImageSubresource subResource{};
-				subResource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-				subResource.mipLevel = mipLevel;
-				subResource.arrayLayer = layer;
-
-				// Aligned sizes by image granularity
-				VkExtent3D imageGranularity = sparseMemoryReq.formatProperties.imageGranularity;
-				glm::uvec3 sparseBindCounts = alignedDivision(extent, imageGranularity);
-				glm::uvec3 lastBlockExtent;
-				lastBlockExtent.x = (extent.width % imageGranularity.width) ? extent.width % imageGranularity.width : imageGranularity.width;
-				lastBlockExtent.y = (extent.height % imageGranularity.height) ? extent.height % imageGranularity.height : imageGranularity.height;
-				lastBlockExtent.z = (extent.depth % imageGranularity.depth) ? extent.depth % imageGranularity.depth : imageGranularity.depth;
-
-				// Alllocate memory for some blocks
-				uint32_t index = 0;
-				for (uint32_t z = 0; z < sparseBindCounts.z; z++)
-				{
-					for (uint32_t y = 0; y < sparseBindCounts.y; y++)
-					{
-						for (uint32_t x = 0; x < sparseBindCounts.x; x++)
-						{
-							// Offset 
-							VkOffset3D offset;
-							offset.x = x * imageGranularity.width;
-							offset.y = y * imageGranularity.height;
-							offset.z = z * imageGranularity.depth;
-							// Size of the page
-							VkExtent3D extent;
-							extent.width = (x == sparseBindCounts.x - 1) ? lastBlockExtent.x : imageGranularity.width;
-							extent.height = (y == sparseBindCounts.y - 1) ? lastBlockExtent.y : imageGranularity.height;
-							extent.depth = (z == sparseBindCounts.z - 1) ? lastBlockExtent.z : imageGranularity.depth;
-
-							// Add new virtual page
-							VirtualTexturePage *newPage = texture.addPage(offset, extent, sparseImageMemoryReqs.alignment, mipLevel, layer);
-							newPage->imageMemoryBind.subresource = subResource;
-
-							if ((x % 2 == 1) || (y % 2 == 1))
-							{
-								// Allocate memory for this virtual page
-								//newPage->allocate(device, memoryTypeIndex);
-							}
-
-							index++;
-						}
-					}
-				}
+			size_t size = AAsset_getLength(asset);
+			std::vector<ktx_uint8_t> data(size);
+			AAsset_read(asset, data.data(), size);
+			AAsset_close(asset);
+			result = ktxTexture_CreateFromMemory(data.data(), size, KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &source);
+#else
+			if (!vks::tools::fileExists(filename)) {
+				vks::tools::exitFatal("Could not load texture from " + filename + "\n\nThe file may be part of the additional asset pack.\n\nRun \"download_assets.py\" in the repository root to download the latest version.", -1);
 			}
-
-			// Check if format has one mip tail per layer
-			if ((!singleMipTail) && (sparseMemoryReq.imageMipTailFirstLod < texture.mipLevels))
-			{
-				// Allocate memory for the mip tail
-				VkMemoryAllocateInfo allocInfo = vks::initializers::memoryAllocateInfo();
-				allocInfo.allocationSize = sparseMemoryReq.imageMipTailSize;
-				allocInfo.memoryTypeIndex = memoryTypeIndex;
-
-				VkDeviceMemory deviceMemory;
-				VK_CHECK_RESULT(vkAllocateMemory(device, &allocInfo, nullptr, &deviceMemory));
-
-				// (Opaque) sparse memory binding
-				VkSparseMemoryBind sparseMemoryBind{};
-				sparseMemoryBind.resourceOffset = sparseMemoryReq.imageMipTailOffset + layer * sparseMemoryReq.imageMipTailStride;
-				sparseMemoryBind.size = sparseMemoryReq.imageMipTailSize;
-				sparseMemoryBind.memory = deviceMemory;
-
-				texture.opaqueMemoryBinds.push_back(sparseMemoryBind);
+			result = ktxTexture_CreateFromNamedFile(filename.c_str(), KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &source);
+#endif
+			assert(result == KTX_SUCCESS);
+			const bool written = vks::VirtualTexture::writeTiledFile(tileFile, source, layout);
+			ktxTexture_Destroy(source);
+			if (!written || !virtualTexture.open(tileFile, vulkanDevice, queue, layout)) {
+				vks::tools::exitFatal("Could not create the tiled virtual texture \"" + tileFile + "\"", -1);
 			}
-		} // end layers and mips
-
-		std::cout << "Texture info:" << std::endl;
-		std::cout << "\tDim: " << texture.width << " x " << texture.height << std::endl;
-		std::cout << "\tVirtual pages: " << texture.pages.size() << std::endl;
-
-		// Check if format has one mip tail for all layers
-		if ((sparseMemoryReq.formatProperties.flags & VK_SPARSE_IMAGE_FORMAT_SINGLE_MIPTAIL_BIT) && (sparseMemoryReq.imageMipTailFirstLod < texture.mipLevels))
-		{
-			// Allocate memory for the mip tail
-			VkMemoryAllocateInfo allocInfo = vks::initializers::memoryAllocateInfo();
-			allocInfo.allocationSize = sparseMemoryReq.imageMipTailSize;
-			allocInfo.memoryTypeIndex = memoryTypeIndex;
-
-			VkDeviceMemory deviceMemory;
-			VK_CHECK_RESULT(vkAllocateMemory(device, &allocInfo, nullptr, &deviceMemory));
-
-			// (Opaque) sparse memory binding
-			VkSparseMemoryBind sparseMemoryBind{};
-			sparseMemoryBind.resourceOffset = sparseMemoryReq.imageMipTailOffset;
-			sparseMemoryBind.size = sparseMemoryReq.imageMipTailSize;
-			sparseMemoryBind.memory = deviceMemory;
-
-			texture.opaqueMemoryBinds.push_back(sparseMemoryBind);
 		}
-
-		// Create signal semaphore for sparse binding
-		VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
-		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &bindSparseSemaphore));
-
-		// Prepare bind sparse info for reuse in queue submission
-		texture.updateSparseBindInfo();
-
-		// Bind to queue
-		// todo: in draw?
-		vkQueueBindSparse(queue, 1, &texture.bindSparseInfo, VK_NULL_HANDLE);
-		//todo: use sparse bind semaphore
-		vkQueueWaitIdle(queue);
-
-		// Create sampler
-		VkSamplerCreateInfo sampler = vks::initializers::samplerCreateInfo();
-		sampler.magFilter = VK_FILTER_LINEAR;
-		sampler.minFilter = VK_FILTER_LINEAR;
-		sampler.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-		sampler.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-		sampler.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-		sampler.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-		sampler.mipLodBias = 0.0f;
-		sampler.compareOp = VK_COMPARE_OP_NEVER;
-		sampler.minLod = 0.0f;
-		sampler.maxLod = static_cast<float>(texture.mipLevels);
-		sampler.maxAnisotropy = vulkanDevice->features.samplerAnisotropy ? vulkanDevice->properties.limits.maxSamplerAnisotropy : 1.0f;
-		sampler.anisotropyEnable = false;
-		sampler.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-		VK_CHECK_RESULT(vkCreateSampler(device, &sampler, nullptr, &texture.sampler));
-
-		// Create image view
-		VkImageViewCreateInfo view = vks::initializers::imageViewCreateInfo();
-		view.image = VK_NULL_HANDLE;
-		view.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		view.format = format;
-		view.components = { VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A };
-		view.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		view.subresourceRange.baseMipLevel = 0;
-		view.subresourceRange.baseArrayLayer = 0;
-		view.subresourceRange.layerCount = 1;
-		view.subresourceRange.levelCount = texture.mipLevels;
-		view.image = texture.image;
-		VK_CHECK_RESULT(vkCreateImageView(device, &view, nullptr, &texture.view));
-
-		// Fill image descriptor image info that can be used during the descriptor set setup
-		texture.descriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		texture.descriptor.imageView = texture.view;
-		texture.descriptor.sampler = texture.sampler;
-
-		// Fill smallest (non-tail) mip map leve
-		fillVirtualTexture(lastFilledMip);
-	}
-
-	// Free all Vulkan resources used a texture object
-	void destroyTextureImage(SparseTexture texture)
-	{
-		vkDestroyImageView(device, texture.view, nullptr);
-		vkDestroyImage(device, texture.image, nullptr);
-		vkDestroySampler(device, texture.sampler, nullptr);
-		texture.destroy();
+		virtualTexture.createFeedbackBuffer(width, height);
 	}
 
 	void buildCommandBuffers()
@@ -618,6 +225,8 @@ public:
 
 			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
+			virtualTexture.recordFeedbackClear(drawCmdBuffers[i]);
+
 			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 			VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
@@ -634,10 +243,10 @@ public:
 			vkCmdBindIndexBuffer(drawCmdBuffers[i], heightMap->indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
 			vkCmdDrawIndexed(drawCmdBuffers[i], heightMap->indexCount, 1, 0, 0, 0);
 
-			drawUI(drawCmdBuffers[i]);
-
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
 
+			virtualTexture.recordFeedbackBarrier(drawCmdBuffers[i]);
+
 			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
 		}
 	}
@@ -646,26 +255,30 @@ public:
 	{
 		VulkanExampleBase::prepareFrame();
 
-		// Sparse bindings
-//		vkQueueBindSparse(queue, 1, &bindSparseInfo, VK_NULL_HANDLE);
-		//todo: use sparse bind semaphore
-//		vkQueueWaitIdle(queue);
+		// Resolve the feedback of the previous frame (completed in submitFrame) and bind and upload pages
+		virtualTexture.update();
+		uboVS.feedbackFrame++;
+		memcpy(uniformBufferVS.mapped, &uboVS, sizeof(uboVS));
 
-		// Command buffer to be sumitted to the queue
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
+		// The frame waits for the page uploads and signals the semaphore the next sparse binding waits on
+		VkSemaphore waitSemaphores[2] = { semaphores.presentComplete, virtualTexture.waitSemaphore };
+		VkPipelineStageFlags waitStages[2] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT };
+		VkSemaphore signalSemaphores[2] = { semaphores.renderComplete, virtualTexture.frameSemaphore };
+		VkSubmitInfo frameSubmitInfo = submitInfo;
+		frameSubmitInfo.waitSemaphoreCount = 2;
+		frameSubmitInfo.pWaitSemaphores = waitSemaphores;
+		frameSubmitInfo.pWaitDstStageMask = waitStages;
+		frameSubmitInfo.signalSemaphoreCount = 2;
+		frameSubmitInfo.pSignalSemaphores = signalSemaphores;
+		frameSubmitInfo.commandBufferCount = 1;
+		frameSubmitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
 
 		// Submit to queue
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &frameSubmitInfo, VK_NULL_HANDLE));
 
 		VulkanExampleBase::submitFrame();
 	}
 
-	void loadAssets()
-	{
-		textures.source.loadFromFile(getAssetPath() + "textures/ground_dry_bc3_unorm.ktx", VK_FORMAT_BC3_UNORM_BLOCK, vulkanDevice, queue, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
-	}
-
 	// Generate a terrain quad patch for feeding to the tessellation control shader
 	void generateTerrain()
 	{
@@ -721,11 +334,12 @@ public:
 
 	void setupDescriptorPool()
 	{
-		// Example uses one ubo and one image sampler
+		// Example uses one ubo, one image sampler and the feedback buffer
 		std::vector<VkDescriptorPoolSize> poolSizes =
 		{
 			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1),
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1)
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1),
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1)
 		};
 
 		VkDescriptorPoolCreateInfo descriptorPoolInfo = 
@@ -741,16 +355,21 @@ public:
 	{
 		std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = 
 		{
-			// Binding 0 : Vertex shader uniform buffer
+			// Binding 0 : Vertex and fragment shader uniform buffer
 			vks::initializers::descriptorSetLayoutBinding(
 				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 
-				VK_SHADER_STAGE_VERTEX_BIT, 
+				VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 
 				0),
 			// Binding 1 : Fragment shader image sampler
 			vks::initializers::descriptorSetLayoutBinding(
 				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 
 				VK_SHADER_STAGE_FRAGMENT_BIT, 
-				1)
+				1),
+			// Binding 2 : Fragment shader virtual texture feedback
+			vks::initializers::descriptorSetLayoutBinding(
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 
+				VK_SHADER_STAGE_FRAGMENT_BIT, 
+				2)
 		};
 
 		VkDescriptorSetLayoutCreateInfo descriptorLayout = 
@@ -791,7 +410,13 @@ public:
 				descriptorSet, 
 				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 
 				1, 
-				&texture.descriptor)
+				&virtualTexture.descriptor),
+			// Binding 2 : Fragment shader virtual texture feedback
+			vks::initializers::writeDescriptorSet(
+				descriptorSet, 
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 
+				2, 
+				&virtualTexture.feedbackBuffer.descriptor)
 		};
 
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
@@ -882,6 +507,8 @@ public:
 			&uniformBufferVS,
 			sizeof(uboVS),
 			&uboVS));
+		// Stays mapped, the feedback frame index changes every frame
+		VK_CHECK_RESULT(uniformBufferVS.map());
 
 		updateUniformBuffers();
 	}
@@ -891,10 +518,13 @@ public:
 		uboVS.projection = camera.matrices.perspective;
 		uboVS.model = camera.matrices.view;
 		uboVS.viewPos = glm::vec4(0.0f, 0.0f, -zoom, 0.0f);
+		uboVS.feedbackWidth = virtualTexture.feedbackWidth;
+		uboVS.feedbackBlockSize = virtualTexture.settings.feedbackBlockSize;
+		uboVS.virtualSize = glm::uvec4(virtualTexture.layout.width, virtualTexture.layout.height, virtualTexture.layout.pageWidth, virtualTexture.layout.pageHeight);
+		uboVS.pagedLevels = virtualTexture.layout.pagedLevels;
+		uboVS.showPages = showPages ? 1 : 0;
 
-		VK_CHECK_RESULT(uniformBufferVS.map());
 		memcpy(uniformBufferVS.mapped, &uboVS, sizeof(uboVS));
-		uniformBufferVS.unmap();
 	}
 
 	void prepare()
@@ -904,12 +534,14 @@ public:
 		if (!vulkanDevice->features.sparseResidencyImage2D) {
 			vks::tools::exitFatal("Device does not support sparse residency for 2D images!", VK_ERROR_FEATURE_NOT_PRESENT);
 		}
-		loadAssets();
+		if (!vulkanDevice->features.fragmentStoresAndAtomics || !vulkanDevice->features.textureCompressionBC) {
+			vks::tools::exitFatal("Device does not support fragment shader stores or BC texture compression!", VK_ERROR_FEATURE_NOT_PRESENT);
+		}
 		generateTerrain();
 		setupVertexDescriptions();
+		// Create a virtual texture with max. possible dimension (only the page pool and the mip tail take up VRAM)
+		prepareVirtualTexture();
 		prepareUniformBuffers();
-		// Create a virtual texture with max. possible dimension (does not take up any VRAM yet)
-		prepareSparseTexture(8192, 8192, 1, VK_FORMAT_R8G8B8A8_UNORM);
 		setupDescriptorSetLayout();
 		preparePipelines();
 		setupDescriptorPool();
@@ -930,124 +562,42 @@ public:
 		updateUniformBuffers();
 	}
 
-	// Clear all pages of the virtual texture
-	// todo: just for testing
-	void flushVirtualTexture()
-	{
-		vkDeviceWaitIdle(device);
-		for (auto& page : texture.pages)
-		{
-			page.release(device);
-		}
-		texture.updateSparseBindInfo();
-		vkQueueBindSparse(queue, 1, &texture.bindSparseInfo, VK_NULL_HANDLE);
-		//todo: use sparse bind semaphore
-		vkQueueWaitIdle(queue);
-		lastFilledMip = texture.mipTailStart - 1;
-	}
-
-	// Fill a complete mip level
-	void fillVirtualTexture(int32_t &mipLevel)
+	virtual void windowResized()
 	{
-		vkDeviceWaitIdle(device);
-		std::vector<VkImageBlit> imageBlits;
-		for (auto& page : texture.pages)
-		{
-			if ((page.mipLevel == mipLevel) && /*(rndDist(rndEngine) < 0.5f) &&*/ (page.imageMemoryBind.memory == VK_NULL_HANDLE))
-			{
-				// Allocate page memory
-				page.allocate(device, memoryTypeIndex);
-
-				// Current mip level scaling
-				uint32_t scale = texture.width / (texture.width >> page.mipLevel);
-
-				for (uint32_t x = 0; x < scale; x++)
-				{
-					for (uint32_t y = 0; y < scale; y++)
-					{
-						// Image blit
-						VkImageBlit blit{};
-						// Source
-						blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-						blit.srcSubresource.baseArrayLayer = 0;
-						blit.srcSubresource.layerCount = 1;
-						blit.srcSubresource.mipLevel = 0;
-						blit.srcOffsets[0] = { 0, 0, 0 };
-						blit.srcOffsets[1] = { static_cast<int32_t>(textures.source.width), static_cast<int32_t>(textures.source.height), 1 };
-						// Dest
-						blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-						blit.dstSubresource.baseArrayLayer = 0;
-						blit.dstSubresource.layerCount = 1;
-						blit.dstSubresource.mipLevel = page.mipLevel;
-						blit.dstOffsets[0].x = static_cast<int32_t>(page.offset.x + x * 128 / scale);
-						blit.dstOffsets[0].y = static_cast<int32_t>(page.offset.y + y * 128 / scale);
-						blit.dstOffsets[0].z = 0;
-						blit.dstOffsets[1].x = static_cast<int32_t>(blit.dstOffsets[0].x + page.extent.width / scale);
-						blit.dstOffsets[1].y = static_cast<int32_t>(blit.dstOffsets[0].y + page.extent.height / scale);
-						blit.dstOffsets[1].z = 1;
-
-						imageBlits.push_back(blit);
-					}
-				}
-			}
+		// The feedback buffer covers the frame
+		if (virtualTexture.createFeedbackBuffer(width, height)) {
+			VkWriteDescriptorSet writeDescriptorSet = vks::initializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &virtualTexture.feedbackBuffer.descriptor);
+			vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, NULL);
+			buildCommandBuffers();
 		}
-
-		// Update sparse queue binding
-		texture.updateSparseBindInfo();
-		vkQueueBindSparse(queue, 1, &texture.bindSparseInfo, VK_NULL_HANDLE);
-		//todo: use sparse bind semaphore
-		vkQueueWaitIdle(queue);
-
-		// Issue blit commands
-		if (imageBlits.size() > 0)
-		{
-			auto tStart = std::chrono::high_resolution_clock::now();
-
-			VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-			vkCmdBlitImage(
-				copyCmd,
-				textures.source.image,
-				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-				texture.image,
-				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				static_cast<uint32_t>(imageBlits.size()),
-				imageBlits.data(),
-				VK_FILTER_LINEAR
-			);
-
-			vulkanDevice->flushCommandBuffer(copyCmd, queue);
-
-			auto tEnd = std::chrono::high_resolution_clock::now();
-			auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
-			std::cout << "Image blits took " << tDiff << " ms" << std::endl;
-		}
-
-		vkQueueWaitIdle(queue);
-
-		mipLevel--;
 	}
 
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
 	{
 		if (overlay->header("Settings")) {
-			if (overlay->sliderFloat("LOD bias", &uboVS.lodBias, 0.0f, (float)texture.mipLevels)) {
+			if (overlay->sliderFloat("LOD bias", &uboVS.lodBias, 0.0f, (float)virtualTexture.layout.mipLevels)) {
+				updateUniformBuffers();
+			}
+			if (overlay->checkBox("Show sampled levels", &showPages)) {
 				updateUniformBuffers();
 			}
-			overlay->text("Last filled mip level: %d", lastFilledMip);
-			if (overlay->button("Fill next mip level")) {
-				if (lastFilledMip >= 0) {
-					fillVirtualTexture(lastFilledMip);
-				}
+			int32_t uploadBudget = virtualTexture.settings.uploadBudget;
+			if (overlay->sliderInt("Pages per frame", &uploadBudget, 1, 64)) {
+				virtualTexture.settings.uploadBudget = uploadBudget;
 			}
 			if (overlay->button("Flush virtual texture")) {
-				flushVirtualTexture();
+				virtualTexture.flush();
 			}
 		}
 		if (overlay->header("Statistics")) {
-			uint32_t respages = 0;
-			std::for_each(texture.pages.begin(), texture.pages.end(), [&respages](VirtualTexturePage page) { respages += (page.imageMemoryBind.memory != VK_NULL_HANDLE) ? 1 : 0; });
-			overlay->text("Resident pages: %d of %d", respages, static_cast<uint32_t>(texture.pages.size()));
+			const vks::VirtualTexture::Statistics &stats = virtualTexture.stats;
+			overlay->text("Resident pages: %d / %d (%d total)", stats.residentPages, virtualTexture.settings.poolPages, stats.totalPages);
+			overlay->text("Requested pages: %d", stats.requestedPages);
+			overlay->text("Pending pages: %d", stats.pendingPages);
+			overlay->text("Uploads: %d this frame, %d total", stats.frameUploads, (uint32_t)stats.uploads);
+			overlay->text("Evictions: %d", (uint32_t)stats.evictions);
+			overlay->text("Feedback resolve: %.2f ms", stats.resolveTime);
+			overlay->text("Page pool: %.1f MB", stats.poolMemory / (1024.0f * 1024.0f));
 		}
 
 	}